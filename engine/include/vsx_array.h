@@ -35,6 +35,13 @@
 // * DON'T POINT TO ANY ELEMENT/DATA STORED IN THE ARRAY
 //   (data is realloc'd, such pointers would be invalid)
 // Now you've been warned, use it for speed!
+//
+// Sharing: share() makes an array refer to another one's buffer without
+// copying, with the buffer reference counted. Whoever resets (reset_used)
+// or grows a shared array gets storage of its own first, the others keep
+// the old contents. Plain in-place writes through operator[] or
+// get_pointer() are seen by everyone sharing the buffer, so start a
+// rewrite with reset_used() or call unshare().
 
 template<class T>
 class vsx_array {
@@ -43,6 +50,19 @@ class vsx_array {
   T* A;
   size_t allocation_increment;
   size_t data_volatile;
+  size_t* refs; // holders of A when shared, 0 when A is ours alone
+
+  // gives up our reference to a shared A, freeing it if we were the last
+  void release_shared()
+  {
+    if (__sync_sub_and_fetch(refs, 1) == 0)
+    {
+      free(refs);
+      free(A);
+    }
+    refs = 0;
+    A = 0;
+  }
 
 public:
   size_t timestamp;
@@ -53,6 +73,8 @@ public:
 
   void set_data(T* nA, int nsize)
   {
+    if (refs)
+      release_shared();
   	A = nA;
   	used = allocated = nsize;
   }
@@ -60,10 +82,70 @@ public:
   // clones another array of same type into this one
   void clone(vsx_array<T>* F)
   {
+    unshare(false);
     allocate(F->size());
+    used = F->size();
     memcpy((void*)A, (void*)(F->get_pointer()), sizeof(T) * used);
   }
 
+  // Refers to other's buffer instead of holding a copy, see the top of
+  // the file. Takes over its timestamp as well.
+  void share(vsx_array<T>& other)
+  {
+    if (&other == this)
+      return;
+    if (other.data_volatile)
+    {
+      // borrowed memory can't be reference counted, copy it
+      clone(&other);
+      timestamp = other.timestamp;
+      return;
+    }
+    if (!(refs && refs == other.refs))
+    {
+      clear();
+      data_volatile = 0;
+      if (other.A)
+      {
+        if (!other.refs)
+        {
+          other.refs = (size_t*)malloc(sizeof(size_t));
+          *other.refs = 1;
+        }
+        __sync_add_and_fetch(other.refs, 1);
+        refs = other.refs;
+        A = other.A;
+      }
+    }
+    used = other.used;
+    allocated = other.allocated;
+    timestamp = other.timestamp;
+  }
+
+  // makes A ours alone, copying the contents if keep_data is set
+  void unshare(bool keep_data = true)
+  {
+    if (!refs)
+      return;
+    if (*refs == 1)
+    {
+      // everyone else let go already
+      free(refs);
+      refs = 0;
+      return;
+    }
+    T* n = (T*)malloc(sizeof(T) * (allocated ? allocated : 1));
+    if (keep_data)
+      memcpy((void*)n, (void*)A, sizeof(T) * used);
+    release_shared();
+    A = n;
+  }
+
+  bool is_shared()
+  {
+    return refs != 0 && *refs > 1;
+  }
+
   void set_volatile() {
     if (0 == data_volatile && A && allocated)
     {
@@ -109,6 +191,9 @@ public:
 
   void clear() {
     if (data_volatile) { return; }
+    if (refs)
+      release_shared();
+    else
   	if (A)
     free(A);
     A = 0;
@@ -118,18 +203,52 @@ public:
 
   void memory_clear()
   {
+    unshare(false);
     memset(A, 0, sizeof(T) * allocated);
   }
 
   void reset_used(size_t val = 0) {
   	// TODO: if value larger than count of allocated items in memory handle this some way
+    if (refs)
+    {
+      if (val < used)
+        used = val;
+      unshare(val != 0);
+    }
     used = val;
   }
 
+  // Makes size() == count and returns the storage. The first items are
+  // kept unless keep_data is false, new ones are uninitialized. Like
+  // reset_used(), a shared array gets storage of its own first, so it's
+  // safe to write to everything up to count afterwards.
+  T* resize(size_t count, bool keep_data = true)
+  {
+    if (refs)
+    {
+      if (count < used)
+        used = count;
+      unshare(keep_data && count != 0);
+    }
+    if (count)
+      allocate(count - 1);
+    used = count;
+    return A;
+  }
+
   void allocate(size_t index) {
     if (index >= allocated || allocated == 0)
     {
     	if (allocation_increment == 0) allocation_increment = 1;
+      if (refs)
+      {
+        // growing a shared buffer, move to our own
+        T* n = (T*)malloc(sizeof(T)*(index+allocation_increment));
+        memcpy((void*)n, (void*)A, sizeof(T) * (used < index ? used : index));
+        release_shared();
+        A = n;
+        allocated = index+allocation_increment;
+      } else
       if (A)
       {
         allocated = index + allocation_increment;
@@ -150,9 +269,12 @@ public:
     return A[index];
   }
 
-  vsx_array() : allocated(0),used(0),A(0),allocation_increment(1),data_volatile(0),timestamp(0) {};
+  vsx_array() : allocated(0),used(0),A(0),allocation_increment(1),data_volatile(0),refs(0),timestamp(0) {};
   ~vsx_array() {
     if (data_volatile) return;
+    if (refs)
+      release_shared();
+    else
   	if (A) free(A);
   }
 };
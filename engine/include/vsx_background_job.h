@@ -0,0 +1,134 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#ifndef VSX_BACKGROUND_JOB_H
+#define VSX_BACKGROUND_JOB_H
+
+#include <pthread.h>
+#include "vsx_thread_pool.h"
+
+// One job at a time on the thread pool, handed over between a module and
+// the pool:
+//
+//   idle --start()--> working --(job returns)--> done --collect()--> idle
+//
+// start(), collect(), busy() and working() are for the owner's thread
+// (normally run()), the job only ever moves working to done. Whatever the
+// job writes is the owner's once collect() has returned true, so results
+// need no locking of their own. Before freeing anything the job uses,
+// wait() for it; the destructor does too, but in a module the buffers are
+// usually gone by then.
+
+#define VSX_BACKGROUND_JOB_IDLE 0
+#define VSX_BACKGROUND_JOB_WORKING 1
+#define VSX_BACKGROUND_JOB_DONE 2
+
+class vsx_background_job
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int state;
+  vsx_thread_pool_job_func func;
+  void* arg;
+
+  static void job(void* ptr)
+  {
+    vsx_background_job* j = (vsx_background_job*)ptr;
+    j->func(j->arg);
+    pthread_mutex_lock(&j->mutex);
+    j->state = VSX_BACKGROUND_JOB_DONE;
+    pthread_cond_broadcast(&j->cond);
+    pthread_mutex_unlock(&j->mutex);
+  }
+
+  int get_state()
+  {
+    pthread_mutex_lock(&mutex);
+    int s = state;
+    pthread_mutex_unlock(&mutex);
+    return s;
+  }
+
+public:
+
+  vsx_background_job()
+  {
+    state = VSX_BACKGROUND_JOB_IDLE;
+    func = 0;
+    arg = 0;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~vsx_background_job()
+  {
+    wait();
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  // only when idle
+  void start(vsx_thread_pool_job_func n_func, void* n_arg)
+  {
+    func = n_func;
+    arg = n_arg;
+    // no lock needed, nothing else touches state while idle
+    state = VSX_BACKGROUND_JOB_WORKING;
+    vsx_thread_pool::get_instance()->add_job(&job, (void*)this);
+  }
+
+  // the job is running
+  bool working()
+  {
+    return get_state() == VSX_BACKGROUND_JOB_WORKING;
+  }
+
+  // running or finished but not collected yet, start() has to wait
+  bool busy()
+  {
+    return get_state() != VSX_BACKGROUND_JOB_IDLE;
+  }
+
+  // true once for every finished job, going back to idle
+  bool collect()
+  {
+    pthread_mutex_lock(&mutex);
+    bool done = state == VSX_BACKGROUND_JOB_DONE;
+    if (done)
+      state = VSX_BACKGROUND_JOB_IDLE;
+    pthread_mutex_unlock(&mutex);
+    return done;
+  }
+
+  // blocks while the job is running
+  void wait()
+  {
+    pthread_mutex_lock(&mutex);
+    while (state == VSX_BACKGROUND_JOB_WORKING)
+      pthread_cond_wait(&cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+};
+
+#endif
@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <vector>
 #include <vsx_string.h>
 #include <vsx_command.h>
 
@@ -41,22 +42,65 @@
 #define VSX_COMMAND_CLIENT_CONNECTED 1
 #define VSX_COMMAND_CLIENT_DISCONNECTED 2
 
+#define VSX_COMMAND_SERVER_PORT "11030"
+
+class vsx_command_server_connection;
+
+// Serves the command lists to any number of clients over TCP.
+//
+// Commands from every client go to cmd_in. Everything in cmd_out goes to
+// all connected clients, batched into one write per client each time the
+// server is flushed.
+//
+// Clients speak the line protocol: one command per line, "_" is a
+// keepalive and "dc" disconnects. A client that sends the line "binary"
+// switches its connection, both ways, to frames of a 4 byte big endian
+// length followed by one command (length 0 is a keepalive).
 class vsx_command_list_server
 {
   pthread_t         worker_t;
   pthread_attr_t    worker_t_attr;
   vsx_command_list* cmd_in;
   vsx_command_list* cmd_out;
+  vsx_string port;
+
+  int listen_sock;
+  // epoll instance on linux, unused with poll
+  int event_sock;
+  // flush() writes a byte here to wake the worker
+  int wake_pipe[2];
+  std::vector<vsx_command_server_connection*> connections;
+  bool running;
+  // set by stop(), the worker checks it each time it wakes
+  volatile bool stopping;
 
   // internal worker method
   static void* server_worker(void *ptr);
 
+  bool listen_on_port();
+  void watch(vsx_command_server_connection* c, bool add);
+  void accept_connections();
+  void read_connection(vsx_command_server_connection* c);
+  void message(vsx_command_server_connection* c, const char* data, size_t size);
+  void write_connection(vsx_command_server_connection* c);
+  void send_commands();
+  void send_keepalives();
+  void remove_closed();
+
 public:
   vsx_command_list_server();
+  ~vsx_command_list_server();
   // set the command lists on which the server class operates
   void set_command_lists(vsx_command_list* new_in, vsx_command_list* new_out);
   // start the server (after setting command_lists)
-  bool start();
+  bool start(const char* listen_port = VSX_COMMAND_SERVER_PORT);
+  // disconnect all clients, close the port and wait for the worker to
+  // finish; start() may be called again after
+  void stop();
+  // send what's in cmd_out now, call once a frame after the engine has
+  // processed the message queue. Without it the server sends on its own
+  // every few milliseconds.
+  void flush();
 };
 
 
@@ -37,6 +37,30 @@
 
 #include <vsx_platform.h>
 
+// SIMD backend, picked at compile time. The matrix and quaternion
+// products below, the batch kernels (vsx_vector_batch.h,
+// vsx_quaternion_batch.h) and the SSE code in the engine headers and
+// plugins all test these instead of __SSE__, so defining
+// VSX_MATH_3D_NO_SIMD turns every SIMD path off and leaves the plain
+// scalar code. VSX_MATH_3D_SSE2 is set as well where the integer SSE2
+// instructions are available.
+//
+// The NEON backend isn't built or tested anywhere yet, so it's opt in:
+// define VSX_MATH_3D_ENABLE_NEON to use it on ARM.
+#if !defined(VSX_MATH_3D_NO_SIMD)
+  #if defined(__SSE__)
+    #include <xmmintrin.h>
+    #define VSX_MATH_3D_SSE
+    #if defined(__SSE2__)
+      #include <emmintrin.h>
+      #define VSX_MATH_3D_SSE2
+    #endif
+  #elif defined(VSX_MATH_3D_ENABLE_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+    #include <arm_neon.h>
+    #define VSX_MATH_3D_NEON
+  #endif
+#endif
+
 #if PLATFORM_FAMILY == PLATFORM_FAMILY_UNIX
 #define VSX_MATH_3D_DLLIMPORT
 #else
@@ -574,7 +598,54 @@ public:
         }
     }
 
+  // this = a * b, a and/or b may be this.
+  // Each result row is a's row weighting b's rows; the SIMD versions do a
+  // row at a time with the same operation order, so all three give the
+  // same result.
   void multiply(vsx_matrix *a, vsx_matrix *b) {
+#if defined(VSX_MATH_3D_SSE)
+    __m128 b0 = _mm_loadu_ps(b->m);
+    __m128 b1 = _mm_loadu_ps(b->m + 4);
+    __m128 b2 = _mm_loadu_ps(b->m + 8);
+    __m128 b3 = _mm_loadu_ps(b->m + 12);
+    __m128 r[4];
+    for (int i = 0; i < 4; i++)
+    {
+      const float* ar = a->m + i * 4;
+      r[i] = _mm_add_ps(
+               _mm_add_ps(
+                 _mm_add_ps(
+                   _mm_mul_ps(_mm_set1_ps(ar[0]), b0),
+                   _mm_mul_ps(_mm_set1_ps(ar[1]), b1)
+                 ),
+                 _mm_mul_ps(_mm_set1_ps(ar[2]), b2)
+               ),
+               _mm_mul_ps(_mm_set1_ps(ar[3]), b3)
+             );
+    }
+    for (int i = 0; i < 4; i++)
+      _mm_storeu_ps(m + i * 4, r[i]);
+#elif defined(VSX_MATH_3D_NEON)
+    float32x4_t b0 = vld1q_f32(b->m);
+    float32x4_t b1 = vld1q_f32(b->m + 4);
+    float32x4_t b2 = vld1q_f32(b->m + 8);
+    float32x4_t b3 = vld1q_f32(b->m + 12);
+    float32x4_t r[4];
+    for (int i = 0; i < 4; i++)
+    {
+      const float* ar = a->m + i * 4;
+      // separate multiply and add, vmlaq may be fused
+      r[i] = vaddq_f32(
+               vaddq_f32(
+                 vaddq_f32(vmulq_n_f32(b0, ar[0]), vmulq_n_f32(b1, ar[1])),
+                 vmulq_n_f32(b2, ar[2])
+               ),
+               vmulq_n_f32(b3, ar[3])
+             );
+    }
+    for (int i = 0; i < 4; i++)
+      vst1q_f32(m + i * 4, r[i]);
+#else
     int i, j;
     float mm[16];
     for (i = 0; i < 4; i++)
@@ -589,6 +660,7 @@ public:
       }
     }
     memcpy(&m,&mm,sizeof(float)*16);
+#endif
   }
 
   void rotation_from_vectors(vsx_vector* dir)
@@ -51,6 +51,34 @@ inline vsx_tex_coord vsx_tex_coord__(float x, float y) {
   return a;
 }
 
+// streams of a mesh, for vsx_mesh_data::share() / touch()
+#define VSX_MESH_VERTICES          1
+#define VSX_MESH_VERTEX_NORMALS    2
+#define VSX_MESH_VERTEX_COLORS     4
+#define VSX_MESH_VERTEX_TEX_COORDS 8
+#define VSX_MESH_FACES             16
+#define VSX_MESH_FACE_NORMALS      32
+#define VSX_MESH_VERTEX_TANGENTS   64
+#define VSX_MESH_FACE_CENTERS      128
+#define VSX_MESH_ALL               255
+
+// Stamps for the per stream timestamps (vsx_array::timestamp), unique
+// for the life of the process so a stream stamp identifies its contents.
+// 0 means never stamped: anyone caching a stream must assume it changed.
+inline size_t vsx_mesh_stamp()
+{
+  static size_t counter = 0;
+  return __sync_add_and_fetch(&counter, 1);
+}
+
+// Data derived from a mesh that consumers build on demand and keep on the
+// mesh, so everyone reading the same mesh shares it (see vsx_mesh_spatial).
+// The mesh deletes it along with itself.
+class vsx_mesh_cache {
+public:
+  virtual ~vsx_mesh_cache() {}
+};
+
 // the mesh contains vertices stored in a local coordinate system.
 #ifndef VSX_NO_MESH
 class vsx_mesh_data {
@@ -67,6 +95,8 @@ public:
   // selected vertices, whom wich should be modified when run through a mesh deformer that modifies the
   // vertex coordinates
   vsx_array<unsigned long>* selected_vertices;
+  // spatial index of the vertices, vsx_mesh_spatial::get() builds it
+  vsx_mesh_cache* spatial;
 
   void calculate_face_centers() {
     if (!faces.size()) return;
@@ -92,6 +122,34 @@ public:
     return res;
   }
 
+  // Shares the given streams of source instead of copying them (see
+  // vsx_array::share), the rest is left alone. A modifier that only
+  // rewrites the vertices shares everything else from its input each run.
+  void share(vsx_mesh_data* source, int streams)
+  {
+    if (streams & VSX_MESH_VERTICES) vertices.share(source->vertices);
+    if (streams & VSX_MESH_VERTEX_NORMALS) vertex_normals.share(source->vertex_normals);
+    if (streams & VSX_MESH_VERTEX_COLORS) vertex_colors.share(source->vertex_colors);
+    if (streams & VSX_MESH_VERTEX_TEX_COORDS) vertex_tex_coords.share(source->vertex_tex_coords);
+    if (streams & VSX_MESH_FACES) faces.share(source->faces);
+    if (streams & VSX_MESH_FACE_NORMALS) face_normals.share(source->face_normals);
+    if (streams & VSX_MESH_VERTEX_TANGENTS) vertex_tangents.share(source->vertex_tangents);
+    if (streams & VSX_MESH_FACE_CENTERS) face_centers.share(source->face_centers);
+  }
+
+  // new stamps for the given streams, call after rewriting them
+  void touch(int streams)
+  {
+    if (streams & VSX_MESH_VERTICES) vertices.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_VERTEX_NORMALS) vertex_normals.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_VERTEX_COLORS) vertex_colors.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_VERTEX_TEX_COORDS) vertex_tex_coords.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_FACES) faces.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_FACE_NORMALS) face_normals.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_VERTEX_TANGENTS) vertex_tangents.timestamp = vsx_mesh_stamp();
+    if (streams & VSX_MESH_FACE_CENTERS) face_centers.timestamp = vsx_mesh_stamp();
+  }
+
   void reset() {
     vertices.reset_used();
     vertex_normals.reset_used();
@@ -103,6 +161,7 @@ public:
   }
   vsx_mesh_data() {
     selected_vertices = 0;
+    spatial = 0;
   }
   
   void clear() {
@@ -125,6 +184,7 @@ public:
 
   ~vsx_mesh_data() {
     clear();
+    delete spatial;
   }
 };
 #endif
@@ -0,0 +1,434 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_MESH_ATTRIBUTES_H
+#define VSX_MESH_ATTRIBUTES_H
+
+#include <math.h>
+#include "vsx_mesh.h"
+#include "vsx_thread_pool.h"
+#include "vsx_vector_batch.h"
+
+// Face normals, vertex normals and tangents of a mesh, computed on the
+// engine thread pool.
+//
+// Everything is gathered rather than scattered: one pass over the faces
+// computes the per face values, a second pass over the vertices sums up
+// the faces around each vertex. That way both passes split into chunks
+// without any locking, and the sums are added in face order, so the
+// result doesn't depend on the number of threads.
+//
+// The vertex -> face adjacency needed for the second pass is kept between
+// calls and only rebuilt when the faces change, as told by the faces
+// stamp (vsx_array::timestamp, see vsx_mesh_stamp). A generator that
+// keeps its faces while moving the vertices around only has to touch()
+// the faces when it really rebuilds them. Unstamped faces (stamp 0) are
+// assumed to change every call.
+//
+// Faces must only refer to existing vertices. Keep one instance per
+// module, calls aren't reentrant.
+//
+// Usage:
+//   attributes.calculate_vertex_normals(mesh->data);
+//   attributes.calculate_tangents(mesh->data, mesh->data->vertex_tangents);
+
+// faces or vertices worth handing to another thread
+#define VSX_MESH_ATTRIBUTES_CHUNK 2048
+
+class vsx_mesh_attributes
+{
+  // faces around vertex v:
+  //   vertex_faces[vertex_offsets[v]] .. vertex_faces[vertex_offsets[v+1]-1]
+  vsx_array<unsigned int> vertex_offsets;
+  vsx_array<unsigned int> vertex_faces;
+
+  // what the adjacency was built from
+  size_t topology_stamp;
+  size_t topology_face_count;
+  size_t topology_vertex_count;
+
+  // per face: cross product of the edges (length is twice the area),
+  // tangent / bitangent directions and the angles at the a, b, c corners
+  vsx_array<vsx_vector> face_vectors;
+  vsx_array<vsx_vector> face_tangents;
+  vsx_array<vsx_vector> face_bitangents;
+  vsx_array<vsx_vector> face_angles;
+
+  // vertex normals for tangents of a mesh without them
+  vsx_array<vsx_vector> scratch_normals;
+
+  // current job
+  vsx_mesh_data* data;
+  vsx_vector* face_normals_dest;
+  const vsx_vector* normals;
+  vsx_vector* normals_dest;
+  vsx_quaternion* tangents_dest;
+
+  static inline void normalize_safe(vsx_vector& v)
+  {
+    float l = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (l > 0.0f)
+    {
+      l = 1.0f / l;
+      v.x *= l;
+      v.y *= l;
+      v.z *= l;
+    }
+  }
+
+  // angle between two unit vectors given their dot product; acos to
+  // within 7e-5 (Abramowitz & Stegun 4.4.45), plenty for a weight
+  static inline float corner_angle(float d)
+  {
+    bool negative = d < 0.0f;
+    d = fabsf(d);
+    if (d > 1.0f) d = 1.0f;
+    float a = sqrtf(1.0f - d) * (1.5707288f + d * (-0.2121144f + d * (0.0742610f - 0.0187293f * d)));
+    return negative ? (float)PI - a : a;
+  }
+
+  // cross products of faces [start, end), normalized as well if asked for
+  static void face_normals_job(void* ptr, size_t start, size_t end)
+  {
+    vsx_mesh_attributes* t = (vsx_mesh_attributes*)ptr;
+    const vsx_face* f = t->data->faces.get_pointer();
+    const vsx_vector* v = t->data->vertices.get_pointer();
+    vsx_vector* out = t->face_vectors.get_pointer();
+    vsx_vector* out_n = t->face_normals_dest;
+    size_t i = start;
+#if defined(VSX_MATH_3D_SSE)
+    for (; i + 4 <= end; i += 4)
+    {
+      const vsx_face* q = f + i;
+      const vsx_vector& a0 = v[q[0].a]; const vsx_vector& a1 = v[q[1].a];
+      const vsx_vector& a2 = v[q[2].a]; const vsx_vector& a3 = v[q[3].a];
+      const vsx_vector& b0 = v[q[0].b]; const vsx_vector& b1 = v[q[1].b];
+      const vsx_vector& b2 = v[q[2].b]; const vsx_vector& b3 = v[q[3].b];
+      const vsx_vector& c0 = v[q[0].c]; const vsx_vector& c1 = v[q[1].c];
+      const vsx_vector& c2 = v[q[2].c]; const vsx_vector& c3 = v[q[3].c];
+      __m128 ax = _mm_setr_ps(a0.x, a1.x, a2.x, a3.x);
+      __m128 ay = _mm_setr_ps(a0.y, a1.y, a2.y, a3.y);
+      __m128 az = _mm_setr_ps(a0.z, a1.z, a2.z, a3.z);
+      __m128 e1x = _mm_sub_ps(_mm_setr_ps(b0.x, b1.x, b2.x, b3.x), ax);
+      __m128 e1y = _mm_sub_ps(_mm_setr_ps(b0.y, b1.y, b2.y, b3.y), ay);
+      __m128 e1z = _mm_sub_ps(_mm_setr_ps(b0.z, b1.z, b2.z, b3.z), az);
+      __m128 e2x = _mm_sub_ps(_mm_setr_ps(c0.x, c1.x, c2.x, c3.x), ax);
+      __m128 e2y = _mm_sub_ps(_mm_setr_ps(c0.y, c1.y, c2.y, c3.y), ay);
+      __m128 e2z = _mm_sub_ps(_mm_setr_ps(c0.z, c1.z, c2.z, c3.z), az);
+      __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+      __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+      __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+      VSX_VECTOR_BATCH_STORE(out + i, nx, ny, nz);
+      if (out_n)
+      {
+        __m128 l = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+        // degenerate faces keep their zero vector
+        __m128 s = _mm_and_ps(_mm_cmpgt_ps(l, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), l));
+        nx = _mm_mul_ps(nx, s);
+        ny = _mm_mul_ps(ny, s);
+        nz = _mm_mul_ps(nz, s);
+        VSX_VECTOR_BATCH_STORE(out_n + i, nx, ny, nz);
+      }
+    }
+#endif
+    for (; i < end; i++)
+    {
+      out[i].assign_face_normal((vsx_vector*)&v[f[i].a], (vsx_vector*)&v[f[i].b], (vsx_vector*)&v[f[i].c]);
+      if (out_n)
+      {
+        out_n[i] = out[i];
+        normalize_safe(out_n[i]);
+      }
+    }
+  }
+
+  // area weighted sums over the faces around vertices [start, end)
+  static void vertex_normals_job(void* ptr, size_t start, size_t end)
+  {
+    vsx_mesh_attributes* t = (vsx_mesh_attributes*)ptr;
+    const unsigned int* offsets = t->vertex_offsets.get_pointer();
+    const unsigned int* faces = t->vertex_faces.get_pointer();
+    const vsx_vector* fv = t->face_vectors.get_pointer();
+    vsx_vector* out = t->normals_dest;
+    for (size_t i = start; i < end; i++)
+    {
+      vsx_vector n(0.0f, 0.0f, 0.0f);
+      for (unsigned int j = offsets[i]; j < offsets[i + 1]; j++)
+        n += fv[faces[j]];
+      normalize_safe(n);
+      out[i] = n;
+    }
+  }
+
+  // tangent directions and corner angles of faces [start, end)
+  static void face_tangents_job(void* ptr, size_t start, size_t end)
+  {
+    vsx_mesh_attributes* t = (vsx_mesh_attributes*)ptr;
+    const vsx_face* f = t->data->faces.get_pointer();
+    const vsx_vector* v = t->data->vertices.get_pointer();
+    const vsx_tex_coord* uv = t->data->vertex_tex_coords.get_pointer();
+    bool has_uv = t->data->vertex_tex_coords.size() >= t->data->vertices.size();
+    vsx_vector* fa = t->face_angles.get_pointer();
+    for (size_t i = start; i < end; i++)
+    {
+      vsx_vector p0 = v[f[i].a];
+      vsx_vector p1 = v[f[i].b];
+      vsx_vector p2 = v[f[i].c];
+      vsx_vector e1 = p1 - p0;
+      vsx_vector e2 = p2 - p0;
+      vsx_vector e3 = p2 - p1;
+
+      // corner angles, used as weights like MikkTSpace does
+      vsx_vector d1 = e1; normalize_safe(d1);
+      vsx_vector d2 = e2; normalize_safe(d2);
+      vsx_vector d3 = e3; normalize_safe(d3);
+      vsx_vector& angles = fa[i];
+      angles.x = corner_angle(d1.dot_product(&d2));
+      angles.y = corner_angle(-d1.x * d3.x - d1.y * d3.y - d1.z * d3.z);
+      angles.z = (float)PI - angles.x - angles.y;
+      if (angles.z < 0.0f)
+        angles.z = 0.0f;
+
+      vsx_vector& ft = t->face_tangents.get_pointer()[i];
+      vsx_vector& fb = t->face_bitangents.get_pointer()[i];
+      ft = fb = vsx_vector(0.0f, 0.0f, 0.0f);
+      if (!has_uv)
+        continue;
+
+      float s1 = uv[f[i].b].s - uv[f[i].a].s;
+      float s2 = uv[f[i].c].s - uv[f[i].a].s;
+      float t1 = uv[f[i].b].t - uv[f[i].a].t;
+      float t2 = uv[f[i].c].t - uv[f[i].a].t;
+      float det = s1 * t2 - s2 * t1;
+      if (det == 0.0f)
+        continue;
+      // only the sign of the uv area matters, the lengths are normalized
+      // away later on, so tiny uv triangles don't blow up
+      float sign = det < 0.0f ? -1.0f : 1.0f;
+      ft = (e1 * t2 - e2 * t1) * sign;
+      fb = (e2 * s1 - e1 * s2) * sign;
+    }
+  }
+
+  // angle weighted sums of the face tangents around vertices [start, end),
+  // projected on the vertex normal's plane
+  static void tangents_job(void* ptr, size_t start, size_t end)
+  {
+    vsx_mesh_attributes* t = (vsx_mesh_attributes*)ptr;
+    const unsigned int* offsets = t->vertex_offsets.get_pointer();
+    const unsigned int* faces = t->vertex_faces.get_pointer();
+    const vsx_face* f = t->data->faces.get_pointer();
+    const vsx_vector* ft = t->face_tangents.get_pointer();
+    const vsx_vector* fb = t->face_bitangents.get_pointer();
+    const vsx_vector* fa = t->face_angles.get_pointer();
+    for (size_t i = start; i < end; i++)
+    {
+      vsx_vector n = t->normals[i];
+      vsx_vector ts(0.0f, 0.0f, 0.0f);
+      vsx_vector bs(0.0f, 0.0f, 0.0f);
+      for (unsigned int j = offsets[i]; j < offsets[i + 1]; j++)
+      {
+        unsigned int fi = faces[j];
+        float angle =
+          f[fi].a == i ? fa[fi].x :
+          f[fi].b == i ? fa[fi].y :
+          fa[fi].z;
+        vsx_vector a = ft[fi];
+        vsx_vector b = fb[fi];
+        a -= n * n.dot_product(&a);
+        b -= n * n.dot_product(&b);
+        normalize_safe(a);
+        normalize_safe(b);
+        ts += a * angle;
+        bs += b * angle;
+      }
+
+      // Gram-Schmidt orthogonalize
+      ts = ts - n * n.dot_product(&ts);
+      normalize_safe(ts);
+      if (ts.x == 0.0f && ts.y == 0.0f && ts.z == 0.0f)
+      {
+        // no uv gradient here, any direction in the plane will do
+        ts.cross(n, fabsf(n.x) < 0.9f ? vsx_vector(1.0f, 0.0f, 0.0f) : vsx_vector(0.0f, 1.0f, 0.0f));
+        normalize_safe(ts);
+      }
+
+      // handedness, bitangent = w * cross(normal, tangent)
+      vsx_vector c;
+      c.cross(n, ts);
+      vsx_quaternion& out = t->tangents_dest[i];
+      out.x = ts.x;
+      out.y = ts.y;
+      out.z = ts.z;
+      out.w = c.dot_product(&bs) < 0.0f ? -1.0f : 1.0f;
+    }
+  }
+
+  void face_pass(vsx_mesh_data* d, vsx_vector* n_face_normals_dest)
+  {
+    data = d;
+    face_normals_dest = n_face_normals_dest;
+    face_vectors.resize(d->faces.size());
+    vsx_thread_pool::get_instance()->parallel_for(
+      d->faces.size(),
+      VSX_MESH_ATTRIBUTES_CHUNK,
+      &face_normals_job,
+      (void*)this
+    );
+  }
+
+  void vertex_normals_pass(vsx_mesh_data* d, vsx_vector* dest)
+  {
+    normals_dest = dest;
+    vsx_thread_pool::get_instance()->parallel_for(
+      d->vertices.size(),
+      VSX_MESH_ATTRIBUTES_CHUNK,
+      &vertex_normals_job,
+      (void*)this
+    );
+  }
+
+public:
+
+  vsx_mesh_attributes()
+  {
+    topology_stamp = 0;
+    topology_face_count = 0;
+    topology_vertex_count = 0;
+    data = 0;
+    face_normals_dest = 0;
+    normals = 0;
+    normals_dest = 0;
+    tangents_dest = 0;
+  }
+
+  // Rebuilds the vertex -> face adjacency unless d has the same (stamped)
+  // faces and vertex count as last time. Returns true if it was rebuilt.
+  bool update_topology(vsx_mesh_data* d)
+  {
+    size_t face_count = d->faces.size();
+    size_t vertex_count = d->vertices.size();
+    if (
+      d->faces.timestamp != 0 &&
+      d->faces.timestamp == topology_stamp &&
+      face_count == topology_face_count &&
+      vertex_count == topology_vertex_count
+    )
+      return false;
+
+    topology_stamp = d->faces.timestamp;
+    topology_face_count = face_count;
+    topology_vertex_count = vertex_count;
+
+    // counting sort of the face corners by vertex
+    unsigned int* offsets = vertex_offsets.resize(vertex_count + 1);
+    memset(offsets, 0, sizeof(unsigned int) * (vertex_count + 1));
+    const vsx_face* f = d->faces.get_pointer();
+    for (size_t i = 0; i < face_count; i++)
+    {
+      offsets[f[i].a + 1]++;
+      offsets[f[i].b + 1]++;
+      offsets[f[i].c + 1]++;
+    }
+    for (size_t i = 0; i < vertex_count; i++)
+      offsets[i + 1] += offsets[i];
+
+    unsigned int* faces = vertex_faces.resize(offsets[vertex_count] + 1);
+    vsx_array<unsigned int> fill;
+    unsigned int* pos = fill.resize(vertex_count + 1);
+    memcpy(pos, offsets, sizeof(unsigned int) * (vertex_count + 1));
+    for (size_t i = 0; i < face_count; i++)
+    {
+      faces[pos[f[i].a]++] = (unsigned int)i;
+      faces[pos[f[i].b]++] = (unsigned int)i;
+      faces[pos[f[i].c]++] = (unsigned int)i;
+    }
+    return true;
+  }
+
+  // d->face_normals: unit normals of the counter-clockwise faces, same
+  // direction as vsx_mesh_data::get_face_normal
+  void calculate_face_normals(vsx_mesh_data* d)
+  {
+    face_pass(d, d->face_normals.resize(d->faces.size(), false));
+    d->touch(VSX_MESH_FACE_NORMALS);
+  }
+
+  // d->vertex_normals: area weighted averages of the surrounding faces'
+  // normals. Vertices without faces get a zero normal.
+  void calculate_vertex_normals(vsx_mesh_data* d)
+  {
+    update_topology(d);
+    face_pass(d, 0);
+    vertex_normals_pass(d, d->vertex_normals.resize(d->vertices.size(), false));
+    d->touch(VSX_MESH_VERTEX_NORMALS);
+  }
+
+  // MikkTSpace style tangents into dest, one per vertex: per face tangents
+  // from the uv gradients, projected on the plane of the vertex normal,
+  // weighted by the corner angle and summed, then orthogonalized to the
+  // normal. w holds the handedness so that the bitangent is
+  // w * cross(normal, tangent). Uses d->vertex_normals when there is one
+  // per vertex, area weighted normals otherwise. Without tex coords the
+  // tangents are just some direction perpendicular to the normal.
+  void calculate_tangents(vsx_mesh_data* d, vsx_array<vsx_quaternion>& dest)
+  {
+    size_t vertex_count = d->vertices.size();
+    size_t face_count = d->faces.size();
+    update_topology(d);
+
+    if (d->vertex_normals.size() >= vertex_count)
+      normals = d->vertex_normals.get_pointer();
+    else
+    {
+      face_pass(d, 0);
+      vertex_normals_pass(d, scratch_normals.resize(vertex_count));
+      normals = scratch_normals.get_pointer();
+    }
+
+    data = d;
+    face_tangents.resize(face_count);
+    face_bitangents.resize(face_count);
+    face_angles.resize(face_count);
+    vsx_thread_pool::get_instance()->parallel_for(
+      face_count,
+      VSX_MESH_ATTRIBUTES_CHUNK,
+      &face_tangents_job,
+      (void*)this
+    );
+
+    tangents_dest = dest.resize(vertex_count, false);
+    vsx_thread_pool::get_instance()->parallel_for(
+      vertex_count,
+      VSX_MESH_ATTRIBUTES_CHUNK,
+      &tangents_job,
+      (void*)this
+    );
+    if (&dest == &d->vertex_tangents)
+      d->touch(VSX_MESH_VERTEX_TANGENTS);
+    else
+      dest.timestamp = vsx_mesh_stamp();
+  }
+};
+
+#endif
@@ -0,0 +1,549 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_MESH_SPATIAL_H
+#define VSX_MESH_SPATIAL_H
+
+#include <math.h>
+#include <string.h>
+#include "vsx_mesh.h"
+#include "vsx_thread_pool.h"
+
+// Proximity queries over the vertices of a mesh.
+//
+// A uniform grid, sized for a couple of vertices per cell, with the vertex
+// ids bucketed by cell (and their positions copied next to them, so a cell
+// is one contiguous read). Bounds and cell assignment run on the engine
+// thread pool, the bucketing is a counting sort.
+//
+// get() returns the index kept on the mesh (vsx_mesh_data::spatial), built
+// on first use and rebuilt when the vertices change: by their stamp when
+// they have one (see vsx_mesh_stamp), otherwise by the mesh timestamp. So
+// any number of modules reading the same mesh share one build per change.
+// Like the modules, it's meant for the render thread; calls aren't
+// reentrant.
+//
+// Queries:
+//   nearest()  - the k nearest vertices, nearest first
+//   within()   - all vertices inside a radius, in no particular order
+//   sorted()   - all vertices, nearest first
+//
+// Usage:
+//   vsx_mesh_spatial* index = vsx_mesh_spatial::get(mesh);
+//   size_t found = index->nearest(point, 4, ids, dist2);
+
+// vertices worth handing to another thread
+#define VSX_MESH_SPATIAL_CHUNK 4096
+
+// grid cells per axis at most
+#define VSX_MESH_SPATIAL_MAX_DIM 1024
+
+class vsx_mesh_spatial : public vsx_mesh_cache
+{
+  // grid
+  vsx_vector origin;
+  float cell_size;
+  float inv_cell_size;
+  int dims[3];
+
+  // vertices in cell c:
+  //   cell_ids[cell_offsets[c]] .. cell_ids[cell_offsets[c+1]-1]
+  // with their positions in cell_points, same order
+  vsx_array<unsigned int> cell_offsets;
+  vsx_array<unsigned int> cell_ids;
+  vsx_array<vsx_vector> cell_points;
+
+  // what it was built from
+  size_t built_stamp;
+  unsigned long built_timestamp;
+  size_t built_count;
+  const vsx_vector* built_pointer;
+
+  // build scratch: bounds per chunk, cell per vertex
+  vsx_array<vsx_vector> chunk_bounds;
+  vsx_array<unsigned int> vertex_cell;
+  const vsx_vector* source;
+  size_t source_count;
+
+  // sorted() scratch
+  vsx_array<unsigned int> sort_keys[2];
+  vsx_array<unsigned int> sort_ids;
+  vsx_vector sort_point;
+
+  // nearest() distances when the caller doesn't want them
+  vsx_array<float> nearest_dist;
+
+  inline int cell_coord(float v, float o, int dim)
+  {
+    // clamp before converting, far points don't fit in an int
+    float c = (v - o) * inv_cell_size;
+    if (!(c > 0.0f)) return 0;
+    if (c >= (float)dim) return dim - 1;
+    return (int)c;
+  }
+
+  inline unsigned int cell_index(int x, int y, int z)
+  {
+    return (unsigned int)((z * dims[1] + y) * dims[0] + x);
+  }
+
+  static void bounds_job(void* arg, size_t start, size_t end)
+  {
+    vsx_mesh_spatial* s = (vsx_mesh_spatial*)arg;
+    vsx_vector* b = s->chunk_bounds.get_pointer();
+    for (size_t c = start; c < end; c++)
+    {
+      size_t i = c * VSX_MESH_SPATIAL_CHUNK;
+      size_t last = i + VSX_MESH_SPATIAL_CHUNK;
+      if (last > s->source_count) last = s->source_count;
+      vsx_vector lo = s->source[i];
+      vsx_vector hi = lo;
+      for (i++; i < last; i++)
+      {
+        const vsx_vector& v = s->source[i];
+        if (v.x < lo.x) lo.x = v.x;
+        if (v.x > hi.x) hi.x = v.x;
+        if (v.y < lo.y) lo.y = v.y;
+        if (v.y > hi.y) hi.y = v.y;
+        if (v.z < lo.z) lo.z = v.z;
+        if (v.z > hi.z) hi.z = v.z;
+      }
+      b[c * 2] = lo;
+      b[c * 2 + 1] = hi;
+    }
+  }
+
+  static void cells_job(void* arg, size_t start, size_t end)
+  {
+    vsx_mesh_spatial* s = (vsx_mesh_spatial*)arg;
+    unsigned int* vc = s->vertex_cell.get_pointer();
+    for (size_t i = start; i < end; i++)
+    {
+      const vsx_vector& v = s->source[i];
+      vc[i] = s->cell_index(
+        s->cell_coord(v.x, s->origin.x, s->dims[0]),
+        s->cell_coord(v.y, s->origin.y, s->dims[1]),
+        s->cell_coord(v.z, s->origin.z, s->dims[2])
+      );
+    }
+  }
+
+  static void points_job(void* arg, size_t start, size_t end)
+  {
+    vsx_mesh_spatial* s = (vsx_mesh_spatial*)arg;
+    const unsigned int* ids = s->cell_ids.get_pointer();
+    vsx_vector* pts = s->cell_points.get_pointer();
+    for (size_t i = start; i < end; i++)
+      pts[i] = s->source[ids[i]];
+  }
+
+  static void distances_job(void* arg, size_t start, size_t end)
+  {
+    vsx_mesh_spatial* s = (vsx_mesh_spatial*)arg;
+    unsigned int* k = s->sort_keys[0].get_pointer();
+    unsigned int* ids = s->sort_ids.get_pointer();
+    const vsx_vector* pts = s->cell_points.get_pointer();
+    const unsigned int* cids = s->cell_ids.get_pointer();
+    vsx_vector p = s->sort_point;
+    for (size_t i = start; i < end; i++)
+    {
+      float dx = pts[i].x - p.x;
+      float dy = pts[i].y - p.y;
+      float dz = pts[i].z - p.z;
+      // non-negative floats order the same as their bits
+      float d2 = dx * dx + dy * dy + dz * dz;
+      memcpy(&k[i], &d2, sizeof(float));
+      ids[i] = cids[i];
+    }
+  }
+
+  void build(const vsx_vector* v, size_t count)
+  {
+    source = v;
+    source_count = count;
+    vsx_thread_pool* pool = vsx_thread_pool::get_instance();
+
+    // bounds
+    size_t chunks = (count + VSX_MESH_SPATIAL_CHUNK - 1) / VSX_MESH_SPATIAL_CHUNK;
+    vsx_vector* b = chunk_bounds.resize(chunks * 2);
+    pool->parallel_for(chunks, 1, &bounds_job, (void*)this);
+    vsx_vector lo = b[0];
+    vsx_vector hi = b[1];
+    for (size_t c = 1; c < chunks; c++)
+    {
+      if (b[c * 2].x < lo.x) lo.x = b[c * 2].x;
+      if (b[c * 2].y < lo.y) lo.y = b[c * 2].y;
+      if (b[c * 2].z < lo.z) lo.z = b[c * 2].z;
+      if (b[c * 2 + 1].x > hi.x) hi.x = b[c * 2 + 1].x;
+      if (b[c * 2 + 1].y > hi.y) hi.y = b[c * 2 + 1].y;
+      if (b[c * 2 + 1].z > hi.z) hi.z = b[c * 2 + 1].z;
+    }
+
+    // cube cells, about 2 vertices per cell over the axes the mesh spans
+    float ext[3] = {hi.x - lo.x, hi.y - lo.y, hi.z - lo.z};
+    float max_ext = ext[0];
+    if (ext[1] > max_ext) max_ext = ext[1];
+    if (ext[2] > max_ext) max_ext = ext[2];
+    float volume = 1.0f;
+    int spanned = 0;
+    for (int a = 0; a < 3; a++)
+      if (ext[a] > max_ext * 1e-4f)
+      {
+        volume *= ext[a];
+        spanned++;
+      }
+    float target = (float)count * 0.5f;
+    if (target < 1.0f) target = 1.0f;
+    cell_size = spanned ? powf(volume / target, 1.0f / (float)spanned) : 1.0f;
+    if (!(cell_size > 0.0f)) cell_size = 1.0f;
+    origin = lo;
+    size_t cells;
+    for (;;)
+    {
+      inv_cell_size = 1.0f / cell_size;
+      cells = 1;
+      for (int a = 0; a < 3; a++)
+      {
+        float d = ext[a] * inv_cell_size;
+        dims[a] = d < (float)VSX_MESH_SPATIAL_MAX_DIM ? (int)d + 1 : VSX_MESH_SPATIAL_MAX_DIM;
+        cells *= dims[a];
+      }
+      // thin, barely spanned axes can blow the cell count up
+      if (cells <= count * 4 + 64)
+        break;
+      cell_size *= 1.25f;
+    }
+
+    // cell per vertex
+    vertex_cell.resize(count);
+    pool->parallel_for(count, VSX_MESH_SPATIAL_CHUNK, &cells_job, (void*)this);
+
+    // bucket by cell
+    unsigned int* off = cell_offsets.resize(cells + 1);
+    memset(off, 0, sizeof(unsigned int) * (cells + 1));
+    const unsigned int* vc = vertex_cell.get_pointer();
+    for (size_t i = 0; i < count; i++)
+      off[vc[i] + 1]++;
+    for (size_t c = 0; c < cells; c++)
+      off[c + 1] += off[c];
+    unsigned int* ids = cell_ids.resize(count);
+    for (size_t i = 0; i < count; i++)
+      ids[off[vc[i]]++] = (unsigned int)i;
+    // the scatter moved each offset to the start of the next cell
+    for (size_t c = cells; c > 0; c--)
+      off[c] = off[c - 1];
+    off[0] = 0;
+
+    cell_points.resize(count);
+    pool->parallel_for(count, VSX_MESH_SPATIAL_CHUNK, &points_job, (void*)this);
+  }
+
+  // Distance from p to the nearest cell outside the box of cells lo..hi,
+  // a lower bound for any vertex not in the box. False when the box covers
+  // the whole grid.
+  bool outside_distance(const vsx_vector& p, const int* lo, const int* hi, float& dist)
+  {
+    float pc[3] = {p.x, p.y, p.z};
+    float oc[3] = {origin.x, origin.y, origin.z};
+    bool any = false;
+    for (int a = 0; a < 3; a++)
+    {
+      if (lo[a] > 0)
+      {
+        float d = pc[a] - (oc[a] + (float)lo[a] * cell_size);
+        if (!any || d < dist) dist = d;
+        any = true;
+      }
+      if (hi[a] < dims[a] - 1)
+      {
+        float d = (oc[a] + (float)(hi[a] + 1) * cell_size) - pc[a];
+        if (!any || d < dist) dist = d;
+        any = true;
+      }
+    }
+    if (dist < 0.0f)
+      dist = 0.0f;
+    return any;
+  }
+
+public:
+
+  vsx_mesh_spatial()
+  {
+    cell_size = inv_cell_size = 1.0f;
+    dims[0] = dims[1] = dims[2] = 1;
+    built_stamp = 0;
+    built_timestamp = 0;
+    built_count = 0;
+    built_pointer = 0;
+    source = 0;
+    source_count = 0;
+  }
+
+  // the index of mesh's vertices, (re)built if they changed since last time
+  static vsx_mesh_spatial* get(vsx_mesh* mesh)
+  {
+    vsx_mesh_data* d = mesh->data;
+    vsx_mesh_spatial* s = (vsx_mesh_spatial*)d->spatial;
+    if (!s)
+    {
+      s = new vsx_mesh_spatial;
+      d->spatial = s;
+    }
+    size_t count = d->vertices.size();
+    const vsx_vector* v = d->vertices.get_pointer();
+    size_t stamp = d->vertices.timestamp;
+    if (
+      count == s->built_count &&
+      v == s->built_pointer &&
+      stamp == s->built_stamp &&
+      (stamp || mesh->timestamp == s->built_timestamp)
+    )
+      return s;
+    s->built_stamp = stamp;
+    s->built_timestamp = mesh->timestamp;
+    s->built_count = count;
+    s->built_pointer = v;
+    if (count)
+      s->build(v, count);
+    return s;
+  }
+
+  size_t size()
+  {
+    return built_count;
+  }
+
+  // The k nearest vertices to p, nearest first. Fills ids (and dist2, the
+  // squared distances, if given) with up to k entries; returns how many.
+  size_t nearest(const vsx_vector& p, size_t k, unsigned int* ids, float* dist2 = 0)
+  {
+    if (!k || !built_count)
+      return 0;
+    if (k > built_count)
+      k = built_count;
+
+    // max-heap of the best k so far, worst on top
+    float* hd = dist2;
+    if (!hd)
+      hd = nearest_dist.resize(k);
+    size_t found = 0;
+
+    const unsigned int* off = cell_offsets.get_pointer();
+    const unsigned int* cids = cell_ids.get_pointer();
+    const vsx_vector* pts = cell_points.get_pointer();
+    int c[3] = {
+      cell_coord(p.x, origin.x, dims[0]),
+      cell_coord(p.y, origin.y, dims[1]),
+      cell_coord(p.z, origin.z, dims[2])
+    };
+
+    for (int r = 0; ; r++)
+    {
+      int lo[3], hi[3];
+      for (int a = 0; a < 3; a++)
+      {
+        lo[a] = c[a] - r > 0 ? c[a] - r : 0;
+        hi[a] = c[a] + r < dims[a] - 1 ? c[a] + r : dims[a] - 1;
+      }
+      // the shell of cells r steps away
+      for (int z = lo[2]; z <= hi[2]; z++)
+      for (int y = lo[1]; y <= hi[1]; y++)
+      {
+        bool inner = (z != c[2] - r && z != c[2] + r && y != c[1] - r && y != c[1] + r);
+        for (int x = lo[0]; x <= hi[0]; x++)
+        {
+          if (inner && x != c[0] - r && x != c[0] + r)
+          {
+            // jump over the inside, visited already
+            x = c[0] + r - 1;
+            continue;
+          }
+          unsigned int cell = cell_index(x, y, z);
+          for (unsigned int i = off[cell]; i < off[cell + 1]; i++)
+          {
+            float dx = pts[i].x - p.x;
+            float dy = pts[i].y - p.y;
+            float dz = pts[i].z - p.z;
+            float d2 = dx * dx + dy * dy + dz * dz;
+            size_t j;
+            if (found < k)
+              j = found++;
+            else
+            if (d2 < hd[0])
+              j = 0;
+            else
+              continue;
+            if (j)
+            {
+              // sift up
+              while (j)
+              {
+                size_t parent = (j - 1) >> 1;
+                if (hd[parent] >= d2)
+                  break;
+                hd[j] = hd[parent];
+                ids[j] = ids[parent];
+                j = parent;
+              }
+            } else
+            {
+              // replace the top, sift down
+              for (;;)
+              {
+                size_t child = j * 2 + 1;
+                if (child >= found)
+                  break;
+                if (child + 1 < found && hd[child + 1] > hd[child])
+                  child++;
+                if (hd[child] <= d2)
+                  break;
+                hd[j] = hd[child];
+                ids[j] = ids[child];
+                j = child;
+              }
+            }
+            hd[j] = d2;
+            ids[j] = cids[i];
+          }
+        }
+      }
+      float out = 0.0f;
+      if (!outside_distance(p, lo, hi, out))
+        break;
+      if (found == k && out * out >= hd[0])
+        break;
+    }
+
+    // heap to ascending order
+    for (size_t n = found; n > 1; n--)
+    {
+      float d2 = hd[n - 1];
+      unsigned int id = ids[n - 1];
+      hd[n - 1] = hd[0];
+      ids[n - 1] = ids[0];
+      size_t j = 0;
+      for (;;)
+      {
+        size_t child = j * 2 + 1;
+        if (child >= n - 1)
+          break;
+        if (child + 1 < n - 1 && hd[child + 1] > hd[child])
+          child++;
+        if (hd[child] <= d2)
+          break;
+        hd[j] = hd[child];
+        ids[j] = ids[child];
+        j = child;
+      }
+      hd[j] = d2;
+      ids[j] = id;
+    }
+    return found;
+  }
+
+  // Appends the ids of all vertices within radius of p to result.
+  void within(const vsx_vector& p, float radius, vsx_array<unsigned int>& result)
+  {
+    if (!built_count || radius < 0.0f)
+      return;
+    int lo[3] = {
+      cell_coord(p.x - radius, origin.x, dims[0]),
+      cell_coord(p.y - radius, origin.y, dims[1]),
+      cell_coord(p.z - radius, origin.z, dims[2])
+    };
+    int hi[3] = {
+      cell_coord(p.x + radius, origin.x, dims[0]),
+      cell_coord(p.y + radius, origin.y, dims[1]),
+      cell_coord(p.z + radius, origin.z, dims[2])
+    };
+    float r2 = radius * radius;
+    const unsigned int* off = cell_offsets.get_pointer();
+    const unsigned int* cids = cell_ids.get_pointer();
+    const vsx_vector* pts = cell_points.get_pointer();
+    for (int z = lo[2]; z <= hi[2]; z++)
+    for (int y = lo[1]; y <= hi[1]; y++)
+    for (int x = lo[0]; x <= hi[0]; x++)
+    {
+      unsigned int cell = cell_index(x, y, z);
+      for (unsigned int i = off[cell]; i < off[cell + 1]; i++)
+      {
+        float dx = pts[i].x - p.x;
+        float dy = pts[i].y - p.y;
+        float dz = pts[i].z - p.z;
+        if (dx * dx + dy * dy + dz * dz <= r2)
+          result.push_back(cids[i]);
+      }
+    }
+  }
+
+  // All vertex ids, nearest to p first, into result (size() entries).
+  // Distances are computed on the thread pool and ordered with an 11 bit
+  // LSD radix sort on their bits, linear in the vertex count.
+  void sorted(const vsx_vector& p, vsx_array<unsigned int>& result)
+  {
+    size_t count = built_count;
+    result.reset_used(0);
+    if (!count)
+      return;
+    sort_keys[0].resize(count);
+    sort_keys[1].resize(count);
+    sort_ids.resize(count);
+    result.allocate(count - 1);
+
+    sort_point = p;
+    vsx_thread_pool::get_instance()->parallel_for(count, VSX_MESH_SPATIAL_CHUNK, &distances_job, (void*)this);
+
+    // three passes (11, 11, 10 bits) between sort_keys[0]/sort_ids and
+    // sort_keys[1]/result, so the last one lands in result
+    unsigned int* src_k = sort_keys[0].get_pointer();
+    unsigned int* src_i = sort_ids.get_pointer();
+    unsigned int* dst_k = sort_keys[1].get_pointer();
+    unsigned int* dst_i = result.get_pointer();
+    unsigned int histogram[2048];
+    for (int shift = 0; shift < 32; shift += 11)
+    {
+      memset(histogram, 0, sizeof(histogram));
+      for (size_t i = 0; i < count; i++)
+        histogram[(src_k[i] >> shift) & 2047]++;
+      unsigned int sum = 0;
+      for (int b = 0; b < 2048; b++)
+      {
+        unsigned int n = histogram[b];
+        histogram[b] = sum;
+        sum += n;
+      }
+      for (size_t i = 0; i < count; i++)
+      {
+        unsigned int pos = histogram[(src_k[i] >> shift) & 2047]++;
+        dst_k[pos] = src_k[i];
+        dst_i[pos] = src_i[i];
+      }
+      unsigned int* t;
+      t = src_k; src_k = dst_k; dst_k = t;
+      t = src_i; src_i = dst_i; dst_i = t;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,801 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_NOISE_H
+#define VSX_NOISE_H
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "vsx_math_3d.h"
+#if defined(VSX_MATH_3D_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Coherent noise for generators and deformers.
+//
+// Two bases:
+//  - gradient: Ken Perlin's original lattice noise in 2D and 3D, with the
+//    very same tables (built from srand(seed) / rand()) and arithmetic as
+//    the old texgen Perlin class, so states keep looking the same. 4D has
+//    no original to match; it hashes through the same permutation and
+//    picks from the 32 fixed simplex gradients, as improved Perlin noise
+//    does, instead of a fourth random table.
+//  - simplex: Stefan Gustavson's simplex noise in 2D, 3D and 4D; cheaper
+//    per sample in higher dimensions and without the axis aligned
+//    artifacts. It uses its own permutation, seeded without touching rand().
+//
+// All samples are in roughly [-1, 1]. Tables are built once in init(),
+// after that an instance is read only and can be sampled from any number
+// of threads at once.
+//
+// The _n functions take arrays of coordinates, any count. Gradient 2D/3D
+// and simplex 2D evaluate four samples at a time with SSE2 (scalar
+// otherwise); gradient 4D and simplex 3D/4D go per sample. The SSE2 gradient paths give
+// the same results as the single sample functions.
+//
+// Usage:
+//   vsx_noise noise;
+//   noise.init(seed);
+//   float v = noise.gradient2(x, y);
+//   noise.fbm2_n(xs, ys, out, count, octaves, frequency, 1.0f);
+
+#define VSX_NOISE_GRADIENT 0
+#define VSX_NOISE_SIMPLEX 1
+
+#define VSX_NOISE_B 1024
+#define VSX_NOISE_BM (VSX_NOISE_B - 1)
+#define VSX_NOISE_N 4096.0f
+
+class vsx_noise
+{
+  // gradient tables, laid out like the original so the shuffle matches
+  int p[VSX_NOISE_B + VSX_NOISE_B + 2];
+  float g2[VSX_NOISE_B + VSX_NOISE_B + 2][2];
+  float g3[VSX_NOISE_B + VSX_NOISE_B + 2][3];
+
+  // simplex permutation, doubled to skip wrapping
+  unsigned char perm[512];
+  unsigned char perm12[512];
+
+  static float s_curve(float t)
+  {
+    return t * t * (3.0f - 2.0f * t);
+  }
+
+  static float lerp(float t, float a, float b)
+  {
+    return a + t * (b - a);
+  }
+
+  static void normalize2(float* v)
+  {
+    float s = 1.0f / (float)sqrt(v[0] * v[0] + v[1] * v[1]);
+    v[0] = v[0] * s;
+    v[1] = v[1] * s;
+  }
+
+  static void normalize3(float* v)
+  {
+    float s = 1.0f / (float)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] = v[0] * s;
+    v[1] = v[1] * s;
+    v[2] = v[2] * s;
+  }
+
+  static int fast_floor(float v)
+  {
+    int i = (int)v;
+    return v < (float)i ? i - 1 : i;
+  }
+
+  static const float* grad3(int i)
+  {
+    static const float g[12][3] =
+    {
+      {1,1,0},{-1,1,0},{1,-1,0},{-1,-1,0},
+      {1,0,1},{-1,0,1},{1,0,-1},{-1,0,-1},
+      {0,1,1},{0,-1,1},{0,1,-1},{0,-1,-1}
+    };
+    return g[i];
+  }
+
+  static const float* grad4(int i)
+  {
+    static const float g[32][4] =
+    {
+      {0,1,1,1},{0,1,1,-1},{0,1,-1,1},{0,1,-1,-1},
+      {0,-1,1,1},{0,-1,1,-1},{0,-1,-1,1},{0,-1,-1,-1},
+      {1,0,1,1},{1,0,1,-1},{1,0,-1,1},{1,0,-1,-1},
+      {-1,0,1,1},{-1,0,1,-1},{-1,0,-1,1},{-1,0,-1,-1},
+      {1,1,0,1},{1,1,0,-1},{1,-1,0,1},{1,-1,0,-1},
+      {-1,1,0,1},{-1,1,0,-1},{-1,-1,0,1},{-1,-1,0,-1},
+      {1,1,1,0},{1,1,-1,0},{1,-1,1,0},{1,-1,-1,0},
+      {-1,1,1,0},{-1,1,-1,0},{-1,-1,1,0},{-1,-1,-1,0}
+    };
+    return g[i];
+  }
+
+  // 4 samples of each basis, the building blocks of the _n functions
+
+  void gradient2_4(const float* x, const float* y, float* out) const
+  {
+#if defined(VSX_MATH_3D_SSE2)
+    __m128 n = _mm_set1_ps(VSX_NOISE_N);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 tx = _mm_add_ps(_mm_loadu_ps(x), n);
+    __m128 ty = _mm_add_ps(_mm_loadu_ps(y), n);
+    __m128i ix = _mm_cvttps_epi32(tx);
+    __m128i iy = _mm_cvttps_epi32(ty);
+    __m128 rx0 = _mm_sub_ps(tx, _mm_cvtepi32_ps(ix));
+    __m128 ry0 = _mm_sub_ps(ty, _mm_cvtepi32_ps(iy));
+    __m128 rx1 = _mm_sub_ps(rx0, one);
+    __m128 ry1 = _mm_sub_ps(ry0, one);
+
+    int bx[4], by[4];
+    _mm_storeu_si128((__m128i*)bx, ix);
+    _mm_storeu_si128((__m128i*)by, iy);
+    // corner gradients per lane, gathered straight into registers
+    const float* q[4][4];
+    for (int k = 0; k < 4; k++)
+    {
+      int bx0 = bx[k] & VSX_NOISE_BM;
+      int by0 = by[k] & VSX_NOISE_BM;
+      int i = p[bx0];
+      int j = p[(bx0 + 1) & VSX_NOISE_BM];
+      q[0][k] = g2[p[i + by0]];
+      q[1][k] = g2[p[j + by0]];
+      q[2][k] = g2[p[i + ((by0 + 1) & VSX_NOISE_BM)]];
+      q[3][k] = g2[p[j + ((by0 + 1) & VSX_NOISE_BM)]];
+    }
+
+    __m128 three = _mm_set1_ps(3.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 sx = _mm_mul_ps(_mm_mul_ps(rx0, rx0), _mm_sub_ps(three, _mm_mul_ps(two, rx0)));
+    __m128 sy = _mm_mul_ps(_mm_mul_ps(ry0, ry0), _mm_sub_ps(three, _mm_mul_ps(two, ry0)));
+
+    #define VSX_NOISE_AT2(rx, ry, c) _mm_add_ps( \
+      _mm_mul_ps(rx, _mm_setr_ps(c[0][0], c[1][0], c[2][0], c[3][0])), \
+      _mm_mul_ps(ry, _mm_setr_ps(c[0][1], c[1][1], c[2][1], c[3][1])))
+    #define VSX_NOISE_LERP(t, a, b) _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)))
+    __m128 u = VSX_NOISE_AT2(rx0, ry0, q[0]);
+    __m128 v = VSX_NOISE_AT2(rx1, ry0, q[1]);
+    __m128 a = VSX_NOISE_LERP(sx, u, v);
+    u = VSX_NOISE_AT2(rx0, ry1, q[2]);
+    v = VSX_NOISE_AT2(rx1, ry1, q[3]);
+    __m128 b = VSX_NOISE_LERP(sx, u, v);
+    _mm_storeu_ps(out, VSX_NOISE_LERP(sy, a, b));
+    #undef VSX_NOISE_AT2
+    #undef VSX_NOISE_LERP
+#else
+    for (int k = 0; k < 4; k++)
+      out[k] = gradient2(x[k], y[k]);
+#endif
+  }
+
+  void gradient3_4(const float* x, const float* y, const float* z, float* out) const
+  {
+#if defined(VSX_MATH_3D_SSE2)
+    __m128 n = _mm_set1_ps(VSX_NOISE_N);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 tx = _mm_add_ps(_mm_loadu_ps(x), n);
+    __m128 ty = _mm_add_ps(_mm_loadu_ps(y), n);
+    __m128 tz = _mm_add_ps(_mm_loadu_ps(z), n);
+    __m128i ix = _mm_cvttps_epi32(tx);
+    __m128i iy = _mm_cvttps_epi32(ty);
+    __m128i iz = _mm_cvttps_epi32(tz);
+    __m128 r0[3], r1[3];
+    r0[0] = _mm_sub_ps(tx, _mm_cvtepi32_ps(ix));
+    r0[1] = _mm_sub_ps(ty, _mm_cvtepi32_ps(iy));
+    r0[2] = _mm_sub_ps(tz, _mm_cvtepi32_ps(iz));
+    for (int a = 0; a < 3; a++)
+      r1[a] = _mm_sub_ps(r0[a], one);
+
+    int bx[4], by[4], bz[4];
+    _mm_storeu_si128((__m128i*)bx, ix);
+    _mm_storeu_si128((__m128i*)by, iy);
+    _mm_storeu_si128((__m128i*)bz, iz);
+    // corner c is x + 2y + 4z, components stored per lane
+    float q[8][3][4];
+    for (int k = 0; k < 4; k++)
+    {
+      int bx0 = bx[k] & VSX_NOISE_BM;
+      int by0 = by[k] & VSX_NOISE_BM;
+      int bz0 = bz[k] & VSX_NOISE_BM;
+      int bz1 = (bz0 + 1) & VSX_NOISE_BM;
+      int i = p[bx0];
+      int j = p[(bx0 + 1) & VSX_NOISE_BM];
+      int b[4];
+      b[0] = p[i + by0];
+      b[1] = p[j + by0];
+      b[2] = p[i + ((by0 + 1) & VSX_NOISE_BM)];
+      b[3] = p[j + ((by0 + 1) & VSX_NOISE_BM)];
+      for (int c = 0; c < 8; c++)
+      {
+        const float* g = g3[b[c & 3] + (c & 4 ? bz1 : bz0)];
+        q[c][0][k] = g[0];
+        q[c][1][k] = g[1];
+        q[c][2][k] = g[2];
+      }
+    }
+
+    __m128 three = _mm_set1_ps(3.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 sc[3];
+    for (int a = 0; a < 3; a++)
+      sc[a] = _mm_mul_ps(_mm_mul_ps(r0[a], r0[a]), _mm_sub_ps(three, _mm_mul_ps(two, r0[a])));
+
+    __m128 d[8];
+    for (int c = 0; c < 8; c++)
+    {
+      __m128 rx = c & 1 ? r1[0] : r0[0];
+      __m128 ry = c & 2 ? r1[1] : r0[1];
+      __m128 rz = c & 4 ? r1[2] : r0[2];
+      d[c] = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(rx, _mm_loadu_ps(q[c][0])),
+        _mm_mul_ps(ry, _mm_loadu_ps(q[c][1]))),
+        _mm_mul_ps(rz, _mm_loadu_ps(q[c][2])));
+    }
+    #define VSX_NOISE_LERP(t, a, b) _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)))
+    __m128 c0 = VSX_NOISE_LERP(sc[1], VSX_NOISE_LERP(sc[0], d[0], d[1]), VSX_NOISE_LERP(sc[0], d[2], d[3]));
+    __m128 c1 = VSX_NOISE_LERP(sc[1], VSX_NOISE_LERP(sc[0], d[4], d[5]), VSX_NOISE_LERP(sc[0], d[6], d[7]));
+    _mm_storeu_ps(out, VSX_NOISE_LERP(sc[2], c0, c1));
+    #undef VSX_NOISE_LERP
+#else
+    for (int k = 0; k < 4; k++)
+      out[k] = gradient3(x[k], y[k], z[k]);
+#endif
+  }
+
+  void simplex2_4(const float* x, const float* y, float* out) const
+  {
+#if defined(VSX_MATH_3D_SSE2)
+    const float F2 = 0.366025403f; // 0.5 * (sqrt(3) - 1)
+    const float G2 = 0.211324865f; // (3 - sqrt(3)) / 6
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 vx = _mm_loadu_ps(x);
+    __m128 vy = _mm_loadu_ps(y);
+    __m128 s = _mm_mul_ps(_mm_add_ps(vx, vy), _mm_set1_ps(F2));
+    // floor: truncate, then step down where that rounded up
+    __m128 fi = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(vx, s)));
+    fi = _mm_sub_ps(fi, _mm_and_ps(_mm_cmpgt_ps(fi, _mm_add_ps(vx, s)), one));
+    __m128 fj = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(vy, s)));
+    fj = _mm_sub_ps(fj, _mm_and_ps(_mm_cmpgt_ps(fj, _mm_add_ps(vy, s)), one));
+    __m128 t = _mm_mul_ps(_mm_add_ps(fi, fj), _mm_set1_ps(G2));
+    __m128 x0 = _mm_sub_ps(vx, _mm_sub_ps(fi, t));
+    __m128 y0 = _mm_sub_ps(vy, _mm_sub_ps(fj, t));
+    __m128 i1 = _mm_and_ps(_mm_cmpgt_ps(x0, y0), one);
+    __m128 j1 = _mm_sub_ps(one, i1);
+    __m128 g2v = _mm_set1_ps(G2);
+    __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), g2v);
+    __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, j1), g2v);
+    __m128 g2x2 = _mm_set1_ps(2.0f * G2 - 1.0f);
+    __m128 x2 = _mm_add_ps(x0, g2x2);
+    __m128 y2 = _mm_add_ps(y0, g2x2);
+
+    int ii[4], jj[4], i1i[4];
+    _mm_storeu_si128((__m128i*)ii, _mm_cvttps_epi32(fi));
+    _mm_storeu_si128((__m128i*)jj, _mm_cvttps_epi32(fj));
+    _mm_storeu_si128((__m128i*)i1i, _mm_cvttps_epi32(i1));
+    float gx[3][4], gy[3][4];
+    for (int k = 0; k < 4; k++)
+    {
+      int a = ii[k] & 255;
+      int b = jj[k] & 255;
+      const float* ga = grad3(perm12[a + perm[b]]);
+      const float* gb = grad3(perm12[a + i1i[k] + perm[b + 1 - i1i[k]]]);
+      const float* gc = grad3(perm12[a + 1 + perm[b + 1]]);
+      gx[0][k] = ga[0]; gy[0][k] = ga[1];
+      gx[1][k] = gb[0]; gy[1][k] = gb[1];
+      gx[2][k] = gc[0]; gy[2][k] = gc[1];
+    }
+
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 xs[3] = {x0, x1, x2};
+    __m128 ys[3] = {y0, y1, y2};
+    __m128 sum = zero;
+    for (int c = 0; c < 3; c++)
+    {
+      __m128 tc = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(xs[c], xs[c])), _mm_mul_ps(ys[c], ys[c]));
+      tc = _mm_max_ps(tc, zero);
+      tc = _mm_mul_ps(tc, tc);
+      __m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(gx[c]), xs[c]), _mm_mul_ps(_mm_loadu_ps(gy[c]), ys[c]));
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(tc, tc), d));
+    }
+    _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(70.0f)));
+#else
+    for (int k = 0; k < 4; k++)
+      out[k] = simplex2(x[k], y[k]);
+#endif
+  }
+
+  void simplex3_4(const float* x, const float* y, const float* z, float* out) const
+  {
+    for (int k = 0; k < 4; k++)
+      out[k] = simplex3(x[k], y[k], z[k]);
+  }
+
+  // sums octaves of either basis, abs_octaves gives turbulence
+  void octaves2_n(const float* x, const float* y, float* out, size_t count, int basis, int octaves, float frequency, float amplitude, bool abs_octaves) const
+  {
+    float bx[4], by[4], n[4], r[4];
+    for (size_t i = 0; i < count; i += 4)
+    {
+      size_t c = count - i < 4 ? count - i : 4;
+      for (size_t k = 0; k < 4; k++)
+      {
+        size_t s = k < c ? i + k : i;
+        bx[k] = x[s] * frequency;
+        by[k] = y[s] * frequency;
+        r[k] = 0.0f;
+      }
+      float amp = amplitude;
+      for (int o = 0; o < octaves; o++)
+      {
+        if (basis == VSX_NOISE_SIMPLEX)
+          simplex2_4(bx, by, n);
+        else
+          gradient2_4(bx, by, n);
+        for (int k = 0; k < 4; k++)
+        {
+          r[k] += (abs_octaves ? (float)fabs(n[k]) : n[k]) * amp;
+          bx[k] *= 2.0f;
+          by[k] *= 2.0f;
+        }
+        amp *= 0.5f;
+      }
+      for (size_t k = 0; k < c; k++)
+        out[i + k] = r[k];
+    }
+  }
+
+  void octaves3_n(const float* x, const float* y, const float* z, float* out, size_t count, int basis, int octaves, float frequency, float amplitude, bool abs_octaves) const
+  {
+    float bx[4], by[4], bz[4], n[4], r[4];
+    for (size_t i = 0; i < count; i += 4)
+    {
+      size_t c = count - i < 4 ? count - i : 4;
+      for (size_t k = 0; k < 4; k++)
+      {
+        size_t s = k < c ? i + k : i;
+        bx[k] = x[s] * frequency;
+        by[k] = y[s] * frequency;
+        bz[k] = z[s] * frequency;
+        r[k] = 0.0f;
+      }
+      float amp = amplitude;
+      for (int o = 0; o < octaves; o++)
+      {
+        if (basis == VSX_NOISE_SIMPLEX)
+          simplex3_4(bx, by, bz, n);
+        else
+          gradient3_4(bx, by, bz, n);
+        for (int k = 0; k < 4; k++)
+        {
+          r[k] += (abs_octaves ? (float)fabs(n[k]) : n[k]) * amp;
+          bx[k] *= 2.0f;
+          by[k] *= 2.0f;
+          bz[k] *= 2.0f;
+        }
+        amp *= 0.5f;
+      }
+      for (size_t k = 0; k < c; k++)
+        out[i + k] = r[k];
+    }
+  }
+
+public:
+
+  // Builds the tables, must be called before sampling. Not thread safe
+  // (reseeds rand() like the original did), so do it before handing the
+  // instance to workers.
+  void init(int seed)
+  {
+    int i, j, k;
+    srand(seed);
+    for (i = 0 ; i < VSX_NOISE_B ; i++)
+    {
+      p[i] = i;
+      // g1 is gone but its rand() call stays to keep the sequence
+      rand();
+      for (j = 0 ; j < 2 ; j++)
+        g2[i][j] = (float)((rand() % (VSX_NOISE_B + VSX_NOISE_B)) - VSX_NOISE_B) / VSX_NOISE_B;
+      normalize2(g2[i]);
+      for (j = 0 ; j < 3 ; j++)
+        g3[i][j] = (float)((rand() % (VSX_NOISE_B + VSX_NOISE_B)) - VSX_NOISE_B) / VSX_NOISE_B;
+      normalize3(g3[i]);
+    }
+
+    while (--i)
+    {
+      k = p[i];
+      p[i] = p[j = rand() % VSX_NOISE_B];
+      p[j] = k;
+    }
+
+    for (i = 0 ; i < VSX_NOISE_B + 2 ; i++)
+    {
+      p[VSX_NOISE_B + i] = p[i];
+      for (j = 0 ; j < 2 ; j++)
+        g2[VSX_NOISE_B + i][j] = g2[i][j];
+      for (j = 0 ; j < 3 ; j++)
+        g3[VSX_NOISE_B + i][j] = g3[i][j];
+    }
+
+    // simplex permutation from a private lcg
+    unsigned int state = (unsigned int)seed * 2654435761u + 1u;
+    for (i = 0; i < 256; i++)
+      perm[i] = (unsigned char)i;
+    for (i = 255; i > 0; i--)
+    {
+      state = state * 1664525u + 1013904223u;
+      j = (int)((state >> 8) % (unsigned int)(i + 1));
+      unsigned char t = perm[i];
+      perm[i] = perm[j];
+      perm[j] = t;
+    }
+    for (i = 0; i < 512; i++)
+    {
+      perm[i] = perm[i & 255];
+      perm12[i] = perm[i] % 12;
+    }
+  }
+
+  // single samples
+
+  float gradient2(float x, float y) const
+  {
+    float tx = x + VSX_NOISE_N;
+    float ty = y + VSX_NOISE_N;
+    int bx0 = ((int)tx) & VSX_NOISE_BM;
+    int bx1 = (bx0 + 1) & VSX_NOISE_BM;
+    float rx0 = tx - (int)tx;
+    float rx1 = rx0 - 1.0f;
+    int by0 = ((int)ty) & VSX_NOISE_BM;
+    int by1 = (by0 + 1) & VSX_NOISE_BM;
+    float ry0 = ty - (int)ty;
+    float ry1 = ry0 - 1.0f;
+
+    int i = p[bx0];
+    int j = p[bx1];
+    const float* q;
+    float sx = s_curve(rx0);
+    float sy = s_curve(ry0);
+
+    q = g2[p[i + by0]];
+    float u = rx0 * q[0] + ry0 * q[1];
+    q = g2[p[j + by0]];
+    float v = rx1 * q[0] + ry0 * q[1];
+    float a = lerp(sx, u, v);
+
+    q = g2[p[i + by1]];
+    u = rx0 * q[0] + ry1 * q[1];
+    q = g2[p[j + by1]];
+    v = rx1 * q[0] + ry1 * q[1];
+    float b = lerp(sx, u, v);
+
+    return lerp(sy, a, b);
+  }
+
+  float gradient3(float x, float y, float z) const
+  {
+    float tx = x + VSX_NOISE_N;
+    float ty = y + VSX_NOISE_N;
+    float tz = z + VSX_NOISE_N;
+    int bx0 = ((int)tx) & VSX_NOISE_BM;
+    int bx1 = (bx0 + 1) & VSX_NOISE_BM;
+    float rx0 = tx - (int)tx;
+    float rx1 = rx0 - 1.0f;
+    int by0 = ((int)ty) & VSX_NOISE_BM;
+    int by1 = (by0 + 1) & VSX_NOISE_BM;
+    float ry0 = ty - (int)ty;
+    float ry1 = ry0 - 1.0f;
+    int bz0 = ((int)tz) & VSX_NOISE_BM;
+    int bz1 = (bz0 + 1) & VSX_NOISE_BM;
+    float rz0 = tz - (int)tz;
+    float rz1 = rz0 - 1.0f;
+
+    int i = p[bx0];
+    int j = p[bx1];
+    int b00 = p[i + by0];
+    int b10 = p[j + by0];
+    int b01 = p[i + by1];
+    int b11 = p[j + by1];
+
+    float t = s_curve(rx0);
+    float sy = s_curve(ry0);
+    float sz = s_curve(rz0);
+    const float* q;
+    float u, v, a, b;
+
+    #define VSX_NOISE_AT3(rx, ry, rz) (rx * q[0] + ry * q[1] + rz * q[2])
+    q = g3[b00 + bz0]; u = VSX_NOISE_AT3(rx0, ry0, rz0);
+    q = g3[b10 + bz0]; v = VSX_NOISE_AT3(rx1, ry0, rz0);
+    a = lerp(t, u, v);
+    q = g3[b01 + bz0]; u = VSX_NOISE_AT3(rx0, ry1, rz0);
+    q = g3[b11 + bz0]; v = VSX_NOISE_AT3(rx1, ry1, rz0);
+    b = lerp(t, u, v);
+    float c = lerp(sy, a, b);
+
+    q = g3[b00 + bz1]; u = VSX_NOISE_AT3(rx0, ry0, rz1);
+    q = g3[b10 + bz1]; v = VSX_NOISE_AT3(rx1, ry0, rz1);
+    a = lerp(t, u, v);
+    q = g3[b01 + bz1]; u = VSX_NOISE_AT3(rx0, ry1, rz1);
+    q = g3[b11 + bz1]; v = VSX_NOISE_AT3(rx1, ry1, rz1);
+    b = lerp(t, u, v);
+    float d = lerp(sy, a, b);
+    #undef VSX_NOISE_AT3
+
+    return lerp(sz, c, d);
+  }
+
+  float gradient4(float x, float y, float z, float w) const
+  {
+    float v[4] = {x, y, z, w};
+    int b0[4], b1[4];
+    float r0[4], r1[4], sc[4];
+    for (int a = 0; a < 4; a++)
+    {
+      float t = v[a] + VSX_NOISE_N;
+      b0[a] = ((int)t) & VSX_NOISE_BM;
+      b1[a] = (b0[a] + 1) & VSX_NOISE_BM;
+      r0[a] = t - (int)t;
+      r1[a] = r0[a] - 1.0f;
+      sc[a] = s_curve(r0[a]);
+    }
+
+    // the 16 corners, bit a of c set for the far side along axis a
+    float d[16];
+    for (int c = 0; c < 16; c++)
+    {
+      int h = p[c & 1 ? b1[0] : b0[0]];
+      h = p[h + (c & 2 ? b1[1] : b0[1])];
+      h = p[h + (c & 4 ? b1[2] : b0[2])];
+      h = p[h + (c & 8 ? b1[3] : b0[3])];
+      const float* g = grad4(h & 31);
+      d[c] =
+        (c & 1 ? r1[0] : r0[0]) * g[0] +
+        (c & 2 ? r1[1] : r0[1]) * g[1] +
+        (c & 4 ? r1[2] : r0[2]) * g[2] +
+        (c & 8 ? r1[3] : r0[3]) * g[3];
+    }
+    // collapse one axis at a time
+    for (int a = 0, n = 16; a < 4; a++)
+    {
+      n /= 2;
+      for (int c = 0; c < n; c++)
+        d[c] = lerp(sc[a], d[2 * c], d[2 * c + 1]);
+    }
+    // the gradients are sqrt(3) long, scale to the range of the others
+    return d[0] * 0.57735027f;
+  }
+
+  float simplex2(float x, float y) const
+  {
+    const float F2 = 0.366025403f;
+    const float G2 = 0.211324865f;
+    float s = (x + y) * F2;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    float t = (float)(i + j) * G2;
+    float x0 = x - ((float)i - t);
+    float y0 = y - ((float)j - t);
+    int i1 = x0 > y0 ? 1 : 0;
+    int j1 = 1 - i1;
+    float x1 = x0 - i1 + G2;
+    float y1 = y0 - j1 + G2;
+    float x2 = x0 + (2.0f * G2 - 1.0f);
+    float y2 = y0 + (2.0f * G2 - 1.0f);
+    int ii = i & 255;
+    int jj = j & 255;
+
+    float n = 0.0f;
+    float t0 = 0.5f - x0 * x0 - y0 * y0;
+    if (t0 > 0.0f)
+    {
+      const float* g = grad3(perm12[ii + perm[jj]]);
+      t0 *= t0;
+      n += t0 * t0 * (g[0] * x0 + g[1] * y0);
+    }
+    float t1 = 0.5f - x1 * x1 - y1 * y1;
+    if (t1 > 0.0f)
+    {
+      const float* g = grad3(perm12[ii + i1 + perm[jj + j1]]);
+      t1 *= t1;
+      n += t1 * t1 * (g[0] * x1 + g[1] * y1);
+    }
+    float t2 = 0.5f - x2 * x2 - y2 * y2;
+    if (t2 > 0.0f)
+    {
+      const float* g = grad3(perm12[ii + 1 + perm[jj + 1]]);
+      t2 *= t2;
+      n += t2 * t2 * (g[0] * x2 + g[1] * y2);
+    }
+    return 70.0f * n;
+  }
+
+  float simplex3(float x, float y, float z) const
+  {
+    const float F3 = 1.0f / 3.0f;
+    const float G3 = 1.0f / 6.0f;
+    float s = (x + y + z) * F3;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    int k = fast_floor(z + s);
+    float t = (float)(i + j + k) * G3;
+    float x0 = x - ((float)i - t);
+    float y0 = y - ((float)j - t);
+    float z0 = z - ((float)k - t);
+
+    // which simplex we're in, ranking the offsets
+    int i1 = x0 >= y0 && x0 >= z0;
+    int j1 = y0 > x0 && y0 >= z0;
+    int k1 = z0 > x0 && z0 > y0;
+    int i2 = x0 >= y0 || x0 >= z0;
+    int j2 = y0 > x0 || y0 >= z0;
+    int k2 = z0 > x0 || z0 > y0;
+
+    float xs[4], ys[4], zs[4];
+    xs[0] = x0; ys[0] = y0; zs[0] = z0;
+    xs[1] = x0 - i1 + G3; ys[1] = y0 - j1 + G3; zs[1] = z0 - k1 + G3;
+    xs[2] = x0 - i2 + 2.0f * G3; ys[2] = y0 - j2 + 2.0f * G3; zs[2] = z0 - k2 + 2.0f * G3;
+    xs[3] = x0 - 1.0f + 3.0f * G3; ys[3] = y0 - 1.0f + 3.0f * G3; zs[3] = z0 - 1.0f + 3.0f * G3;
+    int ii = i & 255;
+    int jj = j & 255;
+    int kk = k & 255;
+    int gi[4];
+    gi[0] = perm12[ii + perm[jj + perm[kk]]];
+    gi[1] = perm12[ii + i1 + perm[jj + j1 + perm[kk + k1]]];
+    gi[2] = perm12[ii + i2 + perm[jj + j2 + perm[kk + k2]]];
+    gi[3] = perm12[ii + 1 + perm[jj + 1 + perm[kk + 1]]];
+
+    float n = 0.0f;
+    for (int c = 0; c < 4; c++)
+    {
+      float tc = 0.6f - xs[c] * xs[c] - ys[c] * ys[c] - zs[c] * zs[c];
+      if (tc > 0.0f)
+      {
+        const float* g = grad3(gi[c]);
+        tc *= tc;
+        n += tc * tc * (g[0] * xs[c] + g[1] * ys[c] + g[2] * zs[c]);
+      }
+    }
+    return 32.0f * n;
+  }
+
+  float simplex4(float x, float y, float z, float w) const
+  {
+    const float F4 = 0.309016994f; // (sqrt(5) - 1) / 4
+    const float G4 = 0.138196601f; // (5 - sqrt(5)) / 20
+    float s = (x + y + z + w) * F4;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    int k = fast_floor(z + s);
+    int l = fast_floor(w + s);
+    float t = (float)(i + j + k + l) * G4;
+    float v0[4];
+    v0[0] = x - ((float)i - t);
+    v0[1] = y - ((float)j - t);
+    v0[2] = z - ((float)k - t);
+    v0[3] = w - ((float)l - t);
+
+    // rank each axis against the others, the largest steps first
+    int rank[4] = {0, 0, 0, 0};
+    for (int a = 0; a < 4; a++)
+      for (int b = a + 1; b < 4; b++)
+      {
+        if (v0[a] > v0[b]) rank[a]++;
+        else rank[b]++;
+      }
+
+    int base[4] = {i & 255, j & 255, k & 255, l & 255};
+    float n = 0.0f;
+    for (int c = 0; c < 5; c++)
+    {
+      // corner c is offset by 1 along the axes ranked >= 4 - c
+      int o[4];
+      float d[4];
+      for (int a = 0; a < 4; a++)
+      {
+        o[a] = c == 0 ? 0 : rank[a] >= 4 - c;
+        d[a] = v0[a] - o[a] + c * G4;
+      }
+      float tc = 0.6f - d[0] * d[0] - d[1] * d[1] - d[2] * d[2] - d[3] * d[3];
+      if (tc > 0.0f)
+      {
+        int gi = perm[base[0] + o[0] + perm[base[1] + o[1] + perm[base[2] + o[2] + perm[base[3] + o[3]]]]] & 31;
+        const float* g = grad4(gi);
+        tc *= tc;
+        n += tc * tc * (g[0] * d[0] + g[1] * d[1] + g[2] * d[2] + g[3] * d[3]);
+      }
+    }
+    return 27.0f * n;
+  }
+
+  // Fractal sum of octaves like the old Perlin::Get: each octave doubles
+  // the frequency and halves the amplitude.
+  float fbm2(float x, float y, int octaves, float frequency, float amplitude, int basis = VSX_NOISE_GRADIENT) const
+  {
+    float r;
+    octaves2_n(&x, &y, &r, 1, basis, octaves, frequency, amplitude, false);
+    return r;
+  }
+
+  // arrays of samples
+
+  void gradient2_n(const float* x, const float* y, float* out, size_t count) const
+  {
+    octaves2_n(x, y, out, count, VSX_NOISE_GRADIENT, 1, 1.0f, 1.0f, false);
+  }
+
+  void gradient3_n(const float* x, const float* y, const float* z, float* out, size_t count) const
+  {
+    octaves3_n(x, y, z, out, count, VSX_NOISE_GRADIENT, 1, 1.0f, 1.0f, false);
+  }
+
+  void gradient4_n(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const
+  {
+    for (size_t i = 0; i < count; i++)
+      out[i] = gradient4(x[i], y[i], z[i], w[i]);
+  }
+
+  void simplex2_n(const float* x, const float* y, float* out, size_t count) const
+  {
+    octaves2_n(x, y, out, count, VSX_NOISE_SIMPLEX, 1, 1.0f, 1.0f, false);
+  }
+
+  void simplex3_n(const float* x, const float* y, const float* z, float* out, size_t count) const
+  {
+    octaves3_n(x, y, z, out, count, VSX_NOISE_SIMPLEX, 1, 1.0f, 1.0f, false);
+  }
+
+  void simplex4_n(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const
+  {
+    for (size_t i = 0; i < count; i++)
+      out[i] = simplex4(x[i], y[i], z[i], w[i]);
+  }
+
+  void fbm2_n(const float* x, const float* y, float* out, size_t count, int octaves, float frequency, float amplitude, int basis = VSX_NOISE_GRADIENT) const
+  {
+    octaves2_n(x, y, out, count, basis, octaves, frequency, amplitude, false);
+  }
+
+  void fbm3_n(const float* x, const float* y, const float* z, float* out, size_t count, int octaves, float frequency, float amplitude, int basis = VSX_NOISE_GRADIENT) const
+  {
+    octaves3_n(x, y, z, out, count, basis, octaves, frequency, amplitude, false);
+  }
+
+  // like fbm but summing the absolute value of each octave
+  void turbulence2_n(const float* x, const float* y, float* out, size_t count, int octaves, float frequency, float amplitude, int basis = VSX_NOISE_GRADIENT) const
+  {
+    octaves2_n(x, y, out, count, basis, octaves, frequency, amplitude, true);
+  }
+
+  void turbulence3_n(const float* x, const float* y, const float* z, float* out, size_t count, int octaves, float frequency, float amplitude, int basis = VSX_NOISE_GRADIENT) const
+  {
+    octaves3_n(x, y, z, out, count, basis, octaves, frequency, amplitude, true);
+  }
+};
+
+#endif
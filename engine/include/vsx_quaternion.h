@@ -164,11 +164,31 @@ public:
   // OPTIMIZATION PENALTY!!!
   // Since we want to be able to multiply with ourselves, q1 is not by reference.
   inline void mul(vsx_quaternion q1, vsx_quaternion &q2) {
+#if defined(VSX_MATH_3D_SSE)
+    // one q1 component times a signed swizzle of q2 per term, summed in
+    // the same order as the scalar code below
+    __m128 b = _mm_loadu_ps(&q2.x);
+    __m128 t0 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(0,1,2,3)), _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f));
+    __m128 t1 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(1,0,3,2)), _mm_setr_ps(0.0f, 0.0f, -0.0f, -0.0f));
+    __m128 t2 = _mm_xor_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2,3,0,1)), _mm_setr_ps(-0.0f, 0.0f, 0.0f, -0.0f));
+    __m128 r = _mm_add_ps(
+                 _mm_add_ps(
+                   _mm_add_ps(
+                     _mm_mul_ps(_mm_set1_ps(q1.x), t0),
+                     _mm_mul_ps(_mm_set1_ps(q1.y), t1)
+                   ),
+                   _mm_mul_ps(_mm_set1_ps(q1.z), t2)
+                 ),
+                 _mm_mul_ps(_mm_set1_ps(q1.w), b)
+               );
+    _mm_storeu_ps(&x, r);
+#else
     x =  q1.x * q2.w + q1.y * q2.z - q1.z * q2.y + q1.w * q2.x;
     y = -q1.x * q2.z + q1.y * q2.w + q1.z * q2.x + q1.w * q2.y;
     z =  q1.x * q2.y - q1.y * q2.x + q1.z * q2.w + q1.w * q2.z;
     w = -q1.x * q2.x - q1.y * q2.y - q1.z * q2.z + q1.w * q2.w;
-}
+#endif
+  }
   
   inline vsx_matrix matrix()
   {
@@ -288,6 +308,7 @@ public:
   
 };
 
-
+// mul() and the batch kernels read quaternions as packed x,y,z,w floats
+typedef char vsx_quaternion_layout_check[sizeof(vsx_quaternion) == 4 * sizeof(float) ? 1 : -1];
 
 #endif
@@ -0,0 +1,226 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#ifndef VSX_QUATERNION_BATCH_H
+#define VSX_QUATERNION_BATCH_H
+
+#include <stddef.h>
+#include "vsx_quaternion.h"
+
+// Slerp of whole quaternion arrays at once, for animation code blending
+// many rotations per frame.
+//
+// vsx_quaternion::slerp needs acos and two sin per call. Here the weights
+// sin((1-t)a)/sin(a) and sin(t*a)/sin(a) come from a fixed polynomial in
+// cos(a) and t (D. Eberly, "A Fast and Accurate Algorithm for Computing
+// SLERP"). It's only multiplies and adds, so SSE/NEON do four quaternions
+// per step; the scalar tail uses the same polynomial. The result is
+// within ~1e-6 of slerp() for unit quaternions and takes the same short
+// way around.
+//
+// from, to and dest may be the same arrays.
+//
+// Usage:
+//   vsx_quaternion_batch_slerp(from, to, t, dest, count);       // one t
+//   vsx_quaternion_batch_slerp(from, to, t_array, dest, count); // t per item
+
+#define VSX_QUATERNION_BATCH_SLERP_TERMS 16
+
+// u[i] = 1/(i(2i+1)), v[i] = i/(2i+1) for i = 1..16, the last pair scaled
+// to soak up the truncation error of the series
+class vsx_quaternion_batch_slerp_table
+{
+public:
+  float u[VSX_QUATERNION_BATCH_SLERP_TERMS];
+  float v[VSX_QUATERNION_BATCH_SLERP_TERMS];
+
+  vsx_quaternion_batch_slerp_table()
+  {
+    for (int i = 1; i <= VSX_QUATERNION_BATCH_SLERP_TERMS; i++)
+    {
+      u[i - 1] = 1.0f / (float)(i * (2 * i + 1));
+      v[i - 1] = (float)i / (float)(2 * i + 1);
+    }
+    const float one_plus_mu = 1.90110745351730037f;
+    u[VSX_QUATERNION_BATCH_SLERP_TERMS - 1] *= one_plus_mu;
+    v[VSX_QUATERNION_BATCH_SLERP_TERMS - 1] *= one_plus_mu;
+  }
+
+  // weights for from and to, cosom = dot(from, to)
+  inline void weights(float cosom, float t, float& w_from, float& w_to) const
+  {
+    float sign = 1.0f;
+    if (cosom < 0.0f)
+    {
+      cosom = -cosom;
+      sign = -1.0f;
+    }
+    float xm1 = cosom - 1.0f;
+    float d = 1.0f - t;
+    float tt = t * t;
+    float dd = d * d;
+    float ft = 1.0f;
+    float fd = 1.0f;
+    for (int i = VSX_QUATERNION_BATCH_SLERP_TERMS - 1; i >= 0; i--)
+    {
+      ft = 1.0f + (u[i] * tt - v[i]) * xm1 * ft;
+      fd = 1.0f + (u[i] * dd - v[i]) * xm1 * fd;
+    }
+    w_from = d * fd;
+    w_to = sign * t * ft;
+  }
+};
+
+inline const vsx_quaternion_batch_slerp_table& vsx_quaternion_batch_slerp_coefficients()
+{
+  static const vsx_quaternion_batch_slerp_table table;
+  return table;
+}
+
+// t_step is 0 for one t for all, 1 for a t per quaternion
+inline void vsx_quaternion_batch_slerp_strided(
+  const vsx_quaternion* from,
+  const vsx_quaternion* to,
+  const float* t,
+  size_t t_step,
+  vsx_quaternion* dest,
+  size_t count
+)
+{
+  const vsx_quaternion_batch_slerp_table& c = vsx_quaternion_batch_slerp_coefficients();
+  size_t i = 0;
+#if defined(VSX_MATH_3D_SSE)
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 sign_bit = _mm_set1_ps(-0.0f);
+  __m128 u[VSX_QUATERNION_BATCH_SLERP_TERMS];
+  __m128 v[VSX_QUATERNION_BATCH_SLERP_TERMS];
+  for (int k = 0; k < VSX_QUATERNION_BATCH_SLERP_TERMS; k++)
+  {
+    u[k] = _mm_set1_ps(c.u[k]);
+    v[k] = _mm_set1_ps(c.v[k]);
+  }
+  for (; i + 4 <= count; i += 4)
+  {
+    // 4 quaternions to x/y/z/w lanes
+    __m128 fx = _mm_loadu_ps(&from[i].x);
+    __m128 fy = _mm_loadu_ps(&from[i + 1].x);
+    __m128 fz = _mm_loadu_ps(&from[i + 2].x);
+    __m128 fw = _mm_loadu_ps(&from[i + 3].x);
+    _MM_TRANSPOSE4_PS(fx, fy, fz, fw);
+    __m128 tx = _mm_loadu_ps(&to[i].x);
+    __m128 ty = _mm_loadu_ps(&to[i + 1].x);
+    __m128 tz = _mm_loadu_ps(&to[i + 2].x);
+    __m128 tw = _mm_loadu_ps(&to[i + 3].x);
+    _MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+
+    __m128 tt = t_step ? _mm_loadu_ps(t + i) : _mm_set1_ps(*t);
+
+    __m128 cosom = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, tx), _mm_mul_ps(fy, ty)), _mm_mul_ps(fz, tz)), _mm_mul_ps(fw, tw));
+    __m128 sign = _mm_and_ps(cosom, sign_bit);
+    __m128 xm1 = _mm_sub_ps(_mm_xor_ps(cosom, sign), one);
+    __m128 d = _mm_sub_ps(one, tt);
+    __m128 t2 = _mm_mul_ps(tt, tt);
+    __m128 d2 = _mm_mul_ps(d, d);
+    __m128 ft = one;
+    __m128 fd = one;
+    for (int k = VSX_QUATERNION_BATCH_SLERP_TERMS - 1; k >= 0; k--)
+    {
+      ft = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u[k], t2), v[k]), xm1), ft));
+      fd = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u[k], d2), v[k]), xm1), fd));
+    }
+    __m128 w_from = _mm_mul_ps(d, fd);
+    __m128 w_to = _mm_xor_ps(_mm_mul_ps(tt, ft), sign);
+
+    __m128 rx = _mm_add_ps(_mm_mul_ps(fx, w_from), _mm_mul_ps(tx, w_to));
+    __m128 ry = _mm_add_ps(_mm_mul_ps(fy, w_from), _mm_mul_ps(ty, w_to));
+    __m128 rz = _mm_add_ps(_mm_mul_ps(fz, w_from), _mm_mul_ps(tz, w_to));
+    __m128 rw = _mm_add_ps(_mm_mul_ps(fw, w_from), _mm_mul_ps(tw, w_to));
+    _MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+    _mm_storeu_ps(&dest[i].x, rx);
+    _mm_storeu_ps(&dest[i + 1].x, ry);
+    _mm_storeu_ps(&dest[i + 2].x, rz);
+    _mm_storeu_ps(&dest[i + 3].x, rw);
+  }
+#elif defined(VSX_MATH_3D_NEON)
+  float32x4_t one = vdupq_n_f32(1.0f);
+  uint32x4_t sign_bit = vdupq_n_u32(0x80000000u);
+  for (; i + 4 <= count; i += 4)
+  {
+    // vld4q splits 4 quaternions to x/y/z/w lanes
+    float32x4x4_t f = vld4q_f32(&from[i].x);
+    float32x4x4_t q = vld4q_f32(&to[i].x);
+    float32x4_t tt = t_step ? vld1q_f32(t + i) : vdupq_n_f32(*t);
+
+    float32x4_t cosom = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(f.val[0], q.val[0]), vmulq_f32(f.val[1], q.val[1])), vmulq_f32(f.val[2], q.val[2])), vmulq_f32(f.val[3], q.val[3]));
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(cosom), sign_bit);
+    float32x4_t xm1 = vsubq_f32(vabsq_f32(cosom), one);
+    float32x4_t d = vsubq_f32(one, tt);
+    float32x4_t t2 = vmulq_f32(tt, tt);
+    float32x4_t d2 = vmulq_f32(d, d);
+    float32x4_t ft = one;
+    float32x4_t fd = one;
+    for (int k = VSX_QUATERNION_BATCH_SLERP_TERMS - 1; k >= 0; k--)
+    {
+      float32x4_t uk = vdupq_n_f32(c.u[k]);
+      float32x4_t vk = vdupq_n_f32(c.v[k]);
+      ft = vaddq_f32(one, vmulq_f32(vmulq_f32(vsubq_f32(vmulq_f32(uk, t2), vk), xm1), ft));
+      fd = vaddq_f32(one, vmulq_f32(vmulq_f32(vsubq_f32(vmulq_f32(uk, d2), vk), xm1), fd));
+    }
+    float32x4_t w_from = vmulq_f32(d, fd);
+    float32x4_t w_to = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vmulq_f32(tt, ft)), sign));
+
+    float32x4x4_t r;
+    for (int k = 0; k < 4; k++)
+      r.val[k] = vaddq_f32(vmulq_f32(f.val[k], w_from), vmulq_f32(q.val[k], w_to));
+    vst4q_f32(&dest[i].x, r);
+  }
+#endif
+  for (; i < count; i++)
+  {
+    const vsx_quaternion& a = from[i];
+    const vsx_quaternion& b = to[i];
+    float w_from, w_to;
+    c.weights(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w, t[i * t_step], w_from, w_to);
+    vsx_quaternion r;
+    r.x = a.x * w_from + b.x * w_to;
+    r.y = a.y * w_from + b.y * w_to;
+    r.z = a.z * w_from + b.z * w_to;
+    r.w = a.w * w_from + b.w * w_to;
+    dest[i] = r;
+  }
+}
+
+// dest[i] = slerp(from[i], to[i], t)
+inline void vsx_quaternion_batch_slerp(const vsx_quaternion* from, const vsx_quaternion* to, float t, vsx_quaternion* dest, size_t count)
+{
+  vsx_quaternion_batch_slerp_strided(from, to, &t, 0, dest, count);
+}
+
+// dest[i] = slerp(from[i], to[i], t[i])
+inline void vsx_quaternion_batch_slerp(const vsx_quaternion* from, const vsx_quaternion* to, const float* t, vsx_quaternion* dest, size_t count)
+{
+  vsx_quaternion_batch_slerp_strided(from, to, t, 1, dest, count);
+}
+
+#endif
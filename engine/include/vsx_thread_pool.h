@@ -0,0 +1,97 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_THREAD_POOL_H
+#define VSX_THREAD_POOL_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <vsx_platform.h>
+
+#if PLATFORM_FAMILY == PLATFORM_FAMILY_UNIX
+#define VSX_THREAD_POOL_DLLIMPORT
+#else
+  #ifdef VSX_ENG_DLL
+    #define VSX_THREAD_POOL_DLLIMPORT __declspec (dllexport)
+  #else
+    #define VSX_THREAD_POOL_DLLIMPORT __declspec (dllimport)
+  #endif
+#endif
+
+// Engine-wide worker pool.
+//
+// One set of worker threads (one per core) shared by every module, so that
+// modules splitting their work up don't each spawn their own threads.
+//
+// Two ways to use it:
+// * parallel_for - splits [0, count) into chunks and runs them on the pool,
+//   the calling thread helps out and the call returns when all chunks are done.
+//   Safe to call from inside a pool job (nested calls never dead-lock as the
+//   caller can always finish the work on its own).
+// * add_job - fire and forget, the job runs on one of the workers.
+
+// called with a sub range [start, end) of the total range
+typedef void (*vsx_thread_pool_range_func)(void* arg, size_t start, size_t end);
+
+// asynchronous job
+typedef void (*vsx_thread_pool_job_func)(void* arg);
+
+class vsx_thread_pool_job;
+
+class vsx_thread_pool {
+  pthread_mutex_t queue_mutex;
+  pthread_cond_t queue_cond;
+  vsx_thread_pool_job* queue_head;
+  vsx_thread_pool_job* queue_tail;
+  size_t num_threads;
+
+  vsx_thread_pool();
+  static void create_instance();
+  void push(vsx_thread_pool_job* job);
+  static void* worker(void* ptr);
+
+public:
+  // the shared instance, workers are started on first use
+  VSX_THREAD_POOL_DLLIMPORT static vsx_thread_pool* get_instance();
+
+  // number of hardware threads, always at least 1
+  VSX_THREAD_POOL_DLLIMPORT static size_t get_num_cpus();
+
+  size_t get_num_threads()
+  {
+    return num_threads;
+  }
+
+  // Runs func over [0, count) split into at most get_num_threads() * 4 chunks
+  // of at least min_chunk items. Ranges smaller than min_chunk run inline.
+  VSX_THREAD_POOL_DLLIMPORT void parallel_for(
+    size_t count,
+    size_t min_chunk,
+    vsx_thread_pool_range_func func,
+    void* arg
+  );
+
+  VSX_THREAD_POOL_DLLIMPORT void add_job(vsx_thread_pool_job_func func, void* arg);
+};
+
+#endif
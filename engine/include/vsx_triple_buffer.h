@@ -0,0 +1,89 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_TRIPLE_BUFFER_H
+#define VSX_TRIPLE_BUFFER_H
+
+// Lock-free handoff of whole values from one producer thread to one
+// consumer thread, where only the latest value matters.
+//
+// Three buffers: the producer owns one, the consumer owns one and the third
+// sits in the middle. Publishing swaps the producer's buffer with the middle
+// one, acquiring swaps the consumer's buffer with the middle one if the
+// producer has put something new there. Neither side ever waits and the
+// consumer always sees a complete value.
+//
+// Usage:
+//   producer: fill in *get_write() completely, then publish()
+//   consumer: acquire(), then read *get_read() until the next acquire()
+
+#define VSX_TRIPLE_BUFFER_FRESH 4
+
+template<class T>
+class vsx_triple_buffer
+{
+  T buffers[3];
+  volatile int middle; // index of the middle buffer | FRESH if unread
+  int write_index;     // producer only
+  int read_index;      // consumer only
+
+public:
+
+  vsx_triple_buffer()
+  :
+    middle(1),
+    write_index(0),
+    read_index(2)
+  {
+  }
+
+  // producer side
+  T* get_write()
+  {
+    return &buffers[write_index];
+  }
+
+  void publish()
+  {
+    // writes to the buffer must be visible before it is handed over
+    __sync_synchronize();
+    write_index = __sync_lock_test_and_set(&middle, write_index | VSX_TRIPLE_BUFFER_FRESH) & 3;
+  }
+
+  // consumer side, returns true if there was a new value
+  bool acquire()
+  {
+    if ( !(middle & VSX_TRIPLE_BUFFER_FRESH) )
+      return false;
+    read_index = __sync_lock_test_and_set(&middle, read_index) & 3;
+    __sync_synchronize();
+    return true;
+  }
+
+  T* get_read()
+  {
+    return &buffers[read_index];
+  }
+};
+
+#endif
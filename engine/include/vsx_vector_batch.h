@@ -0,0 +1,277 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_VECTOR_BATCH_H
+#define VSX_VECTOR_BATCH_H
+
+#include <stddef.h>
+#include "vsx_math_3d.h"
+#include "vsx_quaternion.h"
+
+// Transforms of whole vsx_vector arrays (vertices, normals) at once.
+//
+// Same arithmetic as vsx_matrix::multiply_vector / vsx_vector operators,
+// in the same order, so results match the per vector code. With SSE or
+// NEON (see vsx_math_3d.h) four vectors go per step: loaded as three
+// registers, shuffled to x/y/z lanes (NEON's vld3q does that itself),
+// transformed and shuffled back; the remaining (count % 4) go one by one.
+//
+// src and dest may be the same array, other overlaps aren't allowed.
+//
+// Usage:
+//   vsx_vector_batch_transform(mat, src, dest, count);
+//   vsx_vector_batch_transform(mat, src, dest, count, normals_src, normals_dest);
+//   vsx_vector_batch_scale_offset(scale, offset, src, dest, count);
+
+// the kernels read vectors as packed x,y,z floats
+typedef char vsx_vector_batch_layout_check[sizeof(vsx_vector) == 3 * sizeof(float) ? 1 : -1];
+
+#if defined(VSX_MATH_3D_SSE)
+
+typedef __m128 vsx_vector_batch_reg;
+
+// 4 packed vectors (3 registers) to lanes
+#define VSX_VECTOR_BATCH_LOAD(p, vx, vy, vz) \
+  { \
+    __m128 a0 = _mm_loadu_ps((const float*)(p)); \
+    __m128 a1 = _mm_loadu_ps((const float*)(p) + 4); \
+    __m128 a2 = _mm_loadu_ps((const float*)(p) + 8); \
+    __m128 t = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(2,1,3,2)); \
+    __m128 u = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(0,0,2,1)); \
+    __m128 w = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1,1,2,2)); \
+    vx = _mm_shuffle_ps(a0, t, _MM_SHUFFLE(2,0,3,0)); \
+    vy = _mm_shuffle_ps(u, t, _MM_SHUFFLE(3,1,2,0)); \
+    vz = _mm_shuffle_ps(w, a2, _MM_SHUFFLE(3,0,2,0)); \
+  }
+
+// lanes back to 4 packed vectors
+#define VSX_VECTOR_BATCH_STORE(p, vx, vy, vz) \
+  { \
+    __m128 xy0 = _mm_unpacklo_ps(vx, vy); \
+    __m128 xy1 = _mm_unpackhi_ps(vx, vy); \
+    __m128 zx = _mm_shuffle_ps(vz, xy0, _MM_SHUFFLE(2,2,0,0)); \
+    __m128 yz = _mm_shuffle_ps(xy0, vz, _MM_SHUFFLE(1,1,3,3)); \
+    __m128 zz = _mm_shuffle_ps(vz, xy1, _MM_SHUFFLE(3,2,3,2)); \
+    _mm_storeu_ps((float*)(p), _mm_shuffle_ps(xy0, zx, _MM_SHUFFLE(2,0,1,0))); \
+    _mm_storeu_ps((float*)(p) + 4, _mm_shuffle_ps(yz, xy1, _MM_SHUFFLE(1,0,2,0))); \
+    _mm_storeu_ps((float*)(p) + 8, _mm_shuffle_ps(zz, zz, _MM_SHUFFLE(1,3,2,0))); \
+  }
+
+// the 12 used matrix entries, broadcast
+class vsx_vector_batch_matrix
+{
+public:
+  __m128 m[12];
+
+  vsx_vector_batch_matrix(const vsx_matrix& mat)
+  {
+    for (int i = 0; i < 12; i++)
+      m[i] = _mm_set1_ps(mat.m[i]);
+  }
+
+  inline void transform(__m128& vx, __m128& vy, __m128& vz) const
+  {
+    __m128 nx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], vx), _mm_mul_ps(m[1], vy)), _mm_mul_ps(m[2], vz)), m[3]);
+    __m128 ny = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], vx), _mm_mul_ps(m[5], vy)), _mm_mul_ps(m[6], vz)), m[7]);
+    __m128 nz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], vx), _mm_mul_ps(m[9], vy)), _mm_mul_ps(m[10], vz)), m[11]);
+    vx = nx;
+    vy = ny;
+    vz = nz;
+  }
+};
+
+#elif defined(VSX_MATH_3D_NEON)
+
+typedef float32x4_t vsx_vector_batch_reg;
+
+#define VSX_VECTOR_BATCH_LOAD(p, vx, vy, vz) \
+  { \
+    float32x4x3_t a = vld3q_f32((const float*)(p)); \
+    vx = a.val[0]; \
+    vy = a.val[1]; \
+    vz = a.val[2]; \
+  }
+
+#define VSX_VECTOR_BATCH_STORE(p, vx, vy, vz) \
+  { \
+    float32x4x3_t a; \
+    a.val[0] = vx; \
+    a.val[1] = vy; \
+    a.val[2] = vz; \
+    vst3q_f32((float*)(p), a); \
+  }
+
+class vsx_vector_batch_matrix
+{
+public:
+  float32x4_t m[12];
+
+  vsx_vector_batch_matrix(const vsx_matrix& mat)
+  {
+    for (int i = 0; i < 12; i++)
+      m[i] = vdupq_n_f32(mat.m[i]);
+  }
+
+  // separate multiply and add, vmlaq may be fused
+  inline void transform(float32x4_t& vx, float32x4_t& vy, float32x4_t& vz) const
+  {
+    float32x4_t nx = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[0], vx), vmulq_f32(m[1], vy)), vmulq_f32(m[2], vz)), m[3]);
+    float32x4_t ny = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[4], vx), vmulq_f32(m[5], vy)), vmulq_f32(m[6], vz)), m[7]);
+    float32x4_t nz = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[8], vx), vmulq_f32(m[9], vy)), vmulq_f32(m[10], vz)), m[11]);
+    vx = nx;
+    vy = ny;
+    vz = nz;
+  }
+};
+
+#endif
+
+// dest[i] = mat.multiply_vector(src[i])
+inline void vsx_vector_batch_transform(const vsx_matrix& mat, const vsx_vector* src, vsx_vector* dest, size_t count)
+{
+  size_t i = 0;
+#if defined(VSX_MATH_3D_SSE) || defined(VSX_MATH_3D_NEON)
+  vsx_vector_batch_matrix bm(mat);
+  for (; i + 4 <= count; i += 4)
+  {
+    vsx_vector_batch_reg vx, vy, vz;
+    VSX_VECTOR_BATCH_LOAD(src + i, vx, vy, vz);
+    bm.transform(vx, vy, vz);
+    VSX_VECTOR_BATCH_STORE(dest + i, vx, vy, vz);
+  }
+#endif
+  // copied, multiply_matrix_other_vec can't take its own vector
+  for (; i < count; i++)
+  {
+    vsx_vector v = src[i];
+    dest[i].multiply_matrix_other_vec(mat.m, v);
+  }
+}
+
+// Vertices and normals in one pass. The normals get the same matrix
+// (so the translation column should be zero, as for rotations) and count
+// applies to both.
+inline void vsx_vector_batch_transform(
+  const vsx_matrix& mat,
+  const vsx_vector* src,
+  vsx_vector* dest,
+  size_t count,
+  const vsx_vector* normals_src,
+  vsx_vector* normals_dest
+)
+{
+  size_t i = 0;
+#if defined(VSX_MATH_3D_SSE) || defined(VSX_MATH_3D_NEON)
+  vsx_vector_batch_matrix bm(mat);
+  for (; i + 4 <= count; i += 4)
+  {
+    vsx_vector_batch_reg vx, vy, vz;
+    VSX_VECTOR_BATCH_LOAD(src + i, vx, vy, vz);
+    bm.transform(vx, vy, vz);
+    VSX_VECTOR_BATCH_STORE(dest + i, vx, vy, vz);
+    VSX_VECTOR_BATCH_LOAD(normals_src + i, vx, vy, vz);
+    bm.transform(vx, vy, vz);
+    VSX_VECTOR_BATCH_STORE(normals_dest + i, vx, vy, vz);
+  }
+#endif
+  for (; i < count; i++)
+  {
+    vsx_vector v = src[i];
+    vsx_vector n = normals_src[i];
+    dest[i].multiply_matrix_other_vec(mat.m, v);
+    normals_dest[i].multiply_matrix_other_vec(mat.m, n);
+  }
+}
+
+// rotation by a (normalized) quaternion, normals optional
+inline void vsx_vector_batch_rotate(
+  vsx_quaternion q,
+  const vsx_vector* src,
+  vsx_vector* dest,
+  size_t count,
+  const vsx_vector* normals_src = 0,
+  vsx_vector* normals_dest = 0
+)
+{
+  vsx_matrix mat = q.matrix();
+  if (normals_src)
+    vsx_vector_batch_transform(mat, src, dest, count, normals_src, normals_dest);
+  else
+    vsx_vector_batch_transform(mat, src, dest, count);
+}
+
+// dest[i] = src[i] * scale + offset, per component. Needs no shuffling:
+// four packed vectors line up with scale/offset rotated three ways.
+inline void vsx_vector_batch_scale_offset(const vsx_vector& scale, const vsx_vector& offset, const vsx_vector* src, vsx_vector* dest, size_t count)
+{
+  size_t i = 0;
+#if defined(VSX_MATH_3D_SSE)
+  __m128 s0 = _mm_setr_ps(scale.x, scale.y, scale.z, scale.x);
+  __m128 s1 = _mm_setr_ps(scale.y, scale.z, scale.x, scale.y);
+  __m128 s2 = _mm_setr_ps(scale.z, scale.x, scale.y, scale.z);
+  __m128 o0 = _mm_setr_ps(offset.x, offset.y, offset.z, offset.x);
+  __m128 o1 = _mm_setr_ps(offset.y, offset.z, offset.x, offset.y);
+  __m128 o2 = _mm_setr_ps(offset.z, offset.x, offset.y, offset.z);
+  for (; i + 4 <= count; i += 4)
+  {
+    const float* sp = (const float*)(src + i);
+    float* dp = (float*)(dest + i);
+    __m128 a0 = _mm_loadu_ps(sp);
+    __m128 a1 = _mm_loadu_ps(sp + 4);
+    __m128 a2 = _mm_loadu_ps(sp + 8);
+    _mm_storeu_ps(dp, _mm_add_ps(_mm_mul_ps(a0, s0), o0));
+    _mm_storeu_ps(dp + 4, _mm_add_ps(_mm_mul_ps(a1, s1), o1));
+    _mm_storeu_ps(dp + 8, _mm_add_ps(_mm_mul_ps(a2, s2), o2));
+  }
+#elif defined(VSX_MATH_3D_NEON)
+  vsx_vector_batch_reg s0, s1, s2, o0, o1, o2;
+  {
+    float t[2][8] = {
+      { scale.x, scale.y, scale.z, scale.x, scale.y, scale.z, scale.x, scale.y },
+      { offset.x, offset.y, offset.z, offset.x, offset.y, offset.z, offset.x, offset.y },
+    };
+    s0 = vld1q_f32(t[0]);
+    s1 = vld1q_f32(t[0] + 1);
+    s2 = vld1q_f32(t[0] + 2);
+    o0 = vld1q_f32(t[1]);
+    o1 = vld1q_f32(t[1] + 1);
+    o2 = vld1q_f32(t[1] + 2);
+  }
+  for (; i + 4 <= count; i += 4)
+  {
+    const float* sp = (const float*)(src + i);
+    float* dp = (float*)(dest + i);
+    vst1q_f32(dp, vaddq_f32(vmulq_f32(vld1q_f32(sp), s0), o0));
+    vst1q_f32(dp + 4, vaddq_f32(vmulq_f32(vld1q_f32(sp + 4), s1), o1));
+    vst1q_f32(dp + 8, vaddq_f32(vmulq_f32(vld1q_f32(sp + 8), s2), o2));
+  }
+#endif
+  for (; i < count; i++)
+  {
+    dest[i].x = src[i].x * scale.x + offset.x;
+    dest[i].y = src[i].y * scale.y + offset.y;
+    dest[i].z = src[i].z * scale.z + offset.z;
+  }
+}
+
+#endif
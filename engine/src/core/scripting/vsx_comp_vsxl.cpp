@@ -43,18 +43,24 @@
 #include "vsx_timer.h"
 #include "vsx_engine.h"
 #include "vsx_comp_vsxl.h"
+#include "vsxl_script_cache.h"
 
 class p_info {
 public:
   vsx_module_param_abs* param;
   gmVariable variable;
   vsx_string name;
+  vsxl_handle key; // name as a global table key
   unsigned long id;
 };
 
 class vsx_comp_vsxl_driver : public vsx_comp_vsxl_driver_abs {
   gmVariable vsx_vtime;
   gmVariable vsx_dtime;
+  vsxl_handle vtime_key;
+  vsxl_handle dtime_key;
+  vsxl_handle function; // vsxl_cf
+  void release_handles();
 public:
   std::vector<p_info*> p_list;
   gmMachine* machine;
@@ -70,8 +76,20 @@ vsx_comp_vsxl_driver::vsx_comp_vsxl_driver() {
 #endif
 }
 
+// the handles pin objects of the machine, let go before it's reset
+void vsx_comp_vsxl_driver::release_handles() {
+#ifndef VSXE_NO_GM
+  for (std::vector<p_info*>::iterator it = p_list.begin(); it != p_list.end(); ++it)
+    (*it)->key.release();
+  vtime_key.release();
+  dtime_key.release();
+  function.release();
+#endif
+}
+
 void vsx_comp_vsxl_driver::unload() {
 #ifndef VSXE_NO_GM
+  release_handles();
   if (machine) {
     machine->ResetAndFreeMemory();
     delete machine;
@@ -101,6 +119,7 @@ void *vsx_comp_vsxl_driver::load(vsx_module_param_list* module_list,vsx_string p
     }
   }
 
+  release_handles();
   if (!machine) {
     machine = new gmMachine;
     //gmBindMathLib(machine);
@@ -110,6 +129,7 @@ void *vsx_comp_vsxl_driver::load(vsx_module_param_list* module_list,vsx_string p
     machine = new gmMachine;
     //gmBindMathLib(machine);
   }
+  vsxl_machine_setup(machine);
 
 #ifndef VSX_NO_CLIENT
   if (program == "") {
@@ -132,7 +152,14 @@ global vsxl_cf = function()\n\
   }
 #endif
   // Compile and execute the script
-  machine->ExecuteString(script.c_str(), 0, true);
+  if (vsxl_script_cache::execute(machine, script) == 0)
+    function.resolve_function(machine, "vsxl_cf");
+
+  // look the names up once, run() uses the string objects
+  for (std::vector<p_info*>::iterator it = p_list.begin(); it != p_list.end(); ++it)
+    (*it)->key.resolve_string(machine, (*it)->name.c_str());
+  vtime_key.resolve_string(machine, "_time");
+  dtime_key.resolve_string(machine, "_dtime");
   
 #endif // no gm
 }
@@ -147,20 +174,21 @@ void vsx_comp_vsxl_driver::run() {
   //mytable.Set(machine, "fromstle", mt_var);
   for (std::vector<p_info*>::iterator it = p_list.begin(); it != p_list.end(); ++it) {
     (*it)->variable.SetFloat(((vsx_module_param_float*)(*it)->param)->get());
-    gtable->Set(machine, (*it)->name.c_str(), (*it)->variable);
+    gtable->Set(machine, gmVariable((*it)->key.string()), (*it)->variable);
   }
 
   //gmVariable mt_var;
   //mt_var.SetFloat(0.2);
   vsx_vtime.SetFloat(((vsx_comp_abs*)comp)->r_engine_info->vtime);
   vsx_dtime.SetFloat(((vsx_comp_abs*)comp)->r_engine_info->dtime);
-  machine->GetGlobals()->Set(machine, "_time", vsx_vtime);
-  machine->GetGlobals()->Set(machine, "_dtime", vsx_dtime);
+  gtable->Set(machine, gmVariable(vtime_key.string()), vsx_vtime);
+  gtable->Set(machine, gmVariable(dtime_key.string()), vsx_dtime);
   //machine->GetGlobals()->Set(machine, "size_x", mt_var);
   gmCall call;
 
+  // also this frame's garbage collection step
 	machine->Execute(0);
-	if(call.BeginGlobalFunction(machine, "vsxl_cf"))
+	if(function.get() && call.BeginFunction(machine, function.function()))
   {
     //call.AddParamFloat(realvalue);
     //call.AddParamInt(valueB);
@@ -187,16 +215,12 @@ void vsx_comp_vsxl_driver::run() {
   //}
   //((vsx_module_param_float*)my_param)->set_raw(resultfloat);
 
-  gmVariable stringName;
-  gmVariable retVar;
-
   //stringName.SetString(machine->AllocStringObject("size_x"));
   //retVar = machine->GetGlobals()->Get(stringName);
 
   for (std::vector<p_info*>::iterator it = p_list.begin(); it != p_list.end(); ++it) {
-    stringName.SetString(machine->AllocStringObject((*it)->name.c_str()));
     //printf("var:: %f\n", gtable->Get(stringName).m_value.m_float);
-    ((vsx_module_param_float*)(*it)->param)->set_raw(gtable->Get(stringName).m_value.m_float);
+    ((vsx_module_param_float*)(*it)->param)->set_raw(gtable->Get(gmVariable((*it)->key.string())).m_value.m_float);
     //(*it)->variable.SetFloat(((vsx_module_param_float*)(*it)->param)->get());
     //gtable->Set(machine, (*it)->name, (*it)->variable);
   }
@@ -205,7 +229,6 @@ void vsx_comp_vsxl_driver::run() {
   //std::cout << "froo " << retVar.m_value.m_float << endl;
 //  std::cout << "froo " << machine->GetGlobals()->Get(vsx_dtime).m_value.m_float << endl;
   //std::cout << "resultfloat: " << resultfloat << std::endl;
-  machine->CollectGarbage(false);
 #endif // no gm
 }
 
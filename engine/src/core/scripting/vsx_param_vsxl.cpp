@@ -46,6 +46,8 @@
 #include "vsx_param_sequence_list.h"
 #include "vsx_sequence_pool.h"
 
+#include "vsxl_script_cache.h"
+#include "vsxl_expression.h"
 #include "vsxl_engine.h"
 #include "vsx_engine.h"
 #include "vsx_param_vsxl.h"
@@ -55,6 +57,10 @@
 
 class vsx_param_vsxl_driver_float : public vsx_param_vsxl_driver_abs {
   float realvalue, resultfloat;
+  // the script's vsxl_pf function, resolved at load
+  vsxl_handle function;
+  // the same function run natively when it's a single expression
+  vsxl_expression expression;
 //	gmMachine* machine;
 //	gmVariable vsx_vtime;
 //	gmVariable vsx_dtime;
@@ -114,6 +120,7 @@ static void GM_CDECL AsString(gmUserObject * a_object, char* a_buffer, int a_buf
 
 void vsx_param_vsxl_driver_float::unload() {
 #ifndef VSXE_NO_GM
+  function.release();
 //  printf("unload\n");
   /*if (machine) {
 
@@ -181,7 +188,12 @@ global vsxl_pf"+i2s(id)+" = function(param)\n\
   // Compile and execute the script
   //MessageBox(0, "pre-execute", "status", MB_OK);
   printf("load_9\n");
-  engine->vsxl->machine.ExecuteString(script.c_str(), NULL, false, NULL);
+  // on errors the previous version of the function stays in place
+  if (vsxl_script_cache::execute(&engine->vsxl->machine, script) == 0) {
+    function.resolve_function(&engine->vsxl->machine, ("vsxl_pf"+i2s(id)).c_str());
+    // the function is still defined in the machine for other scripts
+    expression.compile(script.c_str(), ("vsxl_pf"+i2s(id)).c_str());
+  }
   printf("load_a\n");
   //MessageBox(0, "post-execute", "status", MB_OK);
   return this;
@@ -200,15 +212,18 @@ void vsx_param_vsxl_driver_float::run() {
   //mytable.Set(machine, "fromstle", mt_var);
 
   //vsx_vtime.SetFloat(0.12);
-  engine->vsxl->vsx_vtime.SetFloat(((vsx_comp_abs*)comp)->r_engine_info->vtime);
-  engine->vsxl->vsx_dtime.SetFloat(((vsx_comp_abs*)comp)->r_engine_info->dtime);
-  engine->vsxl->machine.GetGlobals()->Set(&(engine->vsxl->machine), "_time", engine->vsxl->vsx_vtime);
-  engine->vsxl->machine.GetGlobals()->Set(&(engine->vsxl->machine), "_dtime", engine->vsxl->vsx_dtime);
+  if (expression.valid()) {
+    resultfloat = expression.eval(realvalue, ((vsx_comp_abs*)comp)->r_engine_info->vtime, ((vsx_comp_abs*)comp)->r_engine_info->dtime);
+    ((vsx_module_param_float*)my_param)->set_raw(resultfloat);
+    return;
+  }
+  engine->vsxl->set_time(((vsx_comp_abs*)comp)->r_engine_info->vtime, ((vsx_comp_abs*)comp)->r_engine_info->dtime);
 
   gmCall call;
 
-	engine->vsxl->machine.Execute(0);
-	if(call.BeginGlobalFunction(&(engine->vsxl->machine), ("vsxl_pf"+i2s(id)).c_str()))
+  // waiting threads and garbage collection are done once per frame, see
+  // vsxl_engine::frame()
+	if(function.get() && call.BeginFunction(&(engine->vsxl->machine), function.function()))
   {
     call.AddParamFloat(realvalue);
     //call.AddParamInt(valueB);
@@ -242,7 +257,6 @@ void vsx_param_vsxl_driver_float::run() {
   //std::cout << "froo " << retVar.m_value.m_float << endl;
 //  std::cout << "froo " << machine->GetGlobals()->Get(vsx_dtime).m_value.m_float << endl;
   //std::cout << "resultfloat: " << resultfloat << std::endl;
-  engine->vsxl->machine.CollectGarbage();
 #endif
 }
 
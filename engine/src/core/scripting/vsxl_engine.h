@@ -24,16 +24,36 @@
 #ifndef VSXL_ENGINE_H_
 #define VSXL_ENGINE_H_
 
+#include "vsxl_script_cache.h"
+
 class vsxl_engine {
 public:
 	gmMachine machine;
 	gmVariable vsx_vtime;
 	gmVariable vsx_dtime;
+	// keys of the _time / _dtime globals
+	vsxl_handle vtime_key;
+	vsxl_handle dtime_key;
 	int pf_id; // counter to make unique parameter filter functions
 	int cf_id;
 	vsxl_engine() : pf_id(0), cf_id(0)
 	{}
+	// publish the engine time to the scripts
+	void set_time(float vtime, float dtime) {
+		vsx_vtime.SetFloat(vtime);
+		vsx_dtime.SetFloat(dtime);
+		machine.GetGlobals()->Set(&machine, gmVariable(vtime_key.string()), vsx_vtime);
+		machine.GetGlobals()->Set(&machine, gmVariable(dtime_key.string()), vsx_dtime);
+	}
+	// once per frame after the filters ran: runs script threads left
+	// waiting and does this frame's share of garbage collection
+	void frame() {
+		machine.Execute(0);
+	}
 	void init() {
+		vsxl_machine_setup(&machine);
+		vtime_key.resolve_string(&machine, "_time");
+		dtime_key.resolve_string(&machine, "_dtime");
     //machine = new gmMachine;
   	printf("float::load2\n");
     //GameObject::s_typeId = machine->CreateUserType("GameObject");
@@ -0,0 +1,641 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "vsxl_expression.h"
+
+// GM_PI_VALUE, binds/gmHelpers.h
+#define VSXL_EXPRESSION_PI 3.1415927f
+
+#define VSXL_EXPRESSION_MAX_NODES 128
+#define VSXL_EXPRESSION_MAX_DEPTH 32
+
+// param, _time, _dtime
+#define VSXL_EXPRESSION_INPUTS 3
+
+enum {
+  VSXL_OP_ADD,
+  VSXL_OP_SUB,
+  VSXL_OP_MUL,
+  VSXL_OP_DIV,
+  VSXL_OP_REM,
+  VSXL_OP_NEG,
+  VSXL_OP_ABS,
+  VSXL_OP_SQRT,
+  VSXL_OP_FLOOR,
+  VSXL_OP_CEIL,
+  VSXL_OP_ROUND,
+  VSXL_OP_DEGTORAD,
+  VSXL_OP_RADTODEG,
+  VSXL_OP_SIN,
+  VSXL_OP_COS,
+  VSXL_OP_TAN,
+  VSXL_OP_ASIN,
+  VSXL_OP_ACOS,
+  VSXL_OP_ATAN,
+  VSXL_OP_LOG,
+  VSXL_OP_LOG_BASE,
+  VSXL_OP_POWER,
+  VSXL_OP_MIN,
+  VSXL_OP_MAX,
+  VSXL_OP_CLAMP
+};
+
+// The math lib functions that are plain arithmetic (no randint and such).
+// A script could assign over these globals; nobody does.
+static const struct {
+  const char* name;
+  int args;
+  int code;
+} vsxl_expression_functions[] = {
+  {"abs", 1, VSXL_OP_ABS},
+  {"sqrt", 1, VSXL_OP_SQRT},
+  {"floor", 1, VSXL_OP_FLOOR},
+  {"ceil", 1, VSXL_OP_CEIL},
+  {"round", 1, VSXL_OP_ROUND},
+  {"degtorad", 1, VSXL_OP_DEGTORAD},
+  {"radtodeg", 1, VSXL_OP_RADTODEG},
+  {"sin", 1, VSXL_OP_SIN},
+  {"cos", 1, VSXL_OP_COS},
+  {"tan", 1, VSXL_OP_TAN},
+  {"asin", 1, VSXL_OP_ASIN},
+  {"acos", 1, VSXL_OP_ACOS},
+  {"atan", 1, VSXL_OP_ATAN},
+  {"log", 1, VSXL_OP_LOG},
+  {"log", 2, VSXL_OP_LOG_BASE},
+  {"power", 2, VSXL_OP_POWER},
+  {"min", 2, VSXL_OP_MIN},
+  {"max", 2, VSXL_OP_MAX},
+  {"clamp", 3, VSXL_OP_CLAMP}
+};
+
+// Written like the float branches in gmOperators.cpp and gmMathLib.cpp so
+// the same library overloads get picked and the results match bit for bit.
+static inline float vsxl_expression_float_op(int code, float a, float b, float c) {
+  switch (code) {
+    case VSXL_OP_ADD: return a + b;
+    case VSXL_OP_SUB: return a - b;
+    case VSXL_OP_MUL: return a * b;
+    case VSXL_OP_DIV: return a / b;
+    case VSXL_OP_REM: return fmodf(a, b);
+    case VSXL_OP_NEG: return -a;
+    case VSXL_OP_ABS: return (float)fabsf(a);
+    case VSXL_OP_SQRT: return sqrtf(a);
+    case VSXL_OP_FLOOR: return floorf(a);
+    case VSXL_OP_CEIL: return ceilf(a);
+    case VSXL_OP_ROUND: return floorf(a + 0.5f);
+    case VSXL_OP_DEGTORAD: return a * (VSXL_EXPRESSION_PI / 180.0f);
+    case VSXL_OP_RADTODEG: return a * (180.0f / VSXL_EXPRESSION_PI);
+    case VSXL_OP_SIN: return sinf(a);
+    case VSXL_OP_COS: return cosf(a);
+    case VSXL_OP_TAN: return tanf(a);
+    case VSXL_OP_ASIN: return asinf(a);
+    case VSXL_OP_ACOS: return acosf(a);
+    case VSXL_OP_ATAN: return atanf(a);
+    case VSXL_OP_LOG: return logf(a);
+    // log(base, value)
+    case VSXL_OP_LOG_BASE: return (float)(log10(b) / log10(a));
+    case VSXL_OP_POWER: return (float)pow(a, b);
+    case VSXL_OP_MIN: return a < b ? a : b;
+    case VSXL_OP_MAX: return a > b ? a : b;
+    // clamp(min, value, max)
+    case VSXL_OP_CLAMP: return b < a ? a : (b > c ? c : b);
+  }
+  return 0.0f;
+}
+
+// functions that give a float even for int arguments
+static bool vsxl_expression_float_result(int code) {
+  switch (code) {
+    case VSXL_OP_DEGTORAD:
+    case VSXL_OP_RADTODEG:
+    case VSXL_OP_SIN:
+    case VSXL_OP_COS:
+    case VSXL_OP_TAN:
+    case VSXL_OP_ASIN:
+    case VSXL_OP_ACOS:
+    case VSXL_OP_ATAN:
+      return true;
+  }
+  return false;
+}
+
+static bool vsxl_expression_to_int(double value, int& out) {
+  // also false for nan
+  if (!(value > -2147483649.0 && value < 2147483648.0))
+    return false;
+  out = (int)value;
+  return true;
+}
+
+// The int branches. False where GameMonkey would crash or the result isn't
+// defined, those scripts are left to it.
+static bool vsxl_expression_int_op(int code, int a, int b, int c, int& out) {
+  switch (code) {
+    case VSXL_OP_ADD: out = (int)((unsigned int)a + (unsigned int)b); return true;
+    case VSXL_OP_SUB: out = (int)((unsigned int)a - (unsigned int)b); return true;
+    case VSXL_OP_MUL: out = (int)((unsigned int)a * (unsigned int)b); return true;
+    case VSXL_OP_DIV:
+    case VSXL_OP_REM:
+      if (b == 0 || (a == INT_MIN && b == -1))
+        return false;
+      out = code == VSXL_OP_DIV ? a / b : a % b;
+      return true;
+    case VSXL_OP_NEG: out = (int)(0u - (unsigned int)a); return true;
+    case VSXL_OP_ABS:
+      if (a == INT_MIN)
+        return false;
+      out = abs(a);
+      return true;
+    case VSXL_OP_SQRT: return vsxl_expression_to_int(sqrtf((float)a), out);
+    case VSXL_OP_FLOOR:
+    case VSXL_OP_CEIL:
+    case VSXL_OP_ROUND:
+      out = a;
+      return true;
+    case VSXL_OP_LOG: {
+      float floatValue = (float)a;
+      return vsxl_expression_to_int(log(floatValue), out);
+    }
+    case VSXL_OP_LOG_BASE: return vsxl_expression_to_int(log10f((float)b) / log10f((float)a), out);
+    case VSXL_OP_POWER: return vsxl_expression_to_int(pow((float)a, (float)b), out);
+    case VSXL_OP_MIN: out = a < b ? a : b; return true;
+    case VSXL_OP_MAX: out = a > b ? a : b; return true;
+    case VSXL_OP_CLAMP: out = b < a ? a : (b > c ? c : b); return true;
+  }
+  return false;
+}
+
+enum {
+  VSXL_NODE_CONSTANT,
+  VSXL_NODE_INPUT,
+  VSXL_NODE_OP
+};
+
+struct vsxl_expression_node {
+  int type;
+  // constant
+  bool is_float;
+  int i;
+  float f;
+  // input register or op code
+  int code;
+  int arg[3];
+  int args;
+};
+
+// tokens past the single character ones
+enum {
+  VSXL_TOKEN_END = 256,
+  VSXL_TOKEN_IDENTIFIER,
+  VSXL_TOKEN_INT,
+  VSXL_TOKEN_FLOAT,
+  VSXL_TOKEN_ERROR
+};
+
+// Recursive descent over the same tokens gmScanner.l produces; anything
+// it doesn't know fails the compile.
+class vsxl_expression_parser {
+  const char* p;
+
+  int token;
+  const char* token_start;
+  int token_length;
+  int int_value;
+  float float_value;
+
+  const char* param;
+  int param_length;
+
+  int depth;
+
+public:
+  vsxl_expression_node nodes[VSXL_EXPRESSION_MAX_NODES];
+  int node_count;
+
+  vsxl_expression_parser(const char* script) {
+    p = script;
+    param = 0;
+    param_length = 0;
+    depth = 0;
+    node_count = 0;
+    next();
+  }
+
+  static bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  }
+
+  static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  void skip_space() {
+    for (;;) {
+      if (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\r' || *p == '\n' || *p == '\f')
+        p++;
+      else if (p[0] == '/' && p[1] == '/') {
+        while (*p && *p != '\n')
+          p++;
+      }
+      else if (p[0] == '/' && p[1] == '*') {
+        p += 2;
+        while (*p && !(p[0] == '*' && p[1] == '/'))
+          p++;
+        if (*p)
+          p += 2;
+      }
+      else
+        return;
+    }
+  }
+
+  void number() {
+    const char* s = p;
+    bool is_float = false;
+    while (is_digit(*p))
+      p++;
+    // "5." and ".5" are both floats
+    if (*p == '.' && (p > s || is_digit(p[1]))) {
+      is_float = true;
+      p++;
+      while (is_digit(*p))
+        p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+      const char* e = p + 1;
+      if (*e == '+' || *e == '-')
+        e++;
+      if (is_digit(*e)) {
+        is_float = true;
+        p = e;
+        while (is_digit(*p))
+          p++;
+      }
+    }
+    if (is_float && (*p == 'f' || *p == 'F'))
+      p++;
+    // 0x.., 5f, 1.2.3 and such
+    if (is_letter(*p) || is_digit(*p) || *p == '.') {
+      token = VSXL_TOKEN_ERROR;
+      return;
+    }
+    if (is_float) {
+      token = VSXL_TOKEN_FLOAT;
+      float_value = (float)atof(s);
+    }
+    else {
+      // atoi past this overflows
+      if (p - s > 9) {
+        token = VSXL_TOKEN_ERROR;
+        return;
+      }
+      token = VSXL_TOKEN_INT;
+      int_value = atoi(s);
+    }
+  }
+
+  void next() {
+    skip_space();
+    token_start = p;
+    if (!*p)
+      token = VSXL_TOKEN_END;
+    else
+    if (is_letter(*p)) {
+      while (is_letter(*p) || is_digit(*p))
+        p++;
+      token = VSXL_TOKEN_IDENTIFIER;
+    }
+    else
+    if (is_digit(*p) || (*p == '.' && is_digit(p[1])))
+      number();
+    else
+    if (strchr("(){}=,;+-*/%", *p))
+      token = *p++;
+    else
+      token = VSXL_TOKEN_ERROR;
+    token_length = (int)(p - token_start);
+  }
+
+  bool is_identifier(const char* name, int length) {
+    return token == VSXL_TOKEN_IDENTIFIER && token_length == length && strncmp(token_start, name, length) == 0;
+  }
+
+  bool is_identifier(const char* name) {
+    return is_identifier(name, (int)strlen(name));
+  }
+
+  bool accept(int t) {
+    if (token != t)
+      return false;
+    next();
+    return true;
+  }
+
+  bool accept_identifier(const char* name) {
+    if (!is_identifier(name))
+      return false;
+    next();
+    return true;
+  }
+
+  int add_node() {
+    if (node_count == VSXL_EXPRESSION_MAX_NODES)
+      return -1;
+    memset(&nodes[node_count], 0, sizeof(vsxl_expression_node));
+    return node_count++;
+  }
+
+  int constant(bool is_float, int i, float f) {
+    int n = add_node();
+    if (n < 0)
+      return -1;
+    nodes[n].type = VSXL_NODE_CONSTANT;
+    nodes[n].is_float = is_float;
+    nodes[n].i = i;
+    nodes[n].f = f;
+    return n;
+  }
+
+  // an op node, or the folded constant if all arguments are constant
+  int op(int code, int* arg, int args) {
+    bool constant_args = true;
+    bool any_float = vsxl_expression_float_result(code);
+    float f[3] = {0.0f, 0.0f, 0.0f};
+    int i[3] = {0, 0, 0};
+    for (int k = 0; k < args; k++) {
+      vsxl_expression_node& a = nodes[arg[k]];
+      if (a.type != VSXL_NODE_CONSTANT) {
+        constant_args = false;
+        break;
+      }
+      any_float |= a.is_float;
+      i[k] = a.i;
+      f[k] = a.is_float ? a.f : (float)a.i;
+    }
+    if (constant_args) {
+      if (any_float)
+        return constant(true, 0, vsxl_expression_float_op(code, f[0], f[1], f[2]));
+      int result;
+      if (!vsxl_expression_int_op(code, i[0], i[1], i[2], result))
+        return -1;
+      return constant(false, result, 0.0f);
+    }
+    int n = add_node();
+    if (n < 0)
+      return -1;
+    nodes[n].type = VSXL_NODE_OP;
+    nodes[n].code = code;
+    nodes[n].args = args;
+    for (int k = 0; k < args; k++)
+      nodes[n].arg[k] = arg[k];
+    return n;
+  }
+
+  int call(const char* name, int name_length) {
+    int arg[3];
+    int args = 0;
+    if (!accept('('))
+      return -1;
+    if (token != ')') {
+      do {
+        if (args == 3)
+          return -1;
+        arg[args] = expression();
+        if (arg[args] < 0)
+          return -1;
+        args++;
+      } while (accept(','));
+    }
+    if (!accept(')'))
+      return -1;
+    for (size_t k = 0; k < sizeof(vsxl_expression_functions) / sizeof(vsxl_expression_functions[0]); k++) {
+      if (vsxl_expression_functions[k].args == args &&
+          (int)strlen(vsxl_expression_functions[k].name) == name_length &&
+          strncmp(vsxl_expression_functions[k].name, name, name_length) == 0)
+        return op(vsxl_expression_functions[k].code, arg, args);
+    }
+    return -1;
+  }
+
+  int primary() {
+    if (token == VSXL_TOKEN_INT) {
+      int n = constant(false, int_value, 0.0f);
+      next();
+      return n;
+    }
+    if (token == VSXL_TOKEN_FLOAT) {
+      int n = constant(true, 0, float_value);
+      next();
+      return n;
+    }
+    if (token == VSXL_TOKEN_IDENTIFIER) {
+      const char* name = token_start;
+      int name_length = token_length;
+      int input = -1;
+      if (is_identifier(param, param_length))
+        input = 0;
+      else
+      if (is_identifier("_time"))
+        input = 1;
+      else
+      if (is_identifier("_dtime"))
+        input = 2;
+      next();
+      if (token == '(') {
+        // calling the param isn't arithmetic
+        if (input == 0)
+          return -1;
+        return call(name, name_length);
+      }
+      if (input < 0)
+        return -1;
+      int n = add_node();
+      if (n < 0)
+        return -1;
+      nodes[n].type = VSXL_NODE_INPUT;
+      nodes[n].code = input;
+      return n;
+    }
+    if (accept('(')) {
+      int n = expression();
+      if (n < 0 || !accept(')'))
+        return -1;
+      return n;
+    }
+    return -1;
+  }
+
+  int unary() {
+    if (++depth > VSXL_EXPRESSION_MAX_DEPTH)
+      return -1;
+    int n;
+    if (accept('-')) {
+      n = unary();
+      if (n >= 0)
+        n = op(VSXL_OP_NEG, &n, 1);
+    }
+    else
+    if (accept('+'))
+      n = unary();
+    else
+      n = primary();
+    depth--;
+    return n;
+  }
+
+  int term() {
+    int arg[2];
+    arg[0] = unary();
+    while (arg[0] >= 0 && (token == '*' || token == '/' || token == '%')) {
+      int code = token == '*' ? VSXL_OP_MUL : (token == '/' ? VSXL_OP_DIV : VSXL_OP_REM);
+      next();
+      arg[1] = unary();
+      if (arg[1] < 0)
+        return -1;
+      arg[0] = op(code, arg, 2);
+    }
+    return arg[0];
+  }
+
+  int expression() {
+    if (++depth > VSXL_EXPRESSION_MAX_DEPTH)
+      return -1;
+    int arg[2];
+    arg[0] = term();
+    while (arg[0] >= 0 && (token == '+' || token == '-')) {
+      int code = token == '+' ? VSXL_OP_ADD : VSXL_OP_SUB;
+      next();
+      arg[1] = term();
+      if (arg[1] < 0)
+        return -1;
+      arg[0] = op(code, arg, 2);
+    }
+    depth--;
+    return arg[0];
+  }
+
+  // global <function_name> = function(<param>) { return <expression>; };
+  int filter(const char* function_name) {
+    if (!accept_identifier("global") || !accept_identifier(function_name) || !accept('='))
+      return -1;
+    if (!accept_identifier("function") || !accept('('))
+      return -1;
+    if (token != VSXL_TOKEN_IDENTIFIER)
+      return -1;
+    param = token_start;
+    param_length = token_length;
+    next();
+    if (!accept(')') || !accept('{') || !accept_identifier("return"))
+      return -1;
+    int n = expression();
+    if (n < 0 || !accept(';') || !accept('}') || !accept(';') || token != VSXL_TOKEN_END)
+      return -1;
+    return n;
+  }
+};
+
+class vsxl_expression_code_gen {
+  vsxl_expression_node* nodes;
+  float* reg;
+  vsxl_expression::op* code;
+  int next_constant;
+  int next_temporary;
+
+public:
+  int code_size;
+
+  vsxl_expression_code_gen(vsxl_expression_node* n, float* r, vsxl_expression::op* c) {
+    nodes = n;
+    reg = r;
+    code = c;
+    next_constant = VSXL_EXPRESSION_INPUTS;
+    next_temporary = VSXL_EXPRESSION_MAX_REGISTERS - 1;
+    code_size = 0;
+  }
+
+  // Register holding the node's value. Temporaries are used like a stack,
+  // an op's result may land on one of its arguments.
+  int emit(int n) {
+    vsxl_expression_node& node = nodes[n];
+    if (node.type == VSXL_NODE_INPUT)
+      return node.code;
+    if (node.type == VSXL_NODE_CONSTANT) {
+      if (next_constant > next_temporary)
+        return -1;
+      reg[next_constant] = node.is_float ? node.f : (float)node.i;
+      return next_constant++;
+    }
+    int saved = next_temporary;
+    int arg[3] = {0, 0, 0};
+    for (int k = 0; k < node.args; k++) {
+      arg[k] = emit(node.arg[k]);
+      if (arg[k] < 0)
+        return -1;
+    }
+    next_temporary = saved;
+    if (next_temporary < next_constant || code_size == VSXL_EXPRESSION_MAX_CODE)
+      return -1;
+    int dst = next_temporary--;
+    vsxl_expression::op& o = code[code_size++];
+    o.code = (unsigned char)node.code;
+    o.dst = (unsigned char)dst;
+    o.a = (unsigned char)arg[0];
+    o.b = (unsigned char)arg[1];
+    o.c = (unsigned char)arg[2];
+    return dst;
+  }
+};
+
+bool vsxl_expression::compile(const char* script, const char* function_name) {
+  compiled = false;
+  vsxl_expression_parser parser(script);
+  int root = parser.filter(function_name);
+  if (root < 0)
+    return false;
+  // an int return isn't picked up by gmCall::GetReturnedFloat, keep
+  // those scripts on GameMonkey
+  if (parser.nodes[root].type == VSXL_NODE_CONSTANT && !parser.nodes[root].is_float)
+    return false;
+  vsxl_expression_code_gen gen(parser.nodes, reg, code);
+  result = gen.emit(root);
+  if (result < 0)
+    return false;
+  code_size = gen.code_size;
+  compiled = true;
+  return true;
+}
+
+float vsxl_expression::eval(float param, float time, float dtime) {
+  reg[0] = param;
+  reg[1] = time;
+  reg[2] = dtime;
+  const op* o = code;
+  const op* end = code + code_size;
+  for (; o != end; o++)
+    reg[o->dst] = vsxl_expression_float_op(o->code, reg[o->a], reg[o->b], reg[o->c]);
+  return reg[result];
+}
@@ -0,0 +1,82 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSXL_EXPRESSION_H_
+#define VSXL_EXPRESSION_H_
+
+// Native evaluation of param filters that are a single expression.
+//
+// Most float param scripts end up as one line, "return sin(_time*2)*0.5+0.5;",
+// and calling into GameMonkey for that (a thread, its stack and an operator
+// dispatch per node) costs far more than the arithmetic itself. compile()
+// recognizes a script made of nothing but
+//
+//   global <function_name> = function(<param>) { return <expression>; };
+//
+// where the expression uses the param, _time, _dtime, number literals,
+// + - * / %, parentheses and the math lib functions, and turns it into
+// register code for eval(). Any other script is left to GameMonkey.
+//
+// The results are the ones GameMonkey gives: int literals do int math
+// (1/2 is 0) and the functions compute like the math lib does. The param
+// and the times are floats, so any int part of an expression is constant
+// and gets folded by compile().
+
+#define VSXL_EXPRESSION_MAX_CODE 64
+#define VSXL_EXPRESSION_MAX_REGISTERS 64
+
+class vsxl_expression {
+public:
+  struct op {
+    unsigned char code;
+    unsigned char dst;
+    unsigned char a, b, c;
+  };
+
+private:
+  op code[VSXL_EXPRESSION_MAX_CODE];
+  int code_size;
+  int result;
+  bool compiled;
+  // param, _time and _dtime, the constants, then temporaries from the top
+  float reg[VSXL_EXPRESSION_MAX_REGISTERS];
+
+public:
+  vsxl_expression() : code_size(0), result(0), compiled(false) {}
+
+  // false (and nothing to eval) unless the script is a single expression
+  // filter as above; script is expected to have compiled in GameMonkey
+  bool compile(const char* script, const char* function_name);
+
+  bool valid() {
+    return compiled;
+  }
+
+  void clear() {
+    compiled = false;
+  }
+
+  float eval(float param, float time, float dtime);
+};
+
+#endif /*VSXL_EXPRESSION_H_*/
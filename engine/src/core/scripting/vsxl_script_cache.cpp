@@ -0,0 +1,154 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "vsxfst.h"
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+#include "gm/gmMachine.h"
+#include "gm/gmStreamBuffer.h"
+#include "vsxl_script_cache.h"
+
+class vsxl_script_cache_entry {
+public:
+  vsx_string script;
+  char* lib;
+  unsigned int lib_size;
+
+  ~vsxl_script_cache_entry() {
+    delete[] lib;
+  }
+};
+
+// edited scripts pile up while working in the gui, start over past this
+#define VSXL_SCRIPT_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+static pthread_mutex_t vsxl_script_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint64_t, vsxl_script_cache_entry*> vsxl_script_cache_entries;
+static size_t vsxl_script_cache_bytes = 0;
+
+// FNV-1a
+static uint64_t vsxl_script_hash(const vsx_string& script) {
+  uint64_t h = 14695981039346656037ULL;
+  const char* p = script.c_str();
+  for (size_t i = 0; i < script.size(); i++) {
+    h ^= (unsigned char)p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void vsxl_script_cache_clear_locked() {
+  std::map<uint64_t, vsxl_script_cache_entry*>::iterator it;
+  for (it = vsxl_script_cache_entries.begin(); it != vsxl_script_cache_entries.end(); ++it)
+    delete it->second;
+  vsxl_script_cache_entries.clear();
+  vsxl_script_cache_bytes = 0;
+}
+
+int vsxl_script_cache::execute(gmMachine* machine, const vsx_string& script) {
+  uint64_t hash = vsxl_script_hash(script);
+  char* lib = 0;
+  unsigned int lib_size = 0;
+
+  pthread_mutex_lock(&vsxl_script_cache_mutex);
+  std::map<uint64_t, vsxl_script_cache_entry*>::iterator it = vsxl_script_cache_entries.find(hash);
+  vsxl_script_cache_entry* entry = 0;
+  if (it != vsxl_script_cache_entries.end() && it->second->script == script)
+    entry = it->second;
+  if (!entry) {
+    gmStreamBufferDynamic stream;
+    int errors = machine->CompileStringToLib(script.c_str(), stream);
+    if (errors) {
+      pthread_mutex_unlock(&vsxl_script_cache_mutex);
+      return errors;
+    }
+    if (vsxl_script_cache_bytes + stream.GetSize() > VSXL_SCRIPT_CACHE_MAX_BYTES)
+      vsxl_script_cache_clear_locked();
+    else
+    if (it != vsxl_script_cache_entries.end()) {
+      // same hash, different script
+      vsxl_script_cache_bytes -= it->second->lib_size;
+      delete it->second;
+      vsxl_script_cache_entries.erase(it);
+    }
+    entry = new vsxl_script_cache_entry;
+    entry->script = script;
+    entry->lib_size = stream.GetSize();
+    entry->lib = new char[entry->lib_size];
+    memcpy(entry->lib, stream.GetData(), entry->lib_size);
+    vsxl_script_cache_entries[hash] = entry;
+    vsxl_script_cache_bytes += entry->lib_size;
+  }
+  // run it outside the lock, the script may take its time
+  lib_size = entry->lib_size;
+  lib = new char[lib_size];
+  memcpy(lib, entry->lib, lib_size);
+  pthread_mutex_unlock(&vsxl_script_cache_mutex);
+
+  gmStreamBufferStatic stream(lib, lib_size);
+  bool ok = machine->ExecuteLib(stream, 0, true);
+  delete[] lib;
+  return ok ? 0 : 1;
+}
+
+void vsxl_script_cache::clear() {
+  pthread_mutex_lock(&vsxl_script_cache_mutex);
+  vsxl_script_cache_clear_locked();
+  pthread_mutex_unlock(&vsxl_script_cache_mutex);
+}
+
+//------------------------------------------------------------------------------
+
+void vsxl_handle::set(gmMachine* m, gmObject* o) {
+  if (o == object && m == machine) return;
+  release();
+  if (!o) return;
+  machine = m;
+  object = o;
+  machine->AddCPPOwnedGMObject(object);
+}
+
+void vsxl_handle::release() {
+  if (object)
+    machine->RemoveCPPOwnedGMObject(object);
+  machine = 0;
+  object = 0;
+}
+
+bool vsxl_handle::resolve_function(gmMachine* m, const char* name) {
+  gmVariable v = m->GetGlobals()->Get(m, name);
+  set(m, v.GetFunctionObjectSafe());
+  return object != 0;
+}
+
+void vsxl_handle::resolve_string(gmMachine* m, const char* name) {
+  set(m, m->AllocStringObject(name));
+}
+
+//------------------------------------------------------------------------------
+
+void vsxl_machine_setup(gmMachine* machine) {
+  machine->GetGC()->SetWorkPerIncrement(VSXL_GC_WORK_PER_FRAME);
+  machine->GetGC()->SetDestructPerIncrement(VSXL_GC_DESTRUCT_PER_FRAME);
+}
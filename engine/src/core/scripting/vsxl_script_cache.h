@@ -0,0 +1,86 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSXL_SCRIPT_CACHE_H_
+#define VSXL_SCRIPT_CACHE_H_
+
+#include "gm/gmMachine.h"
+#include "gm/gmStringObject.h"
+#include "gm/gmFunctionObject.h"
+
+// Compiled VSXL scripts, shared by every engine in the process.
+//
+// Parsing and code generation is the expensive part of loading a script,
+// and a state load used to redo it for every filter. The cache keeps the
+// compiled lib (GameMonkey byte code, not tied to a gmMachine) by a hash
+// of the script text, so loading a script that was seen before, in this
+// engine or another one, only binds the byte code to the machine.
+//
+// The GameMonkey compiler runs on global singletons, so this also keeps
+// two engines from compiling at the same time.
+class vsxl_script_cache
+{
+public:
+  // Same as machine->ExecuteString(script, 0, true): the script's root
+  // function runs now, defining its globals. Returns the number of compile
+  // errors (logged to the machine), 0 on success.
+  static int execute(gmMachine* machine, const vsx_string& script);
+
+  // forget all compiled scripts, machines already running them are fine
+  static void clear();
+};
+
+// Keeps one gm object alive from C++ (the GC won't take it while held)
+// so it can be used directly instead of being looked up by name every
+// frame. Release before the machine is reset or deleted.
+class vsxl_handle
+{
+  gmMachine* machine;
+  gmObject* object;
+public:
+  vsxl_handle() : machine(0), object(0) {}
+  ~vsxl_handle() { release(); }
+
+  void set(gmMachine* m, gmObject* o);
+  void release();
+  gmObject* get() { return object; }
+
+  // the global function called name, false (and empty) if there isn't one
+  bool resolve_function(gmMachine* m, const char* name);
+  // the unique string object for name, for use as a table key
+  void resolve_string(gmMachine* m, const char* name);
+
+  gmFunctionObject* function() { return static_cast<gmFunctionObject*>(object); }
+  gmStringObject* string() { return static_cast<gmStringObject*>(object); }
+};
+
+// Garbage collection work a VSXL machine may do per frame. The drivers
+// no longer collect per call; gmMachine::Execute does one incremental
+// step of this size per frame, so a collection cycle is spread over
+// several frames instead of landing in one.
+#define VSXL_GC_WORK_PER_FRAME 400
+#define VSXL_GC_DESTRUCT_PER_FRAME 200
+
+void vsxl_machine_setup(gmMachine* machine);
+
+#endif /*VSXL_SCRIPT_CACHE_H_*/
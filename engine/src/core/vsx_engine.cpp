@@ -591,6 +591,11 @@ bool vsx_engine::render()
     for (unsigned long i = 0; i < outputs.size(); i++) {
       outputs[i]->prepare();
     }
+
+#ifndef VSXE_NO_GM
+    // vsxl script threads and garbage collection, once per frame
+    if (vsxl) ((vsxl_engine*)vsxl)->frame();
+#endif
     
     // post-rendering reset frame status of the components
     for(std::vector<vsx_comp*>::iterator it = forge.begin(); it < forge.end(); ++it)
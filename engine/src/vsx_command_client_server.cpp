@@ -29,6 +29,16 @@
 
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <string>
+
+#if PLATFORM == PLATFORM_LINUX
+  #define VSX_COMMAND_SERVER_EPOLL
+  #include <sys/epoll.h>
+#else
+  #include <poll.h>
+#endif
 
 #include <vsx_avector.h>
 #include <vsxfst.h>
@@ -57,17 +67,99 @@ void *get_in_addr(struct sockaddr *sa)
     return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
-vsx_command_list_server::vsx_command_list_server()
-{
-  cmd_in = cmd_out = 0;
-}
-
 // ****************************************************************************
 // ****************************************************************************
 // VSX_COMMAND_LIST_SERVER ****************************************************
 // ****************************************************************************
 // ****************************************************************************
 
+#define VSX_COMMAND_SERVER_WELCOME ">>VSXu Server 0.3.0\n"
+
+// how long the worker waits for events, i.e. how often cmd_out is sent
+// when nobody calls flush()
+#define VSX_COMMAND_SERVER_WAIT_MS 10
+
+#define VSX_COMMAND_SERVER_KEEPALIVE_MS 1000
+
+// longest command accepted from a client
+#define VSX_COMMAND_SERVER_MAX_MESSAGE BUFLEN
+
+// a client that lets this much output pile up is dropped
+#define VSX_COMMAND_SERVER_MAX_PENDING (16 * 1024 * 1024)
+
+#define VSX_COMMAND_SERVER_MAX_EVENTS 64
+
+class vsx_command_server_connection
+{
+public:
+  int sock;
+  bool binary;
+  bool closed;
+  // waiting for the socket to take more output
+  bool watch_out;
+  long long last_send;
+  // received, not yet a whole command
+  std::string in;
+  // not yet taken by the socket
+  std::string out;
+
+  vsx_command_server_connection(int s)
+  {
+    sock = s;
+    binary = false;
+    closed = false;
+    watch_out = false;
+    last_send = 0;
+  }
+};
+
+// what the event wait found for one socket
+struct vsx_command_server_event
+{
+  void* target;
+  bool in;
+  bool out;
+};
+
+static long long vsx_command_server_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static bool vsx_command_server_nonblocking(int sock)
+{
+  int flags = fcntl(sock, F_GETFL, 0);
+  return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+static void vsx_command_server_frame(std::string& out, const char* data, size_t size)
+{
+  unsigned char header[4];
+  header[0] = (unsigned char)(size >> 24);
+  header[1] = (unsigned char)(size >> 16);
+  header[2] = (unsigned char)(size >> 8);
+  header[3] = (unsigned char)size;
+  out.append((const char*)header, 4);
+  out.append(data, size);
+}
+
+vsx_command_list_server::vsx_command_list_server()
+{
+  cmd_in = cmd_out = 0;
+  listen_sock = -1;
+  event_sock = -1;
+  wake_pipe[0] = wake_pipe[1] = -1;
+  running = false;
+  stopping = false;
+}
+
+vsx_command_list_server::~vsx_command_list_server()
+{
+  stop();
+}
+
 void vsx_command_list_server::set_command_lists(vsx_command_list* new_in,
                                                 vsx_command_list* new_out)
 {
@@ -75,91 +167,163 @@ void vsx_command_list_server::set_command_lists(vsx_command_list* new_in,
   cmd_out = new_out;
 }
 
-bool vsx_command_list_server::start()
+bool vsx_command_list_server::start(const char* listen_port)
 {
   if (!cmd_in || !cmd_out) return false;
+  // already running, stop() first
+  if (running) return false;
+  port = listen_port;
+  if (pipe(wake_pipe) == -1)
+  {
+    perror("pipe");
+    return false;
+  }
+  vsx_command_server_nonblocking(wake_pipe[0]);
+  vsx_command_server_nonblocking(wake_pipe[1]);
   pthread_attr_init(&worker_t_attr);
+  stopping = false;
   pthread_create(&worker_t, &worker_t_attr, &server_worker, (void*)this);
-  pthread_detach(worker_t);
+  running = true;
   return true;
 }
 
-void* vsx_command_list_server::server_worker(void *ptr)
+void vsx_command_list_server::stop()
+{
+  if (!running) return;
+  stopping = true;
+  flush();
+  pthread_join(worker_t, 0);
+  pthread_attr_destroy(&worker_t_attr);
+  running = false;
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+  wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+void vsx_command_list_server::flush()
+{
+  if (wake_pipe[1] == -1) return;
+  // if the pipe is full the worker is already due to wake up
+  char c = 0;
+  if (write(wake_pipe[1], &c, 1)) {}
+}
+
+bool vsx_command_list_server::listen_on_port()
 {
-  printf("server starting...\n");
-  vsx_command_list_server* this_ = (vsx_command_list_server*)ptr;
-  int listen_sock = -1;
   int status;
   struct addrinfo hints;
   struct addrinfo *servinfo;  // will point to the results
-  struct sockaddr_storage their_addr;
-  char recv_buf[BUFLEN];
-  socklen_t addr_size;
   int tr=1;
-  char s[INET6_ADDRSTRLEN];
-  bool run = true;
-  ssize_t size_recv;
-  int keepalive_timer = 0;
-  vsx_string message_stack;
-  
+
   memset(&hints, 0, sizeof hints); // make sure the struct is empty
   hints.ai_family = AF_INET; //AF_INET6 or AF_UNSPEC
   hints.ai_socktype = SOCK_STREAM; // TCP stream sockets
   hints.ai_flags = AI_PASSIVE;     // fill in my IP for me
 
-  printf("a\n");
-
-  if ((status = getaddrinfo(NULL, "11030", &hints, &servinfo)) != 0)
+  if ((status = getaddrinfo(NULL, port.c_str(), &hints, &servinfo)) != 0)
   {
     printf("getaddrinfo error: %s\n", gai_strerror(status));
-    exit(1);
+    return false;
   }
-  printf("b\n");
   listen_sock = socket(
     servinfo->ai_family,
     servinfo->ai_socktype,
     servinfo->ai_protocol);
   if (listen_sock == -1) {
-    printf("error in socket\n\n");
+    freeaddrinfo(servinfo);
     handle_error("socket");
   }
-  printf("c socket id: %d\n",listen_sock);
-
 
+  const char* failed = 0;
   // kill "Address already in use" error message
   if (setsockopt(listen_sock,SOL_SOCKET,SO_REUSEADDR,&tr,sizeof(int)) == -1)
+    failed = "setsockopt";
+  else
+  if (bind(listen_sock, servinfo->ai_addr, servinfo->ai_addrlen) == -1)
+    failed = "bind";
+  else
+  if (listen(listen_sock, SOMAXCONN) == -1)
+    failed = "listen";
+  else
+  if (!vsx_command_server_nonblocking(listen_sock))
+    failed = "fcntl";
+  if (failed)
+    perror(failed);
+  freeaddrinfo(servinfo);
+
+  if (failed)
   {
-    printf("error in setsockopt\n");
-    handle_error("setsockopt\n");
+    close(listen_sock);
+    listen_sock = -1;
+    return false;
   }
-  printf("d\n");
+  return true;
+}
 
-  if (bind(listen_sock, servinfo->ai_addr, servinfo->ai_addrlen) == -1)
+#ifdef VSX_COMMAND_SERVER_EPOLL
+
+// Level triggered: a socket with unread input keeps showing up, so each
+// event reads once and no client can hold up the others.
+void vsx_command_list_server::watch(vsx_command_server_connection* c, bool add)
+{
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | (c->watch_out ? EPOLLOUT : 0);
+  ev.data.ptr = c;
+  epoll_ctl(event_sock, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, c->sock, &ev);
+}
+
+static int vsx_command_server_wait(int event_sock, vsx_command_server_event* events)
+{
+  struct epoll_event ev[VSX_COMMAND_SERVER_MAX_EVENTS];
+  int n = epoll_wait(event_sock, ev, VSX_COMMAND_SERVER_MAX_EVENTS, VSX_COMMAND_SERVER_WAIT_MS);
+  for (int i = 0; i < n; i++)
   {
-    printf("error in bind\n");
-    handle_error("bind");
+    events[i].target = ev[i].data.ptr;
+    // errors and hangups are found out by reading
+    events[i].in = (ev[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+    events[i].out = (ev[i].events & EPOLLOUT) != 0;
   }
-  printf("e\n");
+  return n;
+}
 
-  freeaddrinfo(servinfo);
-  printf("f\n");
+#else
 
-  if (listen(listen_sock,5) == -1) {
-    printf("error listen\n");
-    handle_error("bind");
-  }
-  printf("g\n");
+void vsx_command_list_server::watch(vsx_command_server_connection* c, bool add)
+{
+  // poll() gets the whole list every time
+  VSX_UNUSED(c);
+  VSX_UNUSED(add);
+}
+
+#endif
 
-  addr_size = sizeof their_addr;
+void vsx_command_list_server::accept_connections()
+{
+  struct sockaddr_storage their_addr;
+  socklen_t addr_size;
+  char s[INET6_ADDRSTRLEN];
+  int flag = 1;
   while (1)
   {
-    printf("waiting for connection...\n");
-    run = true;
+    addr_size = sizeof their_addr;
     int recv_sock = accept(
                             listen_sock,
                             (struct sockaddr *)&their_addr,
                             &addr_size
                           );
+    if (recv_sock == -1)
+    {
+      if (errno == EINTR) continue;
+      return;
+    }
+    if (!vsx_command_server_nonblocking(recv_sock))
+    {
+      close(recv_sock);
+      continue;
+    }
+    // output is batched here already, don't let nagle hold it back
+    setsockopt(recv_sock, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(int));
 
     inet_ntop(
       their_addr.ss_family,
@@ -168,137 +332,288 @@ void* vsx_command_list_server::server_worker(void *ptr)
       sizeof s
     );
     printf("server: got connection from %s\n", s);
-    //
 
-    vsx_string welcome = ">>VSXu Server 0.3.0\n";
+    vsx_command_server_connection* c = new vsx_command_server_connection(recv_sock);
+    connections.push_back(c);
+    watch(c, true);
+    c->out = VSX_COMMAND_SERVER_WELCOME;
+    write_connection(c);
+  }
+}
 
-    send(
-      recv_sock,
-      welcome.c_str(),
-      welcome.size(),
-      0
-    );
+void vsx_command_list_server::read_connection(vsx_command_server_connection* c)
+{
+  char recv_buf[BUFLEN];
+  ssize_t size_recv = recv(c->sock, recv_buf, BUFLEN, 0);
+  if (size_recv == 0)
+  {
+    c->closed = true;
+    return;
+  }
+  if (size_recv == -1)
+  {
+    if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+      c->closed = true;
+    return;
+  }
+  c->in.append(recv_buf, size_recv);
 
-    memset(&recv_buf,0,BUFLEN);
-    while (run)
+  size_t pos = 0;
+  while (!c->closed)
+  {
+    size_t left = c->in.size() - pos;
+    if (c->binary)
     {
-      size_recv = recv(recv_sock, &recv_buf, BUFLEN, MSG_DONTWAIT);
-      if (size_recv == -1)
+      if (left < 4) break;
+      const unsigned char* h = (const unsigned char*)c->in.data() + pos;
+      size_t size = ((size_t)h[0] << 24) | ((size_t)h[1] << 16) | ((size_t)h[2] << 8) | h[3];
+      if (size > VSX_COMMAND_SERVER_MAX_MESSAGE)
       {
-        if (EAGAIN != errno && EWOULDBLOCK != errno)
-        {
-          printf("EAGAIN / EWOULDBLOCK. closing socket...\n");
-          close(recv_sock);
-          run = false;
-        }
+        c->closed = true;
+        break;
       }
-      //printf("status: %d\n",status);
-
-      vsx_command_s *out_command;
-      int count_sent = 0;
-      while (this_->cmd_out->pop(&out_command))
+      if (left - 4 < size) break;
+      message(c, c->in.data() + pos + 4, size);
+      pos += 4 + size;
+    }
+    else
+    {
+      size_t end = c->in.find_first_of("\r\n", pos);
+      if (end == std::string::npos)
       {
-        //printf("sending command: %s\n",out_command->str().c_str() );
-        vsx_string res = out_command->str()+"\n";
-        if (send(
-          recv_sock,
-          res.c_str(),
-          res.size(),
-          MSG_NOSIGNAL
-        ) == -1) {
-          printf("error in sending. closing socket...\n");
-          close(recv_sock);
-          run = false;
-        } else
-        {
-          count_sent++;
-        }
-      }
-      //printf("after cmd_out loop\n");
-      if (!count_sent) {
-        if (keepalive_timer++ == 150) {
-          vsx_string res = "_\n";
-          if (send(
-            recv_sock,
-            res.c_str(),
-            res.size(),
-            MSG_NOSIGNAL
-          ) == -1) {
-            close(recv_sock);
-            run = false;
-          }
-          keepalive_timer = 0;
-        }
+        if (left > VSX_COMMAND_SERVER_MAX_MESSAGE)
+          c->closed = true;
+        break;
       }
+      if (end > pos)
+        message(c, c->in.data() + pos, end - pos);
+      pos = end + 1;
+    }
+  }
+  c->in.erase(0, pos);
+}
+
+void vsx_command_list_server::message(vsx_command_server_connection* c, const char* data, size_t size)
+{
+  std::string m(data, size);
+  if (m == "dc")
+    c->closed = true;
+  else
+  if (m == "binary" && !c->binary)
+    c->binary = true;
+  else
+  if (size && m != "_")
+    cmd_in->add_raw(vsx_string(m.c_str()));
+}
+
+void vsx_command_list_server::write_connection(vsx_command_server_connection* c)
+{
+  size_t sent = 0;
+  while (sent < c->out.size())
+  {
+    ssize_t n = send(
+      c->sock,
+      c->out.data() + sent,
+      c->out.size() - sent,
+      MSG_NOSIGNAL
+    );
+    if (n > 0)
+    {
+      sent += n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    printf("error in sending. closing socket...\n");
+    c->closed = true;
+    return;
+  }
+  if (sent)
+  {
+    c->out.erase(0, sent);
+    c->last_send = vsx_command_server_ms();
+  }
+  if (c->out.size() > VSX_COMMAND_SERVER_MAX_PENDING)
+  {
+    printf("client not reading. closing socket...\n");
+    c->closed = true;
+    return;
+  }
+  bool pending = c->out.size() != 0;
+  if (pending != c->watch_out)
+  {
+    c->watch_out = pending;
+    watch(c, false);
+  }
+}
+
+// Everything in cmd_out, encoded once per protocol, goes to every client
+// in one write. With nobody connected it stays queued for the first one.
+void vsx_command_list_server::send_commands()
+{
+  if (!connections.size()) return;
+  bool any_lines = false, any_binary = false;
+  for (size_t i = 0; i < connections.size(); i++)
+  {
+    if (connections[i]->binary)
+      any_binary = true;
+    else
+      any_lines = true;
+  }
+
+  std::string lines;
+  std::string frames;
+  vsx_command_s *out_command;
+  while (cmd_out->pop(&out_command))
+  {
+    vsx_string res = out_command->str();
+    if (any_lines)
+    {
+      lines.append(res.c_str(), res.size());
+      lines += '\n';
+    }
+    if (any_binary)
+      vsx_command_server_frame(frames, res.c_str(), res.size());
+  }
+  if (!lines.size() && !frames.size()) return;
+
+  for (size_t i = 0; i < connections.size(); i++)
+  {
+    vsx_command_server_connection* c = connections[i];
+    if (c->closed) continue;
+    c->out += c->binary ? frames : lines;
+    write_connection(c);
+  }
+}
+
+void vsx_command_list_server::send_keepalives()
+{
+  long long now = vsx_command_server_ms();
+  for (size_t i = 0; i < connections.size(); i++)
+  {
+    vsx_command_server_connection* c = connections[i];
+    if (c->closed || c->out.size() || now - c->last_send < VSX_COMMAND_SERVER_KEEPALIVE_MS)
+      continue;
+    if (c->binary)
+      vsx_command_server_frame(c->out, "", 0);
+    else
+      c->out = "_\n";
+    write_connection(c);
+  }
+}
+
+void vsx_command_list_server::remove_closed()
+{
+  for (size_t i = 0; i < connections.size(); )
+  {
+    vsx_command_server_connection* c = connections[i];
+    if (!c->closed)
+    {
+      i++;
+      continue;
+    }
+    // closing the socket also takes it out of the epoll set
+    close(c->sock);
+    delete c;
+    connections[i] = connections.back();
+    connections.pop_back();
+  }
+}
 
-      // need microsecond timing calculation
-      if (size_recv > 0 && size_recv < BUFLEN)
+void* vsx_command_list_server::server_worker(void *ptr)
+{
+  printf("server starting...\n");
+  vsx_command_list_server* this_ = (vsx_command_list_server*)ptr;
+  vsx_command_server_event events[VSX_COMMAND_SERVER_MAX_EVENTS];
+
+  if (!this_->listen_on_port())
+    return 0;
+
+#ifdef VSX_COMMAND_SERVER_EPOLL
+  this_->event_sock = epoll_create(VSX_COMMAND_SERVER_MAX_EVENTS);
+  if (this_->event_sock == -1) {
+    handle_error("epoll_create");
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = &this_->listen_sock;
+  epoll_ctl(this_->event_sock, EPOLL_CTL_ADD, this_->listen_sock, &ev);
+  ev.data.ptr = &this_->wake_pipe;
+  epoll_ctl(this_->event_sock, EPOLL_CTL_ADD, this_->wake_pipe[0], &ev);
+#else
+  std::vector<struct pollfd> poll_fds;
+#endif
+
+  while (!this_->stopping)
+  {
+#ifdef VSX_COMMAND_SERVER_EPOLL
+    int n = vsx_command_server_wait(this_->event_sock, events);
+#else
+    poll_fds.resize(this_->connections.size() + 2);
+    poll_fds[0].fd = this_->listen_sock;
+    poll_fds[1].fd = this_->wake_pipe[0];
+    poll_fds[0].events = poll_fds[1].events = POLLIN;
+    for (size_t i = 0; i < this_->connections.size(); i++)
+    {
+      poll_fds[i + 2].fd = this_->connections[i]->sock;
+      poll_fds[i + 2].events = POLLIN | (this_->connections[i]->watch_out ? POLLOUT : 0);
+    }
+    int n = 0;
+    if (poll(&poll_fds[0], poll_fds.size(), VSX_COMMAND_SERVER_WAIT_MS) > 0)
+    {
+      for (size_t i = 0; i < poll_fds.size() && n < VSX_COMMAND_SERVER_MAX_EVENTS; i++)
       {
-        //printf("size_recv: %d\n", size_recv);
-        for (ssize_t i = 0; i < size_recv; i++)
-        {
-          if
-            (
-              (recv_buf[i] == '\n' || recv_buf[i] == '\r')
-              &&
-              message_stack.size()
-            )
-          {
-            //printf("got2: %s___\n",message_stack.c_str());
-            if (message_stack == "dc")
-            {
-              memset(&recv_buf,0,BUFLEN);
-              close(recv_sock);
-              run = false;
-              message_stack = "";
-              //return 0;
-            }
-            else
-            {
-              if (message_stack != "_")
-              {
-                this_->cmd_in->add_raw(message_stack);
-              }
-            }
-            message_stack = "";
-          } else
-          {
-            message_stack.push_back(recv_buf[i]);
-          }
-        }
-        memset(&recv_buf,0,BUFLEN);
+        if (!poll_fds[i].revents) continue;
+        if (i == 0)
+          events[n].target = &this_->listen_sock;
+        else
+        if (i == 1)
+          events[n].target = &this_->wake_pipe;
+        else
+          events[n].target = this_->connections[i - 2];
+        events[n].in = (poll_fds[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0;
+        events[n].out = (poll_fds[i].revents & POLLOUT) != 0;
+        n++;
       }
-      usleep(10);
-      /*if (recv_buf[0] != 0)
+    }
+#endif
+    for (int i = 0; i < n; i++)
+    {
+      if (events[i].target == &this_->listen_sock)
+        this_->accept_connections();
+      else
+      if (events[i].target == &this_->wake_pipe)
       {
-        vsx_string recv_data(recv_buf);
-
-        vsx_avector<vsx_string> parts;
-        vsx_string deli = "\n";
-        explode(recv_data, deli, parts);
-        for (unsigned long i = 0; i < parts.size(); i++)
-        {
-          vsx_string* msg = &parts[i];
-          if ((*msg)[msg->size()-1] == '\r') msg->pop_back();
-          if ((*msg)[msg->size()-1] == '\n') msg->pop_back();
-          if ((*msg)[msg->size()-1] == '\r') msg->pop_back();
-          //printf("got2: %s___\n",msg->c_str());
-          if (*msg == "dc")
-          {
-            close(recv_sock);
-            run = false;
-          }
-          else
-          {
-            this_->cmd_in->add_raw(*msg);
-          }
-        }
-        memset(&recv_buf,0,size_recv+0x1);
+        char buf[64];
+        while (read(this_->wake_pipe[0], buf, sizeof(buf)) > 0) {}
+      }
+      else
+      {
+        // closed ones stay allocated until remove_closed
+        vsx_command_server_connection* c = (vsx_command_server_connection*)events[i].target;
+        if (events[i].in && !c->closed)
+          this_->read_connection(c);
+        if (events[i].out && !c->closed)
+          this_->write_connection(c);
       }
-      usleep(10000);*/
     }
+    this_->send_commands();
+    this_->send_keepalives();
+    this_->remove_closed();
   }
-  close(listen_sock);
+  for (size_t i = 0; i < this_->connections.size(); i++)
+  {
+    close(this_->connections[i]->sock);
+    delete this_->connections[i];
+  }
+  this_->connections.clear();
+#ifdef VSX_COMMAND_SERVER_EPOLL
+  close(this_->event_sock);
+  this_->event_sock = -1;
+#endif
+  close(this_->listen_sock);
+  this_->listen_sock = -1;
   return 0;
 }
 
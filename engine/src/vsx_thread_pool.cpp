@@ -0,0 +1,235 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "vsx_thread_pool.h"
+
+#if PLATFORM_FAMILY == PLATFORM_FAMILY_WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+class vsx_thread_pool_job {
+public:
+  vsx_thread_pool_job_func func;
+  void* arg;
+  vsx_thread_pool_job* next;
+};
+
+// state shared between the caller of parallel_for and its helper jobs.
+// helpers may be picked up after the caller returned, so it's refcounted
+// and freed by whoever lets go of it last.
+class vsx_thread_pool_batch {
+public:
+  vsx_thread_pool_range_func func;
+  void* arg;
+  size_t count;
+  size_t chunk_size;
+  size_t num_chunks;
+  volatile size_t next_chunk;
+  size_t chunks_done;
+  volatile int refs;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  vsx_thread_pool_batch()
+  {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~vsx_thread_pool_batch()
+  {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void run()
+  {
+    size_t local_done = 0;
+    size_t chunk;
+    while ( (chunk = __sync_fetch_and_add(&next_chunk, 1)) < num_chunks )
+    {
+      size_t start = chunk * chunk_size;
+      size_t end = start + chunk_size;
+      if (end > count) end = count;
+      func(arg, start, end);
+      local_done++;
+    }
+    if (!local_done) return;
+    pthread_mutex_lock(&mutex);
+    chunks_done += local_done;
+    if (chunks_done == num_chunks)
+      pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void release()
+  {
+    if (__sync_sub_and_fetch(&refs, 1) == 0)
+      delete this;
+  }
+
+  static void helper(void* ptr)
+  {
+    vsx_thread_pool_batch* batch = (vsx_thread_pool_batch*)ptr;
+    batch->run();
+    batch->release();
+  }
+};
+
+
+
+static vsx_thread_pool* pool_instance = 0;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+void vsx_thread_pool::create_instance()
+{
+  pool_instance = new vsx_thread_pool();
+}
+
+vsx_thread_pool* vsx_thread_pool::get_instance()
+{
+  pthread_once(&pool_once, &vsx_thread_pool::create_instance);
+  return pool_instance;
+}
+
+size_t vsx_thread_pool::get_num_cpus()
+{
+#if PLATFORM_FAMILY == PLATFORM_FAMILY_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  long n = (long)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (n < 1) return 1;
+  return (size_t)n;
+}
+
+vsx_thread_pool::vsx_thread_pool()
+{
+  queue_head = 0;
+  queue_tail = 0;
+  pthread_mutex_init(&queue_mutex, NULL);
+  pthread_cond_init(&queue_cond, NULL);
+
+  num_threads = get_num_cpus();
+  // the pool lives as long as the process, workers are never joined
+  for (size_t i = 0; i < num_threads; i++)
+  {
+    pthread_t worker_t;
+    pthread_attr_t worker_t_attr;
+    pthread_attr_init(&worker_t_attr);
+    pthread_create(&worker_t, &worker_t_attr, &worker, (void*)this);
+    pthread_detach(worker_t);
+    pthread_attr_destroy(&worker_t_attr);
+  }
+}
+
+void* vsx_thread_pool::worker(void* ptr)
+{
+  vsx_thread_pool* pool = (vsx_thread_pool*)ptr;
+  while (1)
+  {
+    pthread_mutex_lock(&pool->queue_mutex);
+    while (!pool->queue_head)
+      pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+    vsx_thread_pool_job* job = pool->queue_head;
+    pool->queue_head = job->next;
+    if (!pool->queue_head)
+      pool->queue_tail = 0;
+    pthread_mutex_unlock(&pool->queue_mutex);
+
+    job->func(job->arg);
+    delete job;
+  }
+  return 0;
+}
+
+void vsx_thread_pool::push(vsx_thread_pool_job* job)
+{
+  job->next = 0;
+  pthread_mutex_lock(&queue_mutex);
+  if (queue_tail)
+    queue_tail->next = job;
+  else
+    queue_head = job;
+  queue_tail = job;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+}
+
+void vsx_thread_pool::add_job(vsx_thread_pool_job_func func, void* arg)
+{
+  vsx_thread_pool_job* job = new vsx_thread_pool_job;
+  job->func = func;
+  job->arg = arg;
+  push(job);
+}
+
+void vsx_thread_pool::parallel_for(
+  size_t count,
+  size_t min_chunk,
+  vsx_thread_pool_range_func func,
+  void* arg
+)
+{
+  if (!count) return;
+  if (min_chunk < 1) min_chunk = 1;
+
+  size_t max_chunks = num_threads * 4;
+  size_t chunk_size = (count + max_chunks - 1) / max_chunks;
+  if (chunk_size < min_chunk) chunk_size = min_chunk;
+  size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+
+  if (num_chunks < 2 || num_threads < 2)
+  {
+    func(arg, 0, count);
+    return;
+  }
+
+  size_t num_helpers = num_chunks - 1;
+  if (num_helpers > num_threads) num_helpers = num_threads;
+
+  vsx_thread_pool_batch* batch = new vsx_thread_pool_batch;
+  batch->func = func;
+  batch->arg = arg;
+  batch->count = count;
+  batch->chunk_size = chunk_size;
+  batch->num_chunks = num_chunks;
+  batch->next_chunk = 0;
+  batch->chunks_done = 0;
+  batch->refs = (int)num_helpers + 1;
+
+  for (size_t i = 0; i < num_helpers; i++)
+    add_job(&vsx_thread_pool_batch::helper, (void*)batch);
+
+  // do our share, then wait for chunks other threads picked up
+  batch->run();
+  pthread_mutex_lock(&batch->mutex);
+  while (batch->chunks_done != batch->num_chunks)
+    pthread_cond_wait(&batch->cond, &batch->mutex);
+  pthread_mutex_unlock(&batch->mutex);
+  batch->release();
+}
@@ -0,0 +1,108 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include "vsx_background_job.h"
+#include "vsx_test.h"
+
+// vsx_background_job: the idle / working / done handoff the modules
+// build on.
+
+struct job_data
+{
+  int input;
+  int output;
+  bool slow;
+};
+
+static void square_job(void* arg)
+{
+  job_data* d = (job_data*)arg;
+  if (d->slow)
+    usleep(20000);
+  d->output = d->input * d->input;
+}
+
+static void test_handoff()
+{
+  vsx_background_job job;
+  job_data d;
+  VSX_TEST_CHECK(!job.busy());
+  VSX_TEST_CHECK(!job.collect());
+
+  for (int i = 0; i < 1000; i++)
+  {
+    d.input = i;
+    d.output = -1;
+    d.slow = (i % 100) == 0;
+    job.start(&square_job, (void*)&d);
+    VSX_TEST_CHECK(job.busy());
+    // the way run() polls it, once per frame
+    while (!job.collect())
+      VSX_TEST_CHECK(job.busy());
+    VSX_TEST_CHECK(d.output == i * i);
+    VSX_TEST_CHECK(!job.busy());
+    VSX_TEST_CHECK(!job.collect());
+    if (vsx_test_failures)
+      return;
+  }
+}
+
+static void test_wait()
+{
+  vsx_background_job job;
+  job_data d;
+  d.input = 7;
+  d.output = -1;
+  d.slow = true;
+  job.start(&square_job, (void*)&d);
+  job.wait();
+  VSX_TEST_CHECK(!job.working());
+  // finished, but still busy until collected
+  VSX_TEST_CHECK(job.busy());
+  VSX_TEST_CHECK(d.output == 49);
+  VSX_TEST_CHECK(job.collect());
+}
+
+static void test_destructor_waits()
+{
+  job_data d;
+  d.input = 3;
+  d.output = -1;
+  d.slow = true;
+  {
+    vsx_background_job job;
+    job.start(&square_job, (void*)&d);
+  }
+  VSX_TEST_CHECK(d.output == 9);
+}
+
+int main()
+{
+  test_handoff();
+  test_wait();
+  test_destructor_waits();
+  return vsx_test_result();
+}
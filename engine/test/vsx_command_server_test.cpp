@@ -0,0 +1,294 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "vsx_command_client_server.h"
+#include "vsx_test.h"
+
+// vsx_command_list_server over localhost: line and binary clients side
+// by side, commands split across writes, a batch of replies to several
+// clients in one flush, keepalives, dc and stop/start, a second start()
+// and a port that is taken. Prints the flush to receive latency.
+
+#define TEST_PORT 11931
+
+static int connect_client()
+{
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in a;
+  memset(&a, 0, sizeof(a));
+  a.sin_family = AF_INET;
+  a.sin_port = htons(TEST_PORT);
+  a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(s, (sockaddr*)&a, sizeof(a)))
+  {
+    perror("connect");
+    exit(1);
+  }
+  int one = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return s;
+}
+
+static int open_fds()
+{
+  int count = 0;
+  DIR* d = opendir("/proc/self/fd");
+  if (!d)
+    return -1;
+  while (readdir(d))
+    count++;
+  closedir(d);
+  return count;
+}
+
+// a server on a port somebody else listens on closes everything it opened
+static void test_port_taken()
+{
+  int blocker = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in a;
+  memset(&a, 0, sizeof(a));
+  a.sin_family = AF_INET;
+  a.sin_port = htons(TEST_PORT + 1);
+  a.sin_addr.s_addr = htonl(INADDR_ANY);
+  VSX_TEST_CHECK(bind(blocker, (sockaddr*)&a, sizeof(a)) == 0);
+  VSX_TEST_CHECK(listen(blocker, 1) == 0);
+
+  vsx_command_list cmd_in, cmd_out;
+  char port[16];
+  sprintf(port, "%d", TEST_PORT + 1);
+  int before = open_fds();
+  for (int i = 0; i < 3; i++)
+  {
+    vsx_command_list_server server;
+    server.set_command_lists(&cmd_in, &cmd_out);
+    VSX_TEST_CHECK(server.start(port));
+    usleep(50000);
+    server.stop();
+  }
+  VSX_TEST_CHECK(open_fds() == before);
+  close(blocker);
+}
+
+static void send_all(int s, const std::string& data)
+{
+  size_t done = 0;
+  while (done < data.size())
+  {
+    ssize_t n = send(s, data.data() + done, data.size() - done, 0);
+    if (n <= 0)
+      return;
+    done += n;
+  }
+}
+
+// reads until there are at least want bytes, the peer closes or
+// timeout_ms passes
+static std::string receive(int s, size_t want, int timeout_ms = 2000)
+{
+  std::string r;
+  char buf[65536];
+  struct timeval tv = {0, 100000};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  for (int t = 0; t < timeout_ms / 100 && r.size() < want; t++)
+  {
+    ssize_t n = recv(s, buf, sizeof(buf), 0);
+    if (n == 0)
+      break;
+    if (n > 0)
+      r.append(buf, n);
+  }
+  return r;
+}
+
+// true once the server has closed the connection, whatever was still
+// unread before that
+static bool closed_by_server(int s, int timeout_ms = 2000)
+{
+  char buf[4096];
+  struct timeval tv = {0, 100000};
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  for (int t = 0; t < timeout_ms / 100; t++)
+  {
+    ssize_t n = recv(s, buf, sizeof(buf), 0);
+    if (n == 0)
+      return true;
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      return true;
+  }
+  return false;
+}
+
+static std::string frame(const std::string& payload)
+{
+  std::string header(4, 0);
+  header[0] = (char)(payload.size() >> 24);
+  header[1] = (char)(payload.size() >> 16);
+  header[2] = (char)(payload.size() >> 8);
+  header[3] = (char)payload.size();
+  return header + payload;
+}
+
+static std::string take_all(vsx_command_list& list)
+{
+  std::string got;
+  vsx_command_s* c;
+  while (list.pop(&c))
+  {
+    got += c->str().c_str();
+    got += "|";
+  }
+  return got;
+}
+
+int main()
+{
+  vsx_command_list cmd_in, cmd_out;
+  vsx_command_list_server server;
+  server.set_command_lists(&cmd_in, &cmd_out);
+  char port[16];
+  sprintf(port, "%d", TEST_PORT);
+  VSX_TEST_CHECK(server.start(port));
+  usleep(100000);
+  // already running: refused, no second worker or wake pipe
+  int fds = open_fds();
+  VSX_TEST_CHECK(!server.start(port));
+  VSX_TEST_CHECK(open_fds() == fds);
+
+  const std::string welcome = ">>VSXu Server 0.3.0\n";
+  int line_a = connect_client();
+  int line_b = connect_client();
+  int binary = connect_client();
+  VSX_TEST_CHECK(receive(line_a, welcome.size()) == welcome);
+  VSX_TEST_CHECK(receive(line_b, welcome.size()) == welcome);
+  VSX_TEST_CHECK(receive(binary, welcome.size()) == welcome);
+
+  // a line split across writes, crlf, keepalive and empty lines skipped
+  send_all(line_a, "hello 1\r\nhel");
+  usleep(20000);
+  send_all(line_a, "lo 2\n_\n\n");
+
+  // binary: the switch, then frames split in the middle of a header,
+  // an empty keepalive frame in between
+  send_all(binary, "binary\n");
+  std::string frames = frame("bin 3") + frame("") + frame("bin 4");
+  send_all(binary, frames.substr(0, 6));
+  usleep(20000);
+  send_all(binary, frames.substr(6, 5));
+  usleep(20000);
+  send_all(binary, frames.substr(11));
+  usleep(100000);
+
+  std::string got = take_all(cmd_in);
+  printf("received: %s\n", got.c_str());
+  VSX_TEST_CHECK(got.find("hello 1|") != std::string::npos);
+  VSX_TEST_CHECK(got.find("hello 2|") != std::string::npos);
+  VSX_TEST_CHECK(got.find("bin 3|") != std::string::npos);
+  VSX_TEST_CHECK(got.find("bin 4|") != std::string::npos);
+  VSX_TEST_CHECK(got.find("hello 1|hello 2|") != std::string::npos);
+  VSX_TEST_CHECK(got.find("bin 3|bin 4|") != std::string::npos);
+  VSX_TEST_CHECK(got.size() == strlen("hello 1|hello 2|bin 3|bin 4|"));
+
+  // one flush, 1000 commands, every client gets them all in its protocol
+  std::string lines, batch;
+  for (int i = 0; i < 1000; i++)
+  {
+    char t[32];
+    sprintf(t, "reply %d", i);
+    cmd_out.add_raw(t);
+    lines += std::string(t) + "\n";
+    batch += frame(t);
+  }
+  server.flush();
+  VSX_TEST_CHECK(receive(line_a, lines.size()) == lines);
+  VSX_TEST_CHECK(receive(line_b, lines.size()) == lines);
+  VSX_TEST_CHECK(receive(binary, batch.size()) == batch);
+
+  // after a second of nothing to send, keepalives in either protocol
+  VSX_TEST_CHECK(receive(line_a, 2, 2500) == "_\n");
+  VSX_TEST_CHECK(receive(binary, 4, 2500) == std::string(4, 0));
+  receive(line_b, 2, 100);
+
+  // dc closes that client only
+  send_all(line_b, "dc\n");
+  VSX_TEST_CHECK(closed_by_server(line_b));
+  cmd_out.add_raw("after dc");
+  server.flush();
+  VSX_TEST_CHECK(receive(line_a, 9) == "after dc\n");
+  VSX_TEST_CHECK(receive(binary, 12) == frame("after dc"));
+  VSX_TEST_CHECK(take_all(cmd_in) == "");
+
+  double latency;
+  int latency_failures = 0;
+  VSX_TEST_TIME(latency, 1000,
+    cmd_out.add_raw("ping 1");
+    server.flush();
+    if (receive(line_a, 7) != "ping 1\n")
+      latency_failures++;
+    receive(binary, 10)
+  );
+  VSX_TEST_CHECK(latency_failures == 0);
+  printf("flush to receive: %.1f us\n", latency * 1e6);
+
+  // many clients at once
+  int many[50];
+  for (int i = 0; i < 50; i++)
+  {
+    many[i] = connect_client();
+    receive(many[i], welcome.size());
+  }
+  cmd_out.add_raw("all 1");
+  server.flush();
+  int reached = 0;
+  for (int i = 0; i < 50; i++)
+    reached += receive(many[i], 6) == "all 1\n";
+  VSX_TEST_CHECK(reached == 50);
+
+  // stop drops the clients and frees the port
+  server.stop();
+  VSX_TEST_CHECK(closed_by_server(line_a));
+  VSX_TEST_CHECK(closed_by_server(binary));
+  VSX_TEST_CHECK(closed_by_server(many[0]));
+  VSX_TEST_CHECK(server.start(port));
+  usleep(100000);
+  int again = connect_client();
+  VSX_TEST_CHECK(receive(again, welcome.size()) == welcome);
+
+  close(again);
+  for (int i = 0; i < 50; i++)
+    close(many[i]);
+  close(line_a);
+  close(line_b);
+  close(binary);
+  server.stop();
+
+  test_port_taken();
+  return vsx_test_result();
+}
@@ -0,0 +1,443 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "vsx_string.h"
+#include "vsxfst.h"
+#include "vsx_dxt.h"
+#include "vsx_test.h"
+
+// vsx_dxt: known blocks byte for byte, whole chains through a reference
+// decoder, and the disk cache (hit, miss, and the entries it has to turn
+// down). Runs with HOME pointed at a fresh temporary directory so the
+// cache starts out empty and nothing is left behind.
+
+// --- reference decoder, straight from the S3TC spec --------------------------
+
+static void decode_565(unsigned short v, int* c)
+{
+  int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+  c[0] = r << 3 | r >> 2;
+  c[1] = g << 2 | g >> 4;
+  c[2] = b << 3 | b >> 2;
+}
+
+static void decode_color(const unsigned char* in, unsigned char out[16][4])
+{
+  unsigned short c0 = in[0] | in[1] << 8;
+  unsigned short c1 = in[2] | in[3] << 8;
+  int p[4][3];
+  decode_565(c0, p[0]);
+  decode_565(c1, p[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    if (c0 > c1)
+    {
+      p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+      p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+    }
+    else
+    {
+      p[2][c] = (p[0][c] + p[1][c]) / 2;
+      p[3][c] = 0;
+    }
+  }
+  unsigned int bits = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int)in[7] << 24;
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      out[i][c] = (unsigned char)p[(bits >> (i * 2)) & 3][c];
+}
+
+static void decode_alpha(const unsigned char* in, unsigned char out[16][4])
+{
+  int p[8];
+  p[0] = in[0];
+  p[1] = in[1];
+  for (int k = 2; k < 8; k++)
+    p[k] = p[0] > p[1] ? ((8 - k) * p[0] + (k - 1) * p[1]) / 7 : 0;
+  if (p[0] <= p[1])
+  {
+    for (int k = 2; k < 6; k++)
+      p[k] = ((6 - k) * p[0] + (k - 1) * p[1]) / 5;
+    p[6] = 0;
+    p[7] = 255;
+  }
+  unsigned long long bits = 0;
+  for (int i = 0; i < 6; i++)
+    bits |= (unsigned long long)in[2 + i] << (i * 8);
+  for (int i = 0; i < 16; i++)
+    out[i][3] = (unsigned char)p[(bits >> (i * 3)) & 7];
+}
+
+// one level back to rgba
+static void decode_level(const unsigned char* in, unsigned long size_x, unsigned long size_y, int format, unsigned char* out)
+{
+  unsigned long blocks_x = (size_x + 3) / 4;
+  unsigned long blocks_y = (size_y + 3) / 4;
+  unsigned char block[16][4];
+  for (unsigned long by = 0; by < blocks_y; by++)
+    for (unsigned long bx = 0; bx < blocks_x; bx++)
+    {
+      memset(block, 255, sizeof(block));
+      if (format == VSX_DXT5)
+      {
+        decode_alpha(in, block);
+        in += 8;
+      }
+      decode_color(in, block);
+      in += 8;
+      for (int y = 0; y < 4; y++)
+        for (int x = 0; x < 4; x++)
+        {
+          unsigned long px = bx * 4 + x, py = by * 4 + y;
+          if (px < size_x && py < size_y)
+            memcpy(out + (py * size_x + px) * 4, block[y * 4 + x], 4);
+        }
+    }
+}
+
+// --- encoder ---------------------------------------------------------------------
+
+static void test_known_blocks()
+{
+  unsigned char rgba[16 * 4];
+  unsigned char out[16];
+
+  // one color: both ends the same, all indices 0
+  for (int i = 0; i < 16; i++)
+  {
+    rgba[i * 4] = 255; rgba[i * 4 + 1] = 0; rgba[i * 4 + 2] = 0; rgba[i * 4 + 3] = 255;
+  }
+  const unsigned char solid_dxt1[8] = {0x00, 0xF8, 0x00, 0xF8, 0, 0, 0, 0};
+  vsx_dxt_compress(rgba, 4, 4, 4, VSX_DXT1, out);
+  VSX_TEST_CHECK(vsx_test_same_bits(out, solid_dxt1, 8));
+
+  // top half opaque white, bottom half transparent black. The ends sit on
+  // the gray axis pulled in by 1/16 of the range: 239 -> 565 (29,59,29),
+  // 16 -> (2,4,2). White picks entry 0, black entry 1; alpha 255 is
+  // entry 0, alpha 0 entry 1.
+  for (int i = 0; i < 16; i++)
+  {
+    unsigned char v = i < 8 ? 255 : 0;
+    rgba[i * 4] = rgba[i * 4 + 1] = rgba[i * 4 + 2] = rgba[i * 4 + 3] = v;
+  }
+  const unsigned char split_dxt5[16] =
+  {
+    0xFF, 0x00, 0x00, 0x00, 0x00, 0x49, 0x92, 0x24,
+    0x7D, 0xEF, 0x82, 0x10, 0x00, 0x00, 0x55, 0x55
+  };
+  vsx_dxt_compress(rgba, 4, 4, 4, VSX_DXT5, out);
+  VSX_TEST_CHECK(vsx_test_same_bits(out, split_dxt5, 16));
+
+  // and the same from rgb, alpha ignored
+  unsigned char rgb[16 * 3];
+  for (int i = 0; i < 16; i++)
+    memcpy(rgb + i * 3, rgba + i * 4, 3);
+  vsx_dxt_compress(rgb, 4, 4, 3, VSX_DXT1, out);
+  VSX_TEST_CHECK(vsx_test_same_bits(out, split_dxt5 + 8, 8));
+}
+
+static int max_error(const unsigned char* a, const unsigned char* b, size_t bytes)
+{
+  int m = 0;
+  for (size_t i = 0; i < bytes; i++)
+  {
+    int d = abs((int)a[i] - (int)b[i]);
+    if (d > m)
+      m = d;
+  }
+  return m;
+}
+
+// the bounds for a smooth gradient, per channel
+#define DXT_GRADIENT_MAX_COLOR_ERROR 16
+#define DXT_GRADIENT_MAX_ALPHA_ERROR 4
+
+static void test_chain()
+{
+  // not a multiple of 4 and not square: edge blocks and 1 wide levels
+  const unsigned long size_x = 37, size_y = 21;
+  unsigned char* image = (unsigned char*)malloc(size_x * size_y * 4);
+  for (unsigned long y = 0; y < size_y; y++)
+    for (unsigned long x = 0; x < size_x; x++)
+    {
+      unsigned char* p = image + (y * size_x + x) * 4;
+      p[0] = (unsigned char)(x * 255 / (size_x - 1));
+      p[1] = (unsigned char)(y * 255 / (size_y - 1));
+      p[2] = 128;
+      p[3] = (unsigned char)((x + y) * 255 / (size_x + size_y - 2));
+    }
+
+  vsx_bitmap source;
+  source.data = image;
+  source.size_x = size_x;
+  source.size_y = size_y;
+  source.bpp = 4;
+  vsx_bitmap dest;
+  dest.data = 0;
+  VSX_TEST_CHECK(vsx_dxt_compress_bitmap(&source, &dest));
+  VSX_TEST_CHECK(vsx_dxt_is_compressed(&dest));
+  VSX_TEST_CHECK(!vsx_dxt_is_compressed(&source));
+  VSX_TEST_CHECK(dest.size_x == size_x && dest.size_y == size_y);
+
+  // 37x21 18x10 9x5 4x2 2x1 1x1
+  VSX_TEST_CHECK(vsx_dxt_levels(size_x, size_y) == 6);
+  VSX_TEST_CHECK(vsx_dxt_level_size(size_x, size_y, VSX_DXT5) == 10 * 6 * 16);
+  VSX_TEST_CHECK(vsx_dxt_level_size(size_x, size_y, VSX_DXT1) == 10 * 6 * 8);
+  VSX_TEST_CHECK(vsx_dxt_chain_size(size_x, size_y, VSX_DXT5) == (60 + 15 + 6 + 1 + 1 + 1) * 16);
+
+  unsigned char* decoded = (unsigned char*)malloc(size_x * size_y * 4);
+  decode_level((unsigned char*)dest.data, size_x, size_y, VSX_DXT5, decoded);
+  int color = 0, alpha = 0;
+  for (size_t i = 0; i < size_x * size_y; i++)
+  {
+    int c = max_error(image + i * 4, decoded + i * 4, 3);
+    int a = abs((int)image[i * 4 + 3] - (int)decoded[i * 4 + 3]);
+    if (c > color) color = c;
+    if (a > alpha) alpha = a;
+  }
+  printf("dxt5 gradient: max error color %d, alpha %d\n", color, alpha);
+  VSX_TEST_CHECK(color <= DXT_GRADIENT_MAX_COLOR_ERROR);
+  VSX_TEST_CHECK(alpha <= DXT_GRADIENT_MAX_ALPHA_ERROR);
+
+  free(dest.data);
+
+  // one color: every level of the chain decodes to it, give or take 565
+  const unsigned long solid_x = 16, solid_y = 8;
+  unsigned char* solid = (unsigned char*)malloc(solid_x * solid_y * 4);
+  for (size_t i = 0; i < solid_x * solid_y; i++)
+  {
+    solid[i * 4] = 200; solid[i * 4 + 1] = 100; solid[i * 4 + 2] = 50; solid[i * 4 + 3] = 128;
+  }
+  source.data = solid;
+  source.size_x = solid_x;
+  source.size_y = solid_y;
+  VSX_TEST_CHECK(vsx_dxt_compress_bitmap(&source, &dest, VSX_DXT5));
+  const unsigned char* level = (const unsigned char*)dest.data;
+  unsigned long lx = solid_x, ly = solid_y;
+  for (int l = 0; l < vsx_dxt_levels(solid_x, solid_y); l++)
+  {
+    decode_level(level, lx, ly, VSX_DXT5, decoded);
+    for (size_t i = 0; i < lx * ly; i++)
+      VSX_TEST_CHECK(max_error(solid, decoded + i * 4, 3) <= 4 && decoded[i * 4 + 3] == 128);
+    level += vsx_dxt_level_size(lx, ly, VSX_DXT5);
+    lx = lx > 1 ? lx / 2 : 1;
+    ly = ly > 1 ? ly / 2 : 1;
+  }
+  free(dest.data);
+  free(solid);
+
+  // nothing to compress
+  vsx_bitmap empty;
+  empty.data = 0;
+  empty.bpp = 4;
+  VSX_TEST_CHECK(!vsx_dxt_compress_bitmap(&empty, &dest));
+  vsx_bitmap float_bitmap;
+  float_bitmap.data = image;
+  float_bitmap.size_x = size_x;
+  float_bitmap.size_y = size_y;
+  float_bitmap.bpp = 16;
+  VSX_TEST_CHECK(!vsx_dxt_compress_bitmap(&float_bitmap, &dest));
+
+  free(decoded);
+  free(image);
+}
+
+// --- disk cache ----------------------------------------------------------------
+
+static vsx_string cache_file(vsx_dxt_hash_t key)
+{
+  char name[32];
+  sprintf(name, "%016llx.dxt", key);
+  return vsx_get_data_path() + "texture_cache/" + name;
+}
+
+static long read_file(const vsx_string& filename, unsigned char** data)
+{
+  FILE* fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+    return -1;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  *data = (unsigned char*)malloc(size + 1);
+  long got = (long)fread(*data, 1, size, fp);
+  fclose(fp);
+  return got;
+}
+
+static void write_file(const vsx_string& filename, const unsigned char* data, long size)
+{
+  FILE* fp = fopen(filename.c_str(), "wb");
+  fwrite(data, 1, size, fp);
+  fclose(fp);
+}
+
+// the entry written over with a changed copy, then loaded
+static bool load_modified(vsx_dxt_hash_t key, const unsigned char* file, long size, long offset, unsigned char value, long new_size)
+{
+  unsigned char* copy = (unsigned char*)malloc(new_size);
+  memcpy(copy, file, size < new_size ? size : new_size);
+  if (new_size > size)
+    memset(copy + size, 0, new_size - size);
+  if (offset >= 0)
+    copy[offset] ^= value;
+  write_file(cache_file(key), copy, new_size);
+  free(copy);
+  vsx_bitmap loaded;
+  loaded.data = 0;
+  bool ok = vsx_dxt_cache_load(key, &loaded);
+  free(loaded.data);
+  return ok;
+}
+
+static void test_cache()
+{
+  const unsigned long size_x = 64, size_y = 40;
+  vsx_test_random r(1);
+  unsigned char* image = (unsigned char*)malloc(size_x * size_y * 3);
+  for (size_t i = 0; i < size_x * size_y * 3; i++)
+    image[i] = (unsigned char)(r.next() & 0xFF);
+  vsx_bitmap source;
+  source.data = image;
+  source.size_x = size_x;
+  source.size_y = size_y;
+  source.bpp = 3;
+  vsx_bitmap compressed;
+  VSX_TEST_CHECK(vsx_dxt_compress_bitmap(&source, &compressed));
+  size_t bytes = vsx_dxt_chain_size(size_x, size_y, VSX_DXT1);
+
+  vsx_dxt_hash_t key = vsx_dxt_hash(image, size_x * size_y * 3);
+  vsx_bitmap loaded;
+  loaded.data = 0;
+  VSX_TEST_CHECK(!vsx_dxt_cache_load(key, &loaded));
+
+  // uncompressed bitmaps aren't stored
+  vsx_dxt_cache_store(key, &source);
+  VSX_TEST_CHECK(access(cache_file(key).c_str(), 0) != 0);
+
+  vsx_dxt_cache_store(key, &compressed);
+  VSX_TEST_CHECK(vsx_dxt_cache_load(key, &loaded));
+  VSX_TEST_CHECK(loaded.size_x == size_x && loaded.size_y == size_y);
+  VSX_TEST_CHECK(loaded.bpp == compressed.bpp && loaded.bformat == compressed.bformat);
+  VSX_TEST_CHECK(loaded.valid);
+  VSX_TEST_CHECK(loaded.data && vsx_test_same_bits(loaded.data, compressed.data, bytes));
+  free(loaded.data);
+  VSX_TEST_CHECK(!vsx_dxt_cache_load(key + 1, &loaded));
+
+  unsigned char* file = 0;
+  long size = read_file(cache_file(key), &file);
+  VSX_TEST_CHECK(size == (long)(28 + bytes));
+  if (size != (long)(28 + bytes))
+    return;
+
+  // as written it loads, every other version doesn't
+  VSX_TEST_CHECK(load_modified(key, file, size, -1, 0, size));
+  // an older layout ("VSXDXT01")
+  VSX_TEST_CHECK(!load_modified(key, file, size, 7, '2' ^ '1', size));
+  // sizes and format
+  VSX_TEST_CHECK(!load_modified(key, file, size, 9, 0x01, size));
+  VSX_TEST_CHECK(!load_modified(key, file, size, 16, 0x04, size));
+  // a damaged block, first and last byte
+  VSX_TEST_CHECK(!load_modified(key, file, size, 28, 0x10, size));
+  VSX_TEST_CHECK(!load_modified(key, file, size, size - 1, 0x80, size));
+  // cut short, inside the header and inside the data
+  VSX_TEST_CHECK(!load_modified(key, file, size, -1, 0, 12));
+  VSX_TEST_CHECK(!load_modified(key, file, size, -1, 0, size - 1));
+  // trailing bytes
+  VSX_TEST_CHECK(!load_modified(key, file, size, -1, 0, size + 16));
+
+  // a new store replaces the bad entry
+  vsx_dxt_cache_store(key, &compressed);
+  loaded.data = 0;
+  VSX_TEST_CHECK(vsx_dxt_cache_load(key, &loaded));
+  free(loaded.data);
+
+  free(file);
+  free(compressed.data);
+  free(image);
+}
+
+static void benchmark()
+{
+  const unsigned long size = 1024;
+  vsx_test_random r(2);
+  unsigned char* image = (unsigned char*)malloc(size * size * 4);
+  for (unsigned long y = 0; y < size; y++)
+    for (unsigned long x = 0; x < size; x++)
+    {
+      unsigned char* p = image + (y * size + x) * 4;
+      p[0] = (unsigned char)(x >> 2);
+      p[1] = (unsigned char)(y >> 2);
+      p[2] = (unsigned char)(r.next() & 0x3F);
+      p[3] = (unsigned char)((x ^ y) & 0xFF);
+    }
+  vsx_bitmap source;
+  source.data = image;
+  source.size_x = size;
+  source.size_y = size;
+  source.bpp = 4;
+  unsigned char* out = (unsigned char*)malloc(vsx_dxt_level_size(size, size, VSX_DXT5));
+  double t_level, t_chain;
+  VSX_TEST_TIME(t_level, 10, vsx_dxt_compress(image, size, size, 4, VSX_DXT5, out));
+  VSX_TEST_TIME(t_chain, 10,
+    vsx_bitmap dest;
+    vsx_dxt_compress_bitmap(&source, &dest);
+    free(dest.data)
+  );
+  printf("dxt5 %lux%lu: %.2f ms per level, %.2f ms with mipmaps\n",
+    size, size, t_level * 1e3, t_chain * 1e3);
+  free(out);
+  free(image);
+}
+
+int main()
+{
+  char home[] = "/tmp/vsx_dxt_test_XXXXXX";
+  if (!mkdtemp(home))
+  {
+    printf("can't make a temporary HOME\n");
+    return 1;
+  }
+  setenv("HOME", home, 1);
+  // vsx_get_data_path() only makes the vsxu part
+  vsx_string share = vsx_string(home) + "/.local";
+  mkdir(share.c_str(), 0700);
+  share = share + "/share";
+  mkdir(share.c_str(), 0700);
+
+  test_known_blocks();
+  test_chain();
+  test_cache();
+  benchmark();
+
+  vsx_string cleanup = vsx_string("rm -rf ") + home;
+  if (system(cleanup.c_str()) != 0)
+    printf("couldn't remove %s\n", home);
+  return vsx_test_result();
+}
@@ -0,0 +1,254 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "vsx_math_3d.h"
+#include "vsx_quaternion.h"
+#include "vsx_quaternion_batch.h"
+#include "vsx_array.h"
+#include "vsx_test.h"
+
+// vsx_matrix::multiply, vsx_quaternion::mul and the batch slerp.
+//
+// This is built twice, as is and with VSX_MATH_3D_NO_SIMD
+// (vsx_math_3d_test_scalar). Both builds compare against the scalar
+// formulas written out below, bit for bit, so with both passing the SIMD
+// and the scalar code in the headers give the same results.
+
+// the #else branch of vsx_matrix::multiply
+static void reference_multiply(const float* a, const float* b, float* out)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    int ii = i * 4;
+    for (int j = 0; j < 4; j++)
+      out[ii + j] = a[ii] * b[j] +
+                    a[ii + 1] * b[4 + j] +
+                    a[ii + 2] * b[8 + j] +
+                    a[ii + 3] * b[12 + j];
+  }
+}
+
+// the #else branch of vsx_quaternion::mul
+static void reference_mul(const vsx_quaternion& q1, const vsx_quaternion& q2, float* out)
+{
+  out[0] =  q1.x * q2.w + q1.y * q2.z - q1.z * q2.y + q1.w * q2.x;
+  out[1] = -q1.x * q2.z + q1.y * q2.w + q1.z * q2.x + q1.w * q2.y;
+  out[2] =  q1.x * q2.y - q1.y * q2.x + q1.z * q2.w + q1.w * q2.z;
+  out[3] = -q1.x * q2.x - q1.y * q2.y - q1.z * q2.z + q1.w * q2.w;
+}
+
+// slerp in double, the short way around
+static void reference_slerp(const vsx_quaternion& a, const vsx_quaternion& b, double t, double* out)
+{
+  double qa[4] = {a.x, a.y, a.z, a.w};
+  double qb[4] = {b.x, b.y, b.z, b.w};
+  double c = qa[0] * qb[0] + qa[1] * qb[1] + qa[2] * qb[2] + qa[3] * qb[3];
+  if (c < 0.0)
+  {
+    c = -c;
+    for (int k = 0; k < 4; k++)
+      qb[k] = -qb[k];
+  }
+  if (c > 1.0)
+    c = 1.0;
+  double w0 = 1.0 - t, w1 = t;
+  double omega = acos(c);
+  if (sin(omega) > 1e-12)
+  {
+    w0 = sin((1.0 - t) * omega) / sin(omega);
+    w1 = sin(t * omega) / sin(omega);
+  }
+  for (int k = 0; k < 4; k++)
+    out[k] = w0 * qa[k] + w1 * qb[k];
+}
+
+static vsx_quaternion random_unit_quaternion(vsx_test_random& r)
+{
+  vsx_quaternion q;
+  q.x = r.range(-1.0f, 1.0f);
+  q.y = r.range(-1.0f, 1.0f);
+  q.z = r.range(-1.0f, 1.0f);
+  q.w = r.range(-1.0f, 1.0f);
+  q.normalize();
+  return q;
+}
+
+static void test_matrix_multiply()
+{
+  vsx_test_random r(1);
+  for (int n = 0; n < 100000; n++)
+  {
+    vsx_matrix a, b, c;
+    for (int k = 0; k < 16; k++)
+    {
+      a.m[k] = r.range(-10.0f, 10.0f);
+      b.m[k] = r.range(-10.0f, 10.0f);
+    }
+    float expected[16];
+    reference_multiply(a.m, b.m, expected);
+    c.multiply(&a, &b);
+    VSX_TEST_CHECK(vsx_test_same_bits(c.m, expected, sizeof(expected)));
+    if (vsx_test_failures)
+      return;
+    // result written over an argument
+    a.multiply(&a, &b);
+    VSX_TEST_CHECK(vsx_test_same_bits(a.m, expected, sizeof(expected)));
+  }
+
+  vsx_matrix a, b, c;
+  for (int k = 0; k < 16; k++)
+  {
+    a.m[k] = r.range(-1.0f, 1.0f);
+    b.m[k] = r.range(-1.0f, 1.0f);
+  }
+  double t_header, t_reference;
+  VSX_TEST_TIME(t_header, 10000000, c.multiply(&a, &b); a.m[0] = c.m[5]);
+  VSX_TEST_TIME(t_reference, 10000000, reference_multiply(a.m, b.m, c.m); a.m[0] = c.m[5]);
+  printf("matrix multiply: %.2f ns, scalar reference %.2f ns\n", t_header * 1e9, t_reference * 1e9);
+}
+
+static void test_quaternion_mul()
+{
+  vsx_test_random r(2);
+  for (int n = 0; n < 100000; n++)
+  {
+    vsx_quaternion a, b, c;
+    a.x = r.range(-2.0f, 2.0f); a.y = r.range(-2.0f, 2.0f);
+    a.z = r.range(-2.0f, 2.0f); a.w = r.range(-2.0f, 2.0f);
+    b.x = r.range(-2.0f, 2.0f); b.y = r.range(-2.0f, 2.0f);
+    b.z = r.range(-2.0f, 2.0f); b.w = r.range(-2.0f, 2.0f);
+    float expected[4];
+    reference_mul(a, b, expected);
+    c.mul(a, b);
+    float got[4] = {c.x, c.y, c.z, c.w};
+    VSX_TEST_CHECK(vsx_test_same_bits(got, expected, sizeof(expected)));
+    if (vsx_test_failures)
+      return;
+    // multiplying into itself, the way the modules use it
+    a.mul(a, b);
+    float got_self[4] = {a.x, a.y, a.z, a.w};
+    VSX_TEST_CHECK(vsx_test_same_bits(got_self, expected, sizeof(expected)));
+  }
+}
+
+// the bound stated for the batch slerp, per component of unit quaternions
+#define BATCH_SLERP_MAX_ERROR 1.8e-7
+
+static void test_batch_slerp()
+{
+  // not a multiple of 4, so the scalar tail runs as well
+  const size_t count = 100003;
+  vsx_test_random r(3);
+  vsx_array<vsx_quaternion> from, to, dest;
+  vsx_array<float> t;
+  from.allocate(count - 1);
+  to.allocate(count - 1);
+  dest.allocate(count - 1);
+  t.allocate(count - 1);
+  for (size_t i = 0; i < count; i++)
+  {
+    from[i] = random_unit_quaternion(r);
+    switch (i % 4)
+    {
+      // nearly the same rotation, where slerp() falls back to lerp
+      case 0:
+        to[i] = from[i];
+        to[i].x += r.range(-1e-4f, 1e-4f);
+        to[i].normalize();
+        break;
+      // the long way round, has to flip
+      case 1:
+        to[i] = random_unit_quaternion(r);
+        if (from[i].x * to[i].x + from[i].y * to[i].y + from[i].z * to[i].z + from[i].w * to[i].w > 0.0f)
+        {
+          to[i].x = -to[i].x; to[i].y = -to[i].y;
+          to[i].z = -to[i].z; to[i].w = -to[i].w;
+        }
+        break;
+      default:
+        to[i] = random_unit_quaternion(r);
+    }
+    // the ends exactly, and everything in between
+    t[i] = (i % 7 == 0) ? 0.0f : (i % 7 == 1) ? 1.0f : r.uniform();
+  }
+
+  double max_error = 0.0;
+  vsx_quaternion_batch_slerp(from.get_pointer(), to.get_pointer(), t.get_pointer(), dest.get_pointer(), count);
+  for (size_t i = 0; i < count; i++)
+  {
+    double expected[4];
+    reference_slerp(from[i], to[i], t[i], expected);
+    float got[4] = {dest[i].x, dest[i].y, dest[i].z, dest[i].w};
+    for (int k = 0; k < 4; k++)
+      if (fabs(got[k] - expected[k]) > max_error)
+        max_error = fabs(got[k] - expected[k]);
+  }
+  printf("batch slerp, t per item: max error %.3g\n", max_error);
+  VSX_TEST_CHECK(max_error <= BATCH_SLERP_MAX_ERROR);
+
+  // one t for all, written over from
+  max_error = 0.0;
+  vsx_array<vsx_quaternion> in_place;
+  in_place.allocate(count - 1);
+  memcpy(in_place.get_pointer(), from.get_pointer(), sizeof(vsx_quaternion) * count);
+  vsx_quaternion_batch_slerp(in_place.get_pointer(), to.get_pointer(), 0.3f, in_place.get_pointer(), count);
+  for (size_t i = 0; i < count; i++)
+  {
+    double expected[4];
+    reference_slerp(from[i], to[i], 0.3f, expected);
+    float got[4] = {in_place[i].x, in_place[i].y, in_place[i].z, in_place[i].w};
+    for (int k = 0; k < 4; k++)
+      if (fabs(got[k] - expected[k]) > max_error)
+        max_error = fabs(got[k] - expected[k]);
+  }
+  printf("batch slerp, one t, in place: max error %.3g\n", max_error);
+  VSX_TEST_CHECK(max_error <= BATCH_SLERP_MAX_ERROR);
+
+  double t_call, t_batch;
+  VSX_TEST_TIME(t_call, 20,
+    for (size_t i = 0; i < count; i++)
+      dest[i].slerp(from[i], to[i], t[i])
+  );
+  VSX_TEST_TIME(t_batch, 20,
+    vsx_quaternion_batch_slerp(from.get_pointer(), to.get_pointer(), t.get_pointer(), dest.get_pointer(), count)
+  );
+  printf("slerp of %d quaternions: %.3f ms per call, %.3f ms batched (%.1fx)\n",
+    (int)count, t_call * 1e3, t_batch * 1e3, t_call / t_batch);
+}
+
+int main()
+{
+#if defined(VSX_MATH_3D_SSE)
+  printf("backend: SSE\n");
+#elif defined(VSX_MATH_3D_NEON)
+  printf("backend: NEON\n");
+#else
+  printf("backend: scalar\n");
+#endif
+  test_matrix_multiply();
+  test_quaternion_mul();
+  test_batch_slerp();
+  return vsx_test_result();
+}
@@ -0,0 +1,271 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <algorithm>
+#include "vsx_mesh_spatial.h"
+#include "vsx_test.h"
+
+// vsx_mesh_spatial's nearest(), within() and sorted() against brute force
+// over the same vertices: random clouds bigger than a bounds chunk,
+// vertices and queries exactly on cell boundaries, queries far outside the
+// grid, radii larger than the grid, empty meshes and rebuilds.
+
+static float dist2(const vsx_vector& a, const vsx_vector& b)
+{
+  // the same expression as the index, so distances compare exactly
+  float dx = a.x - b.x;
+  float dy = a.y - b.y;
+  float dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+static void set_vertices(vsx_mesh& mesh, const vsx_vector* v, size_t count)
+{
+  vsx_vector* dest = mesh.data->vertices.resize(count);
+  for (size_t i = 0; i < count; i++)
+    dest[i] = v[i];
+  mesh.data->touch(VSX_MESH_VERTICES);
+}
+
+static void check_nearest(vsx_mesh_spatial* index, const vsx_vector* v, size_t count, const vsx_vector& p, size_t k)
+{
+  vsx_array<float> all;
+  float* d = all.resize(count);
+  for (size_t i = 0; i < count; i++)
+    d[i] = dist2(v[i], p);
+  std::sort(d, d + count);
+
+  size_t expected = k < count ? k : count;
+  vsx_array<unsigned int> ids;
+  vsx_array<float> got;
+  ids.resize(k);
+  got.resize(k);
+  size_t found = index->nearest(p, k, ids.get_pointer(), got.get_pointer());
+  VSX_TEST_CHECK(found == expected);
+  if (found != expected)
+    return;
+  // ties can come back in any order, their distances can't
+  bool same = true;
+  for (size_t i = 0; i < found; i++)
+  {
+    same = same && got[i] == d[i];
+    same = same && ids[i] < count && dist2(v[ids[i]], p) == got[i];
+    for (size_t j = 0; j < i; j++)
+      same = same && ids[j] != ids[i];
+  }
+  VSX_TEST_CHECK(same);
+
+  // without the distances
+  vsx_array<unsigned int> ids2;
+  ids2.resize(k);
+  VSX_TEST_CHECK(index->nearest(p, k, ids2.get_pointer()) == expected);
+  bool same_ids = true;
+  for (size_t i = 0; i < found; i++)
+    same_ids = same_ids && dist2(v[ids2[i]], p) == d[i];
+  VSX_TEST_CHECK(same_ids);
+}
+
+static void check_within(vsx_mesh_spatial* index, const vsx_vector* v, size_t count, const vsx_vector& p, float radius)
+{
+  vsx_array<unsigned int> expected;
+  float r2 = radius * radius;
+  for (size_t i = 0; i < count; i++)
+    if (dist2(v[i], p) <= r2)
+      expected.push_back((unsigned int)i);
+
+  vsx_array<unsigned int> got;
+  // within() appends
+  got.push_back(0xffffffff);
+  index->within(p, radius, got);
+  VSX_TEST_CHECK(got.size() == expected.size() + 1);
+  if (got.size() != expected.size() + 1)
+    return;
+  VSX_TEST_CHECK(got[0] == 0xffffffff);
+  unsigned int* g = got.get_pointer() + 1;
+  std::sort(g, g + expected.size());
+  VSX_TEST_CHECK(vsx_test_same_bits(g, expected.get_pointer(), sizeof(unsigned int) * expected.size()));
+}
+
+static void check_sorted(vsx_mesh_spatial* index, const vsx_vector* v, size_t count, const vsx_vector& p)
+{
+  vsx_array<unsigned int> got;
+  index->sorted(p, got);
+  VSX_TEST_CHECK(got.size() == count);
+  if (got.size() != count)
+    return;
+  vsx_array<unsigned char> seen;
+  unsigned char* s = seen.resize(count);
+  memset(s, 0, count);
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; i++)
+  {
+    ok = got[i] < count && !s[got[i]];
+    if (!ok)
+      break;
+    s[got[i]] = 1;
+    if (i)
+      ok = dist2(v[got[i - 1]], p) <= dist2(v[got[i]], p);
+  }
+  VSX_TEST_CHECK(ok);
+}
+
+static void check_all(vsx_mesh& mesh, const vsx_vector* v, size_t count, const vsx_vector& p)
+{
+  vsx_mesh_spatial* index = vsx_mesh_spatial::get(&mesh);
+  VSX_TEST_CHECK(index->size() == count);
+  size_t ks[5] = {1, 2, 7, 64, count + 3};
+  for (int k = 0; k < 5; k++)
+    check_nearest(index, v, count, p, ks[k]);
+  float radii[6] = {0.0f, 0.5f, 1.0f, 1.5f, 3.0f, 1e3f};
+  for (int r = 0; r < 6; r++)
+    check_within(index, v, count, p, radii[r]);
+  check_sorted(index, v, count, p);
+}
+
+static void test_empty()
+{
+  vsx_mesh mesh;
+  vsx_mesh_spatial* index = vsx_mesh_spatial::get(&mesh);
+  VSX_TEST_CHECK(index->size() == 0);
+  unsigned int ids[4];
+  float d[4];
+  VSX_TEST_CHECK(index->nearest(vsx_vector(0, 0, 0), 4, ids, d) == 0);
+  vsx_array<unsigned int> got;
+  index->within(vsx_vector(0, 0, 0), 1e6f, got);
+  VSX_TEST_CHECK(got.size() == 0);
+  got.push_back(1);
+  index->sorted(vsx_vector(0, 0, 0), got);
+  VSX_TEST_CHECK(got.size() == 0);
+
+  // a mesh that had vertices and lost them
+  vsx_vector one(1, 2, 3);
+  set_vertices(mesh, &one, 1);
+  index = vsx_mesh_spatial::get(&mesh);
+  VSX_TEST_CHECK(index->nearest(vsx_vector(0, 0, 0), 4, ids, d) == 1);
+  mesh.data->vertices.reset_used(0);
+  mesh.data->touch(VSX_MESH_VERTICES);
+  index = vsx_mesh_spatial::get(&mesh);
+  VSX_TEST_CHECK(index->size() == 0);
+  VSX_TEST_CHECK(index->nearest(vsx_vector(0, 0, 0), 4, ids, d) == 0);
+}
+
+// a single vertex, and every vertex in the same place
+static void test_degenerate()
+{
+  vsx_vector v[100];
+  for (int i = 0; i < 100; i++)
+    v[i] = vsx_vector(-2, 5, 0.25f);
+  vsx_mesh mesh;
+  set_vertices(mesh, v, 1);
+  check_all(mesh, v, 1, vsx_vector(0, 0, 0));
+  check_all(mesh, v, 1, v[0]);
+  set_vertices(mesh, v, 100);
+  check_all(mesh, v, 100, vsx_vector(0, 0, 0));
+  check_all(mesh, v, 100, v[0]);
+}
+
+// 0..4 on every axis, 125 lattice points plus 3 doubles: 128 vertices
+// over a volume of 64 make the cells exactly 1 wide, so every vertex and
+// every query below sits on cell boundaries
+static void test_cell_boundaries()
+{
+  vsx_vector v[128];
+  size_t count = 0;
+  for (int z = 0; z <= 4; z++)
+  for (int y = 0; y <= 4; y++)
+  for (int x = 0; x <= 4; x++)
+    v[count++] = vsx_vector((float)x, (float)y, (float)z);
+  v[count++] = vsx_vector(0, 0, 0);
+  v[count++] = vsx_vector(2, 2, 2);
+  v[count++] = vsx_vector(4, 4, 4);
+
+  vsx_mesh mesh;
+  set_vertices(mesh, v, count);
+  for (int z = -1; z <= 5; z++)
+  for (int y = -1; y <= 5; y++)
+  for (int x = -1; x <= 5; x++)
+    check_all(mesh, v, count, vsx_vector((float)x, (float)y, (float)z));
+  // halfway between boundaries
+  check_all(mesh, v, count, vsx_vector(1.5f, 2.5f, 3.5f));
+
+  // a line: one spanned axis, 16 vertices over 8 also gives 1 wide cells
+  vsx_vector line[16];
+  for (int i = 0; i < 16; i++)
+    line[i] = vsx_vector((float)(i % 9), 0, 0);
+  set_vertices(mesh, line, 16);
+  for (int x = -1; x <= 9; x++)
+    check_all(mesh, line, 16, vsx_vector((float)x, 0, 0));
+  check_all(mesh, line, 16, vsx_vector(3, 1, 0));
+}
+
+static void test_random()
+{
+  vsx_test_random r(7);
+  const size_t count = VSX_MESH_SPATIAL_CHUNK * 2 + 123;
+  vsx_array<vsx_vector> v;
+  vsx_vector* p = v.resize(count);
+  for (size_t i = 0; i < count; i++)
+    p[i] = vsx_vector(r.range(-4.0f, 4.0f), r.range(-1.0f, 1.0f), r.range(-2.0f, 2.0f));
+
+  vsx_mesh mesh;
+  set_vertices(mesh, p, count);
+  for (int q = 0; q < 20; q++)
+    check_all(mesh, p, count, vsx_vector(r.range(-5.0f, 5.0f), r.range(-2.0f, 2.0f), r.range(-3.0f, 3.0f)));
+  // on vertices
+  for (int q = 0; q < 5; q++)
+    check_all(mesh, p, count, p[q * 997]);
+
+  // far outside the grid, and radii far larger than it
+  vsx_vector far[4] = {
+    vsx_vector(1e4f, 0, 0),
+    vsx_vector(-1e4f, -1e4f, 1e4f),
+    vsx_vector(3e9f, 0, 0),
+    vsx_vector(0, -3e9f, 0)
+  };
+  vsx_mesh_spatial* index = vsx_mesh_spatial::get(&mesh);
+  for (int q = 0; q < 4; q++)
+  {
+    check_nearest(index, p, count, far[q], 5);
+    check_within(index, p, count, far[q], 2e4f);
+    check_within(index, p, count, vsx_vector(0, 0, 0), 1e12f);
+  }
+
+  // moved vertices, same array, new stamp: rebuilt
+  for (size_t i = 0; i < count; i++)
+    p[i] = vsx_vector(r.range(0.0f, 100.0f), r.range(0.0f, 1.0f), 0.0f);
+  set_vertices(mesh, p, count);
+  VSX_TEST_CHECK(vsx_mesh_spatial::get(&mesh) == index);
+  for (int q = 0; q < 10; q++)
+    check_all(mesh, p, count, vsx_vector(r.range(-10.0f, 110.0f), r.range(-1.0f, 2.0f), 0.0f));
+}
+
+int main()
+{
+  test_empty();
+  test_degenerate();
+  test_cell_boundaries();
+  test_random();
+  return vsx_test_result();
+}
@@ -0,0 +1,336 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "vsx_noise.h"
+#include "vsx_array.h"
+#include "vsx_test.h"
+
+// vsx_noise against the texgen Perlin class it replaced: the gradient
+// noise has to give the same bits, single samples and the SSE2 _n paths
+// both, so saved perlin_noise states render as before. Also times the
+// 512x512 fbm the texgen module draws, old class vs vsx_noise, and checks
+// gradient4 is continuous and in range. Also built with
+// VSX_MATH_3D_NO_SIMD (vsx_noise_test_scalar).
+
+// The old class (plugins/src/bitmap.texgen/perlin), cut down to what
+// the texgen used.
+#define REFERENCE_B 0x400
+#define REFERENCE_BM 0x3ff
+#define REFERENCE_N 0x1000
+
+#define reference_s_curve(t) ( t * t * (3.0f - 2.0f * t) )
+#define reference_lerp(t, a, b) ( a + t * (b - a) )
+#define reference_setup(i,b0,b1,r0,r1)\
+  t = vec[i] + REFERENCE_N;\
+  b0 = ((int)t) & REFERENCE_BM;\
+  b1 = (b0+1) & REFERENCE_BM;\
+  r0 = t - (int)t;\
+  r1 = r0 - 1.0f;
+
+class reference_perlin
+{
+  int mOctaves;
+  float mFrequency;
+  float mAmplitude;
+  int p[REFERENCE_B + REFERENCE_B + 2];
+  float g3[REFERENCE_B + REFERENCE_B + 2][3];
+  float g2[REFERENCE_B + REFERENCE_B + 2][2];
+  float g1[REFERENCE_B + REFERENCE_B + 2];
+
+  void normalize2(float v[2])
+  {
+    float s = (float)sqrt(v[0] * v[0] + v[1] * v[1]);
+    s = 1.0f/s;
+    v[0] = v[0] * s;
+    v[1] = v[1] * s;
+  }
+
+  void normalize3(float v[3])
+  {
+    float s = (float)sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    s = 1.0f/s;
+    v[0] = v[0] * s;
+    v[1] = v[1] * s;
+    v[2] = v[2] * s;
+  }
+
+public:
+  reference_perlin(int octaves, float freq, float amp, int seed)
+  {
+    mOctaves = octaves;
+    mFrequency = freq;
+    mAmplitude = amp;
+    srand(seed);
+    int i, j, k;
+    for (i = 0 ; i < REFERENCE_B ; i++)
+    {
+      p[i] = i;
+      g1[i] = (float)((rand() % (REFERENCE_B + REFERENCE_B)) - REFERENCE_B) / REFERENCE_B;
+      for (j = 0 ; j < 2 ; j++)
+        g2[i][j] = (float)((rand() % (REFERENCE_B + REFERENCE_B)) - REFERENCE_B) / REFERENCE_B;
+      normalize2(g2[i]);
+      for (j = 0 ; j < 3 ; j++)
+        g3[i][j] = (float)((rand() % (REFERENCE_B + REFERENCE_B)) - REFERENCE_B) / REFERENCE_B;
+      normalize3(g3[i]);
+    }
+    while (--i)
+    {
+      k = p[i];
+      p[i] = p[j = rand() % REFERENCE_B];
+      p[j] = k;
+    }
+    for (i = 0 ; i < REFERENCE_B + 2 ; i++)
+    {
+      p[REFERENCE_B + i] = p[i];
+      g1[REFERENCE_B + i] = g1[i];
+      for (j = 0 ; j < 2 ; j++)
+        g2[REFERENCE_B + i][j] = g2[i][j];
+      for (j = 0 ; j < 3 ; j++)
+        g3[REFERENCE_B + i][j] = g3[i][j];
+    }
+  }
+
+  float noise2(float vec[2])
+  {
+    int bx0, bx1, by0, by1, b00, b10, b01, b11;
+    float rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
+    int i, j;
+    reference_setup(0,bx0,bx1,rx0,rx1);
+    reference_setup(1,by0,by1,ry0,ry1);
+    i = p[bx0];
+    j = p[bx1];
+    b00 = p[i + by0];
+    b10 = p[j + by0];
+    b01 = p[i + by1];
+    b11 = p[j + by1];
+    sx = reference_s_curve(rx0);
+    sy = reference_s_curve(ry0);
+    #define at2(rx,ry) ( rx * q[0] + ry * q[1] )
+    q = g2[b00]; u = at2(rx0,ry0);
+    q = g2[b10]; v = at2(rx1,ry0);
+    a = reference_lerp(sx, u, v);
+    q = g2[b01]; u = at2(rx0,ry1);
+    q = g2[b11]; v = at2(rx1,ry1);
+    b = reference_lerp(sx, u, v);
+    #undef at2
+    return reference_lerp(sy, a, b);
+  }
+
+  float noise3(float vec[3])
+  {
+    int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
+    float rx0, rx1, ry0, ry1, rz0, rz1, *q, sy, sz, a, b, c, d, t, u, v;
+    int i, j;
+    reference_setup(0, bx0,bx1, rx0,rx1);
+    reference_setup(1, by0,by1, ry0,ry1);
+    reference_setup(2, bz0,bz1, rz0,rz1);
+    i = p[ bx0 ];
+    j = p[ bx1 ];
+    b00 = p[ i + by0 ];
+    b10 = p[ j + by0 ];
+    b01 = p[ i + by1 ];
+    b11 = p[ j + by1 ];
+    t  = reference_s_curve(rx0);
+    sy = reference_s_curve(ry0);
+    sz = reference_s_curve(rz0);
+    #define at3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
+    q = g3[ b00 + bz0 ] ; u = at3(rx0,ry0,rz0);
+    q = g3[ b10 + bz0 ] ; v = at3(rx1,ry0,rz0);
+    a = reference_lerp(t, u, v);
+    q = g3[ b01 + bz0 ] ; u = at3(rx0,ry1,rz0);
+    q = g3[ b11 + bz0 ] ; v = at3(rx1,ry1,rz0);
+    b = reference_lerp(t, u, v);
+    c = reference_lerp(sy, a, b);
+    q = g3[ b00 + bz1 ] ; u = at3(rx0,ry0,rz1);
+    q = g3[ b10 + bz1 ] ; v = at3(rx1,ry0,rz1);
+    a = reference_lerp(t, u, v);
+    q = g3[ b01 + bz1 ] ; u = at3(rx0,ry1,rz1);
+    q = g3[ b11 + bz1 ] ; v = at3(rx1,ry1,rz1);
+    b = reference_lerp(t, u, v);
+    d = reference_lerp(sy, a, b);
+    #undef at3
+    return reference_lerp(sz, c, d);
+  }
+
+  float Get(float x, float y)
+  {
+    float vec[2];
+    vec[0] = x * mFrequency;
+    vec[1] = y * mFrequency;
+    float result = 0.0f;
+    float amp = mAmplitude;
+    for (int i = 0; i < mOctaves; i++)
+    {
+      result += noise2(vec) * amp;
+      vec[0] *= 2.0f;
+      vec[1] *= 2.0f;
+      amp *= 0.5f;
+    }
+    return result;
+  }
+};
+
+// the texgen's image size and octave count
+#define SIZE 512
+#define OCTAVES 6
+
+static void test_gradient_matches_perlin()
+{
+  const int seeds[5] = {1, 4, 94, 1234, 65535};
+  vsx_array<float> xs, ys, zs, out, out3;
+  xs.allocate(SIZE - 1);
+  ys.allocate(SIZE - 1);
+  zs.allocate(SIZE - 1);
+  out.allocate(SIZE - 1);
+  out3.allocate(SIZE - 1);
+
+  for (int s = 0; s < 5; s++)
+  {
+    float frequency = (float)(s + 1);
+    reference_perlin reference(OCTAVES, frequency, 1.0f, seeds[s]);
+    vsx_noise noise;
+    noise.init(seeds[s]);
+
+    int mismatches = 0;
+    for (int y = 0; y < SIZE; y++)
+    {
+      // the texgen's pixel to noise space, plus negative coordinates
+      float divisor = 1.0f / (float)SIZE;
+      for (int x = 0; x < SIZE; x++)
+      {
+        xs[x] = (x - (s & 1) * SIZE / 2) * divisor;
+        ys[x] = (y - (s & 1) * SIZE / 2) * divisor;
+        zs[x] = (x ^ y) * divisor * 3.0f;
+      }
+      noise.fbm2_n(xs.get_pointer(), ys.get_pointer(), out.get_pointer(), SIZE, OCTAVES, frequency, 1.0f);
+      noise.gradient3_n(xs.get_pointer(), ys.get_pointer(), zs.get_pointer(), out3.get_pointer(), SIZE);
+      for (int x = 0; x < SIZE; x++)
+      {
+        float expected = reference.Get(xs[x], ys[x]);
+        float single = noise.fbm2(xs[x], ys[x], OCTAVES, frequency, 1.0f);
+        float v3[3] = {xs[x], ys[x], zs[x]};
+        float expected3 = reference.noise3(v3);
+        float single3 = noise.gradient3(xs[x], ys[x], zs[x]);
+        if (!vsx_test_same_bits(&out[x], &expected, sizeof(float)) ||
+            !vsx_test_same_bits(&single, &expected, sizeof(float)) ||
+            !vsx_test_same_bits(&out3[x], &expected3, sizeof(float)) ||
+            !vsx_test_same_bits(&single3, &expected3, sizeof(float)))
+          mismatches++;
+      }
+    }
+    if (mismatches)
+      printf("seed %d: %d mismatching samples\n", seeds[s], mismatches);
+    VSX_TEST_CHECK(mismatches == 0);
+  }
+}
+
+static void test_gradient4()
+{
+  vsx_noise noise;
+  noise.init(94);
+  vsx_test_random r(4);
+  float lo = 0.0f, hi = 0.0f;
+  float xs[1001], ys[1001], zs[1001], ws[1001], out[1001];
+  for (int n = 0; n < 1001; n++)
+  {
+    xs[n] = r.range(-50.0f, 50.0f);
+    ys[n] = r.range(-50.0f, 50.0f);
+    zs[n] = r.range(-50.0f, 50.0f);
+    ws[n] = r.range(-50.0f, 50.0f);
+  }
+  noise.gradient4_n(xs, ys, zs, ws, out, 1001);
+  for (int n = 0; n < 1001; n++)
+  {
+    float v = noise.gradient4(xs[n], ys[n], zs[n], ws[n]);
+    VSX_TEST_CHECK(vsx_test_same_bits(&v, &out[n], sizeof(float)));
+    if (v < lo) lo = v;
+    if (v > hi) hi = v;
+    // continuous: a small step gives a small change
+    float step = noise.gradient4(xs[n] + 1e-3f, ys[n], zs[n], ws[n] - 1e-3f);
+    VSX_TEST_CHECK(fabs(step - v) < 0.01f);
+  }
+  // zero on the lattice points
+  VSX_TEST_CHECK(noise.gradient4(3.0f, -2.0f, 7.0f, 0.0f) == 0.0f);
+  printf("gradient4 over 1001 samples: [%.3f, %.3f]\n", lo, hi);
+  VSX_TEST_CHECK(lo >= -1.0f && hi <= 1.0f);
+  VSX_TEST_CHECK(hi - lo > 0.5f);
+}
+
+static void benchmark_fbm()
+{
+  reference_perlin reference(OCTAVES, 4.0f, 1.0f, 94);
+  vsx_noise noise;
+  noise.init(94);
+  vsx_array<float> xs, ys, out;
+  xs.allocate(SIZE - 1);
+  ys.allocate(SIZE - 1);
+  out.allocate(SIZE - 1);
+  for (int x = 0; x < SIZE; x++)
+    xs[x] = x * (1.0f / SIZE);
+
+  float sum = 0.0f;
+  double t_reference, t_noise;
+  VSX_TEST_TIME(t_reference, 3,
+    for (int y = 0; y < SIZE; y++)
+      for (int x = 0; x < SIZE; x++)
+        sum += reference.Get(xs[x], y * (1.0f / SIZE))
+  );
+  VSX_TEST_TIME(t_noise, 3,
+    for (int y = 0; y < SIZE; y++)
+    {
+      for (int x = 0; x < SIZE; x++)
+        ys[x] = y * (1.0f / SIZE);
+      noise.fbm2_n(xs.get_pointer(), ys.get_pointer(), out.get_pointer(), SIZE, OCTAVES, 4.0f, 1.0f);
+      sum += out[0];
+    }
+  );
+  printf("%dx%d fbm, %d octaves: Perlin class %.2f ms, vsx_noise %.2f ms (%.1fx)\n",
+    SIZE, SIZE, OCTAVES, t_reference * 1e3, t_noise * 1e3, t_reference / t_noise);
+
+  // the other bases at the same size, for comparison
+  double t_simplex;
+  VSX_TEST_TIME(t_simplex, 3,
+    for (int y = 0; y < SIZE; y++)
+    {
+      for (int x = 0; x < SIZE; x++)
+        ys[x] = y * (1.0f / SIZE);
+      noise.fbm2_n(xs.get_pointer(), ys.get_pointer(), out.get_pointer(), SIZE, OCTAVES, 4.0f, 1.0f, VSX_NOISE_SIMPLEX);
+      sum += out[0];
+    }
+  );
+  printf("%dx%d fbm, %d octaves: simplex %.2f ms\n", SIZE, SIZE, OCTAVES, t_simplex * 1e3);
+  if (sum == 12345.0f)
+    printf("\n");
+}
+
+int main()
+{
+  test_gradient_matches_perlin();
+  test_gradient4();
+  benchmark_fbm();
+  return vsx_test_result();
+}
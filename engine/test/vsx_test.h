@@ -0,0 +1,101 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_TEST_H
+#define VSX_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+#include "vsx_timer.h"
+
+// What the test executables share: checks that count failures instead of
+// stopping, a fixed seed random source so every run sees the same data,
+// and a timer for the benchmark printouts. Timings are only printed,
+// never checked, so a busy machine can't fail a test.
+//
+// main() ends with "return vsx_test_result();", ctest goes by the exit
+// code.
+
+static int vsx_test_failures = 0;
+
+#define VSX_TEST_CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      vsx_test_failures++; \
+    } \
+  } while (0)
+
+// same bits, so -0.0f != 0.0f and a nan equals itself
+inline bool vsx_test_same_bits(const void* a, const void* b, size_t size)
+{
+  return memcmp(a, b, size) == 0;
+}
+
+class vsx_test_random
+{
+  unsigned int state;
+public:
+  vsx_test_random(unsigned int seed = 1)
+  {
+    state = seed;
+  }
+
+  unsigned int next()
+  {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+  }
+
+  // [0, 1)
+  float uniform()
+  {
+    return (float)next() * (1.0f / 16777216.0f);
+  }
+
+  // [lo, hi)
+  float range(float lo, float hi)
+  {
+    return lo + (hi - lo) * uniform();
+  }
+};
+
+// seconds per call of the timed loop
+#define VSX_TEST_TIME(result, iterations, body) \
+  do { \
+    vsx_timer vsx_test_timer; \
+    vsx_test_timer.start(); \
+    for (int vsx_test_i = 0; vsx_test_i < (iterations); vsx_test_i++) { body; } \
+    result = vsx_test_timer.dtime() / (double)(iterations); \
+  } while (0)
+
+inline int vsx_test_result()
+{
+  if (vsx_test_failures)
+    printf("%d check(s) failed\n", vsx_test_failures);
+  else
+    printf("all checks passed\n");
+  return vsx_test_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,150 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include "vsx_math_3d.h"
+#include "vsx_quaternion.h"
+#include "vsx_vector_batch.h"
+#include "vsx_array.h"
+#include "vsx_test.h"
+
+// vsx_vector_batch.h over 1M vertex meshes: the batch functions against
+// the per vector loops the mesh modifiers used before, same results bit
+// for bit and the time for each. Also built with VSX_MATH_3D_NO_SIMD
+// (vsx_vector_batch_test_scalar).
+
+// a whole mesh, plus 3 so the scalar tail runs as well
+#define VERTEX_COUNT (1000000 + 3)
+#define RUNS 10
+
+static void compare(const char* name, vsx_array<vsx_vector>& got, vsx_array<vsx_vector>& expected, double t_loop, double t_batch)
+{
+  VSX_TEST_CHECK(vsx_test_same_bits(got.get_pointer(), expected.get_pointer(), sizeof(vsx_vector) * VERTEX_COUNT));
+  printf("%-28s %7.3f ms per vector, %7.3f ms batched (%.1fx)\n",
+    name, t_loop * 1e3, t_batch * 1e3, t_loop / t_batch);
+}
+
+int main()
+{
+  vsx_test_random r(1);
+  vsx_array<vsx_vector> vertices, normals;
+  vsx_array<vsx_vector> loop_vertices, loop_normals;
+  vsx_array<vsx_vector> batch_vertices, batch_normals;
+  vertices.allocate(VERTEX_COUNT - 1);
+  normals.allocate(VERTEX_COUNT - 1);
+  loop_vertices.allocate(VERTEX_COUNT - 1);
+  loop_normals.allocate(VERTEX_COUNT - 1);
+  batch_vertices.allocate(VERTEX_COUNT - 1);
+  batch_normals.allocate(VERTEX_COUNT - 1);
+  for (size_t i = 0; i < VERTEX_COUNT; i++)
+  {
+    vertices[i] = vsx_vector(r.range(-100.0f, 100.0f), r.range(-100.0f, 100.0f), r.range(-100.0f, 100.0f));
+    normals[i] = vsx_vector(r.range(-1.0f, 1.0f), r.range(-1.0f, 1.0f), r.range(-1.0f, 1.0f));
+    normals[i].normalize();
+  }
+
+  vsx_quaternion q;
+  q.x = 0.3f; q.y = -0.5f; q.z = 0.1f; q.w = 0.8f;
+  q.normalize();
+  vsx_matrix rotation = q.matrix();
+  vsx_matrix transform = rotation;
+  transform.m[3] = 12.5f;
+  transform.m[7] = -3.0f;
+  transform.m[11] = 0.25f;
+
+  const vsx_vector* src = vertices.get_pointer();
+  const vsx_vector* nsrc = normals.get_pointer();
+  vsx_vector* lv = loop_vertices.get_pointer();
+  vsx_vector* ln = loop_normals.get_pointer();
+  vsx_vector* bv = batch_vertices.get_pointer();
+  vsx_vector* bn = batch_normals.get_pointer();
+  double t_loop, t_batch;
+
+  VSX_TEST_TIME(t_loop, RUNS,
+    for (size_t i = 0; i < VERTEX_COUNT; i++)
+      lv[i].multiply_matrix_other_vec(transform.m, src[i])
+  );
+  VSX_TEST_TIME(t_batch, RUNS, vsx_vector_batch_transform(transform, src, bv, VERTEX_COUNT));
+  compare("transform", batch_vertices, loop_vertices, t_loop, t_batch);
+
+  VSX_TEST_TIME(t_loop, RUNS,
+    for (size_t i = 0; i < VERTEX_COUNT; i++)
+      lv[i].multiply_matrix_other_vec(rotation.m, src[i])
+  );
+  VSX_TEST_TIME(t_batch, RUNS, vsx_vector_batch_rotate(q, src, bv, VERTEX_COUNT));
+  compare("rotate", batch_vertices, loop_vertices, t_loop, t_batch);
+
+  // both streams in one pass, timed as a whole
+  VSX_TEST_TIME(t_loop, RUNS,
+    for (size_t i = 0; i < VERTEX_COUNT; i++)
+    {
+      lv[i].multiply_matrix_other_vec(rotation.m, src[i]);
+      ln[i].multiply_matrix_other_vec(rotation.m, nsrc[i]);
+    }
+  );
+  VSX_TEST_TIME(t_batch, RUNS, vsx_vector_batch_rotate(q, src, bv, VERTEX_COUNT, nsrc, bn));
+  VSX_TEST_CHECK(vsx_test_same_bits(bn, ln, sizeof(vsx_vector) * VERTEX_COUNT));
+  compare("rotate, with normals", batch_vertices, loop_vertices, t_loop, t_batch);
+
+  vsx_vector scale(2.0f, 0.5f, -1.5f);
+  vsx_vector offset(1.0f, 2.0f, 3.0f);
+  VSX_TEST_TIME(t_loop, RUNS,
+    for (size_t i = 0; i < VERTEX_COUNT; i++)
+    {
+      lv[i].x = src[i].x * scale.x + offset.x;
+      lv[i].y = src[i].y * scale.y + offset.y;
+      lv[i].z = src[i].z * scale.z + offset.z;
+    }
+  );
+  VSX_TEST_TIME(t_batch, RUNS, vsx_vector_batch_scale_offset(scale, offset, src, bv, VERTEX_COUNT));
+  compare("scale and offset", batch_vertices, loop_vertices, t_loop, t_batch);
+
+  // in place, dest == src, vertices and normals
+  memcpy(bv, src, sizeof(vsx_vector) * VERTEX_COUNT);
+  memcpy(bn, nsrc, sizeof(vsx_vector) * VERTEX_COUNT);
+  vsx_vector_batch_transform(rotation, bv, bv, VERTEX_COUNT, bn, bn);
+  for (size_t i = 0; i < VERTEX_COUNT; i++)
+  {
+    lv[i].multiply_matrix_other_vec(rotation.m, src[i]);
+    ln[i].multiply_matrix_other_vec(rotation.m, nsrc[i]);
+  }
+  VSX_TEST_CHECK(vsx_test_same_bits(bv, lv, sizeof(vsx_vector) * VERTEX_COUNT));
+  VSX_TEST_CHECK(vsx_test_same_bits(bn, ln, sizeof(vsx_vector) * VERTEX_COUNT));
+  memcpy(bv, src, sizeof(vsx_vector) * VERTEX_COUNT);
+  vsx_vector_batch_transform(transform, bv, bv, VERTEX_COUNT);
+  for (size_t i = 0; i < VERTEX_COUNT; i++)
+    lv[i].multiply_matrix_other_vec(transform.m, src[i]);
+  VSX_TEST_CHECK(vsx_test_same_bits(bv, lv, sizeof(vsx_vector) * VERTEX_COUNT));
+  memcpy(bv, src, sizeof(vsx_vector) * VERTEX_COUNT);
+  vsx_vector_batch_scale_offset(scale, offset, bv, bv, VERTEX_COUNT);
+  for (size_t i = 0; i < VERTEX_COUNT; i++)
+  {
+    lv[i].x = src[i].x * scale.x + offset.x;
+    lv[i].y = src[i].y * scale.y + offset.y;
+    lv[i].z = src[i].z * scale.z + offset.z;
+  }
+  VSX_TEST_CHECK(vsx_test_same_bits(bv, lv, sizeof(vsx_vector) * VERTEX_COUNT));
+
+  return vsx_test_result();
+}
@@ -0,0 +1,296 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "vsxl_expression.h"
+#include "vsx_test.h"
+
+// vsxl_expression, the native path for single expression param filters:
+// each operator and function against the same float math written out,
+// precedence and associativity, int constant folding, number literals,
+// and scripts it has to turn down (left to GameMonkey) without ever
+// becoming valid. Built when ENGINE_SCRIPTING is on.
+
+static char script[4096];
+
+static const char* filter(const char* expression)
+{
+  sprintf(script, "global vsxl_pf1 = function(x) { return %s; };", expression);
+  return script;
+}
+
+static bool check(const char* expression, float param, float time, float dtime, float expected)
+{
+  vsxl_expression e;
+  if (!e.compile(filter(expression), "vsxl_pf1") || !e.valid())
+  {
+    printf("doesn't compile: %s\n", expression);
+    return false;
+  }
+  float got = e.eval(param, time, dtime);
+  if (!vsx_test_same_bits(&got, &expected, sizeof(float)))
+  {
+    printf("%s: %.9g, expected %.9g\n", expression, got, expected);
+    return false;
+  }
+  return true;
+}
+
+static bool rejects(const char* s)
+{
+  static char rejected[4096];
+  strcpy(rejected, s);
+  vsxl_expression e;
+  // a compiled one first, a failed compile must not leave it valid
+  e.compile(filter("x"), "vsxl_pf1");
+  if (!e.valid() || e.compile(rejected, "vsxl_pf1") || e.valid())
+  {
+    printf("compiles: %s\n", rejected);
+    return false;
+  }
+  return true;
+}
+
+// x + x + ... left to right, count times
+static float repeated_sum(float x, int count)
+{
+  float sum = x;
+  for (int i = 1; i < count; i++)
+    sum += x;
+  return sum;
+}
+
+// one expression over a few inputs, against the C++ written the same way
+#define CHECK_EXPRESSION(expression, cpp) \
+  { \
+    float in[5] = {0.0f, 0.75f, -2.5f, 3.0f, 123.456f}; \
+    for (int vsx_i = 0; vsx_i < 5; vsx_i++) \
+    { \
+      float x = in[vsx_i]; \
+      float _time = 10.0f + x; \
+      float _dtime = 0.016f * (float)(vsx_i + 1); \
+      VSX_TEST_CHECK(check(expression, x, _time, _dtime, (float)(cpp))); \
+    } \
+  }
+
+static void test_operators()
+{
+  CHECK_EXPRESSION("x", x);
+  CHECK_EXPRESSION("_time", _time);
+  CHECK_EXPRESSION("_dtime", _dtime);
+  CHECK_EXPRESSION("x + 2.5", x + 2.5f);
+  CHECK_EXPRESSION("x - _time", x - _time);
+  CHECK_EXPRESSION("x * _dtime", x * _dtime);
+  CHECK_EXPRESSION("x / 4.0", x / 4.0f);
+  CHECK_EXPRESSION("_time % 3.0", fmodf(_time, 3.0f));
+  CHECK_EXPRESSION("-x", -x);
+  CHECK_EXPRESSION("+x", x);
+  CHECK_EXPRESSION("- -x", x);
+  CHECK_EXPRESSION("-(x - 1.0)", -(x - 1.0f));
+}
+
+static void test_precedence()
+{
+  CHECK_EXPRESSION("1.0 + x * 2.0", 1.0f + x * 2.0f);
+  CHECK_EXPRESSION("(1.0 + x) * 2.0", (1.0f + x) * 2.0f);
+  CHECK_EXPRESSION("x * 2.0 + 1.0", x * 2.0f + 1.0f);
+  CHECK_EXPRESSION("x - 1.0 - 2.0", (x - 1.0f) - 2.0f);
+  CHECK_EXPRESSION("x - (1.0 - 2.0)", x - (1.0f - 2.0f));
+  CHECK_EXPRESSION("x / 2.0 / 4.0", (x / 2.0f) / 4.0f);
+  CHECK_EXPRESSION("_time * 3.0 % 2.0", fmodf(_time * 3.0f, 2.0f));
+  CHECK_EXPRESSION("_time % 2.0 * 3.0", fmodf(_time, 2.0f) * 3.0f);
+  CHECK_EXPRESSION("-x * 2.0", (-x) * 2.0f);
+  CHECK_EXPRESSION("2.0 - -x", 2.0f - (-x));
+  CHECK_EXPRESSION("x + 2.0 * _time - _dtime / 4.0", (x + 2.0f * _time) - _dtime / 4.0f);
+  CHECK_EXPRESSION("((x))", x);
+  CHECK_EXPRESSION("sin(_time * 2.0) * 0.5 + 0.5", sinf(_time * 2.0f) * 0.5f + 0.5f);
+  CHECK_EXPRESSION("x * (x + (x * (x + 1.0)))", x * (x + (x * (x + 1.0f))));
+}
+
+static void test_functions()
+{
+  CHECK_EXPRESSION("abs(x)", fabsf(x));
+  CHECK_EXPRESSION("sqrt(_time)", sqrtf(_time));
+  CHECK_EXPRESSION("floor(x)", floorf(x));
+  CHECK_EXPRESSION("ceil(x)", ceilf(x));
+  CHECK_EXPRESSION("round(x)", floorf(x + 0.5f));
+  CHECK_EXPRESSION("degtorad(x)", x * (3.1415927f / 180.0f));
+  CHECK_EXPRESSION("radtodeg(x)", x * (180.0f / 3.1415927f));
+  CHECK_EXPRESSION("sin(x)", sinf(x));
+  CHECK_EXPRESSION("cos(x)", cosf(x));
+  CHECK_EXPRESSION("tan(x)", tanf(x));
+  CHECK_EXPRESSION("asin(_dtime)", asinf(_dtime));
+  CHECK_EXPRESSION("acos(_dtime)", acosf(_dtime));
+  CHECK_EXPRESSION("atan(x)", atanf(x));
+  CHECK_EXPRESSION("log(_time)", logf(_time));
+  CHECK_EXPRESSION("log(2.0, _time)", log10(_time) / log10(2.0f));
+  CHECK_EXPRESSION("power(x, 2.0)", pow(x, 2.0f));
+  CHECK_EXPRESSION("min(x, 1.0)", x < 1.0f ? x : 1.0f);
+  CHECK_EXPRESSION("max(x, 1.0)", x > 1.0f ? x : 1.0f);
+  CHECK_EXPRESSION("clamp(0.0, x, 1.0)", x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x));
+  CHECK_EXPRESSION("max(min(x, 2.0), -1.0) * cos(_time)", (x < 2.0f ? (x > -1.0f ? x : -1.0f) : 2.0f) * cosf(_time));
+}
+
+// GameMonkey does int math on ints; the float inputs make any int part
+// constant, compile() folds it
+static void test_int_folding()
+{
+  CHECK_EXPRESSION("x * (1 / 2)", x * 0.0f);
+  CHECK_EXPRESSION("x * (1.0 / 2)", x * 0.5f);
+  CHECK_EXPRESSION("x + 7 / 2", x + 3.0f);
+  CHECK_EXPRESSION("x + -7 / 2", x + -3.0f);
+  CHECK_EXPRESSION("x + 7 % 4", x + 3.0f);
+  CHECK_EXPRESSION("x + -7 % 4", x + -3.0f);
+  CHECK_EXPRESSION("x * 2 + 1", x * 2.0f + 1.0f);
+  CHECK_EXPRESSION("x + abs(-3)", x + 3.0f);
+  CHECK_EXPRESSION("x + sin(1)", x + sinf(1.0f));
+  CHECK_EXPRESSION("x + min(3, 2) * max(1, 4)", x + 8.0f);
+  CHECK_EXPRESSION("x + clamp(0, 5, 3)", x + 3.0f);
+  CHECK_EXPRESSION("x + 999999999 + 1", (x + 999999999.0f) + 1.0f);
+  // a float anywhere makes the folded part float
+  CHECK_EXPRESSION("x + 1 / 2 * 1.0", x + 0.0f);
+  CHECK_EXPRESSION("x + 1.0 * 1 / 2", x + 0.5f);
+  // a constant float return is fine
+  CHECK_EXPRESSION("1.5", 1.5f);
+  CHECK_EXPRESSION("3 / 2.0", 1.5f);
+}
+
+static void test_literals()
+{
+  CHECK_EXPRESSION("x + .5", x + 0.5f);
+  CHECK_EXPRESSION("x + 5.", x + 5.0f);
+  CHECK_EXPRESSION("x * 1e2", x * 100.0f);
+  CHECK_EXPRESSION("x * 1.5e-1", x * 0.15f);
+  CHECK_EXPRESSION("x * 2E+1", x * 20.0f);
+  CHECK_EXPRESSION("x * 2.5f", x * 2.5f);
+  CHECK_EXPRESSION("x + 0.1", x + 0.1f);
+
+  // whitespace, comments and another param name
+  vsxl_expression e;
+  VSX_TEST_CHECK(e.compile(
+    "// scaled\r\n"
+    "global\tvsxl_pf7 =\nfunction( value )\n{\n"
+    "  /* twice */ return value * 2.0; // done\n"
+    "};\n",
+    "vsxl_pf7"
+  ));
+  VSX_TEST_CHECK(e.eval(1.25f, 0.0f, 0.0f) == 2.5f);
+  // an open comment runs to the end, as in gmScanner
+  VSX_TEST_CHECK(e.compile("global vsxl_pf7 = function(v) { return v + 1.0; }; /* open", "vsxl_pf7"));
+  VSX_TEST_CHECK(e.eval(1.25f, 0.0f, 0.0f) == 2.25f);
+}
+
+static void test_malformed()
+{
+  VSX_TEST_CHECK(rejects(""));
+  VSX_TEST_CHECK(rejects("   "));
+  VSX_TEST_CHECK(rejects(filter("")));
+  VSX_TEST_CHECK(rejects(filter("(x + 1.0")));
+  VSX_TEST_CHECK(rejects(filter("x + 1.0)")));
+  VSX_TEST_CHECK(rejects(filter("x +")));
+  VSX_TEST_CHECK(rejects(filter("* x")));
+  VSX_TEST_CHECK(rejects(filter("x 1.0")));
+  VSX_TEST_CHECK(rejects(filter("()")));
+  // not arithmetic
+  VSX_TEST_CHECK(rejects(filter("y")));
+  VSX_TEST_CHECK(rejects(filter("x ^ 2.0")));
+  VSX_TEST_CHECK(rejects(filter("x == 1.0")));
+  VSX_TEST_CHECK(rejects(filter("x < 1.0")));
+  VSX_TEST_CHECK(rejects(filter("\"x\"")));
+  VSX_TEST_CHECK(rejects(filter("x.y")));
+  VSX_TEST_CHECK(rejects(filter("x[0]")));
+  VSX_TEST_CHECK(rejects(filter("x(1.0)")));
+  VSX_TEST_CHECK(rejects(filter("randint(0, 10)")));
+  VSX_TEST_CHECK(rejects(filter("foo(x)")));
+  // wrong argument counts
+  VSX_TEST_CHECK(rejects(filter("sin()")));
+  VSX_TEST_CHECK(rejects(filter("sin(x, x)")));
+  VSX_TEST_CHECK(rejects(filter("min(x)")));
+  VSX_TEST_CHECK(rejects(filter("clamp(x, x)")));
+  VSX_TEST_CHECK(rejects(filter("clamp(x, x, x, x)")));
+  VSX_TEST_CHECK(rejects(filter("sin(x,)")));
+  // numbers the scanner doesn't take
+  VSX_TEST_CHECK(rejects(filter("x + 0x10")));
+  VSX_TEST_CHECK(rejects(filter("x + 1.2.3")));
+  VSX_TEST_CHECK(rejects(filter("x + 5f")));
+  VSX_TEST_CHECK(rejects(filter("x + 12abc")));
+  VSX_TEST_CHECK(rejects(filter("x + 1234567890")));
+  // int math GameMonkey would crash on, and int results
+  VSX_TEST_CHECK(rejects(filter("x + 1 / 0")));
+  VSX_TEST_CHECK(rejects(filter("x + 1 % 0")));
+  VSX_TEST_CHECK(rejects(filter("x + abs(-2147483647 - 1)")));
+  VSX_TEST_CHECK(rejects(filter("3")));
+  VSX_TEST_CHECK(rejects(filter("1 + 2 * 3")));
+  // not the single statement filter
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x) { return x; }"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x) { return x };"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x) { return x; }; global a = 1;"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x) { a = x; return a; };"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x, y) { return x; };"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function() { return 1.0; };"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf2 = function(x) { return x; };"));
+  VSX_TEST_CHECK(rejects("vsxl_pf1 = function(x) { return x; };"));
+  VSX_TEST_CHECK(rejects("global vsxl_pf1 = function(x) { return x; }; #"));
+
+  // too deep, too many nodes, too much code
+  char deep[256] = "";
+  for (int i = 0; i < 40; i++)
+    strcat(deep, "(");
+  strcat(deep, "x");
+  for (int i = 0; i < 40; i++)
+    strcat(deep, ")");
+  VSX_TEST_CHECK(rejects(filter(deep)));
+  char negated[256] = "";
+  for (int i = 0; i < 40; i++)
+    strcat(negated, "-");
+  strcat(negated, "x");
+  VSX_TEST_CHECK(rejects(filter(negated)));
+  char long_sum[2048] = "x";
+  for (int i = 0; i < 100; i++)
+    strcat(long_sum, " + x");
+  VSX_TEST_CHECK(rejects(filter(long_sum)));
+  char long_constants[2048] = "x";
+  for (int i = 0; i < 70; i++)
+    sprintf(long_constants + strlen(long_constants), " * %d.5", i);
+  VSX_TEST_CHECK(rejects(filter(long_constants)));
+
+  // and something just within the limits still works
+  char sum[512] = "x";
+  for (int i = 0; i < 30; i++)
+    strcat(sum, " + x");
+  CHECK_EXPRESSION(sum, repeated_sum(x, 31));
+}
+
+int main()
+{
+  test_operators();
+  test_precedence();
+  test_functions();
+  test_int_folding();
+  test_literals();
+  test_malformed();
+  return vsx_test_result();
+}
@@ -0,0 +1,101 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_DXT_H
+#define VSX_DXT_H
+
+#include <stddef.h>
+#include <vsx_string.h>
+#include <vsx_bitmap.h>
+
+#if PLATFORM_FAMILY == PLATFORM_FAMILY_UNIX
+  #define VSX_DXT_DLLIMPORT
+#else
+  #if defined(VSX_ENG_DLL)
+    #define VSX_DXT_DLLIMPORT __declspec (dllexport)
+  #else
+    #define VSX_DXT_DLLIMPORT __declspec (dllimport)
+  #endif
+#endif
+
+// CPU block compression of 8 bit bitmaps to DXT1 (rgb) / DXT5 (rgba).
+//
+// Compressed bitmaps take a quarter (DXT5) or an eighth (DXT1, from rgba)
+// of the memory and upload bandwidth. A compressed vsx_bitmap has bpp and
+// bformat set to the GL compressed format and its data holds the whole
+// mipmap chain, level 0 first, down to 1x1; vsx_texture::upload_ram_bitmap
+// uploads those directly.
+//
+// Encoding splits the block rows over the engine thread pool, call it from
+// a job or the render thread as suits; it's pure CPU work.
+//
+// The optional disk cache stores compressed chains under a hash of
+// whatever identifies the source (typically the file contents), so
+// reloading a state skips both decoding and compressing.
+
+#define VSX_DXT_NONE 0
+#define VSX_DXT1 1
+#define VSX_DXT5 5
+
+typedef unsigned long long vsx_dxt_hash_t;
+
+// bytes of one level
+VSX_DXT_DLLIMPORT size_t vsx_dxt_level_size(unsigned long size_x, unsigned long size_y, int format);
+
+// bytes of a full chain, level 0 down to 1x1
+VSX_DXT_DLLIMPORT size_t vsx_dxt_chain_size(unsigned long size_x, unsigned long size_y, int format);
+
+// number of levels in a full chain
+VSX_DXT_DLLIMPORT int vsx_dxt_levels(unsigned long size_x, unsigned long size_y);
+
+// Compresses one level. data is bpp (3 or 4) bytes per pixel, rgb(a)
+// order; out needs vsx_dxt_level_size() bytes.
+VSX_DXT_DLLIMPORT void vsx_dxt_compress(
+  const unsigned char* data,
+  unsigned long size_x,
+  unsigned long size_y,
+  int bpp,
+  int format,
+  unsigned char* out
+);
+
+// Compresses an 8 bit GL_RGB / GL_RGBA bitmap with all its mipmaps into
+// dest (data malloc'ed, free it with free()). format VSX_DXT_NONE picks
+// DXT1 for rgb and DXT5 for rgba. Returns false for bitmaps it can't
+// handle (float, empty), dest is untouched then.
+VSX_DXT_DLLIMPORT bool vsx_dxt_compress_bitmap(vsx_bitmap* source, vsx_bitmap* dest, int format = VSX_DXT_NONE);
+
+// true if bitmap holds compressed data
+VSX_DXT_DLLIMPORT bool vsx_dxt_is_compressed(vsx_bitmap* bitmap);
+
+// FNV-1a, chain it by passing the previous result as seed
+VSX_DXT_DLLIMPORT vsx_dxt_hash_t vsx_dxt_hash(const void* data, size_t bytes, vsx_dxt_hash_t seed = 14695981039346656037ULL);
+
+// Disk cache, in <data path>/texture_cache. load fills dest like
+// vsx_dxt_compress_bitmap and returns false on a miss; entries from an
+// older layout, cut short or not matching their stored hash count as
+// misses. store is best effort. Both are safe to call from any thread.
+VSX_DXT_DLLIMPORT bool vsx_dxt_cache_load(vsx_dxt_hash_t key, vsx_bitmap* dest);
+VSX_DXT_DLLIMPORT void vsx_dxt_cache_store(vsx_dxt_hash_t key, vsx_bitmap* source);
+
+#endif
@@ -0,0 +1,144 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_IMAGE_LOADER_H
+#define VSX_IMAGE_LOADER_H
+
+#include <map>
+#include <pthread.h>
+#include <vsx_string.h>
+#include <vsx_bitmap.h>
+#include <vsxfst.h>
+#include <vsx_dxt.h>
+
+#if PLATFORM_FAMILY == PLATFORM_FAMILY_UNIX
+  #define VSX_IMAGE_LOADER_DLLIMPORT
+#else
+  #if defined(VSX_ENG_DLL)
+    #define VSX_IMAGE_LOADER_DLLIMPORT __declspec (dllexport)
+  #else
+    #define VSX_IMAGE_LOADER_DLLIMPORT __declspec (dllimport)
+  #endif
+#endif
+
+// Shared image decoding.
+//
+// Decodes run as jobs on the engine thread pool instead of a thread per
+// load, and requests for the same file (same filesystem, filename and
+// options) while an earlier decode is still around get that same image,
+// so a state using one texture in ten modules decodes it once.
+//
+// Images are reference counted: request() hands out a reference, release()
+// gives it back and the pixel data is freed when the last one is gone.
+// Hold on to the image for as long as the bitmap is used, typically until
+// it's been uploaded.
+//
+// Usage:
+//   vsx_image* image = vsx_image_loader::get_instance()->request(filesystem, "a.png", VSX_IMAGE_PNG);
+//   ... every frame:
+//   if (image->state == VSX_IMAGE_STATE_DONE) upload(&image->bitmap)
+//   ... when done with it:
+//   vsx_image_loader::get_instance()->release(image);
+//
+// With compression set (VSX_DXT1 / VSX_DXT5 / VSX_DXT_NONE for auto, see
+// vsx_dxt.h) the bitmap comes out block compressed with its mipmaps, and
+// the result is kept in the dxt disk cache keyed by the file contents so
+// the next load skips decoding and compressing.
+
+#define VSX_IMAGE_PNG 0
+#define VSX_IMAGE_JPEG 1
+#define VSX_IMAGE_JPEG_ALPHA 2 // alpha channel taken from a second jpeg
+
+#define VSX_IMAGE_STATE_LOADING 0
+#define VSX_IMAGE_STATE_DONE 1
+#define VSX_IMAGE_STATE_FAILED 2
+
+#define VSX_IMAGE_COMPRESSION_OFF -1
+
+class vsx_image
+{
+public:
+  // bpp / bformat are set like the loader modules always did: GL_RGB for
+  // 1 and 3 component images, GL_RGBA for 2 and 4. Read only once state
+  // is DONE, owned by the image.
+  vsx_bitmap bitmap;
+  // error text when state is FAILED
+  vsx_string error;
+  volatile int state;
+
+  // internal
+  vsx_string key;
+  vsxf* filesystem; // 0 = plain filesystem
+  vsx_string filename;
+  vsx_string alpha_filename;
+  int type;
+  int compression;
+  int references;
+  bool decoding;
+  bool in_cache;
+
+  vsx_image()
+  {
+    state = VSX_IMAGE_STATE_LOADING;
+    filesystem = 0;
+    type = VSX_IMAGE_PNG;
+    compression = VSX_IMAGE_COMPRESSION_OFF;
+    references = 0;
+    decoding = false;
+    in_cache = false;
+    bitmap.data = 0;
+  }
+};
+
+class vsx_image_loader
+{
+  pthread_mutex_t mutex;
+  std::map<vsx_string, vsx_image*> cache;
+
+  vsx_image_loader();
+  static void create_instance();
+  static void decode_job(void* arg);
+  void decode(vsx_image* image);
+  bool load_compressed(vsx_image* image, vsxf* filesystem, vsx_dxt_hash_t& key);
+  void destroy(vsx_image* image);
+
+public:
+  VSX_IMAGE_LOADER_DLLIMPORT static vsx_image_loader* get_instance();
+
+  // Returns a referenced image, shared with anyone else who asked for the
+  // same thing and hasn't released it yet. reload forces a fresh decode
+  // (the file changed), others holding the old image keep it.
+  // compression is VSX_IMAGE_COMPRESSION_OFF or a vsx_dxt format.
+  VSX_IMAGE_LOADER_DLLIMPORT vsx_image* request(
+    vsxf* filesystem,
+    vsx_string filename,
+    int type,
+    vsx_string alpha_filename = "",
+    bool reload = false,
+    int compression = VSX_IMAGE_COMPRESSION_OFF
+  );
+
+  VSX_IMAGE_LOADER_DLLIMPORT void release(vsx_image* image);
+};
+
+#endif
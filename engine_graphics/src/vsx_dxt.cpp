@@ -0,0 +1,516 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#include <vsx_gl_global.h>
+#include <vsx_thread_pool.h>
+#include <vsxfst.h>
+#include <vsx_dxt.h>
+
+// bump the number when the file layout or the encoder output changes, so
+// older entries are treated as misses
+#define VSX_DXT_CACHE_MAGIC "VSXDXT02"
+
+// magic, size_x, size_y, format, then the hash of the chain
+#define VSX_DXT_CACHE_HEADER 28
+
+static int gl_format(int format)
+{
+  return format == VSX_DXT1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+size_t vsx_dxt_level_size(unsigned long size_x, unsigned long size_y, int format)
+{
+  size_t blocks = (size_t)((size_x + 3) / 4) * ((size_y + 3) / 4);
+  return blocks * (format == VSX_DXT1 ? 8 : 16);
+}
+
+int vsx_dxt_levels(unsigned long size_x, unsigned long size_y)
+{
+  int levels = 1;
+  while (size_x > 1 || size_y > 1)
+  {
+    size_x = size_x > 1 ? size_x / 2 : 1;
+    size_y = size_y > 1 ? size_y / 2 : 1;
+    levels++;
+  }
+  return levels;
+}
+
+size_t vsx_dxt_chain_size(unsigned long size_x, unsigned long size_y, int format)
+{
+  size_t total = 0;
+  int levels = vsx_dxt_levels(size_x, size_y);
+  for (int i = 0; i < levels; i++)
+  {
+    total += vsx_dxt_level_size(size_x, size_y, format);
+    size_x = size_x > 1 ? size_x / 2 : 1;
+    size_y = size_y > 1 ? size_y / 2 : 1;
+  }
+  return total;
+}
+
+bool vsx_dxt_is_compressed(vsx_bitmap* bitmap)
+{
+  return
+    bitmap->bpp == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+    bitmap->bpp == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// --- block encoding ----------------------------------------------------------
+
+static unsigned short pack565(const float* c)
+{
+  int r = (int)(c[0] * (31.0f / 255.0f) + 0.5f);
+  int g = (int)(c[1] * (63.0f / 255.0f) + 0.5f);
+  int b = (int)(c[2] * (31.0f / 255.0f) + 0.5f);
+  r = r < 0 ? 0 : r > 31 ? 31 : r;
+  g = g < 0 ? 0 : g > 63 ? 63 : g;
+  b = b < 0 ? 0 : b > 31 ? 31 : b;
+  return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+static void unpack565(unsigned short v, int* c)
+{
+  int r = v >> 11;
+  int g = (v >> 5) & 63;
+  int b = v & 31;
+  c[0] = r << 3 | r >> 2;
+  c[1] = g << 2 | g >> 4;
+  c[2] = b << 3 | b >> 2;
+}
+
+// endpoints on the principal axis of the colors, then nearest palette entry
+static void encode_color_block(unsigned char block[16][4], unsigned char* out)
+{
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 3; c++)
+      mean[c] += block[i][c];
+  for (int c = 0; c < 3; c++)
+    mean[c] *= 1.0f / 16.0f;
+
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; i++)
+  {
+    float r = block[i][0] - mean[0];
+    float g = block[i][1] - mean[1];
+    float b = block[i][2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // a few rounds of power iteration find the dominant axis well enough
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for (int k = 0; k < 6; k++)
+  {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float len = (float)sqrt(x * x + y * y + z * z);
+    if (len < 1e-6f)
+      break;
+    axis[0] = x / len;
+    axis[1] = y / len;
+    axis[2] = z / len;
+  }
+
+  float t_min = 1e9f, t_max = -1e9f;
+  for (int i = 0; i < 16; i++)
+  {
+    float t =
+      (block[i][0] - mean[0]) * axis[0] +
+      (block[i][1] - mean[1]) * axis[1] +
+      (block[i][2] - mean[2]) * axis[2];
+    if (t < t_min) t_min = t;
+    if (t > t_max) t_max = t;
+  }
+  // pull the ends in a little, the extremes are rarely worth a full entry
+  float inset = (t_max - t_min) / 16.0f;
+  t_min += inset;
+  t_max -= inset;
+
+  float e0[3], e1[3];
+  for (int c = 0; c < 3; c++)
+  {
+    e0[c] = mean[c] + axis[c] * t_max;
+    e1[c] = mean[c] + axis[c] * t_min;
+  }
+  unsigned short c0 = pack565(e0);
+  unsigned short c1 = pack565(e1);
+  if (c0 < c1)
+  {
+    unsigned short t = c0;
+    c0 = c1;
+    c1 = t;
+  }
+
+  unsigned int indices = 0;
+  if (c0 != c1)
+  {
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0;
+      int best_d = 1 << 30;
+      for (int p = 0; p < 4; p++)
+      {
+        int dr = block[i][0] - palette[p][0];
+        int dg = block[i][1] - palette[p][1];
+        int db = block[i][2] - palette[p][2];
+        int d = dr * dr + dg * dg + db * db;
+        if (d < best_d)
+        {
+          best_d = d;
+          best = p;
+        }
+      }
+      indices |= (unsigned int)best << (i * 2);
+    }
+  }
+
+  out[0] = (unsigned char)(c0 & 0xFF);
+  out[1] = (unsigned char)(c0 >> 8);
+  out[2] = (unsigned char)(c1 & 0xFF);
+  out[3] = (unsigned char)(c1 >> 8);
+  out[4] = (unsigned char)(indices & 0xFF);
+  out[5] = (unsigned char)((indices >> 8) & 0xFF);
+  out[6] = (unsigned char)((indices >> 16) & 0xFF);
+  out[7] = (unsigned char)(indices >> 24);
+}
+
+// 8 level mode between min and max alpha
+static void encode_alpha_block(unsigned char block[16][4], unsigned char* out)
+{
+  int a0 = 0, a1 = 255;
+  for (int i = 0; i < 16; i++)
+  {
+    if (block[i][3] > a0) a0 = block[i][3];
+    if (block[i][3] < a1) a1 = block[i][3];
+  }
+  out[0] = (unsigned char)a0;
+  out[1] = (unsigned char)a1;
+
+  unsigned long long bits = 0;
+  if (a0 != a1)
+  {
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    for (int k = 2; k < 8; k++)
+      palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+    for (int i = 0; i < 16; i++)
+    {
+      int best = 0;
+      int best_d = 256;
+      for (int k = 0; k < 8; k++)
+      {
+        int d = abs(block[i][3] - palette[k]);
+        if (d < best_d)
+        {
+          best_d = d;
+          best = k;
+        }
+      }
+      bits |= (unsigned long long)best << (i * 3);
+    }
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = (unsigned char)((bits >> (i * 8)) & 0xFF);
+}
+
+struct dxt_job
+{
+  const unsigned char* data;
+  unsigned long size_x;
+  unsigned long size_y;
+  int bpp;
+  int format;
+  unsigned char* out;
+};
+
+static void compress_block_rows(void* arg, size_t start, size_t end)
+{
+  dxt_job* j = (dxt_job*)arg;
+  unsigned long blocks_x = (j->size_x + 3) / 4;
+  size_t block_bytes = j->format == VSX_DXT1 ? 8 : 16;
+  unsigned char block[16][4];
+  for (size_t by = start; by < end; by++)
+  {
+    unsigned char* out = j->out + by * blocks_x * block_bytes;
+    for (unsigned long bx = 0; bx < blocks_x; bx++)
+    {
+      // edge blocks repeat the last row / column
+      for (int y = 0; y < 4; y++)
+      {
+        unsigned long py = by * 4 + y;
+        if (py >= j->size_y) py = j->size_y - 1;
+        for (int x = 0; x < 4; x++)
+        {
+          unsigned long px = bx * 4 + x;
+          if (px >= j->size_x) px = j->size_x - 1;
+          const unsigned char* p = j->data + (py * j->size_x + px) * j->bpp;
+          block[y * 4 + x][0] = p[0];
+          block[y * 4 + x][1] = p[1];
+          block[y * 4 + x][2] = p[2];
+          block[y * 4 + x][3] = j->bpp == 4 ? p[3] : 255;
+        }
+      }
+      if (j->format == VSX_DXT5)
+      {
+        encode_alpha_block(block, out);
+        out += 8;
+      }
+      encode_color_block(block, out);
+      out += 8;
+    }
+  }
+}
+
+void vsx_dxt_compress(const unsigned char* data, unsigned long size_x, unsigned long size_y, int bpp, int format, unsigned char* out)
+{
+  if (!size_x || !size_y)
+    return;
+  dxt_job j;
+  j.data = data;
+  j.size_x = size_x;
+  j.size_y = size_y;
+  j.bpp = bpp;
+  j.format = format;
+  j.out = out;
+  vsx_thread_pool::get_instance()->parallel_for((size_y + 3) / 4, 8, &compress_block_rows, (void*)&j);
+}
+
+// 2x2 box filter, odd edges repeat
+static unsigned char* downsample(const unsigned char* src, unsigned long size_x, unsigned long size_y, int bpp)
+{
+  unsigned long nx = size_x > 1 ? size_x / 2 : 1;
+  unsigned long ny = size_y > 1 ? size_y / 2 : 1;
+  unsigned char* dst = (unsigned char*)malloc(nx * ny * bpp);
+  for (unsigned long y = 0; y < ny; y++)
+  {
+    unsigned long y0 = y * 2;
+    unsigned long y1 = y0 + 1 < size_y ? y0 + 1 : y0;
+    for (unsigned long x = 0; x < nx; x++)
+    {
+      unsigned long x0 = x * 2;
+      unsigned long x1 = x0 + 1 < size_x ? x0 + 1 : x0;
+      for (int c = 0; c < bpp; c++)
+      {
+        int sum =
+          src[(y0 * size_x + x0) * bpp + c] +
+          src[(y0 * size_x + x1) * bpp + c] +
+          src[(y1 * size_x + x0) * bpp + c] +
+          src[(y1 * size_x + x1) * bpp + c];
+        dst[(y * nx + x) * bpp + c] = (unsigned char)((sum + 2) >> 2);
+      }
+    }
+  }
+  return dst;
+}
+
+bool vsx_dxt_compress_bitmap(vsx_bitmap* source, vsx_bitmap* dest, int format)
+{
+  if (!source->data || !source->size_x || !source->size_y)
+    return false;
+  if (source->bpp != 3 && source->bpp != 4)
+    return false;
+  if (format == VSX_DXT_NONE)
+    format = source->bpp == 4 ? VSX_DXT5 : VSX_DXT1;
+
+  unsigned long size_x = source->size_x;
+  unsigned long size_y = source->size_y;
+  int bpp = source->bpp;
+  unsigned char* chain = (unsigned char*)malloc(vsx_dxt_chain_size(size_x, size_y, format));
+  unsigned char* out = chain;
+  const unsigned char* level = (const unsigned char*)source->data;
+  unsigned char* owned = 0;
+  int levels = vsx_dxt_levels(size_x, size_y);
+  for (int i = 0; i < levels; i++)
+  {
+    vsx_dxt_compress(level, size_x, size_y, bpp, format, out);
+    out += vsx_dxt_level_size(size_x, size_y, format);
+    if (i == levels - 1)
+      break;
+    unsigned char* next = downsample(level, size_x, size_y, bpp);
+    free(owned);
+    owned = next;
+    level = next;
+    size_x = size_x > 1 ? size_x / 2 : 1;
+    size_y = size_y > 1 ? size_y / 2 : 1;
+  }
+  free(owned);
+
+  dest->data = chain;
+  dest->size_x = source->size_x;
+  dest->size_y = source->size_y;
+  dest->bpp = gl_format(format);
+  dest->bformat = gl_format(format);
+  dest->valid = true;
+  return true;
+}
+
+vsx_dxt_hash_t vsx_dxt_hash(const void* data, size_t bytes, vsx_dxt_hash_t seed)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  vsx_dxt_hash_t h = seed;
+  for (size_t i = 0; i < bytes; i++)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// --- disk cache --------------------------------------------------------------
+
+static vsx_string cache_filename(vsx_dxt_hash_t key)
+{
+  vsx_string dir = vsx_get_data_path() + "texture_cache/";
+#if defined(_WIN32)
+  CreateDirectory(dir.c_str(), NULL);
+#else
+  mkdir(dir.c_str(), 0700);
+#endif
+  char name[32];
+  sprintf(name, "%016llx.dxt", key);
+  return dir + name;
+}
+
+static void write_u32(unsigned char* p, unsigned long v)
+{
+  p[0] = (unsigned char)(v & 0xFF);
+  p[1] = (unsigned char)((v >> 8) & 0xFF);
+  p[2] = (unsigned char)((v >> 16) & 0xFF);
+  p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
+static unsigned long read_u32(const unsigned char* p)
+{
+  return (unsigned long)p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static void write_u64(unsigned char* p, vsx_dxt_hash_t v)
+{
+  write_u32(p, (unsigned long)(v & 0xFFFFFFFFULL));
+  write_u32(p + 4, (unsigned long)(v >> 32));
+}
+
+static vsx_dxt_hash_t read_u64(const unsigned char* p)
+{
+  return (vsx_dxt_hash_t)read_u32(p) | (vsx_dxt_hash_t)read_u32(p + 4) << 32;
+}
+
+bool vsx_dxt_cache_load(vsx_dxt_hash_t key, vsx_bitmap* dest)
+{
+  FILE* fp = fopen(cache_filename(key).c_str(), "rb");
+  if (!fp)
+    return false;
+
+  unsigned char header[VSX_DXT_CACHE_HEADER];
+  bool ok = fread(header, 1, VSX_DXT_CACHE_HEADER, fp) == VSX_DXT_CACHE_HEADER && memcmp(header, VSX_DXT_CACHE_MAGIC, 8) == 0;
+  unsigned long size_x = ok ? read_u32(&header[8]) : 0;
+  unsigned long size_y = ok ? read_u32(&header[12]) : 0;
+  int format = ok ? (int)read_u32(&header[16]) : 0;
+  ok = ok && size_x && size_y && size_x <= 16384 && size_y <= 16384 && (format == VSX_DXT1 || format == VSX_DXT5);
+  if (!ok)
+  {
+    fclose(fp);
+    return false;
+  }
+
+  size_t bytes = vsx_dxt_chain_size(size_x, size_y, format);
+  unsigned char* chain = (unsigned char*)malloc(bytes);
+  // truncated, too long or damaged: a miss, the next store replaces it
+  ok =
+    fread(chain, 1, bytes, fp) == bytes &&
+    fgetc(fp) == EOF &&
+    vsx_dxt_hash(chain, bytes) == read_u64(&header[20]);
+  if (!ok)
+  {
+    free(chain);
+    fclose(fp);
+    return false;
+  }
+  fclose(fp);
+
+  dest->data = chain;
+  dest->size_x = size_x;
+  dest->size_y = size_y;
+  dest->bpp = gl_format(format);
+  dest->bformat = gl_format(format);
+  dest->valid = true;
+  return true;
+}
+
+void vsx_dxt_cache_store(vsx_dxt_hash_t key, vsx_bitmap* source)
+{
+  if (!vsx_dxt_is_compressed(source) || !source->data)
+    return;
+  int format = source->bpp == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? VSX_DXT1 : VSX_DXT5;
+  vsx_string filename = cache_filename(key);
+
+  // written aside and renamed so readers never see half a file
+  char suffix[32];
+  sprintf(suffix, ".%p.tmp", (void*)source);
+  vsx_string temp = filename + suffix;
+  FILE* fp = fopen(temp.c_str(), "wb");
+  if (!fp)
+    return;
+
+  size_t bytes = vsx_dxt_chain_size(source->size_x, source->size_y, format);
+  unsigned char header[VSX_DXT_CACHE_HEADER];
+  memcpy(header, VSX_DXT_CACHE_MAGIC, 8);
+  write_u32(&header[8], source->size_x);
+  write_u32(&header[12], source->size_y);
+  write_u32(&header[16], (unsigned long)format);
+  write_u64(&header[20], vsx_dxt_hash(source->data, bytes));
+  bool ok =
+    fwrite(header, 1, VSX_DXT_CACHE_HEADER, fp) == VSX_DXT_CACHE_HEADER &&
+    fwrite(source->data, 1, bytes, fp) == bytes;
+  fclose(fp);
+  if (ok)
+  {
+#if defined(_WIN32)
+    remove(filename.c_str());
+#endif
+    ok = rename(temp.c_str(), filename.c_str()) == 0;
+  }
+  if (!ok)
+    remove(temp.c_str());
+}
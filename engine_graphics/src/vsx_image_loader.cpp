@@ -0,0 +1,277 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vsx_gl_global.h>
+#include <vsxg.h>
+#include <vsx_thread_pool.h>
+#include <vsx_image_loader.h>
+
+static vsx_image_loader* loader_instance = 0;
+static pthread_once_t loader_once = PTHREAD_ONCE_INIT;
+
+vsx_image_loader::vsx_image_loader()
+{
+  pthread_mutex_init(&mutex, NULL);
+}
+
+void vsx_image_loader::create_instance()
+{
+  loader_instance = new vsx_image_loader();
+}
+
+vsx_image_loader* vsx_image_loader::get_instance()
+{
+  pthread_once(&loader_once, &vsx_image_loader::create_instance);
+  return loader_instance;
+}
+
+vsx_image* vsx_image_loader::request(vsxf* filesystem, vsx_string filename, int type, vsx_string alpha_filename, bool reload, int compression)
+{
+  char prefix[64];
+  sprintf(prefix, "%p|%d|%d|", (void*)filesystem, type, compression);
+  vsx_string key = vsx_string(prefix) + filename + "|" + alpha_filename;
+
+  pthread_mutex_lock(&mutex);
+  std::map<vsx_string, vsx_image*>::iterator it = cache.find(key);
+  if (it != cache.end())
+  {
+    vsx_image* image = (*it).second;
+    if (!reload)
+    {
+      image->references++;
+      pthread_mutex_unlock(&mutex);
+      return image;
+    }
+    // whoever has the old one keeps it, it's just not handed out anymore
+    image->in_cache = false;
+    cache.erase(it);
+  }
+
+  vsx_image* image = new vsx_image;
+  image->key = key;
+  image->filesystem = filesystem;
+  image->filename = filename;
+  image->alpha_filename = alpha_filename;
+  image->type = type;
+  image->compression = compression;
+  image->references = 1;
+  image->decoding = true;
+  image->in_cache = true;
+  cache[key] = image;
+  pthread_mutex_unlock(&mutex);
+
+  vsx_thread_pool::get_instance()->add_job(&decode_job, (void*)image);
+  return image;
+}
+
+void vsx_image_loader::release(vsx_image* image)
+{
+  if (!image) return;
+  pthread_mutex_lock(&mutex);
+  image->references--;
+  if (image->references == 0)
+  {
+    if (image->in_cache)
+    {
+      cache.erase(image->key);
+      image->in_cache = false;
+    }
+    // a decode still running cleans up after itself
+    if (!image->decoding)
+      destroy(image);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void vsx_image_loader::destroy(vsx_image* image)
+{
+  free(image->bitmap.data);
+  delete image;
+}
+
+void vsx_image_loader::decode_job(void* arg)
+{
+  vsx_image* image = (vsx_image*)arg;
+  vsx_image_loader* loader = get_instance();
+
+  // nobody wants it anymore, don't bother
+  pthread_mutex_lock(&loader->mutex);
+  bool wanted = image->references > 0;
+  pthread_mutex_unlock(&loader->mutex);
+  if (wanted)
+    loader->decode(image);
+
+  pthread_mutex_lock(&loader->mutex);
+  image->decoding = false;
+  if (image->references == 0)
+    loader->destroy(image);
+  pthread_mutex_unlock(&loader->mutex);
+}
+
+// packs 3 byte rgb (plus an optional alpha source) to 32 bit pixels
+static vsx_bitmap_32bt* jpeg_to_32bt(unsigned char* rgb, unsigned char* alpha, unsigned long count)
+{
+  vsx_bitmap_32bt* data = (vsx_bitmap_32bt*)malloc(sizeof(vsx_bitmap_32bt) * count);
+  for (unsigned long i = 0; i < count; ++i)
+  {
+    data[i] =
+        (alpha ? alpha[i*3] << 24 : 0xFF000000) |
+        rgb[i*3+2] << 16 |
+        rgb[i*3+1] << 8 |
+        rgb[i*3];
+  }
+  return data;
+}
+
+// hashes a file's contents into key, false if it can't be read
+static bool hash_file(vsxf* filesystem, vsx_string filename, vsx_dxt_hash_t& key)
+{
+  vsxf_handle* fp = filesystem->f_open(filename.c_str(), "rb");
+  if (!fp)
+    return false;
+  unsigned long size = filesystem->f_get_size(fp);
+  char* buf = filesystem->f_gets_entire(fp);
+  filesystem->f_close(fp);
+  key = vsx_dxt_hash(&size, sizeof(size), key);
+  key = vsx_dxt_hash(buf, size, key);
+  free(buf);
+  return true;
+}
+
+// Looks the image up in the dxt cache. Always fills in key, the cache
+// key to store the result under, 0 if the source couldn't be hashed.
+bool vsx_image_loader::load_compressed(vsx_image* image, vsxf* filesystem, vsx_dxt_hash_t& key)
+{
+  int header[2];
+  header[0] = image->type;
+  header[1] = image->compression;
+  key = vsx_dxt_hash(header, sizeof(header));
+  bool ok = hash_file(filesystem, image->filename, key);
+  if (ok && image->type == VSX_IMAGE_JPEG_ALPHA && image->alpha_filename != "")
+    ok = hash_file(filesystem, image->alpha_filename, key);
+  if (!ok)
+  {
+    key = 0;
+    return false;
+  }
+  return vsx_dxt_cache_load(key, &image->bitmap);
+}
+
+void vsx_image_loader::decode(vsx_image* image)
+{
+  vsxf* i_filesystem = 0x0;
+  vsxf* filesystem = image->filesystem;
+  if (filesystem == 0x0)
+  {
+    i_filesystem = new vsxf;
+    filesystem = i_filesystem;
+  }
+
+  vsx_bitmap& bitm = image->bitmap;
+  int state = VSX_IMAGE_STATE_FAILED;
+  vsx_dxt_hash_t cache_key = 0;
+
+  if (image->compression != VSX_IMAGE_COMPRESSION_OFF && load_compressed(image, filesystem, cache_key))
+    state = VSX_IMAGE_STATE_DONE;
+  else
+  if (image->type == VSX_IMAGE_PNG)
+  {
+    pngRawInfo pp;
+    if (pngLoadRaw(image->filename.c_str(), &pp, filesystem))
+    {
+      if (pp.Components == 1 || pp.Components == 3)
+      {
+        bitm.bpp = 3;
+        bitm.bformat = GL_RGB;
+      } else
+      {
+        bitm.bpp = 4;
+        bitm.bformat = GL_RGBA;
+      }
+      bitm.size_x = pp.Width;
+      bitm.size_y = pp.Height;
+      bitm.data = pp.Data;
+      state = VSX_IMAGE_STATE_DONE;
+    }
+    else
+      image->error = "ERROR! Could not load PNG image";
+  }
+  else
+  {
+    CJPEGTest cj;
+    CJPEGTest cj_a;
+    vsx_string ret;
+    bool ok = cj.LoadJPEG(image->filename, ret, filesystem);
+    bool has_alpha = ok && image->type == VSX_IMAGE_JPEG_ALPHA && image->alpha_filename != "";
+    if (has_alpha)
+      ok = cj_a.LoadJPEG(image->alpha_filename, ret, filesystem);
+    if (has_alpha && ok && (cj_a.GetResX() != cj.GetResX() || cj_a.GetResY() != cj.GetResY()))
+    {
+      ok = false;
+      ret = "ERROR! The alpha image must be the same size as the rgb image";
+    }
+    if (ok)
+    {
+      bitm.size_x = cj.GetResX();
+      bitm.size_y = cj.GetResY();
+      bitm.bpp = 4;
+      bitm.bformat = GL_RGBA;
+      bitm.data = jpeg_to_32bt(
+        (unsigned char*)cj.m_pBuf,
+        has_alpha ? (unsigned char*)cj_a.m_pBuf : 0,
+        bitm.size_x * bitm.size_y
+      );
+      state = VSX_IMAGE_STATE_DONE;
+    }
+    else
+      image->error = ret;
+  }
+
+  if (i_filesystem) delete i_filesystem;
+
+  // freshly decoded, compress and remember it
+  if (state == VSX_IMAGE_STATE_DONE && image->compression != VSX_IMAGE_COMPRESSION_OFF && !vsx_dxt_is_compressed(&bitm))
+  {
+    // plain jpegs are opaque, no point spending bits on their alpha
+    int format = image->compression;
+    if (format == VSX_DXT_NONE && image->type == VSX_IMAGE_JPEG)
+      format = VSX_DXT1;
+    vsx_bitmap compressed;
+    if (vsx_dxt_compress_bitmap(&bitm, &compressed, format))
+    {
+      free(bitm.data);
+      bitm.data = compressed.data;
+      bitm.bpp = compressed.bpp;
+      bitm.bformat = compressed.bformat;
+      if (cache_key)
+        vsx_dxt_cache_store(cache_key, &bitm);
+    }
+  }
+
+  bitm.valid = state == VSX_IMAGE_STATE_DONE;
+  // the bitmap must be complete before anyone sees the new state
+  __sync_synchronize();
+  image->state = state;
+}
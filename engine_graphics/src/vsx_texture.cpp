@@ -25,14 +25,11 @@
 #include <vsxfst.h>
 #include <vsx_gl_global.h>
 #include <vsx_texture.h>
+#include <vsx_dxt.h>
 #ifndef VSX_TEXTURE_NO_GLPNG
   #include <vsxg.h>
   #include <stdlib.h>
-  #ifdef _WIN32
-    #include <pthread.h>
-  #else
-    #include <pthread.h>
-  #endif
+  #include <vsx_image_loader.h>
 #endif
 
 #ifdef VSXU_EXE
@@ -603,6 +600,41 @@ void vsx_texture::upload_ram_bitmap(vsx_bitmap* vbitmap,bool mipmaps, bool upsid
 
 void vsx_texture::upload_ram_bitmap(void* data, unsigned long size_x, unsigned long size_y, bool mipmaps, int bpp, int bpp2, bool upside_down)
 {
+  #ifndef VSXU_OPENGL_ES
+  if (bpp == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || bpp == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+  {
+    // block compressed, data holds the whole mipmap chain (see vsx_dxt.h).
+    // Blocks can't be flipped cheaply, upside_down is ignored.
+    VSX_UNUSED(upside_down);
+    VSX_UNUSED(bpp2);
+    texture_info.ogl_type = GL_TEXTURE_2D;
+    GLboolean oldStatus = glIsEnabled(texture_info.ogl_type);
+    glEnable(texture_info.ogl_type);
+    glBindTexture(texture_info.ogl_type, texture_info.ogl_id);
+    glTexParameteri(texture_info.ogl_type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(texture_info.ogl_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    int format = bpp == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? VSX_DXT1 : VSX_DXT5;
+    int levels = mipmaps ? vsx_dxt_levels(size_x, size_y) : 1;
+    glTexParameteri(texture_info.ogl_type, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    unsigned char* level = (unsigned char*)data;
+    unsigned long lx = size_x;
+    unsigned long ly = size_y;
+    for (int i = 0; i < levels; i++)
+    {
+      size_t bytes = vsx_dxt_level_size(lx, ly, format);
+      glCompressedTexImage2D(texture_info.ogl_type, i, bpp, lx, ly, 0, (GLsizei)bytes, level);
+      level += bytes;
+      lx = lx > 1 ? lx / 2 : 1;
+      ly = ly > 1 ? ly / 2 : 1;
+    }
+    this->texture_info.size_x = size_x;
+    this->texture_info.size_y = size_y;
+    if(!oldStatus) glDisable(texture_info.ogl_type);
+    valid = true;
+    return;
+  }
+  #endif
+
   if (!mipmaps)
   {
     if ((float)size_x/(float)size_y != 1.0) {
@@ -799,31 +831,11 @@ void vsx_texture::load_jpeg(vsx_string fname, bool mipmaps) {
     upload_ram_bitmap((unsigned long*)cj.m_pBuf, cj.GetResX(), cj.GetResY(), mipmaps, 3, GL_RGB);
 }
 
-// PNG THREAD STUFF
-typedef struct {
-  pngRawInfo*       pp;
-  int               thread_state;
-  pthread_t					worker_t;
-  pthread_attr_t		worker_t_attr;
-  vsx_bitmap        bitmap;
-  vsx_string       filename;
-  bool              mipmaps;
-} pti; // png thread info
-
-// thread run by the load_png_thread
-void* png_worker(void *ptr) {
-  ((pti*)((vsx_texture*)ptr)->pti_l)->pp = new pngRawInfo;
-  vsxf filesystem;
-  if (pngLoadRaw(((pti*)((vsx_texture*)ptr)->pti_l)->filename.c_str(), ((pti*)((vsx_texture*)ptr)->pti_l)->pp,&filesystem))
-  {
-    ((pti*)((vsx_texture*)ptr)->pti_l)->thread_state = 2;
-  }
-  return 0;
-}
-
-// load a png but put the heavy processing in a thread
+// load a png but leave the decoding to the image loader, the upload happens
+// in bind() once it's done
 void vsx_texture::load_png_thread(vsx_string fname, bool mipmaps)
 {
+  VSX_UNUSED(mipmaps);
   if (t_glist.find(fname) != t_glist.end()) {
     locked = true;
     texture_info = t_glist[fname];
@@ -832,50 +844,35 @@ void vsx_texture::load_png_thread(vsx_string fname, bool mipmaps)
   } else
   {
     locked = false;
-    if (pti_l) {
-      if (((pti*)pti_l)->thread_state == 1) {
-        long* aa;
-        pthread_join(((pti*)pti_l)->worker_t, (void **)&aa);
-      }
-      free(((pti*)pti_l)->pp->Data);
-      free(pti_l);
-    }
+    if (pti_l)
+      vsx_image_loader::get_instance()->release((vsx_image*)pti_l);
     this->name = fname;
     valid = false;
-    pti* pt = new pti;
-    pt->filename = fname;
-    pt->mipmaps = mipmaps;
-    pthread_attr_init(&pt->worker_t_attr);
-    pt->thread_state = 1;
-    pti_l = (void*)pt;
-    pthread_create(&(pt->worker_t), &(pt->worker_t_attr), &png_worker, (void*)this);
+    pti_l = (void*)vsx_image_loader::get_instance()->request(0x0, fname, VSX_IMAGE_PNG);
   }
 }
 
 bool vsx_texture::bind()
 {
     if (pti_l)
-    if (((pti*)pti_l)->thread_state == 2)
     {
-      if (texture_info.ogl_id != 0)
-      unload();
-      init_opengl_texture();
-      pngRawInfo* pp = (pngRawInfo*)(((pti*)pti_l)->pp);
-      if (pp->Components == 1)
-      upload_ram_bitmap((unsigned long*)(pp->Data),pp->Width,pp->Height,false,3,GL_RGB); else
-      if (pp->Components == 2)
-      upload_ram_bitmap((unsigned long*)(pp->Data),pp->Width,pp->Height,false,4,GL_RGBA); else
-      if (pp->Components == 3)
-      upload_ram_bitmap((unsigned long*)(pp->Data),pp->Width,pp->Height,false,pp->Components,GL_RGB); else
-      if (pp->Components == 4)
-      upload_ram_bitmap((unsigned long*)(pp->Data),pp->Width,pp->Height,false,pp->Components,GL_RGBA);
-      free((((pti*)pti_l)->pp)->Data);
-      texture_info.type = 1; // png
-      t_glist[name] = texture_info;
-      pthread_join(((pti*)pti_l)->worker_t,0);
-      valid = true;
-      delete (pti*)pti_l;
-      pti_l = 0;
+      vsx_image* image = (vsx_image*)pti_l;
+      if (image->state == VSX_IMAGE_STATE_DONE)
+      {
+        if (texture_info.ogl_id != 0)
+        unload();
+        init_opengl_texture();
+        vsx_bitmap* bitm = &image->bitmap;
+        upload_ram_bitmap(bitm->data,bitm->size_x,bitm->size_y,false,bitm->bpp,bitm->bformat);
+        texture_info.type = 1; // png
+        t_glist[name] = texture_info;
+        valid = true;
+      }
+      if (image->state != VSX_IMAGE_STATE_LOADING)
+      {
+        vsx_image_loader::get_instance()->release(image);
+        pti_l = 0;
+      }
     }
   if (texture_info.ogl_id == 0) {
     return false;
@@ -111,6 +111,177 @@ typedef unsigned char uint8;
 
 // 0..24 blend types
 
+// The blend kernels. Every mode is a function of two bytes, so the divide
+// heavy ones are evaluated once into a 256 * 256 table straight from the
+// macros above and looked up from then on - same results, no divides.
+// The plain arithmetic ones are done directly with SSE2, 16 bytes at a time.
+// Either way the opacity mix runs on 16 bytes at a time too.
+
+#define BLEND_TYPES 25
+
+// [top << 8 | base], built on demand on the render thread
+static unsigned char* blend_tables[BLEND_TYPES];
+
+static const unsigned char* blend_get_table(int type)
+{
+  if (blend_tables[type])
+    return blend_tables[type];
+  unsigned char* t = new unsigned char[256 * 256];
+  for (int A = 0; A < 256; A++)
+    for (int B = 0; B < 256; B++)
+    {
+      unsigned char* r = &t[A << 8 | B];
+
+#define BLEND_TABLE(BLT) *r = BLT(A,B);
+      switch (type)
+      {
+        case BLEND_NORMAL       : BLEND_TABLE(Blend_Normal) break;
+        case BLEND_LIGHTEN      : BLEND_TABLE(Blend_Lighten) break;
+        case BLEND_DARKEN       : BLEND_TABLE(Blend_Darken) break;
+        case BLEND_MULTIPLY     : BLEND_TABLE(Blend_Multiply) break;
+        case BLEND_AVERAGE      : BLEND_TABLE(Blend_Average) break;
+        case BLEND_ADD          : BLEND_TABLE(Blend_Add) break;
+        case BLEND_SUBTRACT     : BLEND_TABLE(Blend_Subtract) break;
+        case BLEND_DIFFERENCE   : BLEND_TABLE(Blend_Difference) break;
+        case BLEND_NEGATION     : BLEND_TABLE(Blend_Negation) break;
+        case BLEND_SCREEN       : BLEND_TABLE(Blend_Screen) break;
+        case BLEND_EXCLUSION    : BLEND_TABLE(Blend_Exclusion) break;
+        case BLEND_OVERLAY      : BLEND_TABLE(Blend_Overlay) break;
+        case BLEND_SOFT_LIGHT   : BLEND_TABLE(Blend_Soft_Light) break;
+        case BLEND_HARD_LIGHT   : BLEND_TABLE(Blend_Hard_Light) break;
+        case BLEND_COLOR_DODGE  : BLEND_TABLE(Blend_Color_Dodge) break;
+        case BLEND_COLOR_BURN   : BLEND_TABLE(Blend_Color_Burn) break;
+        case BLEND_LINEAR_DODGE : BLEND_TABLE(Blend_Linear_Dodge) break;
+        case BLEND_LINEAR_BURN  : BLEND_TABLE(Blend_Linear_Burn) break;
+        case BLEND_LINEAR_LIGHT : BLEND_TABLE(Blend_Linear_Light) break;
+        case BLEND_VIVID_LIGHT  : BLEND_TABLE(Blend_Vivid_Light) break;
+        case BLEND_PIN_LIGHT    : BLEND_TABLE(Blend_Pin_Light) break;
+        case BLEND_HARD_MIX     : BLEND_TABLE(Blend_Hard_Mix) break;
+        case BLEND_REFLECT      : BLEND_TABLE(Blend_Reflect) break;
+        case BLEND_GLOW         : BLEND_TABLE(Blend_Glow) break;
+        case BLEND_PHOENIX      : BLEND_TABLE(Blend_Phoenix) break;
+      }
+#undef BLEND_TABLE
+    }
+  blend_tables[type] = t;
+  return t;
+}
+
+// Blend_Opacity for one byte, saturated where the float goes out of range
+inline unsigned char blend_opacity(int f, int base, float opacity)
+{
+  float v = opacity * f + (1 - opacity) * base;
+  if (v <= 0.0f) return 0;
+  if (v >= 255.0f) return 255;
+  return (unsigned char)v;
+}
+
+#if defined(VSX_MATH_3D_SSE2)
+// x / 255 for 16 bit lanes holding 0..65535
+inline __m128i blend_div255_epi16(__m128i x)
+{
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+}
+
+// the modes worth doing without the table; false = use the table
+inline bool blend_simd(int type, __m128i a, __m128i b, __m128i& r)
+{
+  __m128i ff = _mm_set1_epi8((char)0xFF);
+  __m128i zero = _mm_setzero_si128();
+  switch (type)
+  {
+    case BLEND_NORMAL: r = a; return true;
+    case BLEND_LIGHTEN: r = _mm_max_epu8(a, b); return true;
+    case BLEND_DARKEN: r = _mm_min_epu8(a, b); return true;
+    case BLEND_AVERAGE:
+      // avg_epu8 rounds up, the macro rounds down
+      r = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+      return true;
+    case BLEND_ADD:
+    case BLEND_LINEAR_DODGE:
+      r = _mm_adds_epu8(a, b);
+      return true;
+    case BLEND_SUBTRACT:
+    case BLEND_LINEAR_BURN:
+      r = _mm_subs_epu8(a, _mm_xor_si128(b, ff));
+      return true;
+    case BLEND_DIFFERENCE: r = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); return true;
+    case BLEND_HARD_MIX:
+      r = _mm_cmpeq_epi8(_mm_max_epu8(a, _mm_xor_si128(b, ff)), a);
+      return true;
+    case BLEND_MULTIPLY:
+    {
+      __m128i lo = blend_div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+      __m128i hi = blend_div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+      r = _mm_packus_epi16(lo, hi);
+      return true;
+    }
+    case BLEND_SCREEN:
+    {
+      __m128i ia = _mm_xor_si128(a, ff);
+      __m128i ib = _mm_xor_si128(b, ff);
+      __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(ia, zero), _mm_unpacklo_epi8(ib, zero)), 8);
+      __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(ia, zero), _mm_unpackhi_epi8(ib, zero)), 8);
+      r = _mm_xor_si128(_mm_packus_epi16(lo, hi), ff);
+      return true;
+    }
+  }
+  return false;
+}
+
+// opacity * f + (1 - opacity) * base on 4 lanes
+inline __m128i blend_opacity_epi32(__m128i f, __m128i base, __m128 o, __m128 io)
+{
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(o, _mm_cvtepi32_ps(f)), _mm_mul_ps(io, _mm_cvtepi32_ps(base))));
+}
+#endif
+
+// blends count bytes of top onto base in place
+static void blend_bytes(int type, const unsigned char* table, const unsigned char* top, unsigned char* base, size_t count, float opacity)
+{
+  bool mix = opacity != 1.0f;
+  size_t i = 0;
+#if defined(VSX_MATH_3D_SSE2)
+  __m128 o = _mm_set1_ps(opacity);
+  __m128 io = _mm_set1_ps(1 - opacity);
+  __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= count; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)&top[i]);
+    __m128i b = _mm_loadu_si128((const __m128i*)&base[i]);
+    __m128i r;
+    if (!blend_simd(type, a, b, r))
+    {
+      unsigned char f[16];
+      for (int k = 0; k < 16; k++)
+        f[k] = table[top[i + k] << 8 | base[i + k]];
+      r = _mm_loadu_si128((const __m128i*)f);
+    }
+    if (mix)
+    {
+      __m128i f_lo = _mm_unpacklo_epi8(r, zero);
+      __m128i f_hi = _mm_unpackhi_epi8(r, zero);
+      __m128i b_lo = _mm_unpacklo_epi8(b, zero);
+      __m128i b_hi = _mm_unpackhi_epi8(b, zero);
+      __m128i r0 = blend_opacity_epi32(_mm_unpacklo_epi16(f_lo, zero), _mm_unpacklo_epi16(b_lo, zero), o, io);
+      __m128i r1 = blend_opacity_epi32(_mm_unpackhi_epi16(f_lo, zero), _mm_unpackhi_epi16(b_lo, zero), o, io);
+      __m128i r2 = blend_opacity_epi32(_mm_unpacklo_epi16(f_hi, zero), _mm_unpacklo_epi16(b_hi, zero), o, io);
+      __m128i r3 = blend_opacity_epi32(_mm_unpackhi_epi16(f_hi, zero), _mm_unpackhi_epi16(b_hi, zero), o, io);
+      // signed packs saturate to 0..255 on the way down
+      r = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+    }
+    _mm_storeu_si128((__m128i*)&base[i], r);
+  }
+#endif
+  for (; i < count; i++)
+  {
+    int f = table[top[i] << 8 | base[i]];
+    base[i] = mix ? blend_opacity(f, base[i], opacity) : (unsigned char)f;
+  }
+}
+
+// 0..24 blend types
+
 class module_bitmap_blend : public vsx_module {
   
   // out
@@ -120,9 +291,6 @@ class module_bitmap_blend : public vsx_module {
 
   int bitm_timestamp;
 
-  pthread_t	worker_t;
-
-
   int p_updates;
 
 public:
@@ -143,107 +311,64 @@ public:
   
   int blend_type;
   
-  vsx_bitmap*       work_bitmap;
-  bool              worker_running;
-  bool              thread_created;
-  int               thread_state;
+  texgen_tiles tiles;
   int my_ref;
 
-  // our worker thread, to keep the tough generating work off the main loop
-  // this is a fairly simple operation, but when you want to generate fractals
-  // and decode film, you could run into several seconds of processing time. 
-  static void* worker(void *ptr)
+  // a source bitmap placed on the target
+  struct blend_layer
   {
-    module_bitmap_blend* mod = ((module_bitmap_blend*)ptr);
-    vsx_bitmap* bitm = mod->work_bitmap;
-    vsx_bitmap* bitm1 = mod->bitm1;
-    vsx_bitmap* bitm2 = mod->bitm2;
-    
-    unsigned long x,y,ix,iy;
-
-    for (x = 0; x < bitm->size_x * bitm->size_y; x++) ((vsx_bitmap_32bt*)bitm->data)[x] = 0;
-    //TEEEEMP!
-    //bitm->timestamp++;
-    //bitm->valid = true;
-    //mod->thread_state = 2;
-    //return 0;
-    // END TEEEEEMP
-    
-    bool ixbound = false, iybound = false;
-    iy = 0;
-    for (y = (unsigned long)mod->bitm1_ofs->get(1); y < bitm->size_y && !iybound; y++)
+    const vsx_bitmap_32bt* data;
+    long size_x;
+    long size_y;
+    long ofs_x;
+    long ofs_y;
+
+    // the part of target row y it covers, false if none
+    bool span(long y, long width, long& x0, long& x1) const
     {
-      ix = 0;
-      ixbound = false;
-      for (x = (unsigned long)mod->bitm1_ofs->get(0); x < bitm->size_x && !ixbound; x++)
-      {
-        ((vsx_bitmap_32bt*)bitm->data)[x + y * bitm->size_x] = ((vsx_bitmap_32bt*)bitm1->data)[ix + iy * bitm1->size_x];
-        ix++;
-        if (ix >= bitm1->size_x) ixbound = true;
-      }
-      iy++;
-      if (iy >= bitm1->size_y) iybound = true;
+      if (!data || ofs_x < 0 || ofs_y < 0 || y < ofs_y || y >= ofs_y + size_y)
+        return false;
+      x0 = ofs_x;
+      x1 = ofs_x + size_x < width ? ofs_x + size_x : width;
+      return x0 < x1;
     }
+  };
 
-    iybound = false;
-    iy = 0;
-    for (y = (unsigned long)mod->bitm2_ofs->get(1); y < bitm->size_y && !iybound; y++)
-    {
-      ix = 0;
-      ixbound = false;
-      for (x = (unsigned long)mod->bitm2_ofs->get(0); x < bitm->size_x && !ixbound; x++)
-      {
-        vsx_bitmap_32bt* data = (vsx_bitmap_32bt*)bitm->data;
-        vsx_bitmap_32bt* data2 = (vsx_bitmap_32bt*)bitm2->data;
-
-#define BLEND_FUNC(BLT) \
-      for (int a = 0; a < 4; a++)\
-      {\
-        ((unsigned char*)&data[x + y * bitm->size_x])[a] = Blend_Opacity(((unsigned char*)&data2[ix + iy * bitm2->size_x])[a],((unsigned char*)&data[x + y * bitm->size_x])[a],BLT,mod->bitm2_opacity->get());\
-      }\
-      
-  switch (mod->filter_type->get())
+  // parameters of the blend in flight
+  struct blend_work
   {
-    case BLEND_NORMAL       : BLEND_FUNC(Blend_Normal) break;
-    case BLEND_LIGHTEN      : BLEND_FUNC(Blend_Lighten) break;
-    case BLEND_DARKEN       : BLEND_FUNC(Blend_Darken) break;
-    case BLEND_MULTIPLY     : BLEND_FUNC(Blend_Multiply) break;
-    case BLEND_AVERAGE      : BLEND_FUNC(Blend_Average) break;
-    case BLEND_ADD          : BLEND_FUNC(Blend_Add) break;
-    case BLEND_SUBTRACT     : BLEND_FUNC(Blend_Subtract) break;
-    case BLEND_DIFFERENCE   : BLEND_FUNC(Blend_Difference) break;
-    case BLEND_NEGATION     : BLEND_FUNC(Blend_Negation) break;
-    case BLEND_SCREEN       : BLEND_FUNC(Blend_Screen) break;
-    case BLEND_EXCLUSION    : BLEND_FUNC(Blend_Exclusion) break;
-    case BLEND_OVERLAY      : BLEND_FUNC(Blend_Overlay) break;
-    case BLEND_SOFT_LIGHT   : BLEND_FUNC(Blend_Soft_Light) break;
-    case BLEND_HARD_LIGHT   : BLEND_FUNC(Blend_Hard_Light) break;
-    case BLEND_COLOR_DODGE  : BLEND_FUNC(Blend_Color_Dodge) break;
-    case BLEND_COLOR_BURN   : BLEND_FUNC(Blend_Color_Burn) break;
-    case BLEND_LINEAR_DODGE : BLEND_FUNC(Blend_Linear_Dodge) break;
-    case BLEND_LINEAR_BURN  : BLEND_FUNC(Blend_Linear_Burn) break;
-    case BLEND_LINEAR_LIGHT : BLEND_FUNC(Blend_Linear_Light) break;
-    case BLEND_VIVID_LIGHT  : BLEND_FUNC(Blend_Vivid_Light) break;
-    case BLEND_PIN_LIGHT    : BLEND_FUNC(Blend_Pin_Light) break;
-    case BLEND_HARD_MIX     : BLEND_FUNC(Blend_Hard_Mix) break;
-    case BLEND_REFLECT      : BLEND_FUNC(Blend_Reflect) break;
-    case BLEND_GLOW         : BLEND_FUNC(Blend_Glow) break;
-    case BLEND_PHOENIX      : BLEND_FUNC(Blend_Phoenix) break;
-  }
-      
-      ix++;
-      if (ix >= bitm2->size_x) ixbound = true;
-    }
-    iy++;
-    if (iy >= bitm2->size_y) iybound = true;
-  }
+    blend_layer layer1;
+    blend_layer layer2;
+    int type;
+    const unsigned char* table;
+    float opacity;
+  } work;
+
+  // bitmap 1 is copied in, bitmap 2 blended on top, the rest is black
+  static void blend_rows(void* arg, void* data, int size, int y0, int y1)
+  {
+    blend_work* w = (blend_work*)arg;
+    long x0, x1;
+    for (long y = y0; y < y1; y++)
+    {
+      vsx_bitmap_32bt* row = (vsx_bitmap_32bt*)data + y * size;
+      memset(row, 0, sizeof(vsx_bitmap_32bt) * size);
+
+      const blend_layer& l1 = w->layer1;
+      if (l1.span(y, size, x0, x1))
+        memcpy(&row[x0], &l1.data[(y - l1.ofs_y) * l1.size_x], sizeof(vsx_bitmap_32bt) * (x1 - x0));
 
-    bitm->timestamp++;
-    bitm->valid = true;
-    mod->thread_state = 2;
-    //printf("blob thread done\n");
-    // the thread will die here.
-    return 0;
+      const blend_layer& l2 = w->layer2;
+      if (l2.span(y, size, x0, x1))
+        blend_bytes(
+          w->type,
+          w->table,
+          (const unsigned char*)&l2.data[(y - l2.ofs_y) * l2.size_x],
+          (unsigned char*)&row[x0],
+          sizeof(vsx_bitmap_32bt) * (x1 - x0),
+          w->opacity
+        );
+    }
   }
   
   void module_info(vsx_module_info* info)
@@ -295,9 +420,6 @@ BLEND_LINEAR_BURN|BLEND_LINEAR_LIGHT|BLEND_VIVID_LIGHT|BLEND_PIN_LIGHT|BLEND_HAR
 
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
-    thread_state = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
     in1 = (vsx_module_param_bitmap*)in_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"in1");
     in2 = (vsx_module_param_bitmap*)in_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"in2");
@@ -317,7 +439,7 @@ BLEND_LINEAR_BURN|BLEND_LINEAR_LIGHT|BLEND_VIVID_LIGHT|BLEND_PIN_LIGHT|BLEND_HAR
 
     bitmap_type = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"bitmap_type");
     
-    work_bitmap = &bitm;
+    tiles.init(&bitm);
     bitm.data = 0;
     bitm.bpp = 4;
     bitm.bformat = GL_RGBA;
@@ -329,76 +451,54 @@ BLEND_LINEAR_BURN|BLEND_LINEAR_LIGHT|BLEND_VIVID_LIGHT|BLEND_PIN_LIGHT|BLEND_HAR
     //bitm.size_y = bitm.size_x = 256;
     bitm.size_y = bitm.size_x = 0;
     timestamp1 = timestamp2 = -1;
-    to_delete_data = 0;
     result1->set_p(bitm);
   }
-  void *to_delete_data;
+  void set_layer(blend_layer& l, vsx_bitmap* b, vsx_module_param_float3* ofs)
+  {
+    l.data = (const vsx_bitmap_32bt*)b->data;
+    l.size_x = b->size_x;
+    l.size_y = b->size_y;
+    l.ofs_x = (long)ofs->get(0);
+    l.ofs_y = (long)ofs->get(1);
+  }
 
   void run() {
+    // a finished blend replaces the bitmap in one go
+    if (tiles.collect())
+    {
+      result1->set_p(bitm);
+      loading_done = true;
+    }
+
     bitm1 = in1->get_addr();
     bitm2 = in2->get_addr();
-    // initialize our worker thread, we don't want to keep the renderloop waiting do we?
-    if (!worker_running)
-    if (bitm1 && bitm2 && !to_delete_data)
+    if (!tiles.busy())
+    if (bitm1 && bitm2)
     {
       if (bitm1->valid && bitm2->valid)
       if (timestamp1 != bitm1->timestamp || timestamp2 != bitm2->timestamp || p_updates != param_updates) {
-        //printf("both bitmaps are OK it seems %d - %d\n",bitm1->timestamp,timestamp1);
+        int size_x = (int)target_size->get(0);
+        int size_y = (int)target_size->get(1);
+        if (size_x <= 0 || size_y <= 0)
+          return;
         p_updates = param_updates;
-        bitm.valid = false;
         timestamp1 = bitm1->timestamp;
         timestamp2 = bitm2->timestamp;
-        
-        if (bitm.size_x != (unsigned long)target_size->get(0) || bitm.size_y != (unsigned long)target_size->get(1))
-        {
-          if (bitm.data != 0) to_delete_data = bitm.data;
-          bitm.data = new vsx_bitmap_32bt[(int)target_size->get(0)*(int)target_size->get(1)];
-          bitm.size_x = (int)target_size->get(0);
-          bitm.size_y = (int)target_size->get(1);
-        }
-        
-        //printf("creating thread\n");
-        thread_state = 1;
-        worker_running = true;
-        thread_created = true;
-        pthread_create(&worker_t, NULL, &worker, (void*)this);
-        //printf("done creating thread\n");
-      }
-    }
-    if (thread_state == 2) {
-      if (bitm.valid && bitm_timestamp != bitm.timestamp)
-      {
-        if (worker_running)
-        {
-          pthread_join(worker_t,0);
-        }
-        worker_running = false;
-        // ok, new version
-        //printf("uploading subplasma to param\n");
-        bitm_timestamp = bitm.timestamp;
-        result1->set_p(bitm);
-        loading_done = true;
+
+        set_layer(work.layer1, bitm1, bitm1_ofs);
+        set_layer(work.layer2, bitm2, bitm2_ofs);
+        work.type = filter_type->get();
+        if (work.type < 0 || work.type >= BLEND_TYPES)
+          work.type = BLEND_NORMAL;
+        work.table = blend_get_table(work.type);
+        work.opacity = bitm2_opacity->get();
+        tiles.start(size_x, size_y, 4, 0, &blend_rows, (void*)&work);
       }
-      thread_state = 3;
     }
-    if (thread_state == 3)
-    if (to_delete_data
-        )
-    {
-      delete[] (vsx_bitmap_32bt*)to_delete_data;
-      to_delete_data = 0;
-    }
-    
   }
   
   void on_delete() {
-    if (worker_running)
-    {
-      pthread_join(worker_t,NULL);
-    }
-    if (bitm.data)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    tiles.wait();
+    tiles.free_buffers();
   }
 };
@@ -44,6 +44,7 @@
 // temp = abs(x+y) xor abs(x-y)
 // pixel[x,y] = (temp^7) mod 257;
 
+#include "texgen_tiles.h"
 #include "module_bitmap_blob.h"
 #include "perlin_noise.h"
 #include "plasma.h"
@@ -56,7 +56,7 @@ class module_bitmap_blob : public vsx_module {
 	int bitm_timestamp;
 
   vsx_texture* texture;
-  pthread_t					worker_t;
+  texgen_tiles tiles;
 
   int p_updates;
   int my_ref;
@@ -71,14 +71,8 @@ public:
   vsx_module_param_int* alpha;
   vsx_module_param_int* size;
 
-  vsx_bitmap*       work_bitmap;
-  bool              worker_running;
-  bool              thread_created;
-  int               thread_state;
   int               c_type;
   int               i_size;
-  float             work_color[4];
-  int               work_alpha;
 
 
   void module_info(vsx_module_info* info)
@@ -114,9 +108,6 @@ public:
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
     loading_done = true;
-    thread_state = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
     arms = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"arms");
     attenuation = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"attenuation");
@@ -135,7 +126,7 @@ public:
     i_size = 0;
   	result1 = (vsx_module_param_bitmap*)out_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"bitmap");
     result1->set_p(bitm);
-    work_bitmap = &bitm;
+    tiles.init(&bitm);
     bitm.data = 0;
     bitm.bpp = 4;
     bitm.bformat = GL_RGBA;
@@ -149,132 +140,86 @@ public:
       result_texture = (vsx_module_param_texture*)out_parameters.create(VSX_MODULE_PARAM_ID_TEXTURE,"texture");
       result_texture->set(texture);
     }
-    to_delete_data = 0;
   }
-  pthread_attr_t attr;
-  void *to_delete_data;
+  // parameters of the generation in flight
+  struct blob_work
+  {
+    float attenuation;
+    float arms;
+    float star_flower;
+    float angle;
+    int alpha;
+    float color[4];
+  } work;
 
+  // rows [y0, y1) of the blob, run in bands on the thread pool
+  static void generate_rows(void* arg, void* data, int size, int y0, int y1)
+  {
+    blob_work* w = (blob_work*)arg;
+    int hsize = size >> 1;
+    float scale = size/(size-2.0f);
+    float one_div_hsize = 1.0f / ((float)hsize+1);
 
+    // with alpha the color doesn't depend on the pixel
+    long cr = max(0,min(255,(long)(255.0f * w->color[0])));
+    long cg = max(0,min(255,(long)(255.0f * w->color[1])));
+    long cb = max(0,min(255,(long)(255.0f * w->color[2])));
+    long ca = (long)(255.0f * w->color[3]);
 
-  // our worker thread, to keep the tough generating work off the main loop
-  // this is a fairly simple operation, but when you want to generate fractals
-  // and decode film, you could run into several seconds of processing time.
-  static void* worker(void *ptr) {
-    int x,y;
-    float attenuation = ((module_bitmap_blob*)ptr)->attenuation->get();
-    float arms = ((module_bitmap_blob*)ptr)->arms->get()*0.5f;
-    float star_flower = ((module_bitmap_blob*)ptr)->star_flower->get();
-    float angle = ((module_bitmap_blob*)ptr)->angle->get();
-    vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)((module_bitmap_blob*)ptr)->work_bitmap->data;
-    int size = ((module_bitmap_blob*)ptr)->i_size;
-    //float sp1 = (float)size + 1.0f;
-    float dist;
-    int hsize = size >> 1;
-    for(y = -hsize; y < hsize; ++y)
-      for(x = -hsize; x < hsize; ++x,p++)
+    for (int row = y0; row < y1; ++row)
+    {
+      vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)data + row * size;
+      float yy = scale*((float)(row - hsize))+0.5f;
+      for (int x = -hsize; x < hsize; ++x, p++)
       {
-        float xx = (size/(size-2.0f))*((float)x)+0.5f;
-        float yy = (size/(size-2.0f))*((float)y)+0.5f;
+        float xx = scale*((float)x)+0.5f;
         float dd = sqrt(xx*xx + yy*yy);
-        float dstf = dd/((float)hsize+1);
-        float phase = (float)pow(1.0f - (float)fabs((float)cos(angle+arms*(float)atan2(xx,yy)))*(star_flower+(1-star_flower)*(((dstf)))),attenuation);
+        float dstf = dd*one_div_hsize;
+        float phase = (float)pow(1.0f - (float)fabs((float)cos(w->angle+w->arms*(float)atan2(xx,yy)))*(w->star_flower+(1-w->star_flower)*(((dstf)))),w->attenuation);
         if (phase > 2.0f) phase = 1.0f;
-        float pf = (255.0f * (cos(((dstf * PI_FLOAT/2.0f)))*phase));
-        if (pf > 255.0f) pf = 255.0f;
-        if (pf < 0.0f) pf = 0.0f;
-        *p = (long)pf;
-        dist = cos(dstf * PI_FLOAT/2.0f)*phase;
-        if (((module_bitmap_blob*)ptr)->work_alpha == 1)
+        float dist = cos(dstf * PI_FLOAT/2.0f)*phase;
+        if (w->alpha == 1)
         {
-          long pr = max(0,min(255,(long)(255.0f *  ((module_bitmap_blob*)ptr)->work_color[0])));
-          long pg = max(0,min(255,(long)(255.0f *  ((module_bitmap_blob*)ptr)->work_color[1])));
-          long pb = max(0,min(255,(long)(255.0f *  ((module_bitmap_blob*)ptr)->work_color[2])));
-          long pa = max(0,min(255,(long)(255.0f * dist * ((module_bitmap_blob*)ptr)->work_color[3])));
-          *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
-//  			  *p = 0xFF000000 | *p * 0x00010000 | *p * 0x00000100 | *p;
+          long pa = max(0,min(255,(long)(255.0f * dist * w->color[3])));
+          *p = 0x01000000 * pa | cb * 0x00010000 | cg * 0x00000100 | cr;
         } else
-        if (((module_bitmap_blob*)ptr)->work_alpha == 0) {
-          long pr = max(0,min(255,(long)(255.0f * dist * ((module_bitmap_blob*)ptr)->work_color[0])));
-          long pg = max(0,min(255,(long)(255.0f * dist * ((module_bitmap_blob*)ptr)->work_color[1])));
-          long pb = max(0,min(255,(long)(255.0f * dist * ((module_bitmap_blob*)ptr)->work_color[2])));
-          long pa = (long)(255.0f * ((module_bitmap_blob*)ptr)->work_color[3]);
-          *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
+        {
+          long pr = max(0,min(255,(long)(255.0f * dist * w->color[0])));
+          long pg = max(0,min(255,(long)(255.0f * dist * w->color[1])));
+          long pb = max(0,min(255,(long)(255.0f * dist * w->color[2])));
+          *p = 0x01000000 * ca | pb * 0x00010000 | pg * 0x00000100 | pr;
         }
       }
-    ((module_bitmap_blob*)ptr)->work_bitmap->timestamp++;
-    ((module_bitmap_blob*)ptr)->work_bitmap->valid = true;
-    ((module_bitmap_blob*)ptr)->loading_done = true;
-    ((module_bitmap_blob*)ptr)->thread_state = 2;
-    int *retval = new int;
-    *retval = 0;
-    pthread_exit(NULL);
-    // the thread will die here.
-    return 0;
+    }
   }
 
   void run() {
-    //printf("param_updates: %d\n",param_updates);
-    //printf("p_updates: %d\n",p_updates);
-    // initialize our worker thread, we don't want to keep the renderloop waiting do we?
-    if (thread_state == 2)
+    // a finished generation replaces the bitmap in one go
+    if (tiles.collect())
     {
-      if (bitm.valid && bitm_timestamp != bitm.timestamp) {
-        //pthread_join(worker_t,0);
-        worker_running = false;
-        pthread_join(worker_t, NULL);
-        // ok, new version
-        //printf("uploading blob to vram\n");
-        bitm_timestamp = bitm.timestamp;
-        if (c_type == 1)
-        {
-          texture->upload_ram_bitmap(&bitm,true);
-          result_texture->set(texture);
-        }
-        result1->set_p(bitm);
+      if (c_type == 1)
+      {
+        texture->upload_ram_bitmap(&bitm,true);
+        result_texture->set(texture);
       }
-      thread_state = 3;
+      result1->set_p(bitm);
     }
 
-    if (!worker_running)
+    if (!tiles.busy())
     if (p_updates != param_updates)
     {
-      //printf("param updates changed\n");
-      //need_to_rebuild = false;
-      if (i_size != 8 << size->get())
-      {
-        i_size = 8 << size->get();
-        //printf("i_size: %d\n",i_size);
-        if (bitm.data)
-        {
-          to_delete_data = bitm.data;
-        }
-        bitm.data = new vsx_bitmap_32bt[i_size*i_size];
-        bitm.size_y = bitm.size_x = i_size;
-      }
-
       p_updates = param_updates;
-      bitm.valid = false;
-      //printf("creating thread\n");
-      work_alpha = alpha->get();
-      work_color[0] = min(1.0f,color->get(0));
-      work_color[1] = min(1.0f,color->get(1));
-      work_color[2] = min(1.0f,color->get(2));
-      work_color[3] = min(1.0f,color->get(3));
-      thread_state = 1;
-
-      pthread_attr_init(&attr);
-
-      worker_running = true;
-      pthread_create(&worker_t, &attr, &worker, (void*)this);
-      thread_created = true;
-
-      //printf("done creating thread\n");
-    }
-
-    if (to_delete_data)
-    {
-      delete[] (vsx_bitmap_32bt*)to_delete_data;
-      to_delete_data = 0;
+      i_size = 8 << size->get();
+      work.attenuation = attenuation->get();
+      work.arms = arms->get()*0.5f;
+      work.star_flower = star_flower->get();
+      work.angle = angle->get();
+      work.alpha = alpha->get();
+      work.color[0] = min(1.0f,color->get(0));
+      work.color[1] = min(1.0f,color->get(1));
+      work.color[2] = min(1.0f,color->get(2));
+      work.color[3] = min(1.0f,color->get(3));
+      tiles.start(i_size, 4, 0, &generate_rows, (void*)&work);
     }
   }
   void start() {
@@ -289,37 +234,27 @@ public:
 
   void stop() {
     //if (worker_running) {
-      //printf("a");
       //pthread_join(worker_t,0);
-      //printf("b");
       //worker_running = false;
     //}
     if (c_type == 1) {
-      //printf("c");
       //delete texture->transform_obj;
-      //printf("d");
       texture->unload();
-      //printf("e");
       //delete texture;
       //texture = 0;
     }
   }
 
   void on_delete() {
-    // wait for thread to finish
-
-    if (worker_running)
-    {
-      pthread_join(worker_t,NULL);
-    }
+    // wait for the generation to finish
+    tiles.wait();
 
     if (c_type == 1) {
       if (texture) {
-        //printf(":t:");
         texture->unload();
         delete texture;
       }
     }
-    delete[] (vsx_bitmap_32bt*)bitm.data;
+    tiles.free_buffers();
   }
 };
@@ -23,7 +23,7 @@
 
 
 
-#include "perlin/perlin.h"
+#include <vsx_noise.h>
 #include <vsx_bitmap.h>
 
 
@@ -38,8 +38,6 @@ class module_bitmap_texgen_perlin_noise : public vsx_module {
   vsx_bitmap bitm;
   int bitm_timestamp;
 
-  pthread_t         worker_t;
-
   int p_updates;
   int my_ref;
 
@@ -61,148 +59,124 @@ public:
   vsx_module_param_float* perlin_strength;
   vsx_module_param_float4* color;
 
-  vsx_bitmap*       work_bitmap;
-  bool              worker_running;
-  bool              thread_created;
-  int               thread_state;
   int               i_size;
-  int               old_bitmap_type;
-
-  // our worker thread, to keep the tough generating work off the main loop
-  // this is a fairly simple operation, but when you want to generate fractals
-  // and decode film, you could run into several seconds of processing time.
-  static void* worker(void *ptr) {
+  texgen_tiles      tiles;
 
-    module_bitmap_texgen_perlin_noise* mod = ((module_bitmap_texgen_perlin_noise*)ptr);
+  // parameters of the generation in flight
+  struct perlin_work
+  {
+    vsx_noise noise;
+    int octaves;
+    float frequency;
+    float divisor;
+    int bpp;
+    int enable_blob;
+    float attenuation;
+    float arms;
+    float star_flower;
+    float angle;
+    float strength;
+    int alpha;
+    float color[4];
+  } work;
 
-    Perlin* perlin = new Perlin(
-                           mod->octave->get()+1,
-                           mod->frequency->get()+1,
-                           1.0f,
-                           (int)mod->rand_seed->get()
-                         );
-    float divisor = 1.0f / (float)mod->i_size;
+  // pixels per batch of noise samples
+  #define PERLIN_NOISE_CHUNK 64
 
-    float attenuation = mod->attenuation->get();
-    float arms = mod->arms->get()*0.5f;
-    float star_flower = mod->star_flower->get();
-    float angle = mod->angle->get();
-    int size = mod->i_size;
+  static void generate_rows(void* arg, void* data, int size, int y0, int y1)
+  {
+    perlin_work* w = (perlin_work*)arg;
     int hsize = size / 2;
-    
-    if (mod->work_bitmap->bpp == 4)
-    {
-      // integer data type 
-      vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)mod->work_bitmap->data;
-      float yp = 0.0f;
-      float xp;
-      for (int y = -hsize; y < hsize; ++y)
-      {
-        xp = 0.0f;
-        for (int x = -hsize; x < hsize; ++x)
-        {
-          float dist = 1.0f;
-          if (mod->enable_blob->get())
-          {
-            float xx = (size/(size-2.0f))*((float)x)+0.5f;
-            float yy = (size/(size-2.0f))*((float)y)+0.5f;
-            float dd = sqrt(xx*xx + yy*yy);
-            float dstf = dd/((float)hsize+1);
-            float phase = (float)pow(1.0f - (float)fabs((float)cos(angle+arms*(float)atan2(xx,yy)))*(star_flower+(1-star_flower)*(((dstf)))),attenuation);
-            if (phase > 2.0f) phase = 1.0f;
-            dist = (cos(((dstf * PI/2.0f)))*phase);
-            if (dist > 1.0f) dist = 1.0f;
-            if (dist < 0.0f) dist = 0.0f;
-          }
-          float pf = pow( (perlin->Get(xp,yp)+1.0f) * 0.5f, mod->perlin_strength->get()) * 255.0f * dist;
-          if (mod->alpha->get())
-          {
-            long pr = max(0,min(255,(long)(255.0f * mod->color->get(0))));
-            long pg = max(0,min(255,(long)(255.0f * mod->color->get(1))));
-            long pb = max(0,min(255,(long)(255.0f * mod->color->get(2))));
-            long pa = max(0,min(255,(long)(pf * mod->color->get(3))));
-            *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
-          } else
-          {
-            long pr = max(0,min(255,(long)(pf * mod->color->get(0))));
-            long pg = max(0,min(255,(long)(pf * mod->color->get(1))));
-            long pb = max(0,min(255,(long)(pf * mod->color->get(2))));
-            long pa = (long)(255.0f * mod->color->get(3));
-            *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
-          }
-          
-//          *p = 0xFF000000 | pf << 16 | pf << 8 | pf;// | 0 * 0x00000100 | 0;
-          ++p;
-          xp += divisor;
-        }
-        yp += divisor;
-      }
-    } else
-    if (mod->work_bitmap->bpp == GL_RGBA32F_ARB)
+    float divisor = w->divisor;
+    float attenuation = w->attenuation;
+    float arms = w->arms;
+    float star_flower = w->star_flower;
+    float angle = w->angle;
+    float ddiv = 1.0f / (((float)hsize)+1.0f);
+    float xs[PERLIN_NOISE_CHUNK];
+    float ys[PERLIN_NOISE_CHUNK];
+    float noise[PERLIN_NOISE_CHUNK];
+
+    for (int row = y0; row < y1; ++row)
     {
-      //printf("float format\n");
-      // integer data type
-      GLfloat *p = (GLfloat*)mod->work_bitmap->data;
-      float yp = 0.0f;
-      float xp;
-      float ddiv = 1.0f / (((float)hsize)+1.0f);
-      for (int y = -hsize; y < hsize; ++y)
+      int y = row - hsize;
+      float yp = row * divisor;
+      for (int i = 0; i < PERLIN_NOISE_CHUNK; i++)
+        ys[i] = yp;
+
+      for (int x0 = 0; x0 < size; x0 += PERLIN_NOISE_CHUNK)
       {
-        xp = 0.0f;
-        for (int x = -hsize; x < hsize; ++x)
+        int count = size - x0 < PERLIN_NOISE_CHUNK ? size - x0 : PERLIN_NOISE_CHUNK;
+        for (int i = 0; i < count; i++)
+          xs[i] = (x0 + i) * divisor;
+        w->noise.fbm2_n(xs, ys, noise, count, w->octaves, w->frequency, 1.0f);
+
+        for (int i = 0; i < count; i++)
         {
+          int x = x0 + i - hsize;
           float dist = 1.0f;
-          if (mod->enable_blob->get())
+          if (w->enable_blob)
           {
             float xx = (size/(size-2.0f))*((float)x)+0.5f;
             float yy = (size/(size-2.0f))*((float)y)+0.5f;
             float dd = sqrt(xx*xx + yy*yy);
-            if (dd > (float)hsize)
+            if (w->bpp != 4 && dd > (float)hsize)
             {
               dist = 0.0f;
             }
             else
             {
-            float xx = (size/(size-2.0f))*((float)x)+0.5f;
-            float yy = (size/(size-2.0f))*((float)y)+0.5f;
-            float dd = sqrt(xx*xx + yy*yy);
-            float dstf = dd * ddiv;
-            float phase = (float)pow(1.0f - (float)fabs((float)cos(angle+arms*(float)atan2(xx,yy)))*(star_flower+(1-star_flower)*(((dstf)))),attenuation);
-            if (phase > 2.0f) phase = 1.0f;
-            dist = (cos(((dstf * PI/2.0f)))*phase);
-            if (dist > 1.0f) dist = 1.0f;
-            if (dist < 0.0f) dist = 0.0f;
+              float dstf = w->bpp == 4 ? dd/((float)hsize+1) : dd * ddiv;
+              float phase = (float)pow(1.0f - (float)fabs((float)cos(angle+arms*(float)atan2(xx,yy)))*(star_flower+(1-star_flower)*(((dstf)))),attenuation);
+              if (phase > 2.0f) phase = 1.0f;
+              dist = (cos(((dstf * PI/2.0f)))*phase);
+              if (dist > 1.0f) dist = 1.0f;
+              if (dist < 0.0f) dist = 0.0f;
             }
           }
-          
-          GLfloat pf = (GLfloat)(pow( (perlin->Get(xp,yp)+1.0f) * 0.5f, mod->perlin_strength->get())* dist);
-          if (mod->alpha->get())
+
+          if (w->bpp == 4)
           {
-            p[0] = mod->color->get(0);
-            p[1] = mod->color->get(1);
-            p[2] = mod->color->get(2);
-            p[3] = max(0.0f,min(1.0f,pf * mod->color->get(3)));
-          } else {
-            p[0] = pf*mod->color->get(0);
-            p[1] = pf*mod->color->get(1);
-            p[2] = pf*mod->color->get(2);
-            p[3] = mod->color->get(3);
+            // integer data type
+            vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)data + row * size + x0 + i;
+            float pf = pow( (noise[i]+1.0f) * 0.5f, w->strength) * 255.0f * dist;
+            if (w->alpha)
+            {
+              long pr = max(0,min(255,(long)(255.0f * w->color[0])));
+              long pg = max(0,min(255,(long)(255.0f * w->color[1])));
+              long pb = max(0,min(255,(long)(255.0f * w->color[2])));
+              long pa = max(0,min(255,(long)(pf * w->color[3])));
+              *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
+            } else
+            {
+              long pr = max(0,min(255,(long)(pf * w->color[0])));
+              long pg = max(0,min(255,(long)(pf * w->color[1])));
+              long pb = max(0,min(255,(long)(pf * w->color[2])));
+              long pa = (long)(255.0f * w->color[3]);
+              *p = 0x01000000 * pa | pb * 0x00010000 | pg * 0x00000100 | pr;
+            }
+          }
+          else
+          {
+            // float data type
+            GLfloat *p = (GLfloat*)data + (row * size + x0 + i) * 4;
+            GLfloat pf = (GLfloat)(pow( (noise[i]+1.0f) * 0.5f, w->strength)* dist);
+            if (w->alpha)
+            {
+              p[0] = w->color[0];
+              p[1] = w->color[1];
+              p[2] = w->color[2];
+              p[3] = max(0.0f,min(1.0f,pf * w->color[3]));
+            } else {
+              p[0] = pf*w->color[0];
+              p[1] = pf*w->color[1];
+              p[2] = pf*w->color[2];
+              p[3] = w->color[3];
+            }
           }
-          ++p;
-          ++p;
-          ++p;
-          ++p;
-          xp += divisor;
         }
-        yp += divisor;
       }
     }
-    delete perlin;
-    mod->work_bitmap->timestamp++;
-    mod->work_bitmap->valid = true;
-    mod->thread_state = 2;
-    // the thread will die here.
-    return 0;
   }
 
   void module_info(vsx_module_info* info)
@@ -232,9 +206,6 @@ public:
 
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
-    thread_state = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
 
     rand_seed = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"rand_seed");
@@ -275,7 +246,7 @@ public:
     color->set(1.0f, 3);
     
     
-    work_bitmap = &bitm;
+    tiles.init(&bitm);
     bitm.data = 0;
     bitm.bpp = 4;
     bitm.bformat = GL_RGBA;
@@ -285,78 +256,40 @@ public:
     need_to_rebuild = true;
     //bitm.data = new vsx_bitmap_32bt[256*256];
     //bitm.size_y = bitm.size_x = 256;
-    to_delete_data = 0;
-    old_bitmap_type = 0;
   }
-  void *to_delete_data;
-  int  to_delete_type;
   void run() {
-    // initialize our worker thread, we don't want to keep the renderloop waiting do we?
-    if (!worker_running)
-    if (p_updates != param_updates)
+    // a finished generation replaces the bitmap in one go
+    if (tiles.collect())
     {
-      //need_to_rebuild = false;
-      if (i_size != 8 << size->get() || old_bitmap_type != bitmap_type->get()) {
-        i_size = 8 << size->get();
-        if (bitm.data)
-        {
-          to_delete_type = bitm.bformat;
-          to_delete_data = (void*)bitm.data;
-        }
-        old_bitmap_type = bitmap_type->get();
-        switch (old_bitmap_type)
-        {
-          case 0:
-            bitm.bpp = 4;
-            bitm.data = new vsx_bitmap_32bt[i_size*i_size];
-            break;
-          case 1:
-            bitm.bpp = GL_RGBA32F_ARB;
-            bitm.data = new GLfloat[i_size*i_size*4];
-            break;
-        }
-        bitm.size_y = bitm.size_x = i_size;
-      }
-
-      p_updates = param_updates;
-      bitm.valid = false;
-      //printf("creating thread\n");
-      thread_state = 1;
-      worker_running = true;
-      pthread_create(&worker_t, NULL, &worker, (void*)this);
-      thread_created = true;
-
-      //printf("done creating thread\n");
+      result1->set_p(bitm);
+      loading_done = true;
     }
-    if (thread_state == 2) {
-      if (bitm.valid && bitm_timestamp != bitm.timestamp) {
-        pthread_join(worker_t,0);
-        worker_running = false;
-        // ok, new version
-        //printf("uploading subplasma to param\n");
-        bitm_timestamp = bitm.timestamp;
-        result1->set_p(bitm);
-        loading_done = true;
-      }
-      thread_state = 3;
-    }
-    if (to_delete_data && my_ref == 0)
+
+    if (!tiles.busy())
+    if (p_updates != param_updates)
     {
-      delete[] (vsx_bitmap_32bt*)to_delete_data;
-      to_delete_data = 0;
+      p_updates = param_updates;
+      i_size = 8 << size->get();
+      work.noise.init((int)rand_seed->get());
+      work.octaves = octave->get()+1;
+      work.frequency = (float)(frequency->get()+1);
+      work.divisor = 1.0f / (float)i_size;
+      work.bpp = bitmap_type->get() ? GL_RGBA32F_ARB : 4;
+      work.enable_blob = enable_blob->get();
+      work.attenuation = attenuation->get();
+      work.arms = arms->get()*0.5f;
+      work.star_flower = star_flower->get();
+      work.angle = angle->get();
+      work.strength = perlin_strength->get();
+      work.alpha = alpha->get();
+      for (int i = 0; i < 4; i++)
+        work.color[i] = color->get(i);
+      tiles.start(i_size, work.bpp, 0, &generate_rows, (void*)&work);
     }
   }
 
   void on_delete() {
-    // wait for thread to finish
-    void* ret;
-    if (worker_running)
-    {
-      pthread_join(worker_t,&ret);
-    }
-    if (bitm.data)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    tiles.wait();
+    tiles.free_buffers();
   }
 };
@@ -34,8 +34,6 @@ class module_bitmap_plasma : public vsx_module {
   vsx_bitmap bitm;
   int bitm_timestamp;
 
-  pthread_t	worker_t;
-
   int p_updates;
   int my_ref;
 
@@ -61,93 +59,95 @@ public:
   vsx_module_param_float3* a_ofs;
   vsx_module_param_int* size;
   
-  vsx_bitmap*       work_bitmap;
-  bool              thread_created;
-  bool              worker_running;
-  int               thread_state;
   int               i_size;
+  texgen_tiles      tiles;
 
-  // our worker thread, to keep the tough generating work off the main loop
-  // this is a fairly simple operation, but when you want to generate fractals
-  // and decode film, you could run into several seconds of processing time. 
-  static void* worker(void *ptr) {
-    
-    ((module_bitmap_plasma*)ptr)->worker_running = true;
-    int x,y;
-    module_bitmap_plasma* mod = ((module_bitmap_plasma*)ptr);
-    float rpx = mod->r_period->get(0);
-    float rpy = mod->r_period->get(1);
-    float gpx = mod->g_period->get(0);
-    float gpy = mod->g_period->get(1);
-    float bpx = mod->b_period->get(0);
-    float bpy = mod->b_period->get(1);
-    float apx = mod->a_period->get(0);
-    float apy = mod->a_period->get(1);
+  // parameters of the generation in flight. sin(x) * sin(y) separates, so
+  // the x half of every channel is tabled once per generation and each row
+  // only needs its own y half.
+  struct plasma_work
+  {
+    float period[4][2];
+    float ofs[4][2];
+    float amp[4];
+    float col_ofs[4];
+    vsx_array<float> sin_x[4];
+  } work;
 
-    float rox = mod->r_ofs->get(0);
-    float roy = mod->r_ofs->get(1);
-    float gox = mod->g_ofs->get(0);
-    float goy = mod->g_ofs->get(1);
-    float box = mod->b_ofs->get(0);
-    float boy = mod->b_ofs->get(1);
-    float aox = mod->a_ofs->get(0);
-    float aoy = mod->a_ofs->get(1);
-    
-    float ramp = mod->col_amp->get(0)*127.0f;
-    float gamp = mod->col_amp->get(1)*127.0f;
-    float bamp = mod->col_amp->get(2)*127.0f;
-    float aamp = mod->col_amp->get(3)*127.0f;
+  static void prepare(void* arg, int size)
+  {
+    plasma_work* w = (plasma_work*)arg;
+    int hsize = size >> 1;
+    float step = (float)(2.0f*PI)/(float)size;
+    for (int c = 0; c < 4; c++)
+    {
+      w->sin_x[c].allocate(size - 1);
+      float* t = w->sin_x[c].get_pointer();
+      for (int x = -hsize; x < hsize; ++x)
+        t[x + hsize] = (float)sin((x*step+w->ofs[c][0])*w->period[c][0]);
+    }
+  }
 
-    float rofs = mod->col_ofs->get(0)*127.0f;
-    float gofs = mod->col_ofs->get(1)*127.0f;
-    float bofs = mod->col_ofs->get(2)*127.0f;
-    float aofs = mod->col_ofs->get(3)*127.0f;
+  static void generate_rows(void* arg, void* data, int size, int y0, int y1)
+  {
+    plasma_work* w = (plasma_work*)arg;
+    int hsize = size >> 1;
+    float step = (float)(2.0f*PI)/(float)size;
+    const float* sx[4];
+    for (int c = 0; c < 4; c++)
+      sx[c] = w->sin_x[c].get_pointer();
 
-    //float attenuation = ((module_bitmap_plasma*)ptr)->attenuation->get();
-    //float arms = ((module_bitmap_plasma*)ptr)->arms->get()*0.5f;
-    //float star_flower = ((module_bitmap_plasma*)ptr)->star_flower->get();
-    //float angle = ((module_bitmap_plasma*)ptr)->angle->get();
-    vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)((module_bitmap_plasma*)ptr)->work_bitmap->data;
-    int ssize = ((module_bitmap_plasma*)ptr)->i_size;
-    int hsize = ssize >> 1;
-    //float sp1 = (float)size + 1.0f;
-    float size = (float)(2.0f*PI)/(float)ssize;
-    
-    for(y = -hsize; y < hsize; ++y)
+    for (int row = y0; row < y1; ++row)
     {
-      for(x = -hsize; x < hsize; ++x,p++)
-      {
-        //float xx = (size/(size-2.0f))*((float)x)+0.5f;
-        //float yy = (size/(size-2.0f))*((float)y)+0.5f;
-        long r = (long)round(fmod(fabs((sin((x*size+rox)*rpx)*sin((y*size+roy)*rpy)+1.0f)*ramp+rofs),255.0));
-        long g = (long)round(fmod(fabs((sin((x*size+gox)*gpx)*sin((y*size+goy)*gpy)+1.0f)*gamp+gofs),255.0));
-        long b = (long)round(fmod(fabs((sin((x*size+box)*bpx)*sin((y*size+boy)*bpy)+1.0f)*bamp+bofs),255.0));
-        long a = (long)round(fmod(fabs((sin((x*size+aox)*apx)*sin((y*size+aoy)*apy)+1.0f)*aamp+aofs),255.0));
-        //long a = 255;
-        //long g = 0;
-        //long b = 0;
-        //if((long)(dd) > hsize) *p = 0;
-        //else {
-/*          float phase;
-          float dstf = dd/((float)hsize+1);
-          phase = pow(1 - fabs(cos(angle+arms*atan2(xx,yy)))*(star_flower+(1-star_flower)*(((dstf)))),attenuation);
-          if (phase > 2.0) phase = 1.0;
-          *p = (long)(255.0f * (cos(((dstf * PI/2.0f)))*phase));
-          if (*p > 255) *p = 255;
-          if (*p < 0) *p = 0;
-        }*/
-        *p = 0x01000000 * a | b * 0x00010000 | g * 0x00000100 | r;
+      int y = row - hsize;
+      float sy[4];
+      for (int c = 0; c < 4; c++)
+        sy[c] = (float)sin((y*step+w->ofs[c][1])*w->period[c][1]);
 
+      vsx_bitmap_32bt* p = (vsx_bitmap_32bt*)data + row * size;
+      int x = 0;
+#if defined(VSX_MATH_3D_SSE2)
+      __m128 one = _mm_set1_ps(1.0f);
+      __m128 v255 = _mm_set1_ps(255.0f);
+      __m128 inv255 = _mm_set1_ps(1.0f / 255.0f);
+      __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+      __m128 vsy[4], vamp[4], vofs[4];
+      for (int c = 0; c < 4; c++)
+      {
+        vsy[c] = _mm_set1_ps(sy[c]);
+        vamp[c] = _mm_set1_ps(w->amp[c]);
+        vofs[c] = _mm_set1_ps(w->col_ofs[c]);
+      }
+      for (; x + 4 <= size; x += 4)
+      {
+        __m128i pixel = _mm_setzero_si128();
+        for (int c = 3; c >= 0; c--)
+        {
+          // fmod(fabs((sx * sy + 1) * amp + ofs), 255), rounded
+          __m128 v = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&sx[c][x]), vsy[c]), one), vamp[c]), vofs[c]);
+          v = _mm_and_ps(v, abs_mask);
+          __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(v, inv255)));
+          v = _mm_max_ps(_mm_sub_ps(v, _mm_mul_ps(q, v255)), _mm_setzero_ps());
+          pixel = _mm_or_si128(_mm_slli_epi32(pixel, 8), _mm_cvtps_epi32(v));
+        }
+        _mm_storeu_si128((__m128i*)&p[x], pixel);
+      }
+#endif
+      for (; x < size; x++)
+      {
+        vsx_bitmap_32bt pixel = 0;
+        for (int c = 3; c >= 0; c--)
+        {
+          float v = fabs((sx[c][x]*sy[c]+1.0f)*w->amp[c]+w->col_ofs[c]);
+          v -= floor(v * (1.0f / 255.0f)) * 255.0f;
+          if (v < 0.0f) v = 0.0f;
+          pixel = pixel << 8 | (vsx_bitmap_32bt)(long)round(v);
+        }
+        p[x] = pixel;
       }
-    }// for y
-    ((module_bitmap_plasma*)ptr)->work_bitmap->timestamp++;
-    ((module_bitmap_plasma*)ptr)->work_bitmap->valid = true;
-    ((module_bitmap_plasma*)ptr)->thread_state = 2;
-    //printf("blob thread done\n");
-    // the thread will die here.
-    return 0;
+    }
   }
-  
+
   void module_info(vsx_module_info* info)
   {
     info->in_param_spec = "settings:complex{\
@@ -179,9 +179,6 @@ size:enum?8x8|16x16|32x32|64x64|128x128|256x256|512x512|1024x1024";
   
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
-    thread_state = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
 
     col_amp = (vsx_module_param_float4*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT4,"col_amp");
@@ -220,7 +217,7 @@ size:enum?8x8|16x16|32x32|64x64|128x128|256x256|512x512|1024x1024";
     i_size = 0;
   	result1 = (vsx_module_param_bitmap*)out_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"bitmap");
     result1->set_p(bitm);
-    work_bitmap = &bitm;
+    tiles.init(&bitm);
     bitm.data = 0;
     bitm.bpp = 4;
     bitm.bformat = GL_RGBA;
@@ -228,49 +225,32 @@ size:enum?8x8|16x16|32x32|64x64|128x128|256x256|512x512|1024x1024";
     my_ref = 0;
     bitm_timestamp = bitm.timestamp = rand();
     need_to_rebuild = true;
-    to_delete_data = 0;
   }
-  void *to_delete_data;
   void run() {
-    // initialize our worker thread, we don't want to keep the renderloop waiting do we?
-    if (!worker_running)
-    if (p_updates != param_updates) {
-      //need_to_rebuild = false;
-      if (i_size != 8 << size->get()) {
-        i_size = 8 << size->get();
-        if (bitm.data) to_delete_data = bitm.data;
-        //if (bitm.data) delete[] bitm.data;
-        bitm.data = new vsx_bitmap_32bt[i_size*i_size];
-        bitm.size_y = bitm.size_x = i_size;
-      }
+    // a finished generation replaces the bitmap in one go
+    if (tiles.collect())
+    {
+      result1->set_p(bitm);
+      loading_done = true;
+    }
 
+    if (!tiles.busy())
+    if (p_updates != param_updates) {
       p_updates = param_updates;
-      bitm.valid = false;
-      //printf("creating thread\n");
-      thread_state = 1;
-      thread_created = true;
-      worker_running = true;
-      pthread_create(&worker_t, NULL, &worker, (void*)this);
-
-      //printf("done creating thread\n");
-    }
-    if (thread_state == 2) {
-      if (bitm.valid && bitm_timestamp != bitm.timestamp) {
-        pthread_join(worker_t,NULL);
-        worker_running = false;
-        // ok, new version
-        //printf("uploading blob to vram\n");
-        bitm_timestamp = bitm.timestamp;
-        result1->set_p(bitm);
-        loading_done = true;
-        if (to_delete_data)
-        {
-          delete[] (vsx_bitmap_32bt*)to_delete_data;
-          to_delete_data = 0;
-        }
+      i_size = 8 << size->get();
+      vsx_module_param_float3* periods[4] = {r_period, g_period, b_period, a_period};
+      vsx_module_param_float3* offsets[4] = {r_ofs, g_ofs, b_ofs, a_ofs};
+      for (int c = 0; c < 4; c++)
+      {
+        work.period[c][0] = periods[c]->get(0);
+        work.period[c][1] = periods[c]->get(1);
+        work.ofs[c][0] = offsets[c]->get(0);
+        work.ofs[c][1] = offsets[c]->get(1);
+        work.amp[c] = col_amp->get(c)*127.0f;
+        work.col_ofs[c] = col_ofs->get(c)*127.0f;
       }
-      thread_state = 3;
-    }  
+      tiles.start(i_size, 4, &prepare, &generate_rows, (void*)&work);
+    }
   }
   void start() {
   }  
@@ -278,15 +258,7 @@ size:enum?8x8|16x16|32x32|64x64|128x128|256x256|512x512|1024x1024";
   void stop() {}
   
   void on_delete() {
-    if (worker_running)
-    {
-      // wait for thread to finish
-      void* ret;
-      pthread_join(worker_t,&ret);
-    }
-    if  (bitm.data)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    tiles.wait();
+    tiles.free_buffers();
   }
 };
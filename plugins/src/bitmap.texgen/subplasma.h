@@ -62,9 +62,6 @@ class module_bitmap_subplasma : public vsx_module {
 	vsx_bitmap bitm;
 	int bitm_timestamp;
 	
-  pthread_t					worker_t;
-  pthread_attr_t		worker_t_attr;
-
   int p_updates;
   int my_ref;
 
@@ -74,134 +71,115 @@ public:
   vsx_module_param_int* size;
   vsx_module_param_int* amplitude;
   
-  vsx_bitmap*       work_bitmap;
-  bool              thread_created;
-  bool              worker_running;
-  int               thread_state;
   int               i_size;
+  texgen_tiles      tiles;
 
-  // our worker thread, to keep the tough generating work off the main loop
-  // this is a fairly simple operation, but when you want to generate fractals
-  // and decode film, you could run into several seconds of processing time. 
-  static void* worker(void *ptr) {
-    
-    int x,y;
-    module_bitmap_subplasma* mod = ((module_bitmap_subplasma*)ptr);
-    /*float rpx = mod->r_period->get(0);
-    float rpy = mod->r_period->get(1);
-    float gpx = mod->g_period->get(0);
-    float gpy = mod->g_period->get(1);
-    float bpx = mod->b_period->get(0);
-    float bpy = mod->b_period->get(1);
-    float apx = mod->a_period->get(0);
-    float apy = mod->a_period->get(1);
-
-    float rox = mod->r_ofs->get(0);
-    float roy = mod->r_ofs->get(1);
-    float gox = mod->g_ofs->get(0);
-    float goy = mod->g_ofs->get(1);
-    float box = mod->b_ofs->get(0);
-    float boy = mod->b_ofs->get(1);
-    float aox = mod->a_ofs->get(0);
-    float aoy = mod->a_ofs->get(1);
-    
-    float ramp = mod->col_amp->get(0)*127.0;
-    float gamp = mod->col_amp->get(1)*127.0;
-    float bamp = mod->col_amp->get(2)*127.0;
-    float aamp = mod->col_amp->get(3)*127.0;
-
-    float rofs = mod->col_ofs->get(0)*127.0;
-    float gofs = mod->col_ofs->get(1)*127.0;
-    float bofs = mod->col_ofs->get(2)*127.0;
-    float aofs = mod->col_ofs->get(3)*127.0;
-
-    float attenuation = ((module_bitmap_subplasma*)ptr)->attenuation->get();
-    float arms = ((module_bitmap_subplasma*)ptr)->arms->get()*0.5f;
-    float star_flower = ((module_bitmap_subplasma*)ptr)->star_flower->get();
-    float angle = ((module_bitmap_subplasma*)ptr)->angle->get();*/
-//    int gsize = ((module_bitmap_subplasma*)ptr)->i_size;
-    //int hsize = ssize >> 1;
-    //float sp1 = (float)size + 1.0f;
-    //float size = (2.0f*pi)/(float)ssize;
-  
-  unsigned char* SubPlasma = new unsigned char[mod->i_size * mod->i_size];
-  for (x = 0; x < mod->i_size*mod->i_size; ++x) { SubPlasma[x] = 0; }
-  int np=2 << mod->amplitude->get();
-  //int rx=256;
-  //int ry=256;
-
-  unsigned int musize = mod->i_size-1;
-
-  //int ssize=rx/np;
-
-  unsigned int mmu = (unsigned int)(((float)mod->i_size/(float)np));
-  //printf("mmu: %d\n", mmu);
-  unsigned int mm1 = mmu-1;
-  unsigned int mm2 = mmu*2;
-  float mmf = (float)mmu;
-
-  vsx_rand rand;
-
-  rand.srand((int)mod->rand_seed->get());
-  for (y=0; y < np; y++)
-    for (x=0; x < np; x++)
-      SubPlasma[x*mmu+y*mmu*mod->i_size] = rand.rand();
-
-  for (y=0; y<np; y++)
-    for (x=0; x<mod->i_size; x++) {
-      int p=x&(~mm1);
-      int zy=y*mmu*mod->i_size;
-      SubPlasma[x+zy] = catmullrom_interpolate(
-        SubPlasma[((p-mmu)&musize)+zy],
-        SubPlasma[((p   )&musize)+zy],
-        SubPlasma[((p+mmu)&musize)+zy],
-        SubPlasma[((p+mm2)&musize)+zy],
-        (x&mm1)/mmf);
-    }
-
-  int sl = mod->size->get()+3;
-  for (y=0; y<mod->i_size; y++)
-    for (x=0; x<mod->i_size; x++) {
-      int p=y&(~(mm1));
-      SubPlasma[x+y*mod->i_size] = catmullrom_interpolate(
-        SubPlasma[x+(((p-mmu)&musize)<<sl)],
-        SubPlasma[x+(((p   )&musize)<<sl)],
-        SubPlasma[x+(((p+mmu)&musize)<<sl)],
-        SubPlasma[x+(((p+mm2)&musize)<<sl)],
-        (y&(mm1))/mmf);
-    }
-
-  vsx_bitmap_32bt *p = (vsx_bitmap_32bt*)((module_bitmap_subplasma*)ptr)->work_bitmap->data;
-
+  // The plasma is np * np random seeds, catmull-rom interpolated first
+  // along x and then along y. The x pass only touches the np seed rows so
+  // it's done up front; the y pass reads from those and fills the bitmap
+  // one independent row at a time.
+  struct subplasma_work
+  {
+    int seed;
+    int np;
+    int mmu; // distance between seeds
+    vsx_array<unsigned char> seed_rows; // np rows of i_size
+  } work;
 
-    for (x = 0; x < mod->i_size * (mod->i_size); ++x, p++)
+  static void prepare(void* arg, int size)
+  {
+    subplasma_work* w = (subplasma_work*)arg;
+    int np = w->np;
+    unsigned int mmu = w->mmu;
+    unsigned int mm1 = mmu-1;
+    unsigned int mm2 = mmu*2;
+    unsigned int musize = size-1;
+    float mmf = (float)mmu;
+
+    w->seed_rows.allocate(np * size - 1);
+    unsigned char* seeds = w->seed_rows.get_pointer();
+    unsigned char* row = new unsigned char[size];
+
+    vsx_rand rand;
+    rand.srand(w->seed);
+    for (int y = 0; y < np; y++)
+      for (int x = 0; x < np; x++)
+        seeds[x*mmu+y*size] = rand.rand();
+
+    for (int y = 0; y < np; y++)
     {
-      //if (SubPlasma[x] != 0)
-      //printf("SubPlasma[x] = %d,", SubPlasma[x]);
-      *p = 0xFF000000 | ((vsx_bitmap_32bt)SubPlasma[x]) << 16 | (vsx_bitmap_32bt)SubPlasma[x] << 8 | (vsx_bitmap_32bt)SubPlasma[x];// | 0 * 0x00000100 | 0;
-
+      unsigned char* s = &seeds[y*size];
+      for (int x = 0; x < size; x++)
+      {
+        int p = x&(~mm1);
+        row[x] = catmullrom_interpolate(
+          s[(p-mmu)&musize],
+          s[(p    )&musize],
+          s[(p+mmu)&musize],
+          s[(p+mm2)&musize],
+          (x&mm1)/mmf);
+      }
+      memcpy(s, row, size);
     }
+    delete[] row;
+  }
 
-    delete[] SubPlasma;
-    /*for(y = -hsize; y < hsize; ++y)
-      for(x = -hsize; x < hsize; ++x,p++)
+  static void generate_rows(void* arg, void* data, int size, int y0, int y1)
+  {
+    subplasma_work* w = (subplasma_work*)arg;
+    int np = w->np;
+    unsigned int mmu = w->mmu;
+    unsigned int mm1 = mmu-1;
+    float mmf = (float)mmu;
+    const unsigned char* seeds = w->seed_rows.get_pointer();
+
+    for (int y = y0; y < y1; y++)
+    {
+      int j = y / mmu;
+      const unsigned char* r0 = &seeds[((j-1+np)%np)*size];
+      const unsigned char* r1 = &seeds[j*size];
+      const unsigned char* r2 = &seeds[((j+1)%np)*size];
+      const unsigned char* r3 = &seeds[((j+2)%np)*size];
+      float xx = (y&mm1)/mmf;
+      vsx_bitmap_32bt* p = (vsx_bitmap_32bt*)data + y * size;
+      int x = 0;
+#if defined(VSX_MATH_3D_SSE2)
+      // same float math as catmullrom_interpolate, 4 pixels at a time
+      __m128 vxx = _mm_set1_ps(xx);
+      __m128i zero = _mm_setzero_si128();
+      __m128i v255 = _mm_set1_epi32(255);
+      __m128i alpha = _mm_set1_epi32(0xFF000000);
+      for (; x + 4 <= size; x += 4)
       {
-        float xx = (size/(size-2.0f))*((float)x)+0.5f;
-        float yy = (size/(size-2.0f))*((float)y)+0.5f;
-        long r = (long)round(fmod(fabs((sin((x*size+rox)*rpx)*sin((y*size+roy)*rpy)+1.0f)*ramp+rofs),255.0));
-        long g = (long)round(fmod(fabs((sin((x*size+gox)*gpx)*sin((y*size+goy)*gpy)+1.0f)*gamp+gofs),255.0));
-        long b = (long)round(fmod(fabs((sin((x*size+box)*bpx)*sin((y*size+boy)*bpy)+1.0f)*bamp+bofs),255.0));
-        long a = (long)round(fmod(fabs((sin((x*size+aox)*apx)*sin((y*size+aoy)*apy)+1.0f)*aamp+aofs),255.0));
-        *p = 0x01000000 * a | b * 0x00010000 | g * 0x00000100 | r;
-      }*/
-    ((module_bitmap_subplasma*)ptr)->work_bitmap->timestamp++;
-    ((module_bitmap_subplasma*)ptr)->work_bitmap->valid = true;
-    ((module_bitmap_subplasma*)ptr)->thread_state = 2;
-    //printf("blob thread done\n");
-    // the thread will die here.
-    return 0;
+        __m128i v0 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(int*)&r0[x]), zero), zero);
+        __m128i v1 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(int*)&r1[x]), zero), zero);
+        __m128i v2 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(int*)&r2[x]), zero), zero);
+        __m128i v3 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(int*)&r3[x]), zero), zero);
+        __m128i a = _mm_sub_epi32(v0, v1);
+        __m128i P = _mm_sub_epi32(_mm_sub_epi32(v3, v2), a);
+        __m128i Q = _mm_sub_epi32(a, P);
+        __m128i R = _mm_sub_epi32(v2, v0);
+        __m128 t = _mm_mul_ps(vxx, _mm_cvtepi32_ps(P));
+        t = _mm_mul_ps(vxx, _mm_add_ps(_mm_cvtepi32_ps(Q), t));
+        t = _mm_mul_ps(vxx, _mm_add_ps(_mm_cvtepi32_ps(R), t));
+        t = _mm_add_ps(_mm_cvtepi32_ps(v1), t);
+        __m128i g = _mm_cvttps_epi32(t);
+        // clamp to 0..255
+        g = _mm_and_si128(g, _mm_cmpgt_epi32(g, zero));
+        __m128i over = _mm_cmpgt_epi32(g, v255);
+        g = _mm_or_si128(_mm_andnot_si128(over, g), _mm_and_si128(over, v255));
+        __m128i pixel = _mm_or_si128(alpha, _mm_or_si128(g, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(g, 16))));
+        _mm_storeu_si128((__m128i*)&p[x], pixel);
+      }
+#endif
+      for (; x < size; x++)
+      {
+        vsx_bitmap_32bt g = catmullrom_interpolate(r0[x], r1[x], r2[x], r3[x], xx);
+        p[x] = 0xFF000000 | g << 16 | g << 8 | g;
+      }
+    }
   }
-  
+
   void module_info(vsx_module_info* info)
   {
     info->in_param_spec = "rand_seed:float,size:enum?8x8|16x16|32x32|64x64|128x128|256x256|512x512|1024x1024,\
@@ -218,9 +196,6 @@ amplitude:enum?2|4|8|16|32|64|128|256|512";
   
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
-    thread_state = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
 
 
@@ -236,7 +211,7 @@ amplitude:enum?2|4|8|16|32|64|128|256|512";
     i_size = 0;
   	result1 = (vsx_module_param_bitmap*)out_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"bitmap");
     result1->set_p(bitm);
-    work_bitmap = &bitm;
+    tiles.init(&bitm);
     bitm.data = 0;
     bitm.bpp = 4;
     bitm.bformat = GL_RGBA;
@@ -246,62 +221,30 @@ amplitude:enum?2|4|8|16|32|64|128|256|512";
     need_to_rebuild = true;
     //bitm.data = new vsx_bitmap_32bt[256*256];
     //bitm.size_y = bitm.size_x = 256;
-    to_delete_data = 0;
   }
-  void *to_delete_data;
   void run() {
-    // initialize our worker thread, we don't want to keep the renderloop waiting do we?
-    if (!worker_running)
-    if (p_updates != param_updates) {
-      //need_to_rebuild = false;
-      if (i_size != 8 << size->get()) {
-        i_size = 8 << size->get();
-        if (bitm.data) to_delete_data = bitm.data;   
-          //delete[] bitm.data;
-        bitm.data = new vsx_bitmap_32bt[i_size*i_size];
-        bitm.size_y = bitm.size_x = i_size;
-      }
+    // a finished generation replaces the bitmap in one go
+    if (tiles.collect())
+    {
+      result1->set_p(bitm);
+      loading_done = true;
+    }
 
+    if (!tiles.busy())
+    if (p_updates != param_updates) {
       p_updates = param_updates;
-      bitm.valid = false;
-      //printf("creating thread\n");
-      pthread_attr_init(&worker_t_attr);
-      thread_state = 1;
-      worker_running = true;
-      thread_created = true;
-      pthread_create(&worker_t, &worker_t_attr, &worker, (void*)this);
-
-      //printf("done creating thread\n");
-    }
-    if (thread_state == 2) {
-      if (bitm.valid && bitm_timestamp != bitm.timestamp)
-      {
-        pthread_join(worker_t,0);
-        worker_running = false;
-        // ok, new version
-        //printf("uploading subplasma to param\n");
-        bitm_timestamp = bitm.timestamp;
-        result1->set_p(bitm);
-        loading_done = true;
-      }
-      thread_state = 3;
-    }  
-    if (to_delete_data && my_ref == 0)
-    {
-      delete[] (vsx_bitmap_32bt*)to_delete_data;
-      to_delete_data = 0;
+      i_size = 8 << size->get();
+      work.seed = (int)rand_seed->get();
+      // more seeds than pixels makes no sense, cap it at one per pixel
+      work.np = 2 << amplitude->get();
+      if (work.np > i_size) work.np = i_size;
+      work.mmu = i_size / work.np;
+      tiles.start(i_size, 4, &prepare, &generate_rows, (void*)&work);
     }
   }
   
   void on_delete() {
-    if (worker_running)
-    {
-      // wait for thread to finish
-      pthread_join(worker_t,NULL);
-    }
-    if (bitm.data)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    tiles.wait();
+    tiles.free_buffers();
   }
 };
@@ -0,0 +1,205 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef TEXGEN_TILES_H
+#define TEXGEN_TILES_H
+
+#include "vsx_math_3d.h"
+#include "vsx_thread_pool.h"
+#include "vsx_background_job.h"
+#include "vsx_bitmap.h"
+#if defined(VSX_MATH_3D_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Background generation of the texgen bitmaps.
+//
+// A generation runs as one job on the engine thread pool which splits the
+// rows of the bitmap up in bands over all cores. It writes into a back
+// buffer; the module's output bitmap keeps pointing at the last complete
+// frame until collect() swaps the new one in and bumps the timestamp, so
+// consumers only ever see (and upload) finished frames.
+//
+// Usage from the module, all on the render thread:
+//   if (!tiles.busy() && params changed) { snapshot params; tiles.start(...) }
+//   if (tiles.collect()) result->set_p(bitm);
+//   on_delete: tiles.wait(); tiles.free_buffers();
+
+// smallest amount of pixels worth handing to another thread
+#define TEXGEN_TILE_PIXELS 16384
+
+// fills rows [y0, y1) of a bitmap size pixels wide
+typedef void (*texgen_rows_func)(void* arg, void* data, int size, int y0, int y1);
+
+// runs once before the rows, on the job's thread; size is the width
+typedef void (*texgen_prepare_func)(void* arg, int size);
+
+class texgen_buffer
+{
+public:
+  void* data;
+  int size_x;
+  int size_y;
+  int bpp; // 4 or GL_RGBA32F_ARB, like vsx_bitmap
+
+  texgen_buffer()
+  {
+    data = 0;
+    size_x = size_y = 0;
+    bpp = 4;
+  }
+
+  void allocate(int n_size_x, int n_size_y, int n_bpp)
+  {
+    if (data && size_x == n_size_x && size_y == n_size_y && bpp == n_bpp)
+      return;
+    free_data();
+    size_x = n_size_x;
+    size_y = n_size_y;
+    bpp = n_bpp;
+    if (bpp == 4)
+      data = (void*)new vsx_bitmap_32bt[size_x * size_y];
+    else
+      data = (void*)new GLfloat[size_x * size_y * 4];
+  }
+
+  void free_data()
+  {
+    if (!data) return;
+    if (bpp == 4)
+      delete[] (vsx_bitmap_32bt*)data;
+    else
+      delete[] (GLfloat*)data;
+    data = 0;
+  }
+};
+
+class texgen_tiles
+{
+  vsx_bitmap* target;
+  texgen_buffer buffers[2];
+  int front;
+
+  vsx_background_job background;
+
+  // current job
+  texgen_prepare_func prepare_func;
+  texgen_rows_func rows_func;
+  void* arg;
+
+  static void rows_job(void* ptr, size_t start, size_t end)
+  {
+    texgen_tiles* t = (texgen_tiles*)ptr;
+    texgen_buffer& b = t->buffers[t->front ^ 1];
+    t->rows_func(t->arg, b.data, b.size_x, (int)start, (int)end);
+  }
+
+  static void job(void* ptr)
+  {
+    texgen_tiles* t = (texgen_tiles*)ptr;
+    texgen_buffer& b = t->buffers[t->front ^ 1];
+    if (t->prepare_func)
+      t->prepare_func(t->arg, b.size_x);
+    vsx_thread_pool::get_instance()->parallel_for(
+      b.size_y,
+      TEXGEN_TILE_PIXELS / b.size_x + 1,
+      &rows_job,
+      ptr
+    );
+  }
+
+public:
+
+  texgen_tiles()
+  {
+    target = 0;
+    front = 0;
+  }
+
+  ~texgen_tiles()
+  {
+    wait();
+    free_buffers();
+  }
+
+  void init(vsx_bitmap* n_target)
+  {
+    target = n_target;
+  }
+
+  bool busy()
+  {
+    return background.busy();
+  }
+
+  // arg must stay untouched until the generation has been collected
+  void start(int size, int bpp, texgen_prepare_func n_prepare_func, texgen_rows_func n_rows_func, void* n_arg)
+  {
+    start(size, size, bpp, n_prepare_func, n_rows_func, n_arg);
+  }
+
+  void start(int size_x, int size_y, int bpp, texgen_prepare_func n_prepare_func, texgen_rows_func n_rows_func, void* n_arg)
+  {
+    buffers[front ^ 1].allocate(size_x, size_y, bpp);
+    prepare_func = n_prepare_func;
+    rows_func = n_rows_func;
+    arg = n_arg;
+    background.start(&job, (void*)this);
+  }
+
+  // publishes a finished generation to the target bitmap, returns true if
+  // there was one
+  bool collect()
+  {
+    if (!background.collect())
+      return false;
+
+    front ^= 1;
+    texgen_buffer& b = buffers[front];
+    target->data = b.data;
+    target->size_x = b.size_x;
+    target->size_y = b.size_y;
+    target->bpp = b.bpp;
+    target->valid = true;
+    target->timestamp++;
+    return true;
+  }
+
+  void wait()
+  {
+    background.wait();
+  }
+
+  void free_buffers()
+  {
+    buffers[0].free_data();
+    buffers[1].free_data();
+    if (target)
+    {
+      target->data = 0;
+      target->valid = false;
+    }
+  }
+};
+
+#endif
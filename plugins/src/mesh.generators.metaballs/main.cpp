@@ -47,7 +47,7 @@ public:
   {
     info->identifier = "mesh;solid;metaballs";
     info->description = "Generates a metaballs mesh";
-    info->in_param_spec = "grid_size:float?nc=1";
+    info->in_param_spec = "grid_size:float?nc=1&min=2&max=256";
     info->out_param_spec = "mesh:mesh";
     info->component_class = "mesh";
   }
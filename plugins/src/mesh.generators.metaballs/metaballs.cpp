@@ -29,6 +29,10 @@
 #include "marching_cubes.h"
 //#include <memory.h>
 #include "vsx_math_3d.h"
+#include "vsx_thread_pool.h"
+#if defined(VSX_MATH_3D_SSE)
+#include <xmmintrin.h>
+#endif
 //#include "graphics.h"
 //#include <d3dx8.h>
 
@@ -43,21 +47,14 @@ CMetaballs::CMetaballs()
 	m_fLevel    = 100.0f;
 	m_nNumBalls = 12;
 
-	m_nGridSize = 0;
+	m_nGridSize  = 0;
+	m_fVoxelSize = 0;
 
-	m_nMaxOpenVoxels = 8;
-	m_pOpenVoxels    = new int[m_nMaxOpenVoxels*3];
-   
-	m_nNumOpenVoxels    = 0;
+	m_nFrame            = 0;
 	m_pfGridEnergy      = 0;
-	m_pnGridPointStatus = 0;
-	m_pnGridVoxelStatus = 0;
-
-	m_nNumVertices = 0;
-	m_nNumIndices  = 0;
-	m_nFacePart = 0;
-//	m_pVertices    = 0;
-//	m_pIndices     = 0;
+	m_pnGridPointStamp  = 0;
+	m_pnGridVoxelStamp  = 0;
+	m_pnGridVoxelRecord = 0;
 
 //	srand(timeGetTime());
 
@@ -75,12 +72,33 @@ CMetaballs::CMetaballs()
 		m_Balls[i].t = float(rand())/RAND_MAX;
 		m_Balls[i].m = 1;
 	}
+
+	// Edges run from their lower to their upper corner so the first corner
+	// of an edge gives the voxel owning it, the axis is the one that differs
+	for( int e = 0; e < 12; e++ )
+	{
+		float *p0 = CMarchingCubes::m_CubeVertices[CMarchingCubes::m_CubeEdges[e][0]];
+		float *p1 = CMarchingCubes::m_CubeVertices[CMarchingCubes::m_CubeEdges[e][1]];
+		m_EdgeOwner[e][0] = (int)p0[0];
+		m_EdgeOwner[e][1] = (int)p0[1];
+		m_EdgeOwner[e][2] = (int)p0[2];
+		m_EdgeOwner[e][3] = p0[0] != p1[0] ? 0 : (p0[1] != p1[1] ? 1 : 2);
+	}
+
+	for( int c = 0; c < 256; c++ )
+	{
+		int n = 0;
+		while( CMarchingCubes::m_CubeTriangles[c][n] != -1 )
+			n++;
+		m_CubeTriangleCount[c] = n / 3;
+	}
 }
 
 CMetaballs::~CMetaballs() {
 	delete[] m_pfGridEnergy;
-	delete[] m_pnGridPointStatus;
-	delete[] m_pnGridVoxelStatus;
+	delete[] m_pnGridPointStamp;
+	delete[] m_pnGridVoxelStamp;
+	delete[] m_pnGridVoxelRecord;
 }
 //=============================================================================
 void CMetaballs::Update(float dt)
@@ -162,51 +180,83 @@ void CMetaballs::Update(float dt)
 }
 
 //=============================================================================
+void CMetaballs::PrepareBalls()
+{
+	for( int i = 0; i < MAX_BALLS; i++ )
+	{
+		if( i < m_nNumBalls )
+		{
+			m_fBallX[i] = m_Balls[i].p[0];
+			m_fBallY[i] = m_Balls[i].p[1];
+			m_fBallZ[i] = m_Balls[i].p[2];
+			m_fBallM[i] = m_Balls[i].m;
+		}
+		else
+		{
+			m_fBallX[i] = m_fBallY[i] = m_fBallZ[i] = 1000.0f;
+			m_fBallM[i] = 0.0f;
+		}
+	}
+}
+
+//=============================================================================
+// The surface is found in three steps:
+//
+// 1. tracking - starting inside every ball we walk out to the surface and
+//    flood fill along it. Voxels are handled one wavefront at a time; the
+//    grid point energies a wavefront needs are computed on the thread pool
+//    before the cases are looked at.
+// 2. vertices - every surface voxel makes the vertices on the edges it owns,
+//    in parallel chunks.
+// 3. faces - every surface voxel emits its triangles, looking up the shared
+//    vertices through the edge owners, again in parallel chunks.
 void CMetaballs::Render()
 {
 	int nCase = 0,x,y,z;
-	bool bComputed;
-	
-
-	// Lock the vertex and index buffer
-//	CGraphics *pGfx = CGraphics::GetInstance();
-
-//	pGfx->LockVertexBuffer(MAX_VERTICES, (BYTE**)&m_pVertices);
-//	pGfx->LockIndexBuffer(MAX_INDICES, (BYTE**)&m_pIndices);
-	m_nNumIndices = 0;
-	m_nFacePart = 0;
-	m_nNumVertices = 0;
-	m_pVertices.reset_used(0);
+
 	vertices->reset_used(0);
-  vertex_normals->reset_used(0);
-  vertex_tex_coords->reset_used(0);
-  faces->reset_used(0);
-		// Clear status grids
-	memset(m_pnGridPointStatus, 0, sizeof(char)*(m_nGridSize+1)*(m_nGridSize+1)*(m_nGridSize+1));
-	memset(m_pnGridVoxelStatus, 0, sizeof(char)*m_nGridSize*m_nGridSize*m_nGridSize);
-	
+	vertex_normals->reset_used(0);
+	vertex_tex_coords->reset_used(0);
+	faces->reset_used(0);
+	m_SurfaceVoxels.reset_used(0);
+
+	if( !m_nGridSize )
+		return;
+
+	m_nFrame++;
+	if( m_nFrame == 0x7FFFFFFF )
+	{
+		// wrapped, start over with clean grids
+		int nPoints = (m_nGridSize+1)*(m_nGridSize+1)*(m_nGridSize+1);
+		int nVoxels = m_nGridSize*m_nGridSize*m_nGridSize;
+		memset(m_pnGridPointStamp, 0, sizeof(int)*nPoints);
+		memset(m_pnGridVoxelStamp, 0, sizeof(int)*nVoxels);
+		m_nFrame = 1;
+	}
+
+	PrepareBalls();
+
 	for( int i = 0; i < m_nNumBalls; i++ )
 	{
-//    printf("ball: %d\n",i);
 		x = ConvertWorldCoordinateToGridPoint(m_Balls[i].p[0]);
 		y = ConvertWorldCoordinateToGridPoint(m_Balls[i].p[1]);
 		z = ConvertWorldCoordinateToGridPoint(m_Balls[i].p[2]);
-//    printf("ball_a: %d\n",i);
-		
+		if( x < 0 || y < 0 || z < 0 || x >= m_nGridSize || y >= m_nGridSize || z >= m_nGridSize )
+			continue;
+
 		// Work our way out from the center of the ball until the surface is
-		// reached. If the voxel at the surface is already computed then this
+		// reached. If the voxel at the surface is already known then this
 		// ball share surface with a previous ball.
-		bComputed = false;
-		while(1)
+		bool bComputed = false;
+		while( z >= 0 )
 		{
-			if( IsGridVoxelComputed(x,y,z) )
+			if( FindSurfaceVoxel(x,y,z) != -1 )
 			{
 				bComputed = true;
 				break;
 			}
 
-			nCase = ComputeGridVoxel(x,y,z);
-			
+			nCase = ComputeGridVoxelCase(x,y,z);
 
 			if( nCase < 255 )
 				break;
@@ -214,39 +264,225 @@ void CMetaballs::Render()
 			z--;
 		}
 
-		if( bComputed )
+		if( bComputed || z < 0 )
 			continue;
 
-//    printf("ball_c: %d\n",i);
+		TrackSurface(x,y,z);
+	}
+
+	CloseSurface();
+	Polygonize();
+}
 
-		// Compute all voxels on the surface by computing neighbouring voxels
-		// if the surface goes into them.
-		AddNeighborsToList(nCase,x,y,z);
-//    printf("ball_d: %d\n",i);
+//=============================================================================
+void CMetaballs::TrackSurface(int x, int y, int z)
+{
+	size_t nHead = m_SurfaceVoxels.size();
+	AddSurfaceVoxel(x,y,z);
+
+	while( nHead < m_SurfaceVoxels.size() )
+	{
+		size_t nTail = m_SurfaceVoxels.size();
+
+		// Energies of the whole wavefront in one go
+		m_PendingPoints.reset_used(0);
+		for( size_t i = nHead; i < nTail; i++ )
+		{
+			SSurfaceVoxel &v = m_SurfaceVoxels[i];
+			for( int c = 0; c < 8; c++ )
+				AddPendingPoint(v.x + (int)CMarchingCubes::m_CubeVertices[c][0],
+				                v.y + (int)CMarchingCubes::m_CubeVertices[c][1],
+				                v.z + (int)CMarchingCubes::m_CubeVertices[c][2]);
+		}
+		ComputePendingPoints();
+
+		// AddNeighbor appends to m_SurfaceVoxels, don't keep references
+		for( size_t i = nHead; i < nTail; i++ )
+		{
+			int vx = m_SurfaceVoxels[i].x;
+			int vy = m_SurfaceVoxels[i].y;
+			int vz = m_SurfaceVoxels[i].z;
+			int nCase = ComputeGridVoxelCase(vx,vy,vz);
+			m_SurfaceVoxels[i].nCase = nCase;
+			AddNeighborsToList(nCase,vx,vy,vz);
+		}
+		nHead = nTail;
+	}
+}
 
-		while( m_nNumOpenVoxels )
+//=============================================================================
+// Safety net: every edge a triangle uses must have its owner voxel in the
+// list. The flood fill finds them for any sane field, this catches the odd
+// voxel touching the surface only through an edge.
+void CMetaballs::CloseSurface()
+{
+	for( size_t i = 0; i < m_SurfaceVoxels.size(); i++ )
+	{
+		int vx = m_SurfaceVoxels[i].x;
+		int vy = m_SurfaceVoxels[i].y;
+		int vz = m_SurfaceVoxels[i].z;
+		int nCase = m_SurfaceVoxels[i].nCase;
+		for( int t = 0; t < m_CubeTriangleCount[nCase]*3; t++ )
 		{
-//      printf("ball_e: %d %d\n",i,m_nNumOpenVoxels);
-      
-			m_nNumOpenVoxels--;
-			x = m_pOpenVoxels[m_nNumOpenVoxels*3];
-			y = m_pOpenVoxels[m_nNumOpenVoxels*3 + 1];
-			z = m_pOpenVoxels[m_nNumOpenVoxels*3 + 2];
+			int e = CMarchingCubes::m_CubeTriangles[nCase][t];
+			int ox = vx + m_EdgeOwner[e][0];
+			int oy = vy + m_EdgeOwner[e][1];
+			int oz = vz + m_EdgeOwner[e][2];
+			if( ox >= m_nGridSize || oy >= m_nGridSize || oz >= m_nGridSize )
+				continue;
+			if( FindSurfaceVoxel(ox,oy,oz) != -1 )
+				continue;
+			int r = AddSurfaceVoxel(ox,oy,oz);
+			m_SurfaceVoxels[r].nCase = ComputeGridVoxelCase(ox,oy,oz);
+		}
+	}
+}
 
-			nCase = ComputeGridVoxel(x,y,z);
+//=============================================================================
+void CMetaballs::Polygonize()
+{
+	size_t nNumVoxels = m_SurfaceVoxels.size();
+	if( !nNumVoxels )
+		return;
 
-			AddNeighborsToList(nCase,x,y,z);
+	vsx_thread_pool* pool = vsx_thread_pool::get_instance();
+
+	pool->parallel_for(nNumVoxels, 64, &EdgeCountJob, (void*)this);
+
+	int nNumVertices = 0;
+	int nNumFaces = 0;
+	for( size_t i = 0; i < nNumVoxels; i++ )
+	{
+		SSurfaceVoxel &v = m_SurfaceVoxels[i];
+		v.nFirstVertex = nNumVertices;
+		v.nFirstFace = nNumFaces;
+		nNumVertices += v.nNumEdgeVertices;
+		nNumFaces += m_CubeTriangleCount[v.nCase];
+	}
+	if( !nNumVertices || !nNumFaces )
+		return;
+
+	// size the arrays up front, the jobs write through the raw pointers
+	vertices->allocate(nNumVertices-1);
+	vertex_normals->allocate(nNumVertices-1);
+	vertex_tex_coords->allocate(nNumVertices-1);
+	faces->allocate(nNumFaces-1);
+
+	pool->parallel_for(nNumVoxels, 64, &VertexJob, (void*)this);
+	pool->parallel_for(nNumVoxels, 64, &FaceJob, (void*)this);
+}
+
+//=============================================================================
+void CMetaballs::EnergyJob(void* pArg, size_t nStart, size_t nEnd)
+{
+	CMetaballs *p = (CMetaballs*)pArg;
+	int nSize = p->m_nGridSize;
+	int nRow = nSize+1;
+	int *pPoints = p->m_PendingPoints.get_pointer();
+	for( size_t i = nStart; i < nEnd; i++ )
+	{
+		int nIndex = pPoints[i];
+		int x = nIndex % nRow;
+		int y = (nIndex / nRow) % nRow;
+		int z = nIndex / (nRow*nRow);
+
+		// The energy on the edges are always zero to make sure the isosurface is
+		// always closed.
+		if( x == 0 || y == 0 || z == 0 ||
+		    x == nSize || y == nSize || z == nSize )
+		{
+			p->m_pfGridEnergy[nIndex] = 0;
+			continue;
 		}
+		p->m_pfGridEnergy[nIndex] = p->ComputeEnergy(
+			p->ConvertGridPointToWorldCoordinate(x),
+			p->ConvertGridPointToWorldCoordinate(y),
+			p->ConvertGridPointToWorldCoordinate(z));
 	}
+}
 
-	// Unlock buffers
-//	pGfx->UnlockVertexBuffer();
-//	pGfx->UnlockIndexBuffer();
+//=============================================================================
+void CMetaballs::EdgeCountJob(void* pArg, size_t nStart, size_t nEnd)
+{
+	CMetaballs *p = (CMetaballs*)pArg;
+	SSurfaceVoxel *pVoxels = p->m_SurfaceVoxels.get_pointer();
+	float fLevel = p->m_fLevel;
+	for( size_t i = nStart; i < nEnd; i++ )
+	{
+		SSurfaceVoxel &v = pVoxels[i];
+		float b0 = p->m_pfGridEnergy[p->PointIndex(v.x, v.y, v.z)];
+		float bx = v.x < p->m_nGridSize ? p->m_pfGridEnergy[p->PointIndex(v.x+1, v.y, v.z)] : b0;
+		float by = v.y < p->m_nGridSize ? p->m_pfGridEnergy[p->PointIndex(v.x, v.y+1, v.z)] : b0;
+		float bz = v.z < p->m_nGridSize ? p->m_pfGridEnergy[p->PointIndex(v.x, v.y, v.z+1)] : b0;
+		bool bIn = b0 > fLevel;
+		v.nNumEdgeVertices = 0;
+		v.nEdgeVertex[0] = (bx > fLevel) != bIn ? v.nNumEdgeVertices++ : -1;
+		v.nEdgeVertex[1] = (by > fLevel) != bIn ? v.nNumEdgeVertices++ : -1;
+		v.nEdgeVertex[2] = (bz > fLevel) != bIn ? v.nNumEdgeVertices++ : -1;
+	}
+}
 
-	// Render the last triangles
-//	IDirect3DDevice8 *pDev = pGfx->GetD3DDevice();
-//	pDev->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, m_nNumVertices, 
-//		                                           0, m_nNumIndices/3);
+//=============================================================================
+void CMetaballs::VertexJob(void* pArg, size_t nStart, size_t nEnd)
+{
+	CMetaballs *p = (CMetaballs*)pArg;
+	SSurfaceVoxel *pVoxels = p->m_SurfaceVoxels.get_pointer();
+	vsx_vector *pVertices = p->vertices->get_pointer();
+	vsx_vector *pNormals = p->vertex_normals->get_pointer();
+	vsx_tex_coord *pTexCoords = p->vertex_tex_coords->get_pointer();
+	float fLevel = p->m_fLevel;
+
+	for( size_t i = nStart; i < nEnd; i++ )
+	{
+		SSurfaceVoxel &v = pVoxels[i];
+		if( !v.nNumEdgeVertices )
+			continue;
+		float fx = p->ConvertGridPointToWorldCoordinate(v.x);
+		float fy = p->ConvertGridPointToWorldCoordinate(v.y);
+		float fz = p->ConvertGridPointToWorldCoordinate(v.z);
+		float b0 = p->m_pfGridEnergy[p->PointIndex(v.x, v.y, v.z)];
+
+		for( int a = 0; a < 3; a++ )
+		{
+			if( v.nEdgeVertex[a] == -1 )
+				continue;
+			float b1 = p->m_pfGridEnergy[p->PointIndex(v.x + (a == 0), v.y + (a == 1), v.z + (a == 2))];
+			float t = (fLevel - b0)/(b1 - b0);
+
+			int nVertex = v.nFirstVertex + v.nEdgeVertex[a];
+			v.nEdgeVertex[a] = nVertex;
+			vsx_vector &vv = pVertices[nVertex];
+			vv.x = fx + (a == 0 ? t*p->m_fVoxelSize : 0.0f);
+			vv.y = fy + (a == 1 ? t*p->m_fVoxelSize : 0.0f);
+			vv.z = fz + (a == 2 ? t*p->m_fVoxelSize : 0.0f);
+			pNormals[nVertex] = vsx_vector(0,0,0);
+			p->ComputeNormal(&vv, &pNormals[nVertex], &pTexCoords[nVertex]);
+		}
+	}
+}
+
+//=============================================================================
+void CMetaballs::FaceJob(void* pArg, size_t nStart, size_t nEnd)
+{
+	CMetaballs *p = (CMetaballs*)pArg;
+	SSurfaceVoxel *pVoxels = p->m_SurfaceVoxels.get_pointer();
+	vsx_face *pFaces = p->faces->get_pointer();
+
+	for( size_t i = nStart; i < nEnd; i++ )
+	{
+		SSurfaceVoxel &v = pVoxels[i];
+		int nCount = p->m_CubeTriangleCount[v.nCase]*3;
+		GLuint *pIndex = (GLuint*)&pFaces[v.nFirstFace];
+		for( int t = 0; t < nCount; t++ )
+		{
+			int e = CMarchingCubes::m_CubeTriangles[v.nCase][t];
+			int r = p->FindSurfaceVoxel(v.x + p->m_EdgeOwner[e][0],
+			                            v.y + p->m_EdgeOwner[e][1],
+			                            v.z + p->m_EdgeOwner[e][2]);
+			// CloseSurface made sure the owner is there
+			pIndex[t] = pVoxels[r].nEdgeVertex[p->m_EdgeOwner[e][3]];
+		}
+	}
 }
 
 //=============================================================================
@@ -274,82 +510,151 @@ void CMetaballs::AddNeighborsToList(int nCase, int x, int y, int z)
 //=============================================================================
 void CMetaballs::AddNeighbor(int x, int y, int z)
 {
-	if( IsGridVoxelComputed(x,y,z) || IsGridVoxelInList(x,y,z) )
+	if( x < 0 || y < 0 || z < 0 ||
+	    x >= m_nGridSize || y >= m_nGridSize || z >= m_nGridSize )
 		return;
 
-	// Make sure the array is large enough
-	if( m_nMaxOpenVoxels == m_nNumOpenVoxels )
-	{
-		m_nMaxOpenVoxels *= 2;
-		//printf("metaballs allocating more memory\n");
-		int *pTmp = new int[m_nMaxOpenVoxels*3];
-		memcpy(pTmp, m_pOpenVoxels, m_nNumOpenVoxels*3*sizeof(int));
-		delete[] m_pOpenVoxels;
-		m_pOpenVoxels = pTmp;
-	}
+	if( FindSurfaceVoxel(x,y,z) != -1 )
+		return;
 
-	m_pOpenVoxels[m_nNumOpenVoxels*3] = x;
-	m_pOpenVoxels[m_nNumOpenVoxels*3+1] = y;
-	m_pOpenVoxels[m_nNumOpenVoxels*3+2] = z;
+	AddSurfaceVoxel(x,y,z);
+}
 
-	SetGridVoxelInList(x,y,z);
+//=============================================================================
+inline int CMetaballs::FindSurfaceVoxel(int x, int y, int z)
+{
+	int nIndex = VoxelIndex(x,y,z);
+	if( m_pnGridVoxelStamp[nIndex] != m_nFrame )
+		return -1;
+	return m_pnGridVoxelRecord[nIndex];
+}
+
+//=============================================================================
+int CMetaballs::AddSurfaceVoxel(int x, int y, int z)
+{
+	int r = (int)m_SurfaceVoxels.size();
+	SSurfaceVoxel &v = m_SurfaceVoxels[r];
+	v.x = x;
+	v.y = y;
+	v.z = z;
+	v.nCase = 0;
+
+	int nIndex = VoxelIndex(x,y,z);
+	m_pnGridVoxelStamp[nIndex] = m_nFrame;
+	m_pnGridVoxelRecord[nIndex] = r;
+	return r;
+}
+
+//=============================================================================
+inline void CMetaballs::AddPendingPoint(int x, int y, int z)
+{
+	int nIndex = PointIndex(x,y,z);
+	if( m_pnGridPointStamp[nIndex] == m_nFrame )
+		return;
+	m_pnGridPointStamp[nIndex] = m_nFrame;
+	m_PendingPoints.push_back(nIndex);
+}
 
-	m_nNumOpenVoxels++;
+//=============================================================================
+void CMetaballs::ComputePendingPoints()
+{
+	if( !m_PendingPoints.size() )
+		return;
+	vsx_thread_pool::get_instance()->parallel_for(m_PendingPoints.size(), 256, &EnergyJob, (void*)this);
 }
 
 //=============================================================================
 float CMetaballs::ComputeEnergy(float x, float y, float z)
 {
+	// The formula for the energy is 
+	// 
+	//   e += mass/distance^2 
+#if defined(VSX_MATH_3D_SSE)
+	__m128 vx = _mm_set1_ps(x);
+	__m128 vy = _mm_set1_ps(y);
+	__m128 vz = _mm_set1_ps(z);
+	__m128 vmin = _mm_set1_ps(0.0001f);
+	__m128 ve = _mm_setzero_ps();
+	for( int i = 0; i < m_nNumBalls; i += 4 )
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(&m_fBallX[i]), vx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(&m_fBallY[i]), vy);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(&m_fBallZ[i]), vz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy)), _mm_mul_ps(dz,dz));
+		d2 = _mm_max_ps(d2, vmin);
+		ve = _mm_add_ps(ve, _mm_div_ps(_mm_loadu_ps(&m_fBallM[i]), d2));
+	}
+	float e[4];
+	_mm_storeu_ps(e, ve);
+	return (e[0] + e[1]) + (e[2] + e[3]);
+#else
 	float fEnergy = 0;
 	float fSqDist;
 
 	for( int i = 0; i < m_nNumBalls; i++ )
 	{
-		// The formula for the energy is 
-		// 
-		//   e += mass/distance^2 
-
-		fSqDist = (m_Balls[i].p[0] - x)*(m_Balls[i].p[0] - x) +
-		          (m_Balls[i].p[1] - y)*(m_Balls[i].p[1] - y) +
-		          (m_Balls[i].p[2] - z)*(m_Balls[i].p[2] - z);
+		fSqDist = (m_fBallX[i] - x)*(m_fBallX[i] - x) +
+		          (m_fBallY[i] - y)*(m_fBallY[i] - y) +
+		          (m_fBallZ[i] - z)*(m_fBallZ[i] - z);
 
 		if( fSqDist < 0.0001f ) fSqDist = 0.0001f;
 
-		fEnergy += m_Balls[i].m / fSqDist;
+		fEnergy += m_fBallM[i] / fSqDist;
 	}
 
 	return fEnergy;
+#endif
 }
 
-float xx, yy, zz;
-float fSqDist;
-float fsqr;
 //=============================================================================
-void inline CMetaballs::ComputeNormal(vsx_vector* vv, vsx_vector* vn, vsx_tex_coord* vt)
+void CMetaballs::ComputeNormal(vsx_vector* vv, vsx_vector* vn, vsx_tex_coord* vt)
 {
-	
-
+	// To compute the normal we derive the energy formula and get
+	//
+	//   n += 2 * mass * vector / distance^4
+#if defined(VSX_MATH_3D_SSE)
+	__m128 px = _mm_set1_ps(vv->x);
+	__m128 py = _mm_set1_ps(vv->y);
+	__m128 pz = _mm_set1_ps(vv->z);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 nx = _mm_setzero_ps();
+	__m128 ny = _mm_setzero_ps();
+	__m128 nz = _mm_setzero_ps();
+	for( int i = 0; i < m_nNumBalls; i += 4 )
+	{
+		__m128 xx = _mm_sub_ps(px, _mm_loadu_ps(&m_fBallX[i]));
+		__m128 yy = _mm_sub_ps(py, _mm_loadu_ps(&m_fBallY[i]));
+		__m128 zz = _mm_sub_ps(pz, _mm_loadu_ps(&m_fBallZ[i]));
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx,xx), _mm_mul_ps(yy,yy)), _mm_mul_ps(zz,zz));
+		__m128 f = _mm_div_ps(_mm_mul_ps(two, _mm_loadu_ps(&m_fBallM[i])), _mm_mul_ps(d2,d2));
+		nx = _mm_add_ps(nx, _mm_mul_ps(xx, f));
+		ny = _mm_add_ps(ny, _mm_mul_ps(yy, f));
+		nz = _mm_add_ps(nz, _mm_mul_ps(zz, f));
+	}
+	float n[4];
+	_mm_storeu_ps(n, nx);
+	vn->x += (n[0] + n[1]) + (n[2] + n[3]);
+	_mm_storeu_ps(n, ny);
+	vn->y += (n[0] + n[1]) + (n[2] + n[3]);
+	_mm_storeu_ps(n, nz);
+	vn->z += (n[0] + n[1]) + (n[2] + n[3]);
+#else
 	for( int i = 0; i < m_nNumBalls; i ++ )
 	{
-		// To compute the normal we derive the energy formula and get
-		//
-		//   n += 2 * mass * vector / distance^4
+		float xx = vv->x - m_fBallX[i];
+		float yy = vv->y - m_fBallY[i];
+		float zz = vv->z - m_fBallZ[i];
 
-		xx = vv->x - m_Balls[i].p[0];
-		yy = vv->y - m_Balls[i].p[1];
-		zz = vv->z - m_Balls[i].p[2];
-
-		fSqDist = xx*xx + yy*yy + zz*zz;
+		float fSqDist = xx*xx + yy*yy + zz*zz;
 		fSqDist *= fSqDist;
-    fsqr = 2.0f * m_Balls[i].m / (fSqDist);
+		float fsqr = 2.0f * m_fBallM[i] / (fSqDist);
 		vn->x +=  xx * fsqr;
 		vn->y +=  yy * fsqr;
 		vn->z +=  zz * fsqr;
 	}
-	
-	vn->normalize();
+#endif
 
-//	D3DXVec3Normalize((D3DXVECTOR3*)pVertex->n, (D3DXVECTOR3*)pVertex->n);
+	vn->normalize();
 
 	// Compute the sphere-map texture coordinate
 	// Note: The normal used here should be transformed to camera space first
@@ -360,22 +665,22 @@ void inline CMetaballs::ComputeNormal(vsx_vector* vv, vsx_vector* vn, vsx_tex_co
 }
 
 //=============================================================================
+// Used while walking out of the balls, the wavefronts go through
+// ComputePendingPoints instead.
 float CMetaballs::ComputeGridPointEnergy(int x, int y, int z)
 {
-	if( IsGridPointComputed(x,y,z) )
-		return m_pfGridEnergy[x +
-		                      y*(m_nGridSize+1) +
-		                      z*(m_nGridSize+1)*(m_nGridSize+1)];
+	int nIndex = PointIndex(x,y,z);
+	if( m_pnGridPointStamp[nIndex] == m_nFrame )
+		return m_pfGridEnergy[nIndex];
+
+	m_pnGridPointStamp[nIndex] = m_nFrame;
 
 	// The energy on the edges are always zero to make sure the isosurface is
 	// always closed.
 	if( x == 0 || y == 0 || z == 0 ||
 	    x == m_nGridSize || y == m_nGridSize || z == m_nGridSize )
 	{
-		m_pfGridEnergy[x +
-		               y*(m_nGridSize+1) +
-		               z*(m_nGridSize+1)*(m_nGridSize+1)] = 0;
-		SetGridPointComputed(x,y,z);
+		m_pfGridEnergy[nIndex] = 0;
 		return 0;
 	}
 
@@ -383,19 +688,12 @@ float CMetaballs::ComputeGridPointEnergy(int x, int y, int z)
 	float fy = ConvertGridPointToWorldCoordinate(y);
 	float fz = ConvertGridPointToWorldCoordinate(z);
 
-	m_pfGridEnergy[x +
-	               y*(m_nGridSize+1) +
-	               z*(m_nGridSize+1)*(m_nGridSize+1)] = ComputeEnergy(fx,fy,fz);
-
-	SetGridPointComputed(x,y,z);
-
-	return m_pfGridEnergy[x +
-  	                      y*(m_nGridSize+1) +
-	                      z*(m_nGridSize+1)*(m_nGridSize+1)];
+	m_pfGridEnergy[nIndex] = ComputeEnergy(fx,fy,fz);
+	return m_pfGridEnergy[nIndex];
 }
 
 //=============================================================================
-int CMetaballs::ComputeGridVoxel(int x, int y, int z)
+int CMetaballs::ComputeGridVoxelCase(int x, int y, int z)
 {
 	float b[8];
 	b[0] = ComputeGridPointEnergy(x  , y  , z  );
@@ -407,13 +705,6 @@ int CMetaballs::ComputeGridVoxel(int x, int y, int z)
 	b[6] = ComputeGridPointEnergy(x+1, y+1, z+1);
 	b[7] = ComputeGridPointEnergy(x  , y+1, z+1);
 
-	float fx,fy,fz;
-	
-/*	float fx = ConvertGridPointToWorldCoordinate(x) + m_fVoxelSize/2;
-	float fy = ConvertGridPointToWorldCoordinate(y) + m_fVoxelSize/2;
-	float fz = ConvertGridPointToWorldCoordinate(z) + m_fVoxelSize/2;*/
-	
-
 	int c = 0;
 	c |= b[0] > m_fLevel ? (1<<0) : 0;
 	c |= b[1] > m_fLevel ? (1<<1) : 0;
@@ -423,110 +714,6 @@ int CMetaballs::ComputeGridVoxel(int x, int y, int z)
 	c |= b[5] > m_fLevel ? (1<<5) : 0;
 	c |= b[6] > m_fLevel ? (1<<6) : 0;
 	c |= b[7] > m_fLevel ? (1<<7) : 0;
-//	syslog(LOG_ERR,"ComputeGridVoxel c = %d %d",c,__LINE__);
-
-
-	// Compute vertices from marching pyramid case
-	fx = ConvertGridPointToWorldCoordinate(x);
-	fy = ConvertGridPointToWorldCoordinate(y);
-	fz = ConvertGridPointToWorldCoordinate(z);
-//	syslog(LOG_ERR,"ComputeGridVoxel fx=%f   fy=%f   fz=%f %d",fx,fy,fz,__LINE__);
-
-	int i = 0;
-	unsigned short EdgeIndices[12];
-	memset(EdgeIndices, 0xFF, 12*sizeof(unsigned short));
-
-	while(1)
-	{
-//    printf("inner\n");
-	//	usleep(1000);
-		int nEdge =	CMarchingCubes::m_CubeTriangles[c][i];
-	//	syslog(LOG_ERR,"ComputeGridVoxel(%d) c = %d   i = %d   nEdge=%d",__LINE__,c,i,nEdge);
-
-		if( nEdge == -1 )
-			break;
-		if( EdgeIndices[nEdge] == 0xFFFF )
-		{
-			EdgeIndices[nEdge] = m_nNumVertices;
-			
-
-			// Optimization: It's possible that the non-interior edges
-			// have been computed already in neighbouring voxels
-
-			// Compute the vertex by interpolating between the two points
-			int nIndex0 = CMarchingCubes::m_CubeEdges[nEdge][0];
-			int nIndex1 = CMarchingCubes::m_CubeEdges[nEdge][1];
-
-			float t = (m_fLevel - b[nIndex0])/(b[nIndex1] - b[nIndex0]);
-
-
-			(*vertices)[m_nNumVertices].x =
-				CMarchingCubes::m_CubeVertices[nIndex0][0]*(1-t) +
-			    CMarchingCubes::m_CubeVertices[nIndex1][0]*t;
-			(*vertices)[m_nNumVertices].y =
-				CMarchingCubes::m_CubeVertices[nIndex0][1]*(1-t) +
-				CMarchingCubes::m_CubeVertices[nIndex1][1]*t;
-			(*vertices)[m_nNumVertices].z =
-				CMarchingCubes::m_CubeVertices[nIndex0][2]*(1-t) +
-				CMarchingCubes::m_CubeVertices[nIndex1][2]*t;
-			(*vertices)[m_nNumVertices].x = fx +
-				(*vertices)[m_nNumVertices].x*m_fVoxelSize;
-			(*vertices)[m_nNumVertices].y = fy +
-				(*vertices)[m_nNumVertices].y*m_fVoxelSize;
-			(*vertices)[m_nNumVertices].z = fz +
-				(*vertices)[m_nNumVertices].z*m_fVoxelSize;
-
-			// Compute the normal at the vertex
-//			ComputeNormal(&m_pVertices[m_nNumVertices]);
-			ComputeNormal(&(*vertices)[m_nNumVertices],&(*vertex_normals)[m_nNumVertices],&(*vertex_tex_coords)[m_nNumVertices]);
-
-			m_nNumVertices++;
-//			return 0;
-		}
-
-		// Add the edge's vertex index to the index list
-		
-    if (m_nFacePart == 0) {
-      (*faces)[m_nNumIndices].a = EdgeIndices[nEdge];
-    } else
-    if (m_nFacePart == 1) {
-      (*faces)[m_nNumIndices].b = EdgeIndices[nEdge];
-    } else
-    if (m_nFacePart == 2) {
-      (*faces)[m_nNumIndices].c = EdgeIndices[nEdge];
-    }
-
-    ++m_nFacePart;
-    if (m_nFacePart == 3) {
-      m_nFacePart = 0;
-      ++m_nNumIndices;
-    }
-		++i;
-//		if (i == 2000) break;
-	}
-	//printf("ComputeGridVoxel %d",__LINE__);
-
-	SetGridVoxelComputed(x,y,z);
-
-//	if( m_nNumIndices*3 >= MAX_INDICES-30 )
-//	{
-		// Render the computed triangles
-//		CGraphics *pGfx = CGraphics::GetInstance();
-//		IDirect3DDevice8 *pDev = pGfx->GetD3DDevice();
-
-		// Unlock buffers
-//		pGfx->UnlockVertexBuffer();
-//		pGfx->UnlockIndexBuffer();
-
-//		pDev->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, m_nNumVertices, 
-//		                                               0, m_nNumIndices/3);
-
-		// Lock the vertex and index buffer
-//		pGfx->LockVertexBuffer(MAX_VERTICES, (BYTE**)&m_pVertices);
-//		pGfx->LockIndexBuffer(MAX_INDICES, (BYTE**)&m_pIndices);
-//		m_nNumVertices = 0;
-//		m_nNumIndices = 0;
-//	}
 
 	return c;
 }
@@ -546,67 +733,24 @@ int CMetaballs::ConvertWorldCoordinateToGridPoint(float x)
 //=============================================================================
 void CMetaballs::SetGridSize(int nSize)
 {
-	m_fVoxelSize = 2/float(nSize);
-	m_nGridSize  = nSize;
-
-	m_pfGridEnergy      = new float[(nSize+1)*(nSize+1)*(nSize+1)];
-	m_pnGridPointStatus = new char[(nSize+1)*(nSize+1)*(nSize+1)];
-	m_pnGridVoxelStatus = new char[nSize*nSize*nSize];
-}
-
-//=============================================================================
-inline bool CMetaballs::IsGridPointComputed(int x, int y, int z)
-{
-	if( m_pnGridPointStatus[x +
-	                        y*(m_nGridSize+1) +
-	                        z*(m_nGridSize+1)*(m_nGridSize+1)] == 1 )
-		return true;
-	else
-		return false;
-}
+	if( nSize < 2 )
+		nSize = 2;
 
-//=============================================================================
-inline bool CMetaballs::IsGridVoxelComputed(int x, int y, int z)
-{
-	if( m_pnGridVoxelStatus[x +
-	                        y*m_nGridSize +
-	                        z*m_nGridSize*m_nGridSize] == 1 )
-		return true;
-	else
-		return false;
-}
-
-//=============================================================================
-inline bool CMetaballs::IsGridVoxelInList(int x, int y, int z)
-{
-	if( m_pnGridVoxelStatus[x +
-	                        y*m_nGridSize +
-	                        z*m_nGridSize*m_nGridSize] == 2 )
-		return true;
-	else
-		return false;
-}
-
-//=============================================================================
-inline void CMetaballs::SetGridPointComputed(int x, int y, int z)
-{
-	m_pnGridPointStatus[x +
-	                    y*(m_nGridSize+1) +
-	                    z*(m_nGridSize+1)*(m_nGridSize+1)] = 1;
-}
-
-//=============================================================================
-inline void CMetaballs::SetGridVoxelComputed(int x, int y, int z)
-{
-	m_pnGridVoxelStatus[x +
-	                    y*m_nGridSize +
-	                    z*m_nGridSize*m_nGridSize] = 1;
-}
+	delete[] m_pfGridEnergy;
+	delete[] m_pnGridPointStamp;
+	delete[] m_pnGridVoxelStamp;
+	delete[] m_pnGridVoxelRecord;
 
-//=============================================================================
-inline void CMetaballs::SetGridVoxelInList(int x, int y, int z)
-{
-	m_pnGridVoxelStatus[x +
-	                    y*m_nGridSize +
-	                    z*m_nGridSize*m_nGridSize] = 2;
+	m_fVoxelSize = 2/float(nSize);
+	m_nGridSize  = nSize;
+	m_nFrame     = 0;
+
+	int nPoints = (nSize+1)*(nSize+1)*(nSize+1);
+	int nVoxels = nSize*nSize*nSize;
+	m_pfGridEnergy      = new float[nPoints];
+	m_pnGridPointStamp  = new int[nPoints];
+	m_pnGridVoxelStamp  = new int[nVoxels];
+	m_pnGridVoxelRecord = new int[nVoxels];
+	memset(m_pnGridPointStamp, 0, sizeof(int)*nPoints);
+	memset(m_pnGridVoxelStamp, 0, sizeof(int)*nVoxels);
 }
@@ -18,6 +18,20 @@ struct SBall
 	float m;
 };
 
+// A voxel the iso-surface passes through. Each voxel owns the 3 edges
+// leaving its lowest corner along x, y and z so that every edge, and the
+// vertex on it, belongs to exactly one voxel - this is what welds the
+// vertices between neighbouring voxels.
+struct SSurfaceVoxel
+{
+	int x, y, z;
+	int nCase;
+	int nEdgeVertex[3];
+	int nNumEdgeVertices;
+	int nFirstVertex;
+	int nFirstFace;
+};
+
 //#define FVF_VERTEX (D3DFVF_XYZ|D3DFVF_NORMAL|D3DFVF_TEX1)
 /*struct SVertex
 {
@@ -47,43 +61,69 @@ protected:
 	float ComputeEnergy(float x, float y, float z);
 	void  ComputeNormal(vsx_vector* vv, vsx_vector* vn, vsx_tex_coord* vt);
 	float ComputeGridPointEnergy(int x, int y, int z);
-	int   ComputeGridVoxel(int x, int y, int z);
+	int   ComputeGridVoxelCase(int x, int y, int z);
 
-	bool  IsGridPointComputed(int x, int y, int z);
-	bool  IsGridVoxelComputed(int x, int y, int z);
-	bool  IsGridVoxelInList(int x, int y, int z);
-	void  SetGridPointComputed(int x, int y, int z);
-	void  SetGridVoxelComputed(int x, int y, int z);
-	void  SetGridVoxelInList(int x, int y, int z);
+	void  PrepareBalls();
+	void  TrackSurface(int x, int y, int z);
+	void  ComputePendingPoints();
+	void  CloseSurface();
+	void  Polygonize();
 
-	float ConvertGridPointToWorldCoordinate(int x);
-	int   ConvertWorldCoordinateToGridPoint(float x);
+	int   FindSurfaceVoxel(int x, int y, int z);
+	int   AddSurfaceVoxel(int x, int y, int z);
 	void  AddNeighborsToList(int nCase, int x, int y, int z);
 	void  AddNeighbor(int x, int y, int z);
+	void  AddPendingPoint(int x, int y, int z);
+
+	float ConvertGridPointToWorldCoordinate(int x);
+	int   ConvertWorldCoordinateToGridPoint(float x);
+
+	inline int PointIndex(int x, int y, int z)
+	{
+		return x + y*(m_nGridSize+1) + z*(m_nGridSize+1)*(m_nGridSize+1);
+	}
+
+	inline int VoxelIndex(int x, int y, int z)
+	{
+		return x + y*m_nGridSize + z*m_nGridSize*m_nGridSize;
+	}
+
+	// thread pool entry points
+	static void EnergyJob(void* pArg, size_t nStart, size_t nEnd);
+	static void EdgeCountJob(void* pArg, size_t nStart, size_t nEnd);
+	static void VertexJob(void* pArg, size_t nStart, size_t nEnd);
+	static void FaceJob(void* pArg, size_t nStart, size_t nEnd);
 
 	float  m_fLevel;
 
-int    m_nNumBalls;
+	int    m_nNumBalls;
 	SBall  m_Balls[MAX_BALLS];
 
-	int    m_nNumOpenVoxels;
-	int    m_nMaxOpenVoxels;
-	int   *m_pOpenVoxels;
+	// the balls in SoA form for the SSE field evaluation, unused slots have
+	// zero mass so they add nothing
+	float  m_fBallX[MAX_BALLS];
+	float  m_fBallY[MAX_BALLS];
+	float  m_fBallZ[MAX_BALLS];
+	float  m_fBallM[MAX_BALLS];
 
 	int    m_nGridSize;
 	float  m_fVoxelSize;
 
+	// the grids are only touched around the surface; instead of clearing
+	// them every frame an entry is valid when its stamp equals m_nFrame
+	int    m_nFrame;
 	float *m_pfGridEnergy;
-	char  *m_pnGridPointStatus;
-	char  *m_pnGridVoxelStatus;
+	int   *m_pnGridPointStamp;
+	int   *m_pnGridVoxelStamp;
+	int   *m_pnGridVoxelRecord;
 
-	int             m_nNumVertices;
-	int             m_nNumIndices;
-	int             m_nFacePart;
-	vsx_avector_nd<vsx_vector> m_pVertices;
+	vsx_array<SSurfaceVoxel> m_SurfaceVoxels;
+	vsx_array<int>           m_PendingPoints;
 
-//	vsx_vector     *m_pVertices;
-//	unsigned short *m_pIndices;
+	// per marching cubes edge: offset of the owning voxel and which of its
+	// edges it is
+	int    m_EdgeOwner[12][4];
+	int    m_CubeTriangleCount[256];
 };
 
 #endif
@@ -0,0 +1,298 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "vsx_math_3d.h"
+#include "vsx_thread_pool.h"
+#include "fft_plan.h"
+#if defined(VSX_MATH_3D_SSE2)
+#include <emmintrin.h>
+#endif
+
+// columns transformed together by one job, 16 doubles per row fit nicely
+// in cache even for the largest grids
+#define FFT_PLAN_COLUMN_BLOCK 16
+
+// smallest amount of values worth handing to another thread
+#define FFT_PLAN_MIN_VALUES 16384
+
+struct fft_plan_job
+{
+  fft_plan* plan;
+  double* re;
+  double* im;
+};
+
+fft_plan::fft_plan()
+{
+  n = 0;
+  dir = 0;
+  bit_reverse = 0;
+  twiddle_re = 0;
+  twiddle_im = 0;
+}
+
+fft_plan::~fft_plan()
+{
+  free_data();
+}
+
+void fft_plan::free_data()
+{
+  delete[] bit_reverse;
+  delete[] twiddle_re;
+  delete[] twiddle_im;
+  bit_reverse = 0;
+  twiddle_re = 0;
+  twiddle_im = 0;
+  n = 0;
+}
+
+bool fft_plan::init(int size, int direction)
+{
+  if (size == n && direction == dir)
+    return true;
+  free_data();
+  if (size < 2 || (size & (size - 1)))
+    return false;
+
+  n = size;
+  dir = direction;
+
+  bit_reverse = new int[n];
+  int bits = 0;
+  while ((1 << bits) < n) bits++;
+  for (int i = 0; i < n; i++)
+  {
+    int r = 0;
+    for (int b = 0; b < bits; b++)
+      if (i & (1 << b))
+        r |= 1 << (bits - 1 - b);
+    bit_reverse[i] = r;
+  }
+
+  // w = exp(-dir * i * pi * j / h), the same rotation FFT() builds up
+  // incrementally for every line
+  twiddle_re = new double[n];
+  twiddle_im = new double[n];
+  for (int h = 1; h < n; h <<= 1)
+  {
+    for (int j = 0; j < h; j++)
+    {
+      double a = -(double)dir * 3.141592653589793238462643 * (double)j / (double)h;
+      twiddle_re[h - 1 + j] = cos(a);
+      twiddle_im[h - 1 + j] = sin(a);
+    }
+  }
+  return true;
+}
+
+void fft_plan::transform(double* re, double* im)
+{
+  for (int i = 0; i < n; i++)
+  {
+    int j = bit_reverse[i];
+    if (i < j)
+    {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+
+  // first stage, all twiddles are 1
+  for (int i = 0; i < n; i += 2)
+  {
+    double tr = re[i + 1];
+    double ti = im[i + 1];
+    re[i + 1] = re[i] - tr;
+    im[i + 1] = im[i] - ti;
+    re[i] += tr;
+    im[i] += ti;
+  }
+
+  for (int h = 2; h < n; h <<= 1)
+  {
+    double* wr = &twiddle_re[h - 1];
+    double* wi = &twiddle_im[h - 1];
+    for (int s = 0; s < n; s += h << 1)
+    {
+      double* r0 = &re[s];
+      double* i0 = &im[s];
+      double* r1 = &re[s + h];
+      double* i1 = &im[s + h];
+#if defined(VSX_MATH_3D_SSE2)
+      // h is even from here on, two butterflies at a time
+      for (int j = 0; j < h; j += 2)
+      {
+        __m128d w_r = _mm_loadu_pd(&wr[j]);
+        __m128d w_i = _mm_loadu_pd(&wi[j]);
+        __m128d x_r = _mm_loadu_pd(&r1[j]);
+        __m128d x_i = _mm_loadu_pd(&i1[j]);
+        __m128d t_r = _mm_sub_pd(_mm_mul_pd(w_r, x_r), _mm_mul_pd(w_i, x_i));
+        __m128d t_i = _mm_add_pd(_mm_mul_pd(w_r, x_i), _mm_mul_pd(w_i, x_r));
+        __m128d a_r = _mm_loadu_pd(&r0[j]);
+        __m128d a_i = _mm_loadu_pd(&i0[j]);
+        _mm_storeu_pd(&r1[j], _mm_sub_pd(a_r, t_r));
+        _mm_storeu_pd(&i1[j], _mm_sub_pd(a_i, t_i));
+        _mm_storeu_pd(&r0[j], _mm_add_pd(a_r, t_r));
+        _mm_storeu_pd(&i0[j], _mm_add_pd(a_i, t_i));
+      }
+#else
+      for (int j = 0; j < h; j++)
+      {
+        double tr = wr[j] * r1[j] - wi[j] * i1[j];
+        double ti = wr[j] * i1[j] + wi[j] * r1[j];
+        r1[j] = r0[j] - tr;
+        i1[j] = i0[j] - ti;
+        r0[j] += tr;
+        i0[j] += ti;
+      }
+#endif
+    }
+  }
+
+  if (dir == 1)
+  {
+    double scale = 1.0 / (double)n;
+    for (int i = 0; i < n; i++)
+    {
+      re[i] *= scale;
+      im[i] *= scale;
+    }
+  }
+}
+
+void fft_plan::transform_columns(double* re, double* im, int stride, int count)
+{
+  for (int i = 0; i < n; i++)
+  {
+    int j = bit_reverse[i];
+    if (i < j)
+    {
+      double* ra = &re[i * stride];
+      double* ia = &im[i * stride];
+      double* rb = &re[j * stride];
+      double* ib = &im[j * stride];
+      for (int l = 0; l < count; l++)
+      {
+        double t = ra[l]; ra[l] = rb[l]; rb[l] = t;
+        t = ia[l]; ia[l] = ib[l]; ib[l] = t;
+      }
+    }
+  }
+
+  // the butterflies work on whole rows of the block, the twiddle is the
+  // same for every column so the inner loop vectorizes across columns
+  for (int h = 1; h < n; h <<= 1)
+  {
+    for (int s = 0; s < n; s += h << 1)
+    {
+      for (int j = 0; j < h; j++)
+      {
+        double w_r = twiddle_re[h - 1 + j];
+        double w_i = twiddle_im[h - 1 + j];
+        double* r0 = &re[(s + j) * stride];
+        double* i0 = &im[(s + j) * stride];
+        double* r1 = &re[(s + j + h) * stride];
+        double* i1 = &im[(s + j + h) * stride];
+        int l = 0;
+#if defined(VSX_MATH_3D_SSE2)
+        __m128d vw_r = _mm_set1_pd(w_r);
+        __m128d vw_i = _mm_set1_pd(w_i);
+        for (; l + 2 <= count; l += 2)
+        {
+          __m128d x_r = _mm_loadu_pd(&r1[l]);
+          __m128d x_i = _mm_loadu_pd(&i1[l]);
+          __m128d t_r = _mm_sub_pd(_mm_mul_pd(vw_r, x_r), _mm_mul_pd(vw_i, x_i));
+          __m128d t_i = _mm_add_pd(_mm_mul_pd(vw_r, x_i), _mm_mul_pd(vw_i, x_r));
+          __m128d a_r = _mm_loadu_pd(&r0[l]);
+          __m128d a_i = _mm_loadu_pd(&i0[l]);
+          _mm_storeu_pd(&r1[l], _mm_sub_pd(a_r, t_r));
+          _mm_storeu_pd(&i1[l], _mm_sub_pd(a_i, t_i));
+          _mm_storeu_pd(&r0[l], _mm_add_pd(a_r, t_r));
+          _mm_storeu_pd(&i0[l], _mm_add_pd(a_i, t_i));
+        }
+#endif
+        for (; l < count; l++)
+        {
+          double tr = w_r * r1[l] - w_i * i1[l];
+          double ti = w_r * i1[l] + w_i * r1[l];
+          r1[l] = r0[l] - tr;
+          i1[l] = i0[l] - ti;
+          r0[l] += tr;
+          i0[l] += ti;
+        }
+      }
+    }
+  }
+
+  if (dir == 1)
+  {
+    double scale = 1.0 / (double)n;
+    for (int i = 0; i < n; i++)
+    {
+      for (int l = 0; l < count; l++)
+      {
+        re[i * stride + l] *= scale;
+        im[i * stride + l] *= scale;
+      }
+    }
+  }
+}
+
+void fft_plan::row_job(void* arg, size_t start, size_t end)
+{
+  fft_plan_job* job = (fft_plan_job*)arg;
+  int n = job->plan->n;
+  for (size_t r = start; r < end; r++)
+    job->plan->transform(&job->re[r * n], &job->im[r * n]);
+}
+
+void fft_plan::column_job(void* arg, size_t start, size_t end)
+{
+  fft_plan_job* job = (fft_plan_job*)arg;
+  int n = job->plan->n;
+  for (size_t b = start; b < end; b++)
+  {
+    int first = (int)b * FFT_PLAN_COLUMN_BLOCK;
+    int count = n - first;
+    if (count > FFT_PLAN_COLUMN_BLOCK) count = FFT_PLAN_COLUMN_BLOCK;
+    job->plan->transform_columns(&job->re[first], &job->im[first], n, count);
+  }
+}
+
+void fft_plan::transform_2d(double* re, double* im)
+{
+  if (!n) return;
+  fft_plan_job job;
+  job.plan = this;
+  job.re = re;
+  job.im = im;
+
+  vsx_thread_pool* pool = vsx_thread_pool::get_instance();
+  pool->parallel_for(n, FFT_PLAN_MIN_VALUES / n + 1, &row_job, (void*)&job);
+
+  size_t blocks = (n + FFT_PLAN_COLUMN_BLOCK - 1) / FFT_PLAN_COLUMN_BLOCK;
+  pool->parallel_for(blocks, FFT_PLAN_MIN_VALUES / (n * FFT_PLAN_COLUMN_BLOCK) + 1, &column_job, (void*)&job);
+}
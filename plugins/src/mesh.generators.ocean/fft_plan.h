@@ -0,0 +1,71 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef FFT_PLAN_H
+#define FFT_PLAN_H
+
+// Radix-2 complex FFT with the bit reversal permutation and twiddle factors
+// computed once per size instead of on every transform.
+//
+// Data is kept split (separate real and imaginary arrays) so that the
+// butterflies vectorize, 2D grids are row-major n * n.
+//
+// Same conventions as Paul Bourke's FFT() in bourke.cpp:
+// dir = 1 is the forward transform (scaled by 1/n), dir = -1 the reverse.
+class fft_plan
+{
+  int n;
+  int dir;
+  int* bit_reverse;
+  // stage with half size h keeps its h twiddles at offset h - 1
+  double* twiddle_re;
+  double* twiddle_im;
+
+  void free_data();
+
+  static void row_job(void* arg, size_t start, size_t end);
+  static void column_job(void* arg, size_t start, size_t end);
+
+public:
+  fft_plan();
+  ~fft_plan();
+
+  // size must be a power of two, returns false otherwise
+  bool init(int size, int direction);
+
+  int get_size()
+  {
+    return n;
+  }
+
+  // one contiguous line of n values
+  void transform(double* re, double* im);
+
+  // count lines side by side, value k of line l is at re[k * stride + l]
+  void transform_columns(double* re, double* im, int stride, int count);
+
+  // n * n grid, rows and columns split over the engine thread pool
+  void transform_2d(double* re, double* im);
+};
+
+#endif
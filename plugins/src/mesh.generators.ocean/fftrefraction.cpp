@@ -20,6 +20,7 @@
 
 #include "fftrefraction.h"
 #include "matrix.h"
+#include "vsx_thread_pool.h"
 
 #include <math.h>
 
@@ -64,6 +65,72 @@ Alaska::Alaska()
   //	wind = .7;
   wind = 0.1;
   factor = 10.0;	//this determines speed of wave
+
+  nx = ny = 0;
+  hold_horizontal = 0;
+  c = 0;
+  mH0 = 0;
+  p_re = p_im = 0;
+  q_re = q_im = 0;
+  sea = 0;
+  big_normals = 0;
+  set_size(MIN_GRID_SIZE);
+}
+
+Alaska::~Alaska()
+{
+  free_data();
+}
+
+void Alaska::free_data()
+{
+  delete[] hold_horizontal;
+  delete[] c;
+  delete[] mH0;
+  delete[] p_re;
+  delete[] p_im;
+  delete[] q_re;
+  delete[] q_im;
+  delete[] sea;
+  delete[] big_normals;
+  hold_horizontal = 0;
+  c = 0;
+  mH0 = 0;
+  p_re = p_im = 0;
+  q_re = q_im = 0;
+  sea = 0;
+  big_normals = 0;
+  nx = ny = 0;
+}
+
+bool Alaska::set_size(int size)
+{
+  if (size < MIN_GRID_SIZE) size = MIN_GRID_SIZE;
+  if (size > MAX_GRID_SIZE) size = MAX_GRID_SIZE;
+  if (size == nx)
+    return true;
+  if (!plan.init(size, -1))
+    return false;
+
+  free_data();
+  nx = ny = size;
+  hold_horizontal = new double[nx*ny*3];
+  c = new COMPLEX[nx*ny];
+  mH0 = new COMPLEX[nx*ny];
+  p_re = new double[nx*ny];
+  p_im = new double[nx*ny];
+  q_re = new double[nx*ny];
+  q_im = new double[nx*ny];
+  sea = new double[(nx+1)*(ny+1)*3];
+  big_normals = new double[(nx+1)*(ny+1)*3];
+  return true;
+}
+
+// rows per chunk when splitting row loops over the thread pool,
+// the default 64 grid isn't worth splitting
+size_t Alaska::min_rows()
+{
+  return 16384 / nx + 1;
 }
 
 
@@ -88,24 +155,21 @@ void	Alaska::calculate_ho()
 	double horizontal[2];
 	double root_of_phillips;
 	double gauss_value[2];// this is where gauss generator returns two random values
-	for (int i=0;i<NX;i++)
+	for (int i=0;i<nx;i++)
 	{
-		for (int j=0;j<NY;j++)
+		for (int j=0;j<ny;j++)
 		{
-			// hold_horizontal saves these fixed calculations for later use:k[2],klen,klen*klen
-			horizontal[0]=hold_horizontal[i][j][0]=2.0*PI*((double)i-.5*NX)/MAX_WORLD_X;// center the origin
-			horizontal[1]=hold_horizontal[i][j][1]=2.0*PI*((double)j-.5*NX)/MAX_WORLD_Y;// center the origin
-			hold_horizontal[i][j][3]=hold_horizontal[i][j][0]*hold_horizontal[i][j][0]+hold_horizontal[i][j][1]*hold_horizontal[i][j][1];
-			hold_horizontal[i][j][2]=sqrt(hold_horizontal[i][j][3]);
-
-		//	horizontal[0]=hold_horizontal[i][j][0]=2.0*PI*((float)i-.5*NX)/MAX_WORLD_X;
-		//	horizontal[1]=hold_horizontal[i][j][1]=2.0*PI*((float)j-.5*NX)/MAX_WORLD_Y;
+			double* k = &hold_horizontal[(i*ny+j)*3];
+			// hold_horizontal saves these fixed calculations for later use:k[2],klen
+			horizontal[0]=k[0]=2.0*PI*((double)i-.5*nx)/MAX_WORLD_X;// center the origin
+			horizontal[1]=k[1]=2.0*PI*((double)j-.5*nx)/MAX_WORLD_Y;// center the origin
+			k[2]=sqrt(k[0]*k[0]+k[1]*k[1]);
 
 			gauss(gauss_value);
 			root_of_phillips=sqrt(phillips(a_global,horizontal,wind_global));
 
-			mH0[i][j].real=INV_SQRT_TWO*gauss_value[0]*root_of_phillips;
-			mH0[i][j].imag=INV_SQRT_TWO*gauss_value[1]*root_of_phillips;
+			mH0[i*ny+j].real=INV_SQRT_TWO*gauss_value[0]*root_of_phillips;
+			mH0[i*ny+j].imag=INV_SQRT_TWO*gauss_value[1]*root_of_phillips;
 		}
 	}
 }
@@ -133,124 +197,97 @@ void Alaska::make_signed(Vector3 &v, unsigned char *ip)
 }
 
 
-void Alaska::display(void)
+// This is h~(K, t) from the Tessendorf paper.
+// The lower half of the rows (up to and including the middle one) is
+// computed directly, the upper half mirrors it with real and imaginary
+// parts swapped, exactly like the original single loop did.
+void Alaska::spectrum_rows(void* ptr, size_t start, size_t end)
 {
-
-  //double kvector[2];
-  double klength,wkt;
-  //////////////////alernativ below///////////
-	int yHalf = NY/2 + 1;
-	for (int i = 0; i<yHalf; ++i)
+	Alaska* my = (Alaska*)ptr;
+	int n = my->nx;
+	for (int r = (int)start; r < (int)end; ++r)
 	{
-		//int yLine = i*NY;
-		// Mirror the y line index for calculation of -k
-		// The line below evalutes yLineMirr = y == 0 ? 0 : (mYSize-y)*mXSize;
-		// by wrapping the heightmap, since it is periodic.
-		//int yLineMirr = ((NY-i)% NY)*NY;
-		for (int j = 0; j<NX; ++j)
+		bool mirrored = r > n/2;
+		int i = mirrored ? n - r - 1 : r;
+		for (int col = 0; col < n; ++col)
 		{
-			//kvector[0]=2.0*PI*((float)i-.5*NX)/NX;//I was using these
-			//kvector[1]=2.0*PI*((float)j-.5*NY)/NY;
-
-	//		kvector[0]=2.0*PI*((float)i-.5*NX)/MAX_WORLD_X;//but I think I should use these
-	//		kvector[1]=2.0*PI*((float)j-.5*NY)/MAX_WORLD_Y;
+			int j = mirrored ? n - col - 1 : col;
+			double klength = my->hold_horizontal[(i*n+j)*3+2];
+			double wkt = sqrt(klength * my->GRAV_CONSTANT) * my->dtime;
+			double cs = cos(wkt);
+			double sn = sin(wkt);
+			COMPLEX& h = my->mH0[i*n+j];
+			COMPLEX& hm = my->mH0[(n-i-1)*n + (n-j-1)];
 
-      //kvector[0]=hold_horizontal[i][j][0];
-      //kvector[1]=hold_horizontal[i][j][1];
-
-		//	klength=sqrt(kvector[0]*kvector[0]+kvector[1]*kvector[1]);
-			klength=hold_horizontal[i][j][2];
-
-			wkt = sqrt(klength * GRAV_CONSTANT) * dtime;
-
-			// yLineMirr+mXSize-x is the index of -k
-			//int  kNegIndex = yLineMirr*NY + ((NY-j)% NY);
-
-			// This is h~(K, t) from the Tessendorf paper.
-		   	c[i][j].real= mH0[i][j].real*cos(wkt)
-				+ mH0[i][j].imag*sin(wkt)
-				+ mH0[NX - i-1][NY - j-1].real*cos(wkt)
-				- mH0[NX - i-1][NY -j-1].imag*sin(wkt);
-
-			c[i][j].imag= mH0[i][j].imag*cos(wkt)
-				+ mH0[i][j].real*sin(wkt)
-				-mH0[NX - i-1][NY - j-1].imag*cos(wkt)
-	 			- mH0[NX - i-1][NY -j-1].real*sin(wkt);
-
-			// Store it for later transformation
+			double re = h.real*cs + h.imag*sn + hm.real*cs - hm.imag*sn;
+			double im = h.imag*cs + h.real*sn - hm.imag*cs - hm.real*sn;
 
 			// h~(-K) = conj(h~(K))
-			if (i != yHalf-1)
+			if (mirrored)
+			{
+				my->c[r*n+col].real = im;
+				my->c[r*n+col].imag = re;
+			}
+			else
 			{
-				c[NX - i-1][NY - j-1].imag= mH0[i][j].real*cos(wkt)
-				+ mH0[i][j].imag*sin(wkt)
-				+ mH0[NX - i-1][NY - j-1].real*cos(wkt)
-				- mH0[NX - i-1][NY -j-1].imag*sin(wkt);
-
-				c[NY - i-1][NY - j-1].real= mH0[i][j].imag*cos(wkt)
-				+ mH0[i][j].real*sin(wkt)
-				-mH0[NX - i-1][NY - j-1].imag*cos(wkt)
-	 			- mH0[NX - i-1][NY -j-1].real*sin(wkt);
+				my->c[r*n+col].real = re;
+				my->c[r*n+col].imag = im;
 			}
 		}
 	}
+}
+
+void Alaska::display(void)
+{
+	vsx_thread_pool* pool = vsx_thread_pool::get_instance();
+	pool->parallel_for(nx, min_rows(), &spectrum_rows, (void*)this);
 
-		//////////////////end alternative////////////
 	pre_choppy();
-	dir=-1;
-	FFT2D(c, NX, NY, dir);// do the inverse FFT to get the surface
-	///////////////negative power term creation
-	for (int i=0;i<NX;i++)
-	{
-		for (int j=0;j<NY;j++)
-		{
-			c[i][j].real *= float(neg1Pow(i+j));
-	
-			// while we are looping, set up the final x,y values for display
-			displayXY[i][j][0]=((double)i/NX)*MAX_WORLD_X+mDeltaX[i][j].imag;
-			displayXY[i][j][1]=((double)j/NY)*MAX_WORLD_Y+mDeltaY[i][j].imag;
-		}
-	}
-	make_normals(c);
+	// do the inverse FFTs to get the surface
+	plan.transform_2d(p_re, p_im);
+	plan.transform_2d(q_re, q_im);
 
 	prep_loop();	//this loop loads the actual sea vertices
-
-
+	make_normals();
 }
 
-void Alaska::make_normals(COMPLEX c[NX][NY])
+// normals from the finished height field; the last row and column of the
+// grid reuse the first ones since the surface is periodic
+void Alaska::normal_rows(void* ptr, size_t start, size_t end)
 {
-	double x_value,y_value;
-	x_value=MAX_WORLD_X/NX;
-	y_value=MAX_WORLD_Y/NY;
+	Alaska* my = (Alaska*)ptr;
+	int n = my->nx;
+	double x_value = (double)MAX_WORLD_X/n;
+	double y_value = (double)MAX_WORLD_Y/n;
+	double ta[3],tb[3],tc[3];
 
-	for (int i=0;i<NX-1;i++)
+	for (int i = (int)start; i < (int)end; i++)
 	{
-		for (int j=0;j<NY-1;j++)
+		int si = i % n;
+		if (si == n-1) si = 0;
+		for (int j = 0; j <= n; j++)
 		{
+			int sj = j % n;
+			if (sj == n-1) sj = 0;
+			double h = my->sea_at(si,sj)[2];
 			ta[0]=x_value;
 			ta[1]=0.0;
-			ta[2]=(c[i+1][j].real-c[i][j].real)*scale_height;
+			ta[2]=(my->sea_at(si+1,sj)[2]-h)*my->scale_height;
 			tb[0]=0.0;
 			tb[1]=y_value;
-			tb[2]=(c[i][j+1].real-c[i][j].real)*scale_height;
+			tb[2]=(my->sea_at(si,sj+1)[2]-h)*my->scale_height;
 			cross_prod(ta,tb,tc);
-			normals[i][j][0]=tc[0];
-			normals[i][j][1]=tc[1];
-			normals[i][j][2]=tc[2];
+			double* nn = my->normal_at(i,j);
+			nn[0]=tc[0];
+			nn[1]=tc[1];
+			nn[2]=tc[2];
 		}
 	}
+}
 
-	for (int i=0;i<NX;i++)
-	{
-		normals[i][NX-1][0]=normals[i][0][0];
-		normals[i][NX-1][1]=normals[i][0][1];
-		normals[i][NX-1][2]=normals[i][0][2];
-
-		normals[NX-1][i][0]=normals[0][i][0];
-		normals[NX-1][i][1]=normals[0][i][1];
-		normals[NX-1][i][2]=normals[0][i][2];
-	}
+void Alaska::make_normals()
+{
+	vsx_thread_pool::get_instance()->parallel_for(nx+1, min_rows(), &normal_rows, (void*)this);
 }
 
 
@@ -264,126 +301,105 @@ void Alaska::myinit(void)
 
 float	Alaska::neg1Pow(int k)
 {
-	return pow(-1,k);
+	return (k & 1) ? -1.0f : 1.0f;
 }
 
-void	Alaska::pre_choppy()
+// Sets up the spectra for the inverse FFTs. Only the real part of the
+// height transform and the real parts of the DX DY choppiness transforms
+// (the imaginary part of i * k/|k| * c) are ever used. The real part of a
+// transform is the transform of the hermitian part of its input, and two
+// hermitian spectra can share one complex transform since both results are
+// real, which saves a third of the FFT work.
+void Alaska::choppy_rows(void* ptr, size_t start, size_t end)
 {
-	//this function sets up the DX DY choppiness
-	// it assumes that the current c values are in position
-	// before the c values have been FFT'd
-
-	double k[2],klen;
-
-	for (int i=0;i<NX;i++)
+	Alaska* my = (Alaska*)ptr;
+	int n = my->nx;
+	for (int i = (int)start; i < (int)end; i++)
 	{
-		for (int j=0;j<NY;j++)
+		int mi = (n - i) % n;
+		for (int j=0;j<n;j++)
 		{
-
-		//	k[0]=2.0*PI*((float)i-.5*NX)/MAX_WORLD_X;
-		//	k[1]=2.0*PI*((float)j-.5*NY)/MAX_WORLD_Y;
-
-			k[0]=hold_horizontal[i][j][0];
-			k[1]=hold_horizontal[i][j][1];
-
-			klen=sqrt(k[0]*k[0]+k[1]*k[1]);
-			if (klen==0)
+			int mj = (n - j) % n;
+			int a = i*n+j;
+			int b = mi*n+mj;
+			double* k = &my->hold_horizontal[a*3];
+			double* km = &my->hold_horizontal[b*3];
+
+			double dx = 0.0, dy = 0.0;
+			if (k[2] != 0.0)
 			{
-				mDeltaX[i][j].real=0.0;
-				mDeltaX[i][j].imag=0.0;
-				mDeltaY[i][j].real=0.0;
-				mDeltaY[i][j].imag=0.0;
+				dx += my->c[a].imag*(-k[0]/k[2]);
+				dy += my->c[a].imag*(-k[1]/k[2]);
 			}
-			else
+			if (km[2] != 0.0)
 			{
-				mDeltaX[i][j].real=0.0;
-				mDeltaX[i][j].imag=c[i][j].imag*(-k[0]/klen);
-				mDeltaY[i][j].real=0.0;
-				mDeltaY[i][j].imag=c[i][j].imag*(-k[1]/klen);
+				dx += my->c[b].imag*(-km[0]/km[2]);
+				dy += my->c[b].imag*(-km[1]/km[2]);
 			}
+
+			my->p_re[a] = 0.5 * (my->c[a].real + my->c[b].real);
+			my->p_im[a] = 0.5 * (my->c[a].imag - my->c[b].imag) + 0.5 * dx;
+			my->q_re[a] = 0.5 * dy;
+			my->q_im[a] = 0.0;
 		}
 	}
+}
 
-	dir=-1;
-	if (FFT2D(mDeltaX, NX, NY, dir)==FALSE){printf("false on DXFFT!\n");}
-	dir=-1;
-	if (FFT2D(mDeltaY, NX, NY, dir)==FALSE){printf("false on DYFFT!\n");}
+void	Alaska::pre_choppy()
+{
+	//this function sets up the DX DY choppiness
+	// it assumes that the current c values are in position
+	// before the c values have been FFT'd
+	vsx_thread_pool::get_instance()->parallel_for(nx, min_rows(), &choppy_rows, (void*)this);
+}
 
-	for (int i=0;i<NX;i++)
+void Alaska::surface_rows(void* ptr, size_t start, size_t end)
+{
+	Alaska* my = (Alaska*)ptr;
+	int n = my->nx;
+	for (int i = (int)start; i < (int)end; i++)
 	{
-		for (int j=0;j<NY;j++)
+		for (int j=0;j<n;j++)
 		{
-			mDeltaX[i][j].real *= (double) neg1Pow(i+j)*lambda;
-			mDeltaX[i][j].imag *= (double) neg1Pow(i+j)*lambda;
-			mDeltaY[i][j].real *= (double) neg1Pow(i+j)*lambda;
-			mDeltaY[i][j].imag *= (double) neg1Pow(i+j)*lambda;
+			int a = i*n+j;
+			double sign = my->neg1Pow(i+j);
+			double* s = my->sea_at(i,j);
+			s[0]=((double)i/n)*MAX_WORLD_X;
+			s[1]=((double)j/n)*MAX_WORLD_Y;
+			if (!my->normals_only)
+			{
+				s[0]+=my->p_im[a]*sign*my->lambda;
+				s[1]+=my->q_re[a]*sign*my->lambda;
+			}
+			s[2]=my->p_re[a]*sign;
 		}
 	}
-
 }
 
 void	Alaska::prep_loop()
 {
-  if (normals_only)
-  {
-    for (int i=0;i<NX;i++)
-    {
-      for (int j=0;j<NY;j++)
-      {
-        sea[i][j][0]=(float)i;
-        sea[i][j][1]=(float)j;
-        sea[i][j][2]=c[i][j].real;
-
-        big_normals[i][j][0]=normals[i][j][0];
-        big_normals[i][j][1]=normals[i][j][1];
-        big_normals[i][j][2]=normals[i][j][2];
-      }
-    }
-  }
-  else
-  {
-    for (int i=0;i<NX;i++)
-    {
-      for (int j=0;j<NY;j++)
-      {
-        sea[i][j][0]=displayXY[i][j][0];
-        sea[i][j][1]=displayXY[i][j][1];
-        sea[i][j][2]=c[i][j].real;
-
-        big_normals[i][j][0]=normals[i][j][0];
-        big_normals[i][j][1]=normals[i][j][1];
-        big_normals[i][j][2]=normals[i][j][2];
-      }
-    }
-  }
+	vsx_thread_pool::get_instance()->parallel_for(nx, min_rows(), &surface_rows, (void*)this);
 
 	//now fill in the final row and column of the sea correctly
-	// and fill in the normals
-	for (int i=0;i<NX;i++)
+	for (int i=0;i<nx;i++)
 	{
-		sea[BIG_NX-1][i][0]=sea[0][i][0]+MAX_WORLD_X;
-		sea[BIG_NX-1][i][1]=sea[0][i][1];
-		sea[BIG_NX-1][i][2]=sea[0][i][2];
-
-		sea[i][BIG_NY-1][0]=sea[i][0][0];
-		sea[i][BIG_NY-1][1]=sea[i][0][1]+MAX_WORLD_Y;
-		sea[i][BIG_NY-1][2]=sea[i][0][2];
-
-		big_normals[BIG_NX-1][i][0]=big_normals[0][i][0];
-		big_normals[BIG_NX-1][i][1]=big_normals[0][i][1];
-		big_normals[BIG_NX-1][i][2]=big_normals[0][i][2];
-
-		big_normals[i][BIG_NY-1][0]=big_normals[i][0][0];
-		big_normals[i][BIG_NY-1][1]=big_normals[i][0][1];
-		big_normals[i][BIG_NY-1][2]=big_normals[i][0][2];
+		double* s = sea_at(nx,i);
+		double* s0 = sea_at(0,i);
+		s[0]=s0[0]+MAX_WORLD_X;
+		s[1]=s0[1];
+		s[2]=s0[2];
+
+		s = sea_at(i,ny);
+		s0 = sea_at(i,0);
+		s[0]=s0[0];
+		s[1]=s0[1]+MAX_WORLD_Y;
+		s[2]=s0[2];
 	}
-	sea[BIG_NX-1][BIG_NY-1][0]=sea[0][0][0]+MAX_WORLD_X;
-	sea[BIG_NX-1][BIG_NY-1][1]=sea[0][0][1]+MAX_WORLD_Y;
-	sea[BIG_NX-1][BIG_NY-1][2]=sea[0][0][2];
-
-	big_normals[BIG_NX-1][BIG_NY-1][0]=big_normals[0][0][0];
-	big_normals[BIG_NX-1][BIG_NY-1][1]=big_normals[0][0][1];
-	big_normals[BIG_NX-1][BIG_NY-1][2]=big_normals[0][0][2];
+	double* s = sea_at(nx,ny);
+	double* s0 = sea_at(0,0);
+	s[0]=s0[0]+MAX_WORLD_X;
+	s[1]=s0[1]+MAX_WORLD_Y;
+	s[2]=s0[2];
 }
 
 // This function calculates the surface hight points c[x][y].real each time
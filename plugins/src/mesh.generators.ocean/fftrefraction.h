@@ -11,6 +11,7 @@
 #include <GL/glew.h>
 //#include <GL\glut.h>
 #include "paulslib.h"
+#include "fft_plan.h"
 
 struct SVertex3
 {
@@ -22,15 +23,13 @@ struct Vector3
 	float x, y, z;
 };
 
-#define NX 64
-#define NY 64
+// grid size limits, the size itself is set at runtime with Alaska::set_size
+#define MIN_GRID_SIZE 64
+#define MAX_GRID_SIZE 1024
 
 #define INV_SQRT_TWO (1.0f)/sqrt(2.0f)
 #define MAX_WORLD_X 64
 #define MAX_WORLD_Y 64
-#define BIG_NX (NX+1)
-#define BIG_NY (NY+1)
-#define STEPX MAX_WORLD_X/NX
 
 #define MINX 0
 #define MAXX 100
@@ -49,37 +48,51 @@ class Alaska
 public:
   bool normals_only;
   float GRAV_CONSTANT;
-  double hold_horizontal[NX][NY][4];//store k[0],k[1],klen,klen*klen
-  double sea[BIG_NX][BIG_NY][3];
-  COMPLEX c[NX][NY];
-  COMPLEX mH0[NX][NY];
-  COMPLEX mDeltaX[NX][NY];
-  COMPLEX mDeltaY[NX][NY];
+  int nx, ny;	// grid size, power of two, nx == ny
+  double *hold_horizontal;//store k[0],k[1],klen per grid point
+  COMPLEX *c;	// h~(K, t)
+  COMPLEX *mH0;
+  // the inverse FFTs only ever produce real fields, so they are packed
+  // two to a transform: p = height + i * choppy x, q = choppy y
+  double *p_re, *p_im;
+  double *q_re, *q_im;
+  fft_plan plan;
+  double *sea;	// (nx+1) * (ny+1) * 3, last row/column wraps around
+  double *big_normals;
   GLubyte * byteptr;
-  double displayXY[NX][NY][2]; // holds the actual x and y for display
-  
+
   double a_global; // phillips constant
   double wind_global[2];
   double scale_height;	//scale the wave heights
   int deep;
-  double normals[NX][NY][3];
-  double big_normals[BIG_NX][BIG_NY][3];
-  double ta[3],tb[3],tc[3];
-  
+
 
 
   Alaska();
+  ~Alaska();
 
   float time;
   float dtime;
+  // reallocates the grids, call calculate_ho() afterwards
+  bool set_size(int size);
   void	calculate_ho();
   void display(void);
-  void make_normals(COMPLEX c[NX][NY]);
+  void make_normals();
   void myinit(void);
   void pre_choppy();
   void prep_loop();
   void idle(void);
 
+  inline double* sea_at(int i, int j)
+  {
+    return &sea[(i*(ny+1)+j)*3];
+  }
+
+  inline double* normal_at(int i, int j)
+  {
+    return &big_normals[(i*(ny+1)+j)*3];
+  }
+
   // Helpers
   double phillips(double a,double k[2],double wind[2]);
   void my_normalize(Vector3 &vec);
@@ -97,10 +110,18 @@ public:
 
   double factor;	//this determines speed of wave
   double start_time;
+
+private:
+  void free_data();
+  // per row work for the thread pool
+  static void spectrum_rows(void* ptr, size_t start, size_t end);
+  static void choppy_rows(void* ptr, size_t start, size_t end);
+  static void surface_rows(void* ptr, size_t start, size_t end);
+  static void normal_rows(void* ptr, size_t start, size_t end);
+  size_t min_rows();
 };
 
   void gauss(double mywork[2]);
 int	FFT(int,int,double *,double *);
 int	DFT(int,int,double *,double *);
-int	FFT2D(COMPLEX [][NY], int,int,int);
 
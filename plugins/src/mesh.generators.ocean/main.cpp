@@ -27,46 +27,216 @@
 #include "vsx_module.h"
 #include "vsx_math_3d.h"
 #include "fftrefraction.h"
+#include "vsx_thread_pool.h"
 #include <pthread.h>
 #include <semaphore.h>
 #if PLATFORM_FAMILY == PLATFORM_FAMILY_UNIX
 #include <unistd.h>
 #endif
 
+// The surface is built as strips of triangles, two grid rows per strip.
+// Every strip has a fixed number of vertices and faces so the arrays are
+// sized up front and the strips are filled in parallel.
+struct ocean_mesh_job
+{
+  Alaska* ocean;
+  vsx_mesh* mesh;
+  int verts_per_strip;
+  int faces_per_strip;
+};
+
+static void ocean_strip_faces(ocean_mesh_job* job, size_t strip)
+{
+  vsx_face* faces = job->mesh->data->faces.get_pointer() + strip * job->faces_per_strip;
+  GLuint b = (GLuint)(strip * job->verts_per_strip);
+  for (int f = 0; f < job->faces_per_strip; f++)
+  {
+    faces[f].a = b + f;
+    faces[f].b = b + f + 1;
+    faces[f].c = b + f + 2;
+  }
+}
+
+static void ocean_allocate_mesh(ocean_mesh_job* job, size_t num_strips, bool tex_coords)
+{
+  vsx_mesh_data* d = job->mesh->data;
+  size_t num_verts = num_strips * job->verts_per_strip;
+  d->vertices.allocate(num_verts - 1);
+  d->vertex_normals.allocate(num_verts - 1);
+  d->vertices.reset_used(num_verts);
+  d->vertex_normals.reset_used(num_verts);
+  if (tex_coords)
+  {
+    d->vertex_tex_coords.allocate(num_verts - 1);
+    d->vertex_tex_coords.reset_used(num_verts);
+  }
+  else
+    d->vertex_tex_coords.reset_used(0);
+  d->faces.allocate(num_strips * job->faces_per_strip - 1);
+  d->faces.reset_used(num_strips * job->faces_per_strip);
+}
+
+// the sea tiled 3x3 around the origin
+static void ocean_sea_strips(void* ptr, size_t start, size_t end)
+{
+  ocean_mesh_job* job = (ocean_mesh_job*)ptr;
+  Alaska& ocean = *job->ocean;
+  int n = ocean.nx;
+  vsx_vector* vertices = job->mesh->data->vertices.get_pointer();
+  vsx_vector* normals = job->mesh->data->vertex_normals.get_pointer();
+  for (size_t strip = start; strip < end; strip++)
+  {
+    int k = (int)(strip % 3) - 1;
+    int i = (int)((strip / 3) % n);
+    int L = (int)(strip / (3 * n)) - 1;
+    size_t v = strip * job->verts_per_strip;
+    for (int j = 0; j < n + 1; j++)
+    {
+      for (int row = i; row < i + 2; row++)
+      {
+        double* s = ocean.sea_at(row, j);
+        double* nn = ocean.normal_at(row, j);
+        normals[v] = vsx_vector(nn[0], nn[1], nn[2]);
+        vertices[v] = vsx_vector(s[0] + L * MAX_WORLD_X, s[1] + k * MAX_WORLD_Y, s[2] * ocean.scale_height);
+        v++;
+      }
+    }
+    ocean_strip_faces(job, strip);
+  }
+}
+
+static void ocean_generate_sea(Alaska& ocean, vsx_mesh* mesh)
+{
+  ocean_mesh_job job;
+  job.ocean = &ocean;
+  job.mesh = mesh;
+  job.verts_per_strip = 2 * (ocean.nx + 1);
+  job.faces_per_strip = job.verts_per_strip - 2;
+  size_t num_strips = 9 * ocean.nx;
+  ocean_allocate_mesh(&job, num_strips, false);
+  vsx_thread_pool::get_instance()->parallel_for(num_strips, 16, &ocean_sea_strips, (void*)&job);
+}
+
+// the sea wrapped around the z axis, every other column
+#define TDIV (float)MAX_WORLD_X
+#define TD2  (float)MAX_WORLD_X*0.5f
+static void ocean_tunnel_strips(void* ptr, size_t start, size_t end)
+{
+  ocean_mesh_job* job = (ocean_mesh_job*)ptr;
+  Alaska& ocean = *job->ocean;
+  int n = ocean.nx;
+  vsx_vector* vertices = job->mesh->data->vertices.get_pointer();
+  vsx_vector* normals = job->mesh->data->vertex_normals.get_pointer();
+  vsx_tex_coord* tex_coords = job->mesh->data->vertex_tex_coords.get_pointer();
+  for (size_t strip = start; strip < end; strip++)
+  {
+    int i = (int)((strip / 3) % n);
+    size_t v = strip * job->verts_per_strip;
+    for (int j = 0; j < n + 1; j += 2)
+    {
+      for (int row = i; row < i + 2; row++)
+      {
+        double* s = ocean.sea_at(row, j);
+        double* bn = ocean.normal_at(row, j);
+        float gr = PI*2.0f * (float)s[0]/(TDIV);
+        float nra = gr + 90.0f / 360.0f * 2*PI;
+
+        vsx_vector nn;
+        nn.x = bn[0];
+        nn.y = bn[1];
+        nn.normalize();
+        normals[v] = vsx_vector(
+          nn.x* cos(nra) + nn.y * -sin(nra),
+          nn.x* sin(nra) + nn.y * cos(nra),
+          bn[2]);
+        normals[v].normalize();
+
+        float gz = 2.0f+fabs(s[2])*1.5f;
+        vertices[v].x = cos(gr)*gz;
+        vertices[v].y = sin(gr)*gz;
+        vertices[v].z = s[1]*2.0f;
+        tex_coords[v] = vsx_tex_coord__(fabs(s[0]-TD2)*2.0f , fabs(s[1]-TD2)*2.0f);
+        v++;
+      }
+    }
+    ocean_strip_faces(job, strip);
+  }
+}
+
+static void ocean_generate_tunnel(Alaska& ocean, vsx_mesh* mesh)
+{
+  ocean_mesh_job job;
+  job.ocean = &ocean;
+  job.mesh = mesh;
+  job.verts_per_strip = 2 * (ocean.nx / 2 + 1);
+  job.faces_per_strip = job.verts_per_strip - 2;
+  size_t num_strips = 9 * ocean.nx;
+  ocean_allocate_mesh(&job, num_strips, true);
+  vsx_thread_pool::get_instance()->parallel_for(num_strips, 16, &ocean_tunnel_strips, (void*)&job);
+}
+
+
+// Work order for the ocean worker threads. run() fills it in while the
+// worker is idle and the worker takes a copy before starting.
+struct ocean_job
+{
+  float dtime;
+  int grid_size;
+  int normals_only;
+  bool spectrum_changed;
+  double factor;
+  float wind;
+  double wind_x;
+  double wind_y;
+};
+
+static void ocean_apply_job(Alaska& ocean, ocean_job& job)
+{
+  ocean.dtime = job.dtime;
+  ocean.normals_only = job.normals_only != 0;
+  if (job.spectrum_changed || ocean.nx != job.grid_size)
+  {
+    ocean.factor = job.factor;
+    ocean.wind = job.wind;
+    ocean.wind_global[0] = job.wind_x;
+    ocean.wind_global[1] = job.wind_y;
+    ocean.set_size(job.grid_size);
+    ocean.calculate_ho();
+  }
+}
+
 class vsx_module_mesh_ocean_tunnel_threaded : public vsx_module {
 public:
   // in
   vsx_module_param_float* time_speed;
+  vsx_module_param_int* grid_size;
   // out
   vsx_module_param_mesh* result;
 
   // internal
-  vsx_mesh* mesh;
+  vsx_mesh* mesh; // the one the worker fills, the other one is on the output
   vsx_mesh* mesh_a;
   vsx_mesh* mesh_b;
-  //bool first_run;
   Alaska ocean;
   float t;
 
   // threading stuff
   pthread_t         worker_t;
 
+  // only held for flag updates, never while the ocean is computed
   pthread_mutex_t   mesh_mutex;
   int               thread_has_something_to_deliver; // locked by the mesh mutex
-  pthread_mutex_t   thread_exit_mutex;
+  int               thread_exit; // locked by the mesh mutex
+  ocean_job         job; // locked by the mesh mutex
   sem_t sem_worker_todo; // indicates wether the worker should do anything.
   bool              thread_created;
 
-  int p_updates;
-  bool              worker_running;
-  int               thread_state;
-  int               thread_exit;
   vsx_module_mesh_ocean_tunnel_threaded()
   {
     pthread_mutex_init(&mesh_mutex,NULL);
-    pthread_mutex_init(&thread_exit_mutex,NULL);
     sem_init(&sem_worker_todo,0,0);
     thread_has_something_to_deliver = 0;
+    thread_exit = 0;
     thread_created = false;
     mesh_a = 0;
     mesh_b = 0;
@@ -79,9 +249,10 @@ public:
   {
     if (thread_created)
     {
-      pthread_mutex_lock(&thread_exit_mutex);
+      pthread_mutex_lock(&mesh_mutex);
         thread_exit = 1;
-      pthread_mutex_unlock(&thread_exit_mutex);
+      pthread_mutex_unlock(&mesh_mutex);
+      sem_post(&sem_worker_todo);
       void* ret;
       int jret = pthread_join(worker_t, &ret);
       if (jret == 22) printf("ocean_tunnel_threaded: pthread_join failed: EINVAL\n");
@@ -92,7 +263,6 @@ public:
       delete mesh_a;
       delete mesh_b;
     }
-    pthread_mutex_destroy(&thread_exit_mutex);
     pthread_mutex_destroy(&mesh_mutex);
     sem_destroy(&sem_worker_todo);
   }
@@ -101,7 +271,10 @@ public:
   {
     info->identifier = "mesh;generators;ocean_tunnel";
     info->description = "";
-    info->in_param_spec = "time_speed:float";
+    info->in_param_spec =
+        "time_speed:float,"
+        "grid_size:enum?64|128|256|512|1024"
+        ;
     info->out_param_spec = "mesh:mesh";
     info->component_class = "mesh";
   }
@@ -110,152 +283,68 @@ public:
     mesh_a = new vsx_mesh;
     mesh_b = new vsx_mesh;
     mesh = mesh_a;
-    thread_state = 0;
-    thread_exit = 0;
-    worker_running = false;
     
     loading_done = false;
     time_speed = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"time_speed");
     time_speed->set(0.2f);
+    grid_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"grid_size");
     result = (vsx_module_param_mesh*)out_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh");
-    //first_run = true;
     ocean.calculate_ho();
     t = 0;
   }
 
   static void* worker(void *ptr)
   {
+    vsx_module_mesh_ocean_tunnel_threaded* my = ((vsx_module_mesh_ocean_tunnel_threaded*)ptr);
     while (1)
     {
-      vsx_module_mesh_ocean_tunnel_threaded* my = ((vsx_module_mesh_ocean_tunnel_threaded*)ptr);
-      if (0 == sem_trywait(&my->sem_worker_todo))
-      {
-        pthread_mutex_lock(&my->mesh_mutex);
-        my->t += my->time_speed->get()*my->engine->real_dtime;
-        my->ocean.dtime = my->t;
-        my->ocean.display();
-        my->mesh->data->vertices.reset_used(0);
-        my->mesh->data->vertex_normals.reset_used(0);
-        my->mesh->data->vertex_tex_coords.reset_used(0);
-        my->mesh->data->faces.reset_used(0);
-        vsx_face face;
-        vsx_vector g;
-        vsx_vector c;
-        for (int L=-1;L<2;L++)
-        {
-          for (int i=0;i<(BIG_NX-1);i++)
-          {
-            unsigned long b = 0;
-            for (int k=-1;k<2;k++)
-            {
-              unsigned long a = 0;
-              for (int j=0;j<(BIG_NY);j++)
-              {
-                //printf("j: %d\n", j);
-                if (j%2 == 1) continue;
-    #define TDIV (float)MAX_WORLD_X
-    #define TD2  (float)MAX_WORLD_X*0.5f
-                g.x = my->ocean.sea[i][j][0];//+L*MAX_WORLD_X;
-                g.y = my->ocean.sea[i][j][1];//+k*MAX_WORLD_Y;
-                g.z = my->ocean.sea[i][j][2];//*ocean.scale_height;
-
-                float gr = \
-                PI*2.0f * g.x/(TDIV);
-                float nra = gr + 90.0f / 360.0f * 2*PI;
-
-
-                vsx_vector nn;
-                nn.x = my->ocean.big_normals[i][j][0];
-                nn.y = my->ocean.big_normals[i][j][1];
-                nn.normalize();
-                my->mesh->data->vertex_normals.push_back(vsx_vector(\
-                  nn.x* cos(nra) + nn.y * -sin(nra),\
-                  nn.x* sin(nra) + nn.y * cos(nra),\
-                  my->ocean.big_normals[i][j][2]));
-                my->mesh->data->vertex_normals[my->mesh->data->vertex_normals.size()-1].normalize();
-
-
-                float gz = 2.0f+fabs(g.z)*1.5f;
-                c.x = cos(gr)*gz;
-                c.y = sin(gr)*gz;
-                c.z = g.y*2.0f;
-                b = my->mesh->data->vertices.push_back(c);
-                my->mesh->data->vertex_tex_coords.push_back(vsx_tex_coord__(fabs(g.x-TD2)*2.0f , fabs(g.y-TD2)*2.0f));
-                ++a;
-                if (a >= 3) {
-                  face.a = b-3;
-                  face.b = b-2;
-                  face.c = b-1;
-                  my->mesh->data->faces.push_back(face);
-                }
-                g.x = my->ocean.sea[i+1][j][0];//+L*MAX_WORLD_X;
-                g.y = my->ocean.sea[i+1][j][1];//+k*MAX_WORLD_Y;
-                g.z = my->ocean.sea[i+1][j][2];//*ocean.scale_height;
-
-                gr = \
-                PI*2.0f* g.x/(TDIV);
-                nra = gr + 90.0f / 360.0f * 2*PI;
-
-
-                nn.x = my->ocean.big_normals[i+1][j][0];
-                nn.y = my->ocean.big_normals[i+1][j][1];
-                nn.normalize();
-                my->mesh->data->vertex_normals.push_back(vsx_vector(\
-                  nn.x* cos(nra) + nn.y * -sin(nra),\
-                  nn.x* sin(nra) + nn.y * cos(nra),\
-                  my->ocean.big_normals[i+1][j][2]));
-
-                my->mesh->data->vertex_normals[my->mesh->data->vertex_normals.size()-1].normalize();
-
-                gz = 2.0f+fabs(g.z)*1.5f;
-                c.x = cos(gr)*gz;
-                c.y = sin(gr)*gz;
-                c.z = g.y*2.0f;
-                b = my->mesh->data->vertices.push_back(c);
-
-                my->mesh->data->vertex_tex_coords.push_back(vsx_tex_coord__(fabs(g.x-TD2)*2.0f , fabs(g.y-TD2)*2.0f));
-
-                ++a;
-
-                if (a >= 4) {
-                  face.a = b-3;
-                  face.b = b-2;
-                  face.c = b-1;
-                  my->mesh->data->faces.push_back(face);
-                }
-              }
-            }
-          }
-        }
-        my->thread_has_something_to_deliver++;
-        pthread_mutex_unlock(&my->mesh_mutex);
-      } // sem_trywait
-      pthread_mutex_lock(&my->thread_exit_mutex);
+      sem_wait(&my->sem_worker_todo);
+      pthread_mutex_lock(&my->mesh_mutex);
+      ocean_job job = my->job;
       int time_to_exit = my->thread_exit;
-      pthread_mutex_unlock(&my->thread_exit_mutex);
-      if (time_to_exit) {
-        int *retval = new int;
-        *retval = 0;
-        my->thread_exit = 0;
-        pthread_exit((void*)retval);
-        return 0;
-      }
+      pthread_mutex_unlock(&my->mesh_mutex);
+      if (time_to_exit)
+        break;
+
+      ocean_apply_job(my->ocean, job);
+      my->ocean.display();
+      ocean_generate_tunnel(my->ocean, my->mesh);
+
+      pthread_mutex_lock(&my->mesh_mutex);
+      my->thread_has_something_to_deliver = 1;
+      pthread_mutex_unlock(&my->mesh_mutex);
     }
+    return 0;
+  }
+
+  // called with the mesh mutex held (or before the worker exists)
+  void post_job()
+  {
+    job.dtime = t;
+    job.grid_size = MIN_GRID_SIZE << grid_size->get();
+    job.normals_only = 0;
+    job.spectrum_changed = false;
+    job.factor = ocean.factor;
+    job.wind = ocean.wind;
+    job.wind_x = ocean.wind_global[0];
+    job.wind_y = ocean.wind_global[1];
+    sem_post(&sem_worker_todo);
   }
 
   void run() {
     loading_done = true;
+    t += time_speed->get()*engine->real_dtime;
     if (!thread_created)
     {
+      post_job();
       pthread_create(&worker_t, NULL, &worker, (void*)this);
       thread_created = true;
-      sem_post(&sem_worker_todo);
       return;
     }
-    // this concept assumes that the run takes shorter than the framerate to do
-    if (0 == pthread_mutex_lock(&mesh_mutex) )
+    // the worker only holds the lock for a moment, if we miss it the
+    // previous mesh stays on the output for another frame
+    if (0 == pthread_mutex_trylock(&mesh_mutex) )
     {
-      // lock ackquired. thread is waiting for us to set the semaphore before doing anything again.
       if (thread_has_something_to_deliver)
       {
         mesh->timestamp++;
@@ -264,7 +353,8 @@ public:
         // toggle to the other mesh
         if (mesh == mesh_a) mesh = mesh_b;
         else mesh = mesh_a;
-        sem_post(&sem_worker_todo);
+        thread_has_something_to_deliver = 0;
+        post_job();
       }
       pthread_mutex_unlock(&mesh_mutex);
     }
@@ -287,37 +377,36 @@ public:
   vsx_module_param_float* wind_speed_y;
   vsx_module_param_float* time_speed;
   vsx_module_param_int* normals_only;
+  vsx_module_param_int* grid_size;
   // out
   vsx_module_param_mesh* result;
   // internal
-  vsx_mesh* mesh;
+  vsx_mesh* mesh; // the one the worker fills, the other one is on the output
   vsx_mesh* mesh_a;
   vsx_mesh* mesh_b;
 
-  //bool first_run;
   Alaska ocean;
+  bool spectrum_changed;
 
   // threading stuff
   pthread_t         worker_t;
 
+  // only held for flag updates, never while the ocean is computed
   pthread_mutex_t   mesh_mutex;
   int               thread_has_something_to_deliver; // locked by the mesh mutex
-  pthread_mutex_t   thread_exit_mutex;
+  int               thread_exit; // locked by the mesh mutex
+  ocean_job         job; // locked by the mesh mutex
   sem_t sem_worker_todo; // indicates wether the worker should do anything.
   bool              thread_created;
 
-  int p_updates;
-  bool              worker_running;
-  int               thread_state;
-  int               thread_exit;
-
   vsx_module_mesh_ocean_threaded()
   {
     pthread_mutex_init(&mesh_mutex,NULL);
-    pthread_mutex_init(&thread_exit_mutex,NULL);
     sem_init(&sem_worker_todo,0,0);
     thread_has_something_to_deliver = 0;
+    thread_exit = 0;
     thread_created = false;
+    spectrum_changed = false;
     mesh_a = 0;
     mesh_b = 0;
   }
@@ -326,9 +415,10 @@ public:
   {
     if (thread_created)
     {
-      pthread_mutex_lock(&thread_exit_mutex);
+      pthread_mutex_lock(&mesh_mutex);
         thread_exit = 1;
-      pthread_mutex_unlock(&thread_exit_mutex);
+      pthread_mutex_unlock(&mesh_mutex);
+      sem_post(&sem_worker_todo);
       void* ret;
       int jret = pthread_join(worker_t, &ret);
       if (jret == 22) printf("ocean_threaded: pthread_join failed: EINVAL\n");
@@ -339,7 +429,6 @@ public:
       delete mesh_a;
       delete mesh_b;
     }
-    pthread_mutex_destroy(&thread_exit_mutex);
     pthread_mutex_destroy(&mesh_mutex);
     sem_destroy(&sem_worker_todo);
   }
@@ -358,7 +447,8 @@ public:
         "wind_speed_x:float,"
         "wind_speed_y:float,"
         "wind_speed:float,"
-        "normals_only:enum?no|yes"
+        "normals_only:enum?no|yes,"
+        "grid_size:enum?64|128|256|512|1024"
         ;
     info->out_param_spec = "mesh:mesh";
     info->component_class = "mesh";
@@ -369,9 +459,6 @@ public:
     mesh_a = new vsx_mesh;
     mesh_b = new vsx_mesh;
     mesh = mesh_a;
-    thread_state = 0;
-    thread_exit = 0;
-    worker_running = false;
 
     loading_done = false;
     time_speed = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"time_speed");
@@ -386,110 +473,78 @@ public:
     wind_speed_y = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"wind_speed_y");
     wind_speed_y->set(30.0);
     normals_only = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"normals_only");
+    grid_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"grid_size");
     result = (vsx_module_param_mesh*)out_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh");
     ocean.calculate_ho();
   }
 
   static void* worker(void *ptr)
   {
+    vsx_module_mesh_ocean_threaded* my = ((vsx_module_mesh_ocean_threaded*)ptr);
     while (1)
     {
-      vsx_module_mesh_ocean_threaded* my = ((vsx_module_mesh_ocean_threaded*)ptr);
-      if (0 == sem_trywait(&my->sem_worker_todo))
-      {
-        pthread_mutex_lock(&my->mesh_mutex);
-
-        if (my->param_updates)
-        {
-          my->ocean.factor = my->wave_speed->get() * 10.0;
-          my->ocean.wind = my->wind_speed->get() * 0.1;
-          my->ocean.wind_global[0] = my->wind_speed_x->get();
-          my->ocean.wind_global[1] = my->wind_speed_y->get();
-          my->ocean.calculate_ho();
-          my->param_updates = 0;
-        }
-
-        my->ocean.dtime = my->engine->real_vtime*my->time_speed->get() * 0.1f;
-        my->ocean.normals_only = my->normals_only->get();
-
-        my->ocean.display();
-        my->mesh->data->vertices.reset_used(0);
-        my->mesh->data->vertex_normals.reset_used(0);
-        my->mesh->data->vertex_tex_coords.reset_used(0);
-        my->mesh->data->faces.reset_used(0);
-        vsx_face face;
-        for (int L=-1;L<2;L++)
-        {
-          for (int i=0;i<(BIG_NX-1);i++)
-          {
-            unsigned long b = 0;
-            for (int k=-1;k<2;k++)
-            {
-              unsigned long a = 0;
-              for (int j=0;j<(BIG_NY);j++)
-              {
-                my->mesh->data->vertex_normals.push_back(vsx_vector(my->ocean.big_normals[i][j][0],my->ocean.big_normals[i][j][1],my->ocean.big_normals[i][j][2]));
-                b = my->mesh->data->vertices.push_back(vsx_vector(my->ocean.sea[i][j][0]+L*MAX_WORLD_X,my->ocean.sea[i][j][1]+k*MAX_WORLD_Y,my->ocean.sea[i][j][2]*my->ocean.scale_height));
-                ++a;
-                if (a >= 3) {
-                  face.a = b-3;
-                  face.b = b-2;
-                  face.c = b-1;
-                  my->mesh->data->faces.push_back(face);
-                }
-
-                my->mesh->data->vertex_normals.push_back(vsx_vector(my->ocean.big_normals[i+1][j][0],my->ocean.big_normals[i+1][j][1],my->ocean.big_normals[i+1][j][2]));
-                b = my->mesh->data->vertices.push_back(vsx_vector(my->ocean.sea[i+1][j][0]+L*MAX_WORLD_X,my->ocean.sea[i+1][j][1]+k*MAX_WORLD_Y,my->ocean.sea[i+1][j][2]*my->ocean.scale_height));
-                ++a;
-                if (a >= 4) {
-                  face.a = b-3;
-                  face.b = b-2;
-                  face.c = b-1;
-                  my->mesh->data->faces.push_back(face);
-                }
-              }
-            }
-          }
-        }
-        my->thread_has_something_to_deliver++;
-        pthread_mutex_unlock(&my->mesh_mutex);
-      } // sem_trywait
-      pthread_mutex_lock(&my->thread_exit_mutex);
+      sem_wait(&my->sem_worker_todo);
+      pthread_mutex_lock(&my->mesh_mutex);
+      ocean_job job = my->job;
       int time_to_exit = my->thread_exit;
-      pthread_mutex_unlock(&my->thread_exit_mutex);
-      if (time_to_exit) {
-        int *retval = new int;
-        *retval = 0;
-        my->thread_exit = 0;
-        pthread_exit((void*)retval);
-        return 0;
-      }
+      pthread_mutex_unlock(&my->mesh_mutex);
+      if (time_to_exit)
+        break;
+
+      ocean_apply_job(my->ocean, job);
+      my->ocean.display();
+      ocean_generate_sea(my->ocean, my->mesh);
+
+      pthread_mutex_lock(&my->mesh_mutex);
+      my->thread_has_something_to_deliver = 1;
+      pthread_mutex_unlock(&my->mesh_mutex);
     }
+    return 0;
+  }
+
+  // called with the mesh mutex held (or before the worker exists)
+  void post_job()
+  {
+    job.dtime = engine->real_vtime*time_speed->get() * 0.1f;
+    job.grid_size = MIN_GRID_SIZE << grid_size->get();
+    job.normals_only = normals_only->get();
+    job.spectrum_changed = spectrum_changed;
+    job.factor = wave_speed->get() * 10.0;
+    job.wind = wind_speed->get() * 0.1;
+    job.wind_x = wind_speed_x->get();
+    job.wind_y = wind_speed_y->get();
+    spectrum_changed = false;
+    sem_post(&sem_worker_todo);
   }
 
   void run() {
     loading_done = true;
+    if (param_updates)
+    {
+      spectrum_changed = true;
+      param_updates = 0;
+    }
     if (!thread_created)
     {
+      post_job();
       pthread_create(&worker_t, NULL, &worker, (void*)this);
       thread_created = true;
-      sem_post(&sem_worker_todo);
       return;
     }
-    // this concept assumes that the run takes shorter than the framerate to do
-    if (0 == pthread_mutex_lock(&mesh_mutex) )
+    // the worker only holds the lock for a moment, if we miss it the
+    // previous mesh stays on the output for another frame
+    if (0 == pthread_mutex_trylock(&mesh_mutex) )
     {
-      // lock ackquired. thread is waiting for us to set the semaphore before doing anything again.
       if (thread_has_something_to_deliver)
       {
-
         mesh->timestamp++;
         result->set(mesh);
 
         // toggle to the other mesh
         if (mesh == mesh_a) mesh = mesh_b;
         else mesh = mesh_a;
-        sem_post(&sem_worker_todo);
+        thread_has_something_to_deliver = 0;
+        post_job();
       }
       pthread_mutex_unlock(&mesh_mutex);
     }
@@ -513,6 +568,7 @@ class vsx_module_mesh_ocean : public vsx_module {
   vsx_module_param_float* wind_speed_y;
   vsx_module_param_float* time_speed;
   vsx_module_param_int* normals_only;
+  vsx_module_param_int* grid_size;
   // out
 	vsx_module_param_mesh* result;
 	// internal
@@ -541,7 +597,8 @@ public:
         "wind_speed_x:float,"
         "wind_speed_y:float,"
         "wind_speed:float,"
-        "normals_only:enum?no|yes"
+        "normals_only:enum?no|yes,"
+        "grid_size:enum?64|128|256|512|1024"
         ;
     info->out_param_spec = "mesh:mesh";
     info->component_class = "mesh";
@@ -562,6 +619,7 @@ public:
     wind_speed_y = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"wind_speed_y");
     wind_speed_y->set(30.0);
     normals_only = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"normals_only");
+    grid_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"grid_size");
     result = (vsx_module_param_mesh*)out_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh");
     ocean.calculate_ho();
   }
@@ -574,48 +632,12 @@ public:
       ocean.wind = wind_speed->get() * 0.1;
       ocean.wind_global[0] = wind_speed_x->get();
       ocean.wind_global[1] = wind_speed_y->get();
+      ocean.set_size(MIN_GRID_SIZE << grid_size->get());
       ocean.calculate_ho();
       param_updates = 0;
     }
     ocean.display();
-    mesh->data->vertices.reset_used(0);
-    mesh->data->vertex_normals.reset_used(0);
-    mesh->data->vertex_tex_coords.reset_used(0);
-    mesh->data->faces.reset_used(0);
-    vsx_face face;
-    for (int L=-1;L<2;L++)
-    {
-      for (int i=0;i<(BIG_NX-1);i++)
-      {
-        unsigned long b = 0;
-        for (int k=-1;k<2;k++)
-        {
-          unsigned long a = 0;
-          for (int j=0;j<(BIG_NY);j++)
-          {
-            mesh->data->vertex_normals.push_back(vsx_vector(ocean.big_normals[i][j][0],ocean.big_normals[i][j][1],ocean.big_normals[i][j][2]));
-            b = mesh->data->vertices.push_back(vsx_vector(ocean.sea[i][j][0]+L*MAX_WORLD_X,ocean.sea[i][j][1]+k*MAX_WORLD_Y,ocean.sea[i][j][2]*ocean.scale_height));
-            ++a;
-            if (a >= 3) {
-              face.a = b-3;
-              face.b = b-2;
-              face.c = b-1;
-              mesh->data->faces.push_back(face);
-            }
-
-            mesh->data->vertex_normals.push_back(vsx_vector(ocean.big_normals[i+1][j][0],ocean.big_normals[i+1][j][1],ocean.big_normals[i+1][j][2]));
-            b = mesh->data->vertices.push_back(vsx_vector(ocean.sea[i+1][j][0]+L*MAX_WORLD_X,ocean.sea[i+1][j][1]+k*MAX_WORLD_Y,ocean.sea[i+1][j][2]*ocean.scale_height));
-            ++a;
-            if (a >= 4) {
-              face.a = b-3;
-              face.b = b-2;
-              face.c = b-1;
-              mesh->data->faces.push_back(face);
-            }
-          }
-        }
-      }
-    }
+    ocean_generate_sea(ocean, mesh);
     mesh->timestamp++;
     
     loading_done = true;
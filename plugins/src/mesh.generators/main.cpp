@@ -28,6 +28,7 @@
 #include "vsx_math_3d.h"
 #include "vsx_sequence.h"
 #include "vsx_bspline.h"
+#include "vsx_mesh_attributes.h"
 
 class vsx_module_mesh_rand_points : public vsx_module {
   // in
@@ -656,6 +657,7 @@ class vsx_module_mesh_supershape : public vsx_module {
 	bool first_run;
 	int n_segs;
 	int l_param_updates;
+	vsx_mesh_attributes attributes;
 public:
 
   void module_info(vsx_module_info* info)
@@ -683,6 +685,7 @@ public:
   void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
   {
     l_param_updates = -1;
+    n_segs = -1;
     loading_done = true;
 
     x_num_segments = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"x_num_segments");
@@ -730,7 +733,6 @@ public:
       l_param_updates = param_updates;
       //printf("generating supershape mesh\n");
       mesh->data->vertices.reset_used();
-      mesh->data->faces.reset_used();
 			int vi = 0; // vertex index
 
 			// sanity checks
@@ -787,81 +789,22 @@ public:
 
 
       float x1=0,y1=0,z1=0;
-      float x2=0,y2=0,z2=0;
-      float x3=0,y3=0,z3=0;
-//      float x4=0,y4=0,z4=0;
 
       float phi = _y_start;
 
-      vsx_avector<vsx_vector> prev_row_normals;
-      vsx_avector<vsx_vector*> prev_row_threes;
-      vsx_vector prev_norm;
+      // the faces only depend on the number of segments
+      bool rebuild_faces = n_segs != _x_num_segments;
+      if (rebuild_faces)
+        mesh->data->faces.reset_used();
 
       for (int i = 0; i < _x_num_segments+1; i++) {
         float theta = (float)_x_start;
-
-        /*double r1 = pow(
-                    pow(
-                      fabs((1.0f / _x_a) * cos(_x_m * theta / 4.0f))
-                      , _x_n2)
-                    +
-                    pow(
-                      fabs((1.0f / _x_b) * sin(_x_m * theta / 4.0f))
-                      , _x_n3)
-                  , -1.0f/_x_n1);*/
         for(int j = 0; j < _y_num_segments+1; j++) {
-          //eval3D(double a, double b, float m,float n1,float n2,float n3,float phi,float theta,float &x,float &y,float &z)
-
 	        eval3D(_x_a, _x_b, _x_m,_x_n1,_x_n2,_x_n3,phi       ,theta         ,x1,y1,z1);
-	        eval3D(_x_a, _x_b, _x_m,_x_n1,_x_n2,_x_n3,phi       ,theta+theta_step,x2,y2,z2);
-	        eval3D(_x_a, _x_b,_x_m,_x_n1,_x_n2,_x_n3,phi+phi_step,theta+theta_step,x3,y3,z3);
-	        //eval3D(_x_m,_x_n1,_x_n2,_x_n3,phi+phi_step,theta         ,x4,y4,z4);
-	        // Calc normal ->
-	        // create vectors
-	        float v1x=x1-x2; float v2x=x2-x3;
-	        float v1y=y1-y2; float v2y=y2-y3;
-	        float v1z=z1-z2; float v2z=z2-z3;
-	          // Get cross product of vectors
-	        float nx = (v1y * v2z) - (v1z * v2y);
-	        float ny = (v1z * v2x) - (v1x * v2z);
-	        float nz = (v1x * v2y) - (v1y * v2x);
-	        // Normalise final vector
-	        float vLen = (float)sqrt( (nx * nx) + (ny * ny) + (nz * nz) );
-	        vsx_vector norm(-nx/vLen,  -ny/vLen,  -nz/vLen);
-	        mesh->data->vertex_normals[vi] = norm;
 	        mesh->data->vertices[vi] = vsx_vector(x1*scale, y1*scale, z1*scale);
 	        vi++;
-          //mesh->data->vertex_normals[vi] = norm;
-          //mesh->data->vertices[vi] = vsx_vector(x4*scale, y4*scale, z4*scale);
-
-          //vi++;
-          /*mesh->data->vertex_normals[vi] = norm;
-          mesh->data->vertices[vi] = vsx_vector(x3*scale, y3*scale, z3*scale);
-          vi++;
-          mesh->data->vertex_normals[vi] = norm;
-          mesh->data->vertices[vi] = vsx_vector(x4*scale, y4*scale, z4*scale);
-          vi++;*/
-          //Gl.glNormal3f(nx/vLen,  ny/vLen,  nz/vLen);
-          //Gl.glVertex3f(x1*scale, y1*scale, z1*scale);
-          //Gl.glVertex3f(x2*scale, y2*scale, z2*scale);
-          //Gl.glVertex3f(x3*scale, y3*scale, z3*scale);
-          //Gl.glVertex3f(x4*scale, y4*scale, z4*scale);
-          //theta+=addTheta;
-
-          // per-vertex normals (try)
-          if (i > 0 && j > 0)
-          {
-            vsx_vector sum_norm = norm + prev_norm + prev_row_normals[j] + prev_row_normals[j-1];
-            sum_norm.normalize();
-            mesh->data->vertex_normals[vi-2] = sum_norm;
-            mesh->data->vertex_normals[vi-3] = sum_norm;
-            //printf("i: %d j: %d\n", i,j);
-            //mesh->data->vertex_normals[vi-_x_num_segments-2] = sum_norm;
-            //(*prev_row_threes[j]) = sum_norm;
-          }
-          prev_norm = norm;
 
-          if (i > 0 && j > 0)
+          if (rebuild_faces && i > 0 && j > 0)
           {
             vsx_face a;
             a.a = vi - 1; // (0)
@@ -872,41 +815,9 @@ public:
             a.b = vi-1;
             a.c = vi - _x_num_segments-2;
             mesh->data->faces.push_back(a);
-
-  	        //a.a = vi-2; // 3
-  	        //a.b = vi-3; // 2
-  	        //a.c = vi-4; // 1
-  	        //mesh->data->faces.push_back(a);
-//            a.a = vi-2; // 3
-            //a.b = vi-4; // 1
-            //a.c = vi-1; // 4
-            //mesh->data->faces.push_back(a);
           }
           theta += theta_step;
-
-          prev_row_normals[j] = norm;
-          //prev_row_threes[j] = &mesh->data->vertex_normals[vi-2];
-					/*double r2 = pow(
-											pow(
-												fabs((1.0f / _y_a) * cos(_y_m * phi / 4.0f))
-												, _y_n2)
-											+
-											pow(
-											  fabs((1.0f / _y_b) * sin(_y_m * phi / 4.0f))
-											  , _y_n3)
-										, -1.0f/_y_n1);
-
-			    vsx_vector tmp_vec;//(sin(angle) * rad, y, cos(angle) * rad);
-			    tmp_vec.x = r1 * cos(phi) * r2 * cos(theta);
-			    tmp_vec.y = r1 * sin(phi) * r2 * cos(theta);
-			    tmp_vec.z = r2 * sin(theta);
-			    //printf("%f %f %f\n", tmp_vec.x, tmp_vec.y, tmp_vec.z);
-			    mesh->data->vertices[vi] = tmp_vec;
-			    mesh->data->vertex_normals[vi] = tmp_vec;
-			    mesh->data->vertex_colors[vi] = vsx_color(1, 1, 1, 1);
-			    phi += phi_step;
-			    vi++;*/
-				}
+        }
 				phi += phi_step;
 			}
 
@@ -949,6 +860,14 @@ public:
 					mesh->data->faces.push_back(a);
 				}
 	  	}*/
+      if (rebuild_faces)
+      {
+        n_segs = _x_num_segments;
+        mesh->data->touch(VSX_MESH_FACES);
+      }
+      mesh->data->touch(VSX_MESH_VERTICES);
+      attributes.calculate_vertex_normals(mesh->data);
+
 			first_run = false;
 			mesh->timestamp++;
 	    result->set_p(mesh);
@@ -1410,6 +1329,7 @@ public:
 		}
 
   	//printf("%d\n", vi);
+    mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 		mesh->timestamp++;
     result->set_p(mesh);
   }
@@ -1874,9 +1794,14 @@ public:
     int new_num_stacks = (int)num_stacks->get();
     int new_num_sectors = (int)num_sectors->get();
 
-//    if (current_num_stacks == new_num_stacks && current_num_sectors == new_num_sectors) return;
+    // the faces only depend on the number of stacks and sectors
+    bool rebuild_faces = current_num_stacks != new_num_stacks || current_num_sectors != new_num_sectors;
 
-    mesh->data->reset();
+    mesh->data->vertices.reset_used();
+    mesh->data->vertex_normals.reset_used();
+    mesh->data->vertex_colors.reset_used();
+    if (rebuild_faces)
+      mesh->data->faces.reset_used();
     calc_shapes();
 
     current_num_sectors = new_num_sectors;
@@ -1895,7 +1820,6 @@ public:
     float P = p->get();
     float phiofs = phi_offset->get();
 
-    mesh->data->faces.reset_used();
     float one_div_num_stacks = 1.0f / (float)(current_num_stacks);
 
     //int num_vertices = current_num_stacks * (current_num_sectors-1);
@@ -1949,8 +1873,10 @@ public:
 
         //newpoint = point.x * N + point.y * B;
 
-        float px = cos(j1 * TWO_PI) * size_shape_x[index8192] * size_shape_x_multiplier_f;
-        float py = sin(j1 * TWO_PI) * size_shape_y[index8192] * size_shape_y_multiplier_f;
+        float sx = size_shape_x[index8192] * size_shape_x_multiplier_f;
+        float sy = size_shape_y[index8192] * size_shape_y_multiplier_f;
+        float px = cos(j1 * TWO_PI) * sx;
+        float py = sin(j1 * TWO_PI) * sy;
 
         vsx_vector tmp_vec(
             circle_base_pos.x,
@@ -1961,11 +1887,12 @@ public:
         tmp_vec += N * px + B * py;
 
         mesh->data->vertices[vi] = tmp_vec;
-        mesh->data->vertex_normals[vi] = tmp_vec - circle_base_pos;
+        // normal of the (elliptic) cross section, radial when sx == sy
+        mesh->data->vertex_normals[vi] = N * (float)(cos(j1 * TWO_PI) * sy) + B * (float)(sin(j1 * TWO_PI) * sx);
         mesh->data->vertex_normals[vi].normalize();
         mesh->data->vertex_colors[vi] = vsx_color(1, 1, 1, 1);
 
-        if (i && j)
+        if (rebuild_faces && i && j)
         {
           vsx_face a;
           // c                      current row
@@ -1993,7 +1920,7 @@ public:
         }
         vi++;
       }
-      if (i > 1 && i < current_num_stacks-1)
+      if (rebuild_faces && i > 1 && i < current_num_stacks-1)
       {
         //vi--;
         vsx_face a;
@@ -2056,7 +1983,7 @@ public:
     //if (rand()%4 == 2)
     for(int j = 0; j < current_num_sectors-1; j++)
     {
-      if (j)
+      if (rebuild_faces && j)
       {
         vsx_face a;
         // c                      current row
@@ -2076,12 +2003,14 @@ public:
       }
       vi++;
     }
+    if (rebuild_faces)
     {
       vsx_face a;
       a.c = vi - current_num_sectors ;
       a.b = vi - current_num_sectors - 1;
       a.a = current_num_sectors - 1;
       mesh->data->faces.push_back(a);
+      mesh->data->touch(VSX_MESH_FACES);
     }
     /*{
       vsx_face a;
@@ -2096,6 +2025,7 @@ public:
 
     // id=4818, 0, 8
 
+    mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_COLORS);
 
     //printf("%d\n", vi);
     mesh->timestamp++;
@@ -3140,6 +3070,7 @@ class vsx_module_mesh_sphere_icosahedron : public vsx_module
   int l_param_updates;
   int current_subdivision_level;
   int current_max_normalization_level;
+  vsx_mesh_attributes attributes;
 
 public:
   void module_info(vsx_module_info* info)
@@ -3353,12 +3284,6 @@ public:
       if (index_a == -1)
       {
         mesh->data->vertices.push_back(old->poly[i].pt[0]);
-
-        vsx_vector n(0,0,0);
-//        n = old->poly[i].pt[0];
-//        n.normalize();
-        mesh->data->vertex_normals.push_back(n);
-
         index_a = vertex_index;
         vertex_index++;
       }
@@ -3378,12 +3303,6 @@ public:
       if (index_b == -1)
       {
         mesh->data->vertices.push_back(old->poly[i].pt[1]);
-
-        vsx_vector n(0,0,0);
-//        n = old->poly[i].pt[1];
-//        n.normalize();
-        mesh->data->vertex_normals.push_back(n);
-
         index_b = vertex_index;
         vertex_index++;
       }
@@ -3403,12 +3322,6 @@ public:
       if (index_c == -1)
       {
         mesh->data->vertices.push_back(old->poly[i].pt[2]);
-
-        vsx_vector n(0,0,0);
-//        n = old->poly[i].pt[2];
-//        n.normalize();
-        mesh->data->vertex_normals.push_back(n);
-
         index_c = vertex_index;
         vertex_index++;
       }
@@ -3428,31 +3341,14 @@ public:
       face.b = index_a;
       face.c = index_c;
 
-      vsx_vector an;
-      an.assign_face_normal
-      (
-            &mesh->data->vertices[index_b],
-            &mesh->data->vertices[index_a],
-            &mesh->data->vertices[index_c]
-      );
-      //an.normalize();
-      mesh->data->vertex_normals[index_a] += an;
-      mesh->data->vertex_normals[index_b] += an;
-      mesh->data->vertex_normals[index_c] += an;
-
-
-
 //      face.a = i*3+1;
 //      face.b = i*3;
 //      face.c = i*3+2;
       mesh->data->faces.push_back(face);
     }
 
-    // normalize all normals
-    for (size_t i = 0; i < mesh->data->vertex_normals.size(); i++)
-    {
-      mesh->data->vertex_normals[i].normalize();
-    }
+    mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_FACES);
+    attributes.calculate_vertex_normals(mesh->data);
 
     if (maxlevel > 1)
     free(old);
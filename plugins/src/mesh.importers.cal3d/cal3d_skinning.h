@@ -0,0 +1,396 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef CAL3D_SKINNING_H
+#define CAL3D_SKINNING_H
+
+#include <math.h>
+#include <string.h>
+#include "cal3d.h"
+#include "vsx_array.h"
+#include "vsx_mesh.h"
+#include "vsx_vector_batch.h"
+#include "vsx_thread_pool.h"
+#if defined(VSX_MATH_3D_SSE)
+#include <xmmintrin.h>
+#endif
+
+// CPU skinning of a whole CalModel into one vsx_mesh.
+//
+// Does what CalPhysique::calculateVertices / calculateNormals do, without
+// going through the renderer one submesh at a time:
+//
+// * prepare() flattens the vertices, normals and bone influences of all
+//   submeshes into flat arrays, once per model.
+// * update() builds a palette of 3x4 bone matrices once per frame, with the
+//   module transform (pre rotation, rotation, translation) folded in, so each
+//   vertex is transformed exactly once. The vertex range is split over the
+//   thread pool; per vertex the weighted matrix rows are blended with SSE.
+//
+// All submeshes end up after each other in the output, faces offset to
+// match. Submeshes with morph targets or springs aren't handled here, those
+// still go through CalRenderer and get the module transform afterwards.
+
+#define CAL3D_SKINNING_MIN_CHUNK 512
+
+class cal3d_skinning
+{
+  struct part
+  {
+    int mesh_id;
+    int submesh_id;
+    CalSubmesh* submesh;
+    size_t vertex_offset;
+    size_t vertex_count;
+    size_t face_offset;
+    size_t face_count;
+    bool fast;
+  };
+  vsx_array<part> parts;
+  size_t vertex_count;
+  size_t face_count;
+  size_t bone_count;
+
+  // bind pose, by output vertex id
+  vsx_array<vsx_vector> positions;
+  vsx_array<vsx_vector> normals;
+
+  // influences of vertex i are [influence_offsets[i], influence_offsets[i+1])
+  vsx_array<unsigned int> influence_offsets;
+  vsx_array<unsigned int> influence_bones;
+  vsx_array<float> influence_weights;
+
+  // 3 rows of 4 floats (rotation | translation) per bone, plus one entry
+  // without translation for vertices no bone affects
+  vsx_array<float> palette;
+  float global_translation[3];
+
+  // for the parallel pass, ranges are relative to range_offset
+  vsx_vector* dest_vertices;
+  vsx_vector* dest_normals;
+  size_t range_offset;
+
+  // d = a * b, both 3x4 affine, row major
+  static void compose(const float* a, const float* b, float* d)
+  {
+    for (int r = 0; r < 3; r++)
+    {
+      const float* ar = a + r * 4;
+      for (int c = 0; c < 4; c++)
+        d[r * 4 + c] = ar[0] * b[c] + ar[1] * b[4 + c] + ar[2] * b[8 + c];
+      d[r * 4 + 3] += ar[3];
+    }
+  }
+
+  static inline void normalize(float* n)
+  {
+    float l = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+    if (l > 0.0f)
+    {
+      l = 1.0f / (float)sqrt(l);
+      n[0] *= l;
+      n[1] *= l;
+      n[2] *= l;
+    }
+  }
+
+#if defined(VSX_MATH_3D_SSE)
+  // x, y, z of the 3 rows times v in the low lanes
+  static inline __m128 rows_transform(__m128 r0, __m128 r1, __m128 r2, __m128 v)
+  {
+    __m128 a = _mm_mul_ps(r0, v);
+    __m128 b = _mm_mul_ps(r1, v);
+    __m128 c = _mm_mul_ps(r2, v);
+    __m128 d = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    return _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+  }
+#endif
+
+  static void skin_range(void* arg, size_t begin, size_t end)
+  {
+    cal3d_skinning* s = (cal3d_skinning*)arg;
+    const unsigned int* offsets = s->influence_offsets.get_pointer();
+    const unsigned int* ids = s->influence_bones.get_pointer();
+    const float* weights = s->influence_weights.get_pointer();
+    const float* pal = s->palette.get_pointer();
+    const vsx_vector* pos = s->positions.get_pointer();
+    const vsx_vector* nrm = s->normals.get_pointer();
+    const float* gt = s->global_translation;
+    float v[4];
+    float n[4];
+    begin += s->range_offset;
+    end += s->range_offset;
+#if defined(VSX_MATH_3D_SSE)
+    __m128 t = _mm_setr_ps(gt[0], gt[1], gt[2], 0.0f);
+#endif
+    for (size_t i = begin; i < end; i++)
+    {
+      unsigned int k = offsets[i];
+      unsigned int k_end = offsets[i + 1];
+#if defined(VSX_MATH_3D_SSE)
+      __m128 r0 = _mm_setzero_ps();
+      __m128 r1 = _mm_setzero_ps();
+      __m128 r2 = _mm_setzero_ps();
+      for (; k < k_end; k++)
+      {
+        __m128 w = _mm_set1_ps(weights[k]);
+        const float* m = pal + ids[k] * 12;
+        r0 = _mm_add_ps(r0, _mm_mul_ps(w, _mm_loadu_ps(m)));
+        r1 = _mm_add_ps(r1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+        r2 = _mm_add_ps(r2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+      }
+      _mm_storeu_ps(v, _mm_add_ps(rows_transform(r0, r1, r2, _mm_setr_ps(pos[i].x, pos[i].y, pos[i].z, 1.0f)), t));
+      _mm_storeu_ps(n, rows_transform(r0, r1, r2, _mm_setr_ps(nrm[i].x, nrm[i].y, nrm[i].z, 0.0f)));
+#else
+      float m[12];
+      memset(m, 0, sizeof(m));
+      for (; k < k_end; k++)
+      {
+        float w = weights[k];
+        const float* b = pal + ids[k] * 12;
+        for (int j = 0; j < 12; j++)
+          m[j] += w * b[j];
+      }
+      for (int r = 0; r < 3; r++)
+      {
+        const float* mr = m + r * 4;
+        v[r] = mr[0] * pos[i].x + mr[1] * pos[i].y + mr[2] * pos[i].z + mr[3] + gt[r];
+        n[r] = mr[0] * nrm[i].x + mr[1] * nrm[i].y + mr[2] * nrm[i].z;
+      }
+#endif
+      normalize(n);
+      s->dest_vertices[i].x = v[0];
+      s->dest_vertices[i].y = v[1];
+      s->dest_vertices[i].z = v[2];
+      s->dest_normals[i].x = n[0];
+      s->dest_normals[i].y = n[1];
+      s->dest_normals[i].z = n[2];
+    }
+  }
+
+public:
+
+  cal3d_skinning()
+  {
+    vertex_count = 0;
+    face_count = 0;
+    bone_count = 0;
+  }
+
+  size_t get_vertex_count()
+  {
+    return vertex_count;
+  }
+
+  size_t get_face_count()
+  {
+    return face_count;
+  }
+
+  // Reads the submeshes of model. Call again when meshes are attached or
+  // detached.
+  void prepare(CalModel* model)
+  {
+    parts.reset_used(0);
+    vertex_count = 0;
+    face_count = 0;
+    bone_count = model->getSkeleton()->getVectorBone().size();
+
+    std::vector<CalMesh*>& meshes = model->getVectorMesh();
+    for (size_t mi = 0; mi < meshes.size(); mi++)
+    {
+      std::vector<CalSubmesh*>& submeshes = meshes[mi]->getVectorSubmesh();
+      for (size_t si = 0; si < submeshes.size(); si++)
+      {
+        CalSubmesh* submesh = submeshes[si];
+        CalCoreSubmesh* core = submesh->getCoreSubmesh();
+        part p;
+        p.mesh_id = (int)mi;
+        p.submesh_id = (int)si;
+        p.submesh = submesh;
+        p.vertex_offset = vertex_count;
+        p.vertex_count = submesh->getVertexCount();
+        p.face_offset = face_count;
+        p.face_count = submesh->getFaceCount();
+        p.fast =
+          core->getVectorCoreSubMorphTarget().size() == 0 &&
+          !(core->getSpringCount() > 0 && submesh->hasInternalData());
+        parts.push_back(p);
+        vertex_count += p.vertex_count;
+        face_count += p.face_count;
+      }
+    }
+
+    vsx_vector* pos = positions.resize(vertex_count);
+    vsx_vector* nrm = normals.resize(vertex_count);
+    unsigned int* offsets = influence_offsets.resize(vertex_count + 1);
+    influence_bones.reset_used(0);
+    influence_weights.reset_used(0);
+
+    size_t v = 0;
+    for (size_t pi = 0; pi < parts.size(); pi++)
+    {
+      std::vector<CalCoreSubmesh::Vertex>& vertices = parts[pi].submesh->getCoreSubmesh()->getVectorVertex();
+      for (size_t i = 0; i < parts[pi].vertex_count; i++, v++)
+      {
+        CalCoreSubmesh::Vertex& vertex = vertices[i];
+        offsets[v] = (unsigned int)influence_bones.size();
+        pos[v] = vsx_vector(vertex.position.x, vertex.position.y, vertex.position.z);
+        nrm[v] = vsx_vector(vertex.normal.x, vertex.normal.y, vertex.normal.z);
+        if (!parts[pi].fast)
+          continue;
+        if (vertex.vectorInfluence.size() == 0)
+        {
+          influence_bones.push_back((unsigned int)bone_count);
+          influence_weights.push_back(1.0f);
+          continue;
+        }
+        for (size_t j = 0; j < vertex.vectorInfluence.size(); j++)
+        {
+          influence_bones.push_back((unsigned int)vertex.vectorInfluence[j].boneId);
+          influence_weights.push_back(vertex.vectorInfluence[j].weight);
+        }
+      }
+    }
+    offsets[vertex_count] = (unsigned int)influence_bones.size();
+    palette.resize((bone_count + 1) * 12);
+  }
+
+  // Faces (offset per submesh) and the first texture coordinate map.
+  // These don't change between frames.
+  void write_topology(vsx_mesh_data* data)
+  {
+    data->faces.allocate(face_count);
+    data->faces.reset_used(face_count);
+    data->vertex_tex_coords.allocate(vertex_count);
+    data->vertex_tex_coords.reset_used(vertex_count);
+    for (size_t pi = 0; pi < parts.size(); pi++)
+    {
+      part& p = parts[pi];
+      if (!p.face_count)
+        continue;
+      vsx_face* f = data->faces.get_pointer() + p.face_offset;
+      p.submesh->getFaces((CalIndex*)f);
+      for (size_t i = 0; i < p.face_count; i++)
+      {
+        f[i].a += p.vertex_offset;
+        f[i].b += p.vertex_offset;
+        f[i].c += p.vertex_offset;
+      }
+      std::vector<std::vector<CalCoreSubmesh::TextureCoordinate> >& maps =
+        p.submesh->getCoreSubmesh()->getVectorVectorTextureCoordinate();
+      if (maps.size() && p.vertex_count)
+        memcpy(
+          data->vertex_tex_coords.get_pointer() + p.vertex_offset,
+          &maps[0][0],
+          p.vertex_count * sizeof(vsx_tex_coord)
+        );
+    }
+    data->faces.timestamp = vsx_mesh_stamp();
+    data->vertex_tex_coords.timestamp = vsx_mesh_stamp();
+  }
+
+  // Skins the model in its current (calculateState'd) pose into vertices
+  // and normals (vertex count long each), then applies global: a 3x4
+  // row major affine transform (vsx_matrix::m[0..11]).
+  void update(CalModel* model, const float* global, vsx_vector* vertices, vsx_vector* vertex_normals)
+  {
+    if (!vertex_count)
+      return;
+
+    // bone palette, rotation part of global folded in
+    float g[12];
+    memcpy(g, global, sizeof(g));
+    for (int r = 0; r < 3; r++)
+    {
+      global_translation[r] = g[r * 4 + 3];
+      g[r * 4 + 3] = 0.0f;
+    }
+    std::vector<CalBone*>& bones = model->getSkeleton()->getVectorBone();
+    float* pal = palette.get_pointer();
+    for (size_t i = 0; i < bone_count; i++)
+    {
+      const CalMatrix& r = bones[i]->getTransformMatrix();
+      const CalVector& t = bones[i]->getTranslationBoneSpace();
+      float b[12] =
+      {
+        r.dxdx, r.dxdy, r.dxdz, t.x,
+        r.dydx, r.dydy, r.dydz, t.y,
+        r.dzdx, r.dzdy, r.dzdz, t.z
+      };
+      compose(g, b, pal + i * 12);
+    }
+    memcpy(pal + bone_count * 12, g, sizeof(g));
+
+    dest_vertices = vertices;
+    dest_normals = vertex_normals;
+
+    // fast parts are contiguous runs of the vertex range, usually just one
+    size_t pi = 0;
+    while (pi < parts.size())
+    {
+      if (!parts[pi].fast)
+      {
+        pi++;
+        continue;
+      }
+      size_t begin = parts[pi].vertex_offset;
+      size_t end = begin;
+      for (; pi < parts.size() && parts[pi].fast; pi++)
+        end += parts[pi].vertex_count;
+      range_offset = begin;
+      vsx_thread_pool::get_instance()->parallel_for(end - begin, CAL3D_SKINNING_MIN_CHUNK, &skin_range, this);
+    }
+
+    // the rest through cal3d
+    vsx_matrix mat;
+    memcpy(mat.m, global, sizeof(float) * 12);
+    vsx_matrix rot = mat;
+    rot.m[3] = rot.m[7] = rot.m[11] = 0.0f;
+    CalRenderer* renderer = 0;
+    for (pi = 0; pi < parts.size(); pi++)
+    {
+      part& p = parts[pi];
+      if (p.fast || !p.vertex_count)
+        continue;
+      if (!renderer)
+      {
+        renderer = model->getRenderer();
+        renderer->beginRendering();
+      }
+      if (!renderer->selectMeshSubmesh(p.mesh_id, p.submesh_id))
+        continue;
+      vsx_vector* v = vertices + p.vertex_offset;
+      vsx_vector* n = vertex_normals + p.vertex_offset;
+      renderer->getVertices(&v->x);
+      renderer->getNormals(&n->x);
+      vsx_vector_batch_transform(mat, v, v, p.vertex_count);
+      vsx_vector_batch_transform(rot, n, n, p.vertex_count);
+    }
+    if (renderer)
+      renderer->endRendering();
+  }
+};
+
+#endif
@@ -28,15 +28,13 @@
 #include "cal3d.h"
 #include "vsx_math_3d.h"
 #include <pthread.h>
-#include <semaphore.h>
 #include "cal3d.h"
 #include <vsx_timer.h>
+#include <vsx_background_job.h>
+#include "cal3d_skinning.h"
 
 //#define printf(a,b)
 #define VSXU_DEBUG 1
-#if (PLATFORM == PLATFORM_LINUX)
-  #include <sys/prctl.h>
-#endif
 
 typedef struct {
   CalBone* bone;
@@ -48,11 +46,6 @@ typedef struct {
   CalVector o_t;
 } bone_info;
 
-typedef struct {
-  bool is_thread;
-  void* class_pointer;
-} cal3d_thread_info;
-
 class vsx_module_cal3d_loader_threaded : public vsx_module {
 public:
     // in
@@ -81,24 +74,16 @@ public:
     CalModel* m_model;
     vsx_avector<bone_info> bones;
 
-    // threading stuff
-    pthread_t         worker_t;
-    pthread_mutex_t   mesh_mutex;
-    pthread_cond_t count_threshold_cv;
-    int               thread_has_something_to_deliver; // locked by the mesh mutex
-    int               have_sent_work_to_thread;
-    vsx_mesh*         mesh; // locked by the mesh mutex
-
-    pthread_mutex_t   thread_exit_mutex;
-    sem_t sem_worker_todo; // indicates wether the worker should do anything.
+    // skinning, on the thread pool when use_thread is set. The job writes
+    // into mesh while the other one of mesh_a / mesh_b is on the output;
+    // run() swaps them once it's done. Only work_job is shared, the
+    // model and mesh belong to the job while it's busy.
+    cal3d_skinning    skinning;
+    vsx_mesh*         mesh;
+    int               topology_pending; // meshes still without faces / tex coords
+    vsx_background_job work_job;
 
     int p_updates;
-    bool              worker_running;
-    bool              thread_created;
-    int               thread_state;
-    int               thread_exit;
-    int               prev_use_thread;
-    cal3d_thread_info thread_info;
 
     // transform
     vsx_quaternion pre_rotation_quaternion;
@@ -110,22 +95,15 @@ public:
     vsx_vector rot_center;
     vsx_vector post_rot_translate_vec;
 
+    // all of the above as one 3x4 matrix
+    float transform[12];
+
 
   vsx_module_cal3d_loader_threaded() {
     m_model = 0;
     c_model = 0;
-    thread_state = 0;
-    thread_exit = 0;
-    worker_running = false;
-    thread_created = false;
     p_updates = -1;
-    prev_use_thread = 0;
-    pthread_mutex_init(&mesh_mutex,NULL);
-    pthread_mutex_init(&thread_exit_mutex,NULL);
-    pthread_cond_init (&count_threshold_cv, NULL);
-    sem_init(&sem_worker_todo,0,0);
-    thread_has_something_to_deliver = 0;
-    have_sent_work_to_thread = 0;
+    topology_pending = 0;
   }
   bool init() {
 
@@ -135,33 +113,12 @@ public:
 
   void on_delete()
   {
-    if (thread_created)
-    {
-      // thread is probably waiting for data now, so this mutex is free
-      pthread_mutex_lock(&thread_exit_mutex);
-        thread_exit = 1;
-      pthread_mutex_unlock(&thread_exit_mutex);
-
-      // if thread is waiting for data, push it out of it
-      pthread_mutex_lock(&mesh_mutex);
-      pthread_cond_signal(&count_threshold_cv);
-      pthread_mutex_unlock(&mesh_mutex);
-
-      // meanwhile, thread will find the thread_exit we set
-
-      pthread_join(worker_t, NULL);
-    }
-
-    pthread_mutex_lock(&mesh_mutex);
+    work_job.wait();
     if (c_model) {
       delete (CalCoreModel*)c_model;
     }
     delete mesh_a;
     delete mesh_b;
-    pthread_mutex_unlock(&mesh_mutex);
-    pthread_mutex_destroy(&thread_exit_mutex);
-    pthread_mutex_destroy(&mesh_mutex);
-    sem_destroy(&sem_worker_todo);
   }
 
   void module_info(vsx_module_info* info)
@@ -231,7 +188,6 @@ public:
     quat_p->set(1.0f,3);
     use_thread = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"use_thread");
     use_thread->set(0);
-    prev_use_thread = 0;
     if (bones.size())
     {
       for (unsigned long i = 0; i < bones.size(); ++i)
@@ -289,11 +245,11 @@ public:
     redeclare_out_params(out_parameters);
     first_run = true;
     c_model = 0;
-    thread_info.class_pointer = (void*)this;
   }
 
   void param_set_notify(const vsx_string& name) {
-    pthread_mutex_lock(&mesh_mutex);
+    // the job might be using the model
+    work_job.wait();
 
     #ifdef VSXU_DEBUG
     printf("cal3d param set notify..\n");
@@ -424,243 +380,180 @@ public:
           (*it)->enableTangents(0, true);
         }*/
 
+        skinning.prepare(m_model);
+        topology_pending = 2;
         loading_done = true;
       }
     }
-    pthread_mutex_unlock(&mesh_mutex);
   }
 
 
-  static void* worker(void *ptr)
+  // Skins the model into mesh. Runs on the thread pool or from run().
+  void skin()
   {
-    cal3d_thread_info thread_info= *(cal3d_thread_info*)ptr;
-    vsx_module_cal3d_loader_threaded* my = ((vsx_module_cal3d_loader_threaded*)  thread_info.class_pointer);
-    unsigned long exit_check_counter = 0;
-    int first_rendering = 0;
+    m_model->getSkeleton()->calculateState();
 
-    #if (PLATFORM == PLATFORM_LINUX)
-      if (thread_info.is_thread)
-      {
-        char* cal = "cal3d::worker";
-        prctl(PR_SET_NAME,cal);
-      }
-    #endif
-    while (1)
+    vsx_mesh_data* data = mesh->data;
+    if (topology_pending)
     {
-      //vsx_timer time;
-      //time.start();
-      // something needs to be done. lock the mesh.
-      //printf("cal3d %d\n",__LINE__);
-
-      // lock mutex
-      pthread_mutex_lock(&my->mesh_mutex);
-
-      // wait for more work
-      pthread_cond_wait(&my->count_threshold_cv, &my->mesh_mutex);
-
-      //printf("cal3d %d\n",__LINE__);
-      CalSkeleton* m_skeleton = my->m_model->getSkeleton();
-      m_skeleton->calculateState();
-
-      CalRenderer *pCalRenderer;
-      pCalRenderer = my->m_model->getRenderer();
-      pCalRenderer->beginRendering();
-      int meshCount;
-      meshCount = pCalRenderer->getMeshCount();
-
-      int meshId;
-      for(meshId = 0; meshId < meshCount; meshId++)
-      {
-        // get the number of submeshes
-        int submeshCount;
-        submeshCount = pCalRenderer->getSubmeshCount(meshId);
-        //printf("submesh count: %d\n",submeshCount);
-
-        // loop through all submeshes of the mesh
-        int submeshId;
-        for(submeshId = 0; submeshId < submeshCount; submeshId++)
-        {
-          // select mesh and submesh for further data access
-          if(pCalRenderer->selectMeshSubmesh(meshId, submeshId))
-          {
-            my->mesh->data->vertices[pCalRenderer->getVertexCount()+1] = vsx_vector(0,0,0);
-            pCalRenderer->getVertices(&my->mesh->data->vertices[0].x);
-
-            my->mesh->data->vertex_normals[pCalRenderer->getVertexCount()+1] = vsx_vector(0,0,0);
-            pCalRenderer->getNormals(&my->mesh->data->vertex_normals[0].x);
-
-            if (pCalRenderer->isTangentsEnabled(0))
-            {
-              //my->mesh->data->vertex_tangents[pCalRenderer->getVertexCount()+1].x = 0;// = vsx_vector(0,0,0);
-              //int num_tagentspaces = pCalRenderer->getTangentSpaces(0,&my->mesh->data->vertex_tangents[0].x);
-              //printf("fetched %d tangents\n", num_tagentspaces);
-            }
-            //else printf("Tangents are NOT enabled\n");
-
-
-            if (first_rendering < 4)
-            {
-              my->mesh->data->vertex_tex_coords[pCalRenderer->getVertexCount()+1].s = 0;
-              pCalRenderer->getTextureCoordinates(0,&my->mesh->data->vertex_tex_coords[0].s);
-
-              int faceCount = pCalRenderer->getFaceCount();
-              (my->mesh)->data->faces.allocate(faceCount*3);
-              pCalRenderer->getFaces((int*)&(my->mesh)->data->faces[0].a);
-              (my->mesh)->data->faces.reset_used(faceCount);
-              first_rendering++;
-            }
-          }
-        }
-      }
-
-      // end the rendering of the model
-      pCalRenderer->endRendering();
-
-      // ********************************************************************
-      // perform transforms
-
-      my->post_rot_translate_vec += my->rot_center;
-
-      my->pre_rotation_mat = my->pre_rotation_quaternion.matrix();
-      my->rotation_mat = my->rotation_quaternion.matrix();
-
-      unsigned long end = (my->mesh)->data->vertices.size();
-      vsx_vector* vs_v = &(my->mesh)->data->vertices[0];
-      vsx_vector* vs_n = &(my->mesh)->data->vertex_normals[0];
+      skinning.write_topology(data);
+      topology_pending--;
+    }
 
+    // fresh buffers, the previous contents may still be shared downstream
+    size_t vertex_count = skinning.get_vertex_count();
+    data->vertices.reset_used(0);
+    data->vertex_normals.reset_used(0);
+    if (!vertex_count)
+      return;
+    data->vertices.allocate(vertex_count);
+    data->vertices.reset_used(vertex_count);
+    data->vertex_normals.allocate(vertex_count);
+    data->vertex_normals.reset_used(vertex_count);
 
-      for (unsigned long i = 0; i < end; i++)
-      {
-        // scaling
-//          *vs_v *= 0.95f;
-        //vs_v->y *= 0.9f;
-
-        // pre rotation
-        vs_v->multiply_matrix_other_vec
-        (
-          &my->pre_rotation_mat.m[0],
-          *vs_v - my->pre_rot_center
-        );
-        (*vs_v) += my->pre_rot_center;
-        vsx_vector n = *vs_n;
-        vs_n->multiply_matrix_other_vec(
-          &my->pre_rotation_mat.m[0],
-          n
-        );
-
-
-        // post rotation
-        vs_v->multiply_matrix_other_vec
-        (
-          &my->rotation_mat.m[0],
-          *vs_v - my->rot_center
-        );
-        // vertex offset
-        (*vs_v) += my->post_rot_translate_vec;
-        // normal rotation
-        n = *vs_n;
-        vs_n->multiply_matrix_other_vec(
-          &my->rotation_mat.m[0],
-          n
-        );
-        vs_v++;
-        vs_n++;
-      }
-      //printf("thread dtime: %f\n", time.dtime());
+    skinning.update(m_model, transform, data->vertices.get_pointer(), data->vertex_normals.get_pointer());
 
-      // ********************************************************************
-      // calculate tangent space coordinates
+    // ********************************************************************
+    // calculate tangent space coordinates
 
-      vsx_mesh* mesh = my->mesh;
+    mesh->data->vertex_colors.allocate( mesh->data->vertices.size() );
+    mesh->data->vertex_colors.memory_clear();
 
-      mesh->data->vertex_colors.allocate( mesh->data->vertices.size() );
-      mesh->data->vertex_colors.memory_clear();
+    vsx_quaternion* vec_d = (vsx_quaternion*)mesh->data->vertex_colors.get_pointer();
 
-      vsx_quaternion* vec_d = (vsx_quaternion*)mesh->data->vertex_colors.get_pointer();
+    for (unsigned long a = 0; a < mesh->data->faces.size(); a++)
+    {
+      long i1 = mesh->data->faces[a].a;
+      long i2 = mesh->data->faces[a].b;
+      long i3 = mesh->data->faces[a].c;
+
+      const vsx_vector& v1 = mesh->data->vertices[i1];
+      const vsx_vector& v2 = mesh->data->vertices[i2];
+      const vsx_vector& v3 = mesh->data->vertices[i3];
+
+      const vsx_tex_coord& w1 = mesh->data->vertex_tex_coords[i1];
+      const vsx_tex_coord& w2 = mesh->data->vertex_tex_coords[i2];
+      const vsx_tex_coord& w3 = mesh->data->vertex_tex_coords[i3];
+
+      float x1 = v2.x - v1.x;
+      float x2 = v3.x - v1.x;
+      float y1 = v2.y - v1.y;
+      float y2 = v3.y - v1.y;
+      float z1 = v2.z - v1.z;
+      float z2 = v3.z - v1.z;
+
+      float s1 = w2.s - w1.s;
+      float s2 = w3.s - w1.s;
+      float t1 = w2.t - w1.t;
+      float t2 = w3.t - w1.t;
+
+      float r = 1.0f / (s1 * t2 - s2 * t1);
+      vsx_quaternion sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
+      //vsx_vector sdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r,(s1 * z2 - s2 * z1) * r);
+
+      vec_d[i1] += sdir;
+      vec_d[i2] += sdir;
+      vec_d[i3] += sdir;
+
+      //tan2[i1] += tdir;
+      //tan2[i2] += tdir;
+      //tan2[i3] += tdir;
+    }
+    for (unsigned long a = 0; a < mesh->data->vertices.size(); a++)
+    {
+        vsx_vector& n = mesh->data->vertex_normals[a];
+        vsx_quaternion& t = vec_d[a];
 
-      for (unsigned long a = 0; a < mesh->data->faces.size(); a++)
-      {
-        long i1 = mesh->data->faces[a].a;
-        long i2 = mesh->data->faces[a].b;
-        long i3 = mesh->data->faces[a].c;
-
-        const vsx_vector& v1 = mesh->data->vertices[i1];
-        const vsx_vector& v2 = mesh->data->vertices[i2];
-        const vsx_vector& v3 = mesh->data->vertices[i3];
-
-        const vsx_tex_coord& w1 = mesh->data->vertex_tex_coords[i1];
-        const vsx_tex_coord& w2 = mesh->data->vertex_tex_coords[i2];
-        const vsx_tex_coord& w3 = mesh->data->vertex_tex_coords[i3];
-
-        float x1 = v2.x - v1.x;
-        float x2 = v3.x - v1.x;
-        float y1 = v2.y - v1.y;
-        float y2 = v3.y - v1.y;
-        float z1 = v2.z - v1.z;
-        float z2 = v3.z - v1.z;
-
-        float s1 = w2.s - w1.s;
-        float s2 = w3.s - w1.s;
-        float t1 = w2.t - w1.t;
-        float t2 = w3.t - w1.t;
-
-        float r = 1.0f / (s1 * t2 - s2 * t1);
-        vsx_quaternion sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-        //vsx_vector sdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r,(s1 * z2 - s2 * z1) * r);
-
-        vec_d[i1] += sdir;
-        vec_d[i2] += sdir;
-        vec_d[i3] += sdir;
-
-        //tan2[i1] += tdir;
-        //tan2[i2] += tdir;
-        //tan2[i3] += tdir;
-      }
-      for (unsigned long a = 0; a < mesh->data->vertices.size(); a++)
-      {
-          vsx_vector& n = mesh->data->vertex_normals[a];
-          vsx_quaternion& t = vec_d[a];
+        // Gram-Schmidt orthogonalize
+        //vec_d[a] = (t - n * t.dot_product(&n) );
+        vec_d[a] = (t - n * t.dot_product(&n) );
+        vec_d[a].normalize();
 
-          // Gram-Schmidt orthogonalize
-          //vec_d[a] = (t - n * t.dot_product(&n) );
-          vec_d[a] = (t - n * t.dot_product(&n) );
-          vec_d[a].normalize();
+        // Calculate handedness
+        //tangent[a].w = (Dot(Cross(n, t), tan2[a]) < 0.0F) ? -1.0F : 1.0F;
+    }
+  }
 
-          // Calculate handedness
-          //tangent[a].w = (Dot(Cross(n, t), tan2[a]) < 0.0F) ? -1.0F : 1.0F;
-      }
+  static void skin_job(void* arg)
+  {
+    vsx_module_cal3d_loader_threaded* my = (vsx_module_cal3d_loader_threaded*)arg;
+    my->skin();
+  }
 
-      my->thread_has_something_to_deliver++;
-      //printf("cal3d %d\n",__LINE__);
-      pthread_mutex_unlock(&my->mesh_mutex);
-      //printf("cal3d %d\n",__LINE__);
+  // pre rotation about pre_rot_center, then rotation about rot_center and
+  // the post rotation offset, as one matrix:
+  // v' = R2 (R1 (v - pc) + pc - rc) + rc + post
+  void calculate_transform()
+  {
+    pre_rotation_mat = pre_rotation_quaternion.matrix();
+    rotation_mat = rotation_quaternion.matrix();
+    vsx_vector o = pre_rot_center;
+    vsx_vector r1_pc;
+    r1_pc.multiply_matrix_other_vec(&pre_rotation_mat.m[0], pre_rot_center);
+    o -= r1_pc;
+    o -= rot_center;
+    vsx_vector t;
+    t.multiply_matrix_other_vec(&rotation_mat.m[0], o);
+    t += rot_center;
+    t += post_rot_translate_vec;
+    const float* a = rotation_mat.m;
+    const float* b = pre_rotation_mat.m;
+    for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+        transform[r * 4 + c] = a[r * 4] * b[c] + a[r * 4 + 1] * b[4 + c] + a[r * 4 + 2] * b[8 + c];
+    transform[3] = t.x;
+    transform[7] = t.y;
+    transform[11] = t.z;
+  }
 
-      // if we're not supposed to run in a thread
-      if (false == thread_info.is_thread)
-      {
-        return 0;
-      }
+  // hands the finished mesh and the bone state to the outputs
+  void publish()
+  {
+    vsx_module_cal3d_loader_threaded* my = this;
+    m_model->getSkeleton()->calculateBoundingBoxes();
+    if (!my->redeclare_out)
+    {
+      mesh_bbox->data->vertices.allocate(my->bones.size() * 8);
 
+      for (unsigned long j = 0; j < my->bones.size(); ++j)
       {
-        exit_check_counter = 0;
-        // see if the exit flag is set (user changed from threaded to non-threaded mode)
-        //printf("cal3d %d\n",__LINE__);
-        pthread_mutex_lock(&my->thread_exit_mutex);
-        //printf("cal3d %d\n",__LINE__);
-        int time_to_exit = my->thread_exit;
-        //printf("cal3d %d\n",__LINE__);
-        pthread_mutex_unlock(&my->thread_exit_mutex);
-        //printf("cal3d %d\n",__LINE__);
-        if (time_to_exit) {
-          int *retval = new int;
-          *retval = 0;
-          my->thread_exit = 0;
-          pthread_exit((void*)retval);
-          return 0;
+        if (my->bones[j].bone != 0)
+        {
+          CalVector t1 = my->bones[j].bone->getTranslationAbsolute();
+          CalQuaternion q2 = my->bones[j].bone->getRotationAbsolute();
+          my->bones[j].bone->getCoreBone()->calculateBoundingBox(m_model->getCoreModel());
+          my->bones[j].bone->calculateBoundingBox();
+
+          CalBoundingBox bbox = my->bones[j].bone->getBoundingBox();
+          CalVector bboxv[8];
+          bbox.computePoints((CalVector*)&bboxv);
+          for (unsigned long bbi = 0; bbi < 8; bbi++)
+          {
+            mesh_bbox->data->vertices[j*8+bbi].x = bboxv[bbi].x;
+            mesh_bbox->data->vertices[j*8+bbi].y = bboxv[bbi].y;
+            mesh_bbox->data->vertices[j*8+bbi].z = bboxv[bbi].z;
+          }
+          my->bones[j].result_rotation   ->set( q2.x, 0 );
+          my->bones[j].result_rotation   ->set( q2.y, 1 );
+          my->bones[j].result_rotation   ->set( q2.z, 2 );
+          my->bones[j].result_rotation   ->set( q2.w, 3 );
+
+          my->bones[j].result_translation->set( t1.x, 0 );
+          my->bones[j].result_translation->set( t1.y, 1 );
+          my->bones[j].result_translation->set( t1.z, 2 );
         }
       }
     }
-    return 0;
+
+    mesh->data->vertices.timestamp = vsx_mesh_stamp();
+    mesh->data->vertex_normals.timestamp = vsx_mesh_stamp();
+    mesh->data->vertex_colors.timestamp = vsx_mesh_stamp();
+    mesh->timestamp++;
+    result->set(mesh);
+
+    // toggle to the other mesh
+    if (mesh == mesh_a) mesh = mesh_b;
+    else mesh = mesh_a;
   }
 
   void run()
@@ -670,148 +563,66 @@ public:
     if (!bones.size())
       return;
 
-    //printf("cal3d module run!\n");
-    // deal with changes in threading use
-    if (thread_created && use_thread->get() == 0)
-    {
-      // this means the thread is running. kill it off.
-      //printf("cal3d %d\n",__LINE__);
-      pthread_mutex_lock(&thread_exit_mutex);
-      //printf("cal3d %d\n",__LINE__);
-        thread_exit = 1;
-      //printf("cal3d %d\n",__LINE__);
-      pthread_mutex_unlock(&thread_exit_mutex);
-      //printf("cal3d %d\n",__LINE__);
-      void* ret;
-      pthread_join(worker_t,&ret);
-      thread_created = false;
-      thread_info.is_thread = false;
-    }
-    if (!thread_created && use_thread->get() == 1)
-    {
-      //printf("cal3d %d\n",__LINE__);
-      pthread_create(&worker_t, NULL, &worker, (void*)&thread_info);
-      //printf("cal3d %d\n",__LINE__);
-      thread_created = true;
-      thread_info.is_thread = true;
-    }
-
-    if (0 == use_thread->get())
-    {
-      thread_info.is_thread = false;
-      worker((void*)&thread_info);
-    }
-
-    if (0 == pthread_mutex_trylock(&mesh_mutex) )
-    {
-      // lock ackquired. thread is waiting for us to set the semaphore before doing anything again.
-      /*bool wait = true;
-      if (!thread_has_something_to_deliver && have_sent_work_to_thread)
-      {
-        while (wait)
-        {
-          pthread_mutex_unlock(&mesh_mutex);
-          pthread_mutex_lock(&mesh_mutex);
-          if (thread_has_something_to_deliver) wait = false;
-        }
-      }*/
-      if (thread_has_something_to_deliver)
-      {
-        thread_has_something_to_deliver = false;
-        vsx_module_cal3d_loader_threaded* my = this;
-        m_model->getSkeleton()->calculateBoundingBoxes();
-        if (!my->redeclare_out)
-        {
-          mesh_bbox->data->vertices.allocate(my->bones.size() * 8);
+    // still busy, the model is the job's until it's done
+    if (work_job.working())
+      return;
 
-          for (unsigned long j = 0; j < my->bones.size(); ++j)
-          {
-            if (my->bones[j].bone != 0)
-            {
-              CalVector t1 = my->bones[j].bone->getTranslationAbsolute();
-              CalQuaternion q2 = my->bones[j].bone->getRotationAbsolute();
-              my->bones[j].bone->getCoreBone()->calculateBoundingBox(m_model->getCoreModel());
-              my->bones[j].bone->calculateBoundingBox();
-
-              CalBoundingBox bbox = my->bones[j].bone->getBoundingBox();
-              CalVector bboxv[8];
-              bbox.computePoints((CalVector*)&bboxv);
-              for (unsigned long bbi = 0; bbi < 8; bbi++)
-              {
-                mesh_bbox->data->vertices[j*8+bbi].x = bboxv[bbi].x;
-                mesh_bbox->data->vertices[j*8+bbi].y = bboxv[bbi].y;
-                mesh_bbox->data->vertices[j*8+bbi].z = bboxv[bbi].z;
-              }
-              my->bones[j].result_rotation   ->set( q2.x, 0 );
-              my->bones[j].result_rotation   ->set( q2.y, 1 );
-              my->bones[j].result_rotation   ->set( q2.z, 2 );
-              my->bones[j].result_rotation   ->set( q2.w, 3 );
-
-              my->bones[j].result_translation->set( t1.x, 0 );
-              my->bones[j].result_translation->set( t1.y, 1 );
-              my->bones[j].result_translation->set( t1.z, 2 );
-            }
-          }
-        }
+    if (work_job.collect())
+      publish();
 
-        mesh->timestamp++;
-        result->set(mesh);
+    if (p_updates == param_updates)
+      return;
 
-        // toggle to the other mesh
-        if (mesh == mesh_a) mesh = mesh_b;
-        else mesh = mesh_a;
+    CalQuaternion q2;
+    CalVector t1;
+    for (unsigned long j = 0; j < bones.size(); ++j)
+    {
+      t1.x = bones[j].translation->get(0);
+      t1.y = bones[j].translation->get(1);
+      t1.z = bones[j].translation->get(2);
+      q2.x = bones[j].param->get(0);
+      q2.y = bones[j].param->get(1);
+      q2.z = bones[j].param->get(2);
+      q2.w = bones[j].param->get(3);
+      if (bones[j].bone != 0) {
+        bones[j].bone->setRotation(q2);
+        bones[j].bone->setTranslation(bones[j].o_t + t1);
       }
-      if (p_updates != param_updates)
-      {
-        CalQuaternion q2;
-        CalVector t1;
-        for (unsigned long j = 0; j < bones.size(); ++j)
-        {
-          t1.x = bones[j].translation->get(0);
-          t1.y = bones[j].translation->get(1);
-          t1.z = bones[j].translation->get(2);
-          q2.x = bones[j].param->get(0);
-          q2.y = bones[j].param->get(1);
-          q2.z = bones[j].param->get(2);
-          q2.w = bones[j].param->get(3);
-          if (bones[j].bone != 0) {
-            bones[j].bone->setRotation(q2);
-            bones[j].bone->setTranslation(bones[j].o_t + t1);
-          }
-        }
+    }
 
-        pre_rotation_quaternion.x = pre_rotation->get(0);
-        pre_rotation_quaternion.y = pre_rotation->get(1);
-        pre_rotation_quaternion.z = pre_rotation->get(2);
-        pre_rotation_quaternion.w = pre_rotation->get(3);
+    pre_rotation_quaternion.x = pre_rotation->get(0);
+    pre_rotation_quaternion.y = pre_rotation->get(1);
+    pre_rotation_quaternion.z = pre_rotation->get(2);
+    pre_rotation_quaternion.w = pre_rotation->get(3);
 
-        pre_rot_center.x = pre_rotation_center->get(0);
-        pre_rot_center.y = pre_rotation_center->get(1);
-        pre_rot_center.z = pre_rotation_center->get(2);
+    pre_rot_center.x = pre_rotation_center->get(0);
+    pre_rot_center.y = pre_rotation_center->get(1);
+    pre_rot_center.z = pre_rotation_center->get(2);
 
-        rotation_quaternion.x = rotation->get(0);
-        rotation_quaternion.y = rotation->get(1);
-        rotation_quaternion.z = rotation->get(2);
-        rotation_quaternion.w = rotation->get(3);
+    rotation_quaternion.x = rotation->get(0);
+    rotation_quaternion.y = rotation->get(1);
+    rotation_quaternion.z = rotation->get(2);
+    rotation_quaternion.w = rotation->get(3);
 
-        rot_center.x = rotation_center->get(0);
-        rot_center.y = rotation_center->get(1);
-        rot_center.z = rotation_center->get(2);
+    rot_center.x = rotation_center->get(0);
+    rot_center.y = rotation_center->get(1);
+    rot_center.z = rotation_center->get(2);
 
-        post_rot_translate_vec.x = post_rot_translate->get(0);
-        post_rot_translate_vec.y = post_rot_translate->get(1);
-        post_rot_translate_vec.z = post_rot_translate->get(2);
+    post_rot_translate_vec.x = post_rot_translate->get(0);
+    post_rot_translate_vec.y = post_rot_translate->get(1);
+    post_rot_translate_vec.z = post_rot_translate->get(2);
 
-        p_updates = param_updates;
-        //printf("cal3d %d\n",__LINE__);
-        have_sent_work_to_thread = 1;
-        //sem_post(&sem_worker_todo);
-        pthread_cond_signal(&count_threshold_cv);
+    calculate_transform();
+    p_updates = param_updates;
 
-        //printf("cal3d %d\n",__LINE__);
-      }
-      pthread_mutex_unlock(&mesh_mutex);
+    if (use_thread->get() == 0)
+    {
+      skin();
+      publish();
+      return;
     }
+
+    work_job.start(&skin_job, (void*)this);
   }
 };
 
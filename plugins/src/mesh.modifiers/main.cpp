@@ -28,6 +28,11 @@
 #include <vsx_math_3d.h>
 #include <vsx_float_array.h>
 #include <vsx_quaternion.h>
+#include <vsx_vector_batch.h>
+#include <vsx_mesh_attributes.h>
+#include <vsx_background_job.h>
+#include <vsx_mesh_spatial.h>
+#include "mesh_simplify.h"
 #include <pthread.h>
 
 /*
@@ -43,9 +48,12 @@
  */
 
 // HOW TO:
-// When writing a mesh modifier you should consider using poiters and volatile arrays.
-// However, this means you have to set the output mesh to mesh_empty (below), otherwise
-// the receiver might still have direct pointers to data we don't know is there.
+// When writing a mesh modifier, pass the streams you don't change through with
+// mesh->data->share((*p)->data, VSX_MESH_...) and mesh->data->touch() the ones you
+// write, use vsx_vector_batch.h for transforming vertices / normals.
+// If you still use pointers and volatile arrays you have to set the output mesh to
+// mesh_empty (below), otherwise the receiver might still have direct pointers to data
+// we don't know is there.
 // This small snippet in the beginning of the run() method does the trick:
 //     
 // if (!p) 
@@ -57,7 +65,6 @@
 // }   
 
 
-// TODO: optimize the mesh_quat_rotate to also use volatile arrays for speed
 // TODO: optimize the inflation mesh modifier to use volatile arrays for passthru arrays
 // TODO: add a real spheremapping module
 // TODO: quaternion rotation from 2 vertex id's: vector from point to point, normal, crossproduct = matrix -> quaternion
@@ -467,17 +474,27 @@ public:
       }
       mesh->data->vertices.reset_used(0);
       mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
-      for (unsigned int i = 0; i < (*p)->data->vertices.size(); i++)
+      unsigned long end = (*p)->data->vertices.size();
+      unsigned long end_normals = (*p)->data->vertex_normals.size();
+      mesh->data->vertices.allocate(end);
+      mesh->data->vertices.reset_used(end);
+      mesh->data->vertex_normals.allocate(end_normals);
+      mesh->data->vertex_normals.reset_used(end_normals);
+      if (end == end_normals)
       {
-        mesh->data->vertices[i] = mat.multiply_vector((*p)->data->vertices[i]);
-      }
-      for (unsigned int i = 0; i < (*p)->data->vertex_normals.size(); i++)
+        vsx_vector_batch_transform(
+          mat,
+          (*p)->data->vertices.get_pointer(),
+          mesh->data->vertices.get_pointer(),
+          end,
+          (*p)->data->vertex_normals.get_pointer(),
+          mesh->data->vertex_normals.get_pointer()
+        );
+      } else
       {
-        mesh->data->vertex_normals[i] = mat.multiply_vector((*p)->data->vertex_normals[i]);
+        vsx_vector_batch_transform(mat, (*p)->data->vertices.get_pointer(), mesh->data->vertices.get_pointer(), end);
+        vsx_vector_batch_transform(mat, (*p)->data->vertex_normals.get_pointer(), mesh->data->vertex_normals.get_pointer(), end_normals);
       }
 /*
       vsx_array<vsx_vector> vertices;
@@ -486,11 +503,8 @@ public:
       vsx_array<vsx_tex_coord> vertex_tex_coords;
       vsx_array<vsx_face> faces;
 */
-      for (unsigned int i = 0; i < (*p)->data->vertex_tex_coords.size(); i++) mesh->data->vertex_tex_coords[i] = (*p)->data->vertex_tex_coords[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_tangents.size(); i++) mesh->data->vertex_tangents[i] = (*p)->data->vertex_tangents[i];
-      //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
-      for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
+      mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -591,43 +605,23 @@ public:
       //mesh->data->vertices.reset_used(0);
       //mesh->data->vertex_normals.reset_used(0);
 
+      // rotate around neg_vec, then move: fold both into the translation
+      // column, M * (v - neg_vec) + ofs_vec = M * v + (ofs_vec - M * neg_vec)
+      vsx_matrix mat_pos = mat;
+      vsx_vector rotated_neg = mat.multiply_vector(neg_vec);
+      mat_pos.m[3] = mat.m[3] + ofs_vec.x - rotated_neg.x;
+      mat_pos.m[7] = mat.m[7] + ofs_vec.y - rotated_neg.y;
+      mat_pos.m[11] = mat.m[11] + ofs_vec.z - rotated_neg.z;
+
       unsigned long end = (*p)->data->vertices.size();
-      vsx_vector* vs_p = &(*p)->data->vertices[0];//.get_pointer();
       mesh->data->vertices.allocate(end);
       mesh->data->vertices.reset_used(end);
-      vsx_vector* vs_d = mesh->data->vertices.get_pointer();
-
-
-
-      for (unsigned long i = 0; i < end; i++)
-      {
-        //(*vs_d).multiply_matrix_other_vec(&mat.m[0],*vs_p - neg_vec);// = mat.multiply_vector((*p)->data->vertices[i]);
-        //(*vs_d) += ofs_vec;
-        //vs_p++;
-        //vs_d++;
-        //mesh->data->vertices[i] = mat.multiply_vector((*p)->data->vertices[i]);
-        //mesh->data->vertices[i].multiply_matrix_other_vec(&mat.m[0],(*p)->data->vertices[i] - neg_vec);// = mat.multiply_vector((*p)->data->vertices[i]);
-        //mesh->data->vertices[i] += ofs_vec;
-
-        vs_d[i].multiply_matrix_other_vec(&mat.m[0],vs_p[i] - neg_vec);// = mat.multiply_vector((*p)->data->vertices[i]);
-        vs_d[i] += ofs_vec;
-      }
+      vsx_vector_batch_transform(mat_pos, (*p)->data->vertices.get_pointer(), mesh->data->vertices.get_pointer(), end);
 
       end = (*p)->data->vertex_normals.size();
       mesh->data->vertex_normals.allocate(end);
       mesh->data->vertex_normals.reset_used(end);
-      vs_d = mesh->data->vertex_normals.get_pointer();
-      vs_p = (*p)->data->vertex_normals.get_pointer();
-
-      for (unsigned long i = 0; i < end; i++)
-      {
-        //(*vs_d).multiply_matrix_other_vec(&mat.m[0],*vs_p);
-        //mesh->data->vertex_normals[i].multiply_matrix_other_vec(&mat.m[0],(*p)->data->vertex_normals[i]);// = mat.multiply_vector((*p)->data->vertex_normals[i]);
-        vs_d[i].multiply_matrix_other_vec(&mat.m[0],vs_p[i]);// = mat.multiply_vector((*p)->data->vertex_normals[i]);
-        //mesh->data->vertex_normals[i] = mat.multiply_vector((*p)->data->vertex_normals[i]);
-//        vs_p++;
-        //vs_d++;
-      }
+      vsx_vector_batch_transform(mat, (*p)->data->vertex_normals.get_pointer(), mesh->data->vertex_normals.get_pointer(), end);
 /*
       vsx_array<vsx_vector> vertices;
       vsx_array<vsx_vector> vertex_normals;
@@ -637,18 +631,9 @@ public:
 */
       if (prev_timestamp != (*p)->timestamp)
       {
-        mesh->data->vertex_tex_coords.set_volatile();
-        mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-        mesh->data->vertex_tangents.set_volatile();
-        mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-        mesh->data->vertex_colors.set_volatile();
-        mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-        mesh->data->faces.set_volatile();
-        mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+        mesh->data->share((*p)->data, VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
       }
+      mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -708,23 +693,11 @@ public:
       v.y = translation->get(1);
       v.z = translation->get(2);
       mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
       unsigned long end = (*p)->data->vertices.size();
-      vsx_vector* vs_p = &(*p)->data->vertices[0];//.get_pointer();
       mesh->data->vertices.allocate(end);
       mesh->data->vertices.reset_used(end);
-      vsx_vector* vs_d = mesh->data->vertices.get_pointer();
-
-
-      for (unsigned int i = 0; i < end; i++)
-      {
-        //mesh->data->vertices[i] = (*p)->data->vertices[i] + v;
-        vs_d[i] = vs_p[i] + v;
-      }
+      vsx_vector_batch_scale_offset(vsx_vector(1.0f, 1.0f, 1.0f), v, (*p)->data->vertices.get_pointer(), mesh->data->vertices.get_pointer(), end);
 /*
       vsx_array<vsx_vector> vertices;
       vsx_array<vsx_vector> vertex_normals;
@@ -735,20 +708,7 @@ public:
 
       //if (prev_timestamp != (*p)->timestamp)
       //{
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 //      }
 
 
@@ -758,6 +718,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -821,23 +782,11 @@ public:
       v.y = scale->get(1);
       v.z = scale->get(2);
       mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
       unsigned long end = (*p)->data->vertices.size();
-      vsx_vector* vs_p = &(*p)->data->vertices[0];
       mesh->data->vertices.allocate(end);
       mesh->data->vertices.reset_used(end);
-      vsx_vector* vs_d = mesh->data->vertices.get_pointer();
-
-
-      for (unsigned int i = 0; i < end; i++)
-      {
-        //mesh->data->vertices[i] = (*p)->data->vertices[i] + v;
-        vs_d[i] = vs_p[i] * v;
-      }
+      vsx_vector_batch_scale_offset(v, vsx_vector(0.0f, 0.0f, 0.0f), (*p)->data->vertices.get_pointer(), mesh->data->vertices.get_pointer(), end);
 /*
       vsx_array<vsx_vector> vertices;
       vsx_array<vsx_vector> vertex_normals;
@@ -848,20 +797,7 @@ public:
 
       //if (prev_timestamp != (*p)->timestamp)
       //{
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 //      }
 
 
@@ -871,6 +807,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -926,10 +863,6 @@ public:
     if (p && (param_updates || prev_timestamp != (*p)->timestamp)) {
       prev_timestamp = (*p)->timestamp;
       mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
       // 1. find out the minima and maxima of the mesh
       vsx_vector minima;
@@ -971,11 +904,7 @@ public:
       float zmove = -minima.z * scaling;
 
 
-      vs_p = &(*p)->data->vertices[0];
-      for (unsigned int i = 0; i < end; i++)
-      {
-        vs_d[i] = vs_p[i] * scaling + vsx_vector(xmove, ymove, zmove);
-      }
+      vsx_vector_batch_scale_offset(vsx_vector(scaling, scaling, scaling), vsx_vector(xmove, ymove, zmove), (*p)->data->vertices.get_pointer(), vs_d, end);
       //vsx_array<vsx_vector> vertices;
       //vsx_array<vsx_vector> vertex_normals;
       //vsx_array<vsx_color> vertex_colors;
@@ -985,20 +914,7 @@ public:
 
       //if (prev_timestamp != (*p)->timestamp)
       //{
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 //      }
 
 
@@ -1008,6 +924,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -1079,10 +996,6 @@ public:
       v.y = translation->get(1);
       v.z = translation->get(2);
       mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
       unsigned long end = (*p)->data->vertices.size();
       vsx_vector* vs_p = &(*p)->data->vertices[0];//.get_pointer();
@@ -1124,20 +1037,7 @@ public:
 
       //if (prev_timestamp != (*p)->timestamp)
       //{
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 //      }
 
 
@@ -1147,6 +1047,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -1258,6 +1159,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_FACES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -1334,10 +1236,11 @@ public:
         size_t i_vertex_iter = 0;
         size_t i_face_iter = 0;
         size_t i_vertex_weight_iter = 0;
-        mesh->data->vertices.unset_volatile();
-        mesh->data->vertex_normals.unset_volatile();
-        mesh->data->vertex_tex_coords.unset_volatile();
-        mesh->data->faces.unset_volatile();
+        mesh->data->vertices.reset_used(0);
+        mesh->data->vertex_normals.reset_used(0);
+        mesh->data->vertex_tex_coords.reset_used(0);
+        mesh->data->faces.reset_used(0);
+        mesh->data->touch(VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_FACES);
         for (size_t face_iterator = 0; face_iterator < (*p)->data->faces.size(); face_iterator++)
         {
           vsx_vector a,b,c,ab,ac;
@@ -1417,27 +1320,12 @@ public:
         v_ex_p++;
         v_ez_p++;
       }
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       param_updates = 0;
     } else
     {
-      mesh->data->vertices.set_volatile();
-      mesh->data->vertices.set_data((*p)->data->vertices.get_pointer(), (*p)->data->vertices.size());
-
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
       mesh->timestamp = (*p)->timestamp;
     }
     mesh_out->set_p(mesh);
@@ -1583,8 +1471,9 @@ public:
       {
         vsx_vector* ndap = normals_dist_array.get_pointer();
         vsx_vector* vnp = (*p)->data->vertex_normals.get_pointer();
-        mesh->data->vertex_normals.unset_volatile();
+        mesh->data->vertex_normals.reset_used(0);
         mesh->data->vertex_normals.allocate( (*p)->data->vertex_normals.size() );
+        mesh->data->vertex_normals.reset_used( (*p)->data->vertex_normals.size() );
         vsx_vector* vnd = mesh->data->vertex_normals.get_pointer();
         for (unsigned int i = 0; i < (*p)->data->vertex_normals.size(); i++)
         {
@@ -1606,8 +1495,9 @@ public:
         v *= vertex_distortion_factor->get();
         vsx_vector* ndap = normals_dist_array.get_pointer();
         vsx_vector* vp = (*p)->data->vertices.get_pointer();
-        mesh->data->vertices.unset_volatile();
+        mesh->data->vertices.reset_used(0);
         mesh->data->vertices.allocate( (*p)->data->vertices.size() );
+        mesh->data->vertices.reset_used( (*p)->data->vertices.size() );
         vsx_vector* vd = mesh->data->vertices.get_pointer();
 
         for (unsigned int i = 0; i < (*p)->data->vertices.size(); i++)
@@ -1625,28 +1515,16 @@ public:
           vertex_transform_enabled = true;
       }
       {
-        if (!vertex_transform_enabled)
-        {
-          mesh->data->vertices.set_volatile();
-          mesh->data->vertices.set_data((*p)->data->vertices.get_pointer(), (*p)->data->vertices.size());
-        }
-        if (!normal_transform_enabled)
-        {
-          mesh->data->vertex_normals.set_volatile();
-          mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-        }
-
-        mesh->data->vertex_tex_coords.set_volatile();
-        mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-        mesh->data->vertex_tangents.set_volatile();
-        mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-        mesh->data->vertex_colors.set_volatile();
-        mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-        mesh->data->faces.set_volatile();
-        mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+        if (vertex_transform_enabled)
+          mesh->data->touch(VSX_MESH_VERTICES);
+        else
+          mesh->data->share((*p)->data, VSX_MESH_VERTICES);
+        if (normal_transform_enabled)
+          mesh->data->touch(VSX_MESH_VERTEX_NORMALS);
+        else
+          mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS);
+
+        mesh->data->share((*p)->data, VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
       }
       
       mesh->timestamp++;
@@ -1693,93 +1571,51 @@ public:
     tangents = (vsx_module_param_quaternion_array*)out_parameters.create(VSX_MODULE_PARAM_ID_QUATERNION_ARRAY,"tangents");
     i_tangents.data = &data;
     tangents->set_p(i_tangents);
+    prev_vertices = prev_normals = prev_tex_coords = prev_faces = 0;
+  }
+  // stamps of the streams the tangents were computed from
+  size_t prev_vertices;
+  size_t prev_normals;
+  size_t prev_tex_coords;
+  size_t prev_faces;
+  vsx_mesh_attributes attributes;
+
+  // stamped and the same as last time, or empty both times
+  template<class T>
+  bool unchanged(vsx_array<T>& a, size_t prev)
+  {
+    if (!a.size())
+      return prev == 0;
+    return a.timestamp && a.timestamp == prev;
   }
-  unsigned long prev_timestamp;
-  vsx_vector v;
+
   void run() {
     vsx_mesh** p = mesh_in->get_addr();
-    if (p /*&& (prev_timestamp != (*p)->timestamp)*/ ) {
-      prev_timestamp = (*p)->timestamp;
-
+    if (!p)
+      return;
+    vsx_mesh_data* d = (*p)->data;
 
-      if ((*p)->data->vertex_tangents.size())
-      {
-        i_tangents.data = &(*p)->data->vertex_tangents;
-      }
-      else
-      {
-        //printf("calculating tangents\n");
-      //void CalculateTangentArray(long vertexCount, const Point3D *vertex, const Vector3D *normal,
-              //const Point2D *texcoord, long triangleCount, const Triangle *triangle, Vector4D *tangent)
-      //{
-          //Vector3D *tan1 = new Vector3D[vertexCount * 2];
-          //Vector3D *tan2 = tan1 + vertexCount;
-//          ClearMemory(tan1, vertexCount * sizeof(Vector3D) * 2);
-
-      data.allocate((*p)->data->vertices.size());
-      data.reset_used((*p)->data->vertices.size());
-      data.memory_clear();
-      vsx_quaternion* vec_d = data.get_pointer();
-
-/*          for (unsigned long i = 0; i < (*p)->data->vertices.size(); i++) {
-            data[i].x = 0;
-            data[i].y = 0;
-            data[i].z = 0;
-          }
-*/
-          for (unsigned long a = 0; a < (*p)->data->faces.size(); a++)
-          {
-            long i1 = (*p)->data->faces[a].a;
-            long i2 = (*p)->data->faces[a].b;
-            long i3 = (*p)->data->faces[a].c;
-
-            const vsx_vector& v1 = (*p)->data->vertices[i1];
-            const vsx_vector& v2 = (*p)->data->vertices[i2];
-            const vsx_vector& v3 = (*p)->data->vertices[i3];
-
-            const vsx_tex_coord& w1 = (*p)->data->vertex_tex_coords[i1];
-            const vsx_tex_coord& w2 = (*p)->data->vertex_tex_coords[i2];
-            const vsx_tex_coord& w3 = (*p)->data->vertex_tex_coords[i3];
-
-            float x1 = v2.x - v1.x;
-            float x2 = v3.x - v1.x;
-            float y1 = v2.y - v1.y;
-            float y2 = v3.y - v1.y;
-            float z1 = v2.z - v1.z;
-            float z2 = v3.z - v1.z;
-
-            float s1 = w2.s - w1.s;
-            float s2 = w3.s - w1.s;
-            float t1 = w2.t - w1.t;
-            float t2 = w3.t - w1.t;
-
-            float r = 1.0f / (s1 * t2 - s2 * t1);
-            vsx_quaternion sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-            //vsx_vector sdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r,(s1 * z2 - s2 * z1) * r);
-
-            vec_d[i1] += sdir;
-            vec_d[i2] += sdir;
-            vec_d[i3] += sdir;
-
-            //tan2[i1] += tdir;
-            //tan2[i2] += tdir;
-            //tan2[i3] += tdir;
-          }
-          for (unsigned long a = 0; a < data.size(); a++)
-          {
-              vsx_vector& n = (*p)->data->vertex_normals[a];
-              vsx_quaternion& t = vec_d[a];
+    if (d->vertex_tangents.size())
+    {
+      i_tangents.data = &d->vertex_tangents;
+      return;
+    }
+    i_tangents.data = &data;
 
-              // Gram-Schmidt orthogonalize
-              //vec_d[a] = (t - n * t.dot_product(&n) );
-              vec_d[a] = (t - n * t.dot_product(&n) );
-              vec_d[a].normalize();
+    if (
+      unchanged(d->vertices, prev_vertices) &&
+      unchanged(d->vertex_normals, prev_normals) &&
+      unchanged(d->vertex_tex_coords, prev_tex_coords) &&
+      unchanged(d->faces, prev_faces) &&
+      data.size() == d->vertices.size()
+    )
+      return;
+    prev_vertices = d->vertices.size() ? d->vertices.timestamp : 0;
+    prev_normals = d->vertex_normals.size() ? d->vertex_normals.timestamp : 0;
+    prev_tex_coords = d->vertex_tex_coords.size() ? d->vertex_tex_coords.timestamp : 0;
+    prev_faces = d->faces.size() ? d->faces.timestamp : 0;
 
-              // Calculate handedness
-              //tangent[a].w = (Dot(Cross(n, t), tan2[a]) < 0.0F) ? -1.0F : 1.0F;
-          }
-      }
-    }
+    attributes.calculate_tangents(d, data);
   }
 };
 
@@ -2027,9 +1863,17 @@ public:
 
 // mesh inflation by CoR
 // optimized 2010-01 by jaw
-
-#define printVector(a,b,c)
-#define printFloat(a,b,c)
+//
+// The simulation runs as a thread pool job, iterations_per_frame steps per
+// batch. run() never waits for it: it hands over a batch when the job is
+// idle and picks up the result when one is done. The job steps its own
+// copy of the mesh (sim) and writes vertices/normals into the back one of
+// two output meshes; run() swaps that in and shares the streams passed
+// through (faces, tex coords, colors, tangents) from sim. A new input mesh
+// is copied on arrival and swapped in as sim at the next handover, so the
+// simulation carries on toward rest across frames whatever the frame rate.
+
+#define INFLATE_PASSED_STREAMS (VSX_MESH_FACES | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_COLORS | VSX_MESH_VERTEX_TANGENTS)
 
 class vsx_module_mesh_inflate : public vsx_module {
   // in
@@ -2042,39 +1886,71 @@ class vsx_module_mesh_inflate : public vsx_module {
   vsx_module_param_float* damping_factor;
   vsx_module_param_float* material_weight;
   vsx_module_param_float* lower_boundary;
+  vsx_module_param_float* iterations_per_frame;
   // out
   vsx_module_param_mesh* mesh_out;
   vsx_module_param_float* volume_out;
   // internal
-  vsx_mesh* mesh;
+  vsx_mesh* mesh[2]; // output, mesh[front] is the published one
+  int front;
+  unsigned long out_timestamp;
+
+  // latest input, waiting to be handed to the job
+  vsx_mesh_data* input;
+  bool input_pending;
+
+  // owned by the job while it runs
+  vsx_mesh_data* sim;
   vsx_array<vsx_vector> faceLengths;
-  vsx_array<float> faceAreas;
   vsx_array<vsx_vector> verticesSpeed;
 
-  bool debug;
+  // parameters of the batch, written by run() before starting it
+  struct {
+    float step_size;
+    float gas_amount;
+    float gas_expansion_factor;
+    float grid_stiffness_factor;
+    float damping_factor;
+    float material_weight;
+    float lower_boundary;
+    int iterations;
+    bool new_mesh;
+  } work;
+
+  // results of the batch
+  float volume;
+  bool volume_is_initial;
+
+  vsx_background_job work_job;
+
 public:
   bool init() {
-    mesh = new vsx_mesh;
+    mesh[0] = new vsx_mesh;
+    mesh[1] = new vsx_mesh;
+    front = 0;
+    out_timestamp = mesh[0]->timestamp;
+    input = new vsx_mesh_data;
+    input_pending = false;
+    sim = new vsx_mesh_data;
+    volume = 0.0f;
+    volume_is_initial = false;
     return true;
   }
 
   void on_delete()
   {
-    delete mesh;
-  }
-  
-  void _printVector(const char* name, int faceInd, vsx_vector vec) {
-    if(debug) printf("%d %s: %f %f %f \n", faceInd, name, vec.x, vec.y, vec.z);
-  }
-  void _printFloat(const char* name, int faceInd, float f) {
-    if(debug) printf("%d %s: %f \n", faceInd, name, f);
+    // the job works on our buffers, let it finish
+    work_job.wait();
+    delete mesh[0];
+    delete mesh[1];
+    delete input;
+    delete sim;
   }
 
-
   void module_info(vsx_module_info* info)
   {
     info->identifier = "mesh;modifiers;deformers;mesh_inflate";
-    info->description = "Inflates a mesh";
+    info->description = "Inflates a mesh\n\nThe simulation runs in the background,\niterations_per_frame steps at a time.";
     info->in_param_spec = "mesh_in:mesh,"
               "steps_per_second:float,"
               "step_size:float,"
@@ -2083,7 +1959,8 @@ public:
               "grid_stiffness_factor:float,"
               "damping_factor:float,"
               "material_weight:float,"
-              "lower_boundary:float";
+              "lower_boundary:float,"
+              "iterations_per_frame:float?min=1";
 
     info->out_param_spec = "mesh_out:mesh,volume_out:float";
     info->component_class = "mesh";
@@ -2101,6 +1978,7 @@ public:
     damping_factor = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "damping_factor");
     material_weight = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "material_weight");
     lower_boundary = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "lower_boundary");
+    iterations_per_frame = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "iterations_per_frame");
 
 
     steps_per_second->set(100.0f);
@@ -2111,6 +1989,7 @@ public:
     damping_factor->set(0.98f);
     material_weight->set(0.00f);
     lower_boundary->set(-150.00f);
+    iterations_per_frame->set(1.0f);
 
 
     loading_done = true;
@@ -2121,182 +2000,99 @@ public:
   }
 
   unsigned long prev_timestamp;
-  vsx_vector v;
-  float dtimeRest;
 
-  void run() {
-    vsx_mesh** p = mesh_in->get_addr();
-    if (!p) 
+  // a new sim mesh: zero speeds, store the rest lengths of the edges
+  void sim_start()
+  {
+    verticesSpeed.reset_used(0);
+    if (sim->vertices.size())
     {
-      return;
+      verticesSpeed.allocate(sim->vertices.size() - 1);
+      verticesSpeed.memory_clear();
     }
 
-    debug = false;
-    bool newMeshLoaded = false;
-
-
-    //after a mesh change clone the mesh
-    if (p && (prev_timestamp != (*p)->timestamp)) {
-      prev_timestamp = (*p)->timestamp;
-      mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
-
-      for (unsigned int i = 0; i < (*p)->data->vertices.size(); i++)
-      {
-        mesh->data->vertices[i] = (*p)->data->vertices[i] + v;
-        verticesSpeed[i] = vsx_vector(0, 0, 0);
-      }
-
-      for (unsigned int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_tangents.size(); i++) mesh->data->vertex_tangents[i] = (*p)->data->vertex_tangents[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_tex_coords.size(); i++) mesh->data->vertex_tex_coords[i] = (*p)->data->vertex_tex_coords[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
-      for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
-      for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
-
-      //calc and store original face lengths
-      faceLengths.reset_used();
-     	vsx_vector normal;
-     	vsx_vector len;
-     	vsx_vector hypVec;
-      for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) {
-      	vsx_face& f = mesh->data->faces[i];
-      	vsx_vector& v0 = mesh->data->vertices[f.a];
-      	vsx_vector& v1 = mesh->data->vertices[f.b];
-      	vsx_vector& v2 = mesh->data->vertices[f.c];
-      	//calc face area
-        normal.assign_face_normal(&v0, &v1, &v2);
-        float area = normal.length() / 2.0f;
-        faceAreas[i] = area;
-        //facelengths a, b, c stored in vector x, y, z
-        len.x = (v1 - v0).length();
-        len.y = (v2 - v1).length();
-        len.z = (v0 - v2).length();
-        faceLengths.push_back(len);
-      }
-      mesh->timestamp++;
-      param_updates = 0;
-
-      newMeshLoaded = true;
-      dtimeRest = 0.0f;
+    faceLengths.reset_used(0);
+    vsx_face* face_p = sim->faces.get_pointer();
+    vsx_vector* vertex_p = sim->vertices.get_pointer();
+    vsx_vector len;
+    for (unsigned int i = 0; i < sim->faces.size(); i++) {
+      vsx_vector& v0 = vertex_p[face_p[i].a];
+      vsx_vector& v1 = vertex_p[face_p[i].b];
+      vsx_vector& v2 = vertex_p[face_p[i].c];
+      //facelengths a, b, c stored in vector x, y, z
+      len.x = (v1 - v0).length();
+      len.y = (v2 - v1).length();
+      len.z = (v0 - v2).length();
+      faceLengths.push_back(len);
     }
+  }
 
-    float stepSize = step_size->get();
-    //float stepsPerSecond = steps_per_second->get();
-    float gasExpansionFactor = gas_expansion_factor->get();
-    float gridStiffnessFactor = grid_stiffness_factor->get();
-    float dampingFactor =  damping_factor->get();
-    float materialWeight = material_weight->get();
-    float lowerBoundary = lower_boundary->get();
-
-    //use engine->dtime; and dtimeRest
-    //to repeat the calculation several times ((dtime + rest) * stepsPerSecond)
-
-
-
-    //calculate volume
-    float volume = 0.0f;
-    vsx_face* face_p = mesh->data->faces.get_pointer();
-    vsx_vector* vertex_p = mesh->data->vertices.get_pointer();
+  // one simulation step on sim, returns the volume before the step
+  float sim_step(float gas)
+  {
+    float stepSize = work.step_size;
+    float gasExpansionFactor = work.gas_expansion_factor;
+    float gridStiffnessFactor = work.grid_stiffness_factor;
+    float dampingFactor = work.damping_factor;
+    float materialWeight = work.material_weight;
+    float lowerBoundary = work.lower_boundary;
+
+    vsx_face* face_p = sim->faces.get_pointer();
+    vsx_vector* vertex_p = sim->vertices.get_pointer();
     vsx_vector* faces_length_p = faceLengths.get_pointer();
-
-    verticesSpeed.allocate(mesh->data->vertices.size());
     vsx_vector* vertices_speed_p = verticesSpeed.get_pointer();
 
+    //calculate volume
+    float volume = 0.0f;
     float onedivsix = (1.0f / 6.0f);
-    for(unsigned int i = 0; i < mesh->data->faces.size(); i++) {
-    	vsx_face& f = face_p[i];//mesh->data->faces[i];
-    	vsx_vector& v0 = vertex_p[f.a];
-    	vsx_vector& v2 = vertex_p[f.b];
-    	vsx_vector& v1 = vertex_p[f.c];
+    for(unsigned int i = 0; i < sim->faces.size(); i++) {
+      vsx_face& f = face_p[i];
+      vsx_vector& v0 = vertex_p[f.a];
+      vsx_vector& v2 = vertex_p[f.b];
+      vsx_vector& v1 = vertex_p[f.c];
 
       volume += (v0.x * (v1.y - v2.y) +
            v1.x * (v2.y - v0.y) +
            v2.x * (v0.y - v1.y)) * (v0.z + v1.z + v2.z) * onedivsix;
-
     }
 
     //default gas_amount to volume of a new mesh i.e. no pressure
-    if(newMeshLoaded) {
-      gas_amount->set(volume);
-    }
-    float pressure = (gas_amount->get() - volume) / volume;
-
-    //mesh->data->face_normals.reset_used(0);
-    //mesh->data->vertex_normals.reset_used(0);
-
-
-    //calculate face areas, normals, forces and add to speed
-    for(unsigned int i = 0; i < mesh->data->faces.size(); i++) {
-    	vsx_face& f = face_p[i];//mesh->data->faces[i];
-    	vsx_vector& v0 = vertex_p[f.a];//mesh->data->vertices[f.a];
-    	vsx_vector& v1 = vertex_p[f.b];//mesh->data->vertices[f.b];
-    	vsx_vector& v2 = vertex_p[f.c];//mesh->data->vertices[f.c];
-
-              printVector("v0", i, v0);
-              printVector("v1", i, v1);
-              printVector("v2", i, v2);
-
-    	//vsx_vector normal = mesh->data->get_face_normal(i);
-      vsx_vector a = vertex_p[face_p[i].b] - vertex_p[face_p[i].a];
-      vsx_vector b = vertex_p[face_p[i].c] - vertex_p[face_p[i].a];
+    if (gas < 0.0f)
+      gas = volume;
+    float pressure = (gas - volume) / volume;
+
+    //calculate face normals, forces and add to speed
+    for(unsigned int i = 0; i < sim->faces.size(); i++) {
+      vsx_face& f = face_p[i];
+      vsx_vector& v0 = vertex_p[f.a];
+      vsx_vector& v1 = vertex_p[f.b];
+      vsx_vector& v2 = vertex_p[f.c];
+
+      vsx_vector a = v1 - v0;
+      vsx_vector b = v2 - v0;
       vsx_vector normal;
       normal.cross(a,b);
 
-
-
-              printVector("normal", i, normal);
-
-      //float len = normal.length();
-      //float area = len / 2;
-
-              printFloat("length", i, len);
-              printFloat("area", i, len);
-
       vsx_vector edgeA = (v1 - v0);
       vsx_vector edgeB = (v2 - v1);
       vsx_vector edgeC = (v0 - v2);
 
-              printVector("edgeA", i, edgeA);
-              printVector("edgeB", i, edgeB);
-              printVector("edgeC", i, edgeC);
-
       float lenA = edgeA.length();
       float lenB = edgeB.length();
       float lenC = edgeC.length();
 
-              printFloat("lenA", i, lenA);
-              printFloat("lenB", i, lenB);
-              printFloat("lenC", i, lenC);
-
-
       float edgeForceA = (faces_length_p[i].x - lenA) / faces_length_p[i].x;
       float edgeForceB = (faces_length_p[i].y - lenB) / faces_length_p[i].y;
       float edgeForceC = (faces_length_p[i].z - lenC) / faces_length_p[i].z;
 
-              printFloat("edgeForceA", i, edgeForceA);
-              printFloat("edgeForceB", i, edgeForceB);
-              printFloat("edgeForceC", i, edgeForceC);
-
       float edgeAccA = edgeForceA / lenA;
       float edgeAccB = edgeForceB / lenB;
       float edgeAccC = edgeForceC / lenC;
 
-              printFloat("edgeAccA", i, edgeAccA);
-              printFloat("edgeAccB", i, edgeAccB);
-              printFloat("edgeAccC", i, edgeAccC);
-
       vsx_vector accA = edgeA * edgeAccA;
       vsx_vector accB = edgeB * edgeAccB;
       vsx_vector accC = edgeC * edgeAccC;
 
-              printVector("accA", i, accA);
-              printVector("accB", i, accB);
-              printVector("accC", i, accC);
-
       vertices_speed_p[f.a] -= (accA - accC) * gridStiffnessFactor;
       vertices_speed_p[f.b] -= (accB - accA) * gridStiffnessFactor;
       vertices_speed_p[f.c] -= (accC - accB) * gridStiffnessFactor;
@@ -2311,64 +2107,136 @@ public:
       vertices_speed_p[f.a].y -= materialWeight;
       vertices_speed_p[f.b].y -= materialWeight;
       vertices_speed_p[f.c].y -= materialWeight;
-
     }
 
     //apply speeds to vertices
-    for(unsigned int i = 0; i < mesh->data->vertices.size(); i++) {
+    for(unsigned int i = 0; i < sim->vertices.size(); i++) {
       vertex_p[i] += vertices_speed_p[i] * stepSize;
       if(vertex_p[i].y < lowerBoundary) {
         vertex_p[i].y = lowerBoundary;
       }
       vertices_speed_p[i] = vertices_speed_p[i] * dampingFactor;
     }
+    return volume;
+  }
 
-
-    mesh->data->vertex_normals.allocate(mesh->data->vertices.size());
-    mesh->data->vertex_normals.memory_clear();
-    vsx_vector* vertex_normals_p = mesh->data->vertex_normals.get_pointer();
-    /*for(unsigned int i = 0; i < mesh->data->vertices.size(); i++) {
-      mesh->data->vertex_normals[i] = vsx_vector(0, 0, 0);
-    }*/
-
-    //TODO: create vertex normals, for rendering... should be a separate module...
-    for(unsigned int i = 0; i < mesh->data->faces.size(); i++) {
+  // sim vertices and their normals into the back output mesh
+  void sim_publish()
+  {
+    vsx_mesh_data* d = mesh[front ^ 1]->data;
+    d->vertices.clone(&sim->vertices);
+
+    // may still be shared with a reader of the previous frame
+    d->vertex_normals.reset_used(0);
+    d->vertex_normals.allocate(d->vertices.size());
+    d->vertex_normals.memory_clear();
+    d->vertex_normals.reset_used(d->vertices.size());
+
+    vsx_face* face_p = sim->faces.get_pointer();
+    vsx_vector* vertex_p = d->vertices.get_pointer();
+    vsx_vector* vertex_normals_p = d->vertex_normals.get_pointer();
+    for(unsigned int i = 0; i < sim->faces.size(); i++) {
       vsx_vector a = vertex_p[face_p[i].b] - vertex_p[face_p[i].a];
       vsx_vector b = vertex_p[face_p[i].c] - vertex_p[face_p[i].a];
       vsx_vector normal;
       normal.cross(a,b);
+      normal = -normal;
+      normal.normalize();
+      vertex_normals_p[face_p[i].a] += normal;
+      vertex_normals_p[face_p[i].b] += normal;
+      vertex_normals_p[face_p[i].c] += normal;
+    }
+    d->touch(VSX_MESH_VERTICES | VSX_MESH_VERTEX_NORMALS);
+  }
 
-    	//vsx_vector normal = mesh->data->get_face_normal(i);
-    	normal = -normal;
-    	normal.normalize();
-    	vertex_normals_p[face_p[i].a] += normal;
-    	vertex_normals_p[face_p[i].b] += normal;
-    	vertex_normals_p[face_p[i].c] += normal;
+  static void inflate_job(void* arg)
+  {
+    vsx_module_mesh_inflate* m = (vsx_module_mesh_inflate*)arg;
+    float gas = m->work.gas_amount;
+    m->volume_is_initial = false;
+    if (m->work.new_mesh)
+    {
+      m->sim_start();
+      gas = -1.0f;
+    }
+    for (int i = 0; i < m->work.iterations; i++)
+    {
+      float v = m->sim_step(gas);
+      if (gas < 0.0f)
+      {
+        // the gas amount the new mesh starts with, run() stores it
+        gas = v;
+        m->volume_is_initial = true;
+      }
+      m->volume = v;
     }
+    m->sim_publish();
+  }
 
-    volume_out->set(volume);
+  void run() {
+    vsx_mesh** p = mesh_in->get_addr();
+    if (!p)
+    {
+      return;
+    }
 
-    //printf("***************Pressure %f     ", pressure);
-    //printf(" Volume %f\n", volume);
+    //after a mesh change copy the mesh, the job gets it when it's idle
+    if (prev_timestamp != (*p)->timestamp) {
+      prev_timestamp = (*p)->timestamp;
+      vsx_mesh_data* s = (*p)->data;
+      input->vertices.clone(&s->vertices);
+      input->vertex_tangents.clone(&s->vertex_tangents);
+      input->vertex_tex_coords.clone(&s->vertex_tex_coords);
+      input->vertex_colors.clone(&s->vertex_colors);
+      input->faces.clone(&s->faces);
+      input->touch(VSX_MESH_ALL);
+      input_pending = true;
+      param_updates = 0;
+    }
 
-    mesh_out->set_p(mesh);
-  }
-};
+    if (work_job.working())
+      return;
 
-#undef printVector
-#undef printFloat
+    if (work_job.collect())
+    {
+      front ^= 1;
+      mesh[front]->data->share(sim, INFLATE_PASSED_STREAMS);
+      mesh[front]->timestamp = ++out_timestamp;
+      mesh_out->set_p(mesh[front]);
+      if (volume_is_initial)
+        gas_amount->set(volume);
+      volume_out->set(volume);
+    }
 
+    work.new_mesh = input_pending;
+    if (input_pending)
+    {
+      vsx_mesh_data* t = sim;
+      sim = input;
+      input = t;
+      input_pending = false;
+    }
+    if (!sim->vertices.size() || !sim->faces.size())
+      return;
 
+    work.step_size = step_size->get();
+    work.gas_amount = gas_amount->get();
+    work.gas_expansion_factor = gas_expansion_factor->get();
+    work.grid_stiffness_factor = grid_stiffness_factor->get();
+    work.damping_factor = damping_factor->get();
+    work.material_weight = material_weight->get();
+    work.lower_boundary = lower_boundary->get();
+    work.iterations = (int)iterations_per_frame->get();
+    if (work.iterations < 1)
+      work.iterations = 1;
 
-class vertex_holder {
-public:
-  float dist;
-  int id;
-  bool operator < (const vertex_holder& a) {
-      return dist > a.dist;
+    work_job.start(&inflate_job, (void*)this);
   }
 };
 
+
+
+
 class vsx_module_mesh_vertex_distance_sort : public vsx_module {
   // in
   vsx_module_param_mesh* mesh_in;
@@ -2378,96 +2246,12 @@ class vsx_module_mesh_vertex_distance_sort : public vsx_module {
   vsx_module_param_float_array* original_ids;
   // internal
   vsx_mesh* mesh;
-  vsx_array<vertex_holder*> distances;
+  vsx_array<unsigned int> order;
 
   // previous id maintanence
   vsx_float_array i_ids;
   vsx_array<float> ids_data;
 
-  //*******************************************************************************
-  //*******************************************************************************
-  //*******************************************************************************
-  //*******************************************************************************
-
-  // fast square root routine from nvidia
-  
-  #define FP_BITS(fp) (*(unsigned int *)&(fp))
-
-  unsigned int fast_sqrt_table[0x10000];  // declare table of square roots
-
-  typedef union FastSqrtUnion
-  {
-    float f;
-    unsigned int i;
-  } FastSqrtUnion;
-
-  void  build_sqrt_table()
-  {
-    unsigned int i;
-    FastSqrtUnion s;
-
-    for (i = 0; i <= 0x7FFF; i++)
-    {
-
-      // Build a float with the bit pattern i as mantissa
-      //  and an exponent of 0, stored as 127
-
-      s.i = (i << 8) | (0x7F << 23);
-      s.f = (float)sqrt(s.f);
-
-      // Take the square root then strip the first 7 bits of
-      //  the mantissa into the table
-
-      fast_sqrt_table[i + 0x8000] = (s.i & 0x7FFFFF);
-
-      // Repeat the process, this time with an exponent of 1,
-      //  stored as 128
-
-      s.i = (i << 8) | (0x80 << 23);
-      s.f = (float)sqrt(s.f);
-
-      fast_sqrt_table[i] = (s.i & 0x7FFFFF);
-    }
-  }
-
-  inline float fastsqrt(float n)
-  {
-    if (FP_BITS(n) == 0)
-      return 0.0;                 // check for square root of 0
-
-    FP_BITS(n) = fast_sqrt_table[(FP_BITS(n) >> 8) & 0xFFFF] | ((((FP_BITS(n) - 0x3F800000) >> 1) + 0x3F800000) & 0x7F800000);
-
-    return n;
-  }
-  
-  void quicksort(vertex_holder** a, int left, int right) {
-      int i = left, j = right;
-      vertex_holder *tmp;
-      float pivot = a[(left + right) / 2]->dist;
-
-      /* partition */
-      while (i <= j) {
-            while (a[i]->dist < pivot)
-                  i++;
-            while (a[j]->dist > pivot)
-                  j--;
-            if (i <= j) {
-                  tmp = a[i];
-                  a[i] = a[j];
-                  a[j] = tmp;
-                  i++;
-                  j--;
-            }
-      };
-
-      /* recursion */
-      if (left < j)
-            quicksort(a, left, j);
-      if (i < right)
-            quicksort(a, i, right);
-}
-  
-
 public:
 
   bool init() {
@@ -2477,7 +2261,6 @@ public:
 
   void on_delete()
   {
-    // clear out the distances list
     delete mesh;
   }
 
@@ -2500,8 +2283,6 @@ public:
     original_ids = (vsx_module_param_float_array*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT_ARRAY,"original_ids");
     i_ids.data = &ids_data;
     original_ids->set_p(i_ids);
-    
-    build_sqrt_table();
   }
 
 
@@ -2514,57 +2295,26 @@ public:
       if (!(*p)->data->vertices.size()) return;
       // if new mesh from upstream, import it into ours...
       //---
-      float dtx = distance_to->get(0);
-      float dty = distance_to->get(1);
-      float dtz = distance_to->get(2);
-      //---
-      //  init pointer iterators
+      vsx_vector point(distance_to->get(0), distance_to->get(1), distance_to->get(2));
       size_t vertex_count = (*p)->data->vertices.size();
-      //printf("distances arreay size: %d      mesh data size: %d\n", distances.size(), vertex_count);
-      if (distances.size() < vertex_count)
-      {
-        #ifdef VSXU_DEBUG
-        printf("allocating more memory for vertex holders...\n");
-        #endif
-        distances.allocate(vertex_count-1);
-        for (size_t i = 0; i < vertex_count; i++)
-        {
-          distances[i] = new vertex_holder;
-        }
-      }
-      //-----------------------------------------------------------
-      vertex_holder** vf = distances.get_pointer();
-      vsx_vector* vp = (*p)->data->vertices.get_pointer();
-      //
-      
-      for (unsigned int i = 0; i < (*p)->data->vertices.size(); i++)
-      {
-        float x = fabs(dtx - (*vp).x);
-        float y = fabs(dty - (*vp).y);
-        float z = fabs(dtz - (*vp).z);
-        // yo pythagoras!
-        (*vf)->dist = sqrtf(x*x + y*y + z*z);
-        (*vf)->id = i;
-        vf++;
-        vp++;
-      }
-      // sort the arrays
-      quicksort(distances.get_pointer(),0,vertex_count-1);
-      // put it back into our private mesh, payload order is calculated by id
-      mesh->data->vertices.allocate(vertex_count);
-      vertex_holder** ddp = distances.get_pointer();
+      // nearest first, from the index shared by everyone reading this mesh
+      vsx_mesh_spatial::get(*p)->sorted(point, order);
+      // put it back into our private mesh, farthest first
+      mesh->data->vertices.reset_used(0);
+      mesh->data->vertices.allocate(vertex_count - 1);
+      ids_data.reset_used(0);
+      ids_data.allocate(vertex_count - 1);
+      const unsigned int* op = order.get_pointer();
       vsx_vector* dp = mesh->data->vertices.get_end_pointer();
       vsx_vector* ds = (*p)->data->vertices.get_pointer();
-      size_t i = 0;
-      while (i < vertex_count)
+      float* ip = ids_data.get_pointer();
+      for (size_t i = 0; i < vertex_count; i++)
       {
-        //printf("id: %d  %f\n", (*ddp)->id,(*ddp)->dist);
-        *dp = ds[(*ddp)->id];
-        ids_data[i] = (float)(*ddp)->id;
+        *dp = ds[op[i]];
+        ip[i] = (float)op[i];
         dp--;
-        ddp++;
-        i++;
       }
+      mesh->data->touch(VSX_MESH_VERTICES);
       // finally set output params
       mesh->timestamp++;
       mesh_out->set_p(mesh);
@@ -2632,10 +2382,6 @@ public:
       am.y = amount->get(1);
       am.z = amount->get(2);
       mesh->data->vertices.reset_used(0);
-      mesh->data->vertex_normals.reset_used(0);
-      mesh->data->vertex_tex_coords.reset_used(0);
-      mesh->data->vertex_colors.reset_used(0);
-      mesh->data->faces.reset_used(0);
 
       unsigned long end = (*p)->data->vertices.size();
       vsx_vector* vs_p = &(*p)->data->vertices[0];
@@ -2671,20 +2417,7 @@ public:
 
       //if (prev_timestamp != (*p)->timestamp)
       //{
-      mesh->data->vertex_normals.set_volatile();
-      mesh->data->vertex_normals.set_data((*p)->data->vertex_normals.get_pointer(), (*p)->data->vertex_normals.size());
-
-      mesh->data->vertex_tex_coords.set_volatile();
-      mesh->data->vertex_tex_coords.set_data((*p)->data->vertex_tex_coords.get_pointer(), (*p)->data->vertex_tex_coords.size());
-
-      mesh->data->vertex_tangents.set_volatile();
-      mesh->data->vertex_tangents.set_data((*p)->data->vertex_tangents.get_pointer(), (*p)->data->vertex_tangents.size());
-
-      mesh->data->vertex_colors.set_volatile();
-      mesh->data->vertex_colors.set_data((*p)->data->vertex_colors.get_pointer(), (*p)->data->vertex_colors.size());
-
-      mesh->data->faces.set_volatile();
-      mesh->data->faces.set_data((*p)->data->faces.get_pointer(), (*p)->data->faces.size());
+      mesh->data->share((*p)->data, VSX_MESH_VERTEX_NORMALS | VSX_MESH_VERTEX_TEX_COORDS | VSX_MESH_VERTEX_TANGENTS | VSX_MESH_VERTEX_COLORS | VSX_MESH_FACES);
 //      }
 
 
@@ -2694,6 +2427,7 @@ public:
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
       //for (unsigned int i = 0; i < (*p)->data->vertex_colors.size(); i++) mesh->data->vertex_colors[i] = (*p)->data->vertex_colors[i];
       //for (unsigned int i = 0; i < (*p)->data->faces.size(); i++) mesh->data->faces[i] = (*p)->data->faces[i];
+      mesh->data->touch(VSX_MESH_VERTICES);
       mesh->timestamp++;
       mesh_out->set_p(mesh);
       //for (int i = 0; i < (*p)->data->vertex_normals.size(); i++) mesh->data->vertex_normals[i] = (*p)->data->vertex_normals[i];
@@ -2704,6 +2438,200 @@ public:
 
 
 
+// Decimates the input mesh in a background job (see mesh_simplify.h) and
+// keeps the results until the input or the settings change. Up to 4
+// levels of detail, each reduced by ratio from the one before; which one
+// goes out is picked by lod_distance / lod_range. Until the first result
+// is ready the input is passed through.
+
+#define SIMPLIFY_MAX_LEVELS 4
+
+class vsx_module_mesh_simplify : public vsx_module {
+  // in
+  vsx_module_param_mesh* mesh_in;
+  vsx_module_param_float* ratio;
+  vsx_module_param_float* max_error;
+  vsx_module_param_int* lod_levels;
+  vsx_module_param_float* lod_distance;
+  vsx_module_param_float* lod_range;
+  // out
+  vsx_module_param_mesh* mesh_out;
+  vsx_module_param_float* faces_out;
+  // internal
+  vsx_mesh* lod[SIMPLIFY_MAX_LEVELS];
+  int levels_ready;
+
+  // what the job works on, set by run() before starting it
+  vsx_mesh_data* source;
+  vsx_mesh_data* result[SIMPLIFY_MAX_LEVELS];
+  int job_levels;
+  float job_ratio;
+  float job_max_error;
+  mesh_simplify simplify;
+  vsx_mesh_attributes attributes;
+
+  unsigned long prev_timestamp;
+  float prev_ratio;
+  float prev_max_error;
+  int prev_levels;
+  bool dirty;
+
+  vsx_background_job work_job;
+
+public:
+  bool init() {
+    for (int i = 0; i < SIMPLIFY_MAX_LEVELS; i++)
+    {
+      lod[i] = new vsx_mesh;
+      result[i] = new vsx_mesh_data;
+    }
+    levels_ready = 0;
+    source = new vsx_mesh_data;
+    prev_timestamp = 0xFFFFFFFF;
+    prev_ratio = prev_max_error = -1.0f;
+    prev_levels = -1;
+    dirty = false;
+    return true;
+  }
+
+  void on_delete()
+  {
+    work_job.wait();
+    for (int i = 0; i < SIMPLIFY_MAX_LEVELS; i++)
+    {
+      delete lod[i];
+      delete result[i];
+    }
+    delete source;
+  }
+
+  void module_info(vsx_module_info* info)
+  {
+    info->identifier = "mesh;modifiers;simplify";
+    info->description = "Reduces the face count of a mesh\n"
+                        "(quadric error edge collapse).\n"
+                        "ratio: faces kept per level\n"
+                        "max_error: largest collapse as a fraction\n"
+                        "  of the mesh size, 0 for no limit\n"
+                        "level = lod_distance / lod_range";
+    info->in_param_spec = "mesh_in:mesh,"
+              "ratio:float?min=0&max=1,"
+              "max_error:float?min=0,"
+              "lod:complex{"
+                "lod_levels:enum?1|2|3|4,"
+                "lod_distance:float,"
+                "lod_range:float"
+              "}";
+    info->out_param_spec = "mesh_out:mesh,faces_out:float";
+    info->component_class = "mesh";
+  }
+
+  void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
+  {
+    mesh_in = (vsx_module_param_mesh*)in_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh_in");
+    ratio = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "ratio");
+    ratio->set(0.5f);
+    max_error = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "max_error");
+    max_error->set(0.0f);
+    lod_levels = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT, "lod_levels");
+    lod_levels->set(0);
+    lod_distance = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "lod_distance");
+    lod_distance->set(0.0f);
+    lod_range = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT, "lod_range");
+    lod_range->set(10.0f);
+    loading_done = true;
+    mesh_out = (vsx_module_param_mesh*)out_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh_out");
+    faces_out = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"faces_out");
+    faces_out->set(0.0f);
+  }
+
+  static void simplify_job(void* arg)
+  {
+    vsx_module_mesh_simplify* m = (vsx_module_mesh_simplify*)arg;
+    bool normals = m->source->vertex_normals.size() != 0;
+    vsx_mesh_data* from = m->source;
+    float target = (float)from->faces.size();
+    for (int l = 0; l < m->job_levels; l++)
+    {
+      target *= m->job_ratio;
+      m->simplify.run(from, m->result[l], (size_t)target, m->job_max_error);
+      // the kept normals don't fit the coarser surface, redo them
+      if (normals)
+        m->attributes.calculate_vertex_normals(m->result[l]);
+      from = m->result[l];
+    }
+  }
+
+  void run() {
+    vsx_mesh** p = mesh_in->get_addr();
+    if (!p)
+      return;
+
+    // the lod selection doesn't need a new run
+    if (
+      prev_timestamp != (*p)->timestamp ||
+      prev_ratio != ratio->get() ||
+      prev_max_error != max_error->get() ||
+      prev_levels != lod_levels->get()
+    )
+    {
+      prev_timestamp = (*p)->timestamp;
+      prev_ratio = ratio->get();
+      prev_max_error = max_error->get();
+      prev_levels = lod_levels->get();
+      dirty = true;
+    }
+
+    if (work_job.collect())
+    {
+      for (int l = 0; l < job_levels; l++)
+      {
+        lod[l]->data->share(result[l], VSX_MESH_ALL);
+        lod[l]->timestamp++;
+      }
+      levels_ready = job_levels;
+    }
+
+    if (dirty && !work_job.busy())
+    {
+      dirty = false;
+      vsx_mesh_data* s = (*p)->data;
+      source->vertices.clone(&s->vertices);
+      source->vertex_normals.clone(&s->vertex_normals);
+      source->vertex_tex_coords.clone(&s->vertex_tex_coords);
+      source->vertex_colors.clone(&s->vertex_colors);
+      source->faces.clone(&s->faces);
+      job_levels = lod_levels->get() + 1;
+      if (job_levels < 1) job_levels = 1;
+      if (job_levels > SIMPLIFY_MAX_LEVELS) job_levels = SIMPLIFY_MAX_LEVELS;
+      job_ratio = ratio->get();
+      if (job_ratio < 0.0f) job_ratio = 0.0f;
+      if (job_ratio > 1.0f) job_ratio = 1.0f;
+      job_max_error = max_error->get();
+      work_job.start(&simplify_job, (void*)this);
+    }
+
+    if (!levels_ready)
+    {
+      mesh_out->set_p(*p);
+      faces_out->set((float)(*p)->data->faces.size());
+      return;
+    }
+
+    int level = 0;
+    if (lod_range->get() > 0.0f)
+    {
+      float l = lod_distance->get() / lod_range->get();
+      if (l > 0.0f)
+        level = l < (float)levels_ready ? (int)l : levels_ready - 1;
+    }
+    mesh_out->set_p(lod[level]);
+    faces_out->set((float)lod[level]->data->faces.size());
+  }
+};
+
+
+
 //******************************************************************************
 //*** F A C T O R Y ************************************************************
 //******************************************************************************
@@ -2742,6 +2670,7 @@ vsx_module* create_new_module(unsigned long module, void* args)
     case 15: return (vsx_module*)(new vsx_module_mesh_translate_edge_wraparound);
     case 16: return (vsx_module*)(new vsx_module_mesh_vortex);
     case 17: return (vsx_module*)(new vsx_module_mesh_scale_normalize);
+    case 18: return (vsx_module*)(new vsx_module_mesh_simplify);
   }
   return 0;
 }
@@ -2767,9 +2696,10 @@ void destroy_module(vsx_module* m,unsigned long module) {
     case 15: delete (vsx_module_mesh_translate_edge_wraparound*)m; break;
     case 16: delete (vsx_module_mesh_vortex*)m; break;
     case 17: delete (vsx_module_mesh_scale_normalize*)m; break;
+    case 18: delete (vsx_module_mesh_simplify*)m; break;
   }
 }
 
 unsigned long get_num_modules() {
-  return 18;
+  return 19;
 }
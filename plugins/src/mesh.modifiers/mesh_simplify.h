@@ -0,0 +1,511 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <math.h>
+#include <string.h>
+#include "vsx_mesh.h"
+
+// Quadric error edge collapse decimation (Garland & Heckbert).
+//
+// Every vertex carries the sum of the squared distance quadrics of the
+// planes of its faces. Collapsing an edge merges the two vertices into one
+// at the point minimizing the summed quadric, its error being that
+// quadric's value there. Rather than a priority queue, each sweep collapses
+// every edge under a threshold that grows from sweep to sweep, until the
+// target face count (or the error limit) is reached; the cheap edges still
+// go first, at a fraction of the bookkeeping.
+//
+// Collapses that would flip or squash a neighbouring face are skipped, and
+// vertices on open edges stay put, so holes and the seams of meshes with
+// split vertices (tex coord seams, hard edges) are kept. That also means a
+// mesh where no face shares vertices with another can't be reduced.
+//
+// Errors are measured with the mesh scaled to a unit bounding box
+// diagonal, so max_error is a fraction of the mesh size, whatever its size.
+//
+// The surviving vertices keep their normals, tex coords and colors. Plain
+// CPU work on its own buffers, made to run in a background job.
+
+class mesh_simplify
+{
+  // symmetric 4x4 matrix, upper triangle:
+  // 0 1 2 3
+  //   4 5 6
+  //     7 8
+  //       9
+  struct quadric
+  {
+    double m[10];
+  };
+
+  struct tri
+  {
+    unsigned int v[3];
+    double err[4]; // per edge (v[j] -> v[j+1]), [3] is the smallest
+    bool deleted;
+    bool dirty;
+    vsx_vector n;
+  };
+
+  struct vert
+  {
+    vsx_vector p;
+    quadric q;
+    unsigned int tstart;
+    unsigned int tcount;
+    bool border;
+  };
+
+  // a corner of a face, vertex -> faces lists point into these
+  struct ref
+  {
+    unsigned int tid;
+    unsigned int tvertex;
+  };
+
+  vsx_array<tri> tris;
+  vsx_array<vert> verts;
+  vsx_array<ref> refs;
+
+  // per vertex scratch
+  vsx_array<unsigned int> vcount;
+  vsx_array<unsigned int> vids;
+  vsx_array<unsigned char> deleted0;
+  vsx_array<unsigned char> deleted1;
+
+  static inline void normalize_safe(vsx_vector& v)
+  {
+    float l = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    if (l > 0.0f)
+    {
+      l = 1.0f / l;
+      v.x *= l;
+      v.y *= l;
+      v.z *= l;
+    }
+  }
+
+  static inline void plane_quadric(quadric& q, double a, double b, double c, double d)
+  {
+    q.m[0] = a * a; q.m[1] = a * b; q.m[2] = a * c; q.m[3] = a * d;
+    q.m[4] = b * b; q.m[5] = b * c; q.m[6] = b * d;
+    q.m[7] = c * c; q.m[8] = c * d;
+    q.m[9] = d * d;
+  }
+
+  static inline void add(quadric& q, const quadric& o)
+  {
+    for (int i = 0; i < 10; i++)
+      q.m[i] += o.m[i];
+  }
+
+  static inline double det3(
+    const quadric& q,
+    int a11, int a12, int a13,
+    int a21, int a22, int a23,
+    int a31, int a32, int a33
+  )
+  {
+    return
+      q.m[a11] * q.m[a22] * q.m[a33] + q.m[a13] * q.m[a21] * q.m[a32] + q.m[a12] * q.m[a23] * q.m[a31]
+      - q.m[a13] * q.m[a22] * q.m[a31] - q.m[a11] * q.m[a23] * q.m[a32] - q.m[a12] * q.m[a21] * q.m[a33];
+  }
+
+  static inline double vertex_error(const quadric& q, double x, double y, double z)
+  {
+    const double* m = q.m;
+    return
+      m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+      m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+      m[7] * z * z + 2 * m[8] * z + m[9];
+  }
+
+  // error of collapsing v1-v2, and where the merged vertex goes
+  double edge_error(unsigned int id1, unsigned int id2, vsx_vector& result)
+  {
+    vert* v = verts.get_pointer();
+    quadric q = v[id1].q;
+    add(q, v[id2].q);
+    bool border = v[id1].border & v[id2].border;
+    double det = det3(q, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+    if (det != 0.0 && !border)
+    {
+      // the minimum of the quadric
+      result.x = (float)(-1.0 / det * det3(q, 1, 2, 3, 4, 5, 6, 5, 7, 8));
+      result.y = (float)( 1.0 / det * det3(q, 0, 2, 3, 1, 5, 6, 2, 7, 8));
+      result.z = (float)(-1.0 / det * det3(q, 0, 1, 3, 1, 4, 6, 2, 5, 8));
+      return vertex_error(q, result.x, result.y, result.z);
+    }
+    // singular (flat or straight surroundings): best of the ends and middle
+    vsx_vector p1 = v[id1].p;
+    vsx_vector p2 = v[id2].p;
+    vsx_vector p3 = vsx_vector((p1.x + p2.x) * 0.5f, (p1.y + p2.y) * 0.5f, (p1.z + p2.z) * 0.5f);
+    double e1 = vertex_error(q, p1.x, p1.y, p1.z);
+    double e2 = vertex_error(q, p2.x, p2.y, p2.z);
+    double e3 = vertex_error(q, p3.x, p3.y, p3.z);
+    double e = e1;
+    result = p1;
+    if (e2 < e) { e = e2; result = p2; }
+    if (e3 < e) { e = e3; result = p3; }
+    return e;
+  }
+
+  void update_errors(tri& t)
+  {
+    vsx_vector p;
+    for (int j = 0; j < 3; j++)
+      t.err[j] = edge_error(t.v[j], t.v[(j + 1) % 3], p);
+    t.err[3] = t.err[0];
+    if (t.err[1] < t.err[3]) t.err[3] = t.err[1];
+    if (t.err[2] < t.err[3]) t.err[3] = t.err[2];
+  }
+
+  // would moving vertex i0 (collapsing into i1) to p flip or squash one of
+  // its faces? marks the faces that go away with the edge in deleted
+  bool flipped(const vsx_vector& p, unsigned int i0, unsigned int i1, unsigned char* deleted)
+  {
+    vert* v = verts.get_pointer();
+    const vert& v0 = v[i0];
+    ref* r = refs.get_pointer();
+    for (unsigned int k = 0; k < v0.tcount; k++)
+    {
+      tri& t = tris[r[v0.tstart + k].tid];
+      if (t.deleted)
+        continue;
+      unsigned int s = r[v0.tstart + k].tvertex;
+      unsigned int id1 = t.v[(s + 1) % 3];
+      unsigned int id2 = t.v[(s + 2) % 3];
+      if (id1 == i1 || id2 == i1)
+      {
+        deleted[k] = 1;
+        continue;
+      }
+      vsx_vector d1 = v[id1].p - p;
+      vsx_vector d2 = v[id2].p - p;
+      normalize_safe(d1);
+      normalize_safe(d2);
+      if (fabsf(d1.dot_product(&d2)) > 0.999f)
+        return true;
+      vsx_vector n;
+      n.cross(d1, d2);
+      normalize_safe(n);
+      deleted[k] = 0;
+      if (n.dot_product(&t.n) < 0.2f)
+        return true;
+    }
+    return false;
+  }
+
+  // repoints the faces of v at i0, dropping the ones marked deleted
+  void update_faces(unsigned int i0, const vert& v, const unsigned char* deleted, size_t& deleted_count)
+  {
+    for (unsigned int k = 0; k < v.tcount; k++)
+    {
+      ref r = refs[v.tstart + k];
+      tri& t = tris[r.tid];
+      if (t.deleted)
+        continue;
+      if (deleted[k])
+      {
+        t.deleted = true;
+        deleted_count++;
+        continue;
+      }
+      t.v[r.tvertex] = i0;
+      t.dirty = true;
+      update_errors(t);
+      refs.push_back(r);
+    }
+  }
+
+  // drops deleted faces and rebuilds the vertex -> faces lists; the first
+  // time also finds the border and sets up quadrics and errors
+  void update_mesh(int iteration)
+  {
+    if (iteration > 0)
+    {
+      size_t dst = 0;
+      for (size_t i = 0; i < tris.size(); i++)
+        if (!tris[i].deleted)
+          tris[dst++] = tris[i];
+      tris.reset_used(dst);
+    }
+
+    vert* v = verts.get_pointer();
+    size_t vc = verts.size();
+    tri* t = tris.get_pointer();
+    size_t tc = tris.size();
+
+    for (size_t i = 0; i < vc; i++)
+    {
+      v[i].tstart = 0;
+      v[i].tcount = 0;
+    }
+    for (size_t i = 0; i < tc; i++)
+      for (int j = 0; j < 3; j++)
+        v[t[i].v[j]].tcount++;
+    unsigned int tstart = 0;
+    for (size_t i = 0; i < vc; i++)
+    {
+      v[i].tstart = tstart;
+      tstart += v[i].tcount;
+      v[i].tcount = 0;
+    }
+    ref* r = refs.resize(tc * 3);
+    for (size_t i = 0; i < tc; i++)
+      for (unsigned int j = 0; j < 3; j++)
+      {
+        vert& vv = v[t[i].v[j]];
+        r[vv.tstart + vv.tcount].tid = (unsigned int)i;
+        r[vv.tstart + vv.tcount].tvertex = j;
+        vv.tcount++;
+      }
+
+    if (iteration)
+      return;
+
+    // an edge used by a single face is open, its vertices are border
+    unsigned int* count = vcount.resize(vc);
+    unsigned int* ids = vids.resize(vc);
+    for (size_t i = 0; i < vc; i++)
+      v[i].border = false;
+    for (size_t i = 0; i < vc; i++)
+    {
+      size_t n = 0;
+      for (unsigned int k = 0; k < v[i].tcount; k++)
+      {
+        const tri& ft = t[r[v[i].tstart + k].tid];
+        for (int j = 0; j < 3; j++)
+        {
+          unsigned int id = ft.v[j];
+          size_t o = 0;
+          while (o < n && ids[o] != id)
+            o++;
+          if (o == n)
+          {
+            ids[n] = id;
+            count[n] = 1;
+            n++;
+          } else
+            count[o]++;
+        }
+      }
+      for (size_t o = 0; o < n; o++)
+        if (count[o] == 1)
+          v[ids[o]].border = true;
+    }
+
+    for (size_t i = 0; i < vc; i++)
+      memset(&v[i].q, 0, sizeof(quadric));
+    for (size_t i = 0; i < tc; i++)
+    {
+      vsx_vector p0 = v[t[i].v[0]].p;
+      vsx_vector e1 = v[t[i].v[1]].p - p0;
+      vsx_vector e2 = v[t[i].v[2]].p - p0;
+      vsx_vector n;
+      n.cross(e1, e2);
+      normalize_safe(n);
+      t[i].n = n;
+      quadric q;
+      plane_quadric(q, n.x, n.y, n.z, -n.dot_product(&p0));
+      for (int j = 0; j < 3; j++)
+        add(v[t[i].v[j]].q, q);
+    }
+    for (size_t i = 0; i < tc; i++)
+      update_errors(t[i]);
+  }
+
+public:
+
+  // Decimates src into dest (vertices, faces and the normals, tex coords
+  // and colors src has), down to target_faces faces or until collapses
+  // would cost more than max_error (fraction of the mesh size, 0 for no
+  // limit). src and dest must differ. Returns the face count reached.
+  size_t run(vsx_mesh_data* src, vsx_mesh_data* dest, size_t target_faces, float max_error)
+  {
+    size_t vc = src->vertices.size();
+
+    // bounds, to measure errors relative to the mesh size
+    vsx_vector lo, hi;
+    if (vc)
+      lo = hi = src->vertices[0];
+    for (size_t i = 1; i < vc; i++)
+    {
+      const vsx_vector& p = src->vertices[i];
+      if (p.x < lo.x) lo.x = p.x;
+      if (p.x > hi.x) hi.x = p.x;
+      if (p.y < lo.y) lo.y = p.y;
+      if (p.y > hi.y) hi.y = p.y;
+      if (p.z < lo.z) lo.z = p.z;
+      if (p.z > hi.z) hi.z = p.z;
+    }
+    vsx_vector center((lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f);
+    vsx_vector ext = hi - lo;
+    float scale = ext.length();
+    if (!(scale > 0.0f))
+      scale = 1.0f;
+    float inv_scale = 1.0f / scale;
+
+    vert* v = verts.resize(vc);
+    for (size_t i = 0; i < vc; i++)
+    {
+      vsx_vector p = src->vertices[i] - center;
+      v[i].p = p * inv_scale;
+    }
+
+    // faces, leaving out broken and degenerate ones
+    tris.reset_used(0);
+    vsx_face* sf = src->faces.get_pointer();
+    for (size_t i = 0; i < src->faces.size(); i++)
+    {
+      tri t;
+      t.v[0] = sf[i].a;
+      t.v[1] = sf[i].b;
+      t.v[2] = sf[i].c;
+      if (t.v[0] >= vc || t.v[1] >= vc || t.v[2] >= vc)
+        continue;
+      if (t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0])
+        continue;
+      t.deleted = false;
+      t.dirty = false;
+      tris.push_back(t);
+    }
+
+    size_t face_count = tris.size();
+    double max_err2 = (double)max_error * (double)max_error;
+    size_t deleted_count = 0;
+    for (int iteration = 0; iteration < 100 && face_count - deleted_count > target_faces; iteration++)
+    {
+      if (iteration % 5 == 0)
+        update_mesh(iteration);
+
+      for (size_t i = 0; i < tris.size(); i++)
+        tris[i].dirty = false;
+
+      // the threshold rises steeply; early sweeps only take nearly free
+      // collapses (flat areas), later ones whatever it takes
+      double threshold = 0.000000001 * pow((double)(iteration + 3), 7.0);
+      bool last = false;
+      if (max_error > 0.0f && threshold >= max_err2)
+      {
+        threshold = max_err2;
+        last = true;
+      }
+
+      for (size_t i = 0; i < tris.size(); i++)
+      {
+        tri& t = tris[i];
+        if (t.err[3] > threshold || t.deleted || t.dirty)
+          continue;
+        for (int j = 0; j < 3; j++)
+        {
+          if (t.err[j] > threshold)
+            continue;
+          unsigned int i0 = t.v[j];
+          unsigned int i1 = t.v[(j + 1) % 3];
+          v = verts.get_pointer();
+          if (v[i0].border || v[i1].border)
+            continue;
+
+          vsx_vector p;
+          edge_error(i0, i1, p);
+          unsigned char* d0 = deleted0.resize(v[i0].tcount);
+          unsigned char* d1 = deleted1.resize(v[i1].tcount);
+          if (flipped(p, i0, i1, d0) || flipped(p, i1, i0, d1))
+            continue;
+
+          // i1 goes into i0; i0 gets a fresh face list at the end of refs
+          v[i0].p = p;
+          add(v[i0].q, v[i1].q);
+          unsigned int tstart = (unsigned int)refs.size();
+          vert v0 = v[i0];
+          vert v1 = v[i1];
+          update_faces(i0, v0, d0, deleted_count);
+          update_faces(i0, v1, d1, deleted_count);
+          v = verts.get_pointer();
+          unsigned int tcount = (unsigned int)refs.size() - tstart;
+          if (tcount <= v[i0].tcount)
+          {
+            // fits where the old list was
+            if (tcount)
+              memmove(&refs[v[i0].tstart], &refs[tstart], tcount * sizeof(ref));
+            refs.reset_used(tstart);
+          } else
+            v[i0].tstart = tstart;
+          v[i0].tcount = tcount;
+          break;
+        }
+        if (face_count - deleted_count <= target_faces)
+          break;
+      }
+      if (last)
+        break;
+    }
+
+    // compact into dest, keeping the used vertices in their old order
+    update_mesh(1);
+    v = verts.get_pointer();
+    unsigned int* remap = vids.resize(vc);
+    for (size_t i = 0; i < vc; i++)
+      remap[i] = 0xFFFFFFFF;
+    for (size_t i = 0; i < tris.size(); i++)
+      for (int j = 0; j < 3; j++)
+        remap[tris[i].v[j]] = 0;
+
+    bool normals = src->vertex_normals.size() >= vc;
+    bool tex_coords = src->vertex_tex_coords.size() >= vc;
+    bool colors = src->vertex_colors.size() >= vc;
+    dest->vertices.reset_used(0);
+    dest->vertex_normals.reset_used(0);
+    dest->vertex_tex_coords.reset_used(0);
+    dest->vertex_colors.reset_used(0);
+    dest->vertex_tangents.reset_used(0);
+    dest->faces.reset_used(0);
+    unsigned int used = 0;
+    for (size_t i = 0; i < vc; i++)
+    {
+      if (remap[i])
+        continue;
+      remap[i] = used++;
+      dest->vertices.push_back(v[i].p * scale + center);
+      if (normals) dest->vertex_normals.push_back(src->vertex_normals[i]);
+      if (tex_coords) dest->vertex_tex_coords.push_back(src->vertex_tex_coords[i]);
+      if (colors) dest->vertex_colors.push_back(src->vertex_colors[i]);
+    }
+    for (size_t i = 0; i < tris.size(); i++)
+    {
+      vsx_face f;
+      f.a = remap[tris[i].v[0]];
+      f.b = remap[tris[i].v[1]];
+      f.c = remap[tris[i].v[2]];
+      dest->faces.push_back(f);
+    }
+    dest->touch(VSX_MESH_ALL);
+    return dest->faces.size();
+  }
+};
+
+#endif
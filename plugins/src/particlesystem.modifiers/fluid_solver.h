@@ -0,0 +1,490 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef FLUID_SOLVER_H
+#define FLUID_SOLVER_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "vsx_math_3d.h"
+#if defined(VSX_MATH_3D_SSE)
+#include <xmmintrin.h>
+#endif
+#include "vsx_thread_pool.h"
+
+// Jos Stam's stable fluids (velocity part only), reworked to scale:
+// * lin_solve is Jacobi instead of Gauss-Seidel; every cell of an iteration
+//   only reads the previous iteration so a row can be done 4 cells at a time
+//   with SSE and the rows can be split up over the engine thread pool.
+// * grid size and iteration count are set at runtime.
+// * depth > 1 gives a 3d grid (6-neighbour stencil, w velocity along k).
+//
+// Cells are (n+2) per axis including the boundary layer; a 2d grid is a
+// single slab with k = 0.
+
+// less cells than this per chunk aren't worth handing to another thread
+#define FLUID_SOLVER_MIN_CELLS 4096
+
+class vsx_fluid_solver {
+public:
+  int n;
+  int depth;
+  int iterations;
+
+  float* u;
+  float* v;
+  float* w;
+  float* u_prev;
+  float* v_prev;
+  float* w_prev;
+
+private:
+  float* scratch;
+  size_t size;
+  size_t stride_y;
+  size_t stride_z;
+
+  // arguments for the row kernels when they run on the pool
+  struct row_job {
+    vsx_fluid_solver* solver;
+    float* d;
+    const float* d0;
+    const float* x0;
+    float a;
+    float inv_c;
+    float dt0;
+    float* p;
+    float* div;
+  };
+
+  inline bool is_3d()
+  {
+    return depth > 1;
+  }
+
+  // interior row r -> index of its first interior cell
+  inline size_t row_start(size_t r)
+  {
+    size_t j = r % n + 1;
+    size_t k = is_3d() ? r / n + 1 : 0;
+    return 1 + j * stride_y + k * stride_z;
+  }
+
+  inline size_t num_rows()
+  {
+    return (size_t)n * (size_t)depth;
+  }
+
+  void dispatch(vsx_thread_pool_range_func func, row_job* job)
+  {
+    vsx_thread_pool::get_instance()->parallel_for(num_rows(), FLUID_SOLVER_MIN_CELLS / n + 1, func, (void*)job);
+  }
+
+  //--------------------------------------------------------------------------
+  // boundaries
+
+  void set_bnd(int b, float* x)
+  {
+    int N = n;
+    size_t sy = stride_y;
+    size_t sz = stride_z;
+    if (!is_3d())
+    {
+      for (int i = 1; i <= N; i++)
+      {
+        x[i*sy]         = b == 1 ? -x[1 + i*sy] : x[1 + i*sy];
+        x[N+1 + i*sy]   = b == 1 ? -x[N + i*sy] : x[N + i*sy];
+        x[i]            = b == 2 ? -x[i + sy]   : x[i + sy];
+        x[i + (N+1)*sy] = b == 2 ? -x[i + N*sy] : x[i + N*sy];
+      }
+      x[0]                = 0.5f * (x[1]                + x[sy]);
+      x[(N+1)*sy]         = 0.5f * (x[1 + (N+1)*sy]     + x[N*sy]);
+      x[N+1]              = 0.5f * (x[N]                + x[N+1 + sy]);
+      x[N+1 + (N+1)*sy]   = 0.5f * (x[N + (N+1)*sy]     + x[N+1 + N*sy]);
+      return;
+    }
+    for (int k = 1; k <= N; k++)
+    {
+      for (int i = 1; i <= N; i++)
+      {
+        // x faces
+        x[0   + i*sy + k*sz] = b == 1 ? -x[1 + i*sy + k*sz] : x[1 + i*sy + k*sz];
+        x[N+1 + i*sy + k*sz] = b == 1 ? -x[N + i*sy + k*sz] : x[N + i*sy + k*sz];
+        // y faces
+        x[i + 0*sy     + k*sz] = b == 2 ? -x[i + 1*sy + k*sz] : x[i + 1*sy + k*sz];
+        x[i + (N+1)*sy + k*sz] = b == 2 ? -x[i + N*sy + k*sz] : x[i + N*sy + k*sz];
+        // z faces
+        x[i + k*sy + 0*sz]     = b == 3 ? -x[i + k*sy + 1*sz] : x[i + k*sy + 1*sz];
+        x[i + k*sy + (N+1)*sz] = b == 3 ? -x[i + k*sy + N*sz] : x[i + k*sy + N*sz];
+      }
+    }
+    // edges are only read by advect's interpolation, average them from
+    // their two face neighbours. the 8 corners are left at zero.
+    for (int i = 1; i <= N; i++)
+    {
+      x[i + 0*sy + 0*sz]         = 0.5f * (x[i + 1*sy + 0*sz]     + x[i + 0*sy + 1*sz]);
+      x[i + (N+1)*sy + 0*sz]     = 0.5f * (x[i + N*sy + 0*sz]     + x[i + (N+1)*sy + 1*sz]);
+      x[i + 0*sy + (N+1)*sz]     = 0.5f * (x[i + 1*sy + (N+1)*sz] + x[i + 0*sy + N*sz]);
+      x[i + (N+1)*sy + (N+1)*sz] = 0.5f * (x[i + N*sy + (N+1)*sz] + x[i + (N+1)*sy + N*sz]);
+
+      x[0 + i*sy + 0*sz]         = 0.5f * (x[1 + i*sy + 0*sz]     + x[0 + i*sy + 1*sz]);
+      x[N+1 + i*sy + 0*sz]       = 0.5f * (x[N + i*sy + 0*sz]     + x[N+1 + i*sy + 1*sz]);
+      x[0 + i*sy + (N+1)*sz]     = 0.5f * (x[1 + i*sy + (N+1)*sz] + x[0 + i*sy + N*sz]);
+      x[N+1 + i*sy + (N+1)*sz]   = 0.5f * (x[N + i*sy + (N+1)*sz] + x[N+1 + i*sy + N*sz]);
+
+      x[0 + 0*sy + i*sz]         = 0.5f * (x[1 + 0*sy + i*sz]     + x[0 + 1*sy + i*sz]);
+      x[N+1 + 0*sy + i*sz]       = 0.5f * (x[N + 0*sy + i*sz]     + x[N+1 + 1*sy + i*sz]);
+      x[0 + (N+1)*sy + i*sz]     = 0.5f * (x[1 + (N+1)*sy + i*sz] + x[0 + N*sy + i*sz]);
+      x[N+1 + (N+1)*sy + i*sz]   = 0.5f * (x[N + (N+1)*sy + i*sz] + x[N+1 + N*sy + i*sz]);
+    }
+  }
+
+  //--------------------------------------------------------------------------
+  // jacobi relaxation
+
+  static void jacobi_rows(void* arg, size_t start, size_t end)
+  {
+    row_job* job = (row_job*)arg;
+    vsx_fluid_solver* s = job->solver;
+    const float* x = job->d0;
+    const float* x0 = job->x0;
+    float* dst = job->d;
+    const float a = job->a;
+    const float inv_c = job->inv_c;
+    const ptrdiff_t sy = (ptrdiff_t)s->stride_y;
+    const ptrdiff_t sz = (ptrdiff_t)s->stride_z;
+    const bool three_d = s->is_3d();
+    const int N = s->n;
+
+    for (size_t r = start; r < end; r++)
+    {
+      size_t o = s->row_start(r);
+      int i = 0;
+#if defined(VSX_MATH_3D_SSE)
+      const __m128 va = _mm_set1_ps(a);
+      const __m128 vc = _mm_set1_ps(inv_c);
+      for (; i + 4 <= N; i += 4)
+      {
+        const float* c = x + o + i;
+        __m128 sum = _mm_add_ps(_mm_loadu_ps(c - 1), _mm_loadu_ps(c + 1));
+        sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(c - sy), _mm_loadu_ps(c + sy)));
+        if (three_d)
+          sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(c - sz), _mm_loadu_ps(c + sz)));
+        __m128 res = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(x0 + o + i), _mm_mul_ps(va, sum)), vc);
+        _mm_storeu_ps(dst + o + i, res);
+      }
+#endif
+      for (; i < N; i++)
+      {
+        const float* c = x + o + i;
+        float sum = c[-1] + c[1] + c[-sy] + c[sy];
+        if (three_d)
+          sum += c[-sz] + c[sz];
+        dst[o + i] = (x0[o + i] + a * sum) * inv_c;
+      }
+    }
+  }
+
+  void lin_solve(int b, float* x, float* x0, float a, float c)
+  {
+    row_job job;
+    job.solver = this;
+    job.x0 = x0;
+    job.a = a;
+    job.inv_c = 1.0f / c;
+
+    // ping-pong between x and scratch; the boundary layer of scratch must
+    // be valid too, so start from a copy
+    memcpy(scratch, x, size * sizeof(float));
+    float* src = x;
+    float* dst = scratch;
+    for (int k = 0; k < iterations; k++)
+    {
+      job.d0 = src;
+      job.d = dst;
+      dispatch(&jacobi_rows, &job);
+      set_bnd(b, dst);
+      float* t = src; src = dst; dst = t;
+    }
+    if (src != x)
+      memcpy(x, src, size * sizeof(float));
+  }
+
+  void diffuse(int b, float* x, float* x0, float diff, float dt)
+  {
+    float a = dt * diff * n * n;
+    lin_solve(b, x, x0, a, 1 + (is_3d() ? 6 : 4) * a);
+  }
+
+  //--------------------------------------------------------------------------
+  // advection, the back traced position is a gather so this stays scalar
+
+  static void advect_rows(void* arg, size_t start, size_t end)
+  {
+    row_job* job = (row_job*)arg;
+    vsx_fluid_solver* s = job->solver;
+    const float* d0 = job->d0;
+    float* d = job->d;
+    const float dt0 = job->dt0;
+    const int N = s->n;
+    const size_t sy = s->stride_y;
+    const size_t sz = s->stride_z;
+    const float lim = N + 0.5f;
+
+    for (size_t r = start; r < end; r++)
+    {
+      size_t j = r % N + 1;
+      size_t k = s->is_3d() ? r / N + 1 : 0;
+      size_t o = s->row_start(r) - 1;
+      for (int i = 1; i <= N; i++)
+      {
+        size_t c = o + i;
+        float x = i - dt0 * s->u_prev[c];
+        float y = j - dt0 * s->v_prev[c];
+        x = x < 0.5f ? 0.5f : (x > lim ? lim : x);
+        y = y < 0.5f ? 0.5f : (y > lim ? lim : y);
+        int i0 = (int)x;
+        int j0 = (int)y;
+        float s1 = x - i0; float s0 = 1 - s1;
+        float t1 = y - j0; float t0 = 1 - t1;
+        if (!s->is_3d())
+        {
+          size_t c0 = i0 + j0 * sy;
+          d[c] = s0 * (t0 * d0[c0]      + t1 * d0[c0 + sy]) +
+                 s1 * (t0 * d0[c0 + 1]  + t1 * d0[c0 + 1 + sy]);
+          continue;
+        }
+        float z = k - dt0 * s->w_prev[c];
+        z = z < 0.5f ? 0.5f : (z > lim ? lim : z);
+        int k0 = (int)z;
+        float r1 = z - k0; float r0 = 1 - r1;
+        size_t c0 = i0 + j0 * sy + k0 * sz;
+        d[c] =
+          r0 * (s0 * (t0 * d0[c0]           + t1 * d0[c0 + sy]) +
+                s1 * (t0 * d0[c0 + 1]       + t1 * d0[c0 + 1 + sy])) +
+          r1 * (s0 * (t0 * d0[c0 + sz]      + t1 * d0[c0 + sy + sz]) +
+                s1 * (t0 * d0[c0 + 1 + sz]  + t1 * d0[c0 + 1 + sy + sz]));
+      }
+    }
+  }
+
+  // velocity field to trace back through is always u_prev/v_prev/w_prev
+  void advect(int b, float* d, float* d0, float dt)
+  {
+    row_job job;
+    job.solver = this;
+    job.d = d;
+    job.d0 = d0;
+    job.dt0 = dt * n;
+    dispatch(&advect_rows, &job);
+    set_bnd(b, d);
+  }
+
+  //--------------------------------------------------------------------------
+  // projection
+
+  static void divergence_rows(void* arg, size_t start, size_t end)
+  {
+    row_job* job = (row_job*)arg;
+    vsx_fluid_solver* s = job->solver;
+    const ptrdiff_t sy = (ptrdiff_t)s->stride_y;
+    const ptrdiff_t sz = (ptrdiff_t)s->stride_z;
+    const float h = -0.5f / s->n;
+    for (size_t r = start; r < end; r++)
+    {
+      size_t o = s->row_start(r);
+      for (int i = 0; i < s->n; i++)
+      {
+        size_t c = o + i;
+        float dv = s->u[c+1] - s->u[c-1] + s->v[c+sy] - s->v[c-sy];
+        if (s->is_3d())
+          dv += s->w[c+sz] - s->w[c-sz];
+        job->div[c] = h * dv;
+        job->p[c] = 0.0f;
+      }
+    }
+  }
+
+  static void gradient_rows(void* arg, size_t start, size_t end)
+  {
+    row_job* job = (row_job*)arg;
+    vsx_fluid_solver* s = job->solver;
+    const ptrdiff_t sy = (ptrdiff_t)s->stride_y;
+    const ptrdiff_t sz = (ptrdiff_t)s->stride_z;
+    const float h = 0.5f * s->n;
+    const float* p = job->p;
+    for (size_t r = start; r < end; r++)
+    {
+      size_t o = s->row_start(r);
+      for (int i = 0; i < s->n; i++)
+      {
+        size_t c = o + i;
+        s->u[c] -= h * (p[c+1]  - p[c-1]);
+        s->v[c] -= h * (p[c+sy] - p[c-sy]);
+        if (s->is_3d())
+          s->w[c] -= h * (p[c+sz] - p[c-sz]);
+      }
+    }
+  }
+
+  void project(float* p, float* div)
+  {
+    row_job job;
+    job.solver = this;
+    job.p = p;
+    job.div = div;
+    dispatch(&divergence_rows, &job);
+    set_bnd(0, div);
+    set_bnd(0, p);
+
+    lin_solve(0, p, div, 1, is_3d() ? 6 : 4);
+
+    dispatch(&gradient_rows, &job);
+    set_bnd(1, u);
+    set_bnd(2, v);
+    if (is_3d())
+      set_bnd(3, w);
+  }
+
+  void add_source(float* x, float* s, float dt)
+  {
+    for (size_t i = 0; i < size; i++)
+      x[i] += dt * s[i];
+  }
+
+  #define FLUID_SOLVER_SWAP(x0,x) {float * tmp=x0;x0=x;x=tmp;}
+
+public:
+
+  vsx_fluid_solver()
+  {
+    n = 0;
+    depth = 0;
+    iterations = 20;
+    size = 0;
+    u = v = w = u_prev = v_prev = w_prev = scratch = 0;
+  }
+
+  ~vsx_fluid_solver()
+  {
+    free_data();
+  }
+
+  inline size_t index(int i, int j, int k = 0)
+  {
+    return i + j * stride_y + k * stride_z;
+  }
+
+  size_t get_size()
+  {
+    return size;
+  }
+
+  void free_data()
+  {
+    if (u) free(u);
+    if (v) free(v);
+    if (w) free(w);
+    if (u_prev) free(u_prev);
+    if (v_prev) free(v_prev);
+    if (w_prev) free(w_prev);
+    if (scratch) free(scratch);
+    u = v = w = u_prev = v_prev = w_prev = scratch = 0;
+  }
+
+  // (re)allocates the grid, returns false if the memory couldn't be had
+  bool init(int new_n, bool three_d)
+  {
+    free_data();
+    n = new_n;
+    depth = three_d ? n : 1;
+    stride_y = n + 2;
+    stride_z = three_d ? stride_y * stride_y : 0;
+    size = stride_y * stride_y * (three_d ? stride_y : 1);
+
+    u       = (float*)malloc(size * sizeof(float));
+    v       = (float*)malloc(size * sizeof(float));
+    u_prev  = (float*)malloc(size * sizeof(float));
+    v_prev  = (float*)malloc(size * sizeof(float));
+    scratch = (float*)malloc(size * sizeof(float));
+    if (three_d)
+    {
+      w       = (float*)malloc(size * sizeof(float));
+      w_prev  = (float*)malloc(size * sizeof(float));
+    }
+    if (!u || !v || !u_prev || !v_prev || !scratch || (three_d && (!w || !w_prev)))
+    {
+      free_data();
+      n = depth = 0;
+      size = 0;
+      return false;
+    }
+    clear();
+    return true;
+  }
+
+  void clear()
+  {
+    memset(u, 0, size * sizeof(float));
+    memset(v, 0, size * sizeof(float));
+    clear_prev();
+    if (w) memset(w, 0, size * sizeof(float));
+  }
+
+  // the prev arrays are the force input for the next step
+  void clear_prev()
+  {
+    memset(u_prev, 0, size * sizeof(float));
+    memset(v_prev, 0, size * sizeof(float));
+    if (w_prev) memset(w_prev, 0, size * sizeof(float));
+  }
+
+  void vel_step(float visc, float dt)
+  {
+    add_source(u, u_prev, dt);
+    add_source(v, v_prev, dt);
+    if (is_3d())
+      add_source(w, w_prev, dt);
+
+    FLUID_SOLVER_SWAP(u_prev, u); diffuse(1, u, u_prev, visc, dt);
+    FLUID_SOLVER_SWAP(v_prev, v); diffuse(2, v, v_prev, visc, dt);
+    if (is_3d())
+    {
+      FLUID_SOLVER_SWAP(w_prev, w); diffuse(3, w, w_prev, visc, dt);
+    }
+    project(u_prev, v_prev);
+
+    FLUID_SOLVER_SWAP(u_prev, u);
+    FLUID_SOLVER_SWAP(v_prev, v);
+    if (is_3d())
+      FLUID_SOLVER_SWAP(w_prev, w);
+    advect(1, u, u_prev, dt);
+    advect(2, v, v_prev, dt);
+    if (is_3d())
+      advect(3, w, w_prev, dt);
+    project(u_prev, v_prev);
+  }
+};
+
+#endif
@@ -1,15 +1,176 @@
 #include "vsx_avector.h"
 #include "vsx_array.h"
+#include "vsx_math_3d.h"
+#include "vsx_thread_pool.h"
 #include "gravity_lines.h"
+#if defined(VSX_MATH_3D_SSE)
+#include <xmmintrin.h>
+#endif
 
-//Vec3d Mass::center;
-//Vec3d Mass::gravity(0.5f, 0.0f, 0.0f);
-//float Mass::friction = 0.07f;
+// groups of 4 masses per thread pool chunk
+#define GRAVITY_LINES_MIN_CHUNK 16
 
-void Mass::setCenter(const float &x, const float &y, const float &z) {
-  center.x = x;
-  center.y = y;
-  center.z = z;
+// one mass for integrate()
+typedef struct {
+  gravity_lines* owner;
+  unsigned long index;
+} gravity_lane;
+
+void gravity_lines::add_mass(float m)
+{
+  pos_x.push_back(0.0f);
+  pos_y.push_back(0.0f);
+  pos_z.push_back(0.0f);
+  speed_x.push_back(0.0f);
+  speed_y.push_back(0.0f);
+  speed_z.push_back(0.0f);
+  mass.push_back(m);
+}
+
+// Runs masses [begin * 4, end * 4) through their owners' pending steps.
+// The steps are done in the same order and precision as one mass at a
+// time, lanes with fewer steps than the others just stop changing.
+static void integrate_range(void* arg, size_t begin, size_t end)
+{
+  vsx_array<gravity_lane>& lanes = *(vsx_array<gravity_lane>*)arg;
+  const float dt = GRAVITY_LINES_TIME_DIFF;
+  for (size_t g = begin; g < end; g++)
+  {
+    const gravity_lane* l = lanes.get_pointer() + g * 4;
+    size_t n = lanes.size() - g * 4;
+    if (n > 4) n = 4;
+#if defined(VSX_MATH_3D_SSE)
+    float px[4], py[4], pz[4], vx[4], vy[4], vz[4];
+    float m[4], cx[4], cy[4], cz[4], k[4], steps[4];
+    int max_steps = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+      if (i >= n)
+      {
+        // padding, never active
+        px[i] = py[i] = pz[i] = vx[i] = vy[i] = vz[i] = 0.0f;
+        cx[i] = cy[i] = cz[i] = k[i] = steps[i] = 0.0f;
+        m[i] = 1.0f;
+        continue;
+      }
+      gravity_lines* o = l[i].owner;
+      unsigned long j = l[i].index;
+      px[i] = o->pos_x[j];
+      py[i] = o->pos_y[j];
+      pz[i] = o->pos_z[j];
+      vx[i] = o->speed_x[j];
+      vy[i] = o->speed_y[j];
+      vz[i] = o->speed_z[j];
+      m[i] = o->mass[j];
+      cx[i] = o->center_x;
+      cy[i] = o->center_y;
+      cz[i] = o->center_z;
+      k[i] = 1.0f - (o->friction * 0.07f * dt);
+      steps[i] = (float)o->pending_steps;
+      if (o->pending_steps > max_steps)
+        max_steps = o->pending_steps;
+    }
+    __m128 r_px = _mm_loadu_ps(px), r_py = _mm_loadu_ps(py), r_pz = _mm_loadu_ps(pz);
+    __m128 r_vx = _mm_loadu_ps(vx), r_vy = _mm_loadu_ps(vy), r_vz = _mm_loadu_ps(vz);
+    __m128 r_m = _mm_loadu_ps(m);
+    __m128 r_cx = _mm_loadu_ps(cx), r_cy = _mm_loadu_ps(cy), r_cz = _mm_loadu_ps(cz);
+    __m128 r_k = _mm_loadu_ps(k);
+    __m128 r_steps = _mm_loadu_ps(steps);
+    __m128 r_dt = _mm_set1_ps(dt);
+    for (int s = 0; s < max_steps; s++)
+    {
+      __m128 active = _mm_cmplt_ps(_mm_set1_ps((float)s), r_steps);
+      __m128 nvx = _mm_mul_ps(_mm_add_ps(r_vx, _mm_mul_ps(_mm_div_ps(_mm_sub_ps(r_cx, r_px), r_m), r_dt)), r_k);
+      __m128 nvy = _mm_mul_ps(_mm_add_ps(r_vy, _mm_mul_ps(_mm_div_ps(_mm_sub_ps(r_cy, r_py), r_m), r_dt)), r_k);
+      __m128 nvz = _mm_mul_ps(_mm_add_ps(r_vz, _mm_mul_ps(_mm_div_ps(_mm_sub_ps(r_cz, r_pz), r_m), r_dt)), r_k);
+      #define GRAVITY_LINES_SELECT(a, b) _mm_or_ps(_mm_and_ps(active, a), _mm_andnot_ps(active, b))
+      r_px = GRAVITY_LINES_SELECT(_mm_add_ps(r_px, _mm_mul_ps(nvx, r_dt)), r_px);
+      r_py = GRAVITY_LINES_SELECT(_mm_add_ps(r_py, _mm_mul_ps(nvy, r_dt)), r_py);
+      r_pz = GRAVITY_LINES_SELECT(_mm_add_ps(r_pz, _mm_mul_ps(nvz, r_dt)), r_pz);
+      r_vx = GRAVITY_LINES_SELECT(nvx, r_vx);
+      r_vy = GRAVITY_LINES_SELECT(nvy, r_vy);
+      r_vz = GRAVITY_LINES_SELECT(nvz, r_vz);
+      #undef GRAVITY_LINES_SELECT
+      _mm_storeu_ps(px, r_px);
+      _mm_storeu_ps(py, r_py);
+      _mm_storeu_ps(pz, r_pz);
+      for (size_t i = 0; i < n; i++)
+      {
+        gravity_lines* o = l[i].owner;
+        if (s >= o->pending_steps)
+          continue;
+        vsx_vector& t = o->oldPos[l[i].index][(o->offs + s) % BUFF_LEN];
+        t.x = px[i];
+        t.y = py[i];
+        t.z = pz[i];
+      }
+    }
+    _mm_storeu_ps(vx, r_vx);
+    _mm_storeu_ps(vy, r_vy);
+    _mm_storeu_ps(vz, r_vz);
+    for (size_t i = 0; i < n; i++)
+    {
+      gravity_lines* o = l[i].owner;
+      unsigned long j = l[i].index;
+      o->pos_x[j] = px[i];
+      o->pos_y[j] = py[i];
+      o->pos_z[j] = pz[i];
+      o->speed_x[j] = vx[i];
+      o->speed_y[j] = vy[i];
+      o->speed_z[j] = vz[i];
+    }
+#else
+    for (size_t i = 0; i < n; i++)
+    {
+      gravity_lines* o = l[i].owner;
+      unsigned long j = l[i].index;
+      float px = o->pos_x[j], py = o->pos_y[j], pz = o->pos_z[j];
+      float vx = o->speed_x[j], vy = o->speed_y[j], vz = o->speed_z[j];
+      float m = o->mass[j];
+      float k = 1.0f - (o->friction * 0.07f * dt);
+      vsx_vector* trail = o->oldPos[j];
+      for (int s = 0; s < o->pending_steps; s++)
+      {
+        vx = (vx + (o->center_x - px) / m * dt) * k;
+        vy = (vy + (o->center_y - py) / m * dt) * k;
+        vz = (vz + (o->center_z - pz) / m * dt) * k;
+        px += vx * dt;
+        py += vy * dt;
+        pz += vz * dt;
+        vsx_vector& t = trail[(o->offs + s) % BUFF_LEN];
+        t.x = px;
+        t.y = py;
+        t.z = pz;
+      }
+      o->pos_x[j] = px;
+      o->pos_y[j] = py;
+      o->pos_z[j] = pz;
+      o->speed_x[j] = vx;
+      o->speed_y[j] = vy;
+      o->speed_z[j] = vz;
+    }
+#endif
+  }
+}
+
+void gravity_lines::integrate(gravity_lines** list, size_t count)
+{
+  vsx_array<gravity_lane> lanes;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (list[i]->pending_steps <= 0)
+      continue;
+    for (int j = 0; j < list[i]->num_lines; j++)
+    {
+      gravity_lane l;
+      l.owner = list[i];
+      l.index = j;
+      lanes.push_back(l);
+    }
+  }
+  if (!lanes.size())
+    return;
+  vsx_thread_pool::get_instance()->parallel_for((lanes.size() + 3) / 4, GRAVITY_LINES_MIN_CHUNK, &integrate_range, (void*)&lanes);
 }
 
 
@@ -27,7 +188,7 @@ void gravity_lines::init()
 
 	first = true;
 	num_lines = 40;
-	vsx_vector v;
+	pending_steps = 0;
 /*	color0[0] = 1;
 	color0[1] = 1;
 	color0[2] = 1;
@@ -41,14 +202,10 @@ void gravity_lines::init()
 	//masses[1].init(v,v, masses[0].mass+0.1f);
 	
 	for(int i = 0; i < num_lines / 3; i++) {
-		Mass m; 
-		m.init(v, v, 7 / (rand() / (float)RAND_MAX * 2.5f + 0.35f));
-	  masses.push_back(m);
+	  add_mass(7 / (rand() / (float)RAND_MAX * 2.5f + 0.35f));
 	}
 	for(int i = num_lines / 3; i < num_lines+1; i++) {
-		Mass m; 
-		m.init(v, v, 7 / (rand() / (float)RAND_MAX * 1.1f + 1.31f));
-	  masses.push_back(m);
+	  add_mass(7 / (rand() / (float)RAND_MAX * 1.1f + 1.31f));
 	}
 }
 
@@ -66,57 +223,45 @@ void gravity_lines::reset_pos(float x, float y, float z)
   }
 }
 
-void gravity_lines::update(float delta_time, float x, float y, float z) {
-  //printf("update start\n");
+void gravity_lines::begin_update(float delta_time, float x, float y, float z) {
 	if (delta_time > 0.16667f) delta_time = 0.16667f;
 	while (oldPos.size() != (unsigned long)num_lines)
 	{
 		oldPos.push_back(new vsx_vector[BUFF_LEN]);
-		/*float y = (float)(rand()%1000) * 0.001f;
-		for (int i = 0; i < BUFF_LEN; i++) {
-			oldPos[oldPos.size()-1][i] = vsx_vector((float)i*0.001f, y ,1.0f);
-		}*/
 	}
-	
+
   curr_time += (float)fabs(delta_time);
-  
+
   int num_steps = (int)((curr_time - last_step_time) * step_freq);
 
 	if (first) {
-//  	offs = 1024-num*2.0f; 
 		num_steps = BUFF_LEN;
 	}
 
   last_step_time += num_steps / step_freq;
-  
-  vsx_vector pos;
-  //printf("num_steps: %d\n",num_steps);
-
-  for(int j = 0; j < num_steps; j++) {
-    for(int i = 0; i < num_lines; i++) {
-      //printf("i: %d\n", i);
-  		masses[i].friction = friction*0.07f;
-  		//printf("masses[i].friction: %\n",masses[i].friction);
-  		//printf("masses[i].setCenter(%f, %f, %f);\n",x,y,z);
-  		//if (!j) 
-  		masses[i].setCenter(x, y, z);
-      masses[i].update(0.08f);
-      pos = masses[i].getPos();
-      oldPos[i][offs].x = pos.x;
-      oldPos[i][offs].y = pos.y;
-      oldPos[i][offs].z = pos.z;
-      //printf("pos(%f, %f, %f);\n",pos.x,pos.y,pos.z);
-    }
-    offs = (offs + 1) % BUFF_LEN;
-    //printf("ofs = %d\n",offs);
-  }
+
+  center_x = x;
+  center_y = y;
+  center_z = z;
+  pending_steps = num_steps;
+}
+
+void gravity_lines::end_update() {
+  if (pending_steps > 0)
+    offs = (offs + pending_steps) % BUFF_LEN;
+  pending_steps = 0;
 
 	if (first) {
-  	offs = 0; 
+  	offs = 0;
 		first = false;
-		//num_steps = BUFF_LEN;
 	}
+}
 
+void gravity_lines::update(float delta_time, float x, float y, float z) {
+  begin_update(delta_time, x, y, z);
+  gravity_lines* self = this;
+  integrate(&self, 1);
+  end_update();
 }
 
 void gravity_lines::render() {
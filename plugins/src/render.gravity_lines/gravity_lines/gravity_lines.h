@@ -9,6 +9,7 @@
 #include <cmath>
 #include <vector>
 #include "vsx_math_3d.h"
+#include "vsx_array.h"
 
 //////////////////////////////////////////////////
 
@@ -19,50 +20,29 @@ public:
   float x, y, z;
 };*/
 
-//////////////////////////////////////////////////
-
-class Mass {
-
-public:
-  Mass() : friction(0.07f), mass(1.0f) {};
-
-  void init(vsx_vector pos, vsx_vector spd, float m = 1.0f) {
-    position = pos;
-    speed = spd;
-    mass = m;
-    friction = 1.5f;
-  }
-
-  inline void update(float timeDiff) {
-    //printf("timeDiff: %f\n", mass);
-    speed.x += (center.x - position.x) / mass * timeDiff;
-    speed.y += (center.y - position.y) / mass * timeDiff;
-    speed.z += (center.z - position.z) / mass * timeDiff;
-//    float ft = (friction * timeDiff);
-    //if (ft < 0.00001f)
-    speed.x *= 1.0f - (friction * timeDiff);
-    speed.y *= 1.0f - (friction * timeDiff);
-    speed.z *= 1.0f - (friction * timeDiff);
-    position.x += speed.x * timeDiff;
-    position.y += speed.y * timeDiff;
-    position.z += speed.z * timeDiff;
-  }
-
-
-  const vsx_vector& getPos() const {return position;}
-
-  void setCenter(const float &x, const float &y, const float &z);
-
-  float friction;
-  float mass;
-  vsx_vector position, speed;
-  vsx_vector center;
-};
-
 //////////////////////////////////////////////////
 //#define NUMBER 2
 #define BUFF_LEN 1024
 
+// time step of one simulation step
+#define GRAVITY_LINES_TIME_DIFF 0.08f
+
+// The masses are kept as structure of arrays, one entry per mass. Each
+// simulation step pulls a mass towards the center, applies friction and
+// moves it:
+//
+//   speed += (center - position) / mass * time_diff
+//   speed *= 1 - friction * time_diff
+//   position += speed * time_diff
+//
+// Only the first num_lines masses are simulated, each leaving a trail of
+// BUFF_LEN positions in oldPos.
+//
+// update() runs the steps for one object. To update many objects (ribbon
+// per particle), call begin_update() on each, integrate() once with all of
+// them and end_update() on each: integrate() puts the masses of all the
+// objects four to an SSE register and spreads them over the thread pool.
+
 class gravity_lines {
 public:
   bool first;
@@ -82,11 +62,26 @@ public:
   virtual void update(float delta_time, float x, float y, float z);
   virtual void render();
 
+  // counts the steps due, sets the center and makes sure the trails exist
+  void begin_update(float delta_time, float x, float y, float z);
+  // advances the trails past the steps integrate() wrote
+  void end_update();
+  // runs the pending steps of all the masses in list
+  static void integrate(gravity_lines** list, size_t count);
+
+  void add_mass(float m);
+
   float curr_time, last_step_time, step_freq;
   float friction;
 
+  // simulation state
+  vsx_array<float> pos_x, pos_y, pos_z;
+  vsx_array<float> speed_x, speed_y, speed_z;
+  vsx_array<float> mass;
+  float center_x, center_y, center_z;
+  int pending_steps;
+
   unsigned long offs;
-  std::vector<Mass> masses;
   std::vector<vsx_vector*> oldPos;
   //vsx_vector oldPos[NUMBER][BUFF_LEN];
   ~gravity_lines();
@@ -15,7 +15,6 @@ void gravity_strip::init_strip()
 
 
 	num_lines = 1;
-	vsx_vector v;
 /*	color0[0] = 1;
 	color0[1] = 1;
 	color0[2] = 1;
@@ -25,9 +24,7 @@ void gravity_strip::init_strip()
 	color1[2] = 1;
 	color1[3] = 1;*/
 
-	Mass m;
-	m.init(v,v,7 / (rand() / (float)RAND_MAX * 2.5f + 0.35f));
-	masses.push_back(m);
+	add_mass(7 / (rand() / (float)RAND_MAX * 2.5f + 0.35f));
 	first = true;
 	//masses[1].init(v,v, masses[0].mass+0.2f);
 }
@@ -206,7 +206,7 @@ public:
   void output(vsx_module_param_abs* param)
   {
     VSX_UNUSED(param);
-		gr.masses[1].mass = gr.masses[0].mass + ribbon_width->get();
+		gr.mass[1] = gr.mass[0] + ribbon_width->get();
 		gr.length = length->get();
 		gr.friction = friction->get();
 	  gr.color0[0] = color0->get(0);
@@ -243,6 +243,8 @@ class vsx_module_gravity_ribbon_particles : public vsx_module {
 	// internal
 	vsx_avector<gravity_strip*> gr;
 	gravity_strip* grp;
+	// the strips updated this frame, for gravity_lines::integrate
+	vsx_array<gravity_lines*> batch;
 
 	float last_update;
 	unsigned long prev_num_particles;
@@ -342,10 +344,11 @@ public:
       }
       //printf("done alloc %d\n",particles->particles->size());
 
+      batch.reset_used(0);
       for (unsigned long i = 0; i < particles->particles->size(); ++i) {
       	//gr[i].length = 0.0f;
       	gr[i]->width = ribbon_width->get();
-				//gr[i].masses[1].mass = gr[i].masses[0].mass + ribbon_width->get();
+				//gr[i].mass[1] = gr[i].mass[0] + ribbon_width->get();
 				gr[i]->length = length->get();
 				gr[i]->friction = friction->get();
         float tt = ((*particles->particles)[i].time/(*particles->particles)[i].lifetime);
@@ -361,17 +364,24 @@ public:
 			  gr[i]->color1[2] = color1->get(2);
 			  gr[i]->step_freq = 10.0f * step_length->get();
 		  	//if (last_update != engine->vtime) {
-			  gr[i]->update(engine->dtime, (*(particles->particles))[i].pos.x, (*(particles->particles))[i].pos.y, (*(particles->particles))[i].pos.z);
+			  gr[i]->begin_update(engine->dtime, (*(particles->particles))[i].pos.x, (*(particles->particles))[i].pos.y, (*(particles->particles))[i].pos.z);
+			  batch.push_back(gr[i]);
 					//last_upd ate = engine->vtime;
 	  		//}
 				//printf("%f, %f, %f\n", (*particles->particles)[i].pos.x, (*particles->particles)[i].pos.y, (*particles->particles)[i].pos.z);
-			  gr[i]->render();
 		//		printf("%d %d;;; %d\n",__LINE__,i, particles->particles->size());
         // add the delta-time to the time of the particle
         /*(*particles->particles)[i].pos.x += px*engine->dtime;
         (*particles->particles)[i].pos.y += py*engine->dtime;
         (*particles->particles)[i].pos.z += pz*engine->dtime;*/
       }
+
+      // all ribbons at once, then draw them
+      gravity_lines::integrate(batch.get_pointer(), batch.size());
+      for (unsigned long i = 0; i < particles->particles->size(); ++i) {
+        gr[i]->end_update();
+        gr[i]->render();
+      }
       //printf("done drawing\n");
     }
 	render_result->set(1);
@@ -400,6 +410,8 @@ class vsx_module_gravity_ribbon_mesh : public vsx_module {
   // internal
   vsx_avector<gravity_strip*> gr;
   gravity_strip* grp;
+  // the strips updated this frame, for gravity_lines::integrate
+  vsx_array<gravity_lines*> batch;
   vsx_mesh** mesh;
   vsx_mesh* mesh_out;
 
@@ -500,6 +512,16 @@ public:
     mesh_result = (vsx_module_param_mesh*)out_parameters.create(VSX_MODULE_PARAM_ID_MESH,"mesh_out");
   }
 
+  // steps all the strips that had begin_update() this frame
+  void integrate_batch()
+  {
+    gravity_lines::integrate(batch.get_pointer(), batch.size());
+    for (unsigned long i = 0; i < batch.size(); ++i)
+    {
+      batch[i]->end_update();
+    }
+  }
+
   void output(vsx_module_param_abs* param) {
     mesh = in_mesh->get_addr();
 
@@ -531,13 +553,14 @@ public:
 
 
       //printf("in-mesh vertex count: %d\n", mesh->data->vertices.size());
+      batch.reset_used(0);
       if (param == render_result)
       {
         for (unsigned long i = 0; i < prev_num_vertices; ++i)
         {
           //gr[i].length = 0.0f;
           gr[i]->width = ribbon_width->get();
-          //gr[i].masses[1].mass = gr[i].masses[0].mass + ribbon_width->get();
+          //gr[i].mass[1] = gr[i].mass[0] + ribbon_width->get();
           gr[i]->length = length->get();
           gr[i]->friction = friction->get();
           //float tt = ((*particles->particles)[i].time/(*particles->particles)[i].lifetime);
@@ -562,14 +585,14 @@ public:
             );
           } else
           {
-            gr[i]->update(
+            gr[i]->begin_update(
               engine->dtime,
               (*mesh)->data->vertices[mesh_index].x,
               (*mesh)->data->vertices[mesh_index].y,
               (*mesh)->data->vertices[mesh_index].z
             );
+            batch.push_back(gr[i]);
           }
-          gr[i]->render();
               //(*(particles->particles))[i].pos.x, (*(particles->particles))[i].pos.y, (*(particles->particles))[i].pos.z);
             //last_upd ate = engine->vtime;
           //}
@@ -582,6 +605,11 @@ public:
           mesh_index++;
           mesh_index = mesh_index % (*mesh)->data->vertices.size();
         }
+        integrate_batch();
+        for (unsigned long i = 0; i < prev_num_vertices; ++i)
+        {
+          gr[i]->render();
+        }
       }
       else
       {
@@ -645,19 +673,22 @@ public:
             );
           } else
           {
-            gr[i]->update(
+            gr[i]->begin_update(
               engine->dtime,
               (*mesh)->data->vertices[mesh_index].x,
               (*mesh)->data->vertices[mesh_index].y,
               (*mesh)->data->vertices[mesh_index].z
             );
+            batch.push_back(gr[i]);
           }
-          //printf("%d\n", (int)i);
-
-          gr[i]->generate_mesh(*mesh_out,fs_d, vs_d, ns_d, ts_d, matrix_result, &upv, generated_vertices, generated_faces);
           mesh_index++;
           mesh_index = mesh_index % (*mesh)->data->vertices.size();
         }
+        integrate_batch();
+        for (unsigned long i = 0; i < prev_num_vertices; ++i)
+        {
+          gr[i]->generate_mesh(*mesh_out,fs_d, vs_d, ns_d, ts_d, matrix_result, &upv, generated_vertices, generated_faces);
+        }
 
 //        printf("generated faces: %d\n", generated_faces);
         //printf("generated vertices: %d\n", generated_vertices);
@@ -0,0 +1,200 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef FACE_ZSORT_H
+#define FACE_ZSORT_H
+
+#include <string.h>
+#include "vsx_array.h"
+
+// Depth ordering of faces for the transparency renderer.
+//
+// sort() orders face indices by a float key, smallest first. It's a three
+// pass LSD radix sort, 11 bits per pass, over buffers kept between calls:
+// linear time, no recursion and no bad case for already sorted input.
+// The floats are mapped to unsigned ints that compare the same way.
+//
+// Between frames where the camera only moved a little, last frame's
+// order is nearly right. With the coherent hint, sort() first tries an
+// insertion sort over the previous order. That costs O(n + moves). If
+// the order changed more than FACE_ZSORT_MAX_MOVES moves per face, it
+// gives up and falls back to the radix sort, so a wrong hint only costs
+// the attempt.
+//
+// Nothing GL in here, so it can be run and timed on its own.
+
+#define FACE_ZSORT_BITS 11
+#define FACE_ZSORT_BUCKETS (1 << FACE_ZSORT_BITS)
+#define FACE_ZSORT_MASK (FACE_ZSORT_BUCKETS - 1)
+
+// insertion sort moves per face before falling back to the radix sort
+#define FACE_ZSORT_MAX_MOVES 8
+
+class face_zsort
+{
+  // face ids in sorted order and their keys, double buffered for the
+  // radix passes; [front] holds the result
+  vsx_array<unsigned int> order[2];
+  vsx_array<unsigned int> keys[2];
+  int front;
+
+  // key of each face, by face id
+  vsx_array<unsigned int> face_keys;
+
+  size_t sorted_count;
+  bool incremental;
+
+  unsigned int histogram[3][FACE_ZSORT_BUCKETS];
+
+  // positive floats get the sign bit set, negative ones all bits flipped
+  static inline unsigned int float_key(float f)
+  {
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    return u ^ ((unsigned int)((int)u >> 31) | 0x80000000u);
+  }
+
+  void radix_sort(size_t count)
+  {
+    const unsigned int* fk = face_keys.get_pointer();
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < count; i++)
+    {
+      unsigned int k = fk[i];
+      histogram[0][k & FACE_ZSORT_MASK]++;
+      histogram[1][(k >> FACE_ZSORT_BITS) & FACE_ZSORT_MASK]++;
+      histogram[2][k >> (2 * FACE_ZSORT_BITS)]++;
+    }
+
+    // start from face order
+    front = 0;
+    unsigned int* o = order[0].get_pointer();
+    unsigned int* k = keys[0].get_pointer();
+    for (size_t i = 0; i < count; i++)
+    {
+      o[i] = (unsigned int)i;
+      k[i] = fk[i];
+    }
+
+    for (int pass = 0; pass < 3; pass++)
+    {
+      unsigned int* h = histogram[pass];
+      int shift = pass * FACE_ZSORT_BITS;
+      const unsigned int* src_o = order[front].get_pointer();
+      const unsigned int* src_k = keys[front].get_pointer();
+
+      // all keys share this digit, nothing to do
+      if (h[(src_k[0] >> shift) & FACE_ZSORT_MASK] == count)
+        continue;
+
+      unsigned int sum = 0;
+      for (int i = 0; i < FACE_ZSORT_BUCKETS; i++)
+      {
+        unsigned int c = h[i];
+        h[i] = sum;
+        sum += c;
+      }
+
+      unsigned int* dst_o = order[front ^ 1].get_pointer();
+      unsigned int* dst_k = keys[front ^ 1].get_pointer();
+      for (size_t i = 0; i < count; i++)
+      {
+        unsigned int p = h[(src_k[i] >> shift) & FACE_ZSORT_MASK]++;
+        dst_o[p] = src_o[i];
+        dst_k[p] = src_k[i];
+      }
+      front ^= 1;
+    }
+  }
+
+  // false if it ran out of moves, the order is still a valid permutation
+  bool insertion_sort(size_t count)
+  {
+    const unsigned int* fk = face_keys.get_pointer();
+    unsigned int* o = order[front].get_pointer();
+    size_t moves_left = count * FACE_ZSORT_MAX_MOVES;
+    for (size_t i = 1; i < count; i++)
+    {
+      unsigned int id = o[i];
+      unsigned int key = fk[id];
+      size_t j = i;
+      while (j > 0 && fk[o[j - 1]] > key)
+      {
+        o[j] = o[j - 1];
+        j--;
+        if (!--moves_left)
+        {
+          o[j] = id;
+          return false;
+        }
+      }
+      o[j] = id;
+    }
+    return true;
+  }
+
+public:
+
+  face_zsort()
+  {
+    front = 0;
+    sorted_count = 0;
+    incremental = false;
+  }
+
+  // Sorts faces [0, count) by depth (smallest first) and returns the
+  // face ids in that order, valid until the next call. Pass coherent
+  // when the depths are likely close to the previous call's.
+  const unsigned int* sort(const float* depth, size_t count, bool coherent)
+  {
+    if (!count)
+    {
+      sorted_count = 0;
+      return 0;
+    }
+    unsigned int* fk = face_keys.resize(count);
+    for (size_t i = 0; i < count; i++)
+      fk[i] = float_key(depth[i]);
+
+    incremental = coherent && count == sorted_count && insertion_sort(count);
+    if (!incremental)
+    {
+      for (int i = 0; i < 2; i++)
+      {
+        order[i].resize(count);
+        keys[i].resize(count);
+      }
+      radix_sort(count);
+    }
+    sorted_count = count;
+    return order[front].get_pointer();
+  }
+
+  // true if the last sort() got away with the insertion sort
+  bool was_incremental()
+  {
+    return incremental;
+  }
+};
+
+#endif
@@ -594,19 +594,8 @@ public:
   }
 };
 
-class face_holder {
-public:
-  double dist;
-  int id;
-  bool operator < (const face_holder& a) {
-      return dist > a.dist;
-  }
-  //face_holder() : dist(0),id(0) {};
-};
-
-
-
 #include "module_render_mesh.h"
+#include "face_zsort.h"
 
 
 
@@ -773,8 +762,10 @@ class vsx_module_render_mesh_zsort : public vsx_module {
   vsx_texture** ta;
   bool m_normals, m_tex, m_colors;
   vsx_matrix mod_mat, proj_mat;
-  vsx_avector_nd<face_holder> f_distances;
-  vsx_avector_nd<vsx_face> f_result;
+  face_zsort zsort;
+  vsx_array<float> f_distances;
+  vsx_array<vsx_face> f_result;
+  vsx_vector prev_sort_dir;
 public:
   void module_info(vsx_module_info* info)
   {
@@ -801,40 +792,6 @@ public:
   }
 
 
-  static int fpartition(face_holder* a, int first, int last) {
-    face_holder pivot = a[first];
-    int lastS1 = first;
-    int firstUnknown = first + 1;
-    while (firstUnknown <= last) {
-      if (a[firstUnknown] < pivot) {
-        lastS1++;
-        face_holder b = a[firstUnknown];
-        a[firstUnknown] = a[lastS1];
-        a[lastS1] = b;
-        //printf("a");
-        //std::swap(a[firstUnknown], a[lastS1]);
-      }
-      firstUnknown++;
-    }
-    face_holder b = a[first];
-    a[first] = a[lastS1];
-    a[lastS1] = b;
-    //std::swap(a[first], a[lastS1]);
-    return lastS1;
-  }
-
-  static void fquicksort(face_holder* a, int first, int last) {
-    if (first < last) {
-      int pivotIndex = fpartition(a, first, last);
-      fquicksort(a, first, pivotIndex - 1);
-      fquicksort(a, pivotIndex + 1, last);
-    }
-  }
-
-  static void fquicksort(face_holder* a, int aSize) {
-    fquicksort(a, 0, aSize - 1);
-  }
-
   void output(vsx_module_param_abs* param)
   {
     VSX_UNUSED(param);
@@ -887,31 +844,37 @@ public:
         //b.z*=10;
         //b.dump("camera_pos");
 
-        // make sure we have centers to sort on
-        if (!(*mesh)->data->face_centers.size()) {
-          (*mesh)->data->calculate_face_centers();
-        }
-        // loop through all the faces and calculate the distance from the camera
-        for (unsigned long i = 0; i < (*mesh)->data->face_centers.size(); ++i) {
-          //f_distances[i].dist = (*mesh)->data->face_centers[i].distance(b);
-          f_distances[i].dist = (*mesh)->data->face_centers[i].dot_product(&sort_vec);
-          f_distances[i].id = i;
-          /*glPushMatrix();
-          glTranslatef((*mesh)->data->face_centers[i].x,(*mesh)->data->face_centers[i].y,(*mesh)->data->face_centers[i].z);
-          glColor4f(1,1,1,1);
-          gluSphere(quadratic,0.1,20,20);
-          glPopMatrix();
-          printf("id: %d  dist: %f\n",i, f_distances[i].dist);*/
-        }
-        //printf("-----\n");
-        // we have the distances, now time to sort
-        //std::sort(f_distances, f_distances.get_end_pointer());
-        fquicksort(f_distances.get_pointer(),f_distances.size());
-        for (unsigned long i = 0; i < (*mesh)->data->face_centers.size(); ++i) {
-          //printf("id: %d  dist: %f\n",f_distances[i].id, f_distances[i].dist);
-          f_result[i] = (*mesh)->data->faces[f_distances[i].id];
-          //f_result[(*mesh)->data->face_centers.size()-1-i] = (*mesh)->data->faces[f_distances[i].id];
+        // Distance of each face along the view direction, the sum of its
+        // corners standing in for the center. Negated as the farthest
+        // faces go first.
+        size_t face_count = (*mesh)->data->faces.size();
+        const vsx_face* faces = (*mesh)->data->faces.get_pointer();
+        const vsx_vector* vertices = (*mesh)->data->vertices.get_pointer();
+        f_distances.allocate(face_count);
+        float* dist = f_distances.get_pointer();
+        for (size_t i = 0; i < face_count; ++i) {
+          const vsx_vector& a = vertices[faces[i].a];
+          const vsx_vector& b = vertices[faces[i].b];
+          const vsx_vector& c = vertices[faces[i].c];
+          dist[i] = -(
+            (a.x + b.x + c.x) * sort_vec.x +
+            (a.y + b.y + c.y) * sort_vec.y +
+            (a.z + b.z + c.z) * sort_vec.z
+          );
         }
+
+        // a small camera move leaves the previous order nearly sorted
+        vsx_vector sort_dir = sort_vec;
+        sort_dir.normalize();
+        bool coherent = sort_dir.dot_product(&prev_sort_dir) > 0.99f;
+        prev_sort_dir = sort_dir;
+
+        const unsigned int* order = zsort.sort(dist, face_count, coherent);
+        f_result.allocate(face_count);
+        f_result.reset_used(face_count);
+        vsx_face* result = f_result.get_pointer();
+        for (size_t i = 0; i < face_count; ++i)
+          result[i] = faces[order[i]];
         //printf("f_Result.size: %d\n",f_result.size());
 
 
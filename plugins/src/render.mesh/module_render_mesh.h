@@ -94,6 +94,50 @@ class vsx_module_render_mesh : public vsx_module
   size_t current_num_vertices;
   size_t current_num_faces;
 
+  // which version of each stream the vbo holds (vsx_array::timestamp and
+  // buffer), so streams a modifier chain didn't touch aren't sent again
+  enum
+  {
+    stream_normals,
+    stream_tex_coords,
+    stream_colors,
+    stream_vertices,
+    stream_faces,
+    stream_count
+  };
+  size_t uploaded_stamp[stream_count];
+  void* uploaded_pointer[stream_count];
+
+  // unstamped streams (0, from modules not keeping stamps) always count
+  // as changed
+  template<class T>
+  bool stream_changed(vsx_array<T>& stream, int slot)
+  {
+    return
+      stream.timestamp == 0
+      ||
+      uploaded_stamp[slot] != stream.timestamp
+      ||
+      uploaded_pointer[slot] != (void*)stream.get_pointer()
+    ;
+  }
+
+  template<class T>
+  void stream_uploaded(vsx_array<T>& stream, int slot)
+  {
+    uploaded_stamp[slot] = stream.timestamp;
+    uploaded_pointer[slot] = (void*)stream.get_pointer();
+  }
+
+  void streams_uploaded()
+  {
+    stream_uploaded((*mesh)->data->vertex_normals, stream_normals);
+    stream_uploaded((*mesh)->data->vertex_tex_coords, stream_tex_coords);
+    stream_uploaded((*mesh)->data->vertex_colors, stream_colors);
+    stream_uploaded((*mesh)->data->vertices, stream_vertices);
+    stream_uploaded((*mesh)->data->faces, stream_faces);
+  }
+
 
   ///////////////////////////////////////////////////////////////////////////////
   // generate vertex buffer object and bind it with its data
@@ -286,6 +330,7 @@ class vsx_module_render_mesh : public vsx_module
     current_num_faces = (*mesh)->data->faces.size();
     glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
     //HANDLE_GL_ERROR;
+    streams_uploaded();
     return true;
   }
 
@@ -299,6 +344,8 @@ class vsx_module_render_mesh : public vsx_module
 
     vbo_id_vertex_normals_texcoords = 0;
     vbo_id_draw_indices = 0;
+    for (int i = 0; i < stream_count; i++)
+      uploaded_stamp[i] = 0;
   }
 
 
@@ -396,6 +443,11 @@ public:
     current_vbo_draw_type = 0;
     current_num_vertices = 0;
     current_num_faces = 0;
+    for (int i = 0; i < stream_count; i++)
+    {
+      uploaded_stamp[i] = 0;
+      uploaded_pointer[i] = 0;
+    }
 
     // vbo handles
     vbo_id_vertex_normals_texcoords = 0;
@@ -679,7 +731,7 @@ public:
     {
       //printf("uploading %d vertices to VBO\n", (*mesh)->data->vertices.size());
       //printf("vertices ofset: %d\n", offset_vertices);
-      if ((*mesh)->data->vertex_normals.get_used())
+      if ((*mesh)->data->vertex_normals.get_used() && stream_changed((*mesh)->data->vertex_normals, stream_normals))
       {
         glBufferSubDataARB
         (
@@ -690,7 +742,7 @@ public:
         );
       }
 
-      if ((*mesh)->data->vertex_tex_coords.get_used())
+      if ((*mesh)->data->vertex_tex_coords.get_used() && stream_changed((*mesh)->data->vertex_tex_coords, stream_tex_coords))
       {
         // optimize away the UV uploads
         if
@@ -710,7 +762,7 @@ public:
 
       if (use_vertex_colors->get())
       {
-        if ((*mesh)->data->vertex_colors.get_used())
+        if ((*mesh)->data->vertex_colors.get_used() && stream_changed((*mesh)->data->vertex_colors, stream_colors))
         {
           glBufferSubDataARB
           (
@@ -721,15 +773,36 @@ public:
           );
         }
       }
-      glBufferSubDataARB
-      (
-        GL_ARRAY_BUFFER_ARB,
-        offset_vertices,
-        (*mesh)->data->vertices.get_sizeof(),
-        (*mesh)->data->vertices.get_pointer()
-      );
+      if (stream_changed((*mesh)->data->vertices, stream_vertices))
+      {
+        glBufferSubDataARB
+        (
+          GL_ARRAY_BUFFER_ARB,
+          offset_vertices,
+          (*mesh)->data->vertices.get_sizeof(),
+          (*mesh)->data->vertices.get_pointer()
+        );
+      }
       num_uploads++;
 
+      // the indices were static until now, only follow stamped changes
+      if ((*mesh)->data->faces.timestamp && stream_changed((*mesh)->data->faces, stream_faces))
+      {
+        glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, vbo_id_draw_indices);
+        glBufferSubDataARB
+        (
+          GL_ELEMENT_ARRAY_BUFFER_ARB,
+          0,
+          (*mesh)->data->faces.get_sizeof(),
+          (*mesh)->data->faces.get_pointer()
+        );
+        glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+      }
+      streams_uploaded();
+      // colors weren't sent, send them when they're switched on
+      if (!use_vertex_colors->get())
+        uploaded_stamp[stream_colors] = 0;
+
     }
     // unbind the VBO buffers
     glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
@@ -26,11 +26,8 @@
 #include "vsx_param.h"
 #include "vsx_module.h"
 
-#include "ftgl/FTGLPolygonFont.h"
-#include "ftgl/FTGLBitmapFont.h"
-#include "ftgl/FTGLOutlineFont.h"
-#include "ftgl/FTGLTextureFont.h"
 #include "vsx_math_3d.h"
+#include "text_font_cache.h"
 
 
 
@@ -40,8 +37,8 @@ typedef struct {
 } text_info;
 
 class vsx_module_text_s : public vsx_module {
-  FTFont* ftfont;
-  FTFont* ftfont2;
+  // shared with other text modules using the same font
+  text_font* font;
   vsx_vector mf_location;
   vsx_string cur_font;
   int cur_render_type;
@@ -148,8 +145,7 @@ void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list&
 	align->set(0);
 	cur_render_type = 0;
 	
-	ftfont = 0;
-	ftfont2 = 0;
+	font = 0;
 
 	rotation_axis = (vsx_module_param_float3*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT3, "rotation_axis");
 	rotation_axis->set(0.0f, 0);
@@ -181,15 +177,15 @@ void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list&
 
 
 int process_lines() {
-  if (!ftfont) return 0;
+  if (!font) return 0;
   vsx_string deli = "\n";
   vsx_avector<vsx_string> t_lines;
   explode(text_in->get(), deli, t_lines);
   lines.clear();
   for (unsigned long i = 0; i < t_lines.size(); ++i) {
-    float x1, y1, z1, x2, y2, z2;
+    float x1, y1, x2, y2;
     lines[i].string = t_lines[i];
-    ftfont->BBox(t_lines[i].c_str(), x1, y1, z1, x2, y2, z2);
+    font->bbox(t_lines[i].c_str(), x1, y1, x2, y2);
     lines[i].size_x = x2 - x1;
     lines[i].size_y = y2 - y1;
   }
@@ -200,7 +196,7 @@ void param_set_notify(const vsx_string& name) {
   if (!declare_run) return;
   if (name == "font_in" || name == "glyph_size") {
     setup_font();
-    if (ftfont) {
+    if (font) {
     	process_lines();
     } 
   }
@@ -217,53 +213,42 @@ void setup_font() {
   		font_in->set(cur_font);
   		return;
   	} else message = "module||ok";
-    //printf("loading font: %s\n",cur_font.c_str());
-    vsxf_handle *fp;
-    if ((fp = engine->filesystem->f_open(font_in->get().c_str(), "rb")) == NULL) 
-    {
-      printf("font not found: %s\n",cur_font.c_str());
-      return;
-    }
     cur_font = font_in->get();
     cur_render_type = render_type->get();
     cur_glyph_size = glyph_size->get();
+    unsigned int face_size = (unsigned int)round(cur_glyph_size);
 
-  //printf("setup font");
-    if (ftfont) {
-      delete ftfont;
-      ftfont = 0;
+    if (font) {
+      text_font::release(font);
+      font = 0;
     }
-    if (ftfont2) {
-    	delete ftfont2;
-    	ftfont2 = 0;
+    font = text_font::acquire(engine->filesystem, cur_font, face_size, cur_render_type);
+    if (font) {
+      loading_done = true;
+      return;
+    }
+
+    //printf("loading font: %s\n",cur_font.c_str());
+    vsxf_handle *fp;
+    if ((fp = engine->filesystem->f_open(cur_font.c_str(), "rb")) == NULL)
+    {
+      printf("font not found: %s\n",cur_font.c_str());
+      return;
     }
     unsigned long size = engine->filesystem->f_get_size(fp);
     //printf("file size: %d\n",size);
-    char* fdata = (char*)malloc(size);
-    //char* tdata = engine->filesystem->f_gets_entire(fp);
+    unsigned char* fdata = (unsigned char*)malloc(size);
     unsigned long bread = engine->filesystem->f_read((void*)fdata, size, fp);
+    engine->filesystem->f_close(fp);
     //printf("after read %d\n",bread);
-    if (bread == size) {
-      switch (cur_render_type) {
-        case 0:
-          ftfont = new FTGLTextureFont((unsigned char*)fdata, size);
-//        ftfont = new FTGLTextureFont(cur_font.c_str());
-          break;
-        case 1:
-          ftfont = new FTGLPolygonFont((unsigned char*)fdata, size);
-          ftfont2 = new FTGLOutlineFont((unsigned char*)fdata, size);
-//        ftfont = new FTGLPolygonFont(cur_font.c_str());
-          break;
-      }
-      ftfont->FaceSize((unsigned int)round(cur_glyph_size));
-      ftfont->CharMap(ft_encoding_unicode);
-      if (ftfont2) {
-      	ftfont2->FaceSize((unsigned int)round(cur_glyph_size));
-      	ftfont2->CharMap(ft_encoding_unicode);
-      }
-      loading_done = true;
+    if (bread != size) {
+      free(fdata);
+      return;
     }
-    engine->filesystem->f_close(fp);
+    // the cache owns fdata from here on
+    font = text_font::create(engine->filesystem, cur_font, face_size, cur_render_type, fdata, size);
+    if (font)
+      loading_done = true;
   }
 }
 
@@ -294,7 +279,7 @@ void output(vsx_module_param_abs* param) { VSX_UNUSED(param);
     //ftfont->CharMap(ft_encoding_unicode);
 //	}
   
-  if (!ftfont) {
+  if (!font) {
     message = "module||error loading font "+cur_font;
     return;
   }
@@ -344,18 +329,18 @@ void output(vsx_module_param_abs* param) { VSX_UNUSED(param);
     
     if (cur_render_type == 1) 
 		{
-    	if (outline_alpha->get() > 0.0f && ftfont2) {
+    	if (outline_alpha->get() > 0.0f) {
     		float pre_linew;
     		glGetFloatv(GL_LINE_WIDTH, &pre_linew);
     		glLineWidth(outline_thickness->get());
     		glColor4f(outline_color->get(0),outline_color->get(1),outline_color->get(2),outline_alpha->get()*outline_color->get(3)*text_alpha->get());
-    		ftfont2->Render(lines[i].string.c_str());
+    		font->render_outline(lines[i].string.c_str());
     		glLineWidth(pre_linew);
     	}
   		glColor4f(red->get(),green->get(),blue->get(),text_alpha->get());
 		}
 		
-    ftfont->Render(lines[i].string.c_str());
+    font->render(lines[i].string.c_str());
     glPopMatrix();
     ypos += l_leading;
   }
@@ -403,12 +388,16 @@ void output(vsx_module_param_abs* param) { VSX_UNUSED(param);
 //	((vsx_param_render*)out_parameter)->set(1);
 }
 void stop() {
-  if (ftfont) {
-    delete ftfont;
-    ftfont = 0;
+  if (font) {
+    text_font::release(font);
+    font = 0;
   }
 }
 
+void on_delete() {
+  stop();
+}
+
 void start() {
   cur_font = "";
   setup_font();
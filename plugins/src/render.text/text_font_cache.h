@@ -0,0 +1,485 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef TEXT_FONT_CACHE_H
+#define TEXT_FONT_CACHE_H
+
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+#include "vsx_array.h"
+#include "vsx_string.h"
+#include "vsxfst.h"
+#include "vsx_thread_pool.h"
+#include "ftgl/FTGLPolygonFont.h"
+#include "ftgl/FTGLOutlineFont.h"
+
+// Fonts shared by all text modules in the process, keyed by
+// (filesystem, font file, glyph size, render type). Modules showing the
+// same font get the same text_font and the glyphs are only made once. The
+// filesystem is part of the key since the same name can be a different
+// file in another engine's archive.
+//
+// Texture fonts (render type 0) don't use FTGL: all 255 character codes a
+// string can hold are rasterized up front with FreeType, split over the
+// thread pool (each chunk with its own FT_Library, FreeType isn't thread
+// safe per library). The bitmaps are packed into one atlas, uploaded on
+// the first render. Advances, bounding boxes and kerning are kept in
+// tables, so layout never touches FreeType. Metrics and placement match
+// FTGLTextureFont: unhinted outlines, 72 dpi, 3 texels of padding.
+//
+// Polygon fonts (render type 1) are FTGL geometry, the FTGLPolygonFont and
+// FTGLOutlineFont pair is shared as is.
+//
+// Everything except the glyph rasterization runs on the thread the
+// modules run on, which also owns the GL context.
+
+#define TEXT_FONT_GLYPHS 256
+#define TEXT_FONT_PADDING 3
+#define TEXT_FONT_MIN_CHUNK 32
+
+class text_font
+{
+public:
+  struct glyph
+  {
+    unsigned int index;
+    float advance;
+    // outline box, for layout
+    float lower_x, lower_y, upper_x, upper_y;
+    // bitmap, placed relative to the pen
+    int left, top, width, height;
+    float u0, v0, u1, v1;
+    unsigned char* bitmap; // only while building
+  };
+
+  vsx_string key;
+  int refs;
+  int render_type;
+  unsigned int size;
+
+  // texture fonts
+  glyph glyphs[TEXT_FONT_GLYPHS];
+  // 26.6 kerning, x and y per (left, right) pair; empty without kerning
+  vsx_array<short> kerning;
+  unsigned char* atlas;
+  int atlas_width, atlas_height;
+  GLuint texture;
+
+  // polygon fonts
+  FTFont* polygon;
+  FTFont* outline;
+
+private:
+  // the font file, FreeType and FTGL faces use it in place
+  unsigned char* data;
+  unsigned long data_size;
+  bool has_kerning;
+
+  static bool open_face(text_font* f, FT_Library& library, FT_Face& face)
+  {
+    if (FT_Init_FreeType(&library))
+      return false;
+    if (
+      FT_New_Memory_Face(library, f->data, (FT_Long)f->data_size, 0, &face) ||
+      FT_Select_Charmap(face, FT_ENCODING_UNICODE) ||
+      FT_Set_Char_Size(face, 0L, f->size * 64, 72, 72)
+    )
+    {
+      FT_Done_FreeType(library);
+      return false;
+    }
+    return true;
+  }
+
+  static void rasterize_range(void* arg, size_t begin, size_t end)
+  {
+    text_font* f = (text_font*)arg;
+    FT_Library library;
+    FT_Face face;
+    if (!open_face(f, library, face))
+      return;
+    for (size_t c = begin; c < end; c++)
+    {
+      glyph& g = f->glyphs[c];
+      g.index = FT_Get_Char_Index(face, (FT_ULong)c);
+      if (FT_Load_Glyph(face, g.index, FT_LOAD_NO_HINTING))
+        continue;
+      FT_GlyphSlot slot = face->glyph;
+      g.advance = (float)slot->advance.x / 64.0f;
+      FT_BBox box;
+      FT_Outline_Get_CBox(&slot->outline, &box);
+      g.lower_x = (float)box.xMin / 64.0f;
+      g.lower_y = (float)box.yMin / 64.0f;
+      g.upper_x = (float)box.xMax / 64.0f;
+      g.upper_y = (float)box.yMax / 64.0f;
+      if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL) || slot->format != FT_GLYPH_FORMAT_BITMAP)
+        continue;
+      g.left = slot->bitmap_left;
+      g.top = slot->bitmap_top;
+      g.width = slot->bitmap.width;
+      g.height = slot->bitmap.rows;
+      if (g.width && g.height)
+      {
+        g.bitmap = (unsigned char*)malloc(g.width * g.height);
+        for (int y = 0; y < g.height; y++)
+          memcpy(g.bitmap + y * g.width, slot->bitmap.buffer + y * slot->bitmap.pitch, g.width);
+      }
+    }
+    // kerning rows for the left hand glyphs of this range
+    if (f->has_kerning)
+    {
+      unsigned int index[TEXT_FONT_GLYPHS];
+      for (size_t n = 0; n < TEXT_FONT_GLYPHS; n++)
+        index[n] = FT_Get_Char_Index(face, (FT_ULong)n);
+      short* k = f->kerning.get_pointer();
+      for (size_t c = begin; c < end; c++)
+      {
+        unsigned int left = index[c];
+        for (size_t n = 1; n < TEXT_FONT_GLYPHS; n++)
+        {
+          unsigned int right = index[n];
+          FT_Vector v;
+          v.x = v.y = 0;
+          if (left && right)
+            FT_Get_Kerning(face, left, right, FT_KERNING_UNFITTED, &v);
+          k[(c * TEXT_FONT_GLYPHS + n) * 2] = (short)v.x;
+          k[(c * TEXT_FONT_GLYPHS + n) * 2 + 1] = (short)v.y;
+        }
+      }
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+  }
+
+  // row by row in code order, like FTGL fills its textures
+  bool pack(int width, int& height)
+  {
+    int row_height = 0;
+    int x = TEXT_FONT_PADDING;
+    int y = TEXT_FONT_PADDING;
+    for (int c = 1; c < TEXT_FONT_GLYPHS; c++)
+    {
+      glyph& g = glyphs[c];
+      if (g.width + 2 * TEXT_FONT_PADDING > width)
+        return false;
+      if (x + g.width + TEXT_FONT_PADDING > width)
+      {
+        x = TEXT_FONT_PADDING;
+        y += row_height + TEXT_FONT_PADDING;
+        row_height = 0;
+      }
+      g.u0 = (float)x;
+      g.v0 = (float)y;
+      x += g.width + TEXT_FONT_PADDING;
+      if (g.height > row_height)
+        row_height = g.height;
+    }
+    height = y + row_height + TEXT_FONT_PADDING;
+    return true;
+  }
+
+  bool build_atlas()
+  {
+    memset(glyphs, 0, sizeof(glyphs));
+    {
+      FT_Library library;
+      FT_Face face;
+      if (!open_face(this, library, face))
+        return false;
+      has_kerning = FT_HAS_KERNING(face) != 0;
+      FT_Done_Face(face);
+      FT_Done_FreeType(library);
+    }
+    if (has_kerning)
+    {
+      kerning.allocate(TEXT_FONT_GLYPHS * TEXT_FONT_GLYPHS * 2);
+      kerning.reset_used(TEXT_FONT_GLYPHS * TEXT_FONT_GLYPHS * 2);
+      memset(kerning.get_pointer(), 0, sizeof(short) * TEXT_FONT_GLYPHS * TEXT_FONT_GLYPHS * 2);
+    }
+
+    vsx_thread_pool::get_instance()->parallel_for(TEXT_FONT_GLYPHS, TEXT_FONT_MIN_CHUNK, &rasterize_range, (void*)this);
+
+    // smallest power of two square-ish texture that holds everything
+    atlas_width = 64;
+    while (!pack(atlas_width, atlas_height) || atlas_height > atlas_width)
+      atlas_width <<= 1;
+    int h = 1;
+    while (h < atlas_height)
+      h <<= 1;
+    atlas_height = h;
+
+    atlas = (unsigned char*)calloc(atlas_width * atlas_height, 1);
+    for (int c = 1; c < TEXT_FONT_GLYPHS; c++)
+    {
+      glyph& g = glyphs[c];
+      int x = (int)g.u0;
+      int y = (int)g.v0;
+      for (int r = 0; r < g.height; r++)
+        memcpy(atlas + (y + r) * atlas_width + x, g.bitmap + r * g.width, g.width);
+      free(g.bitmap);
+      g.bitmap = 0;
+      g.u0 = (float)x / (float)atlas_width;
+      g.v0 = (float)y / (float)atlas_height;
+      g.u1 = (float)(x + g.width) / (float)atlas_width;
+      g.v1 = (float)(y + g.height) / (float)atlas_height;
+    }
+    return true;
+  }
+
+  void upload()
+  {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_LSB_FIRST, GL_FALSE);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, atlas_width, atlas_height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, atlas);
+    glPopClientAttrib();
+    // the GL copy is the one that's used from now on
+    free(atlas);
+    atlas = 0;
+  }
+
+  inline void kern(unsigned char c, unsigned char next, float& x, float& y)
+  {
+    x = y = 0.0f;
+    if (!has_kerning || !next)
+      return;
+    const short* k = kerning.get_pointer() + (c * TEXT_FONT_GLYPHS + next) * 2;
+    x = (float)k[0] / 64.0f;
+    y = (float)k[1] / 64.0f;
+  }
+
+  text_font()
+  {
+    refs = 1;
+    render_type = 0;
+    size = 0;
+    atlas = 0;
+    atlas_width = atlas_height = 0;
+    texture = 0;
+    polygon = 0;
+    outline = 0;
+    data = 0;
+    data_size = 0;
+    has_kerning = false;
+  }
+
+  ~text_font()
+  {
+    if (texture)
+      glDeleteTextures(1, &texture);
+    if (atlas)
+      free(atlas);
+    if (polygon)
+      delete polygon;
+    if (outline)
+      delete outline;
+    if (data)
+      free(data);
+  }
+
+  static pthread_mutex_t* cache_mutex()
+  {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    return &mutex;
+  }
+
+  static std::map<vsx_string, text_font*>& cache()
+  {
+    static std::map<vsx_string, text_font*> fonts;
+    return fonts;
+  }
+
+  static vsx_string make_key(vsxf* filesystem, const vsx_string& filename, unsigned int size, int render_type)
+  {
+    char prefix[64];
+    sprintf(prefix, "%p|%u|%d|", (void*)filesystem, size, render_type);
+    return vsx_string(prefix) + filename;
+  }
+
+public:
+
+  // The shared font, or 0 if nobody has loaded it yet. Pair with release().
+  static text_font* acquire(vsxf* filesystem, const vsx_string& filename, unsigned int size, int render_type)
+  {
+    pthread_mutex_lock(cache_mutex());
+    text_font* f = 0;
+    std::map<vsx_string, text_font*>::iterator it = cache().find(make_key(filesystem, filename, size, render_type));
+    if (it != cache().end())
+    {
+      f = it->second;
+      f->refs++;
+    }
+    pthread_mutex_unlock(cache_mutex());
+    return f;
+  }
+
+  // Makes the font from the file contents (malloc'd, ownership moves here)
+  // and shares it. 0 if FreeType can't read it. Pair with release().
+  static text_font* create(vsxf* filesystem, const vsx_string& filename, unsigned int size, int render_type, unsigned char* file_data, unsigned long file_size)
+  {
+    text_font* f = new text_font;
+    f->key = make_key(filesystem, filename, size, render_type);
+    f->render_type = render_type;
+    f->size = size;
+    f->data = file_data;
+    f->data_size = file_size;
+    if (render_type == 1)
+    {
+      f->polygon = new FTGLPolygonFont(file_data, file_size);
+      f->outline = new FTGLOutlineFont(file_data, file_size);
+      if (f->polygon->Error() || f->outline->Error())
+      {
+        delete f;
+        return 0;
+      }
+      f->polygon->FaceSize(size);
+      f->polygon->CharMap(ft_encoding_unicode);
+      f->outline->FaceSize(size);
+      f->outline->CharMap(ft_encoding_unicode);
+    }
+    else
+    if (!f->build_atlas())
+    {
+      delete f;
+      return 0;
+    }
+
+    pthread_mutex_lock(cache_mutex());
+    std::map<vsx_string, text_font*>::iterator it = cache().find(f->key);
+    if (it != cache().end())
+    {
+      // someone else got there first
+      delete f;
+      f = it->second;
+      f->refs++;
+    }
+    else
+      cache()[f->key] = f;
+    pthread_mutex_unlock(cache_mutex());
+    return f;
+  }
+
+  static void release(text_font* f)
+  {
+    pthread_mutex_lock(cache_mutex());
+    bool last = --f->refs == 0;
+    if (last)
+      cache().erase(f->key);
+    pthread_mutex_unlock(cache_mutex());
+    if (last)
+      delete f;
+  }
+
+  // same as FTFont::BBox
+  void bbox(const char* string, float& llx, float& lly, float& urx, float& ury)
+  {
+    llx = lly = urx = ury = 0.0f;
+    if (render_type == 1)
+    {
+      float llz, urz;
+      polygon->BBox(string, llx, lly, llz, urx, ury, urz);
+      return;
+    }
+    const unsigned char* c = (const unsigned char*)string;
+    if (!c || !*c)
+      return;
+    float advance = 0.0f;
+    for (; *c; c++)
+    {
+      glyph& g = glyphs[*c];
+      if (c == (const unsigned char*)string)
+      {
+        llx = g.lower_x;
+        lly = g.lower_y;
+        urx = g.upper_x;
+        ury = g.upper_y;
+      }
+      else
+      {
+        if (g.lower_x + advance < llx) llx = g.lower_x + advance;
+        if (g.lower_y < lly) lly = g.lower_y;
+        if (g.upper_x + advance > urx) urx = g.upper_x + advance;
+        if (g.upper_y > ury) ury = g.upper_y;
+      }
+      float kx, ky;
+      kern(*c, *(c + 1), kx, ky);
+      advance += kx + g.advance;
+    }
+  }
+
+  // draws at the origin, x to the right and y up, in pixels of the glyph
+  // size; texture fonts need GL_TEXTURE_2D enabled
+  void render(const char* string)
+  {
+    if (render_type == 1)
+    {
+      polygon->Render(string);
+      return;
+    }
+    if (!texture)
+      upload();
+    glBindTexture(GL_TEXTURE_2D, texture);
+    float pen_x = 0.0f;
+    float pen_y = 0.0f;
+    glBegin(GL_QUADS);
+    for (const unsigned char* c = (const unsigned char*)string; *c; c++)
+    {
+      glyph& g = glyphs[*c];
+      float x0 = pen_x + (float)g.left;
+      float y0 = pen_y + (float)g.top;
+      float x1 = x0 + (float)g.width;
+      float y1 = y0 - (float)g.height;
+      glTexCoord2f(g.u0, g.v0); glVertex2f(x0, y0);
+      glTexCoord2f(g.u0, g.v1); glVertex2f(x0, y1);
+      glTexCoord2f(g.u1, g.v1); glVertex2f(x1, y1);
+      glTexCoord2f(g.u1, g.v0); glVertex2f(x1, y0);
+      float kx, ky;
+      kern(*c, *(c + 1), kx, ky);
+      pen_x += g.advance + kx;
+      pen_y += ky;
+    }
+    glEnd();
+  }
+
+  // polygon fonts only
+  void render_outline(const char* string)
+  {
+    if (outline)
+      outline->Render(string);
+  }
+};
+
+#endif
@@ -33,9 +33,13 @@
 #include "vsx_module.h"
 #include "vsx_float_array.h"
 #include "vsx_math_3d.h"
+#include "vsx_triple_buffer.h"
 
 #include <pthread.h>
 #include "fftreal/fftreal.h"
+#include "vsx_audio_analyzer.h"
+#include "vsx_wav_reader.h"
+#include "vsx_paudio_frame.h"
 #include <unistd.h>
 
 int rtaudio_started = 0;
@@ -43,11 +47,10 @@ int rtaudio_started = 0;
 typedef struct
 {
     float l_mul;
-    vsx_float_array spectrum[2];
-    vsx_float_array wave[2];    // 512 L 512 R BANZAI!
-    //float spectrum[2][512];
-    float vu[2];
-    float octaves[2][8];
+    vsx_audio_analyzer analyzer;
+    // the audio callback publishes frames here, the listener modules pick
+    // up the latest complete one every engine frame
+    vsx_triple_buffer<vsx_paudio_frame> frames;
 } vsx_paudio_struct;
 
 vsx_paudio_struct pa_audio_data;
@@ -106,6 +109,7 @@ int rtaudio_type = 0;
 
 #include "vsx_listener_rtaudio.h"
 #include "vsx_listener_mediaplayer.h"
+#include "vsx_listener_file.h"
 
 
 //******************************************************************************
@@ -158,6 +162,8 @@ vsx_module* create_new_module(unsigned long module, void* args)
   vsx_argvector* internal_args = (vsx_argvector*) args;
   switch(module)
   {
+    case 1:
+    return (vsx_module*)(new vsx_listener_file);
     case 0:
     if (internal_args->has_param("sound_type_media_player"))
     {
@@ -207,6 +213,8 @@ vsx_module* create_new_module(unsigned long module, void* args)
 
 void destroy_module(vsx_module* m,unsigned long module)
 {
+  if (module == 1)
+    return delete (vsx_listener_file*)m;
   switch(sound_module_type)
   {
     case 0:
@@ -217,7 +225,7 @@ void destroy_module(vsx_module* m,unsigned long module)
 }
 
 unsigned long get_num_modules() {
-  return 1;
+  return 2;
 }
 
 void on_unload_library()
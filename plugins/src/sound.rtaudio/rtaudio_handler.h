@@ -25,20 +25,13 @@
   #include <sys/prctl.h>
 #endif
 
-float fftbuf[1024];
-size_t fftbuf_it = 0;
-
 // rt audio instance
 RtAudio* padc = 0x0;
 
 // reference counter
 size_t rt_refcounter = 0;
 
-FFTReal* fftr = 0x0;
-
 const float one_div_32768 = 1.0f / 32768.0f;
-const float one_div_256 = 1.0f / 256.0f;
-const float one_div_512 = 1.0f / 512.0f;
 
 
 
@@ -59,97 +52,22 @@ int record( void *outputBuffer, void *inputBuffer, unsigned int nBufferFrames,
 
   vsx_paudio_struct* pa_d = &pa_audio_data;
 
-  int j = 0;
-  // nab left channel for spectrum data
-  for (size_t i = 0; i < 512; i++)
-  {
-    const float &f = (float)buf[j] * one_div_32768;
-
-    (*(pa_d->wave[0].data))[i] = f * pa_d->l_mul;
-    fftbuf[fftbuf_it++] = f;
-    j++;
-    j++;
-  }
-  fftbuf_it = fftbuf_it % 1024;
-
-  j = 1;
+  // everything goes into our own frame, the render thread only gets to see
+  // it once it's complete
+  vsx_paudio_frame* frame = pa_d->frames.get_write();
 
+  float left[512];
+  float right[512];
   for (size_t i = 0; i < 512; i++)
   {
-    (*(pa_d->wave[1].data))[i] = (float)buf[j] * one_div_32768 * pa_d->l_mul;
-    j++;
-    j++;
-  }
-  // do some FFT's
-  float spectrum[1024];
-  float spectrum_dest[512];
-  fftr->do_fft( (float*)&spectrum, (float*) &fftbuf[0]);
-  float re, im;
-
-  for(int ii = 0; ii < 256; ii++)
-  {
-    re = spectrum[ii];
-    im = spectrum[ii + 256];
-    spectrum_dest[ii] = (float)sqrt(re * re + im * im) * one_div_256 * pa_d->l_mul;
-  }
-
-  // calc vu
-  float vu = 0.0f;
-  for (int ii = 0; ii < 256; ii++)
-  {
-    vu += spectrum_dest[ii];
-  }
-  pa_d->vu[0] = vu;
-  pa_d->vu[1] = vu;
-
-  for (size_t ii = 0; ii < 512; ii++)
-  {
-    (*(pa_d->spectrum[0].data))[ii] =
-        spectrum_dest[ii >> 1]
-                            *
-                            3.0f
-                            *
-                            pow(
-                              log(
-                                10.0f
-                                +
-                                44100.0f * ( (float)ii * one_div_512 )
-                                ),
-                              1.0f
-                              );
+    left[i] = (float)buf[i * 2] * one_div_32768;
+    right[i] = (float)buf[i * 2 + 1] * one_div_32768;
   }
 
+  vsx_paudio_fill_frame(frame, &pa_d->analyzer, left, right, pa_d->l_mul);
 
-
-  //normalize_fft( (float*)spectrum_dest, pa_d->spectrum[0]);
-
-  /*for (size_t ii = 0; ii < 512; ii++)
-  {
-    //float f = log( 2.0f + 8.0f * (ii / 512.0f) );
-    (*(pa_d->spectrum[0].data))[ii] *= pow(log( 2.0f + 8.0f * (ii / 512.0f)) ,3.0f);
-  }*/
-
-
-  const float one_div_50 = 1.0f / 50.0f;
-
-
-  #define spec_calc(cur_val, start, offset) \
-    cur_val = 0.0f;\
-    for (int ii = start * 50 + offset; ii < (start+1)*50; ii++) {\
-      cur_val += (*(pa_d->spectrum[0].data))[ii];\
-    }\
-    cur_val = (cur_val * one_div_50)
-
-  spec_calc(pa_d->octaves[0][0], 0, 10);
-  spec_calc(pa_d->octaves[0][1], 1, 0);
-  spec_calc(pa_d->octaves[0][2], 2, 0);
-  spec_calc(pa_d->octaves[0][3], 3, 0);
-  spec_calc(pa_d->octaves[0][4], 4, 0);
-  spec_calc(pa_d->octaves[0][5], 5, 0);
-  spec_calc(pa_d->octaves[0][6], 6, 0);
-  spec_calc(pa_d->octaves[0][7], 7, 0);
-
-  #undef spec_calc
+  pa_d->frames.publish();
+  return 0;
 }
 
 
@@ -164,7 +82,6 @@ void setup_rtaudio()
   else
   {
     padc = new RtAudio((RtAudio::Api)rtaudio_type);
-    fftr = new FFTReal(512);
     rt_refcounter++;
     #if (PLATFORM == PLATFORM_WINDOWS)
     rt_refcounter++;
@@ -177,19 +94,6 @@ void setup_rtaudio()
     return;
   }
 
-  vsx_paudio_struct* pa_d = &pa_audio_data;
-
-  pa_d->wave[0].data = new vsx_array<float>;
-  pa_d->wave[1].data = new vsx_array<float>;
-  for (int i = 0; i < 512; ++i) pa_d->wave[0].data->push_back(0);
-  for (int i = 0; i < 512; ++i) pa_d->wave[1].data->push_back(0);
-
-  pa_d->spectrum[0].data = new vsx_array<float>;
-  pa_d->spectrum[1].data = new vsx_array<float>;
-  for (int i = 0; i < 512; ++i) pa_d->spectrum[0].data->push_back(0);
-  for (int i = 0; i < 512; ++i) pa_d->spectrum[1].data->push_back(0);
-
-
   RtAudio::StreamParameters parameters;
   parameters.deviceId = padc->getDefaultInputDevice();
   parameters.nChannels = 2;
@@ -236,7 +140,6 @@ void shutdown_rtaudio()
 
     if ( padc->isStreamOpen() ) padc->closeStream();
     delete padc;
-    delete fftr;
     padc = 0;
   }
 }
@@ -0,0 +1,376 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_AUDIO_ANALYZER_H
+#define VSX_AUDIO_ANALYZER_H
+
+#include <math.h>
+#include <string.h>
+#include "vsx_math_3d.h"
+#if defined(VSX_MATH_3D_SSE)
+#include <xmmintrin.h>
+#endif
+
+// Spectrum analysis for the listeners: windowed FFT of the latest
+// fft_size samples every hop, reduced to the 512 spectrum bands the
+// modules have always put out.
+//
+// Settings are changed from the render thread with configure() while the
+// audio thread keeps calling process(). A new setup is built on the render
+// thread and handed over through an atomic pointer, the audio thread never
+// allocates, frees or waits.
+
+#define VSX_AUDIO_SPECTRUM_BANDS 512
+#define VSX_AUDIO_MAX_FFT_SIZE 4096
+#define VSX_AUDIO_SAMPLE_RATE 44100.0f
+
+enum vsx_audio_window
+{
+  VSX_AUDIO_WINDOW_NONE,
+  VSX_AUDIO_WINDOW_HANN,
+  VSX_AUDIO_WINDOW_HAMMING,
+  VSX_AUDIO_WINDOW_BLACKMAN
+};
+
+enum vsx_audio_band_mapping
+{
+  VSX_AUDIO_BANDS_LINEAR,
+  VSX_AUDIO_BANDS_LOG,
+  VSX_AUDIO_BANDS_MEL
+};
+
+enum vsx_audio_hop
+{
+  VSX_AUDIO_HOP_EVERY_BUFFER,
+  VSX_AUDIO_HOP_FFT_SIZE,
+  VSX_AUDIO_HOP_HALF_FFT_SIZE,
+  VSX_AUDIO_HOP_QUARTER_FFT_SIZE
+};
+
+//******************************************************************************
+// kernels
+
+// dest[i] = src[i] * w[i]
+inline void vsx_audio_mul(float* dest, const float* src, const float* w, int count)
+{
+  int i = 0;
+#if defined(VSX_MATH_3D_SSE)
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_ps(&dest[i], _mm_mul_ps(_mm_loadu_ps(&src[i]), _mm_loadu_ps(&w[i])));
+#endif
+  for (; i < count; i++)
+    dest[i] = src[i] * w[i];
+}
+
+// dest[i] = sqrt(re[i]^2 + im[i]^2) * scale
+inline void vsx_audio_magnitude(float* dest, const float* re, const float* im, int count, float scale)
+{
+  int i = 0;
+#if defined(VSX_MATH_3D_SSE)
+  __m128 s = _mm_set1_ps(scale);
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 r = _mm_loadu_ps(&re[i]);
+    __m128 m = _mm_loadu_ps(&im[i]);
+    __m128 p = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m));
+    _mm_storeu_ps(&dest[i], _mm_mul_ps(_mm_sqrt_ps(p), s));
+  }
+#endif
+  for (; i < count; i++)
+    dest[i] = sqrtf(re[i] * re[i] + im[i] * im[i]) * scale;
+}
+
+inline float vsx_audio_sum(const float* src, int count)
+{
+  int i = 0;
+  float sum = 0.0f;
+#if defined(VSX_MATH_3D_SSE)
+  if (count >= 8)
+  {
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+      acc = _mm_add_ps(acc, _mm_loadu_ps(&src[i]));
+    float a[4];
+    _mm_storeu_ps(a, acc);
+    sum = (a[0] + a[1]) + (a[2] + a[3]);
+  }
+#endif
+  for (; i < count; i++)
+    sum += src[i];
+  return sum;
+}
+
+//******************************************************************************
+// everything that depends on the settings, only touched by one thread at a time
+
+class vsx_audio_analyzer_setup
+{
+public:
+  int fft_size;
+  int hop_mode;
+  int window_type;
+  int band_mapping;
+
+  FFTReal* fft;
+  float* window;
+  float* input;
+  float* output;
+  float* magnitudes;
+  float magnitude_scale;
+  float vu_scale;
+  int band_start[VSX_AUDIO_SPECTRUM_BANDS];
+  int band_end[VSX_AUDIO_SPECTRUM_BANDS];
+  float band_weight[VSX_AUDIO_SPECTRUM_BANDS];
+
+  vsx_audio_analyzer_setup(int n_fft_size, int n_hop_mode, int n_window_type, int n_band_mapping)
+  {
+    fft_size = n_fft_size;
+    hop_mode = n_hop_mode;
+    window_type = n_window_type;
+    band_mapping = n_band_mapping;
+
+    fft = new FFTReal(fft_size);
+    window = new float[fft_size];
+    input = new float[fft_size];
+    output = new float[fft_size];
+    magnitudes = new float[fft_size / 2];
+
+    float window_sum = 0.0f;
+    for (int i = 0; i < fft_size; i++)
+    {
+      float x = 2.0f * (float)PI * (float)i / (float)(fft_size - 1);
+      switch (window_type)
+      {
+        case VSX_AUDIO_WINDOW_HANN: window[i] = 0.5f - 0.5f * cos(x); break;
+        case VSX_AUDIO_WINDOW_HAMMING: window[i] = 0.54f - 0.46f * cos(x); break;
+        case VSX_AUDIO_WINDOW_BLACKMAN: window[i] = 0.42f - 0.5f * cos(x) + 0.08f * cos(2.0f * x); break;
+        default: window[i] = 1.0f;
+      }
+      window_sum += window[i];
+    }
+
+    // amplitudes stay the same as with the original 512 point unwindowed
+    // fft regardless of size and window. vu is a sum over all bins; the
+    // sqrt keeps noise at the level the 256 bins of the original gave
+    magnitude_scale = 2.0f / window_sum;
+    vu_scale = sqrtf(256.0f / (float)(fft_size / 2));
+
+    int bins = fft_size / 2;
+    float bin_hz = VSX_AUDIO_SAMPLE_RATE / (float)fft_size;
+    float max_mel = 2595.0f * log10(1.0f + VSX_AUDIO_SAMPLE_RATE * 0.5f / 700.0f);
+    for (int b = 0; b < VSX_AUDIO_SPECTRUM_BANDS; b++)
+    {
+      float f0 = (float)b / (float)VSX_AUDIO_SPECTRUM_BANDS;
+      float f1 = (float)(b + 1) / (float)VSX_AUDIO_SPECTRUM_BANDS;
+      float e0, e1; // band edges in bins
+      switch (band_mapping)
+      {
+        case VSX_AUDIO_BANDS_LOG:
+          e0 = pow((float)bins, f0);
+          e1 = pow((float)bins, f1);
+        break;
+        case VSX_AUDIO_BANDS_MEL:
+          e0 = 700.0f * (pow(10.0f, f0 * max_mel / 2595.0f) - 1.0f) / bin_hz;
+          e1 = 700.0f * (pow(10.0f, f1 * max_mel / 2595.0f) - 1.0f) / bin_hz;
+        break;
+        default:
+          e0 = f0 * (float)bins;
+          e1 = f1 * (float)bins;
+      }
+      int start = (int)e0;
+      int end = (int)e1;
+      if (start > bins - 1) start = bins - 1;
+      if (end <= start) end = start + 1;
+      if (end > bins) end = bins;
+      band_start[b] = start;
+      band_end[b] = end;
+      band_weight[b] = 3.0f * log(10.0f + 44100.0f * ((float)b / 512.0f)) / (float)(end - start);
+    }
+  }
+
+  ~vsx_audio_analyzer_setup()
+  {
+    delete fft;
+    delete[] window;
+    delete[] input;
+    delete[] output;
+    delete[] magnitudes;
+  }
+
+  int get_hop(int buffer_size)
+  {
+    switch (hop_mode)
+    {
+      case VSX_AUDIO_HOP_FFT_SIZE: return fft_size;
+      case VSX_AUDIO_HOP_HALF_FFT_SIZE: return fft_size / 2;
+      case VSX_AUDIO_HOP_QUARTER_FFT_SIZE: return fft_size / 4;
+    }
+    return buffer_size;
+  }
+};
+
+//******************************************************************************
+
+class vsx_audio_analyzer
+{
+  float history[VSX_AUDIO_MAX_FFT_SIZE];
+  int history_pos;
+  int since_analysis;
+
+  vsx_audio_analyzer_setup* setup; // audio thread
+  vsx_audio_analyzer_setup* volatile pending; // render -> audio
+  vsx_audio_analyzer_setup* volatile retired; // audio -> render
+
+  // requested on the render thread
+  int fft_size;
+  int hop_mode;
+  int window_type;
+  int band_mapping;
+
+public:
+
+  // last analysis
+  float spectrum[VSX_AUDIO_SPECTRUM_BANDS];
+  float vu;
+
+  vsx_audio_analyzer()
+  {
+    memset(history, 0, sizeof(history));
+    memset(spectrum, 0, sizeof(spectrum));
+    vu = 0.0f;
+    history_pos = 0;
+    since_analysis = 0;
+    fft_size = 512;
+    hop_mode = VSX_AUDIO_HOP_EVERY_BUFFER;
+    window_type = VSX_AUDIO_WINDOW_NONE;
+    band_mapping = VSX_AUDIO_BANDS_LINEAR;
+    setup = new vsx_audio_analyzer_setup(fft_size, hop_mode, window_type, band_mapping);
+    pending = 0;
+    retired = 0;
+  }
+
+  ~vsx_audio_analyzer()
+  {
+    delete setup;
+    delete pending;
+    delete retired;
+  }
+
+  // render thread
+  void configure(int n_fft_size, int n_hop_mode, int n_window_type, int n_band_mapping)
+  {
+    collect();
+    if (n_fft_size < 256) n_fft_size = 256;
+    if (n_fft_size > VSX_AUDIO_MAX_FFT_SIZE) n_fft_size = VSX_AUDIO_MAX_FFT_SIZE;
+    if
+    (
+      n_fft_size == fft_size &&
+      n_hop_mode == hop_mode &&
+      n_window_type == window_type &&
+      n_band_mapping == band_mapping
+    )
+      return;
+    fft_size = n_fft_size;
+    hop_mode = n_hop_mode;
+    window_type = n_window_type;
+    band_mapping = n_band_mapping;
+    vsx_audio_analyzer_setup* n = new vsx_audio_analyzer_setup(fft_size, hop_mode, window_type, band_mapping);
+    __sync_synchronize();
+    // if the audio thread didn't get to the previous one it never will
+    delete __sync_lock_test_and_set(&pending, n);
+  }
+
+  // render thread, frees the setup the audio thread let go of
+  void collect()
+  {
+    vsx_audio_analyzer_setup* r = retired;
+    if (!r) return;
+    delete r;
+    __sync_synchronize();
+    retired = 0;
+  }
+
+  // audio thread: feeds count mono samples, returns true if a new
+  // analysis was made
+  bool process(const float* samples, int count, float l_mul)
+  {
+    // only switch when the previous setup has been collected so there's
+    // never more than one in flight
+    if (pending && !retired)
+    {
+      vsx_audio_analyzer_setup* n = __sync_lock_test_and_set(&pending, (vsx_audio_analyzer_setup*)0);
+      if (n)
+      {
+        retired = setup;
+        setup = n;
+        since_analysis = setup->get_hop(count);
+      }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      history[history_pos] = samples[i];
+      history_pos = (history_pos + 1) & (VSX_AUDIO_MAX_FFT_SIZE - 1);
+    }
+    since_analysis += count;
+    int hop = setup->get_hop(count);
+    if (since_analysis < hop)
+      return false;
+    since_analysis %= hop;
+
+    analyze(l_mul);
+    return true;
+  }
+
+  void analyze(float l_mul)
+  {
+    vsx_audio_analyzer_setup* s = setup;
+    int n = s->fft_size;
+
+    // latest n samples in order, windowed
+    int start = (history_pos - n) & (VSX_AUDIO_MAX_FFT_SIZE - 1);
+    int first = VSX_AUDIO_MAX_FFT_SIZE - start;
+    if (first > n) first = n;
+    vsx_audio_mul(s->input, &history[start], s->window, first);
+    if (first < n)
+      vsx_audio_mul(&s->input[first], history, &s->window[first], n - first);
+
+    s->fft->do_fft(s->output, s->input);
+
+    // FFTReal puts the real parts in the lower half, imaginary in the upper
+    int bins = n / 2;
+    vsx_audio_magnitude(s->magnitudes, s->output, &s->output[bins], bins, s->magnitude_scale * l_mul);
+
+    vu = vsx_audio_sum(s->magnitudes, bins) * s->vu_scale;
+
+    for (int b = 0; b < VSX_AUDIO_SPECTRUM_BANDS; b++)
+    {
+      int b0 = s->band_start[b];
+      int len = s->band_end[b] - b0;
+      float v = len == 1 ? s->magnitudes[b0] : vsx_audio_sum(&s->magnitudes[b0], len);
+      spectrum[b] = v * s->band_weight[b];
+    }
+  }
+};
+
+#endif
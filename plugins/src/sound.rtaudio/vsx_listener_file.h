@@ -0,0 +1,389 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "vsx_param.h"
+#include "vsx_module.h"
+#if (PLATFORM == PLATFORM_LINUX)
+  #include <sys/prctl.h>
+#endif
+#include "vsx_float_array.h"
+#include "vsx_triple_buffer.h"
+#include "vsx_timer.h"
+#include "vsx_wav_reader.h"
+#include "vsx_paudio_frame.h"
+
+#define VSX_LISTENER_FILE_REALTIME 0
+#define VSX_LISTENER_FILE_FRAME_LOCKED 1
+
+// Same outputs as the sound card listener but fed from a WAV/PCM file, so
+// states can be run and measured with identical input every time.
+//
+// realtime:     a feeder thread hands out 512 samples every 11.6 ms, the
+//               same way the audio callback does
+// frame_locked: every engine frame advances the file by exactly the frame
+//               time, with set_constant_frame_progression() the output
+//               only depends on the frame number
+class vsx_listener_file : public vsx_module {
+  // in
+  vsx_module_param_resource* filename;
+  vsx_module_param_int* playback;
+  vsx_module_param_int* loop;
+  vsx_module_param_float* multiplier;
+  vsx_module_param_int* fft_size;
+  vsx_module_param_int* hop_size;
+  vsx_module_param_int* window;
+  vsx_module_param_int* band_mapping;
+  // out
+  vsx_module_param_float* vu_l_p;
+  vsx_module_param_float* vu_r_p;
+  vsx_module_param_float* octaves_l_0_p;
+  vsx_module_param_float* octaves_l_1_p;
+  vsx_module_param_float* octaves_l_2_p;
+  vsx_module_param_float* octaves_l_3_p;
+  vsx_module_param_float* octaves_l_4_p;
+  vsx_module_param_float* octaves_l_5_p;
+  vsx_module_param_float* octaves_l_6_p;
+  vsx_module_param_float* octaves_l_7_p;
+  vsx_module_param_float* octaves_r_0_p;
+  vsx_module_param_float* octaves_r_1_p;
+  vsx_module_param_float* octaves_r_2_p;
+  vsx_module_param_float* octaves_r_3_p;
+  vsx_module_param_float* octaves_r_4_p;
+  vsx_module_param_float* octaves_r_5_p;
+  vsx_module_param_float* octaves_r_6_p;
+  vsx_module_param_float* octaves_r_7_p;
+  vsx_module_param_float_array* wave_p;
+  vsx_float_array wave;
+  vsx_float_array spectrum;
+  vsx_module_param_float_array* spectrum_p;
+  vsx_module_param_float_array* spectrum_p_hq;
+
+  // internals
+  vsx_string current_filename;
+  int current_playback;
+  vsx_wav_reader reader;
+  vsx_audio_analyzer analyzer;
+  vsx_triple_buffer<vsx_paudio_frame> frames;
+
+  // frame_locked: samples owed to the analysis, carried between frames
+  double samples_due;
+
+  // realtime
+  pthread_t feeder_thread;
+  bool feeder_running;
+  volatile int feeder_stop;
+  volatile float feeder_l_mul;
+
+  void read_block(float l_mul)
+  {
+    float left[512];
+    float right[512];
+    reader.read(left, right, 512);
+    vsx_paudio_fill_frame(frames.get_write(), &analyzer, left, right, l_mul);
+    frames.publish();
+  }
+
+  static void* feeder(void* ptr)
+  {
+    vsx_listener_file* my = (vsx_listener_file*)ptr;
+    #if (PLATFORM == PLATFORM_LINUX)
+      char* cal = "sound.file";
+      prctl(PR_SET_NAME,cal);
+    #endif
+    vsx_timer timer;
+    timer.start();
+    double start = timer.atime();
+    double block_time = 512.0 / (double)VSX_WAV_READER_RATE;
+    unsigned long blocks = 0;
+    while (!my->feeder_stop)
+    {
+      double wait = start + (double)blocks * block_time - timer.atime();
+      if (wait > 0.0)
+      {
+        #if (PLATFORM_FAMILY == PLATFORM_FAMILY_WINDOWS)
+          Sleep((DWORD)(wait * 1000.0));
+        #else
+          usleep((useconds_t)(wait * 1000000.0));
+        #endif
+        continue;
+      }
+      // fell far behind (debugger, suspended machine), don't try to catch up
+      if (wait < -0.25)
+      {
+        start = timer.atime();
+        blocks = 0;
+      }
+      my->read_block(my->feeder_l_mul);
+      blocks++;
+    }
+    return 0;
+  }
+
+  void start_feeder()
+  {
+    if (feeder_running) return;
+    feeder_stop = 0;
+    feeder_running = pthread_create(&feeder_thread, NULL, &feeder, (void*)this) == 0;
+  }
+
+  void stop_feeder()
+  {
+    if (!feeder_running) return;
+    feeder_stop = 1;
+    pthread_join(feeder_thread, NULL);
+    feeder_running = false;
+  }
+
+public:
+
+void module_info(vsx_module_info* info)
+{
+  info->output = 1;
+  info->identifier = "sound;input_visualization_listener_file";
+#ifndef VSX_NO_CLIENT
+  info->description = "Same outputs as the sound card\n\
+listener, from a WAV or raw PCM file.\n\
+realtime plays the file like a live\n\
+input, frame_locked advances it by\n\
+the engine frame time so the output\n\
+is identical every run.\n\
+The octaves are 0 = bass, 7 = treble";
+  info->in_param_spec = "\
+filename:resource,\
+playback:enum?realtime|frame_locked,\
+loop:enum?no|yes,\
+multiplier:float,\
+analysis:complex{\
+fft_size:enum?256|512|1024|2048|4096,\
+hop_size:enum?every_buffer|fft_size|half_fft_size|quarter_fft_size,\
+window:enum?none|hann|hamming|blackman,\
+band_mapping:enum?linear|log|mel\
+}\
+";
+  info->out_param_spec = "\
+vu:complex{\
+vu_l:float,\
+vu_r:float\
+},\
+octaves:complex{\
+  left:complex{\
+    octaves_l_0:float,\
+    octaves_l_1:float,\
+    octaves_l_2:float,\
+    octaves_l_3:float,\
+    octaves_l_4:float,\
+    octaves_l_5:float,\
+    octaves_l_6:float,\
+    octaves_l_7:float\
+  },\
+  right:complex{\
+    octaves_r_0:float,\
+    octaves_r_1:float,\
+    octaves_r_2:float,\
+    octaves_r_3:float,\
+    octaves_r_4:float,\
+    octaves_r_5:float,\
+    octaves_r_6:float,\
+    octaves_r_7:float\
+  }\
+},\
+wave:float_array,\
+normal:complex{spectrum:float_array},hq:complex{spectrum_hq:float_array}";
+  info->component_class = "output";
+#endif
+}
+
+void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list& out_parameters)
+{
+  filename = (vsx_module_param_resource*)in_parameters.create(VSX_MODULE_PARAM_ID_RESOURCE,"filename");
+  filename->set("");
+  current_filename = "";
+
+  playback = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"playback");
+  current_playback = -1;
+  loop = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"loop");
+  loop->set(1);
+
+  multiplier = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"multiplier");
+  multiplier->set(1);
+
+  fft_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"fft_size");
+  fft_size->set(1);
+  hop_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"hop_size");
+  window = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"window");
+  band_mapping = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"band_mapping");
+
+  //////////////////
+
+  vu_l_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"vu_l");
+  vu_r_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"vu_r");
+  vu_l_p->set(0);
+  vu_r_p->set(0);
+  octaves_l_0_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_0");
+  octaves_l_1_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_1");
+  octaves_l_2_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_2");
+  octaves_l_3_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_3");
+  octaves_l_4_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_4");
+  octaves_l_5_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_5");
+  octaves_l_6_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_6");
+  octaves_l_7_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_l_7");
+  octaves_r_0_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_0");
+  octaves_r_1_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_1");
+  octaves_r_2_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_2");
+  octaves_r_3_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_3");
+  octaves_r_4_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_4");
+  octaves_r_5_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_5");
+  octaves_r_6_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_6");
+  octaves_r_7_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"octaves_r_7");
+  octaves_l_0_p->set(0);
+  octaves_l_1_p->set(0);
+  octaves_l_2_p->set(0);
+  octaves_l_3_p->set(0);
+  octaves_l_4_p->set(0);
+  octaves_l_5_p->set(0);
+  octaves_l_6_p->set(0);
+  octaves_l_7_p->set(0);
+  octaves_r_0_p->set(0);
+  octaves_r_1_p->set(0);
+  octaves_r_2_p->set(0);
+  octaves_r_3_p->set(0);
+  octaves_r_4_p->set(0);
+  octaves_r_5_p->set(0);
+  octaves_r_6_p->set(0);
+  octaves_r_7_p->set(0);
+  wave_p = (vsx_module_param_float_array*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT_ARRAY,"wave");
+  wave.data = new vsx_array<float>;
+  for (int i = 0; i < 512; ++i) wave.data->push_back(0);
+  wave_p->set_p(wave);
+
+  spectrum_p = (vsx_module_param_float_array*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT_ARRAY,"spectrum");
+  spectrum_p_hq = (vsx_module_param_float_array*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT_ARRAY,"spectrum_hq");
+  spectrum.data = new vsx_array<float>;
+  for (int i = 0; i < 512; ++i) spectrum.data->push_back(0);
+  spectrum_p->set_p(spectrum);
+  spectrum_p_hq->set_p(spectrum);
+
+  samples_due = 0.0;
+  feeder_running = false;
+  feeder_stop = 0;
+  feeder_l_mul = 1.0f;
+
+  loading_done = true;
+}
+
+bool init() {
+  return true;
+}
+
+void on_delete() {
+  stop_feeder();
+  reader.close();
+  delete wave.data;
+  delete spectrum.data;
+}
+
+void run()
+{
+  float l_mul = multiplier->get()*engine->amp;
+  analyzer.configure(
+    256 << fft_size->get(),
+    hop_size->get(),
+    window->get(),
+    band_mapping->get()
+  );
+
+  if (filename->get() != current_filename || playback->get() != current_playback)
+  {
+    stop_feeder();
+    current_filename = filename->get();
+    current_playback = playback->get();
+    if (!reader.open(engine->filesystem, current_filename) && current_filename.size())
+      message = "module||error loading "+current_filename;
+    else
+      message = "module||ok";
+    samples_due = 0.0;
+  }
+  reader.loop = loop->get() == 1;
+
+  if (reader.is_open())
+  {
+    if (current_playback == VSX_LISTENER_FILE_REALTIME)
+    {
+      feeder_l_mul = l_mul;
+      start_feeder();
+    }
+    else
+    {
+      samples_due += (double)engine->real_dtime * (double)VSX_WAV_READER_RATE;
+      // never more than a second of catching up in one frame
+      if (samples_due > (double)VSX_WAV_READER_RATE)
+        samples_due = (double)VSX_WAV_READER_RATE;
+      while (samples_due >= 512.0)
+      {
+        read_block(l_mul);
+        samples_due -= 512.0;
+      }
+    }
+  }
+
+  if (frames.acquire())
+  {
+    wave.timestamp++;
+    spectrum.timestamp++;
+  }
+  vsx_paudio_frame* frame = frames.get_read();
+
+  float* spectrum_dest = spectrum.data->get_pointer();
+  float* wave_dest = wave.data->get_pointer();
+  for (int i = 0; i < 512; i++)
+  {
+    spectrum_dest[i] = frame->spectrum[i];
+    wave_dest[i] = frame->wave[0][i];
+  }
+  wave_p->set_p(wave);
+  spectrum_p->set_p(spectrum);
+  spectrum_p_hq->set_p(spectrum);
+  vu_l_p->set(frame->vu[0]);
+  vu_r_p->set(frame->vu[1]);
+
+  octaves_l_0_p->set(frame->octaves[0][0]);
+  octaves_l_1_p->set(frame->octaves[0][1]);
+  octaves_l_2_p->set(frame->octaves[0][2]);
+  octaves_l_3_p->set(frame->octaves[0][3]);
+  octaves_l_4_p->set(frame->octaves[0][4]);
+  octaves_l_5_p->set(frame->octaves[0][5]);
+  octaves_l_6_p->set(frame->octaves[0][6]);
+  octaves_l_7_p->set(frame->octaves[0][7]);
+
+  octaves_r_0_p->set(frame->octaves[1][0]);
+  octaves_r_1_p->set(frame->octaves[1][1]);
+  octaves_r_2_p->set(frame->octaves[1][2]);
+  octaves_r_3_p->set(frame->octaves[1][3]);
+  octaves_r_4_p->set(frame->octaves[1][4]);
+  octaves_r_5_p->set(frame->octaves[1][5]);
+  octaves_r_6_p->set(frame->octaves[1][6]);
+  octaves_r_7_p->set(frame->octaves[1][7]);
+}
+};
@@ -24,6 +24,10 @@
 class vsx_listener_mediaplayer : public vsx_module {
   // in
   vsx_module_param_int* quality;
+  vsx_module_param_int* fft_size;
+  vsx_module_param_int* hop_size;
+  vsx_module_param_int* window;
+  vsx_module_param_int* band_mapping;
   // out
   vsx_module_param_float* multiplier;
   float old_mult;
@@ -61,9 +65,7 @@ class vsx_listener_mediaplayer : public vsx_module {
     vsx_module_param_float_array* spectrum_p_hq;
     vsx_float_array octave_spectrum_hq;
     vsx_module_param_float_array* octave_spectrum_p_hq;
-    float fftbuf[1024];
-    size_t fftbuf_it;
-    FFTReal* fft;
+    vsx_audio_analyzer analyzer;
 
 public:
 
@@ -86,7 +88,13 @@ somewhat CPU-intensive task to do\n\
 the FFT for both every frame. \n\
 Default is to only run\n\
 the normal one.`\
-,multiplier:float\
+,multiplier:float,\
+analysis:complex{\
+fft_size:enum?256|512|1024|2048|4096,\
+hop_size:enum?every_buffer|fft_size|half_fft_size|quarter_fft_size,\
+window:enum?none|hann|hamming|blackman,\
+band_mapping:enum?linear|log|mel\
+}\
 ";
   info->out_param_spec = "\
 vu:complex{\
@@ -129,6 +137,12 @@ void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list&
   multiplier = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"multiplier");
   multiplier->set(1);
 
+  fft_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"fft_size");
+  fft_size->set(1);
+  hop_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"hop_size");
+  window = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"window");
+  band_mapping = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"band_mapping");
+
   //////////////////
 
   vu_l_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"vu_l");
@@ -182,8 +196,6 @@ void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list&
   spectrum_p->set_p(spectrum);
   spectrum_p_hq->set_p(spectrum_hq);
   //printf("spectrum size0: %d\n",spectrum.data->size());
-  fftbuf_it = 0;
-  fft = new FFTReal(512);
   loading_done = true;
 }
 
@@ -206,6 +218,12 @@ int i;
 
   void run() {
     float l_mul = multiplier->get()*engine->amp*0.4f;
+    analyzer.configure(
+      256 << fft_size->get(),
+      hop_size->get(),
+      window->get(),
+      band_mapping->get()
+    );
     // set wave
     if (0 == engine->param_float_arrays.size())
     {
@@ -225,43 +243,24 @@ int i;
       //vsx_engine_float_array* lv_freq_data = engine->param_float_arrays[1];
 
       // Process incoming wave data
+      float samples[512];
       for (i = 0; i < 512; ++i)
       {
         const float &f = (*lv_wave_data).array[i];
         // add to wave buffer
         (*(wave.data))[i] =  f * l_mul;
-        // add to spectrum buffer
-        fftbuf[fftbuf_it++] = f;
+        samples[i] = f;
       }
       wave_p->set_p(wave);
 
       // Spectrum analysis
-      fftbuf_it = fftbuf_it % 1024;
-      // do some FFT's
-      float dspectrum[1024];
-      float spectrum_dest[512];
-      fft->do_fft( (float*)&dspectrum, (float*) &fftbuf[0]);
-      float re, im;
-
-      for(int ii = 0; ii < 256; ii++)
-      {
-        re = dspectrum[ii];
-        im = dspectrum[ii + 256];
-        spectrum_dest[ii] = (float)sqrt(re * re + im * im) / 256.0f * l_mul;
-      }
-
-      // calc vu
-      float vu = 0.0f;
-      for (int ii = 0; ii < 256; ii++)
-      {
-        vu += spectrum_dest[ii];
-      }
-      vu_l_p->set(vu);
-      vu_r_p->set(vu);
+      analyzer.process(samples, 512, l_mul);
+      vu_l_p->set(analyzer.vu);
+      vu_r_p->set(analyzer.vu);
 
       for (size_t ii = 0; ii < 512; ii++)
       {
-        (*(spectrum.data))[ii] = spectrum_dest[ii >> 1] * 3.0f * pow(log( 10.0f + 44100.0f * (ii / 512.0f)) ,1.0f);
+        (*(spectrum.data))[ii] = analyzer.spectrum[ii];
       }
 
     }
@@ -29,6 +29,10 @@
 class vsx_listener_pulse : public vsx_module {
   // in
   vsx_module_param_int* quality;
+  vsx_module_param_int* fft_size;
+  vsx_module_param_int* hop_size;
+  vsx_module_param_int* window;
+  vsx_module_param_int* band_mapping;
   // out
   vsx_module_param_float* multiplier;
   float old_mult;
@@ -87,7 +91,13 @@ somewhat CPU-intensive task to do\n\
 the FFT for both every frame. \n\
 Default is to only run\n\
 the normal one.`\
-,multiplier:float\
+,multiplier:float,\
+analysis:complex{\
+fft_size:enum?256|512|1024|2048|4096,\
+hop_size:enum?every_buffer|fft_size|half_fft_size|quarter_fft_size,\
+window:enum?none|hann|hamming|blackman,\
+band_mapping:enum?linear|log|mel\
+}\
 ";
   info->out_param_spec = "\
 vu:complex{\
@@ -130,6 +140,12 @@ void declare_params(vsx_module_param_list& in_parameters, vsx_module_param_list&
   multiplier = (vsx_module_param_float*)in_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"multiplier");
   multiplier->set(1);
 
+  fft_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"fft_size");
+  fft_size->set(1);
+  hop_size = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"hop_size");
+  window = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"window");
+  band_mapping = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"band_mapping");
+
   //////////////////
 
   vu_l_p = (vsx_module_param_float*)out_parameters.create(VSX_MODULE_PARAM_ID_FLOAT,"vu_l");
@@ -195,7 +211,9 @@ bool init() {
 
 void on_delete() {
   shutdown_rtaudio();
+  delete wave.data;
   delete spectrum.data;
+  delete spectrum_hq.data;
 }
 
 int echo_log(const char* message, int a) {
@@ -210,33 +228,58 @@ int i;
 void run()
 {
   pa_audio_data.l_mul = multiplier->get()*engine->amp;
+  pa_audio_data.analyzer.configure(
+    256 << fft_size->get(),
+    hop_size->get(),
+    window->get(),
+    band_mapping->get()
+  );
+
+  // take the latest complete frame from the audio thread; if there's nothing
+  // new the previous one is still ours to read
+  if (pa_audio_data.frames.acquire())
+  {
+    wave.timestamp++;
+    spectrum.timestamp++;
+  }
+  vsx_paudio_frame* frame = pa_audio_data.frames.get_read();
+
+  // the outputs get their own copy, other modules read them during the
+  // whole frame
+  float* spectrum_dest = spectrum.data->get_pointer();
+  for (int i = 0; i < 512; i++)
+    spectrum_dest[i] = frame->spectrum[i];
+
   // set wave
   if (0 == engine->param_float_arrays.size())
   {
-    wave_p->set_p(pa_audio_data.wave[0]);
+    float* wave_dest = wave.data->get_pointer();
+    for (int i = 0; i < 512; i++)
+      wave_dest[i] = frame->wave[0][i];
+    wave_p->set_p(wave);
   }
-  spectrum_p->set_p(pa_audio_data.spectrum[0]);
-  spectrum_p_hq->set_p(pa_audio_data.spectrum[0]);
-  vu_l_p->set(pa_audio_data.vu[0]);
-  vu_r_p->set(pa_audio_data.vu[1]);
-
-  octaves_l_0_p->set(pa_audio_data.octaves[0][0]);
-  octaves_l_1_p->set(pa_audio_data.octaves[0][1]);
-  octaves_l_2_p->set(pa_audio_data.octaves[0][2]);
-  octaves_l_3_p->set(pa_audio_data.octaves[0][3]);
-  octaves_l_4_p->set(pa_audio_data.octaves[0][4]);
-  octaves_l_5_p->set(pa_audio_data.octaves[0][5]);
-  octaves_l_6_p->set(pa_audio_data.octaves[0][6]);
-  octaves_l_7_p->set(pa_audio_data.octaves[0][7]);
-
-  octaves_r_0_p->set(pa_audio_data.octaves[0][0]);
-  octaves_r_1_p->set(pa_audio_data.octaves[0][1]);
-  octaves_r_2_p->set(pa_audio_data.octaves[0][2]);
-  octaves_r_3_p->set(pa_audio_data.octaves[0][3]);
-  octaves_r_4_p->set(pa_audio_data.octaves[0][4]);
-  octaves_r_5_p->set(pa_audio_data.octaves[0][5]);
-  octaves_r_6_p->set(pa_audio_data.octaves[0][6]);
-  octaves_r_7_p->set(pa_audio_data.octaves[0][7]);
+  spectrum_p->set_p(spectrum);
+  spectrum_p_hq->set_p(spectrum);
+  vu_l_p->set(frame->vu[0]);
+  vu_r_p->set(frame->vu[1]);
+
+  octaves_l_0_p->set(frame->octaves[0][0]);
+  octaves_l_1_p->set(frame->octaves[0][1]);
+  octaves_l_2_p->set(frame->octaves[0][2]);
+  octaves_l_3_p->set(frame->octaves[0][3]);
+  octaves_l_4_p->set(frame->octaves[0][4]);
+  octaves_l_5_p->set(frame->octaves[0][5]);
+  octaves_l_6_p->set(frame->octaves[0][6]);
+  octaves_l_7_p->set(frame->octaves[0][7]);
+
+  octaves_r_0_p->set(frame->octaves[1][0]);
+  octaves_r_1_p->set(frame->octaves[1][1]);
+  octaves_r_2_p->set(frame->octaves[1][2]);
+  octaves_r_3_p->set(frame->octaves[1][3]);
+  octaves_r_4_p->set(frame->octaves[1][4]);
+  octaves_r_5_p->set(frame->octaves[1][5]);
+  octaves_r_6_p->set(frame->octaves[1][6]);
+  octaves_r_7_p->set(frame->octaves[1][7]);
 
 }
 };
@@ -0,0 +1,80 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_PAUDIO_FRAME_H
+#define VSX_PAUDIO_FRAME_H
+
+#include <string.h>
+#include "fftreal/fftreal.h"
+#include "vsx_audio_analyzer.h"
+
+// one complete analysis result from the audio thread
+typedef struct
+{
+    float wave[2][512];    // 512 L 512 R BANZAI!
+    float spectrum[512];
+    float vu[2];
+    float octaves[2][8];
+} vsx_paudio_frame;
+
+// analysis of one 512 sample buffer per channel, used by every listener that
+// has raw samples to work from
+inline void vsx_paudio_fill_frame(vsx_paudio_frame* frame, vsx_audio_analyzer* analyzer, const float* left, const float* right, float l_mul)
+{
+  for (size_t i = 0; i < 512; i++)
+  {
+    frame->wave[0][i] = left[i] * l_mul;
+    frame->wave[1][i] = right[i] * l_mul;
+  }
+
+  // the analyzer keeps the previous spectrum until the next hop is due
+  analyzer->process(left, 512, l_mul);
+  memcpy(frame->spectrum, analyzer->spectrum, sizeof(frame->spectrum));
+  frame->vu[0] = analyzer->vu;
+  frame->vu[1] = analyzer->vu;
+
+  const float one_div_50 = 1.0f / 50.0f;
+
+  #define spec_calc(cur_val, start, offset) \
+    cur_val = 0.0f;\
+    for (int ii = start * 50 + offset; ii < (start+1)*50; ii++) {\
+      cur_val += frame->spectrum[ii];\
+    }\
+    cur_val = (cur_val * one_div_50)
+
+  spec_calc(frame->octaves[0][0], 0, 10);
+  spec_calc(frame->octaves[0][1], 1, 0);
+  spec_calc(frame->octaves[0][2], 2, 0);
+  spec_calc(frame->octaves[0][3], 3, 0);
+  spec_calc(frame->octaves[0][4], 4, 0);
+  spec_calc(frame->octaves[0][5], 5, 0);
+  spec_calc(frame->octaves[0][6], 6, 0);
+  spec_calc(frame->octaves[0][7], 7, 0);
+
+  #undef spec_calc
+
+  for (int ii = 0; ii < 8; ii++)
+    frame->octaves[1][ii] = frame->octaves[0][ii];
+}
+
+#endif
@@ -0,0 +1,353 @@
+/**
+* Project: VSXu: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef VSX_WAV_READER_H
+#define VSX_WAV_READER_H
+
+#include <string.h>
+#include "vsxfst.h"
+
+// Streaming reader for WAV files (integer PCM 8/16/24/32 bit, float 32/64
+// bit, any channel count) and headerless 16 bit stereo 44.1 kHz PCM
+// (.pcm / .raw). Only a block is decoded at a time so songs of any length
+// can be fed through without loading them.
+//
+// Output is always a left/right pair of floats at 44.1 kHz, mono is
+// duplicated, channels past the second are dropped and other sample rates
+// are converted with linear interpolation.
+//
+// Files are read through vsxf so this works from inside packed states too.
+// One reader must only be used by one thread at a time.
+
+#define VSX_WAV_READER_RATE 44100
+#define VSX_WAV_READER_BLOCK 1024
+#define VSX_WAV_READER_MAX_CHANNELS 16
+
+#define VSX_WAV_FORMAT_PCM 1
+#define VSX_WAV_FORMAT_FLOAT 3
+#define VSX_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+class vsx_wav_reader
+{
+  vsxf* filesystem;
+  vsxf_handle* fp;
+  vsx_string filename;
+
+  int format;
+  int channels;
+  int bits;
+  int sample_rate;
+  int frame_bytes;
+  unsigned long data_left; // bytes
+
+  // decoded block
+  unsigned char raw[VSX_WAV_READER_BLOCK * VSX_WAV_READER_MAX_CHANNELS * 8];
+  float block[2][VSX_WAV_READER_BLOCK];
+  int block_pos;
+  int block_count;
+
+  // resampling, output frames are taken between cur and next
+  double step;
+  double phase;
+  float cur[2];
+  float next[2];
+
+  unsigned long read_u32(const unsigned char* p)
+  {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+  }
+
+  int read_u16(const unsigned char* p)
+  {
+    return (int)p[0] | ((int)p[1] << 8);
+  }
+
+  bool skip(unsigned long bytes)
+  {
+    while (bytes)
+    {
+      unsigned long n = bytes < sizeof(raw) ? bytes : sizeof(raw);
+      if ((unsigned long)filesystem->f_read(raw, n, fp) != n)
+        return false;
+      bytes -= n;
+    }
+    return true;
+  }
+
+  // walks the RIFF chunks up to the start of the sample data
+  bool read_header()
+  {
+    unsigned char h[12];
+    if (filesystem->f_read(h, 12, fp) != 12)
+      return false;
+
+    if (memcmp(h, "RIFF", 4) != 0 || memcmp(&h[8], "WAVE", 4) != 0)
+    {
+      // no header, assume what the rtaudio listener records
+      filesystem->f_close(fp);
+      fp = filesystem->f_open(filename.c_str(), "rb");
+      if (!fp) return false;
+      format = VSX_WAV_FORMAT_PCM;
+      channels = 2;
+      bits = 16;
+      sample_rate = VSX_WAV_READER_RATE;
+      frame_bytes = 4;
+      data_left = filesystem->f_get_size(fp);
+      return true;
+    }
+
+    bool have_format = false;
+    while (1)
+    {
+      unsigned char c[8];
+      if (filesystem->f_read(c, 8, fp) != 8)
+        return false;
+      unsigned long size = read_u32(&c[4]);
+
+      if (memcmp(c, "fmt ", 4) == 0)
+      {
+        unsigned char f[40];
+        if (size < 16) return false;
+        unsigned long n = size < sizeof(f) ? size : sizeof(f);
+        if ((unsigned long)filesystem->f_read(f, n, fp) != n) return false;
+        if (!skip(size - n + (size & 1))) return false;
+        format = read_u16(f);
+        channels = read_u16(&f[2]);
+        sample_rate = (int)read_u32(&f[4]);
+        bits = read_u16(&f[14]);
+        // the real format is the first two bytes of the sub format guid
+        if (format == VSX_WAV_FORMAT_EXTENSIBLE && n >= 26)
+          format = read_u16(&f[24]);
+        have_format = true;
+        continue;
+      }
+
+      if (memcmp(c, "data", 4) == 0)
+      {
+        if (!have_format) return false;
+        data_left = size;
+        break;
+      }
+
+      if (!skip(size + (size & 1)))
+        return false;
+    }
+
+    if (channels < 1 || channels > VSX_WAV_READER_MAX_CHANNELS || sample_rate <= 0)
+      return false;
+    if (format == VSX_WAV_FORMAT_PCM && (bits != 8 && bits != 16 && bits != 24 && bits != 32))
+      return false;
+    if (format == VSX_WAV_FORMAT_FLOAT && (bits != 32 && bits != 64))
+      return false;
+    if (format != VSX_WAV_FORMAT_PCM && format != VSX_WAV_FORMAT_FLOAT)
+      return false;
+    frame_bytes = channels * bits / 8;
+    return true;
+  }
+
+  float decode(const unsigned char* p)
+  {
+    if (format == VSX_WAV_FORMAT_FLOAT)
+    {
+      if (bits == 32)
+      {
+        float f;
+        memcpy(&f, p, 4);
+        return f;
+      }
+      double d;
+      memcpy(&d, p, 8);
+      return (float)d;
+    }
+    switch (bits)
+    {
+      case 8: return (float)((int)p[0] - 128) * (1.0f / 128.0f);
+      case 16: return (float)(short)read_u16(p) * (1.0f / 32768.0f);
+      case 24: return (float)((int)(read_u32(p) << 8) >> 8) * (1.0f / 8388608.0f);
+    }
+    return (float)(int)read_u32(p) * (1.0f / 2147483648.0f);
+  }
+
+  bool rewind()
+  {
+    if (fp)
+      filesystem->f_close(fp);
+    fp = filesystem->f_open(filename.c_str(), "rb");
+    if (!fp)
+      return false;
+    if (!read_header())
+    {
+      if (fp) filesystem->f_close(fp);
+      fp = 0;
+      return false;
+    }
+    return true;
+  }
+
+  bool fill_block()
+  {
+    block_pos = 0;
+    block_count = 0;
+    if (!fp) return false;
+    if (data_left < (unsigned long)frame_bytes)
+    {
+      if (!loop || !rewind() || data_left < (unsigned long)frame_bytes)
+        return false;
+    }
+
+    unsigned long bytes = (unsigned long)VSX_WAV_READER_BLOCK * frame_bytes;
+    if (bytes > data_left) bytes = data_left;
+    unsigned long got = filesystem->f_read(raw, bytes, fp);
+    data_left = got < bytes ? 0 : data_left - got;
+
+    int frames = (int)(got / frame_bytes);
+    int sample_bytes = bits / 8;
+    const unsigned char* p = raw;
+    for (int i = 0; i < frames; i++)
+    {
+      block[0][i] = decode(p);
+      block[1][i] = channels > 1 ? decode(p + sample_bytes) : block[0][i];
+      p += frame_bytes;
+    }
+    block_count = frames;
+    return frames > 0;
+  }
+
+  // next frame in the file's own rate, silence past the end
+  void pull(float* frame)
+  {
+    if (block_pos == block_count && !fill_block())
+    {
+      frame[0] = 0.0f;
+      frame[1] = 0.0f;
+      finished = true;
+      return;
+    }
+    frame[0] = block[0][block_pos];
+    frame[1] = block[1][block_pos];
+    block_pos++;
+  }
+
+public:
+
+  // start over from the beginning when the end is reached
+  bool loop;
+  // set once a non-looping file has run out
+  bool finished;
+
+  vsx_wav_reader()
+  {
+    filesystem = 0;
+    fp = 0;
+    loop = true;
+    finished = false;
+    block_pos = 0;
+    block_count = 0;
+  }
+
+  ~vsx_wav_reader()
+  {
+    close();
+  }
+
+  bool open(vsxf* n_filesystem, vsx_string n_filename)
+  {
+    close();
+    filesystem = n_filesystem;
+    filename = n_filename;
+    if (!rewind())
+      return false;
+    step = (double)sample_rate / (double)VSX_WAV_READER_RATE;
+    phase = 0.0;
+    pull(cur);
+    pull(next);
+    finished = false;
+    return true;
+  }
+
+  void close()
+  {
+    if (fp)
+      filesystem->f_close(fp);
+    fp = 0;
+    block_pos = 0;
+    block_count = 0;
+    finished = false;
+  }
+
+  bool is_open()
+  {
+    return fp != 0;
+  }
+
+  int get_sample_rate()
+  {
+    return sample_rate;
+  }
+
+  int get_channels()
+  {
+    return channels;
+  }
+
+  // count frames at 44.1 kHz
+  void read(float* left, float* right, int count)
+  {
+    if (!fp)
+    {
+      memset(left, 0, sizeof(float) * count);
+      memset(right, 0, sizeof(float) * count);
+      return;
+    }
+
+    if (sample_rate == VSX_WAV_READER_RATE)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        left[i] = cur[0];
+        right[i] = cur[1];
+        cur[0] = next[0];
+        cur[1] = next[1];
+        pull(next);
+      }
+      return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      float t = (float)phase;
+      left[i] = cur[0] + (next[0] - cur[0]) * t;
+      right[i] = cur[1] + (next[1] - cur[1]) * t;
+      phase += step;
+      while (phase >= 1.0)
+      {
+        phase -= 1.0;
+        cur[0] = next[0];
+        cur[1] = next[1];
+        pull(next);
+      }
+    }
+  }
+};
+
+#endif
@@ -29,6 +29,9 @@
 #include "vsx_module.h"
 #include "pthread.h"
 #include "vsxg.h"
+#include "vsx_image_loader.h"
+#include "vsx_dxt.h"
+#include "vsx_background_job.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -40,11 +43,27 @@
 typedef struct stat t_stat;
 
 
+// compression param (none|auto|dxt1|dxt5) to an image loader setting,
+// off when the driver can't take s3tc
+static int texture_compression(vsx_module_param_int* compression)
+{
+  if (!compression || compression->get() == 0)
+    return VSX_IMAGE_COMPRESSION_OFF;
+  if (!GLEW_EXT_texture_compression_s3tc)
+    return VSX_IMAGE_COMPRESSION_OFF;
+  if (compression->get() == 2)
+    return VSX_DXT1;
+  if (compression->get() == 3)
+    return VSX_DXT5;
+  return VSX_DXT_NONE;
+}
+
 class texture_loaders_bitmap2texture : public vsx_module {
   // in
 	float time;
 	vsx_module_param_bitmap* bitm_in;
 	vsx_module_param_int* mipmaps;
+	vsx_module_param_int* compression;
 	
 	// out
 	vsx_module_param_texture* result_texture;
@@ -55,14 +74,53 @@ class texture_loaders_bitmap2texture : public vsx_module {
 	
   vsx_texture* texture;
 
+  // dxt compression runs as a job on the thread pool. It works on a copy
+  // of the bitmap since the producer is free to rewrite its own as soon
+  // as it's been handed out.
+  vsx_background_job compress;
+  int compress_format;
+  vsx_bitmap compress_source;
+  vsx_bitmap compress_result;
+  bool compressed_uploaded;
+
+  static void compress_job(void* arg)
+  {
+    texture_loaders_bitmap2texture* m = (texture_loaders_bitmap2texture*)arg;
+    vsx_bitmap result;
+    if (vsx_dxt_compress_bitmap(&m->compress_source, &result, m->compress_format))
+    {
+      free(m->compress_result.data);
+      m->compress_result = result;
+    }
+  }
+
+  // copies the bitmap and starts compressing it, false if it can't be
+  bool compress_start(vsx_bitmap* source, int format)
+  {
+    if (source->bpp != 3 && source->bpp != 4)
+      return false;
+    size_t bytes = source->size_x * source->size_y * source->bpp;
+    if (!bytes)
+      return false;
+    compress_source.data = realloc(compress_source.data, bytes);
+    memcpy(compress_source.data, source->data, bytes);
+    compress_source.size_x = source->size_x;
+    compress_source.size_y = source->size_y;
+    compress_source.bpp = source->bpp;
+    compress_source.bformat = source->bformat;
+    compress_format = format;
+    compress.start(&compress_job, (void*)this);
+    return true;
+  }
+
 public:
 
 	void module_info(vsx_module_info* info)
 	{
 	  info->identifier = "texture;loaders;bitmap2texture";
 	#ifndef VSX_NO_CLIENT
-	  info->description = "";
-	  info->in_param_spec = "bitmap:bitmap,mipmaps:enum?yes|no";
+	  info->description = "Uploads a bitmap as a texture.\ncompression compresses it to\nDXT in the background first,\nthe texture keeps the previous\nframe until that's done.";
+	  info->in_param_spec = "bitmap:bitmap,mipmaps:enum?yes|no,compression:enum?none|auto|dxt1|dxt5";
 	  info->out_param_spec = "texture:texture";
 	  info->component_class = "texture";
 	#endif
@@ -75,6 +133,8 @@ public:
 		bitm_in = (vsx_module_param_bitmap*)in_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"bitmap");
 		mipmaps = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"mipmaps");
 		mipmaps->set(0);
+		compression = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT,"compression");
+		compression->set(0);
 	  //bitm_in->set(bitm);
 	  //bitm.size_x = 0;
 	  //bitm.size_y = 0;
@@ -83,22 +143,48 @@ public:
 	  texture = new vsx_texture;
 	  texture->locked = true;
 	  texture->init_opengl_texture();
+
+	  compress_format = VSX_DXT_NONE;
+	  compress_source.data = 0;
+	  compress_result.data = 0;
+	  compressed_uploaded = false;
 	
 	  result_texture = (vsx_module_param_texture*)out_parameters.create(VSX_MODULE_PARAM_ID_TEXTURE,"texture");  
 	  loading_done = true;
 	}
 	
 	void run() {
+	  // a finished compression goes up in place of the previous frame
+	  if (compress.collect() && compress_result.data)
+	  {
+	    texture->upload_ram_bitmap(&compress_result, mipmaps->get() == 0);
+	    result_texture->set(texture);
+	    compressed_uploaded = true;
+	  }
+
 	  bitm = bitm_in->get_addr();
 	  if (!bitm) {
       result_texture->valid = false;
 	    return;
 	  }
 	  if (bitm->valid && bitm_timestamp != bitm->timestamp) {
+	    int format = texture_compression(compression);
+	    if (format != VSX_IMAGE_COMPRESSION_OFF)
+	    {
+	      // one at a time, later versions are picked up once it's done
+	      if (compress.busy())
+	        return;
+	      if (compress_start(bitm, format))
+	      {
+	        bitm_timestamp = bitm->timestamp;
+	        return;
+	      }
+	    }
 	    //texture->unload();
 	    // ok, new version
 	    //printf("uploading bitmap as texture %d \n",bitm->timestamp);
 	    bitm_timestamp = bitm->timestamp;
+	    compressed_uploaded = false;
 	    //printf("u-");
 	    if (mipmaps->get() == 0)
 	    texture->upload_ram_bitmap(bitm,true);
@@ -116,6 +202,12 @@ public:
 	void start() {
 	  //printf("starting textureuploader\n");
 	  texture->init_opengl_texture();
+	  if (compressed_uploaded)
+	  {
+	    texture->upload_ram_bitmap(&compress_result, mipmaps->get() == 0);
+	    result_texture->set(texture);
+	    return;
+	  }
 	  bitm = bitm_in->get_addr();
 	  if (bitm) {
 	    texture->upload_ram_bitmap(bitm,mipmaps->get());
@@ -124,6 +216,9 @@ public:
 	}  
 	
 	void on_delete() {
+	  compress.wait();
+	  free(compress_source.data);
+	  free(compress_result.data);
 	  texture->unload();
 	  delete texture;
 	}
@@ -143,6 +238,7 @@ class module_load_png : public vsx_module {
   float time;
   vsx_module_param_resource* filename_in;
   vsx_module_param_int* reload;
+  vsx_module_param_int* compression; // texture loader only
   
   // out
   vsx_module_param_bitmap* bitmap_out;
@@ -150,33 +246,15 @@ class module_load_png : public vsx_module {
   
   // internal
   
-  // threading stuff
-  void* pti_l;
-  
   vsx_texture* texture;
-  
-  static void* png_worker_v(void *ptr) {
-    //printf("thread starting\n");
-    //if (((module_load_png*)ptr)->bitm.data) {
-      //delete ((module_load_png*)ptr)->bitm.data;
-    //}
 
-    module_load_png* module = ((module_load_png*)ptr);
-    
-    ((module_load_png*)ptr)->pp = new pngRawInfo;
-    if (pngLoadRaw( module->current_filename.c_str(), ((module_load_png*)ptr)->pp,((module_load_png*)ptr)->engine->filesystem)) {
-      ((module_load_png*)ptr)->bitm.valid = true;
-      ((module_load_png*)ptr)->thread_state = 2;
-    } else {
-      //printf("thread: bitmap not valid\n");
-      ((module_load_png*)ptr)->bitm.valid = false;
-      ((module_load_png*)ptr)->thread_state = -1;
-      ((module_load_png*)ptr)->last_modify_time = 0;
-    }
-    //printf("png thread ending\n");
-    return 0;
-  }
-  
+  // decode in flight or done, shared with other loaders of the same file
+  vsx_image* image;
+  int current_compression;
+
+  // what the texture is made from, the compressed image isn't a bitmap
+  // anyone else could read
+  vsx_bitmap* upload_bitmap;
 
 public:
   int m_type;
@@ -184,10 +262,6 @@ public:
   vsx_bitmap bitm;
   int bitm_timestamp; // keep track of the timestamp for the bitmap internally 
   int               thread_state;
-  bool              thread_working;
-  pngRawInfo*       pp;
-  pthread_t         worker_t;
-  pthread_attr_t    worker_t_attr;
 
   int texture_timestamp;
 
@@ -196,6 +270,8 @@ public:
   #ifndef VSX_NO_CLIENT
     info->description = "Loads a PNG image from\ndisk and outputs a \n - VSXu bitmap \n and\n - texture.\nTexture is only loaded when used.\nThis is to preserve memory.";
     info->in_param_spec = "filename:resource,reload:enum?no|yes";
+    if (m_type == 1)
+      info->in_param_spec += ",compression:enum?none|auto|dxt1|dxt5";
     info->out_param_spec = "texture:texture,bitmap:bitmap";
 #endif
     if (m_type == 0)
@@ -218,6 +294,11 @@ public:
     current_filename = "";
     
     reload = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT, "reload");
+    compression = 0x0;
+    if (m_type == 1)
+      compression = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT, "compression");
+    current_compression = VSX_IMAGE_COMPRESSION_OFF;
+    upload_bitmap = &bitm;
     
     // out
     bitmap_out = (vsx_module_param_bitmap*)out_parameters.create(VSX_MODULE_PARAM_ID_BITMAP,"bitmap");
@@ -230,67 +311,64 @@ public:
   
     bitmap_out->set_p(bitm);
     thread_state = 0;
+    image = 0x0;
     texture = 0x0;
     
     texture_out = (vsx_module_param_texture*)out_parameters.create(VSX_MODULE_PARAM_ID_TEXTURE,"texture");
     texture_out->valid = false;
   }
   
-  time_t last_modify_time;
-  t_stat st;
+  void release_image()
+  {
+    if (!image) return;
+    bitm.valid = false;
+    bitm.data = 0;
+    upload_bitmap = &bitm;
+    vsx_image_loader::get_instance()->release(image);
+    image = 0x0;
+  }
+
   void run()
   {
-    if (current_filename != filename_in->get() || reload->get() == 1) {
+    int want_compression = texture_compression(compression);
+    if (current_filename != filename_in->get() || reload->get() == 1 || want_compression != current_compression) {
+      bool force = reload->get() == 1;
       reload->set(0);
 
-      // time to decode a new png
-      if (thread_state > 0) {
-        if (thread_state == 1) {
-          long* aa;
-          pthread_join(worker_t, (void **)&aa);
-        }
-        free(pp->Data);
-        delete pp; 
-      }
      	if (!verify_filesuffix(filename_in->get(),"png")) {
      		filename_in->set(current_filename);
      		message = "module||ERROR! This is not a PNG image file!";
      		return;
      	} else message = "module||ok";
-    
+
+      // time to decode a new png
+      release_image();
       current_filename = filename_in->get();
-      stat(current_filename.c_str(), &st);
-      last_modify_time = st.st_mtime;
-      pthread_attr_init(&worker_t_attr);
+      current_compression = want_compression;
       thread_state = 1;
-      pthread_create(&(worker_t), &(worker_t_attr), &png_worker_v, (void*)this);
+      image = vsx_image_loader::get_instance()->request(engine->filesystem, current_filename, VSX_IMAGE_PNG, "", force, current_compression);
     }
-    //printf("foobar\n");
-    if (thread_state == 2) {
+    if (thread_state == 1 && image->state != VSX_IMAGE_STATE_LOADING) {
       thread_state = 3;
-      if (bitm.valid) {
-        if (pp->Components == 1) {
-          bitm.bpp = 3;
-          bitm.bformat = GL_RGB;
-        } else 
-        if (pp->Components == 2) {
-          bitm.bpp = 4;
-          bitm.bformat = GL_RGBA;
-        } else
-        if (pp->Components == 3) {
-          bitm.bpp = 3;
-          bitm.bformat = GL_RGB;
-        } else
-        if (pp->Components == 4) {
-          bitm.bpp = 4;
-          bitm.bformat = GL_RGBA;
-        }
-        bitm.size_x = pp->Width;
-        bitm.size_y = pp->Height;
-        bitm.data = (vsx_bitmap_32bt*)(pp->Data);
+      if (image->state == VSX_IMAGE_STATE_DONE && vsx_dxt_is_compressed(&image->bitmap)) {
+        // texture only, the bitmap output stays empty
+        upload_bitmap = &image->bitmap;
+        bitm.timestamp++;
+      } else
+      if (image->state == VSX_IMAGE_STATE_DONE) {
+        bitm.bpp = image->bitmap.bpp;
+        bitm.bformat = image->bitmap.bformat;
+        bitm.size_x = image->bitmap.size_x;
+        bitm.size_y = image->bitmap.size_y;
+        bitm.data = image->bitmap.data;
+        bitm.valid = true;
 
         bitm.timestamp++;
         bitmap_out->set_p(bitm);
+      } else
+      {
+        thread_state = -1;
+        message = "module||"+image->error+"\n"+current_filename;
       }
       loading_done = true;
   }
@@ -309,7 +387,7 @@ void output(vsx_module_param_abs* param)
         texture->init_opengl_texture();
         texture->valid = false;
       }
-      texture->upload_ram_bitmap(&bitm,true);
+      texture->upload_ram_bitmap(upload_bitmap,true);
       texture->valid = true;
       texture_out->set(texture);
       texture_timestamp = bitm.timestamp;
@@ -325,20 +403,17 @@ void stop() {
 }
 
 void start() {
+  if (!texture)
+    return;
   texture->init_opengl_texture();
-  texture->upload_ram_bitmap(&bitm,true);
+  texture->upload_ram_bitmap(upload_bitmap,true);
   texture->valid = true;
   texture_out->set(texture);
 }
 
 
 void on_delete() {
-  if (thread_state == 1)
-  pthread_join(worker_t,0);
-  if (thread_state > 0) {
-    free(pp->Data);
-    delete pp;
-  }
+  release_image();
   if (texture) {
     texture->unload();
     delete texture;
@@ -361,56 +436,28 @@ class module_load_jpeg : public vsx_module
   // out
   vsx_module_param_bitmap* bitmap_out;
   vsx_module_param_texture* texture_out;
+  vsx_module_param_int* compression; // texture loader only
   // internal
   vsx_texture* texture;
 
-  // threading stuff
-  void* pti_l;
-  
-  static void* jpeg_worker_v(void *ptr)
-  {
-    module_load_jpeg* mod = (module_load_jpeg*)ptr;
-
-    CJPEGTest* cj = new CJPEGTest;
-    vsx_string ret;
-    if
-    (
-     !(cj
-       ->LoadJPEG(
-       mod->current_filename,
-       ret,
-       mod->engine->filesystem
-     ))
-    )
-    {
-      mod->message = "module||"+ret+"\n"+((module_load_jpeg*)ptr)->current_filename;
-      mod->thread_state = -1;
-      delete cj;
-      return 0;
-    }
-    mod->bitm.size_x = cj->GetResX();
-    mod->bitm.size_y = cj->GetResY();
-
-    // allocate data in the vsx_bitmap
-    vsx_bitmap_32bt b_c = (mod->bitm.size_x) * (mod->bitm.size_y);
-
-    unsigned char* rb = (unsigned char*)cj->m_pBuf;
-    mod->bitm.data = new vsx_bitmap_32bt[b_c*2];
+  // decode in flight or done, shared with other loaders of the same file
+  vsx_image* image;
+  int current_compression;
 
-    for (unsigned long i = 0; i < b_c; ++i)
-    {
-      ((vsx_bitmap_32bt*)mod->bitm.data)[i] =
-          0xFF000000 |
-          rb[i*3+2] << 16 |
-          rb[i*3+1] << 8 |
-          rb[i*3];
-    }
-    delete cj;
-    mod->thread_state = 2;
+  // what the texture is made from, the compressed image isn't a bitmap
+  // anyone else could read
+  vsx_bitmap* upload_bitmap;
 
-    return 0;
+  void release_image()
+  {
+    if (!image) return;
+    bitm.valid = false;
+    bitm.data = 0;
+    upload_bitmap = &bitm;
+    vsx_image_loader::get_instance()->release(image);
+    image = 0x0;
   }
-  
+
 public:
   int m_type;
 
@@ -418,15 +465,14 @@ public:
   vsx_bitmap bitm;
   int bitm_timestamp; // keep track of the timestamp for the bitmap internally 
   int               thread_state;
-  bool              thread_working;
-  pthread_t         worker_t;
-  pthread_attr_t    worker_t_attr;
   int texture_timestamp;
   
   void module_info(vsx_module_info* info)
   {
     info->description = "Loads a JPEG image from\ndisk and outputs a \n - VSXu bitmap \n and\n - texture.\nTexture is only loaded when used.\nThis is to preserve memory.";
     info->in_param_spec = "filename:resource";
+    if (m_type == 1)
+      info->in_param_spec += ",compression:enum?none|auto|dxt1|dxt5";
     info->out_param_spec = "texture:texture,bitmap:bitmap";
 
     if (m_type == 0)
@@ -460,6 +506,12 @@ public:
   
     bitmap_out->set_p(bitm);
     thread_state = 0;
+    image = 0x0;
+    compression = 0x0;
+    if (m_type == 1)
+      compression = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT, "compression");
+    current_compression = VSX_IMAGE_COMPRESSION_OFF;
+    upload_bitmap = &bitm;
     texture_out = (vsx_module_param_texture*)out_parameters.create(VSX_MODULE_PARAM_ID_TEXTURE,"texture");
 
   	texture = new vsx_texture;
@@ -469,20 +521,14 @@ public:
   
   void run()
   {
-    if (current_filename != filename_in->get())
+    int want_compression = texture_compression(compression);
+    if (current_filename != filename_in->get() || want_compression != current_compression)
     {
       if (thread_state == -1)
       {
         message = "module||ok";
       }
 
-      // time to decode a new jpg
-      if (thread_state == 1)
-      {
-        long* aa;
-        pthread_join(worker_t, (void **)&aa);
-      }
-
       if (!verify_filesuffix(filename_in->get(),"jpg"))
       {
      		filename_in->set(current_filename);
@@ -491,20 +537,41 @@ public:
       }
       message = "module||ok";
       
+      // time to decode a new jpg
+      release_image();
       current_filename = filename_in->get();
-      pthread_attr_init(&worker_t_attr);
+      current_compression = want_compression;
       thread_state = 1;
-      pthread_create(&(worker_t), &(worker_t_attr), &jpeg_worker_v, (void*)this);
+      image = vsx_image_loader::get_instance()->request(engine->filesystem, current_filename, VSX_IMAGE_JPEG, "", false, current_compression);
     }
-    if (thread_state == 2)
+    if (thread_state == 1 && image->state != VSX_IMAGE_STATE_LOADING)
     {
-      bitm.bpp = 4;
-      bitm.bformat = GL_RGBA;
-      bitm.valid = true;
-      ++bitm.timestamp;
-      thread_state = 3;
+      if (image->state == VSX_IMAGE_STATE_DONE && vsx_dxt_is_compressed(&image->bitmap))
+      {
+        // texture only, the bitmap output stays empty
+        upload_bitmap = &image->bitmap;
+        ++bitm.timestamp;
+        thread_state = 3;
+      }
+      else
+      if (image->state == VSX_IMAGE_STATE_DONE)
+      {
+        bitm.bpp = 4;
+        bitm.bformat = GL_RGBA;
+        bitm.size_x = image->bitmap.size_x;
+        bitm.size_y = image->bitmap.size_y;
+        bitm.data = image->bitmap.data;
+        bitm.valid = true;
+        ++bitm.timestamp;
+        thread_state = 3;
+        bitmap_out->set_p(bitm);
+      }
+      else
+      {
+        thread_state = -1;
+        message = "module||"+image->error+"\n"+current_filename;
+      }
       loading_done = true;
-      bitmap_out->set_p(bitm);
     }
   }
 
@@ -512,9 +579,9 @@ public:
   {
     if (param == (vsx_module_param_abs*)texture_out)
     {
-      if (texture_timestamp != bitm.timestamp && bitm.valid)
+      if (texture_timestamp != bitm.timestamp && upload_bitmap->valid)
       {
-        texture->upload_ram_bitmap(&bitm,true);
+        texture->upload_ram_bitmap(upload_bitmap,true);
         texture->valid = true;
         texture_out->set(texture);
         texture_timestamp = bitm.timestamp;
@@ -524,12 +591,7 @@ public:
   
   void on_delete()
   {
-    if (thread_state == 1) 
-    pthread_join(worker_t, 0);
-    if (bitm.valid)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    release_image();
   }  
 };
 
@@ -549,110 +611,26 @@ class module_load_jpeg_alpha : public vsx_module
   // out
   vsx_module_param_bitmap* bitmap_out;
   vsx_module_param_texture* texture_out;
+  vsx_module_param_int* compression; // texture loader only
   // internal
   vsx_texture* texture;
 
-  // threading stuff
-  void* pti_l;
+  // decode in flight or done, shared with other loaders of the same files
+  vsx_image* image;
+  int current_compression;
 
-  static void* jpeg_worker_v(void *ptr)
-  {
-    module_load_jpeg_alpha* mod = (module_load_jpeg_alpha*)ptr;
-
-    vsx_string ret;
-
-    CJPEGTest* cj = new CJPEGTest;
-    if
-    (
-     !(cj
-       ->LoadJPEG(
-       mod->current_filename,
-       ret,
-       mod->engine->filesystem
-     ))
-    )
-    {
-      mod->message = "module||"+ret+"\n"+((module_load_jpeg*)ptr)->current_filename;
-      mod->thread_state = -1;
-      delete cj;
-      return 0;
-    }
-
-    if (mod->current_alpha_filename != "")
-    {
-
-      CJPEGTest* cj_a = new CJPEGTest;
-      if
-      (
-        !(cj_a
-         ->LoadJPEG(
-         mod->current_alpha_filename,
-         ret,
-         mod->engine->filesystem
-       ))
-      )
-      {
-        mod->message = "module||"+ret+"\n"+((module_load_jpeg*)ptr)->current_filename;
-        mod->thread_state = -1;
-        delete cj;
-        delete cj_a;
-        return 0;
-      }
-
-      mod->bitm.size_x = cj->GetResX();
-      mod->bitm.size_y = cj->GetResY();
-
-      // allocate data in the vsx_bitmap
-      vsx_bitmap_32bt b_c = (mod->bitm.size_x) * (mod->bitm.size_y);
-
-      unsigned char* rgbcp = (unsigned char*)cj->m_pBuf;
-
-      unsigned char* acp = (unsigned char*)cj_a->m_pBuf;
-
-      mod->bitm.data = new vsx_bitmap_32bt[b_c*2];
-
-      for (unsigned long i = 0; i < b_c; ++i)
-      {
-        ((vsx_bitmap_32bt*)mod->bitm.data)[i] =
-            acp[i*3] << 24 |
-            rgbcp[i*3+2] << 16 |
-            rgbcp[i*3+1] << 8 |
-            rgbcp[i*3];
-      }
-
-      delete cj;
-      delete cj_a;
-
-      mod->thread_state = 2;
-      return 0;
-    }
+  // what the texture is made from, the compressed image isn't a bitmap
+  // anyone else could read
+  vsx_bitmap* upload_bitmap;
 
-    // no alpha filename selected
-
-    mod->bitm.size_x = cj->GetResX();
-    mod->bitm.size_y = cj->GetResY();
-
-    // allocate data in the vsx_bitmap
-    vsx_bitmap_32bt b_c = (mod->bitm.size_x) * (mod->bitm.size_y);
-
-    unsigned char* rgbcp = (unsigned char*)cj->m_pBuf;
-
-    mod->bitm.data = new vsx_bitmap_32bt[b_c*2];
-
-    for (unsigned long i = 0; i < b_c; ++i)
-    {
-      ((vsx_bitmap_32bt*)mod->bitm.data)[i] =
-          0xFF000000 |
-          rgbcp[i*3+2] << 16 |
-          rgbcp[i*3+1] << 8 |
-          rgbcp[i*3];
-    }
-
-    delete cj;
-
-    mod->thread_state = 2;
-
-    return 0;
+  void release_image()
+  {
+    if (!image) return;
+    bitm.valid = false;
+    bitm.data = 0;
+    upload_bitmap = &bitm;
+    vsx_image_loader::get_instance()->release(image);
+    image = 0x0;
   }
 
 public:
@@ -664,9 +642,6 @@ public:
   vsx_bitmap bitm;
   int bitm_timestamp; // keep track of the timestamp for the bitmap internally
   int               thread_state;
-  bool              thread_working;
-  pthread_t         worker_t;
-  pthread_attr_t    worker_t_attr;
   int texture_timestamp;
 
   void module_info(vsx_module_info* info)
@@ -687,6 +662,8 @@ public:
       "filename_rgb:resource,"
       "filename_alpha:resource"
     ;
+    if (m_type == 1)
+      info->in_param_spec += ",compression:enum?none|auto|dxt1|dxt5";
 
     info->out_param_spec =
       "texture:texture,"
@@ -727,6 +704,12 @@ public:
 
     bitmap_out->set_p(bitm);
     thread_state = 0;
+    image = 0x0;
+    compression = 0x0;
+    if (m_type == 1)
+      compression = (vsx_module_param_int*)in_parameters.create(VSX_MODULE_PARAM_ID_INT, "compression");
+    current_compression = VSX_IMAGE_COMPRESSION_OFF;
+    upload_bitmap = &bitm;
     texture_out = (vsx_module_param_texture*)out_parameters.create(VSX_MODULE_PARAM_ID_TEXTURE,"texture");
 
     texture = new vsx_texture;
@@ -736,20 +719,14 @@ public:
 
   void run()
   {
-    if (current_filename != filename_in->get())
+    int want_compression = texture_compression(compression);
+    if (current_filename != filename_in->get() || want_compression != current_compression)
     {
       if (thread_state == -1)
       {
         message = "module||ok";
       }
 
-      // time to decode a new jpg
-      if (thread_state == 1)
-      {
-        long* aa;
-        pthread_join(worker_t, (void **)&aa);
-      }
-
       if (!verify_filesuffix(filename_in->get(),"jpg"))
       {
         filename_in->set(current_filename);
@@ -758,22 +735,43 @@ public:
       }
       message = "module||ok";
 
+      // time to decode a new jpg
+      release_image();
       current_filename = filename_in->get();
       current_alpha_filename = filename_alpha_in->get();
+      current_compression = want_compression;
 
-      pthread_attr_init(&worker_t_attr);
       thread_state = 1;
-      pthread_create(&(worker_t), &(worker_t_attr), &jpeg_worker_v, (void*)this);
+      image = vsx_image_loader::get_instance()->request(engine->filesystem, current_filename, VSX_IMAGE_JPEG_ALPHA, current_alpha_filename, false, current_compression);
     }
-    if (thread_state == 2)
+    if (thread_state == 1 && image->state != VSX_IMAGE_STATE_LOADING)
     {
-      bitm.bpp = 4;
-      bitm.bformat = GL_RGBA;
-      bitm.valid = true;
-      ++bitm.timestamp;
-      thread_state = 3;
+      if (image->state == VSX_IMAGE_STATE_DONE && vsx_dxt_is_compressed(&image->bitmap))
+      {
+        // texture only, the bitmap output stays empty
+        upload_bitmap = &image->bitmap;
+        ++bitm.timestamp;
+        thread_state = 3;
+      }
+      else
+      if (image->state == VSX_IMAGE_STATE_DONE)
+      {
+        bitm.bpp = 4;
+        bitm.bformat = GL_RGBA;
+        bitm.size_x = image->bitmap.size_x;
+        bitm.size_y = image->bitmap.size_y;
+        bitm.data = image->bitmap.data;
+        bitm.valid = true;
+        ++bitm.timestamp;
+        thread_state = 3;
+        bitmap_out->set_p(bitm);
+      }
+      else
+      {
+        thread_state = -1;
+        message = "module||"+image->error+"\n"+current_filename;
+      }
       loading_done = true;
-      bitmap_out->set_p(bitm);
     }
   }
 
@@ -781,9 +779,9 @@ public:
   {
     if (param == (vsx_module_param_abs*)texture_out)
     {
-      if (texture_timestamp != bitm.timestamp && bitm.valid)
+      if (texture_timestamp != bitm.timestamp && upload_bitmap->valid)
       {
-        texture->upload_ram_bitmap(&bitm,true);
+        texture->upload_ram_bitmap(upload_bitmap,true);
         texture->valid = true;
         texture_out->set(texture);
         texture_timestamp = bitm.timestamp;
@@ -793,12 +791,7 @@ public:
 
   void on_delete()
   {
-    if (thread_state == 1)
-    pthread_join(worker_t, 0);
-    if (bitm.valid)
-    {
-      delete[] (vsx_bitmap_32bt*)bitm.data;
-    }
+    release_image();
   }
 };
 
@@ -0,0 +1,150 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include "vsx_gl_global.h"
+#include "vsx_math_3d.h"
+#include "vsx_param.h"
+#include "vsx_module.h"
+#include <pthread.h>
+#include <math.h>
+#include "texgen_tiles.h"
+#include "blend.h"
+#include "vsx_test.h"
+
+// bitmap.texgen's blend kernels against the Blend_* macros they replace.
+// All 25 modes, every pair of bytes through the tables, then blend_bytes
+// (SSE2 modes, table modes, the scalar tail) over random rows at several
+// opacities against Blend_Opacity byte for byte. Also built with
+// VSX_MATH_3D_NO_SIMD (bitmap_texgen_blend_test_scalar).
+
+static const char* blend_names[BLEND_TYPES] =
+{
+  "normal", "lighten", "darken", "multiply", "average", "add", "subtract",
+  "difference", "negation", "screen", "exclusion", "overlay", "soft_light",
+  "hard_light", "color_dodge", "color_burn", "linear_dodge", "linear_burn",
+  "linear_light", "vivid_light", "pin_light", "hard_mix", "reflect", "glow",
+  "phoenix"
+};
+
+// what the module did per byte before: Blend_Opacity around the macro
+static unsigned char reference(int type, int A, int B, float O)
+{
+#define BLEND_REFERENCE(BLT) return Blend_Opacity(A,B,BLT,O);
+  switch (type)
+  {
+    case BLEND_NORMAL       : BLEND_REFERENCE(Blend_Normal)
+    case BLEND_LIGHTEN      : BLEND_REFERENCE(Blend_Lighten)
+    case BLEND_DARKEN       : BLEND_REFERENCE(Blend_Darken)
+    case BLEND_MULTIPLY     : BLEND_REFERENCE(Blend_Multiply)
+    case BLEND_AVERAGE      : BLEND_REFERENCE(Blend_Average)
+    case BLEND_ADD          : BLEND_REFERENCE(Blend_Add)
+    case BLEND_SUBTRACT     : BLEND_REFERENCE(Blend_Subtract)
+    case BLEND_DIFFERENCE   : BLEND_REFERENCE(Blend_Difference)
+    case BLEND_NEGATION     : BLEND_REFERENCE(Blend_Negation)
+    case BLEND_SCREEN       : BLEND_REFERENCE(Blend_Screen)
+    case BLEND_EXCLUSION    : BLEND_REFERENCE(Blend_Exclusion)
+    case BLEND_OVERLAY      : BLEND_REFERENCE(Blend_Overlay)
+    case BLEND_SOFT_LIGHT   : BLEND_REFERENCE(Blend_Soft_Light)
+    case BLEND_HARD_LIGHT   : BLEND_REFERENCE(Blend_Hard_Light)
+    case BLEND_COLOR_DODGE  : BLEND_REFERENCE(Blend_Color_Dodge)
+    case BLEND_COLOR_BURN   : BLEND_REFERENCE(Blend_Color_Burn)
+    case BLEND_LINEAR_DODGE : BLEND_REFERENCE(Blend_Linear_Dodge)
+    case BLEND_LINEAR_BURN  : BLEND_REFERENCE(Blend_Linear_Burn)
+    case BLEND_LINEAR_LIGHT : BLEND_REFERENCE(Blend_Linear_Light)
+    case BLEND_VIVID_LIGHT  : BLEND_REFERENCE(Blend_Vivid_Light)
+    case BLEND_PIN_LIGHT    : BLEND_REFERENCE(Blend_Pin_Light)
+    case BLEND_HARD_MIX     : BLEND_REFERENCE(Blend_Hard_Mix)
+    case BLEND_REFLECT      : BLEND_REFERENCE(Blend_Reflect)
+    case BLEND_GLOW         : BLEND_REFERENCE(Blend_Glow)
+    case BLEND_PHOENIX      : BLEND_REFERENCE(Blend_Phoenix)
+  }
+#undef BLEND_REFERENCE
+  return 0;
+}
+
+// a 512 pixel rgba row plus some, so the scalar tail runs as well
+#define ROW (512 * 4 + 7)
+#define OPACITIES 5
+
+int main()
+{
+  const float opacities[OPACITIES] = {1.0f, 0.0f, 0.5f, 0.25f, 0.73f};
+  vsx_test_random r(1);
+  unsigned char top[ROW], base[ROW], got[ROW], expected[ROW];
+  // every pair of values shows up in some row
+  for (int i = 0; i < ROW; i++)
+  {
+    top[i] = (unsigned char)(r.next() & 255);
+    base[i] = (unsigned char)(r.next() & 255);
+  }
+
+  double total_kernel = 0.0, total_reference = 0.0;
+  for (int type = 0; type < BLEND_TYPES; type++)
+  {
+    const unsigned char* table = blend_get_table(type);
+    int mismatches = 0;
+    for (int A = 0; A < 256; A++)
+      for (int B = 0; B < 256; B++)
+        if (table[A << 8 | B] != reference(type, A, B, 1.0f))
+          mismatches++;
+
+    for (int o = 0; o < OPACITIES; o++)
+      for (int pass = 0; pass < 256; pass++)
+      {
+        // walk all of top's values across each base
+        for (int i = 0; i < ROW; i++)
+        {
+          got[i] = base[i];
+          expected[i] = reference(type, (unsigned char)(top[i] + pass), base[i], opacities[o]);
+        }
+        unsigned char shifted[ROW];
+        for (int i = 0; i < ROW; i++)
+          shifted[i] = (unsigned char)(top[i] + pass);
+        blend_bytes(type, table, shifted, got, ROW, opacities[o]);
+        if (memcmp(got, expected, ROW))
+          for (int i = 0; i < ROW; i++)
+            mismatches += got[i] != expected[i];
+      }
+    if (mismatches)
+      printf("%s: %d mismatching bytes\n", blend_names[type], mismatches);
+    VSX_TEST_CHECK(mismatches == 0);
+
+    double t_kernel, t_reference;
+    VSX_TEST_TIME(t_kernel, 2000,
+      memcpy(got, base, ROW);
+      blend_bytes(type, table, top, got, ROW, 0.73f)
+    );
+    VSX_TEST_TIME(t_reference, 2000,
+      for (int i = 0; i < ROW; i++)
+        got[i] = reference(type, top[i], base[i], 0.73f)
+    );
+    total_kernel += t_kernel;
+    total_reference += t_reference;
+    printf("%-13s %6.2f us per row, macros %6.2f us (%.1fx)\n",
+      blend_names[type], t_kernel * 1e6, t_reference * 1e6, t_reference / t_kernel);
+  }
+  printf("all modes     %6.2f us per row, macros %6.2f us (%.1fx)\n",
+    total_kernel * 1e6, total_reference * 1e6, total_reference / total_kernel);
+  return vsx_test_result();
+}
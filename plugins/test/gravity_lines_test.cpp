@@ -0,0 +1,243 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vsx_math_3d.h"
+#include "vsx_param.h"
+#include "vsx_module.h"
+#include "vsx_thread_pool.h"
+#include "gravity_lines/gravity_lines.h"
+#include "gravity_lines/gravity_strip.h"
+#include "vsx_test.h"
+
+// render.gravity_lines: a 40 line set and 58 ribbon strips run for 400
+// frames of varying length, stepped with update() per object and with
+// begin_update() / integrate() over all of them / end_update() as the
+// ribbon modules do. After every frame the trails of both are compared
+// bit for bit with the Mass based code they replaced. Also built with
+// VSX_MATH_3D_NO_SIMD (gravity_lines_test_scalar), so the SSE and the
+// scalar integrate() both match it.
+
+#define STRIPS 58
+#define FRAMES 400
+
+// the removed Mass class and gravity_lines::update(), cut down
+class reference_lines
+{
+  struct mass_state
+  {
+    float friction;
+    float mass;
+    vsx_vector position, speed, center;
+
+    void update(float timeDiff)
+    {
+      speed.x += (center.x - position.x) / mass * timeDiff;
+      speed.y += (center.y - position.y) / mass * timeDiff;
+      speed.z += (center.z - position.z) / mass * timeDiff;
+      speed.x *= 1.0f - (friction * timeDiff);
+      speed.y *= 1.0f - (friction * timeDiff);
+      speed.z *= 1.0f - (friction * timeDiff);
+      position.x += speed.x * timeDiff;
+      position.y += speed.y * timeDiff;
+      position.z += speed.z * timeDiff;
+    }
+  };
+
+public:
+  bool first;
+  int num_lines;
+  float curr_time, last_step_time, step_freq;
+  float friction;
+  unsigned long offs;
+  std::vector<mass_state> masses;
+  std::vector<vsx_vector*> oldPos;
+
+  // same masses as an initialized gravity_lines
+  reference_lines(const gravity_lines& g)
+  {
+    first = true;
+    num_lines = g.num_lines;
+    curr_time = 0.0f;
+    last_step_time = 0.0f;
+    step_freq = g.step_freq;
+    friction = 1.0f;
+    offs = 0;
+    for (size_t i = 0; i < g.mass.size(); i++)
+    {
+      mass_state m;
+      m.friction = 1.5f;
+      m.mass = g.mass[i];
+      masses.push_back(m);
+    }
+  }
+
+  ~reference_lines()
+  {
+    for (size_t i = 0; i < oldPos.size(); i++)
+      delete[] oldPos[i];
+  }
+
+  void update(float delta_time, float x, float y, float z)
+  {
+    if (delta_time > 0.16667f) delta_time = 0.16667f;
+    while (oldPos.size() != (unsigned long)num_lines)
+      oldPos.push_back(new vsx_vector[BUFF_LEN]);
+    curr_time += (float)fabs(delta_time);
+    int num_steps = (int)((curr_time - last_step_time) * step_freq);
+    if (first)
+      num_steps = BUFF_LEN;
+    last_step_time += num_steps / step_freq;
+    for (int j = 0; j < num_steps; j++)
+    {
+      for (int i = 0; i < num_lines; i++)
+      {
+        masses[i].friction = friction * 0.07f;
+        masses[i].center = vsx_vector(x, y, z);
+        masses[i].update(0.08f);
+        oldPos[i][offs] = masses[i].position;
+      }
+      offs = (offs + 1) % BUFF_LEN;
+    }
+    if (first)
+    {
+      offs = 0;
+      first = false;
+    }
+  }
+};
+
+// one set of objects, the line set first
+struct scene
+{
+  gravity_lines* objects[STRIPS + 1];
+
+  scene()
+  {
+    // the same masses in every scene
+    srand(1);
+    objects[0] = new gravity_lines;
+    objects[0]->init();
+    for (int i = 0; i < STRIPS; i++)
+    {
+      gravity_strip* s = new gravity_strip;
+      s->init_strip();
+      objects[i + 1] = s;
+    }
+    for (int i = 0; i <= STRIPS; i++)
+      objects[i]->friction = 1.0f;
+  }
+
+  ~scene()
+  {
+    for (int i = 0; i <= STRIPS; i++)
+      delete objects[i];
+  }
+};
+
+// where object i is at frame f
+static vsx_vector center(int i, int f)
+{
+  float t = f * 0.05f + i * 0.3f;
+  return vsx_vector((float)sin(t) * 2.0f, (float)cos(t * 1.3f), (float)sin(t * 0.7f) * 0.5f - i * 0.01f);
+}
+
+static bool same_trails(gravity_lines* g, reference_lines* r)
+{
+  if (g->offs != r->offs || g->oldPos.size() != r->oldPos.size())
+    return false;
+  for (size_t i = 0; i < g->oldPos.size(); i++)
+    if (!vsx_test_same_bits(g->oldPos[i], r->oldPos[i], sizeof(vsx_vector) * BUFF_LEN))
+      return false;
+  return true;
+}
+
+int main()
+{
+  scene per_object;
+  scene batched;
+  reference_lines* reference[STRIPS + 1];
+  for (int i = 0; i <= STRIPS; i++)
+    reference[i] = new reference_lines(*per_object.objects[i]);
+
+  vsx_test_random r(1);
+  int mismatches_update = 0, mismatches_integrate = 0;
+  double t_update = 0.0, t_integrate = 0.0;
+  for (int f = 0; f < FRAMES; f++)
+  {
+    // mostly 60 fps with jitter, some long frames that get clamped and
+    // some short ones that step nothing
+    float dt = r.range(0.012f, 0.022f);
+    if (f % 37 == 5) dt = 0.25f;
+    if (f % 11 == 3) dt = 0.002f;
+
+    for (int i = 0; i <= STRIPS; i++)
+    {
+      vsx_vector c = center(i, f);
+      reference[i]->update(dt, c.x, c.y, c.z);
+    }
+
+    double t;
+    VSX_TEST_TIME(t, 1,
+      for (int i = 0; i <= STRIPS; i++)
+      {
+        vsx_vector c = center(i, f);
+        per_object.objects[i]->update(dt, c.x, c.y, c.z);
+      }
+    );
+    t_update += t;
+
+    VSX_TEST_TIME(t, 1,
+      for (int i = 0; i <= STRIPS; i++)
+      {
+        vsx_vector c = center(i, f);
+        batched.objects[i]->begin_update(dt, c.x, c.y, c.z);
+      }
+      gravity_lines::integrate(batched.objects, STRIPS + 1);
+      for (int i = 0; i <= STRIPS; i++)
+        batched.objects[i]->end_update()
+    );
+    t_integrate += t;
+
+    for (int i = 0; i <= STRIPS; i++)
+    {
+      mismatches_update += !same_trails(per_object.objects[i], reference[i]);
+      mismatches_integrate += !same_trails(batched.objects[i], reference[i]);
+    }
+  }
+  if (mismatches_update || mismatches_integrate)
+    printf("mismatching trails (object x frame): update() %d, integrate() %d\n", mismatches_update, mismatches_integrate);
+  VSX_TEST_CHECK(mismatches_update == 0);
+  VSX_TEST_CHECK(mismatches_integrate == 0);
+  // the trails did move
+  VSX_TEST_CHECK(per_object.objects[0]->oldPos[0][0].x != per_object.objects[0]->oldPos[0][BUFF_LEN / 2].x);
+
+  printf("%d frames: update() per object %.2f ms, integrate() %.2f ms\n",
+    FRAMES, t_update * 1e3, t_integrate * 1e3);
+
+  for (int i = 0; i <= STRIPS; i++)
+    delete reference[i];
+  return vsx_test_result();
+}
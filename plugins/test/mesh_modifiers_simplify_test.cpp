@@ -0,0 +1,273 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+#include "mesh_simplify.h"
+#include "vsx_test.h"
+
+// mesh.modifiers' quadric simplification on closed and open meshes: the
+// result must have valid indices, no degenerate faces, no unused vertices,
+// matching attribute streams and no more faces than asked for.
+
+#define PI_F 3.14159265f
+
+static void add_face(vsx_mesh_data* m, unsigned int a, unsigned int b, unsigned int c)
+{
+  vsx_face f;
+  f.a = a;
+  f.b = b;
+  f.c = c;
+  m->faces.push_back(f);
+}
+
+static void add_vertex(vsx_mesh_data* m, const vsx_vector& p, const vsx_vector& n, float u, float v)
+{
+  m->vertices.push_back(p);
+  m->vertex_normals.push_back(n);
+  vsx_tex_coord t;
+  t.s = u;
+  t.t = v;
+  m->vertex_tex_coords.push_back(t);
+}
+
+// closed, one vertex per pole, the seam shares its vertices
+static void make_sphere(vsx_mesh_data* m, int rings, int segments)
+{
+  add_vertex(m, vsx_vector(0, 1, 0), vsx_vector(0, 1, 0), 0.5f, 0.0f);
+  for (int r = 1; r < rings; r++)
+  {
+    float lat = PI_F * (float)r / (float)rings;
+    for (int s = 0; s < segments; s++)
+    {
+      float lon = 2.0f * PI_F * (float)s / (float)segments;
+      vsx_vector p(sinf(lat) * cosf(lon), cosf(lat), sinf(lat) * sinf(lon));
+      add_vertex(m, p, p, (float)s / (float)segments, (float)r / (float)rings);
+    }
+  }
+  add_vertex(m, vsx_vector(0, -1, 0), vsx_vector(0, -1, 0), 0.5f, 1.0f);
+  unsigned int bottom = (unsigned int)m->vertices.size() - 1;
+  for (int s = 0; s < segments; s++)
+  {
+    unsigned int s1 = (unsigned int)((s + 1) % segments);
+    add_face(m, 0, 1 + s1, 1 + s);
+    for (int r = 0; r < rings - 2; r++)
+    {
+      unsigned int a = 1 + r * segments + s;
+      unsigned int b = 1 + r * segments + s1;
+      unsigned int c = 1 + (r + 1) * segments + s;
+      unsigned int d = 1 + (r + 1) * segments + s1;
+      add_face(m, a, b, d);
+      add_face(m, a, d, c);
+    }
+    unsigned int last = 1 + (rings - 2) * segments;
+    add_face(m, last + s, last + s1, bottom);
+  }
+}
+
+// closed, genus one
+static void make_torus(vsx_mesh_data* m, int rings, int segments)
+{
+  for (int r = 0; r < rings; r++)
+  {
+    float a = 2.0f * PI_F * (float)r / (float)rings;
+    for (int s = 0; s < segments; s++)
+    {
+      float b = 2.0f * PI_F * (float)s / (float)segments;
+      vsx_vector n(cosf(a) * cosf(b), sinf(b), sinf(a) * cosf(b));
+      vsx_vector p(cosf(a) * (1.0f + 0.3f * cosf(b)), 0.3f * sinf(b), sinf(a) * (1.0f + 0.3f * cosf(b)));
+      add_vertex(m, p, n, (float)r / (float)rings, (float)s / (float)segments);
+    }
+  }
+  for (int r = 0; r < rings; r++)
+    for (int s = 0; s < segments; s++)
+    {
+      unsigned int a = r * segments + s;
+      unsigned int b = r * segments + (s + 1) % segments;
+      unsigned int c = ((r + 1) % rings) * segments + s;
+      unsigned int d = ((r + 1) % rings) * segments + (s + 1) % segments;
+      add_face(m, a, c, d);
+      add_face(m, a, d, b);
+    }
+}
+
+// open, a bumpy height field; the border stays put
+static void make_grid(vsx_mesh_data* m, int n)
+{
+  for (int y = 0; y <= n; y++)
+    for (int x = 0; x <= n; x++)
+    {
+      float u = (float)x / (float)n;
+      float v = (float)y / (float)n;
+      vsx_vector p(u, 0.05f * sinf(u * 7.0f) * cosf(v * 5.0f), v);
+      add_vertex(m, p, vsx_vector(0, 1, 0), u, v);
+    }
+  for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++)
+    {
+      unsigned int a = y * (n + 1) + x;
+      add_face(m, a, a + n + 1, a + n + 2);
+      add_face(m, a, a + n + 2, a + 1);
+    }
+}
+
+// everything a consumer of the result relies on
+static bool valid(vsx_mesh_data* m)
+{
+  size_t vc = m->vertices.size();
+  if (m->vertex_normals.size() != vc || m->vertex_tex_coords.size() != vc)
+    return false;
+  vsx_array<unsigned char> used;
+  unsigned char* u = used.resize(vc);
+  if (vc)
+    memset(u, 0, vc);
+  for (size_t i = 0; i < m->faces.size(); i++)
+  {
+    const vsx_face& f = m->faces[i];
+    if (f.a >= vc || f.b >= vc || f.c >= vc)
+      return false;
+    if (f.a == f.b || f.b == f.c || f.c == f.a)
+      return false;
+    vsx_vector e1 = m->vertices[f.b] - m->vertices[f.a];
+    vsx_vector e2 = m->vertices[f.c] - m->vertices[f.a];
+    vsx_vector n;
+    n.cross(e1, e2);
+    if (!(n.length() > 0.0f))
+      return false;
+    u[f.a] = u[f.b] = u[f.c] = 1;
+  }
+  for (size_t i = 0; i < vc; i++)
+    if (!u[i])
+      return false;
+  return true;
+}
+
+static void check_targets(vsx_mesh_data* src, bool closed)
+{
+  VSX_TEST_CHECK(valid(src));
+  size_t faces = src->faces.size();
+  float ratios[5] = {1.0f, 0.5f, 0.25f, 0.1f, 0.02f};
+  for (int r = 0; r < 5; r++)
+  {
+    size_t target = (size_t)((float)faces * ratios[r]);
+    mesh_simplify simplify;
+    vsx_mesh_data dest;
+    size_t reached = simplify.run(src, &dest, target, 0.0f);
+    VSX_TEST_CHECK(reached == dest.faces.size());
+    VSX_TEST_CHECK(valid(&dest));
+    if (ratios[r] == 1.0f)
+    {
+      VSX_TEST_CHECK(reached == faces);
+      VSX_TEST_CHECK(dest.vertices.size() == src->vertices.size());
+    }
+    // open meshes keep their border, so they can't go all the way down
+    if (closed || ratios[r] >= 0.25f)
+      VSX_TEST_CHECK(reached <= target);
+    VSX_TEST_CHECK(reached <= faces);
+  }
+}
+
+static void test_closed()
+{
+  vsx_mesh_data sphere;
+  make_sphere(&sphere, 24, 32);
+  check_targets(&sphere, true);
+
+  vsx_mesh_data torus;
+  make_torus(&torus, 40, 16);
+  check_targets(&torus, true);
+}
+
+static void test_open()
+{
+  vsx_mesh_data grid;
+  make_grid(&grid, 30);
+  check_targets(&grid, false);
+
+  // the border survives: the corners are still there
+  mesh_simplify simplify;
+  vsx_mesh_data dest;
+  simplify.run(&grid, &dest, grid.faces.size() / 4, 0.0f);
+  int corners = 0;
+  for (size_t i = 0; i < dest.vertices.size(); i++)
+  {
+    const vsx_vector& p = dest.vertices[i];
+    if ((p.x == 0.0f || p.x == 1.0f) && (p.z == 0.0f || p.z == 1.0f))
+      corners++;
+  }
+  VSX_TEST_CHECK(corners == 4);
+}
+
+// broken input faces are dropped, not passed on
+static void test_broken_input()
+{
+  vsx_mesh_data sphere;
+  make_sphere(&sphere, 12, 16);
+  size_t faces = sphere.faces.size();
+  unsigned int vc = (unsigned int)sphere.vertices.size();
+  add_face(&sphere, 0, 1, vc);
+  add_face(&sphere, 5, 5, 6);
+  add_face(&sphere, 7, 8, 7);
+  add_face(&sphere, 0xFFFFFFFF, 2, 3);
+
+  mesh_simplify simplify;
+  vsx_mesh_data dest;
+  size_t reached = simplify.run(&sphere, &dest, faces, 0.0f);
+  VSX_TEST_CHECK(reached == faces);
+  VSX_TEST_CHECK(valid(&dest));
+
+  reached = simplify.run(&sphere, &dest, faces / 3, 0.0f);
+  VSX_TEST_CHECK(reached <= faces / 3);
+  VSX_TEST_CHECK(valid(&dest));
+
+  // nothing usable at all
+  vsx_mesh_data empty;
+  reached = simplify.run(&empty, &dest, 10, 0.0f);
+  VSX_TEST_CHECK(reached == 0);
+  VSX_TEST_CHECK(dest.vertices.size() == 0);
+}
+
+// the error limit stops early, never below the target
+static void test_max_error()
+{
+  vsx_mesh_data sphere;
+  make_sphere(&sphere, 24, 32);
+  size_t faces = sphere.faces.size();
+  mesh_simplify simplify;
+  vsx_mesh_data loose, tight;
+  size_t reached_loose = simplify.run(&sphere, &loose, faces / 20, 0.0f);
+  size_t reached_tight = simplify.run(&sphere, &tight, faces / 20, 0.001f);
+  VSX_TEST_CHECK(valid(&tight));
+  VSX_TEST_CHECK(reached_tight > reached_loose);
+  VSX_TEST_CHECK(reached_tight <= faces);
+}
+
+int main()
+{
+  test_closed();
+  test_open();
+  test_broken_input();
+  test_max_error();
+  return vsx_test_result();
+}
@@ -0,0 +1,228 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "face_zsort.h"
+#include "vsx_array.h"
+#include "vsx_test.h"
+
+// render.mesh's face_zsort against std::sort, both the radix path and the
+// frame coherent insertion sort, plus timings for each.
+
+static const float* ref_depth;
+
+// the order face_zsort uses: -0 before +0, equal keys keep face order
+static bool ref_less(unsigned int a, unsigned int b)
+{
+  float da = ref_depth[a], db = ref_depth[b];
+  if (da < db)
+    return true;
+  if (da == db)
+    return signbit(da) && !signbit(db);
+  return false;
+}
+
+static void reference_sort(const float* depth, size_t count, vsx_array<unsigned int>& out)
+{
+  unsigned int* o = out.resize(count);
+  for (size_t i = 0; i < count; i++)
+    o[i] = (unsigned int)i;
+  ref_depth = depth;
+  std::stable_sort(o, o + count, ref_less);
+}
+
+// a permutation of [0, count), in depth order
+static bool is_sorted_order(const float* depth, const unsigned int* o, size_t count)
+{
+  vsx_array<unsigned char> seen;
+  unsigned char* s = seen.resize(count);
+  memset(s, 0, count);
+  ref_depth = depth;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (o[i] >= count || s[o[i]])
+      return false;
+    s[o[i]] = 1;
+    if (i && ref_less(o[i], o[i - 1]))
+      return false;
+  }
+  return true;
+}
+
+// the radix path is stable, so it has to give exactly std::stable_sort's ids
+static bool same_as_reference(const float* depth, const unsigned int* o, size_t count)
+{
+  vsx_array<unsigned int> expected;
+  reference_sort(depth, count, expected);
+  return vsx_test_same_bits(o, expected.get_pointer(), count * sizeof(unsigned int));
+}
+
+static void test_keys()
+{
+  face_zsort z;
+  vsx_test_random r(1);
+  vsx_array<float> depth;
+  const size_t count = 5000;
+  float* d = depth.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    switch (i % 5)
+    {
+      case 0: d[i] = r.range(-1000.0f, 1000.0f); break;
+      case 1: d[i] = -r.range(0.0f, 1e-30f); break;
+      case 2: d[i] = (float)(r.next() % 8) - 4.0f; break; // lots of equal keys
+      case 3: d[i] = (r.next() & 1) ? 0.0f : -0.0f; break;
+      default: d[i] = r.range(-1e20f, 1e20f);
+    }
+  }
+  const unsigned int* o = z.sort(d, count, false);
+  VSX_TEST_CHECK(!z.was_incremental());
+  VSX_TEST_CHECK(same_as_reference(d, o, count));
+
+  // all the same, every radix pass gets skipped
+  for (size_t i = 0; i < count; i++)
+    d[i] = 2.5f;
+  o = z.sort(d, count, false);
+  VSX_TEST_CHECK(same_as_reference(d, o, count));
+
+  // one face
+  d[0] = -3.0f;
+  o = z.sort(d, 1, true);
+  VSX_TEST_CHECK(o[0] == 0);
+
+  // none
+  VSX_TEST_CHECK(z.sort(d, 0, false) == 0);
+}
+
+static void test_count_changes()
+{
+  face_zsort z;
+  vsx_test_random r(2);
+  vsx_array<float> depth;
+  size_t counts[] = {100, 3000, 17, 3000, 2999, 1, 4096};
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+  {
+    size_t count = counts[c];
+    float* d = depth.resize(count);
+    for (size_t i = 0; i < count; i++)
+      d[i] = r.range(-50.0f, 50.0f);
+    // coherent, but a different count can't reuse the last order
+    const unsigned int* o = z.sort(d, count, true);
+    if (c && counts[c - 1] != count)
+      VSX_TEST_CHECK(!z.was_incremental());
+    VSX_TEST_CHECK(is_sorted_order(d, o, count));
+    if (!z.was_incremental())
+      VSX_TEST_CHECK(same_as_reference(d, o, count));
+  }
+}
+
+static void test_coherent()
+{
+  face_zsort z;
+  vsx_test_random r(3);
+  vsx_array<float> depth;
+  const size_t count = 10000;
+  float* d = depth.resize(count);
+  for (size_t i = 0; i < count; i++)
+    d[i] = r.range(0.0f, 100.0f);
+  z.sort(d, count, true);
+  VSX_TEST_CHECK(!z.was_incremental());
+
+  // a small camera move: a few neighbours swap places
+  for (int frame = 0; frame < 20; frame++)
+  {
+    for (size_t i = 0; i < count; i++)
+      d[i] += r.range(-0.005f, 0.005f);
+    const unsigned int* o = z.sort(d, count, true);
+    VSX_TEST_CHECK(z.was_incremental());
+    VSX_TEST_CHECK(is_sorted_order(d, o, count));
+  }
+
+  // without the hint it's always the radix sort
+  const unsigned int* o = z.sort(d, count, false);
+  VSX_TEST_CHECK(!z.was_incremental());
+  VSX_TEST_CHECK(same_as_reference(d, o, count));
+
+  // turned around: far more than FACE_ZSORT_MAX_MOVES per face, so the
+  // insertion sort gives up half way and the radix sort starts over
+  for (size_t i = 0; i < count; i++)
+    d[i] = 100.0f - d[i];
+  o = z.sort(d, count, true);
+  VSX_TEST_CHECK(!z.was_incremental());
+  VSX_TEST_CHECK(same_as_reference(d, o, count));
+
+  // the next small move is incremental again
+  for (size_t i = 0; i < count; i++)
+    d[i] += r.range(-0.005f, 0.005f);
+  o = z.sort(d, count, true);
+  VSX_TEST_CHECK(z.was_incremental());
+  VSX_TEST_CHECK(is_sorted_order(d, o, count));
+}
+
+static void benchmark()
+{
+  const size_t count = 100000;
+  face_zsort z;
+  vsx_test_random r(4);
+  vsx_array<float> depth[2];
+  vsx_array<unsigned int> ids;
+  float* d0 = depth[0].resize(count);
+  float* d1 = depth[1].resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    d0[i] = r.range(0.0f, 100.0f);
+    d1[i] = d0[i] + r.range(-0.001f, 0.001f);
+  }
+
+  double t_std, t_radix, t_coherent;
+  unsigned int* o = ids.resize(count);
+  ref_depth = d0;
+  VSX_TEST_TIME(t_std, 20,
+    for (size_t i = 0; i < count; i++)
+      o[i] = (unsigned int)i;
+    std::sort(o, o + count, ref_less)
+  );
+  VSX_TEST_TIME(t_radix, 20, z.sort(d0, count, false));
+  // two frames a small camera move apart, alternating
+  z.sort(d0, count, false);
+  bool all_incremental = true;
+  VSX_TEST_TIME(t_coherent, 20,
+    z.sort(depth[(vsx_test_i + 1) & 1].get_pointer(), count, true);
+    all_incremental &= z.was_incremental()
+  );
+  VSX_TEST_CHECK(all_incremental);
+  printf("sort of %d faces: std::sort %.3f ms, radix %.3f ms, coherent %.3f ms\n",
+    (int)count, t_std * 1e3, t_radix * 1e3, t_coherent * 1e3);
+}
+
+int main()
+{
+  test_keys();
+  test_count_changes();
+  test_coherent();
+  benchmark();
+  return vsx_test_result();
+}
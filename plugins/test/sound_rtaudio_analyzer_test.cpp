@@ -0,0 +1,145 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+#include "vsx_math_3d.h"
+#include "fftreal/fftreal.h"
+#include "vsx_audio_analyzer.h"
+#include "vsx_test.h"
+
+// sound.rtaudio's listener analysis: the CPU time of one audio callback
+// (a 512 sample buffer, analysed every buffer) at each FFT size, window
+// and band mapping, plus checks that the kernels match plain loops and
+// that a sine lands in its band. Also built with VSX_MATH_3D_NO_SIMD
+// (sound_rtaudio_analyzer_test_scalar) to compare the timings.
+
+#define BUFFER 512
+#define CALLBACKS 2000
+
+static void test_kernels()
+{
+  vsx_test_random r(1);
+  float a[1027], b[1027], got[1027], expected[1027];
+  for (int i = 0; i < 1027; i++)
+  {
+    a[i] = r.range(-1.0f, 1.0f);
+    b[i] = r.range(-1.0f, 1.0f);
+  }
+  vsx_audio_mul(got, a, b, 1027);
+  for (int i = 0; i < 1027; i++)
+    expected[i] = a[i] * b[i];
+  VSX_TEST_CHECK(vsx_test_same_bits(got, expected, sizeof(expected)));
+
+  vsx_audio_magnitude(got, a, b, 1027, 0.5f);
+  for (int i = 0; i < 1027; i++)
+    expected[i] = sqrtf(a[i] * a[i] + b[i] * b[i]) * 0.5f;
+  VSX_TEST_CHECK(vsx_test_same_bits(got, expected, sizeof(expected)));
+
+  // the SSE sum adds in a different order
+  for (int count = 1; count < 1027; count += 13)
+  {
+    double sum = 0.0;
+    for (int i = 0; i < count; i++)
+      sum += a[i];
+    VSX_TEST_CHECK(fabs(vsx_audio_sum(a, count) - sum) < 1e-4);
+  }
+}
+
+// a sine on bin k ends up in the band that holds bin k
+static void test_sine()
+{
+  for (int n = 256; n <= VSX_AUDIO_MAX_FFT_SIZE; n *= 2)
+  {
+    vsx_audio_analyzer analyzer;
+    analyzer.configure(n, VSX_AUDIO_HOP_EVERY_BUFFER, VSX_AUDIO_WINDOW_HANN, VSX_AUDIO_BANDS_LINEAR);
+    int k = n / 8 + 1;
+    float buffer[BUFFER];
+    for (int c = 0; c < VSX_AUDIO_MAX_FFT_SIZE / BUFFER; c++)
+    {
+      for (int i = 0; i < BUFFER; i++)
+        buffer[i] = (float)sin(2.0 * PI * k * (c * BUFFER + i) / n);
+      analyzer.process(buffer, BUFFER, 1.0f);
+    }
+    int peak = 0;
+    for (int b = 1; b < VSX_AUDIO_SPECTRUM_BANDS; b++)
+      if (analyzer.spectrum[b] > analyzer.spectrum[peak])
+        peak = b;
+    int bins = n / 2;
+    int first_bin = peak * bins / VSX_AUDIO_SPECTRUM_BANDS;
+    int last_bin = ((peak + 1) * bins - 1) / VSX_AUDIO_SPECTRUM_BANDS;
+    if (k < first_bin || k > last_bin)
+      printf("fft size %d: sine on bin %d peaks in band %d (bins %d-%d)\n", n, k, peak, first_bin, last_bin);
+    VSX_TEST_CHECK(k >= first_bin && k <= last_bin);
+    VSX_TEST_CHECK(analyzer.vu > 0.0f);
+
+    // and silence is silent
+    for (int i = 0; i < BUFFER; i++)
+      buffer[i] = 0.0f;
+    for (int c = 0; c < VSX_AUDIO_MAX_FFT_SIZE / BUFFER; c++)
+      analyzer.process(buffer, BUFFER, 1.0f);
+    float loudest = 0.0f;
+    for (int b = 0; b < VSX_AUDIO_SPECTRUM_BANDS; b++)
+      if (analyzer.spectrum[b] > loudest)
+        loudest = analyzer.spectrum[b];
+    VSX_TEST_CHECK(loudest == 0.0f && analyzer.vu == 0.0f);
+  }
+}
+
+// the window is a table once configured, so hamming and blackman cost
+// what hann does
+static void benchmark_callbacks()
+{
+  vsx_test_random r(2);
+  float buffer[8][BUFFER];
+  for (int c = 0; c < 8; c++)
+    for (int i = 0; i < BUFFER; i++)
+      buffer[c][i] = r.range(-1.0f, 1.0f);
+
+  printf("us per %d sample callback, analysed every callback\n", BUFFER);
+  printf("fft size  window  linear     log     mel\n");
+  for (int n = 256; n <= VSX_AUDIO_MAX_FFT_SIZE; n *= 2)
+    for (int w = VSX_AUDIO_WINDOW_NONE; w <= VSX_AUDIO_WINDOW_HANN; w++)
+    {
+      printf("%8d  %-6s", n, w == VSX_AUDIO_WINDOW_NONE ? "none" : "hann");
+      for (int m = VSX_AUDIO_BANDS_LINEAR; m <= VSX_AUDIO_BANDS_MEL; m++)
+      {
+        vsx_audio_analyzer analyzer;
+        analyzer.configure(n, VSX_AUDIO_HOP_EVERY_BUFFER, w, m);
+        analyzer.process(buffer[0], BUFFER, 1.0f);
+        double t;
+        VSX_TEST_TIME(t, CALLBACKS, analyzer.process(buffer[vsx_test_i & 7], BUFFER, 1.0f));
+        printf("  %6.2f", t * 1e6);
+      }
+      printf("\n");
+    }
+}
+
+int main()
+{
+  test_kernels();
+  test_sine();
+  benchmark_callbacks();
+  return vsx_test_result();
+}
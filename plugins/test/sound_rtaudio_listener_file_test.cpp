@@ -0,0 +1,401 @@
+/**
+* Project: VSXu Engine: Realtime modular visual programming engine.
+*
+* This file is part of Vovoid VSXu Engine.
+*
+* @author Jonatan Wallmander, Robert Wenzel, Vovoid Media Technologies AB Copyright (C) 2003-2013
+* @see The GNU Lesser General Public License (LGPL)
+*
+* VSXu Engine is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "vsx_param.h"
+#include "vsx_module.h"
+#include "vsx_listener_file.h"
+#include "vsx_test.h"
+
+// sound.rtaudio's file listener: tests/audio/two_tones.wav played in
+// frame_locked mode with a fixed frame time must give the same wave and
+// octaves every run, with each tone in its own octave. Also feeds the WAV
+// reader broken copies of the file: truncated data, unsupported formats
+// and malformed headers.
+//
+// two_tones.wav is 44.1 kHz mono 16 bit, 8820 samples of 1033.6 Hz
+// followed by 8820 samples of 7493.6 Hz at half amplitude. Both are exact
+// bins of a 512 point FFT (12 and 87), so with the default analysis
+// (512 points, every buffer, no window, linear bands) they land in
+// octave 0 and octave 3.
+
+#define TONE_SAMPLES 8820
+#define FILE_SAMPLES (TONE_SAMPLES * 2)
+#define DTIME (1.0f / 60.0f)
+#define FRAMES 40
+
+static const char* wav_path = VSX_TEST_AUDIO_DIR "two_tones.wav";
+static const char* tmp_path = "sound_rtaudio_listener_file_test.tmp";
+
+static unsigned char wav[44 + FILE_SAMPLES * 2];
+static float samples[FILE_SAMPLES];
+
+static bool load_wav()
+{
+  FILE* fp = fopen(wav_path, "rb");
+  if (!fp)
+    return false;
+  size_t got = fread(wav, 1, sizeof(wav), fp);
+  bool at_end = fgetc(fp) == EOF;
+  fclose(fp);
+  if (got != sizeof(wav) || !at_end || memcmp(&wav[36], "data", 4) != 0)
+    return false;
+  // the reader's own conversion, so the comparisons can be exact
+  for (int i = 0; i < FILE_SAMPLES; i++)
+    samples[i] = (float)(short)(wav[44 + i * 2] | (wav[45 + i * 2] << 8)) * (1.0f / 32768.0f);
+  return true;
+}
+
+static void put_u16(unsigned char* p, int v)
+{
+  p[0] = (unsigned char)(v & 0xff);
+  p[1] = (unsigned char)((v >> 8) & 0xff);
+}
+
+static void put_u32(unsigned char* p, unsigned long v)
+{
+  put_u16(p, (int)(v & 0xffff));
+  put_u16(p + 2, (int)((v >> 16) & 0xffff));
+}
+
+static void write_tmp(const unsigned char* data, size_t size)
+{
+  FILE* fp = fopen(tmp_path, "wb");
+  fwrite(data, 1, size, fp);
+  fclose(fp);
+}
+
+//******************************************************************************
+// the module
+
+static vsx_module_param_abs* find_param(vsx_module_param_list& list, const char* name)
+{
+  for (size_t i = 0; i < list.id_vec.size(); i++)
+    if (list.id_vec[i]->name == name)
+      return list.id_vec[i];
+  return 0;
+}
+
+static float get_float(vsx_module_param_list& list, const char* name)
+{
+  return ((vsx_module_param_float*)find_param(list, name))->get();
+}
+
+static const float* get_wave(vsx_module_param_list& list)
+{
+  vsx_float_array* a = ((vsx_module_param_float_array*)find_param(list, "wave"))->get_addr();
+  return a->data->get_pointer();
+}
+
+struct listener_run
+{
+  vsxf filesystem;
+  vsx_module_engine_info engine;
+  vsx_module_param_list in;
+  vsx_module_param_list out;
+  vsx_listener_file listener;
+
+  listener_run(const char* filename)
+  {
+    engine.filesystem = &filesystem;
+    engine.real_dtime = DTIME;
+    listener.engine = &engine;
+    listener.declare_params(in, out);
+    listener.init();
+    // the engine gives inputs the module didn't set their type's default
+    ((vsx_module_param_int*)find_param(in, "hop_size"))->set(VSX_AUDIO_HOP_EVERY_BUFFER);
+    ((vsx_module_param_int*)find_param(in, "window"))->set(VSX_AUDIO_WINDOW_NONE);
+    ((vsx_module_param_int*)find_param(in, "band_mapping"))->set(VSX_AUDIO_BANDS_LINEAR);
+    ((vsx_module_param_resource*)find_param(in, "filename"))->set(filename);
+    ((vsx_module_param_int*)find_param(in, "playback"))->set(VSX_LISTENER_FILE_FRAME_LOCKED);
+    ((vsx_module_param_int*)find_param(in, "loop"))->set(0);
+  }
+
+  ~listener_run()
+  {
+    listener.on_delete();
+  }
+};
+
+// per frame: the last block analysed, -1 before the first one
+static void expected_blocks(int* last_block)
+{
+  // the same accumulation as the module
+  double samples_due = 0.0;
+  int blocks = 0;
+  for (int f = 0; f < FRAMES; f++)
+  {
+    samples_due += (double)DTIME * (double)VSX_WAV_READER_RATE;
+    while (samples_due >= 512.0)
+    {
+      blocks++;
+      samples_due -= 512.0;
+    }
+    last_block[f] = blocks - 1;
+  }
+}
+
+static void test_frame_locked(float* octaves_out, float* wave_out)
+{
+  int last_block[FRAMES];
+  expected_blocks(last_block);
+
+  listener_run r(wav_path);
+  for (int f = 0; f < FRAMES; f++)
+  {
+    r.listener.run();
+    VSX_TEST_CHECK(r.listener.message == "module||ok");
+
+    float octaves[8];
+    char name[16];
+    for (int o = 0; o < 8; o++)
+    {
+      sprintf(name, "octaves_l_%d", o);
+      octaves[o] = get_float(r.out, name);
+      sprintf(name, "octaves_r_%d", o);
+      VSX_TEST_CHECK(get_float(r.out, name) == octaves[o]);
+    }
+    const float* wave = get_wave(r.out);
+    float vu = get_float(r.out, "vu_l");
+    VSX_TEST_CHECK(get_float(r.out, "vu_r") == vu);
+
+    // the wave is the last block read, silence past the end of the file
+    int b = last_block[f];
+    float expected[512];
+    for (int i = 0; i < 512; i++)
+    {
+      int s = b * 512 + i;
+      expected[i] = (b >= 0 && s < FILE_SAMPLES) ? samples[s] : 0.0f;
+    }
+    VSX_TEST_CHECK(vsx_test_same_bits(wave, expected, sizeof(expected)));
+
+    int loudest = 0;
+    float others = 0.0f;
+    for (int o = 1; o < 8; o++)
+      if (octaves[o] > octaves[loudest])
+        loudest = o;
+    for (int o = 0; o < 8; o++)
+      if (o != loudest && octaves[o] > others)
+        others = octaves[o];
+
+    if (b >= 0 && (b + 1) * 512 <= TONE_SAMPLES)
+    {
+      VSX_TEST_CHECK(loudest == 0);
+      VSX_TEST_CHECK(octaves[0] > others * 10.0f);
+    }
+    if (b * 512 >= TONE_SAMPLES && (b + 1) * 512 <= FILE_SAMPLES)
+    {
+      VSX_TEST_CHECK(loudest == 3);
+      VSX_TEST_CHECK(octaves[3] > others * 10.0f);
+    }
+    if (b < 0 || b * 512 >= FILE_SAMPLES)
+    {
+      VSX_TEST_CHECK(vu == 0.0f);
+      VSX_TEST_CHECK(octaves[loudest] == 0.0f);
+    }
+
+    memcpy(&octaves_out[f * 8], octaves, sizeof(octaves));
+    memcpy(&wave_out[f * 512], wave, sizeof(float) * 512);
+  }
+  // the run has to get past the end of the file to check the silence
+  VSX_TEST_CHECK(last_block[FRAMES - 1] * 512 >= FILE_SAMPLES);
+}
+
+static void test_repeatable()
+{
+  static float octaves[2][FRAMES * 8];
+  static float wave[2][FRAMES * 512];
+  test_frame_locked(octaves[0], wave[0]);
+  test_frame_locked(octaves[1], wave[1]);
+  VSX_TEST_CHECK(vsx_test_same_bits(octaves[0], octaves[1], sizeof(octaves[0])));
+  VSX_TEST_CHECK(vsx_test_same_bits(wave[0], wave[1], sizeof(wave[0])));
+}
+
+// a file the reader refuses leaves the outputs silent
+static void test_module_error()
+{
+  write_tmp(wav, 30);
+  listener_run r(tmp_path);
+  for (int f = 0; f < 4; f++)
+  {
+    r.listener.run();
+    VSX_TEST_CHECK(r.listener.message == vsx_string("module||error loading ") + tmp_path);
+    VSX_TEST_CHECK(get_float(r.out, "vu_l") == 0.0f);
+    VSX_TEST_CHECK(get_float(r.out, "octaves_l_0") == 0.0f);
+    const float* wave = get_wave(r.out);
+    for (int i = 0; i < 512; i++)
+      VSX_TEST_CHECK(wave[i] == 0.0f);
+  }
+}
+
+//******************************************************************************
+// the reader
+
+static bool reader_opens(const unsigned char* data, size_t size)
+{
+  write_tmp(data, size);
+  vsxf filesystem;
+  vsx_wav_reader reader;
+  return reader.open(&filesystem, tmp_path);
+}
+
+static void test_malformed()
+{
+  static unsigned char broken[sizeof(wav) + 16];
+
+  // cut inside the RIFF header and inside the fmt chunk
+  VSX_TEST_CHECK(!reader_opens(wav, 0));
+  VSX_TEST_CHECK(!reader_opens(wav, 10));
+  VSX_TEST_CHECK(!reader_opens(wav, 20));
+  VSX_TEST_CHECK(!reader_opens(wav, 30));
+  // fmt but no data chunk
+  VSX_TEST_CHECK(!reader_opens(wav, 36));
+
+  // the untouched file
+  VSX_TEST_CHECK(reader_opens(wav, sizeof(wav)));
+
+  // ADPCM, mu-law and an extensible header with an ADPCM sub format
+  int tags[3] = {2, 7, 0xFFFE};
+  for (int t = 0; t < 3; t++)
+  {
+    memcpy(broken, wav, sizeof(wav));
+    put_u16(&broken[20], tags[t]);
+    if (tags[t] == 0xFFFE)
+    {
+      // 40 byte fmt chunk, shift the rest up
+      put_u32(&broken[16], 40);
+      memset(&broken[36], 0, 24);
+      put_u16(&broken[36], 22);
+      put_u16(&broken[44], 2);
+      memcpy(&broken[60], &wav[36], sizeof(wav) - 36);
+      VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav) + 24));
+      // the same header with a PCM sub format is fine
+      put_u16(&broken[44], 1);
+      VSX_TEST_CHECK(reader_opens(broken, sizeof(wav) + 24));
+      continue;
+    }
+    VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+  }
+
+  // PCM bit depths that don't exist, float of the wrong size
+  int bad_bits[4] = {0, 4, 12, 20};
+  for (int i = 0; i < 4; i++)
+  {
+    memcpy(broken, wav, sizeof(wav));
+    put_u16(&broken[34], bad_bits[i]);
+    VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+  }
+  memcpy(broken, wav, sizeof(wav));
+  put_u16(&broken[20], 3);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+
+  // no channels, too many channels, no sample rate
+  memcpy(broken, wav, sizeof(wav));
+  put_u16(&broken[22], 0);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+  put_u16(&broken[22], VSX_WAV_READER_MAX_CHANNELS + 1);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+  memcpy(broken, wav, sizeof(wav));
+  put_u32(&broken[24], 0);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+
+  // fmt chunk smaller than the fields it must have
+  memcpy(broken, wav, sizeof(wav));
+  put_u32(&broken[16], 8);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+
+  // data before fmt
+  memcpy(broken, wav, 12);
+  memcpy(&broken[12], &wav[36], sizeof(wav) - 36);
+  memcpy(&broken[12 + sizeof(wav) - 36], &wav[12], 24);
+  VSX_TEST_CHECK(!reader_opens(broken, sizeof(wav)));
+
+  // an odd sized chunk the reader doesn't know is skipped with its pad byte
+  memcpy(broken, wav, 36);
+  memcpy(&broken[36], "junk", 4);
+  put_u32(&broken[40], 3);
+  memset(&broken[44], 0xAA, 4);
+  memcpy(&broken[48], &wav[36], sizeof(wav) - 36);
+  write_tmp(broken, sizeof(wav) + 12);
+  vsxf filesystem;
+  vsx_wav_reader reader;
+  VSX_TEST_CHECK(reader.open(&filesystem, tmp_path));
+  static float left[FILE_SAMPLES], right[FILE_SAMPLES];
+  reader.loop = false;
+  reader.read(left, right, FILE_SAMPLES);
+  VSX_TEST_CHECK(vsx_test_same_bits(left, samples, sizeof(samples)));
+  VSX_TEST_CHECK(vsx_test_same_bits(right, samples, sizeof(samples)));
+  reader.close();
+}
+
+// data shorter than its chunk says: the samples that are there, then
+// silence, no matter where the file stops
+static void test_short_read()
+{
+  static float left[FILE_SAMPLES + 512], right[FILE_SAMPLES + 512];
+  // whole samples, the middle of a sample, the middle of a read block
+  size_t cuts[4] = {1, 1001, 2000, 3 * VSX_WAV_READER_BLOCK + 7};
+  for (int c = 0; c < 4; c++)
+  {
+    size_t bytes = cuts[c];
+    write_tmp(wav, 44 + bytes);
+    vsxf filesystem;
+    vsx_wav_reader reader;
+    reader.loop = false;
+    VSX_TEST_CHECK(reader.open(&filesystem, tmp_path));
+    reader.read(left, right, FILE_SAMPLES + 512);
+    size_t whole = bytes / 2;
+    VSX_TEST_CHECK(vsx_test_same_bits(left, samples, sizeof(float) * whole));
+    bool silent = true;
+    for (size_t i = whole; i < FILE_SAMPLES + 512; i++)
+      silent = silent && left[i] == 0.0f && right[i] == 0.0f;
+    VSX_TEST_CHECK(silent);
+    VSX_TEST_CHECK(reader.finished);
+  }
+
+  // looping a truncated file starts over after what is there
+  write_tmp(wav, 44 + 2000);
+  vsxf filesystem;
+  vsx_wav_reader reader;
+  reader.loop = true;
+  VSX_TEST_CHECK(reader.open(&filesystem, tmp_path));
+  reader.read(left, right, 3000);
+  VSX_TEST_CHECK(vsx_test_same_bits(left, samples, sizeof(float) * 1000));
+  VSX_TEST_CHECK(vsx_test_same_bits(&left[1000], samples, sizeof(float) * 1000));
+  VSX_TEST_CHECK(vsx_test_same_bits(&left[2000], samples, sizeof(float) * 1000));
+  VSX_TEST_CHECK(!reader.finished);
+}
+
+int main()
+{
+  VSX_TEST_CHECK(load_wav());
+  test_repeatable();
+  test_module_error();
+  test_malformed();
+  test_short_read();
+  remove(tmp_path);
+  return vsx_test_result();
+}
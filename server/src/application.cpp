@@ -174,6 +174,8 @@ public:
 	    
       if (vxe) {
         vxe->process_message_queue(&internal_cmd_in,&internal_cmd_out);
+        // send this frame's replies to the clients in one go
+        cl_server.flush();
         vxe->render();
 
         glMatrixMode(GL_PROJECTION);